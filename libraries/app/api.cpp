@@ -17,46 +17,148 @@
  */
 #include <graphene/app/api.hpp>
 #include <graphene/app/application.hpp>
+#include <graphene/app/read_replica.hpp>
+#include <graphene/app/subscription_hub.hpp>
 #include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/database.hpp>
 #include <graphene/utilities/key_conversion.hpp>
+#include <graphene/time/time.hpp>
 #include <graphene/chain/operation_history_object.hpp>
 
 #include <fc/crypto/hex.hpp>
 
 namespace graphene { namespace app {
 
-    database_api::database_api(graphene::chain::database& db):_db(db)
+    namespace {
+       template<typename T> struct is_callback : std::false_type {};
+       template<typename Signature> struct is_callback<std::function<Signature>> : std::true_type {};
+
+       template<typename... Args> struct has_callback : std::false_type {};
+       template<typename Arg, typename... Args>
+       struct has_callback<Arg, Args...>
+          : std::integral_constant<bool, is_callback<typename std::decay<Arg>::type>::value || has_callback<Args...>::value> {};
+
+       template<typename R>
+       R call_with_variants( const fc::variants& params, size_t pos, const std::function<R()>& f )
+       {
+          FC_ASSERT( pos == params.size(), "Too many parameters", ("expected",pos)("given",params.size()) );
+          return f();
+       }
+
+       /// Converts the parameters of f in order, one at a time, then calls it
+       template<typename R, typename Arg, typename... Args>
+       R call_with_variants( const fc::variants& params, size_t pos, const std::function<R(Arg, Args...)>& f )
+       {
+          FC_ASSERT( pos < params.size(), "Too few parameters", ("given",params.size()) );
+          auto arg = params[pos].as<typename std::decay<Arg>::type>();
+          return call_with_variants( params, pos + 1, std::function<R(Args...)>( [&f,&arg]( Args... args ) {
+             return f( arg, std::forward<Args>(args)... );
+          }));
+       }
+
+       typedef std::function<fc::variant(const fc::variants&)> variant_method;
+
+       template<typename R, typename... Args>
+       variant_method make_variant_method( const std::function<R(Args...)>& f, std::false_type )
+       {
+          return [f]( const fc::variants& params ) { return fc::variant( call_with_variants( params, 0, f ) ); };
+       }
+
+       template<typename... Args>
+       variant_method make_variant_method( const std::function<void(Args...)>& f, std::true_type )
+       {
+          return [f]( const fc::variants& params ) { call_with_variants( params, 0, f ); return fc::variant(); };
+       }
+
+       /// Collects the methods of an fc::api which take no callback
+       struct batch_method_visitor
+       {
+          batch_method_visitor( map<string, variant_method>& methods ):methods(methods){}
+
+          template<typename R, typename... Args>
+          void operator()( const char* name, std::function<R(Args...)>& method )const
+          {
+             add( name, method, has_callback<Args...>() );
+          }
+
+          template<typename R, typename... Args>
+          void add( const char* name, const std::function<R(Args...)>& method, std::false_type )const
+          {
+             methods[name] = make_variant_method( method, std::is_void<R>() );
+          }
+
+          template<typename R, typename... Args>
+          void add( const char*, const std::function<R(Args...)>&, std::true_type )const {}
+
+          map<string, variant_method>& methods;
+       };
+    }
+
+    database_api::database_api(graphene::chain::database& db, std::shared_ptr<subscription_hub> hub,
+                               std::shared_ptr<read_replica> replica)
+    :_hub(hub ? hub : std::make_shared<subscription_hub>(std::ref(db))),
+     _subscriber(_hub->add_subscriber()),
+     _replica(replica),
+     _db(db)
     {
-       _change_connection = _db.changed_objects.connect([this](const vector<object_id_type>& ids) {
-                                    on_objects_changed(ids);
-                                    });
-       _applied_block_connection = _db.applied_block.connect([this](const signed_block&){ on_applied_block(); });
+    }
+
+    template<typename Query>
+    auto database_api::read( Query&& query )const -> decltype( query( std::declval<const graphene::chain::database&>() ) )
+    {
+       if( _replica )
+          return _replica->read( std::forward<Query>(query) );
+       return query( static_cast<const graphene::chain::database&>(_db) );
     }
 
     fc::variants database_api::get_objects(const vector<object_id_type>& ids)const
     {
-       fc::variants result;
-       result.reserve(ids.size());
+       fc::variants result = read([&](const database& db) {
+          fc::variants result;
+          result.reserve(ids.size());
 
-       std::transform(ids.begin(), ids.end(), std::back_inserter(result),
-                      [this](object_id_type id) -> fc::variant {
-          if(auto obj = _db.find_object(id))
-             return obj->to_variant();
-          return {};
+          std::transform(ids.begin(), ids.end(), std::back_inserter(result),
+                         [this,&db](object_id_type id) -> fc::variant {
+             if(_replica && !_replica->is_copied(id))
+                return {};
+             if(auto obj = db.find_object(id))
+                return obj->to_variant();
+             return {};
+          });
+
+          return result;
        });
 
+       // The indexes added by plugins are not in the replica, so their objects are read from the database itself,
+       // unless this is a call of a batch, running on a worker thread
+       if( _replica && !_replica->is_worker_thread() )
+          for( size_t i = 0; i < ids.size(); ++i )
+             if( !_replica->is_copied(ids[i]) )
+                if( auto obj = _db.find_object(ids[i]) )
+                   result[i] = obj->to_variant();
        return result;
     }
 
     optional<block_header> database_api::get_block_header(uint32_t block_num) const
     {
-       auto result = _db.fetch_block_by_number(block_num);
+       auto result = _db.fetch_block_header_by_number(block_num);
        if(result)
           return *result;
        return {};
     }
 
+    vector<block_header_summary> database_api::get_block_headers(uint32_t first_block_num, uint32_t limit)const
+    {
+       FC_ASSERT( limit <= 1000 );
+       return _db.fetch_block_header_summaries(first_block_num, limit);
+    }
+
+    optional<fc::sha256> database_api::get_state_hash(uint32_t block_num)const
+    {
+       FC_ASSERT( _db.state_hash_enabled(), "This node does not hash its state" );
+       return _db.get_state_hash_at(block_num);
+    }
+
     optional<signed_block> database_api::get_block(uint32_t block_num)const
     {
        return _db.fetch_block_by_number(block_num);
@@ -64,111 +166,217 @@ namespace graphene { namespace app {
 
     vector<optional<account_object>> database_api::lookup_account_names(const vector<string>& account_names)const
     {
-       const auto& accounts_by_name = _db.get_index_type<account_index>().indices().get<by_name>();
-       vector<optional<account_object> > result;
-       result.reserve(account_names.size());
-       std::transform(account_names.begin(), account_names.end(), std::back_inserter(result),
-                      [&accounts_by_name](const string& name) -> optional<account_object> {
-          auto itr = accounts_by_name.find(name);
-          return itr == accounts_by_name.end()? optional<account_object>() : *itr;
+       return read([&](const database& db) {
+          const auto& accounts_by_name = db.get_index_type<account_index>().indices().get<by_name>();
+          vector<optional<account_object> > result;
+          result.reserve(account_names.size());
+          std::transform(account_names.begin(), account_names.end(), std::back_inserter(result),
+                         [&accounts_by_name](const string& name) -> optional<account_object> {
+             auto itr = accounts_by_name.find(name);
+             return itr == accounts_by_name.end()? optional<account_object>() : *itr;
+          });
+          return result;
+       });
+    }
+
+    vector<optional<account_id_type>> database_api::lookup_account_ids(const vector<string>& account_names)const
+    {
+       FC_ASSERT( account_names.size() <= 1000 );
+       return read([&](const database& db) {
+          const auto& accounts_by_name = db.get_index_type<account_index>().indices().get<by_name>();
+          vector<optional<account_id_type>> result;
+          result.reserve(account_names.size());
+          for( const string& name : account_names )
+          {
+             auto itr = accounts_by_name.find(name);
+             result.push_back(itr == accounts_by_name.end() ? optional<account_id_type>() : itr->get_id());
+          }
+          return result;
+       });
+    }
+
+    vector<optional<asset_id_type>> database_api::lookup_asset_ids(const vector<string>& symbols)const
+    {
+       FC_ASSERT( symbols.size() <= 1000 );
+       return read([&](const database& db) {
+          const auto& assets_by_symbol = db.get_index_type<asset_index>().indices().get<by_exact_symbol>();
+          vector<optional<asset_id_type>> result;
+          result.reserve(symbols.size());
+          for( const string& symbol : symbols )
+          {
+             auto itr = assets_by_symbol.find(symbol);
+             result.push_back(itr == assets_by_symbol.end() ? optional<asset_id_type>() : itr->get_id());
+          }
+          return result;
        });
-       return result;
     }
 
     vector<optional<asset_object>> database_api::lookup_asset_symbols(const vector<string>& symbols)const
     {
-       const auto& assets_by_symbol = _db.get_index_type<asset_index>().indices().get<by_symbol>();
-       vector<optional<asset_object> > result;
-       result.reserve(symbols.size());
-       std::transform(symbols.begin(), symbols.end(), std::back_inserter(result),
-                      [&assets_by_symbol](const string& symbol) -> optional<asset_object> {
-          auto itr = assets_by_symbol.find(symbol);
-          return itr == assets_by_symbol.end()? optional<asset_object>() : *itr;
+       return read([&](const database& db) {
+          const auto& assets_by_symbol = db.get_index_type<asset_index>().indices().get<by_exact_symbol>();
+          vector<optional<asset_object> > result;
+          result.reserve(symbols.size());
+          std::transform(symbols.begin(), symbols.end(), std::back_inserter(result),
+                         [&assets_by_symbol](const string& symbol) -> optional<asset_object> {
+             auto itr = assets_by_symbol.find(symbol);
+             return itr == assets_by_symbol.end()? optional<asset_object>() : *itr;
+          });
+          return result;
        });
-       return result;
     }
 
     global_property_object database_api::get_global_properties()const
     {
-       return _db.get(global_property_id_type());
+       return read([](const database& db) { return db.get(global_property_id_type()); });
     }
 
     dynamic_global_property_object database_api::get_dynamic_global_properties()const
     {
-       return _db.get(dynamic_global_property_id_type());
+       return read([](const database& db) { return db.get(dynamic_global_property_id_type()); });
     }
 
     vector<optional<key_object>> database_api::get_keys(const vector<key_id_type>& key_ids)const
     {
-       vector<optional<key_object>> result; result.reserve(key_ids.size());
-       std::transform(key_ids.begin(), key_ids.end(), std::back_inserter(result),
-                      [this](key_id_type id) -> optional<key_object> {
-          if(auto o = _db.find(id))
-             return *o;
-          return {};
+       return read([&](const database& db) {
+          vector<optional<key_object>> result; result.reserve(key_ids.size());
+          std::transform(key_ids.begin(), key_ids.end(), std::back_inserter(result),
+                         [&db](key_id_type id) -> optional<key_object> {
+             if(auto o = db.find(id))
+                return *o;
+             return {};
+          });
+          return result;
        });
-       return result;
     }
 
     vector<optional<account_object>> database_api::get_accounts(const vector<account_id_type>& account_ids)const
     {
-       vector<optional<account_object>> result; result.reserve(account_ids.size());
-       std::transform(account_ids.begin(), account_ids.end(), std::back_inserter(result),
-                      [this](account_id_type id) -> optional<account_object> {
-          if(auto o = _db.find(id))
-             return *o;
-          return {};
+       return read([&](const database& db) {
+          vector<optional<account_object>> result; result.reserve(account_ids.size());
+          std::transform(account_ids.begin(), account_ids.end(), std::back_inserter(result),
+                         [&db](account_id_type id) -> optional<account_object> {
+             if(auto o = db.find(id))
+                return *o;
+             return {};
+          });
+          return result;
        });
-       return result;
     }
 
     vector<optional<asset_object>> database_api::get_assets(const vector<asset_id_type>& asset_ids)const
     {
-       vector<optional<asset_object>> result; result.reserve(asset_ids.size());
-       std::transform(asset_ids.begin(), asset_ids.end(), std::back_inserter(result),
-                      [this](asset_id_type id) -> optional<asset_object> {
-          if(auto o = _db.find(id))
-             return *o;
-          return {};
+       return read([&](const database& db) {
+          vector<optional<asset_object>> result; result.reserve(asset_ids.size());
+          std::transform(asset_ids.begin(), asset_ids.end(), std::back_inserter(result),
+                         [&db](asset_id_type id) -> optional<asset_object> {
+             if(auto o = db.find(id))
+                return *o;
+             return {};
+          });
+          return result;
        });
-       return result;
     }
 
     uint64_t database_api::get_account_count()const
     {
-       return _db.get_index_type<account_index>().indices().size();
+       return read([](const database& db) -> uint64_t { return db.get_index_type<account_index>().indices().size(); });
     }
 
-    map<string,account_id_type> database_api::lookup_accounts(const string& lower_bound_name, uint32_t limit)const
+    vector<pair<string,account_id_type>> database_api::lookup_accounts(const string& lower_bound_name, uint32_t limit)const
     {
        FC_ASSERT( limit <= 1000 );
-       const auto& accounts_by_name = _db.get_index_type<account_index>().indices().get<by_name>();
-       map<string,account_id_type> result;
+       return read([&](const database& db) {
+          vector<pair<string,account_id_type>> result;
+          result.reserve(limit);
+          if( limit == 0 )
+             return result;
+          db.get_account_name_table().visit_from(lower_bound_name, [&](const char* name, size_t size, account_id_type id) {
+             result.emplace_back(string(name, size), id);
+             return result.size() < limit;
+          });
+          return result;
+       });
+    }
 
-       for( auto itr = accounts_by_name.lower_bound(lower_bound_name);
-            limit-- && itr != accounts_by_name.end();
-            ++itr )
-          result.insert(make_pair(itr->name, itr->get_id()));
+    vector<pair<string,account_id_type>> database_api::lookup_accounts_by_prefix(const string& prefix, uint32_t limit)const
+    {
+       FC_ASSERT( limit <= 1000 );
+       return read([&](const database& db) {
+          vector<pair<string,account_id_type>> result;
+          if( limit == 0 )
+             return result;
+          db.get_account_name_table().visit_from(prefix, [&](const char* name, size_t size, account_id_type id) {
+             if( size < prefix.size() || prefix.compare(0, prefix.size(), name, prefix.size()) != 0 )
+                return false;
+             result.emplace_back(string(name, size), id);
+             return result.size() < limit;
+          });
+          return result;
+       });
+    }
 
-       return result;
+    namespace {
+       vector<asset> account_balances(const database& db, account_id_type acnt, const flat_set<asset_id_type>& assets)
+       {
+          vector<asset> result;  result.reserve(assets.size());
+
+          std::transform(assets.begin(), assets.end(), std::back_inserter(result),
+                         [&db, acnt](asset_id_type id) { return db.get_balance(acnt, id); });
+
+          return result;
+       }
+
+       vector<asset> all_account_balances(const database& db, account_id_type acnt)
+       {
+          const auto& balances_by_account = db.get_index_type<account_balance_index>().indices().get<by_account>();
+          auto range = balances_by_account.equal_range(acnt);
+          vector<asset> result;
+          for( auto itr = range.first; itr != range.second; ++itr )
+             if( itr->balance != 0 )
+                result.push_back(itr->get_balance());
+          return result;
+       }
     }
 
     vector<asset> database_api::get_account_balances(account_id_type acnt, const flat_set<asset_id_type>& assets)const
     {
-       vector<asset> result;  result.reserve(assets.size());
+       return read([&](const database& db) { return account_balances(db, acnt, assets); });
+    }
 
-       std::transform(assets.begin(), assets.end(), std::back_inserter(result),
-                      [this, acnt](asset_id_type id) { return _db.get_balance(acnt, id); });
+    vector<asset> database_api::get_named_account_balances(const std::string& name, const flat_set<asset_id_type>& assets) const
+    {
+       return read([&](const database& db) {
+          const auto& accounts_by_name = db.get_index_type<account_index>().indices().get<by_name>();
+          auto itr = accounts_by_name.find(name);
+          FC_ASSERT( itr != accounts_by_name.end() );
+          return account_balances(db, itr->get_id(), assets);
+       });
+    }
 
-       return result;
+    vector<asset> database_api::get_all_account_balances(account_id_type acnt)const
+    {
+       return read([&](const database& db) { return all_account_balances(db, acnt); });
     }
 
-    vector<asset> database_api::get_named_account_balances(const std::string& name, const flat_set<asset_id_type>& assets) const
+    vector<vector<asset>> database_api::get_balances_for_accounts(const vector<account_id_type>& ids)const
+    {
+       return read([&](const database& db) {
+          vector<vector<asset>> result;  result.reserve(ids.size());
+          for( auto id : ids )
+             result.push_back(all_account_balances(db, id));
+          return result;
+       });
+    }
+
+    vector<vesting_balance_object> database_api::get_vesting_balances(account_id_type account_id)const
     {
-       const auto& accounts_by_name = _db.get_index_type<account_index>().indices().get<by_name>();
-       auto itr = accounts_by_name.find(name);
-       FC_ASSERT( itr != accounts_by_name.end() );
-       return get_account_balances(itr->get_id(), assets);
+       return read([&](const database& db) {
+          const auto& by_owner = db.get_index_type<vesting_balance_index>().indices().get<by_account>();
+          auto itr = by_owner.lower_bound(account_id);
+          auto end = by_owner.upper_bound(account_id);
+          return vector<vesting_balance_object>(itr, end);
+       });
     }
 
     /**
@@ -176,77 +384,111 @@ namespace graphene { namespace app {
      */
     vector<limit_order_object> database_api::get_limit_orders(asset_id_type a, asset_id_type b, uint32_t limit)const
     {
-       const auto& limit_order_idx = _db.get_index_type<limit_order_index>();
-       const auto& limit_price_idx = limit_order_idx.indices().get<by_price>();
+       return read([&](const database& db) {
+          const auto& limit_order_idx = db.get_index_type<limit_order_index>();
+          const auto& limit_price_idx = limit_order_idx.indices().get<by_price>();
 
-       vector<limit_order_object> result;
+          vector<limit_order_object> result;
 
-       uint32_t count = 0;
-       auto limit_itr = limit_price_idx.lower_bound(price::max(a,b));
-       auto limit_end = limit_price_idx.upper_bound(price::min(a,b));
-       while(limit_itr != limit_end && count < limit)
-       {
-          result.push_back(*limit_itr);
-          ++limit_itr;
-          ++count;
-       }
-       count = 0;
-       limit_itr = limit_price_idx.lower_bound(price::max(b,a));
-       limit_end = limit_price_idx.upper_bound(price::min(b,a));
-       while(limit_itr != limit_end && count < limit)
-       {
-          result.push_back(*limit_itr);
-          ++limit_itr;
-          ++count;
-       }
+          uint32_t count = 0;
+          auto limit_itr = limit_price_idx.lower_bound(price::max(a,b));
+          auto limit_end = limit_price_idx.upper_bound(price::min(a,b));
+          while(limit_itr != limit_end && count < limit)
+          {
+             result.push_back(*limit_itr);
+             ++limit_itr;
+             ++count;
+          }
+          count = 0;
+          limit_itr = limit_price_idx.lower_bound(price::max(b,a));
+          limit_end = limit_price_idx.upper_bound(price::min(b,a));
+          while(limit_itr != limit_end && count < limit)
+          {
+             result.push_back(*limit_itr);
+             ++limit_itr;
+             ++count;
+          }
 
-       return result;
+          return result;
+       });
+    }
+
+    order_book database_api::get_order_book(asset_id_type base, asset_id_type quote, uint32_t depth)const
+    {
+       return read([&](const database& db) { return subscription_hub::get_order_book( db, base, quote, depth ); });
     }
 
     vector<short_order_object> database_api::get_short_orders(asset_id_type a, uint32_t limit)const
     {
-      const auto& short_order_idx = _db.get_index_type<short_order_index>();
-      const auto& sell_price_idx = short_order_idx.indices().get<by_price>();
-      const asset_object& mia = _db.get(a);
+      return read([&](const database& db) {
+        const auto& short_order_idx = db.get_index_type<short_order_index>();
+        const auto& sell_price_idx = short_order_idx.indices().get<by_price>();
+        const asset_object& mia = db.get(a);
 
-      price index_price = price::min(mia.get_id(), mia.bitasset_data(_db).options.short_backing_asset);
+        price index_price = price::min(mia.get_id(), mia.bitasset_data(db).options.short_backing_asset);
 
-      auto short_itr = sell_price_idx.lower_bound(index_price.max());
-      auto short_end = sell_price_idx.upper_bound(index_price.min());
+        auto short_itr = sell_price_idx.lower_bound(index_price.max());
+        auto short_end = sell_price_idx.upper_bound(index_price.min());
 
-      return vector<short_order_object>(short_itr, short_end);
+        return vector<short_order_object>(short_itr, short_end);
+      });
+    }
+
+    vector<bond_offer_object> database_api::get_bond_offers(asset_id_type a, uint32_t limit)const
+    {
+       FC_ASSERT( limit <= 100 );
+       return read([&](const database& db) {
+          const auto& offer_idx = db.get_index_type<bond_offer_index>().indices().get<by_best_rate>();
+
+          vector<bond_offer_object> result;
+          for( bool offer_to_borrow : { false, true } )
+          {
+             auto itr = offer_idx.lower_bound( boost::make_tuple( a, offer_to_borrow ) );
+             auto end = offer_idx.upper_bound( boost::make_tuple( a, offer_to_borrow ) );
+             for( uint32_t count = 0; itr != end && count < limit; ++itr, ++count )
+                result.push_back( *itr );
+          }
+          return result;
+       });
     }
 
     vector<call_order_object> database_api::get_call_orders(asset_id_type a, uint32_t limit)const
     {
-       const auto& call_index = _db.get_index_type<call_order_index>().indices().get<by_price>();
-       const asset_object& mia = _db.get(a);
-       price index_price = price::min(mia.bitasset_data(_db).options.short_backing_asset, mia.get_id());
+       return read([&](const database& db) {
+          const auto& call_index = db.get_index_type<call_order_index>().indices().get<by_price>();
+          const asset_object& mia = db.get(a);
+          price index_price = price::min(mia.bitasset_data(db).options.short_backing_asset, mia.get_id());
 
-       return vector<call_order_object>(call_index.lower_bound(index_price.min()),
-                                        call_index.lower_bound(index_price.max()));
+          return vector<call_order_object>(call_index.lower_bound(index_price.min()),
+                                           call_index.lower_bound(index_price.max()));
+       });
     }
 
     vector<force_settlement_object> database_api::get_settle_orders(asset_id_type a, uint32_t limit)const
     {
-       const auto& settle_index = _db.get_index_type<force_settlement_index>().indices().get<by_expiration>();
-       const asset_object& mia = _db.get(a);
-       return vector<force_settlement_object>(settle_index.lower_bound(mia.get_id()),
-                                              settle_index.upper_bound(mia.get_id()));
+       return read([&](const database& db) {
+          const auto& settle_index = db.get_index_type<force_settlement_index>().indices().get<by_expiration>();
+          const asset_object& mia = db.get(a);
+          return vector<force_settlement_object>(settle_index.lower_bound(mia.get_id()),
+                                                 settle_index.upper_bound(mia.get_id()));
+       });
     }
 
     vector<asset_object> database_api::list_assets(const string& lower_bound_symbol, uint32_t limit)const
     {
        FC_ASSERT( limit <= 100 );
-       const auto& assets_by_symbol = _db.get_index_type<asset_index>().indices().get<by_symbol>();
-       vector<asset_object> result;
-       result.reserve(limit);
+       return read([&](const database& db) {
+          const auto& assets_by_symbol = db.get_index_type<asset_index>().indices().get<by_symbol>();
+          vector<asset_object> result;
+          result.reserve(limit);
 
-       auto itr = assets_by_symbol.lower_bound(lower_bound_symbol);
-       while(limit-- && itr != assets_by_symbol.end())
-          result.emplace_back(*itr++);
+          uint32_t remaining = limit;
+          auto itr = assets_by_symbol.lower_bound(lower_bound_symbol);
+          while(remaining-- && itr != assets_by_symbol.end())
+             result.emplace_back(*itr++);
 
-       return result;
+          return result;
+       });
     }
 
     login_api::login_api(application& a)
@@ -259,7 +501,7 @@ namespace graphene { namespace app {
 
     bool login_api::login(const string& user, const string& password)
     {
-       auto db_api = std::make_shared<database_api>(std::ref(*_app.chain_database()));
+       auto db_api = std::make_shared<database_api>(std::ref(*_app.chain_database()), _app.subscriptions(), _app.replica());
        auto net_api = std::make_shared<network_api>(std::ref(_app));
        auto hist_api = std::make_shared<history_api>(_app);
        _database_api = db_api;
@@ -268,21 +510,93 @@ namespace graphene { namespace app {
        return true;
     }
 
+    std::map<string, bool> login_api::get_plugin_readiness()const
+    {
+       return _app.get_plugin_readiness();
+    }
+
+    namespace {
+       /// A node replicating the state of another has no p2p network
+       net::node& p2p_network(application& app)
+       {
+          net::node_ptr node = app.p2p_node();
+          FC_ASSERT( node, "This node replicates its state and is not connected to the p2p network" );
+          return *node;
+       }
+    }
+
     void network_api::add_node(const fc::ip::endpoint& ep)
     {
-       _app.p2p_node()->add_node(ep);
+       p2p_network(_app).add_node(ep);
+    }
+
+    network_api::network_api(application& a)
+    :_app(a),
+     _hub(a.subscriptions()),
+     _subscriber(_hub->add_subscriber())
+    {
+    }
+
+    network_api::~network_api()
+    {
+       _hub->remove_subscriber(_subscriber);
     }
 
     void network_api::broadcast_transaction(const signed_transaction& trx)
     {
        trx.validate();
+       net::node& node = p2p_network(_app);
        _app.chain_database()->push_transaction(trx);
-       _app.p2p_node()->broadcast_transaction(trx);
+       node.broadcast_transaction(trx);
+    }
+
+    void network_api::broadcast_transaction_with_callback(std::function<void(const variant&)> callback,
+                                                          const signed_transaction& trx)
+    {
+       const transaction_id_type trx_id = trx.id();
+       _hub->subscribe_to_transaction(_subscriber, callback, trx_id);
+       try {
+          broadcast_transaction(trx);
+       } catch( ... ) {
+          _hub->unsubscribe_from_transaction(_subscriber, trx_id);
+          throw;
+       }
     }
 
     std::vector<net::peer_status> network_api::get_connected_peers() const
     {
-      return _app.p2p_node()->get_connected_peers();
+      return p2p_network(_app).get_connected_peers();
+    }
+
+    fc::variant_object network_api::get_upload_rates() const
+    {
+      return p2p_network(_app).get_upload_rates();
+    }
+
+    std::vector<net::block_propagation_trace> network_api::get_block_propagation_traces() const
+    {
+      std::vector<net::block_propagation_trace> traces = p2p_network(_app).get_block_propagation_traces();
+      fc::optional<fc::time_point> ntp_now = graphene::time::ntp_time();
+      if( !ntp_now )
+         return traces;
+      const fc::microseconds correction = *ntp_now - fc::time_point::now();
+      auto correct = [&]( fc::time_point& t ) {
+         if( t != fc::time_point() )
+            t += correction;
+      };
+      for( net::block_propagation_trace& trace : traces )
+      {
+         correct( trace.first_seen_time );
+         correct( trace.received_time );
+         correct( trace.applied_time );
+         correct( trace.first_relayed_time );
+      }
+      return traces;
+    }
+
+    graphene::time::time_stats network_api::get_time_stats() const
+    {
+      return graphene::time::get_time_stats();
     }
 
     fc::api<network_api> login_api::network()const
@@ -303,131 +617,175 @@ namespace graphene { namespace app {
        return *_history_api;
     }
 
-    void database_api::on_objects_changed(const vector<object_id_type>& ids)
+    database_api::~database_api()
     {
-       vector<object_id_type> my_objects;
-       for(auto id : ids)
-          if(_subscriptions.find(id) != _subscriptions.end())
-             my_objects.push_back(id);
+       _hub->remove_subscriber(_subscriber);
+    }
 
-       _broadcast_changes_complete = fc::async([=](){
-          for(auto id : my_objects)
-          {
-             const object* obj = _db.find_object(id);
-             if(obj)
-             {
-                _subscriptions[id](obj->to_variant());
-             }
-          }
-       });
+    void database_api::subscribe_to_objects( const std::function<void(const fc::variant&)>&  callback, const vector<object_id_type>& ids)
+    {
+       _hub->subscribe_to_objects(_subscriber, callback, ids);
     }
 
-    /** note: this method cannot yield because it is called in the middle of
-     * apply a block.
-     */
-    void database_api::on_applied_block()
+    void database_api::unsubscribe_from_objects(const vector<object_id_type>& ids)
+    {
+       _hub->unsubscribe_from_objects(_subscriber, ids);
+    }
+
+    void database_api::subscribe_to_market(std::function<void(const variant&)> callback, asset_id_type a, asset_id_type b)
+    {
+       if(a > b) std::swap(a,b);
+       FC_ASSERT(a != b);
+       _hub->subscribe_to_market(_subscriber, callback, std::make_pair(a,b));
+    }
+
+    void database_api::unsubscribe_from_market(asset_id_type a, asset_id_type b)
+    {
+       if(a > b) std::swap(a,b);
+       FC_ASSERT(a != b);
+       _hub->unsubscribe_from_market(_subscriber, std::make_pair(a,b));
+    }
+
+    void database_api::subscribe_to_order_book(std::function<void(const variant&)> callback,
+                                               asset_id_type base, asset_id_type quote, uint32_t depth)
+    {
+       _hub->subscribe_to_order_book(_subscriber, callback, base, quote, depth);
+    }
+
+    void database_api::unsubscribe_from_order_book(asset_id_type base, asset_id_type quote)
+    {
+       _hub->unsubscribe_from_order_book(_subscriber, base, quote);
+    }
+
+    void database_api::subscribe_to_transaction(std::function<void(const variant&)> callback, transaction_id_type trx_id)
+    {
+       _hub->subscribe_to_transaction(_subscriber, callback, trx_id);
+    }
+
+    void database_api::unsubscribe_from_transaction(transaction_id_type trx_id)
+    {
+       _hub->unsubscribe_from_transaction(_subscriber, trx_id);
+    }
+
+    void database_api::cancel_all_subscriptions()
     {
-       if(_market_subscriptions.size() == 0)
-          return;
+       _hub->cancel_all_subscriptions(_subscriber);
+    }
 
-       const auto& ops = _db.get_applied_operations();
-       map< std::pair<asset_id_type,asset_id_type>, vector<pair<operation, operation_result>> > subscribed_markets_ops;
-       for(const auto& op : ops)
+    fc::variants database_api::batch(const vector<batch_call>& calls)const
+    {
+       if( _batch_methods.empty() )
        {
-          std::pair<asset_id_type,asset_id_type> market;
-          switch(op.op.which())
-          {
-             case operation::tag<limit_order_create_operation>::value:
-                market = op.op.get<limit_order_create_operation>().get_market();
-                break;
-             case operation::tag<short_order_create_operation>::value:
-                market = op.op.get<limit_order_create_operation>().get_market();
-                break;
-             case operation::tag<fill_order_operation>::value:
-                market = op.op.get<fill_order_operation>().get_market();
-                break;
-                /*
-             case operation::tag<limit_order_cancel_operation>::value:
-             case operation::tag<short_order_cancel_operation>::value:
-             */
-             default: break;
-          }
-          if(_market_subscriptions.count(market))
-             subscribed_markets_ops[market].push_back(std::make_pair(op.op, op.result));
+          fc::api<database_api>( const_cast<database_api*>(this) )->visit( batch_method_visitor( _batch_methods ) );
+          _batch_methods.erase( "batch" );
        }
-       fc::async([=](){
-          for(auto item : subscribed_markets_ops)
+       for( const auto& call : calls )
+          FC_ASSERT( _batch_methods.count( call.method ), "Method cannot be called in a batch", ("method",call.method) );
+
+       // With a replica, the calls all run within this one query, which holds the lock on the copy for them
+       return read([&](const database&) {
+          fc::variants results;
+          results.reserve( calls.size() );
+          for( size_t i = 0; i < calls.size(); ++i )
           {
-             auto itr = _market_subscriptions.find(item.first);
-             if(itr != _market_subscriptions.end())
-                itr->second(fc::variant(item.second));
+             try {
+                results.push_back( _batch_methods.at( calls[i].method )( calls[i].params ) );
+             } FC_CAPTURE_AND_RETHROW( (i)(calls[i].method) )
           }
+          return results;
        });
     }
 
-    database_api::~database_api()
+    std::string database_api::get_transaction_hex(const signed_transaction& trx)const
     {
-       try {
-          if(_broadcast_changes_complete.valid())
-          {
-             _broadcast_changes_complete.cancel();
-             _broadcast_changes_complete.wait();
-          }
-       } catch (const fc::exception& e)
-       {
-          wlog("${e}", ("e",e.to_detail_string()));
-       }
+       return fc::to_hex(fc::raw::pack(trx));
     }
 
-    void database_api::subscribe_to_objects( const std::function<void(const fc::variant&)>&  callback, const vector<object_id_type>& ids)
+    signature_cache_stats database_api::get_signature_cache_stats()const
     {
-       for(auto id : ids) _subscriptions[id] = callback;
+       return _db.get_signature_cache_stats();
     }
 
-    void database_api::unsubscribe_from_objects(const vector<object_id_type>& ids)
+    undo_stats database_api::get_undo_stats()const
     {
-       for(auto id : ids) _subscriptions.erase(id);
+       return _db.get_undo_stats();
     }
 
-    void database_api::subscribe_to_market(std::function<void(const variant&)> callback, asset_id_type a, asset_id_type b)
+    transaction_conflict_stats database_api::get_transaction_conflict_stats()const
     {
-       if(a > b) std::swap(a,b);
-       FC_ASSERT(a != b);
-       _market_subscriptions[ std::make_pair(a,b) ] = callback;
+       return _db.get_transaction_conflict_stats();
     }
 
-    void database_api::unsubscribe_from_market(asset_id_type a, asset_id_type b)
+    vector<evaluator_stats> database_api::get_evaluator_stats()const
     {
-       if(a > b) std::swap(a,b);
-       FC_ASSERT(a != b);
-       _market_subscriptions.erase(std::make_pair(a,b));
+       vector<evaluator_stats> result;
+       for( const evaluator_stats& stats : _db.get_evaluator_stats() )
+          if( stats.calls > 0 )
+             result.push_back( stats );
+       return result;
     }
 
-    std::string database_api::get_transaction_hex(const signed_transaction& trx)const
+    vector<block_timing> database_api::get_block_timings()const
     {
-       return fc::to_hex(fc::raw::pack(trx));
+       const auto& timings = _db.get_block_timings();
+       return vector<block_timing>( timings.begin(), timings.end() );
+    }
+
+    vector<index_stats> database_api::get_index_stats()const
+    {
+       return _db.get_index_stats();
     }
 
     vector<operation_history_object> history_api::get_account_history(account_id_type account, operation_history_id_type stop, int limit, operation_history_id_type start) const
     {
+       FC_ASSERT(limit >= 0 && limit <= 100);
+       auto hist = _app.get_plugin<account_history::account_history_plugin>( "account_history" );
+       FC_ASSERT( hist, "Account history plugin is not enabled" );
+       return hist->get_account_history(account, stop, limit, start);
+    }
+
+    vector<operation_history_object> history_api::get_relative_account_history(account_id_type account, uint64_t stop, int limit, uint64_t start) const
+    {
+       FC_ASSERT(limit >= 0 && limit <= 100);
+       auto hist = _app.get_plugin<account_history::account_history_plugin>( "account_history" );
+       FC_ASSERT( hist, "Account history plugin is not enabled" );
+       return hist->get_relative_account_history(account, stop, limit, start);
+    }
+
+    uint64_t history_api::get_account_history_count(account_id_type account) const
+    {
+       auto hist = _app.get_plugin<account_history::account_history_plugin>( "account_history" );
+       FC_ASSERT( hist, "Account history plugin is not enabled" );
+       return hist->get_account_history_count(account);
+    }
+
+    flat_set<uint32_t> history_api::get_market_history_buckets()const
+    {
+       auto hist = _app.get_plugin<market_history::market_history_plugin>( "market_history" );
+       FC_ASSERT( hist, "Market history plugin is not enabled" );
+       return hist->tracked_buckets();
+    }
+
+    vector<market_history::bucket_object> history_api::get_market_history( asset_id_type a, asset_id_type b, uint32_t bucket_seconds,
+                                                                           fc::time_point_sec start, fc::time_point_sec end )const
+    { try {
        FC_ASSERT(_app.chain_database());
        const auto& db = *_app.chain_database();
-       FC_ASSERT(limit <= 100);
-       vector<operation_history_object> result;
-       const auto& stats = account(db).statistics(db);
-       if(stats.most_recent_op == account_transaction_history_id_type()) return result;
-       const account_transaction_history_object* node = &stats.most_recent_op(db);
-       if(start == operation_history_id_type())
-          start = node->id;
-       while(node && node->operation_id.instance.value > stop.instance.value && result.size() < limit)
+       auto hist = _app.get_plugin<market_history::market_history_plugin>( "market_history" );
+       FC_ASSERT( hist, "Market history plugin is not enabled" );
+       FC_ASSERT( hist->tracked_buckets().count( bucket_seconds ), "Market history is not kept for this bucket size" );
+       if( b < a ) std::swap( a, b );
+
+       vector<market_history::bucket_object> result;
+       const auto& by_key_idx = db.get_index_type<market_history::bucket_index>().indices().get<market_history::by_key>();
+       auto itr = by_key_idx.lower_bound( boost::make_tuple( a, b, bucket_seconds, start ) );
+       auto end_itr = by_key_idx.upper_bound( boost::make_tuple( a, b, bucket_seconds, end ) );
+       while( itr != end_itr && result.size() < 200 )
        {
-          if(node->id.instance() <= start.instance.value)
-             result.push_back(node->operation_id(db));
-          if(node->next == account_transaction_history_id_type())
-             node = nullptr;
-          else node = db.find(node->next);
+          result.push_back( *itr );
+          ++itr;
        }
        return result;
-    }
+    } FC_CAPTURE_AND_RETHROW( (a)(b)(bucket_seconds)(start)(end) ) }
 
 } } // graphene::app
@@ -18,12 +18,27 @@
 #include <graphene/app/application.hpp>
 #include <graphene/app/plugin.hpp>
 #include <graphene/app/api.hpp>
+#include <graphene/app/binary_api_server.hpp>
+#include <graphene/app/metrics_server.hpp>
+#include <graphene/app/read_replica.hpp>
+#include <graphene/app/state_replication.hpp>
+#include <graphene/app/subscription_hub.hpp>
 
+#include <graphene/net/config.hpp>
 #include <graphene/net/core_messages.hpp>
 
+#include <graphene/chain/key_object.hpp>
+#include <graphene/chain/transaction_object.hpp>
+#include <graphene/chain/witness_object.hpp>
+
+#include <graphene/db/page_arena.hpp>
+
 #include <graphene/time/time.hpp>
 
 #include <graphene/utilities/key_conversion.hpp>
+#include <graphene/utilities/metrics.hpp>
+#include <graphene/utilities/numa.hpp>
+#include <graphene/utilities/trace_log.hpp>
 
 #include <fc/rpc/api_connection.hpp>
 #include <fc/rpc/websocket_api.hpp>
@@ -31,6 +46,11 @@
 #include <boost/filesystem/path.hpp>
 
 #include <iostream>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <set>
 
 #include <fc/log/file_appender.hpp>
 #include <fc/log/logger.hpp>
@@ -65,6 +85,15 @@ namespace detail {
          _p2p_network->load_configuration(data_dir / "p2p");
          _p2p_network->set_node_delegate(this);
 
+         if( _thread_pools.is_configured("p2p-io") )
+            _p2p_network->set_io_threads(_thread_pools.get("p2p-io"));
+         if( _options->count("p2p-numa-node") )
+         {
+            const uint32_t numa_node = _options->at("p2p-numa-node").as<uint32_t>();
+            if( !_p2p_network->bind_to_numa_node(numa_node) )
+               wlog("Could not bind the p2p threads to NUMA node ${node}", ("node", numa_node));
+         }
+
          if( _options->count("seed-node") )
          {
             auto seeds = _options->at("seed-node").as<vector<string>>();
@@ -84,6 +113,8 @@ namespace detail {
          _p2p_network->listen_to_p2p_network();
          ilog("Configured p2p node to listen on ${ip}", ("ip", _p2p_network->get_actual_listening_endpoint()));
 
+         if( _bootstrap_attestations )
+            _p2p_network->bootstrap_state_from_peers(_bootstrap_attestations);
          _p2p_network->connect_to_p2p_network();
          _p2p_network->sync_from(net::item_id(net::core_message_type_enum::block_message_type,
                                               _chain_db->head_block_id()),
@@ -100,7 +131,7 @@ namespace detail {
          _websocket_server->on_connection([&]( const fc::http::websocket_connection_ptr& c ){
             auto wsc = std::make_shared<fc::rpc::websocket_api_connection>(*c);
             auto login = std::make_shared<graphene::app::login_api>( std::ref(*_self) );
-            auto db_api = std::make_shared<graphene::app::database_api>( std::ref(*_self->chain_database()) );
+            auto db_api = std::make_shared<graphene::app::database_api>( std::ref(*_self->chain_database()), _subscriptions, _replica );
             wsc->register_api(fc::api<graphene::app::database_api>(db_api));
             wsc->register_api(fc::api<graphene::app::login_api>(login));
             c->set_session_data( wsc );
@@ -123,7 +154,7 @@ namespace detail {
          _websocket_tls_server->on_connection([&]( const fc::http::websocket_connection_ptr& c ){
             auto wsc = std::make_shared<fc::rpc::websocket_api_connection>(*c);
             auto login = std::make_shared<graphene::app::login_api>( std::ref(*_self) );
-            auto db_api = std::make_shared<graphene::app::database_api>( std::ref(*_self->chain_database()) );
+            auto db_api = std::make_shared<graphene::app::database_api>( std::ref(*_self->chain_database()), _subscriptions, _replica );
             wsc->register_api(fc::api<graphene::app::database_api>(db_api));
             wsc->register_api(fc::api<graphene::app::login_api>(login));
             c->set_session_data( wsc );
@@ -132,9 +163,48 @@ namespace detail {
          _websocket_tls_server->start_accept();
       } FC_CAPTURE_AND_RETHROW() }
 
+      void reset_binary_api_server()
+      { try {
+         if( !_options->count("rpc-binary-endpoint") )
+            return;
+
+         _binary_api_server = std::make_shared<binary_api_server>( std::ref(*_self) );
+         _binary_api_server->listen( fc::ip::endpoint::from_string(_options->at("rpc-binary-endpoint").as<string>()) );
+         ilog("Binary API listening on ${ip}", ("ip", _binary_api_server->get_local_endpoint()));
+      } FC_CAPTURE_AND_RETHROW() }
+
+      void reset_replication_server()
+      { try {
+         if( !_options->count("replication-endpoint") )
+            return;
+         // A replica applies no blocks, so it would have none to publish
+         FC_ASSERT( !_options->count("replicate-from"), "A replica cannot publish its state to other replicas" );
+
+         _replication_server = std::make_shared<state_replication_server>( std::ref(*_chain_db) );
+         _replication_server->listen( fc::ip::endpoint::from_string(_options->at("replication-endpoint").as<string>()) );
+         ilog("Publishing the state to replicas on ${ip}", ("ip", _replication_server->get_local_endpoint()));
+      } FC_CAPTURE_AND_RETHROW() }
+
+      void reset_metrics_server()
+      { try {
+         if( !_options->count("metrics-endpoint") )
+            return;
+
+         // The collector runs where the metrics are rendered, which is this thread, so it may read the database
+         _metrics_collector = utilities::metrics().add_collector( [this]() {
+            static utilities::gauge& head_block_age = utilities::metrics().get_gauge(
+               "graphene_head_block_age_seconds", "Seconds since the time of the head block" );
+            head_block_age.set( (fc::time_point::now() - _chain_db->head_block_time()).to_seconds() );
+         });
+         _metrics_server = std::make_shared<metrics_server>();
+         _metrics_server->listen( fc::ip::endpoint::from_string(_options->at("metrics-endpoint").as<string>()) );
+         ilog("Metrics served on ${ip}", ("ip", _metrics_server->get_local_endpoint()));
+      } FC_CAPTURE_AND_RETHROW() }
+
       application_impl(application* self)
          : _self(self),
-           _chain_db(std::make_shared<chain::database>())
+           _chain_db(std::make_shared<chain::database>()),
+           _subscriptions(std::make_shared<subscription_hub>(std::ref(*_chain_db)))
       {
       }
 
@@ -145,6 +215,19 @@ namespace detail {
 
       void startup()
       { try {
+         // Set first, so that the chain state loaded below is placed accordingly
+         if( _options->count("huge-pages") )
+            graphene::db::set_huge_page_mode(graphene::db::huge_page_mode_from_string(_options->at("huge-pages").as<string>()));
+         ilog("Huge pages for the object indexes: ${mode}", ("mode", graphene::db::to_string(graphene::db::get_huge_page_mode())));
+         if( _options->count("chain-numa-node") )
+         {
+            const uint32_t numa_node = _options->at("chain-numa-node").as<uint32_t>();
+            if( !utilities::bind_current_thread_to_numa_node(numa_node) )
+               wlog("Could not bind the chain thread to NUMA node ${node}", ("node", numa_node));
+         }
+         ilog("Chain thread runs on ${cpus}", ("cpus", utilities::describe_current_thread_affinity()));
+         configure_thread_pools();
+
          bool clean = !fc::exists(_data_dir / "blockchain/dblock");
          fc::create_directories(_data_dir / "blockchain/dblock");
 
@@ -158,22 +241,243 @@ namespace detail {
          if( _options->count("resync-blockchain") )
             _chain_db->wipe(_data_dir / "blockchain", true);
 
-         if( _options->count("replay-blockchain") )
+         _chain_db->set_signature_threads(_thread_pools.get("sigcheck"));
+         if( _options->count("signature-cache-size") )
+            _chain_db->set_signature_cache_size(_options->at("signature-cache-size").as<uint32_t>());
+         if( _options->count("batch-signature-verification") )
+            _chain_db->set_batch_signature_verification(_options->at("batch-signature-verification").as<bool>());
+         if( _options->count("undo-history-max-bytes") )
+            _chain_db->set_undo_history_max_bytes(_options->at("undo-history-max-bytes").as<uint64_t>());
+         if( _options->count("enable-read-views") && _options->at("enable-read-views").as<bool>() )
+            _chain_db->enable_read_views();
+         if( _options->count("track-transaction-conflicts") )
+            _chain_db->set_transaction_conflict_tracking(_options->at("track-transaction-conflicts").as<bool>());
+         if( _options->count("evaluator-sample-interval") )
+            _chain_db->set_evaluator_sample_interval(_options->at("evaluator-sample-interval").as<uint32_t>());
+         if( _options->count("block-timing-history") )
+            _chain_db->set_block_timing_history(_options->at("block-timing-history").as<uint32_t>());
+         if( _options->count("object-store-profile") || _options->count("object-store-cache-size") )
+         {
+            auto profile = graphene::db::default_profile;
+            if( _options->count("object-store-profile") )
+               profile = fc::variant( _options->at("object-store-profile").as<string>() ).as<graphene::db::level_profile>();
+            uint64_t cache_size = 0;
+            if( _options->count("object-store-cache-size") )
+               cache_size = _options->at("object-store-cache-size").as<uint64_t>();
+            _chain_db->set_store_options( profile, cache_size );
+         }
+         if( _options->count("flush-state-interval") )
+            _chain_db->set_flush_interval(_options->at("flush-state-interval").as<uint32_t>());
+         if( _options->count("checkpoint-interval") )
+            _chain_db->set_checkpoint_interval(_options->at("checkpoint-interval").as<uint32_t>());
+         if( _options->count("sync-interval-blocks") || _options->count("sync-interval-ms") )
+            _chain_db->set_sync_interval(_options->count("sync-interval-blocks") ? _options->at("sync-interval-blocks").as<uint32_t>() : 0,
+                                         _options->count("sync-interval-ms") ? _options->at("sync-interval-ms").as<uint32_t>() : 0);
+         if( _options->count("checkpoint") )
+         {
+            fc::flat_map<uint32_t,block_id_type> checkpoints;
+            for( const auto& cp : _options->at("checkpoint").as<vector<string>>() )
+               checkpoints.insert( fc::json::from_string(cp).as<std::pair<uint32_t,block_id_type>>() );
+            _chain_db->add_block_checkpoints( checkpoints );
+         }
+         if( _options->count("compress-blocks") )
+            _chain_db->set_block_compression(_options->at("compress-blocks").as<bool>());
+         if( _options->count("prune-blocks") )
+            _chain_db->set_block_pruning(_options->at("prune-blocks").as<uint32_t>());
+         if( _options->count("trusted-replay") )
+            _chain_db->set_trusted_replay(_options->at("trusted-replay").as<bool>());
+
+         const bool replicated = _options->count("replicate-from") != 0;
+         if( replicated )
+         {
+            // The state comes from the replication server, so only the genesis indexes are set up here
+            ilog("Replicating the state of ${ep} rather than applying blocks", ("ep", _options->at("replicate-from").as<string>()));
+            _chain_db->open_in_memory(initial_allocation);
+         } else if( _options->count("open-from-snapshot") )
+         {
+            _chain_db->open_from_snapshot(_options->at("open-from-snapshot").as<boost::filesystem::path>(),
+                                          _data_dir / "blockchain");
+         } else if( _options->count("replay-blockchain") )
          {
             ilog("Replaying blockchain on user request.");
             _chain_db->reindex(_data_dir/"blockchain", initial_allocation);
          } else if( clean )
             _chain_db->open(_data_dir / "blockchain", initial_allocation);
-         else {
+         else if( _options->count("checkpoint-interval") ) {
+            wlog("Detected unclean shutdown. Resuming from the last checkpoint...");
+            try {
+               _chain_db->open(_data_dir / "blockchain", initial_allocation);
+            } catch( const fc::exception& e ) {
+               wlog("Unable to resume from the last checkpoint, replaying blockchain: ${e}", ("e", e.to_detail_string()));
+               _chain_db->reindex(_data_dir / "blockchain", initial_allocation);
+            }
+         } else {
             wlog("Detected unclean shutdown. Replaying blockchain...");
             _chain_db->reindex(_data_dir / "blockchain", initial_allocation);
          }
 
-         reset_p2p_node(_data_dir);
+         if( _options->count("state-hash") && _options->at("state-hash").as<bool>() )
+            _chain_db->enable_state_hash();
+
+         if( _options->count("state-snapshot-interval") && !replicated )
+         {
+            const uint32_t interval = _options->at("state-snapshot-interval").as<uint32_t>();
+            FC_ASSERT( interval > 0, "state-snapshot-interval must be at least 1" );
+            // The manifest of a served snapshot carries the hash of its state
+            if( !_chain_db->state_hash_enabled() )
+               _chain_db->enable_state_hash();
+            _chain_db->applied_block.connect([this, interval](const signed_block& b){
+               // Written once the block is done with, and skipped while the last one is still being written
+               if( b.block_num() % interval == 0 && (!_state_snapshot_task.valid() || _state_snapshot_task.ready()) )
+                  _state_snapshot_task = fc::async([this]{ serve_state_snapshot(); }, "Serve State Snapshot");
+            });
+         }
+         // Only a node which has applied no blocks yet has nothing to lose by taking its state from peers
+         if( _options->count("bootstrap-from-peers") && !replicated && _chain_db->head_block_num() == 0 )
+         {
+            _bootstrap_attestations = std::max<uint32_t>( _options->at("bootstrap-from-peers").as<uint32_t>(), 1 );
+            ilog("Bootstrapping the state from a snapshot served by ${n} peers", ("n", _bootstrap_attestations));
+         }
+
+         _chain_db->applied_block.connect([this](const signed_block&){ publish_known_items(); });
+         publish_known_items();
+
+         if( _options->count("subscription-queue-limit") )
+         {
+            string policy = _options->count("subscription-overflow-policy") ?
+                            _options->at("subscription-overflow-policy").as<string>() : "drop";
+            FC_ASSERT( policy == "drop" || policy == "unsubscribe", "Unknown subscription overflow policy ${p}", ("p", policy) );
+            _subscriptions->set_queue_limit( _options->at("subscription-queue-limit").as<uint64_t>(),
+                                             policy == "drop" ? subscription_hub::drop_oldest : subscription_hub::unsubscribe );
+         }
+
+         // The copy follows applied blocks, which a replicated state has none of, and a bootstrapped state is
+         // copied once it has arrived
+         const utilities::thread_group& api_threads = _thread_pools.get("api");
+         if( !api_threads.empty() && !replicated && !_bootstrap_attestations )
+            _replica = std::make_shared<read_replica>( std::ref(*_chain_db), api_threads );
+
+         if( replicated )
+         {
+            _replication_client = std::make_shared<state_replication_client>( std::ref(*_chain_db) );
+            _replication_client->connect( fc::ip::endpoint::from_string(_options->at("replicate-from").as<string>()) );
+         }
+         else
+            reset_p2p_node(_data_dir);
          reset_websocket_server();
          reset_websocket_tls_server();
+         reset_binary_api_server();
+         reset_replication_server();
+         reset_metrics_server();
+
+         if( _options->count("index-stats-interval") )
+            schedule_index_stats(_options->at("index-stats-interval").as<uint32_t>());
+         if( _options->count("evaluator-stats-interval") )
+            schedule_evaluator_stats(_options->at("evaluator-stats-interval").as<uint32_t>());
       } FC_CAPTURE_AND_RETHROW() }
 
+      void schedule_index_stats( uint32_t interval_seconds )
+      {
+         _index_stats_task = fc::schedule([this, interval_seconds]{
+            for( const graphene::db::index_stats& stats : _chain_db->get_index_stats() )
+               ilog("Index ${space}.${type}: ${count} objects, ${objects} bytes of objects, ${container} bytes of index, "
+                    "${pool_used} bytes of pool in use, ${pool_free} bytes of pool free",
+                    ("space", stats.space_id)("type", stats.type_id)("count", stats.object_count)
+                    ("objects", stats.object_bytes)("container", stats.container_bytes)
+                    ("pool_used", stats.pool_used_bytes)("pool_free", stats.pool_free_bytes));
+            schedule_index_stats(interval_seconds);
+         }, fc::time_point::now() + fc::seconds(interval_seconds), "Index Stats");
+      }
+
+      void schedule_evaluator_stats( uint32_t interval_seconds )
+      {
+         _evaluator_stats_task = fc::schedule([this, interval_seconds]{
+            for( const graphene::chain::evaluator_stats& stats : _chain_db->get_evaluator_stats() )
+            {
+               if( stats.calls == 0 )
+                  continue;
+               uint64_t sampled = std::max<uint64_t>( stats.sampled_calls, 1 );
+               ilog("Evaluator ${op}: ${calls} calls, ${evaluate} ns to evaluate (max ${max_evaluate}), ${apply} ns to apply (max ${max_apply}), ${clones} undo clones on average",
+                    ("op", stats.operation)("calls", stats.calls)
+                    ("evaluate", stats.evaluate_ns / sampled)("max_evaluate", stats.max_evaluate_ns)
+                    ("apply", stats.apply_ns / sampled)("max_apply", stats.max_apply_ns)
+                    ("clones", double(stats.undo_clones) / sampled));
+            }
+            schedule_evaluator_stats(interval_seconds);
+         }, fc::time_point::now() + fc::seconds(interval_seconds), "Evaluator Stats");
+      }
+
+      /**
+       * The items the p2p thread can check for without waiting on the chain thread, published after each
+       * block.  A block which isn't listed is only certainly unknown if it's ahead of head_block_num.
+       */
+      struct known_items_snapshot
+      {
+         uint32_t                    head_block_num = 0;
+         vector<block_id_type>       recent_block_ids; ///< sorted
+         vector<chain::transaction_id_type> transaction_ids;  ///< sorted
+
+         /// what admit_transaction_on_any_thread() checks incoming transactions against
+         fc::time_point_sec          head_block_time;
+         uint32_t                    maximum_transaction_size = 0;
+         uint32_t                    maximum_time_until_expiration = 0;
+         chain::fee_schedule_type    fees;
+      };
+
+      void publish_known_items()
+      {
+         const size_t max_recent_block_ids = 1024;
+         if( _chain_db->head_block_num() > 0 )
+         {
+            _recent_block_ids.push_back( _chain_db->head_block_id() );
+            if( _recent_block_ids.size() > max_recent_block_ids )
+               _recent_block_ids.pop_front();
+         }
+
+         auto snapshot = std::make_shared<known_items_snapshot>();
+         snapshot->head_block_num = _chain_db->head_block_num();
+         snapshot->recent_block_ids.assign( _recent_block_ids.begin(), _recent_block_ids.end() );
+         std::sort( snapshot->recent_block_ids.begin(), snapshot->recent_block_ids.end() );
+         const auto& trx_idx = _chain_db->get_index_type<chain::transaction_index>().indices().get<chain::by_trx_id>();
+         snapshot->transaction_ids.reserve( trx_idx.size() );
+         for( const chain::transaction_object& trx : trx_idx )
+            snapshot->transaction_ids.push_back( trx.trx_id );
+         std::sort( snapshot->transaction_ids.begin(), snapshot->transaction_ids.end() );
+         const chain::chain_parameters& params = _chain_db->get_global_properties().parameters;
+         snapshot->head_block_time = _chain_db->head_block_time();
+         snapshot->maximum_transaction_size = params.maximum_transaction_size;
+         snapshot->maximum_time_until_expiration = params.maximum_time_until_expiration;
+         snapshot->fees = _chain_db->current_fee_schedule();
+
+         std::lock_guard<std::mutex> lock( _known_items_mutex );
+         _known_items = std::move( snapshot );
+      }
+
+      virtual bool has_item_on_any_thread( const net::item_id& id, bool& has_the_item ) override
+      {
+         std::shared_ptr<const known_items_snapshot> snapshot;
+         {
+            std::lock_guard<std::mutex> lock( _known_items_mutex );
+            snapshot = _known_items;
+         }
+         if( !snapshot )
+            return false;
+
+         if( id.item_type == graphene::net::block_message_type )
+         {
+            if( std::binary_search( snapshot->recent_block_ids.begin(), snapshot->recent_block_ids.end(), id.item_hash ) )
+               has_the_item = true;
+            else if( block_header::num_from_id( id.item_hash ) > snapshot->head_block_num )
+               has_the_item = false;
+            else
+               return false; // may be an older block, or one on a fork
+            return true;
+         }
+         // a transaction pushed since the snapshot reads as unknown, which only costs refetching it
+         has_the_item = std::binary_search( snapshot->transaction_ids.begin(), snapshot->transaction_ids.end(), id.item_hash );
+         return true;
+      }
+
       /**
        * If delegate has the item, the network has no need to fetch it.
        */
@@ -200,17 +504,96 @@ namespace detail {
       virtual bool handle_block( const graphene::net::block_message& blk_msg, bool sync_mode ) override
       { try {
          ilog("Got block #${n} from network", ("n", blk_msg.block.block_num()));
+         // Nodes which aren't producing only check transaction signatures if they asked to verify them off the
+         // chain thread or in a batch
+         bool check_signatures = _is_block_producer || _chain_db->get_signature_thread_count() > 0
+                                 || _chain_db->get_batch_signature_verification();
          try {
-            return _chain_db->push_block( blk_msg.block, _is_block_producer? database::skip_nothing : database::skip_transaction_signatures );
+            return _chain_db->push_block( blk_msg.block, check_signatures? database::skip_nothing : database::skip_transaction_signatures );
          } catch( const fc::exception& e ) {
             elog("Error when pushing block:\n${e}", ("e", e.to_detail_string()));
             throw;
          }
       } FC_CAPTURE_AND_RETHROW( (blk_msg)(sync_mode) ) }
 
+      virtual uint32_t handle_sync_blocks( const std::vector<graphene::net::block_message>& blocks ) override
+      { try {
+         if( blocks.empty() )
+            return 0;
+         ilog("Got sync blocks #${first} to #${last} from network",
+              ("first", blocks.front().block.block_num())("last", blocks.back().block.block_num()));
+         bool check_signatures = _is_block_producer || _chain_db->get_signature_thread_count() > 0
+                                 || _chain_db->get_batch_signature_verification();
+         vector<const signed_block*> run;
+         run.reserve( blocks.size() );
+         for( const graphene::net::block_message& blk_msg : blocks )
+            run.push_back( &blk_msg.block );
+         return _chain_db->push_blocks( run, check_signatures? database::skip_nothing : database::skip_transaction_signatures );
+      } FC_CAPTURE_AND_RETHROW( (blocks.size()) ) }
+
+      /**
+       * Sheds transactions that can't possibly be accepted using only the last published snapshot: ones
+       * already known, oversized, expired, or paying less than the fee schedule requires in the core asset.
+       * Fees paid in other assets, and relative expirations, are left to push_transaction.
+       */
+      virtual bool admit_transaction_on_any_thread( const graphene::net::trx_message& trx_msg, std::string& reason ) override
+      {
+         std::shared_ptr<const known_items_snapshot> snapshot;
+         {
+            std::lock_guard<std::mutex> lock( _known_items_mutex );
+            snapshot = _known_items;
+         }
+         if( !snapshot || snapshot->head_block_num == 0 )
+            return true;
+
+         const chain::signed_transaction& trx = trx_msg.trx;
+         if( std::binary_search( snapshot->transaction_ids.begin(), snapshot->transaction_ids.end(), trx.id() ) )
+         {
+            reason = "transaction is already in the chain";
+            return false;
+         }
+         if( fc::raw::pack_size( trx ) > snapshot->maximum_transaction_size )
+         {
+            reason = "transaction is too large";
+            return false;
+         }
+         if( trx.relative_expiration == 0 )
+         {
+            // the snapshot may be a block or more behind, so the latest acceptable expiration is taken from the clock
+            fc::time_point_sec expiration( trx.ref_block_prefix );
+            fc::time_point_sec latest = std::max( snapshot->head_block_time, fc::time_point_sec( fc::time_point::now() ) );
+            if( expiration < snapshot->head_block_time ||
+                expiration > latest + snapshot->maximum_time_until_expiration )
+            {
+               reason = "transaction has an invalid expiration time";
+               return false;
+            }
+         }
+         for( const chain::operation& op : trx.operations )
+         {
+            const chain::asset fee = op.visit( operation_get_fee() );
+            if( fee.asset_id == chain::asset_id_type() &&
+                fee.amount < op.visit( chain::operation_calculate_fee( snapshot->fees ) ) )
+            {
+               reason = "transaction pays less than the required fee";
+               return false;
+            }
+         }
+         return true;
+      }
+
+      struct operation_get_fee
+      {
+         typedef chain::asset result_type;
+         template<typename T>
+         chain::asset operator()( const T& op )const { return op.fee; }
+      };
+
       virtual bool handle_transaction( const graphene::net::trx_message& trx_msg, bool sync_mode ) override
       { try {
-         ilog("Got transaction from network");
+         tlog("Got transaction from network");
+         // Reject what we can off the chain thread, so floods of bad transactions don't hold up the chain
+         _chain_db->precheck_transaction( trx_msg.trx );
          _chain_db->push_transaction( trx_msg.trx );
          return false;
       } FC_CAPTURE_AND_RETHROW( (trx_msg)(sync_mode) ) }
@@ -248,16 +631,16 @@ namespace detail {
             ++itr;
          }
 
-         for( auto num = block_header::num_from_id(last_known_block_id);
-              num <= _chain_db->head_block_num() && result.size() < limit;
-              ++num )
-            if( num > 0 )
-               result.push_back(_chain_db->get_block_id_for_num(num));
+         const uint32_t first_num = std::max<uint32_t>( block_header::num_from_id(last_known_block_id), 1 );
+         if( first_num <= _chain_db->head_block_num() )
+            result = _chain_db->get_block_ids_for_nums( first_num,
+                                                        std::min<uint32_t>( limit, _chain_db->head_block_num() - first_num + 1 ) );
+         FC_ASSERT( !result.empty() );
 
          if( block_header::num_from_id(result.back()) < _chain_db->head_block_num() )
             remaining_item_count = _chain_db->head_block_num() - block_header::num_from_id(result.back());
 
-         idump((blockchain_synopsis)(limit)(result)(remaining_item_count));
+         tdump((blockchain_synopsis)(limit)(result)(remaining_item_count));
          return result;
       } FC_CAPTURE_AND_RETHROW( (blockchain_synopsis)(remaining_item_count)(limit) ) }
 
@@ -266,20 +649,137 @@ namespace detail {
        */
       virtual message get_item( const item_id& id ) override
       { try {
-         ilog("Request for item ${id}", ("id", id));
+         tlog("Request for item ${id}", ("id", id));
          if( id.item_type == graphene::net::block_message_type )
          {
+            // A block_message is the packed block followed by its id, so a stored block is sent as it was packed
+            message msg;
+            msg.msg_type = block_message::type;
+            if( _chain_db->fetch_packed_block_by_id( id.item_hash, msg.data ) )
+            {
+               const block_id_type block_id = id.item_hash;
+               const vector<char> packed_id = fc::raw::pack( block_id );
+               msg.data.insert( msg.data.end(), packed_id.begin(), packed_id.end() );
+               msg.size = (uint32_t)msg.data.size();
+               tlog("Serving up block #${num}", ("num", block_header::num_from_id(block_id)));
+               return msg;
+            }
+
             auto opt_block = _chain_db->fetch_block_by_id( id.item_hash );
             if( !opt_block )
                elog("Couldn't find block ${id} -- corresponding ID in our chain is ${id2}",
                     ("id", id.item_hash)("id2", _chain_db->get_block_id_for_num(block_header::num_from_id(id.item_hash))));
             FC_ASSERT( opt_block.valid() );
-            ilog("Serving up block #${num}", ("num", opt_block->block_num()));
+            tlog("Serving up block #${num}", ("num", opt_block->block_num()));
             return block_message( std::move(*opt_block) );
          }
          return trx_message( _chain_db->get_recent_transaction( id.item_hash ) );
       } FC_CAPTURE_AND_RETHROW( (id) ) }
 
+      virtual net::state_snapshot_manifest_message get_state_snapshot_manifest() override
+      {
+         return _served_snapshot ? *_served_snapshot : net::state_snapshot_manifest_message();
+      }
+
+      virtual std::vector<char> get_state_snapshot_chunk( const block_id_type& block_id, uint32_t chunk_index ) override
+      { try {
+         std::vector<char> chunk;
+         if( !_served_snapshot || _served_snapshot->block_id != block_id )
+            return chunk;
+         const uint32_t size = _served_snapshot->size_of_chunk( chunk_index );
+         if( size == 0 )
+            return chunk;
+
+         std::ifstream in( served_snapshot_file().generic_string(), std::ios::binary );
+         in.seekg( uint64_t(chunk_index) * _served_snapshot->chunk_size );
+         chunk.resize( size );
+         in.read( chunk.data(), size );
+         FC_ASSERT( in, "Unable to read the served state snapshot" );
+         return chunk;
+      } FC_CAPTURE_AND_RETHROW( (block_id)(chunk_index) ) }
+
+      virtual void handle_state_snapshot( const net::state_snapshot_manifest_message& manifest,
+                                          const std::vector<char>& snapshot ) override
+      { try {
+         FC_ASSERT( _chain_db->head_block_num() == 0, "Only a node which has applied no blocks bootstraps from a snapshot" );
+         const fc::path file = _data_dir / "p2p_snapshot.download";
+         {
+            std::ofstream out( file.generic_string(), std::ios::binary | std::ios::trunc );
+            out.write( snapshot.data(), snapshot.size() );
+            FC_ASSERT( out, "Unable to write the downloaded state snapshot" );
+         }
+
+         // The chunks are only known to be what the peers committed to, so the state is checked in a scratch
+         // database before it replaces ours
+         {
+            chain::database scratch;
+            scratch.open_in_memory_from_snapshot( file );
+            FC_ASSERT( scratch.get_global_properties().chain_id == _chain_db->get_global_properties().chain_id,
+                       "The snapshot is of another chain" );
+            FC_ASSERT( scratch.head_block_id() == manifest.block_id, "The snapshot is not of the block its manifest names" );
+            const chain::witness_object& witness = manifest.head_block_header.witness( scratch );
+            FC_ASSERT( manifest.head_block_header.validate_signee( witness.signing_key( scratch ).key() ),
+                       "The head block of the snapshot was not signed by its witness" );
+            scratch.enable_state_hash();
+            FC_ASSERT( scratch.get_state_hash() == manifest.state_hash, "The state in the snapshot does not match its hash" );
+         }
+
+         _chain_db->reset_to_snapshot( file, _data_dir / "blockchain" );
+         fc::remove( file );
+         _recent_block_ids.clear();
+         publish_known_items();
+         const utilities::thread_group& api_threads = _thread_pools.get("api");
+         if( !api_threads.empty() )
+            _replica = std::make_shared<read_replica>( std::ref(*_chain_db), api_threads );
+         ilog("Bootstrapped the state as of block ${num} from peers", ("num", _chain_db->head_block_num()));
+      } FC_CAPTURE_AND_RETHROW() }
+
+      fc::path served_snapshot_file()const
+      {
+         return _data_dir / "p2p_snapshot";
+      }
+
+      /**
+       * Snapshots the state as of the head block for peers to bootstrap from.  The file is read a chunk at a time
+       * as peers ask for it, and only replaces the one served before once it is complete.
+       */
+      void serve_state_snapshot()
+      {
+         try {
+            if( _chain_db->head_block_num() == 0 )
+               return;
+            net::state_snapshot_manifest_message manifest;
+            manifest.block_id = _chain_db->head_block_id();
+            manifest.head_block_header = *_chain_db->fetch_block_by_id( manifest.block_id );
+            // The hash recorded after the head block, as the current one covers the pending transactions
+            auto state_hash = _chain_db->get_state_hash_at( _chain_db->head_block_num() );
+            if( !state_hash )
+               return;
+            manifest.state_hash = *state_hash;
+            manifest.chunk_size = GRAPHENE_NET_STATE_SNAPSHOT_CHUNK_SIZE;
+
+            const fc::path next_file = _data_dir / "p2p_snapshot.next";
+            _chain_db->snapshot( next_file );
+            std::ifstream in( next_file.generic_string(), std::ios::binary );
+            std::vector<char> chunk( manifest.chunk_size );
+            fc::sha256 commitment;
+            while( in.read( chunk.data(), chunk.size() ) || in.gcount() > 0 )
+            {
+               commitment = net::state_snapshot_manifest_message::commit_to_chunk( commitment, chunk.data(), in.gcount() );
+               manifest.chunk_commitments.push_back( commitment );
+               manifest.snapshot_size += in.gcount();
+            }
+            in.close();
+
+            fc::rename( next_file, served_snapshot_file() );
+            _served_snapshot = manifest;
+            ilog("Serving the state snapshot of block ${num} to peers, ${size} bytes",
+                 ("num", manifest.head_block_header.block_num())("size", manifest.snapshot_size));
+         } catch( const fc::exception& e ) {
+            elog("Unable to snapshot the state for peers: ${e}", ("e", e.to_detail_string()));
+         }
+      }
+
       virtual fc::sha256 get_chain_id()const override
       {
          return _chain_db->get_global_properties().chain_id;
@@ -311,11 +811,15 @@ namespace detail {
          auto current = 1;
          while( current < head_block_num )
          {
-            result.push_back( _chain_db->get_block_id_for_num( head_block_num - current ) );
+            // A state opened from a snapshot has no blocks before the snapshot's
+            auto block_ids = _chain_db->get_block_ids_for_nums( head_block_num - current, 1 );
+            if( block_ids.empty() )
+               break;
+            result.push_back( block_ids.front() );
             current = current*2;
          }
          std::reverse( result.begin(), result.end() );
-         idump((reference_point)(number_of_blocks_after_reference_point)(result));
+         tdump((reference_point)(number_of_blocks_after_reference_point)(result));
          return result;
       } FC_CAPTURE_AND_RETHROW( (reference_point)(number_of_blocks_after_reference_point) ) }
 
@@ -350,8 +854,8 @@ namespace detail {
        */
       virtual fc::time_point_sec get_block_time(const item_hash_t& block_id) override
       { try {
-         auto opt_block = _chain_db->fetch_block_by_id( block_id );
-         if( opt_block.valid() ) return opt_block->timestamp;
+         auto header = _chain_db->fetch_block_header_by_id( block_id );
+         if( header.valid() ) return header->timestamp;
          return fc::time_point_sec::min();
       } FC_CAPTURE_AND_RETHROW( (block_id) ) }
 
@@ -376,17 +880,67 @@ namespace detail {
          // notify GUI or something cool
       }
 
+      /**
+       * Sizes the thread pools from thread-pool, and from signature-threads and api-read-threads for the pools
+       * they name which thread-pool leaves out
+       */
+      void configure_thread_pools()
+      {
+         if( _options->count("thread-pool") )
+            for( const string& spec : _options->at("thread-pool").as<vector<string>>() )
+            {
+               const auto role_and_config = utilities::thread_pools::parse(spec);
+               _thread_pools.configure(role_and_config.first, role_and_config.second);
+            }
+         auto configure_from = [this]( const char* option, const char* role ) {
+            if( _options->count(option) && !_thread_pools.is_configured(role) )
+            {
+               utilities::thread_pools::pool_config config;
+               config.thread_count = _options->at(option).as<uint32_t>();
+               _thread_pools.configure(role, config);
+            }
+         };
+         configure_from("signature-threads", "sigcheck");
+         configure_from("api-read-threads", "api");
+         ilog("Thread pools: ${pools}", ("pools", _thread_pools.describe()));
+      }
+
       application* _self;
 
       fc::path _data_dir;
       const bpo::variables_map* _options = nullptr;
 
+      /// the worker threads, by role; declared first, so the pools are the last to let go of them
+      utilities::thread_pools                               _thread_pools;
       std::shared_ptr<graphene::chain::database>            _chain_db;
+      /// shared by the database_api of every connection, so each block is dispatched once
+      std::shared_ptr<subscription_hub>                     _subscriptions;
+      /// set when there are api threads
+      std::shared_ptr<read_replica>                         _replica;
       std::shared_ptr<graphene::net::node>                  _p2p_network;
       std::shared_ptr<fc::http::websocket_server>      _websocket_server;
       std::shared_ptr<fc::http::websocket_tls_server>  _websocket_tls_server;
+      std::shared_ptr<binary_api_server>               _binary_api_server;
+      std::shared_ptr<state_replication_server>        _replication_server;
+      /// set instead of the p2p node when the state is replicated from another node
+      std::shared_ptr<state_replication_client>        _replication_client;
+      std::shared_ptr<metrics_server>                  _metrics_server;
+      fc::optional<uint64_t>                           _metrics_collector;
 
       std::map<string, std::shared_ptr<abstract_plugin>> _plugins;
+      fc::future<void>                                   _index_stats_task;
+      fc::future<void>                                   _evaluator_stats_task;
+      fc::future<void>                                   _state_snapshot_task;
+
+      /// the snapshot in served_snapshot_file(), once one has been written
+      fc::optional<net::state_snapshot_manifest_message> _served_snapshot;
+      /// how many peers must serve a snapshot for this node to bootstrap from it, 0 when it syncs from its own head
+      uint32_t                                           _bootstrap_attestations = 0;
+
+      /// the ids of the last blocks applied, oldest first; only touched on the chain thread
+      std::deque<block_id_type>                          _recent_block_ids;
+      std::mutex                                         _known_items_mutex;
+      std::shared_ptr<const known_items_snapshot>        _known_items;
    };
 
 }
@@ -397,6 +951,18 @@ application::application()
 
 application::~application()
 {
+   if( my->_index_stats_task.valid() )
+      my->_index_stats_task.cancel_and_wait(__FUNCTION__);
+   if( my->_evaluator_stats_task.valid() )
+      my->_evaluator_stats_task.cancel_and_wait(__FUNCTION__);
+   if( my->_state_snapshot_task.valid() )
+      my->_state_snapshot_task.cancel_and_wait(__FUNCTION__);
+   my->_binary_api_server.reset();
+   my->_replication_server.reset();
+   my->_replication_client.reset();
+   my->_metrics_server.reset();
+   if( my->_metrics_collector )
+      utilities::metrics().remove_collector( *my->_metrics_collector );
    if( my->_p2p_network )
    {
       ilog("Closing p2p node");
@@ -418,14 +984,49 @@ void application::set_program_options(boost::program_options::options_descriptio
          ("seed-node,s", bpo::value<vector<string>>()->composing(), "P2P nodes to connect to on startup (may specify multiple times)")
          ("rpc-endpoint", bpo::value<string>()->implicit_value("127.0.0.1:8090"), "Endpoint for websocket RPC to listen on")
          ("rpc-tls-endpoint", bpo::value<string>()->implicit_value("127.0.0.1:8089"), "Endpoint for TLS websocket RPC to listen on")
+         ("rpc-binary-endpoint", bpo::value<string>()->implicit_value("127.0.0.1:8091"), "Endpoint for the fc::raw packed binary RPC to listen on")
+         ("metrics-endpoint", bpo::value<string>()->implicit_value("127.0.0.1:8092"), "Endpoint to serve metrics over HTTP on, at /metrics in the Prometheus text format")
+         ("replication-endpoint", bpo::value<string>()->implicit_value("127.0.0.1:8093"), "Endpoint to publish the changes of every block on, for trusted replicas to follow")
+         ("replicate-from", bpo::value<string>(), "Follow the state of the node publishing on this endpoint instead of applying blocks from the p2p network")
          ("server-pem,p", bpo::value<string>()->implicit_value("server.pem"), "The TLS certificate file for this server")
          ("server-pem-password,P", bpo::value<string>()->implicit_value(""), "Password for this certificate")
          ("genesis-json", bpo::value<boost::filesystem::path>(), "File to read Genesis State from")
+         ("signature-threads", bpo::value<uint32_t>(), "Number of threads used to recover transaction signatures in incoming blocks")
+         ("signature-cache-size", bpo::value<uint32_t>(), "Number of recovered transaction signatures to remember")
+         ("batch-signature-verification", bpo::value<bool>()->implicit_value(true), "Verify all signatures of an incoming block as a single batch")
+         ("undo-history-max-bytes", bpo::value<uint64_t>(), "Maximum memory held by the undo history, in addition to its maximum depth")
+         ("enable-read-views", bpo::value<bool>()->implicit_value(true), "Keep copies of the objects which other threads can read while blocks are applied")
+         ("track-transaction-conflicts", bpo::value<bool>()->implicit_value(true), "Count the transactions of applied blocks which write objects an earlier transaction of their block wrote")
+         ("evaluator-sample-interval", bpo::value<uint32_t>(), "Time one in every this many evaluations of each operation type")
+         ("evaluator-stats-interval", bpo::value<uint32_t>(), "Log the number of evaluations of each operation type and their times every this many seconds")
+         ("block-timing-history", bpo::value<uint32_t>(), "Number of recently applied blocks whose phase timings are kept for the API, 0 to not time them")
+         ("flush-state-interval", bpo::value<uint32_t>(), "Write the changed chain state to disk every this many blocks")
+         ("checkpoint-interval", bpo::value<uint32_t>(), "Checkpoint the chain state every this many blocks, so that an unclean shutdown does not require a replay of the whole blockchain")
+         ("sync-interval-blocks", bpo::value<uint32_t>(), "Write the stored blocks and checkpoints through to disk together every this many blocks")
+         ("sync-interval-ms", bpo::value<uint32_t>(), "Write the stored blocks and checkpoints through to disk together every this many milliseconds")
+         ("checkpoint", bpo::value<vector<string>>()->composing(), "Pairs of [BLOCK_NUM,BLOCK_ID] which blocks must match; blocks up to the last one have their signatures trusted")
+         ("compress-blocks", bpo::value<bool>()->implicit_value(true), "Compress the blocks written to the block database")
+         ("prune-blocks", bpo::value<uint32_t>(), "Keep only the last this many blocks in the block database, and only the ids of older ones")
+         ("state-hash", bpo::value<bool>()->implicit_value(true), "Keep a hash of the chain state, updated with each block, to compare with other nodes")
+         ("state-snapshot-interval", bpo::value<uint32_t>(), "Snapshot the chain state every this many blocks, and serve the latest snapshot to peers bootstrapping from one")
+         ("bootstrap-from-peers", bpo::value<uint32_t>()->implicit_value(2), "When no block has been applied yet, download a recent state snapshot which at least this many peers serve instead of syncing from genesis")
+         ("trusted-replay", bpo::value<bool>()->default_value(true), "Skip the signature and authority checks of blocks replayed from the local block database")
+         ("object-store-profile", bpo::value<string>(), "LevelDB settings of the chain state store: default_profile, point_lookup, sequential_scan or write_heavy")
+         ("object-store-cache-size", bpo::value<uint64_t>(), "Memory used by the chain state store for its block cache and write buffers, in bytes")
+         ("index-stats-interval", bpo::value<uint32_t>(), "Log the number of objects and the memory held by each object index every this many seconds")
+         ("subscription-queue-limit", bpo::value<uint64_t>(), "Queue at most this many bytes of push notifications for each API client")
+         ("subscription-overflow-policy", bpo::value<string>()->default_value("drop"), "What to do with an API client over its subscription-queue-limit: drop its oldest notifications, or unsubscribe it from everything")
+         ("api-read-threads", bpo::value<uint32_t>(), "Run the database API queries on this many threads, against a copy of the chain state updated after each block")
+         ("huge-pages", bpo::value<string>(), "Back the storage of the object indexes with huge pages: none, transparent or explicit")
+         ("chain-numa-node", bpo::value<uint32_t>(), "Pin the chain thread, and the chain state it loads, to this NUMA node")
+         ("p2p-numa-node", bpo::value<uint32_t>(), "Pin the p2p network threads to this NUMA node")
+         ("thread-pool", bpo::value<vector<string>>()->composing(), "Size a pool of worker threads, as ROLE=COUNT, or ROLE=COUNT@NODE to pin it to a NUMA node. The roles are sigcheck, api, p2p-io and worker (may specify multiple times)")
          ;
    command_line_options.add(configuration_file_options);
    command_line_options.add_options()
          ("replay-blockchain", "Rebuild object graph by replaying all blocks")
          ("resync-blockchain", "Delete all blocks and re-sync with network from scratch")
+         ("open-from-snapshot", bpo::value<boost::filesystem::path>(), "Delete the chain state and blocks, and start from the state in a snapshot file")
          ;
    command_line_options.add(_cli_options);
    configuration_file_options.add(_cfg_options);
@@ -447,6 +1048,11 @@ std::shared_ptr<abstract_plugin> application::get_plugin(const string& name) con
    return my->_plugins[name];
 }
 
+const fc::path& application::data_dir()const
+{
+   return my->_data_dir;
+}
+
 net::node_ptr application::p2p_node()
 {
    return my->_p2p_network;
@@ -457,6 +1063,21 @@ std::shared_ptr<chain::database> application::chain_database() const
    return my->_chain_db;
 }
 
+std::shared_ptr<subscription_hub> application::subscriptions() const
+{
+   return my->_subscriptions;
+}
+
+utilities::thread_pools& application::thread_pools()
+{
+   return my->_thread_pools;
+}
+
+std::shared_ptr<read_replica> application::replica() const
+{
+   return my->_replica;
+}
+
 void application::set_block_production(bool producing_blocks)
 {
    my->_is_block_producer = producing_blocks;
@@ -483,9 +1104,44 @@ void application::initialize_plugins( const boost::program_options::variables_ma
 
 void application::startup_plugins()
 {
-   for( auto& entry : my->_plugins )
-      entry.second->plugin_startup();
-   return;
+   // Each plugin starts in a task of its own as soon as those it depends on have started, so a plugin waiting on
+   //    other threads doesn't hold up the ones which don't need it
+   std::map<string, fc::future<void>> started;
+   std::set<string> starting;
+   std::function<fc::future<void>(const string&)> start = [&]( const string& name ) -> fc::future<void> {
+      auto itr = started.find( name );
+      if( itr != started.end() )
+         return itr->second;
+      FC_ASSERT( starting.insert( name ).second, "Plugin ${name} depends on itself", ("name", name) );
+      std::shared_ptr<abstract_plugin> plugin = my->_plugins.at( name );
+      vector<fc::future<void>> dependencies;
+      for( const string& dependency : plugin->plugin_dependencies() )
+      {
+         FC_ASSERT( my->_plugins.count( dependency ), "Plugin ${name} depends on ${dependency}, which is not registered",
+                    ("name", name)("dependency", dependency) );
+         dependencies.push_back( start( dependency ) );
+      }
+      starting.erase( name );
+      fc::future<void> done = fc::async( [plugin, dependencies]() mutable {
+         for( fc::future<void>& dependency : dependencies )
+            dependency.wait();
+         plugin->plugin_startup();
+      }, "plugin_startup" );
+      started[name] = done;
+      return done;
+   };
+   for( const auto& entry : my->_plugins )
+      start( entry.first );
+   for( auto& entry : started )
+      entry.second.wait();
+}
+
+std::map<string, bool> application::get_plugin_readiness()const
+{
+   std::map<string, bool> readiness;
+   for( const auto& entry : my->_plugins )
+      readiness[entry.first] = entry.second->plugin_is_ready();
+   return readiness;
 }
 
 // namespace detail
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/app/binary_api_server.hpp>
+#include <graphene/app/application.hpp>
+
+#include <fc/io/raw.hpp>
+#include <fc/io/raw_variant.hpp>
+#include <fc/thread/thread.hpp>
+
+namespace graphene { namespace app {
+
+   namespace {
+      /// Frames larger than this are taken for a broken client, which is disconnected
+      const uint32_t max_frame_size = 16 * 1024 * 1024;
+
+      template<typename T> struct is_callback : std::false_type {};
+      template<typename Signature> struct is_callback<std::function<Signature>> : std::true_type {};
+
+      template<typename... Args> struct has_callback : std::false_type {};
+      template<typename Arg, typename... Args>
+      struct has_callback<Arg, Args...>
+         : std::integral_constant<bool, is_callback<typename std::decay<Arg>::type>::value || has_callback<Args...>::value> {};
+
+      template<typename R>
+      R call_unpacked( fc::datastream<const char*>& ds, const std::function<R()>& f )
+      {
+         return f();
+      }
+
+      /// Unpacks the arguments of f in order, one at a time, then calls it
+      template<typename R, typename Arg, typename... Args>
+      R call_unpacked( fc::datastream<const char*>& ds, const std::function<R(Arg, Args...)>& f )
+      {
+         typename std::decay<Arg>::type arg;
+         fc::raw::unpack( ds, arg );
+         return call_unpacked( ds, std::function<R(Args...)>( [&f,&arg]( Args... args ) {
+            return f( arg, std::forward<Args>(args)... );
+         }));
+      }
+
+      typedef std::function<vector<char>( fc::datastream<const char*>& )> raw_method;
+
+      template<typename R, typename... Args>
+      raw_method make_raw_method( const std::function<R(Args...)>& f, std::false_type )
+      {
+         return [f]( fc::datastream<const char*>& ds ) { return fc::raw::pack( call_unpacked( ds, f ) ); };
+      }
+
+      template<typename... Args>
+      raw_method make_raw_method( const std::function<void(Args...)>& f, std::true_type )
+      {
+         return [f]( fc::datastream<const char*>& ds ) { call_unpacked( ds, f ); return vector<char>(); };
+      }
+
+      /// Collects the methods of an fc::api which can be called with packed arguments
+      struct raw_method_visitor
+      {
+         raw_method_visitor( map<string, raw_method>& methods ):methods(methods){}
+
+         template<typename R, typename... Args>
+         void operator()( const char* name, std::function<R(Args...)>& method )const
+         {
+            add( name, method, has_callback<Args...>() );
+         }
+
+         template<typename R, typename... Args>
+         void add( const char* name, const std::function<R(Args...)>& method, std::false_type )const
+         {
+            methods[name] = make_raw_method( method, std::is_void<R>() );
+         }
+
+         template<typename R, typename... Args>
+         void add( const char*, const std::function<R(Args...)>&, std::true_type )const {}
+
+         map<string, raw_method>& methods;
+      };
+   }
+
+   binary_api_server::binary_api_server( application& app )
+   :_database_api( std::make_shared<database_api>( std::ref(*app.chain_database()), app.subscriptions(), app.replica() ) ),
+    _history_api( std::make_shared<history_api>( app ) )
+   {
+      fc::api<database_api>( _database_api )->visit( raw_method_visitor( _methods["database"] ) );
+      fc::api<history_api>( _history_api )->visit( raw_method_visitor( _methods["history"] ) );
+   }
+
+   binary_api_server::~binary_api_server()
+   {
+      try {
+         _tcp_server.close();
+         if( _accept_loop_complete.valid() )
+            _accept_loop_complete.cancel_and_wait( __FUNCTION__ );
+      } catch( const fc::exception& e )
+      {
+         wlog( "${e}", ("e",e.to_detail_string()) );
+      }
+      auto connections = std::move( _connections );
+      for( auto& item : connections )
+      {
+         try {
+            item.first->close();
+            item.second.cancel_and_wait( __FUNCTION__ );
+         } catch( const fc::exception& e )
+         {
+            wlog( "${e}", ("e",e.to_detail_string()) );
+         }
+      }
+   }
+
+   void binary_api_server::listen( const fc::ip::endpoint& ep )
+   {
+      _tcp_server.set_reuse_address();
+      _tcp_server.listen( ep );
+      _accept_loop_complete = fc::async( [this](){ accept_loop(); }, "binary_api_server::accept_loop" );
+   }
+
+   fc::ip::endpoint binary_api_server::get_local_endpoint()const
+   {
+      return _tcp_server.get_local_endpoint();
+   }
+
+   void binary_api_server::accept_loop()
+   {
+      while( !_accept_loop_complete.canceled() )
+      {
+         auto sock = std::make_shared<fc::tcp_socket>();
+         try {
+            _tcp_server.accept( *sock );
+         } catch( const fc::canceled_exception& )
+         {
+            throw;
+         } catch( const fc::exception& e )
+         {
+            wlog( "Stopped accepting binary API connections: ${e}", ("e",e.to_detail_string()) );
+            return;
+         }
+         _connections[sock] = fc::async( [this,sock](){ serve( sock ); }, "binary_api_server::serve" );
+      }
+   }
+
+   void binary_api_server::serve( const std::shared_ptr<fc::tcp_socket>& sock )
+   {
+      try {
+         vector<char> frame;
+         for(;;)
+         {
+            uint32_t size = 0;
+            sock->read( reinterpret_cast<char*>(&size), sizeof(size) );
+            FC_ASSERT( size <= max_frame_size, "Binary API frame too large", ("size",size) );
+            frame.resize( size );
+            if( size )
+               sock->read( frame.data(), size );
+
+            const vector<char> reply = fc::raw::pack( call( fc::raw::unpack<binary_api_request>( frame ) ) );
+            const uint32_t reply_size = reply.size();
+            sock->write( reinterpret_cast<const char*>(&reply_size), sizeof(reply_size) );
+            sock->write( reply.data(), reply.size() );
+            sock->flush();
+         }
+      } catch( const fc::canceled_exception& )
+      {
+         throw;
+      } catch( const fc::exception& e )
+      {
+         // End of stream, or a frame which could not be read
+         dlog( "Binary API connection closed: ${e}", ("e",e.to_string()) );
+      }
+      // Our own future is dropped last, once nothing of this task is touched any more
+      _connections.erase( sock );
+   }
+
+   binary_api_response binary_api_server::call( const binary_api_request& request )
+   {
+      binary_api_response response;
+      response.id = request.id;
+      try {
+         auto api = _methods.find( request.api );
+         FC_ASSERT( api != _methods.end(), "Unknown API", ("api",request.api) );
+         auto method = api->second.find( request.method );
+         FC_ASSERT( method != api->second.end(), "Unknown method", ("api",request.api)("method",request.method) );
+         fc::datastream<const char*> ds( request.params.data(), request.params.size() );
+         response.result = method->second( ds );
+      } catch( const fc::exception& e )
+      {
+         response.error = e.to_string();
+      }
+      return response;
+   }
+
+} }
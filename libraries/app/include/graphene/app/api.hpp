@@ -24,13 +24,60 @@
 #include <graphene/chain/limit_order_object.hpp>
 #include <graphene/chain/short_order_object.hpp>
 #include <graphene/chain/key_object.hpp>
+#include <graphene/chain/vesting_balance_object.hpp>
+#include <graphene/chain/bond_object.hpp>
+#include <graphene/account_history/account_history_plugin.hpp>
+#include <graphene/market_history/market_history_plugin.hpp>
 #include <graphene/net/node.hpp>
+#include <graphene/time/time.hpp>
 #include <fc/api.hpp>
 
 namespace graphene { namespace app {
    using namespace graphene::chain;
 
    class application;
+   class subscription_hub;
+   class read_replica;
+
+   /// @brief The limit orders selling at one price
+   struct order_book_level
+   {
+      price      sell_price;
+      /// Total amount of sell_price.base offered at this price
+      share_type for_sale;
+      uint32_t   orders = 0;
+   };
+
+   /// @brief The limit orders between two assets, aggregated by price with the best prices first
+   struct order_book
+   {
+      asset_id_type            base;
+      asset_id_type            quote;
+      /// Levels selling base for quote
+      vector<order_book_level> asks;
+      /// Levels selling quote for base
+      vector<order_book_level> bids;
+   };
+
+   /// @brief Where a watched transaction was included, as passed to @ref database_api::subscribe_to_transaction callbacks
+   struct transaction_confirmation
+   {
+      transaction_id_type      id;
+      uint32_t                 block_num = 0;
+      block_id_type            block_id;
+      /// Position of the transaction in its block
+      uint32_t                 trx_num = 0;
+      vector<operation_result> operation_results;
+      /// Set in the last notification, once the block can no longer be undone
+      bool                     irreversible = false;
+   };
+
+   /// @brief One call of a @ref database_api::batch
+   struct batch_call
+   {
+      string       method;
+      fc::variants params;
+   };
 
    /**
     * @brief The database_api class implements the RPC API for the chain database.
@@ -42,7 +89,15 @@ namespace graphene { namespace app {
    class database_api
    {
       public:
-         database_api(graphene::chain::database& db);
+         /**
+          * @param db The database queried
+          * @param hub The hub dispatching the notifications of every database_api of db; one is created for this
+          * database_api alone if none is given
+          * @param replica If given, the copy of the state of db which the queries of objects are run against on
+          * worker threads, rather than db itself
+          */
+         database_api(graphene::chain::database& db, std::shared_ptr<subscription_hub> hub = std::shared_ptr<subscription_hub>(),
+                      std::shared_ptr<read_replica> replica = std::shared_ptr<read_replica>());
          ~database_api();
          /**
           * @brief Get the objects corresponding to the provided IDs
@@ -58,6 +113,21 @@ namespace graphene { namespace app {
           * @return header of the referenced block, or null if no matching block was found
           */
          optional<block_header>            get_block_header(uint32_t block_num)const;
+         /**
+          * @brief Retrieve consecutive block headers, with the number of transactions and size of each block
+          * @param first_block_num Height of the first block whose header should be returned
+          * @param limit Maximum number of headers to return; must not exceed 1000
+          * @return the headers from first_block_num on, stopping at the first block not found
+          */
+         vector<block_header_summary>      get_block_headers(uint32_t first_block_num, uint32_t limit)const;
+         /**
+          * @brief Retrieve the hash of the chain state after a block, to compare the state of two nodes
+          * @param block_num Height of the block after which the state was hashed
+          * @return the hash, or null if the block is not one of the last 1024 applied since the node started hashing
+          *
+          * The node must run with state-hash enabled.
+          */
+         optional<fc::sha256>              get_state_hash(uint32_t block_num)const;
          /**
           * @brief Retrieve a full, signed block
           * @param block_num Height of the block to be returned
@@ -112,6 +182,18 @@ namespace graphene { namespace app {
           * This function has semantics identical to @ref get_objects
           */
          vector<optional<asset_object>> lookup_asset_symbols(const vector<string>& asset_symbols)const;
+         /**
+          * @brief Resolve account names to their IDs, without returning the accounts themselves
+          * @param account_names Names of the accounts to resolve; at most 1000
+          * @return The ID of each named account, or null for names no account holds
+          */
+         vector<optional<account_id_type>> lookup_account_ids(const vector<string>& account_names)const;
+         /**
+          * @brief Resolve asset symbols to their IDs, without returning the assets themselves
+          * @param asset_symbols Symbols of the assets to resolve; at most 1000
+          * @return The ID of each asset, or null for symbols no asset holds
+          */
+         vector<optional<asset_id_type>> lookup_asset_ids(const vector<string>& asset_symbols)const;
 
          /**
           * @brief Get an account's balances in various assets
@@ -122,6 +204,24 @@ namespace graphene { namespace app {
          vector<asset> get_account_balances(account_id_type id, const flat_set<asset_id_type>& assets)const;
          /// Semantically equivalent to @ref get_account_balances, but takes a name instead of an ID.
          vector<asset> get_named_account_balances(const std::string& name, const flat_set<asset_id_type>& assets)const;
+         /**
+          * @brief Get all nonzero balances of an account
+          * @param id ID of the account to get balances for
+          * @return Balances of the account in every asset it holds
+          */
+         vector<asset> get_all_account_balances(account_id_type id)const;
+         /**
+          * @brief Get all nonzero balances of several accounts at once
+          * @param ids IDs of the accounts to get balances for
+          * @return The balances of each account, as returned by @ref get_all_account_balances, in the order of ids
+          */
+         vector<vector<asset>> get_balances_for_accounts(const vector<account_id_type>& ids)const;
+         /**
+          * @brief Get the vesting balances owned by an account
+          * @param account_id ID of the account to get vesting balances for
+          * @return Every vesting balance the account owns, in order of creation
+          */
+         vector<vesting_balance_object> get_vesting_balances(account_id_type account_id)const;
          /**
           * @brief Get the total number of accounts registered with the blockchain
           */
@@ -130,9 +230,16 @@ namespace graphene { namespace app {
           * @brief Get names and IDs for registered accounts
           * @param lower_bound_name Lower bound of the first name to return
           * @param limit Maximum number of results to return -- must not exceed 1000
-          * @return Map of account names to corresponding IDs
+          * @return Account names and corresponding IDs, in name order
+          */
+         vector<pair<string,account_id_type>> lookup_accounts(const string& lower_bound_name, uint32_t limit)const;
+         /**
+          * @brief Get names and IDs for registered accounts whose names start with a prefix
+          * @param prefix Prefix of the names to return
+          * @param limit Maximum number of results to return -- must not exceed 1000
+          * @return Account names and corresponding IDs, in name order
           */
-         map<string,account_id_type> lookup_accounts(const string& lower_bound_name, uint32_t limit)const;
+         vector<pair<string,account_id_type>> lookup_accounts_by_prefix(const string& prefix, uint32_t limit)const;
 
          /**
           * @brief Get limit orders in a given market
@@ -142,6 +249,14 @@ namespace graphene { namespace app {
           * @return The limit orders, ordered from least price to greatest
           */
          vector<limit_order_object> get_limit_orders(asset_id_type a, asset_id_type b, uint32_t limit)const;
+         /**
+          * @brief Get the limit orders between two assets, aggregated by price
+          * @param base ID of the asset sold by the asks
+          * @param quote ID of the asset sold by the bids
+          * @param depth Maximum number of price levels to retrieve on each side (must not exceed 100)
+          * @return The best depth levels of asks and of bids
+          */
+         order_book get_order_book(asset_id_type base, asset_id_type quote, uint32_t depth)const;
          /**
           * @brief Get short orders in a given asset
           * @param a ID of asset being sold
@@ -149,6 +264,14 @@ namespace graphene { namespace app {
           * @return The short orders, ordered from least price to greatest
           */
          vector<short_order_object> get_short_orders(asset_id_type a, uint32_t limit)const;
+         /**
+          * @brief Get the best bond offers in a given asset
+          * @param a ID of the asset offered to be lent or borrowed
+          * @param limit Maximum number of offers to retrieve on each side (must not exceed 100)
+          * @return The offers to lend, lowest interest rate first, followed by the offers to borrow, highest interest
+          * rate first; offers at the same rate are ordered from the largest amount to the smallest
+          */
+         vector<bond_offer_object> get_bond_offers(asset_id_type a, uint32_t limit)const;
          /**
           * @brief Get call orders in a given asset
           * @param a ID of asset being called
@@ -206,27 +329,113 @@ namespace graphene { namespace app {
           * @param b Second asset ID
           */
          void unsubscribe_from_market(asset_id_type a, asset_id_type b);
+         /**
+          * @brief Request notification of the price levels which change in an order book
+          * @param callback Callback method which is called after every block which changes the book
+          * @param base ID of the asset sold by the asks
+          * @param quote ID of the asset sold by the bids
+          * @param depth Number of price levels to follow on each side (must not exceed 100)
+          *
+          * Callback will be passed a variant containing an @ref order_book holding only the levels which changed
+          * since the previous notification.  A level which emptied, or fell out of the followed depth, is passed
+          * with nothing for sale.  Use @ref get_order_book for the initial state.
+          */
+         void subscribe_to_order_book(std::function<void(const variant&)> callback,
+                                      asset_id_type base, asset_id_type quote, uint32_t depth);
+         /**
+          * @brief Unsubscribe from changes to a given order book
+          * @param base ID of the asset sold by the asks
+          * @param quote ID of the asset sold by the bids
+          */
+         void unsubscribe_from_order_book(asset_id_type base, asset_id_type quote);
+         /**
+          * @brief Request notification when a transaction is included in a block, and when that block becomes
+          * irreversible
+          * @param callback Callback method which is called with a @ref transaction_confirmation
+          * @param trx_id ID of the transaction to watch
+          *
+          * The callback is called each time the transaction is included in an applied block, which after a fork may
+          * happen more than once, and a last time with irreversible set, after which the subscription ends.  Only
+          * blocks applied after the subscription are looked at, so subscribe before broadcasting the transaction.
+          */
+         void subscribe_to_transaction(std::function<void(const variant&)> callback, transaction_id_type trx_id);
+         /**
+          * @brief Stop watching a transaction
+          * @param trx_id ID of the transaction to stop watching
+          */
+         void unsubscribe_from_transaction(transaction_id_type trx_id);
          /**
           * @brief Stop receiving any notifications
           *
-          * This unsubscribes from all subscribed markets and objects.
+          * This unsubscribes from all subscribed markets, objects and transactions.
           */
-         void cancel_all_subscriptions()
-         { _subscriptions.clear(); _market_subscriptions.clear(); }
+         void cancel_all_subscriptions();
          ///@}
 
          /// @brief Get a hexdump of the serialized binary form of a transaction
          std::string get_transaction_hex(const signed_transaction& trx)const;
+
+         /**
+          * @brief Get the hit and miss counts of the recovered signature cache
+          */
+         signature_cache_stats get_signature_cache_stats()const;
+
+         /**
+          * @brief Get the depth of the undo history and the memory held by each of its states
+          */
+         undo_stats get_undo_stats()const;
+
+         /**
+          * @brief Get how many transactions of the applied blocks wrote objects an earlier transaction of their block
+          * wrote
+          *
+          * Nothing is counted unless the track-transaction-conflicts option is set.
+          */
+         transaction_conflict_stats get_transaction_conflict_stats()const;
+
+         /**
+          * @brief Get the number of evaluations of each operation type evaluated so far, and their times
+          *
+          * Only one in every evaluator-sample-interval evaluations is timed; none are unless that option is set.
+          */
+         vector<evaluator_stats> get_evaluator_stats()const;
+
+         /**
+          * @brief Get how long each phase of applying the most recent blocks took, the oldest block first
+          *
+          * The times of the applied_block and changed_objects observers are also given one by one, so the cost of
+          * each plugin can be told apart.
+          */
+         vector<block_timing> get_block_timings()const;
+
+         /**
+          * @brief Get the number of objects and the memory held by each object index
+          *
+          * This visits every object in the database, so it should not be called often on a large chain.
+          */
+         vector<index_stats> get_index_stats()const;
+
+         /**
+          * @brief Make several calls of this API at once
+          * @param calls The methods to call, with their parameters
+          * @return The result of each call, in order
+          *
+          * The calls are all made against the same state, without any block applied in between, and without waiting
+          * on anything else to run.  If any call fails, the whole batch fails.  The push notification methods and
+          * batch itself cannot be called in a batch.  When the API reads a copy of the state, get_objects returns null
+          * in a batch for the objects of the indexes added by plugins.
+          */
+         fc::variants batch(const vector<batch_call>& calls)const;
       private:
-         /** called every time a block is applied to report the objects that were changed */
-         void on_objects_changed(const vector<object_id_type>& ids);
-         void on_applied_block();
-
-         fc::future<void>                                                                _broadcast_changes_complete;
-         boost::signals2::scoped_connection                                              _change_connection;
-         boost::signals2::scoped_connection                                              _applied_block_connection;
-         map<object_id_type, std::function<void(const fc::variant&)> >                   _subscriptions;
-         map< pair<asset_id_type,asset_id_type>, std::function<void(const variant&)> >  _market_subscriptions;
+         /// Runs query against the replica if there is one, or else against the database itself
+         template<typename Query>
+         auto read( Query&& query )const -> decltype( query( std::declval<const graphene::chain::database&>() ) );
+
+         std::shared_ptr<subscription_hub>                                               _hub;
+         uint64_t                                                                        _subscriber;
+         std::shared_ptr<read_replica>                                                   _replica;
+         /// The methods callable in a batch, by name, built by the first batch
+         mutable map<string, std::function<fc::variant(const fc::variants&)>>            _batch_methods;
          graphene::chain::database&                                                      _db;
    };
 
@@ -252,6 +461,38 @@ namespace graphene { namespace app {
                                                            operation_history_id_type stop = operation_history_id_type(),
                                                            int limit = 100,
                                                            operation_history_id_type start = operation_history_id_type())const;
+      /**
+       * @brief Get operations relevant to the specified account by their sequence numbers within its history
+       *
+       * The operations of an account are numbered from 1 in the order they happened, so any page of the history is a
+       * direct seek.
+       *
+       * @param account The account whose history should be queried
+       * @param stop Sequence number of the operation before the earliest to retrieve
+       * @param limit Maximum number of operations to retrieve (must not exceed 100)
+       * @param start Sequence number of the most recent operation to retrieve, or 0 for the last one
+       * @return A list of operations performed by account, ordered from most recent to oldest.
+       */
+      vector<operation_history_object> get_relative_account_history(account_id_type account,
+                                                                    uint64_t stop = 0,
+                                                                    int limit = 100,
+                                                                    uint64_t start = 0)const;
+      /// @brief Get the number of operations in the history of an account, which is the sequence number of the last one
+      uint64_t get_account_history_count(account_id_type account)const;
+
+      /**
+       * @brief Get the trading history of a market, one bucket per interval with fills
+       * @param a One asset of the market
+       * @param b The other asset of the market; the order of a and b does not matter
+       * @param bucket_seconds Interval length, must be one of @ref get_market_history_buckets
+       * @param start Earliest bucket open time to retrieve
+       * @param end Latest bucket open time to retrieve
+       * @return At most 200 buckets, ordered from oldest to most recent
+       */
+      vector<market_history::bucket_object> get_market_history(asset_id_type a, asset_id_type b, uint32_t bucket_seconds,
+                                                               fc::time_point_sec start, fc::time_point_sec end)const;
+      /// @brief Get the interval lengths, in seconds, for which market history is kept
+      flat_set<uint32_t> get_market_history_buckets()const;
 
    private:
         application&              _app;
@@ -265,7 +506,8 @@ namespace graphene { namespace app {
    class network_api
    {
       public:
-         network_api(application& a):_app(a){}
+         network_api(application& a);
+         ~network_api();
 
          /**
           * @brief Broadcast a transaction to the network
@@ -275,6 +517,16 @@ namespace graphene { namespace app {
           * apply locally, an error will be thrown and the transaction will not be broadcast.
           */
          void broadcast_transaction(const signed_transaction& trx);
+         /**
+          * @brief Broadcast a transaction to the network, and be notified when it is confirmed
+          * @param callback Callback method which is called as by @ref database_api::subscribe_to_transaction
+          * @param trx The transaction to broadcast
+          *
+          * The transaction is watched before it is pushed, so no confirmation is missed.  If it fails to apply
+          * locally, an error is thrown and it is not watched.
+          */
+         void broadcast_transaction_with_callback(std::function<void(const variant&)> callback,
+                                                  const signed_transaction& trx);
          /**
           * @brief add_node Connect to a new peer
           * @param ep The IP/Port of the peer to connect to
@@ -284,9 +536,27 @@ namespace graphene { namespace app {
           * @brief Get status of all current connections to peers
           */
          std::vector<net::peer_status> get_connected_peers() const;
+         /**
+          * @brief Get the upload limits and rates of the peers syncing from us, of the peers in sync with us, and
+          * of each peer
+          */
+         fc::variant_object get_upload_rates() const;
+         /**
+          * @brief Get the propagation traces of the most recent blocks this node has seen, oldest first
+          *
+          * The times are corrected to NTP time when it is known, so the traces of different nodes can be compared
+          * to follow a block from the witness which produced it to every node.
+          */
+         std::vector<net::block_propagation_trace> get_block_propagation_traces() const;
+         /**
+          * @brief Get the correction NTP makes to the local clock of this node
+          */
+         graphene::time::time_stats get_time_stats() const;
 
       private:
          application&              _app;
+         std::shared_ptr<subscription_hub> _hub;
+         uint64_t                  _subscriber;
    };
 
    /**
@@ -310,6 +580,13 @@ namespace graphene { namespace app {
           * has sucessfully authenticated.
           */
          bool login(const string& user, const string& password);
+         /**
+          * @brief Whether each plugin is serving normally, by name
+          *
+          * Plugins may finish starting in the background, and answer incompletely until they are ready.  This needs
+          * no login, so a load balancer can wait for a restarted node before sending it clients.
+          */
+         std::map<string, bool> get_plugin_readiness()const;
          /// @brief Retrieve the network API
          fc::api<network_api> network()const;
          /// @brief Retrieve the database API
@@ -326,9 +603,16 @@ namespace graphene { namespace app {
 
 }}  // graphene::app
 
+FC_REFLECT( graphene::app::order_book_level, (sell_price)(for_sale)(orders) )
+FC_REFLECT( graphene::app::order_book, (base)(quote)(asks)(bids) )
+FC_REFLECT( graphene::app::transaction_confirmation, (id)(block_num)(block_id)(trx_num)(operation_results)(irreversible) )
+FC_REFLECT( graphene::app::batch_call, (method)(params) )
+
 FC_API(graphene::app::database_api,
        (get_objects)
        (get_block_header)
+       (get_block_headers)
+       (get_state_hash)
        (get_block)
        (get_global_properties)
        (get_dynamic_global_properties)
@@ -338,11 +622,19 @@ FC_API(graphene::app::database_api,
        (lookup_account_names)
        (get_account_count)
        (lookup_accounts)
+       (lookup_accounts_by_prefix)
        (get_account_balances)
        (get_named_account_balances)
+       (get_vesting_balances)
+       (get_all_account_balances)
+       (get_balances_for_accounts)
        (lookup_asset_symbols)
+       (lookup_account_ids)
+       (lookup_asset_ids)
        (get_limit_orders)
+       (get_order_book)
        (get_short_orders)
+       (get_bond_offers)
        (get_call_orders)
        (get_settle_orders)
        (list_assets)
@@ -350,13 +642,31 @@ FC_API(graphene::app::database_api,
        (unsubscribe_from_objects)
        (subscribe_to_market)
        (unsubscribe_from_market)
+       (subscribe_to_order_book)
+       (unsubscribe_from_order_book)
+       (subscribe_to_transaction)
+       (unsubscribe_from_transaction)
        (cancel_all_subscriptions)
        (get_transaction_hex)
+       (get_signature_cache_stats)
+       (get_undo_stats)
+       (get_transaction_conflict_stats)
+       (get_evaluator_stats)
+       (get_block_timings)
+       (get_index_stats)
+       (batch)
+     )
+FC_API(graphene::app::history_api,
+       (get_account_history)
+       (get_relative_account_history)
+       (get_account_history_count)
+       (get_market_history)
+       (get_market_history_buckets)
      )
-FC_API(graphene::app::history_api, (get_account_history))
-FC_API(graphene::app::network_api, (broadcast_transaction)(add_node)(get_connected_peers))
+FC_API(graphene::app::network_api, (broadcast_transaction)(broadcast_transaction_with_callback)(add_node)(get_connected_peers)(get_upload_rates)(get_block_propagation_traces)(get_time_stats))
 FC_API(graphene::app::login_api,
        (login)
+       (get_plugin_readiness)
        (network)
        (database)
        (history)
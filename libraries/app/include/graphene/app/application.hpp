@@ -19,6 +19,7 @@
 
 #include <graphene/net/node.hpp>
 #include <graphene/chain/database.hpp>
+#include <graphene/utilities/thread_pools.hpp>
 
 #include <boost/program_options.hpp>
 
@@ -28,6 +29,8 @@ namespace graphene { namespace app {
    using std::string;
 
    class abstract_plugin;
+   class subscription_hub;
+   class read_replica;
 
    class application
    {
@@ -41,8 +44,11 @@ namespace graphene { namespace app {
          void initialize_plugins( const bpo::variables_map& options );
          void startup();
          void shutdown();
+         /// Starts the plugins concurrently, each once the plugins it depends on have started
          void startup_plugins();
          void shutdown_plugins();
+         /// @return whether each plugin is ready, by name; see abstract_plugin::plugin_is_ready()
+         std::map<string, bool> get_plugin_readiness()const;
 
          template<typename PluginType>
          std::shared_ptr<PluginType> register_plugin()
@@ -71,8 +77,15 @@ namespace graphene { namespace app {
             return result;
          }
 
+         /// @return the directory given to initialize, which is empty until then
+         const fc::path&                  data_dir()const;
          net::node_ptr                    p2p_node();
          std::shared_ptr<chain::database> chain_database()const;
+         std::shared_ptr<subscription_hub> subscriptions()const;
+         /// @return the worker threads of the node, by role, which plugins share rather than starting their own
+         utilities::thread_pools&          thread_pools();
+         /// @return the copy of the chain state the database API reads, or null if it reads the database itself
+         std::shared_ptr<read_replica>     replica()const;
 
          void set_block_production(bool producing_blocks);
 
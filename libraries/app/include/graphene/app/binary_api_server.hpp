@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/app/api.hpp>
+
+#include <fc/network/tcp_socket.hpp>
+#include <fc/thread/future.hpp>
+
+namespace graphene { namespace app {
+
+   class application;
+
+   /// A call of a method of the database or history API, with its arguments fc::raw packed one after the other
+   struct binary_api_request
+   {
+      uint64_t     id = 0;
+      /// "database" or "history"
+      string       api;
+      string       method;
+      vector<char> params;
+   };
+
+   /// The result of the call with the same id, fc::raw packed, or the error it raised
+   struct binary_api_response
+   {
+      uint64_t         id = 0;
+      optional<string> error;
+      vector<char>     result;
+   };
+
+   /**
+    * @brief Serves the database and history APIs over plain TCP in fc::raw packed frames instead of JSON
+    *
+    * Each frame is a 32 bit little endian size followed by that many bytes of a packed @ref binary_api_request, or of
+    * a packed @ref binary_api_response in reply.  The arguments and results are packed with the same reflection as
+    * the chain itself uses, so no variant is built for them; the js_operation_serializer program dumps what clients
+    * need to pack and unpack them.  Responses are sent in the order the requests were received.
+    *
+    * The methods which take callbacks are left out, as push notifications need the websocket API.
+    */
+   class binary_api_server
+   {
+      public:
+         binary_api_server( application& app );
+         ~binary_api_server();
+
+         void             listen( const fc::ip::endpoint& ep );
+         fc::ip::endpoint get_local_endpoint()const;
+
+         /// Calls a method as a request from a client would, for testing
+         binary_api_response call( const binary_api_request& request );
+
+      private:
+         void accept_loop();
+         void serve( const std::shared_ptr<fc::tcp_socket>& sock );
+
+         typedef std::function<vector<char>( fc::datastream<const char*>& )> raw_method;
+
+         std::shared_ptr<database_api>                                    _database_api;
+         std::shared_ptr<history_api>                                     _history_api;
+         /// The methods of each API by name
+         map<string, map<string, raw_method>>                             _methods;
+
+         fc::tcp_server                                                   _tcp_server;
+         fc::future<void>                                                 _accept_loop_complete;
+         map<std::shared_ptr<fc::tcp_socket>, fc::future<void>>           _connections;
+   };
+
+} }
+
+FC_REFLECT( graphene::app::binary_api_request, (id)(api)(method)(params) )
+FC_REFLECT( graphene::app::binary_api_response, (id)(error)(result) )
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <graphene/chain/address.hpp>
+#include <graphene/chain/pts_address.hpp>
+#include <graphene/chain/types.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/reflect/variant.hpp>
+
+#include <type_traits>
+
+namespace graphene { namespace app {
+
+   /**
+    * Types which are reflected but whose to_variant is written by hand, so json_writer must write them through their
+    * variant rather than member by member.  Specialize it for any other such type.
+    */
+   template<typename T> struct json_leaf : std::false_type {};
+   template<> struct json_leaf<graphene::chain::public_key_type> : std::true_type {};
+   template<> struct json_leaf<graphene::chain::vote_id_type> : std::true_type {};
+   template<> struct json_leaf<graphene::chain::address> : std::true_type {};
+   template<> struct json_leaf<graphene::chain::pts_address> : std::true_type {};
+   template<> struct json_leaf<graphene::db::object_id_type> : std::true_type {};
+   template<uint8_t SpaceID, uint8_t TypeID, typename T>
+   struct json_leaf<graphene::db::object_id<SpaceID,TypeID,T>> : std::true_type {};
+   template<typename T> struct json_leaf<fc::safe<T>> : std::true_type {};
+
+   /**
+    * @brief Writes values as JSON straight into a string, without building their fc::variant first
+    *
+    * The text is the same as fc::json::to_string gives for the variant of the value.  Reflected structs, containers,
+    * optionals and static variants are written piece by piece, so building the variant of a large block or object
+    * costs no more than that of its largest scalar member; the scalars, such as numbers, strings and ids, are written
+    * through their variant, which keeps their formatting the same by construction.
+    */
+   class json_writer
+   {
+      public:
+         explicit json_writer( string& out ) : _out( out ) {}
+
+         template<typename T>
+         json_writer& write( const T& value )
+         {
+            write_value( value );
+            return *this;
+         }
+
+      private:
+         template<typename T>
+         struct is_struct : std::integral_constant<bool, fc::reflector<T>::is_defined::value
+                                                         && !fc::reflector<T>::is_enum::value
+                                                         && !json_leaf<T>::value> {};
+
+         template<typename T>
+         void write_value( const T& value ) { write_value( value, is_struct<T>() ); }
+
+         template<typename T>
+         void write_value( const T& value, std::false_type )
+         {
+            _out += fc::json::to_string( fc::variant( value ) );
+         }
+         template<typename T>
+         void write_value( const T& value, std::true_type )
+         {
+            _out += '{';
+            bool first = true;
+            fc::reflector<T>::visit( member_writer<T>( *this, value, first ) );
+            _out += '}';
+         }
+
+         template<typename T>
+         void write_value( const fc::optional<T>& value )
+         {
+            if( value.valid() )
+               write_value( *value );
+            else
+               _out += "null";
+         }
+         template<typename A, typename B>
+         void write_value( const std::pair<A,B>& value )
+         {
+            _out += '[';
+            write_value( value.first );
+            _out += ',';
+            write_value( value.second );
+            _out += ']';
+         }
+         /// vector<char> is written as hex, through its variant
+         void write_value( const vector<char>& value ) { write_value( value, std::false_type() ); }
+         template<typename T>
+         void write_value( const vector<T>& value ) { write_sequence( value ); }
+         template<typename T>
+         void write_value( const fc::flat_set<T>& value ) { write_sequence( value ); }
+         template<typename K, typename V>
+         void write_value( const fc::flat_map<K,V>& value ) { write_sequence( value ); }
+         template<typename... Types>
+         void write_value( const fc::static_variant<Types...>& value )
+         {
+            _out += '[';
+            _out += fc::to_string( int64_t( value.which() ) );
+            _out += ',';
+            alternative_writer visitor( *this );
+            value.visit( visitor );
+            _out += ']';
+         }
+
+         template<typename Sequence>
+         void write_sequence( const Sequence& values )
+         {
+            _out += '[';
+            bool first = true;
+            for( const auto& value : values )
+            {
+               if( !first )
+                  _out += ',';
+               first = false;
+               write_value( value );
+            }
+            _out += ']';
+         }
+
+         void write_key( const char* name, bool& first )
+         {
+            if( !first )
+               _out += ',';
+            first = false;
+            _out += '"';
+            _out += name;
+            _out += "\":";
+         }
+
+         /// Writes the members in the order fc::to_variant adds them, leaving out unset optional ones as it does
+         template<typename T>
+         struct member_writer
+         {
+            member_writer( json_writer& w, const T& v, bool& f ) : writer( w ), value( v ), first( f ) {}
+
+            template<typename Member, class Class, Member (Class::*member)>
+            void operator()( const char* name )const { write( name, value.*member ); }
+
+            template<typename M>
+            void write( const char* name, const fc::optional<M>& member )const
+            {
+               if( member.valid() )
+               {
+                  writer.write_key( name, first );
+                  writer.write_value( *member );
+               }
+            }
+            template<typename M>
+            void write( const char* name, const M& member )const
+            {
+               writer.write_key( name, first );
+               writer.write_value( member );
+            }
+
+            json_writer& writer;
+            const T&     value;
+            bool&        first;
+         };
+
+         struct alternative_writer
+         {
+            typedef void result_type;
+            alternative_writer( json_writer& w ) : writer( w ) {}
+            template<typename T>
+            void operator()( const T& value )const { writer.write_value( value ); }
+            json_writer& writer;
+         };
+
+         string& _out;
+   };
+
+   /// @return the JSON text of value, the same as fc::json::to_string( fc::variant( value ) )
+   template<typename T>
+   string to_json_string( const T& value )
+   {
+      string result;
+      json_writer( result ).write( value );
+      return result;
+   }
+
+} } // graphene::app
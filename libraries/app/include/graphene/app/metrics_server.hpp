@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <fc/network/tcp_socket.hpp>
+#include <fc/thread/future.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace graphene { namespace app {
+
+   /**
+    * @brief Serves the metrics registry of the process over HTTP, for scrapers such as Prometheus
+    *
+    * Every GET of /metrics is answered with graphene::utilities::metrics() rendered in the Prometheus text format,
+    * and the connection is closed after the response.  Anything else gets a 404.
+    */
+   class metrics_server
+   {
+      public:
+         metrics_server();
+         ~metrics_server();
+
+         void             listen( const fc::ip::endpoint& ep );
+         fc::ip::endpoint get_local_endpoint()const;
+
+         /// The whole HTTP response to a request, given up to the blank line after its headers, for testing
+         static std::string respond( const std::string& request_head );
+
+      private:
+         void accept_loop();
+         void serve( const std::shared_ptr<fc::tcp_socket>& sock );
+
+         fc::tcp_server                                                   _tcp_server;
+         fc::future<void>                                                 _accept_loop_complete;
+         std::map<std::shared_ptr<fc::tcp_socket>, fc::future<void>>      _connections;
+   };
+
+} }
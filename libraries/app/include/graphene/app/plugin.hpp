@@ -52,6 +52,21 @@ class abstract_plugin
        */
       virtual void plugin_startup() = 0;
 
+      /**
+       * @brief The names of the plugins which must have started before this one starts
+       *
+       * Plugins start concurrently, each as soon as those it depends on have.
+       */
+      virtual std::vector<std::string> plugin_dependencies()const { return std::vector<std::string>(); }
+
+      /**
+       * @brief Whether the plugin is serving normally
+       *
+       * A plugin may start work which takes a while, such as rebuilding an index, in the background, and answer
+       * incompletely until it is done.  This is reported through the API, so clients can wait for it.
+       */
+      virtual bool plugin_is_ready()const { return true; }
+
       /**
        * @brief Cleanly shut down the plugin.
        *
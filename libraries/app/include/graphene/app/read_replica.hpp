@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/chain/database.hpp>
+
+#include <fc/thread/thread.hpp>
+
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <atomic>
+
+namespace graphene { namespace app {
+
+   /**
+    * @brief A copy of the chain state as of the head block, which the API reads on worker threads
+    *
+    * After each block, the objects the block created, modified or removed are packed on the chain thread and applied
+    * to the copy on an update thread, so neither the chain thread nor the API wait on each other.  Each query holds a
+    * shared lock on the copy while it runs, and each update an exclusive one, so a query sees the state as of one
+    * block, never part of one.  The copy leaves out the pending transactions and the indexes added by plugins.
+    *
+    * When a block does not follow the one the copy was last brought up to, as after a switch to another fork or
+    * while the undo history was disabled, the whole state is copied again.
+    */
+   class read_replica
+   {
+      public:
+         /**
+          * @param db The database copied, which must be open
+          * @param threads The worker threads running the queries, of which there must be at least one
+          */
+         read_replica( graphene::chain::database& db, const utilities::thread_group& threads );
+         ~read_replica();
+
+         /**
+          * Runs query on one of the worker threads against the copy, waiting for its result
+          *
+          * @param query Called with the copy; it must not keep references into it once it returns.  It may read again,
+          * as the calls of a batch do, which then runs in the same query.
+          */
+         template<typename Query>
+         auto read( Query&& query ) -> decltype( query( std::declval<const graphene::chain::database&>() ) )
+         {
+            // A query made by another query on a worker thread already holds the lock, and must not wait for it
+            if( is_worker_thread() )
+               return query( static_cast<const graphene::chain::database&>( *_copy ) );
+            auto& thread = *_threads[_next_thread++ % _threads.size()];
+            return thread.async( [this,&query]() {
+               boost::shared_lock<boost::shared_mutex> lock( _copy_mutex );
+               return query( static_cast<const graphene::chain::database&>( *_copy ) );
+            }, "read_replica::read" ).wait();
+         }
+
+         /// Waits for the changes of the blocks applied so far to reach the copy
+         void wait_for_updates();
+
+         /// @return true if the copy has the index of objects like id
+         bool is_copied( object_id_type id )const { return _copy_indexes.count( object_id_type( id.space(), id.type(), 0 ) ); }
+
+         /// @return true when called from a query, on one of the worker threads
+         bool is_worker_thread()const;
+
+      private:
+         void on_applied_block( const signed_block& b );
+         void on_affected_objects( const vector<object_id_type>& ids );
+         /// Queues changes to be applied on the update thread; a full copy replaces the copy altogether
+         void update( shared_ptr<const db::object_changes> changes, bool full );
+
+         graphene::chain::database&                          _db;
+         unique_ptr<graphene::chain::database>               _copy;
+         boost::shared_mutex                                 _copy_mutex;
+         /// The indexes of the copy, by the id of their first object, which is fixed once the copy is constructed
+         std::set<object_id_type>                            _copy_indexes;
+         utilities::thread_group                             _threads;
+         std::atomic<uint32_t>                               _next_thread;
+         fc::thread                                          _update_thread;
+
+         /// Only touched on the chain thread: the last block applied, and the one the copy is brought up to
+         block_id_type                                       _applied_head;
+         block_id_type                                       _copied_head;
+         /// Set when the block being applied does not follow _copied_head
+         bool                                                _copy_needed = false;
+         boost::signals2::scoped_connection                  _applied_block_connection;
+         boost::signals2::scoped_connection                  _affected_objects_connection;
+   };
+
+} }
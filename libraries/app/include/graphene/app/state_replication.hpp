@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/chain/database.hpp>
+
+#include <fc/network/tcp_socket.hpp>
+#include <fc/thread/future.hpp>
+
+#include <deque>
+
+namespace graphene { namespace app {
+
+   /**
+    * One step of the replication stream: the objects a block changed, the undoing of a block, or the whole state
+    */
+   struct state_diff
+   {
+      enum step_type
+      {
+         apply_block = 0, ///< changes holds the objects the block created, modified and removed
+         undo_block  = 1, ///< the block is popped, as when switching forks; changes is empty
+         full_state  = 2  ///< changes holds every object, which replaces the state as of the block
+      };
+
+      uint8_t                                  step = apply_block;
+      /// The block applied or undone, or the head block of the full state
+      block_id_type                            block_id;
+      /// The header of block_id, when the publisher has the block
+      optional<chain::signed_block_header>     header;
+      db::object_changes                       changes;
+   };
+
+   /**
+    * @brief Publishes the changes of every block applied to a database, for replicas to apply without evaluating
+    *
+    * Each subscriber is sent the full state when it connects, then a @ref state_diff of every block with the objects
+    * packed by object::pack(), in the order they are applied.  When the chain switches forks, the blocks popped are
+    * sent as undo steps before the blocks of the new fork; when a block does not follow any block sent, as when the
+    * undo history was disabled, the full state is sent again.
+    *
+    * Each frame is a 32 bit little endian size followed by that many bytes of a packed state_diff.  Replicas are
+    * trusted with the whole state and nothing they send is read, so the endpoint belongs on a private network.
+    */
+   class state_replication_server
+   {
+      public:
+         state_replication_server( graphene::chain::database& db );
+         ~state_replication_server();
+
+         void             listen( const fc::ip::endpoint& ep );
+         fc::ip::endpoint get_local_endpoint()const;
+
+         /// A subscriber which falls this many frames behind is disconnected, and gets the full state on reconnecting
+         static const size_t max_queued_frames = 1024;
+
+      private:
+         typedef std::shared_ptr<const vector<char>> frame_ptr;
+         struct subscriber
+         {
+            std::deque<frame_ptr> frames;
+            fc::future<void>      writer;
+         };
+         typedef std::shared_ptr<fc::tcp_socket> socket_ptr;
+
+         void on_applied_block( const signed_block& b );
+         void on_affected_objects( const vector<object_id_type>& ids );
+         frame_ptr pack_full_state()const;
+         void publish( const state_diff& diff );
+         void queue( const socket_ptr& sock, const frame_ptr& frame );
+         void write_frames( const socket_ptr& sock );
+         void accept_loop();
+
+         graphene::chain::database&                 _db;
+         /// The blocks sent, the newest last, as far back as a fork switch can undo
+         std::deque<block_id_type>                  _published;
+         /// The block being applied, and whether it follows the last block sent
+         optional<chain::signed_block_header>       _applied;
+         bool                                       _full_state_needed = false;
+
+         fc::tcp_server                             _tcp_server;
+         fc::future<void>                           _accept_loop_complete;
+         map<socket_ptr, subscriber>                _subscribers;
+         boost::signals2::scoped_connection         _applied_block_connection;
+         boost::signals2::scoped_connection         _affected_objects_connection;
+   };
+
+   /**
+    * @brief Keeps a database up to date with the stream of a @ref state_replication_server
+    *
+    * The database only serves reads: no block is evaluated, and its objects are replaced by those sent.  Each block
+    * is applied in an undo session of its own, so that an undo step pops it as pop_block would.  The changed objects
+    * are announced through changed_objects, though applied_block is never emitted.  When the connection drops, the
+    * client connects again and gets the full state.
+    */
+   class state_replication_client
+   {
+      public:
+         state_replication_client( graphene::chain::database& db );
+         ~state_replication_client();
+
+         /// Starts following the server at ep, connecting again whenever the connection drops
+         void connect( const fc::ip::endpoint& ep );
+
+         /// Applies one step of the stream to the database
+         void apply( const state_diff& diff );
+
+      private:
+         void follow( const fc::ip::endpoint& ep );
+
+         graphene::chain::database&                 _db;
+         std::shared_ptr<fc::tcp_socket>            _socket;
+         fc::future<void>                           _follow_complete;
+   };
+
+} }
+
+FC_REFLECT( graphene::app::state_diff, (step)(block_id)(header)(changes) )
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/app/api.hpp>
+
+#include <fc/thread/future.hpp>
+
+#include <deque>
+
+namespace graphene { namespace app {
+
+   /**
+    * @brief Dispatches the push notifications of every database_api connected to one database
+    *
+    * The hub is the only listener on the database's applied_block and changed_objects signals, so the work done on
+    * the chain thread for each block depends on what changed and on how many distinct objects, markets and order books
+    * are watched, not on how many clients watch them.  Subscribers are indexed by what they watch; each block's changes
+    * are looked up in those indexes once, and the resulting notifications are appended to the queue of each subscriber
+    * concerned.  Every subscriber drains its own queue in its own task, so a slow connection only delays itself.
+    *
+    * A change to an object which is still queued for a subscriber replaces the queued value, so a client which falls
+    * behind receives only the latest version of each object.  The bytes queued for each subscriber may be capped, in
+    * which case a subscriber over the cap either loses its oldest notifications or all of its subscriptions.
+    */
+   class subscription_hub
+   {
+      public:
+         typedef std::function<void(const fc::variant&)> callback_type;
+         typedef uint64_t                                subscriber_id;
+         typedef pair<asset_id_type,asset_id_type>      market_type;
+         /// A changed value as sent to subscribers, serialized once and shared by all of their queues
+         typedef std::shared_ptr<const fc::variant>      serialized_value;
+
+         /// What happens to a subscriber whose queue would grow past the limit
+         enum overflow_policy
+         {
+            drop_oldest, ///< the oldest queued notifications are discarded to make room
+            unsubscribe  ///< the queue and every subscription of the subscriber are dropped
+         };
+
+         subscription_hub(graphene::chain::database& db);
+         ~subscription_hub();
+
+         /// @param max_queued_bytes the most serialized bytes queued for one subscriber, 0 for no limit
+         void set_queue_limit(uint64_t max_queued_bytes, overflow_policy policy);
+
+         /// @return a new subscriber, which must be removed with @ref remove_subscriber once it is gone
+         subscriber_id add_subscriber();
+         /// Drops all subscriptions of s and any notifications still queued for it
+         void remove_subscriber(subscriber_id s);
+
+         void subscribe_to_objects(subscriber_id s, const callback_type& callback, const vector<object_id_type>& ids);
+         void unsubscribe_from_objects(subscriber_id s, const vector<object_id_type>& ids);
+         /// @param market the pair of assets, lower id first
+         void subscribe_to_market(subscriber_id s, const callback_type& callback, market_type market);
+         void unsubscribe_from_market(subscriber_id s, market_type market);
+         void subscribe_to_order_book(subscriber_id s, const callback_type& callback,
+                                      asset_id_type base, asset_id_type quote, uint32_t depth);
+         void unsubscribe_from_order_book(subscriber_id s, asset_id_type base, asset_id_type quote);
+         void subscribe_to_transaction(subscriber_id s, const callback_type& callback, transaction_id_type id);
+         void unsubscribe_from_transaction(subscriber_id s, transaction_id_type id);
+         void cancel_all_subscriptions(subscriber_id s);
+
+         /// @return the best depth levels of each side of the book between base and quote in db
+         static order_book get_order_book(const graphene::chain::database& db,
+                                          asset_id_type base, asset_id_type quote, uint32_t depth);
+
+      private:
+         void on_objects_changed(const vector<object_id_type>& ids);
+         void on_applied_block(const signed_block& block);
+         void notify_order_book_changes();
+         /// Records the watched transactions of block, and the inclusions which became irreversible with it
+         void notify_transaction_confirmations(const signed_block& block);
+
+         /// Starts the task which fans the pending changes out, unless it is already scheduled
+         void schedule_dispatch();
+         void dispatch_changes();
+         /// Queues a call of callback with value for s, starting the delivery task of s if it is idle.  A value of
+         /// object replaces the one already queued for it, if any
+         void enqueue(subscriber_id s, const callback_type& callback, const serialized_value& value, uint64_t bytes,
+                      optional<object_id_type> object = optional<object_id_type>());
+         void deliver(subscriber_id s);
+
+         /// The order books followed to the same depth share one copy of the book as of the last block
+         typedef std::tuple<asset_id_type,asset_id_type,uint32_t> order_book_key;
+         struct order_book_group
+         {
+            order_book             last;
+            std::set<subscriber_id> subscribers;
+         };
+
+         struct notification
+         {
+            callback_type                                       callback;
+            serialized_value                                    value;
+            uint64_t                                            bytes = 0;
+            optional<object_id_type>                            object;
+         };
+
+         struct subscriber
+         {
+            map<object_id_type, callback_type>                  objects;
+            map<market_type, callback_type>                     markets;
+            /// Keyed by base and quote, like the public API, the depth being kept with the callback
+            map<pair<asset_id_type,asset_id_type>, pair<uint32_t,callback_type>> order_books;
+            map<transaction_id_type, callback_type>             transactions;
+            std::deque<notification>                            queue;
+            /// The number of notifications ever taken off the front of queue, so queued_objects can index it
+            uint64_t                                            dequeued = 0;
+            /// The position, counted from the first notification ever queued, of each object's queued value
+            map<object_id_type, uint64_t>                       queued_objects;
+            uint64_t                                            queued_bytes = 0;
+            /// Set while notifications are being dropped, so each overflow is logged once
+            bool                                                overflowing = false;
+            fc::future<void>                                    delivery;
+         };
+
+         /// Takes the front notification off the queue of sub
+         notification pop_notification(subscriber& sub);
+
+         graphene::chain::database&                             _db;
+         subscriber_id                                          _next_subscriber_id = 0;
+         map<subscriber_id, subscriber>                         _subscribers;
+         map<object_id_type, std::set<subscriber_id>>           _object_subscribers;
+         map<market_type, std::set<subscriber_id>>              _market_subscribers;
+         map<order_book_key, order_book_group>                  _order_book_groups;
+         map<transaction_id_type, std::set<subscriber_id>>      _transaction_subscribers;
+         /// The last inclusion of each watched transaction whose block is not irreversible yet
+         map<transaction_id_type, transaction_confirmation>     _included_transactions;
+         uint64_t                                               _max_queued_bytes = 0;
+         overflow_policy                                        _overflow_policy = drop_oldest;
+         /// Over the limit with the unsubscribe policy during the current dispatch
+         vector<subscriber_id>                                  _overflowed_subscribers;
+
+         /// Changed since the last dispatch; objects are read when dispatched, so each is sent once in its latest state
+         std::set<object_id_type>                               _pending_objects;
+         /// The operations of each block which changed a watched market
+         vector<pair<market_type, vector<pair<operation, operation_result>>>> _pending_market_changes;
+         /// The levels of each block which changed in a followed order book
+         vector<pair<order_book_key, order_book>>               _pending_order_book_changes;
+         /// The inclusions of watched transactions, and their becoming irreversible, in the order they happened
+         vector<transaction_confirmation>                       _pending_confirmations;
+         fc::future<void>                                       _dispatch_changes_complete;
+         boost::signals2::scoped_connection                     _change_connection;
+         boost::signals2::scoped_connection                     _applied_block_connection;
+   };
+
+} }
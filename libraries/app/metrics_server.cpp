@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/app/metrics_server.hpp>
+
+#include <graphene/utilities/metrics.hpp>
+
+#include <fc/log/logger.hpp>
+#include <fc/thread/thread.hpp>
+
+namespace graphene { namespace app {
+
+   namespace {
+      /// Requests with longer heads are taken for a broken client, which is disconnected
+      const size_t max_request_head_size = 8 * 1024;
+
+      std::string http_response( const std::string& status, const std::string& content_type, const std::string& body )
+      {
+         return "HTTP/1.1 " + status + "\r\n"
+                "Content-Type: " + content_type + "\r\n"
+                "Content-Length: " + std::to_string( body.size() ) + "\r\n"
+                "Connection: close\r\n"
+                "\r\n" + body;
+      }
+   }
+
+   metrics_server::metrics_server() {}
+
+   metrics_server::~metrics_server()
+   {
+      try {
+         _tcp_server.close();
+         if( _accept_loop_complete.valid() )
+            _accept_loop_complete.cancel_and_wait( __FUNCTION__ );
+      } catch( const fc::exception& e )
+      {
+         wlog( "${e}", ("e",e.to_detail_string()) );
+      }
+      auto connections = std::move( _connections );
+      for( auto& item : connections )
+      {
+         try {
+            item.first->close();
+            item.second.cancel_and_wait( __FUNCTION__ );
+         } catch( const fc::exception& e )
+         {
+            wlog( "${e}", ("e",e.to_detail_string()) );
+         }
+      }
+   }
+
+   void metrics_server::listen( const fc::ip::endpoint& ep )
+   {
+      _tcp_server.set_reuse_address();
+      _tcp_server.listen( ep );
+      _accept_loop_complete = fc::async( [this](){ accept_loop(); }, "metrics_server::accept_loop" );
+   }
+
+   fc::ip::endpoint metrics_server::get_local_endpoint()const
+   {
+      return _tcp_server.get_local_endpoint();
+   }
+
+   void metrics_server::accept_loop()
+   {
+      while( !_accept_loop_complete.canceled() )
+      {
+         auto sock = std::make_shared<fc::tcp_socket>();
+         try {
+            _tcp_server.accept( *sock );
+         } catch( const fc::canceled_exception& )
+         {
+            throw;
+         } catch( const fc::exception& e )
+         {
+            wlog( "Stopped accepting metrics connections: ${e}", ("e",e.to_detail_string()) );
+            return;
+         }
+         _connections[sock] = fc::async( [this,sock](){ serve( sock ); }, "metrics_server::serve" );
+      }
+   }
+
+   void metrics_server::serve( const std::shared_ptr<fc::tcp_socket>& sock )
+   {
+      try {
+         std::string head;
+         char buffer[1024];
+         while( head.find( "\r\n\r\n" ) == std::string::npos )
+         {
+            FC_ASSERT( head.size() <= max_request_head_size, "Metrics request too large" );
+            size_t size = sock->readsome( buffer, sizeof(buffer) );
+            head.append( buffer, size );
+         }
+         const std::string response = respond( head );
+         sock->write( response.data(), response.size() );
+         sock->flush();
+         sock->close();
+      } catch( const fc::canceled_exception& )
+      {
+         throw;
+      } catch( const fc::exception& e )
+      {
+         dlog( "Metrics connection closed: ${e}", ("e",e.to_string()) );
+      }
+      // Our own future is dropped last, once nothing of this task is touched any more
+      _connections.erase( sock );
+   }
+
+   std::string metrics_server::respond( const std::string& request_head )
+   {
+      // Only the request line matters: the method, then the path, which may carry a query
+      const size_t method_end = request_head.find( ' ' );
+      const size_t path_end = method_end == std::string::npos ? method_end
+                                                              : request_head.find_first_of( " ?\r", method_end + 1 );
+      if( path_end == std::string::npos || request_head.compare( 0, method_end, "GET" ) != 0
+          || request_head.compare( method_end + 1, path_end - method_end - 1, "/metrics" ) != 0 )
+         return http_response( "404 Not Found", "text/plain", "Not found, try /metrics\n" );
+      return http_response( "200 OK", "text/plain; version=0.0.4", utilities::metrics().render() );
+   }
+
+} }
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/app/read_replica.hpp>
+
+namespace graphene { namespace app {
+
+   read_replica::read_replica( graphene::chain::database& db, const utilities::thread_group& threads )
+   :_db(db),
+    _copy(new graphene::chain::database()),
+    _threads(threads),
+    _next_thread(0),
+    _update_thread("read_replica")
+   {
+      FC_ASSERT( !_threads.empty() );
+      _copy->_undo_db.disable();
+      for( auto id : _copy->pack_all_objects()->next_ids )
+         _copy_indexes.insert( object_id_type( id.space(), id.type(), 0 ) );
+
+      _applied_block_connection = _db.applied_block.connect( [this]( const signed_block& b ){ on_applied_block( b ); } );
+      _affected_objects_connection = _db.affected_objects.connect( [this]( const vector<object_id_type>& ids ){
+         on_affected_objects( ids );
+      });
+
+      _copied_head = _applied_head = _db.head_block_id();
+      update( _db.pack_all_objects(), true );
+   }
+
+   read_replica::~read_replica()
+   {
+      _applied_block_connection.disconnect();
+      _affected_objects_connection.disconnect();
+      // Let the queued updates finish before the copy goes away
+      wait_for_updates();
+   }
+
+   void read_replica::wait_for_updates()
+   {
+      _update_thread.async( []{} ).wait();
+   }
+
+   bool read_replica::is_worker_thread()const
+   {
+      const fc::thread* current = &fc::thread::current();
+      for( const auto& thread : _threads )
+         if( thread.get() == current )
+            return true;
+      return false;
+   }
+
+   /** note: called before affected_objects, which is only emitted while the undo history is enabled */
+   void read_replica::on_applied_block( const signed_block& b )
+   {
+      if( b.previous != _copied_head )
+         _copy_needed = true;
+      _applied_head = b.id();
+   }
+
+   void read_replica::on_affected_objects( const vector<object_id_type>& ids )
+   {
+      if( _copy_needed )
+      {
+         ilog( "Copying the state for the API again at block ${b}", ("b", block_header::num_from_id(_applied_head)) );
+         update( _db.pack_all_objects(), true );
+      }
+      else
+         update( _db.pack_objects( ids ), false );
+      _copy_needed = false;
+      _copied_head = _applied_head;
+   }
+
+   void read_replica::update( shared_ptr<const db::object_changes> changes, bool full )
+   {
+      // Tasks run in the order they are queued, so the copy goes through the blocks in order
+      _update_thread.async( [this,changes,full]() {
+         if( full )
+         {
+            unique_ptr<graphene::chain::database> copy( new graphene::chain::database() );
+            copy->_undo_db.disable();
+            copy->apply_changes( *changes );
+            boost::unique_lock<boost::shared_mutex> lock( _copy_mutex );
+            _copy.swap( copy );
+         }
+         else
+         {
+            boost::unique_lock<boost::shared_mutex> lock( _copy_mutex );
+            _copy->apply_changes( *changes );
+         }
+      }, "read_replica::update" );
+   }
+
+} }
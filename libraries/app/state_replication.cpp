@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/app/state_replication.hpp>
+
+#include <fc/io/raw.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <cstring>
+
+namespace graphene { namespace app {
+
+   namespace {
+      /// Packs diff into a frame, behind its size
+      std::shared_ptr<const vector<char>> pack_frame( const state_diff& diff )
+      {
+         const uint32_t size = fc::raw::pack_size( diff );
+         auto frame = std::make_shared<vector<char>>( sizeof(size) + size );
+         memcpy( frame->data(), &size, sizeof(size) );
+         fc::datastream<char*> ds( frame->data() + sizeof(size), size );
+         fc::raw::pack( ds, diff );
+         return frame;
+      }
+   }
+
+   state_replication_server::state_replication_server( graphene::chain::database& db )
+   :_db(db)
+   {
+      _applied_block_connection = _db.applied_block.connect( [this]( const signed_block& b ){ on_applied_block( b ); } );
+      _affected_objects_connection = _db.affected_objects.connect( [this]( const vector<object_id_type>& ids ){
+         on_affected_objects( ids );
+      });
+      _published.push_back( _db.head_block_id() );
+   }
+
+   state_replication_server::~state_replication_server()
+   {
+      _applied_block_connection.disconnect();
+      _affected_objects_connection.disconnect();
+      try {
+         _tcp_server.close();
+         if( _accept_loop_complete.valid() )
+            _accept_loop_complete.cancel_and_wait( __FUNCTION__ );
+      } catch( const fc::exception& e )
+      {
+         wlog( "${e}", ("e",e.to_detail_string()) );
+      }
+      auto subscribers = std::move( _subscribers );
+      for( auto& item : subscribers )
+      {
+         try {
+            item.first->close();
+            if( item.second.writer.valid() && !item.second.writer.ready() )
+               item.second.writer.cancel_and_wait( __FUNCTION__ );
+         } catch( const fc::exception& e )
+         {
+            wlog( "${e}", ("e",e.to_detail_string()) );
+         }
+      }
+   }
+
+   void state_replication_server::listen( const fc::ip::endpoint& ep )
+   {
+      _tcp_server.set_reuse_address();
+      _tcp_server.listen( ep );
+      _accept_loop_complete = fc::async( [this](){ accept_loop(); }, "state_replication_server::accept_loop" );
+   }
+
+   fc::ip::endpoint state_replication_server::get_local_endpoint()const
+   {
+      return _tcp_server.get_local_endpoint();
+   }
+
+   void state_replication_server::accept_loop()
+   {
+      while( !_accept_loop_complete.canceled() )
+      {
+         auto sock = std::make_shared<fc::tcp_socket>();
+         try {
+            _tcp_server.accept( *sock );
+         } catch( const fc::canceled_exception& )
+         {
+            throw;
+         } catch( const fc::exception& e )
+         {
+            wlog( "Stopped accepting replicas: ${e}", ("e",e.to_detail_string()) );
+            return;
+         }
+         ilog( "Replica connected from ${ep}", ("ep",sock->remote_endpoint()) );
+         _subscribers[sock];
+         queue( sock, pack_full_state() );
+      }
+   }
+
+   /** note: called before affected_objects, which is only emitted while the undo history is enabled */
+   void state_replication_server::on_applied_block( const signed_block& b )
+   {
+      _applied = chain::signed_block_header( b );
+      auto sent = std::find( _published.rbegin(), _published.rend(), b.previous );
+      if( sent == _published.rend() )
+      {
+         _full_state_needed = true;
+         return;
+      }
+      // The blocks sent after the one this block follows were popped
+      while( _published.back() != b.previous )
+      {
+         state_diff diff;
+         diff.step = state_diff::undo_block;
+         diff.block_id = _published.back();
+         publish( diff );
+         _published.pop_back();
+      }
+   }
+
+   void state_replication_server::on_affected_objects( const vector<object_id_type>& ids )
+   {
+      if( !_applied )
+         return;
+      state_diff diff;
+      diff.block_id = _applied->id();
+      diff.header = *_applied;
+      if( _full_state_needed )
+      {
+         ilog( "Sending the whole state to the replicas again at block ${b}", ("b", _applied->block_num()) );
+         _published.clear();
+         diff.step = state_diff::full_state;
+         diff.changes = std::move( *_db.pack_all_objects() );
+      }
+      else
+      {
+         diff.step = state_diff::apply_block;
+         diff.changes = std::move( *_db.pack_objects( ids ) );
+      }
+      publish( diff );
+
+      _published.push_back( diff.block_id );
+      while( _published.size() > std::max<size_t>( _db.get_global_properties().parameters.maximum_undo_history, 1 ) )
+         _published.pop_front();
+      _applied.reset();
+      _full_state_needed = false;
+   }
+
+   state_replication_server::frame_ptr state_replication_server::pack_full_state()const
+   {
+      state_diff diff;
+      diff.step = state_diff::full_state;
+      diff.block_id = _db.head_block_id();
+      if( _db.head_block_num() > 0 )
+         diff.header = _db.fetch_block_header_by_id( diff.block_id );
+      diff.changes = std::move( *_db.pack_all_objects() );
+      return pack_frame( diff );
+   }
+
+   void state_replication_server::publish( const state_diff& diff )
+   {
+      if( _subscribers.empty() )
+         return;
+      // Every subscriber is sent the same bytes, so they are packed once
+      const frame_ptr frame = pack_frame( diff );
+      vector<socket_ptr> sockets;
+      for( const auto& item : _subscribers )
+         sockets.push_back( item.first );
+      for( const auto& sock : sockets )
+         queue( sock, frame );
+   }
+
+   void state_replication_server::queue( const socket_ptr& sock, const frame_ptr& frame )
+   {
+      auto itr = _subscribers.find( sock );
+      if( itr == _subscribers.end() )
+         return;
+      subscriber& sub = itr->second;
+      if( sub.frames.size() >= max_queued_frames )
+      {
+         wlog( "Disconnecting a replica which is ${n} blocks behind", ("n",sub.frames.size()) );
+         // The writer erases the subscriber once the failed write returns
+         sock->close();
+         sub.frames.clear();
+         return;
+      }
+      sub.frames.push_back( frame );
+      if( !sub.writer.valid() || sub.writer.ready() )
+         sub.writer = fc::async( [this,sock](){ write_frames( sock ); }, "state_replication_server::write_frames" );
+   }
+
+   void state_replication_server::write_frames( const socket_ptr& sock )
+   {
+      try {
+         for(;;)
+         {
+            auto itr = _subscribers.find( sock );
+            if( itr == _subscribers.end() || itr->second.frames.empty() )
+               return;
+            const frame_ptr frame = itr->second.frames.front();
+            sock->write( frame->data(), frame->size() );
+            sock->flush();
+            // Frames may have been queued, or the subscriber dropped, while writing
+            itr = _subscribers.find( sock );
+            if( itr != _subscribers.end() && !itr->second.frames.empty() )
+               itr->second.frames.pop_front();
+         }
+      } catch( const fc::canceled_exception& )
+      {
+         throw;
+      } catch( const fc::exception& e )
+      {
+         dlog( "Replica disconnected: ${e}", ("e",e.to_string()) );
+      }
+      // Our own future is dropped last, once nothing of this task is touched any more
+      _subscribers.erase( sock );
+   }
+
+   state_replication_client::state_replication_client( graphene::chain::database& db )
+   :_db(db)
+   {
+   }
+
+   state_replication_client::~state_replication_client()
+   {
+      try {
+         if( _socket )
+            _socket->close();
+         if( _follow_complete.valid() )
+            _follow_complete.cancel_and_wait( __FUNCTION__ );
+      } catch( const fc::exception& e )
+      {
+         wlog( "${e}", ("e",e.to_detail_string()) );
+      }
+   }
+
+   void state_replication_client::connect( const fc::ip::endpoint& ep )
+   {
+      FC_ASSERT( !_follow_complete.valid(), "Already following a replication server" );
+      _follow_complete = fc::async( [this,ep](){ follow( ep ); }, "state_replication_client::follow" );
+   }
+
+   void state_replication_client::follow( const fc::ip::endpoint& ep )
+   {
+      vector<char> frame;
+      while( !_follow_complete.canceled() )
+      {
+         try {
+            _socket = std::make_shared<fc::tcp_socket>();
+            _socket->connect_to( ep );
+            ilog( "Replicating the state of ${ep}", ("ep",ep) );
+            for(;;)
+            {
+               uint32_t size = 0;
+               _socket->read( reinterpret_cast<char*>(&size), sizeof(size) );
+               frame.resize( size );
+               if( size )
+                  _socket->read( frame.data(), size );
+               apply( fc::raw::unpack<state_diff>( frame ) );
+            }
+         } catch( const fc::canceled_exception& )
+         {
+            throw;
+         } catch( const fc::exception& e )
+         {
+            wlog( "Lost the replication stream of ${ep}, connecting again: ${e}", ("ep",ep)("e",e.to_string()) );
+         }
+         _socket->close();
+         fc::usleep( fc::seconds(1) );
+      }
+   }
+
+   void state_replication_client::apply( const state_diff& diff )
+   { try {
+      // Nothing is evaluated here, so there is no pending state to keep out of the way
+      _db.clear_pending();
+      vector<object_id_type> changed;
+      switch( diff.step )
+      {
+         case state_diff::full_state:
+         {
+            // The history of the previous state cannot undo into this one
+            _db._undo_db.discard_oldest( 0 );
+            _db._undo_db.disable();
+            _db.replace_all_objects( diff.changes );
+            _db._undo_db.enable();
+            break;
+         }
+         case state_diff::apply_block:
+         {
+            FC_ASSERT( diff.header && diff.header->previous == _db.head_block_id(),
+                       "The block does not follow the head block", ("block",diff.block_id)("head",_db.head_block_id()) );
+            auto session = _db._undo_db.start_undo_session();
+            _db.apply_changes( diff.changes );
+            session.commit();
+            break;
+         }
+         case state_diff::undo_block:
+         {
+            FC_ASSERT( diff.block_id == _db.head_block_id(), "Only the head block can be undone",
+                       ("block",diff.block_id)("head",_db.head_block_id()) );
+            // The objects the block modified or removed are back as they were
+            const auto undone = _db._undo_db.head_changes();
+            _db._undo_db.pop_commit();
+            changed = undone.modified;
+            changed.insert( changed.end(), undone.removed.begin(), undone.removed.end() );
+            break;
+         }
+         default:
+            FC_THROW( "Unknown replication step ${s}", ("s",diff.step) );
+      }
+      FC_ASSERT( _db.head_block_id() == diff.block_id || diff.step == state_diff::undo_block,
+                 "The state does not reach the block", ("block",diff.block_id)("head",_db.head_block_id()) );
+
+      if( diff.step != state_diff::undo_block )
+      {
+         changed.reserve( diff.changes.stored.size() );
+         for( const auto& item : diff.changes.stored )
+            changed.push_back( item.first );
+      }
+      _db.changed_objects( changed );
+   } FC_CAPTURE_AND_RETHROW( (diff.step)(diff.block_id) ) }
+
+} }
@@ -0,0 +1,557 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/app/subscription_hub.hpp>
+#include <graphene/chain/database.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/thread/thread.hpp>
+
+namespace graphene { namespace app {
+
+   namespace {
+      /// Appends the totals of the best depth levels selling sell for receive, best price first
+      void aggregate_levels( const market_order_book<limit_order_object>& book, asset_id_type sell, asset_id_type receive,
+                             uint32_t depth, vector<order_book_level>& result )
+      {
+         const auto* levels = book.levels( sell, receive );
+         if( !levels ) return;
+         for( const auto& level : *levels )
+         {
+            if( result.size() >= depth ) break;
+            order_book_level total;
+            total.sell_price = level.first;
+            total.orders = level.second.size();
+            for( const limit_order_object* order : level.second )
+               total.for_sale += order->for_sale;
+            result.push_back( total );
+         }
+      }
+
+      /// @return the levels of after which differ from before, and the levels of before which are gone, emptied
+      vector<order_book_level> level_deltas( const vector<order_book_level>& before, const vector<order_book_level>& after )
+      {
+         vector<order_book_level> deltas;
+         auto b = before.begin();
+         auto a = after.begin();
+         while( b != before.end() || a != after.end() )
+         {
+            if( a == after.end() || (b != before.end() && a->sell_price < b->sell_price) )
+            {
+               order_book_level gone = *b++;
+               gone.for_sale = 0;
+               gone.orders = 0;
+               deltas.push_back( gone );
+            }
+            else if( b == before.end() || b->sell_price < a->sell_price )
+               deltas.push_back( *a++ );
+            else
+            {
+               if( a->for_sale != b->for_sale || a->orders != b->orders )
+                  deltas.push_back( *a );
+               ++a, ++b;
+            }
+         }
+         return deltas;
+      }
+   }
+
+   subscription_hub::subscription_hub(graphene::chain::database& db):_db(db)
+   {
+      _change_connection = _db.changed_objects.connect([this](const vector<object_id_type>& ids) {
+                                   on_objects_changed(ids);
+                                   });
+      _applied_block_connection = _db.applied_block.connect([this](const signed_block& b){ on_applied_block(b); });
+   }
+
+   void subscription_hub::set_queue_limit(uint64_t max_queued_bytes, overflow_policy policy)
+   {
+      _max_queued_bytes = max_queued_bytes;
+      _overflow_policy = policy;
+   }
+
+   subscription_hub::~subscription_hub()
+   {
+      try {
+         if( _dispatch_changes_complete.valid() && !_dispatch_changes_complete.ready() )
+         {
+            _dispatch_changes_complete.cancel();
+            _dispatch_changes_complete.wait();
+         }
+      } catch (const fc::exception& e)
+      {
+         wlog("${e}", ("e",e.to_detail_string()));
+      }
+      for( auto& item : _subscribers )
+      {
+         try {
+            auto& delivery = item.second.delivery;
+            if( delivery.valid() && !delivery.ready() )
+            {
+               delivery.cancel();
+               delivery.wait();
+            }
+         } catch (const fc::exception& e)
+         {
+            wlog("${e}", ("e",e.to_detail_string()));
+         }
+      }
+   }
+
+   subscription_hub::subscriber_id subscription_hub::add_subscriber()
+   {
+      subscriber_id s = _next_subscriber_id++;
+      _subscribers[s];
+      return s;
+   }
+
+   void subscription_hub::remove_subscriber(subscriber_id s)
+   {
+      cancel_all_subscriptions(s);
+      // A delivery in progress finds the subscriber gone and stops
+      _subscribers.erase(s);
+   }
+
+   void subscription_hub::subscribe_to_objects(subscriber_id s, const callback_type& callback, const vector<object_id_type>& ids)
+   {
+      auto& sub = _subscribers.at(s);
+      for( auto id : ids )
+      {
+         sub.objects[id] = callback;
+         _object_subscribers[id].insert(s);
+      }
+   }
+
+   void subscription_hub::unsubscribe_from_objects(subscriber_id s, const vector<object_id_type>& ids)
+   {
+      auto& sub = _subscribers.at(s);
+      for( auto id : ids )
+      {
+         if( !sub.objects.erase(id) ) continue;
+         auto itr = _object_subscribers.find(id);
+         itr->second.erase(s);
+         if( itr->second.empty() )
+            _object_subscribers.erase(itr);
+      }
+   }
+
+   void subscription_hub::subscribe_to_market(subscriber_id s, const callback_type& callback, market_type market)
+   {
+      _subscribers.at(s).markets[market] = callback;
+      // Market updates are built from the applied operations, which are only captured while someone watches a market
+      if( _market_subscribers.empty() )
+         _db.add_applied_operations_consumer();
+      _market_subscribers[market].insert(s);
+   }
+
+   void subscription_hub::unsubscribe_from_market(subscriber_id s, market_type market)
+   {
+      if( !_subscribers.at(s).markets.erase(market) ) return;
+      auto itr = _market_subscribers.find(market);
+      itr->second.erase(s);
+      if( itr->second.empty() )
+      {
+         _market_subscribers.erase(itr);
+         if( _market_subscribers.empty() )
+            _db.remove_applied_operations_consumer();
+      }
+   }
+
+   void subscription_hub::subscribe_to_order_book(subscriber_id s, const callback_type& callback,
+                                                  asset_id_type base, asset_id_type quote, uint32_t depth)
+   {
+      FC_ASSERT( base != quote );
+      auto& sub = _subscribers.at(s);
+      unsubscribe_from_order_book( s, base, quote );
+      order_book_key key( base, quote, depth );
+      auto itr = _order_book_groups.find(key);
+      if( itr == _order_book_groups.end() )
+      {
+         order_book_group group;
+         group.last = get_order_book( _db, base, quote, depth );
+         itr = _order_book_groups.emplace( key, std::move(group) ).first;
+      }
+      itr->second.subscribers.insert(s);
+      sub.order_books[ std::make_pair(base,quote) ] = std::make_pair( depth, callback );
+   }
+
+   void subscription_hub::unsubscribe_from_order_book(subscriber_id s, asset_id_type base, asset_id_type quote)
+   {
+      auto& sub = _subscribers.at(s);
+      auto book = sub.order_books.find( std::make_pair(base,quote) );
+      if( book == sub.order_books.end() ) return;
+      auto itr = _order_book_groups.find( order_book_key( base, quote, book->second.first ) );
+      itr->second.subscribers.erase(s);
+      if( itr->second.subscribers.empty() )
+         _order_book_groups.erase(itr);
+      sub.order_books.erase(book);
+   }
+
+   void subscription_hub::subscribe_to_transaction(subscriber_id s, const callback_type& callback, transaction_id_type id)
+   {
+      _subscribers.at(s).transactions[id] = callback;
+      _transaction_subscribers[id].insert(s);
+   }
+
+   void subscription_hub::unsubscribe_from_transaction(subscriber_id s, transaction_id_type id)
+   {
+      if( !_subscribers.at(s).transactions.erase(id) ) return;
+      auto itr = _transaction_subscribers.find(id);
+      itr->second.erase(s);
+      if( itr->second.empty() )
+      {
+         _transaction_subscribers.erase(itr);
+         _included_transactions.erase(id);
+      }
+   }
+
+   void subscription_hub::cancel_all_subscriptions(subscriber_id s)
+   {
+      auto& sub = _subscribers.at(s);
+      vector<object_id_type> ids;
+      ids.reserve( sub.objects.size() );
+      for( const auto& item : sub.objects )
+         ids.push_back( item.first );
+      unsubscribe_from_objects( s, ids );
+      while( !sub.markets.empty() )
+         unsubscribe_from_market( s, sub.markets.begin()->first );
+      while( !sub.order_books.empty() )
+         unsubscribe_from_order_book( s, sub.order_books.begin()->first.first, sub.order_books.begin()->first.second );
+      while( !sub.transactions.empty() )
+         unsubscribe_from_transaction( s, sub.transactions.begin()->first );
+      sub.queue.clear();
+      sub.queued_objects.clear();
+      sub.queued_bytes = 0;
+   }
+
+   order_book subscription_hub::get_order_book(const graphene::chain::database& db,
+                                               asset_id_type base, asset_id_type quote, uint32_t depth)
+   {
+      FC_ASSERT( depth <= 100 );
+      order_book result;
+      result.base = base;
+      result.quote = quote;
+      aggregate_levels( db.get_limit_order_book(), base, quote, depth, result.asks );
+      aggregate_levels( db.get_limit_order_book(), quote, base, depth, result.bids );
+      return result;
+   }
+
+   void subscription_hub::on_objects_changed(const vector<object_id_type>& ids)
+   {
+      if( _object_subscribers.empty() )
+         return;
+      bool watched = false;
+      for( auto id : ids )
+         if( _object_subscribers.find(id) != _object_subscribers.end() )
+         {
+            _pending_objects.insert(id);
+            watched = true;
+         }
+      if( watched )
+         schedule_dispatch();
+   }
+
+   /** note: this method cannot yield because it is called in the middle of
+    * apply a block.
+    */
+   void subscription_hub::on_applied_block(const signed_block& block)
+   {
+      notify_order_book_changes();
+      notify_transaction_confirmations( block );
+      if( _market_subscribers.empty() )
+         return;
+
+      map< market_type, vector<pair<operation, operation_result>> > subscribed_markets_ops;
+      for( const auto& op : _db.get_applied_operations() )
+      {
+         market_type market;
+         switch( op.op.which() )
+         {
+            case operation::tag<limit_order_create_operation>::value:
+               market = op.op.get<limit_order_create_operation>().get_market();
+               break;
+            case operation::tag<short_order_create_operation>::value:
+               market = op.op.get<short_order_create_operation>().get_market();
+               break;
+            case operation::tag<fill_order_operation>::value:
+               market = op.op.get<fill_order_operation>().get_market();
+               break;
+               /*
+            case operation::tag<limit_order_cancel_operation>::value:
+            case operation::tag<short_order_cancel_operation>::value:
+            */
+            default: continue;
+         }
+         if( _market_subscribers.count(market) )
+            subscribed_markets_ops[market].push_back( std::make_pair( op.op, op.result ) );
+      }
+      if( subscribed_markets_ops.empty() )
+         return;
+
+      for( auto& item : subscribed_markets_ops )
+         _pending_market_changes.emplace_back( item.first, std::move(item.second) );
+      schedule_dispatch();
+   }
+
+   /** called from on_applied_block, so the books are compared as of the end of each block */
+   void subscription_hub::notify_order_book_changes()
+   {
+      bool changed = false;
+      for( auto& item : _order_book_groups )
+      {
+         auto& group = item.second;
+         order_book now = get_order_book( _db, std::get<0>(item.first), std::get<1>(item.first), std::get<2>(item.first) );
+         order_book delta;
+         delta.base = now.base;
+         delta.quote = now.quote;
+         delta.asks = level_deltas( group.last.asks, now.asks );
+         delta.bids = level_deltas( group.last.bids, now.bids );
+         group.last = std::move( now );
+         if( !delta.asks.empty() || !delta.bids.empty() )
+         {
+            _pending_order_book_changes.emplace_back( item.first, std::move(delta) );
+            changed = true;
+         }
+      }
+      if( changed )
+         schedule_dispatch();
+   }
+
+   void subscription_hub::notify_transaction_confirmations(const signed_block& block)
+   {
+      if( _transaction_subscribers.empty() )
+         return;
+      bool changed = false;
+
+      // One pass over the block, computing each id once
+      const uint32_t block_num = block.block_num();
+      for( uint32_t trx_num = 0; trx_num < block.transactions.size(); ++trx_num )
+      {
+         const processed_transaction& trx = block.transactions[trx_num];
+         const transaction_id_type id = trx.id();
+         if( !_transaction_subscribers.count(id) )
+            continue;
+         transaction_confirmation confirmation;
+         confirmation.id = id;
+         confirmation.block_num = block_num;
+         confirmation.block_id = block.id();
+         confirmation.trx_num = trx_num;
+         confirmation.operation_results = trx.operation_results;
+         _included_transactions[id] = confirmation;
+         _pending_confirmations.push_back( std::move(confirmation) );
+         changed = true;
+      }
+
+      const uint32_t last_irreversible = _db.get_dynamic_global_properties().last_irreversible_block_num;
+      for( auto itr = _included_transactions.begin(); itr != _included_transactions.end(); )
+      {
+         transaction_confirmation& confirmation = itr->second;
+         if( confirmation.block_num > last_irreversible )
+         {
+            ++itr;
+            continue;
+         }
+         // A block switched away from leaves the transaction watched, to be found in the block replacing it
+         if( _db.get_block_id_for_num( confirmation.block_num ) == confirmation.block_id )
+         {
+            confirmation.irreversible = true;
+            _pending_confirmations.push_back( std::move(confirmation) );
+            changed = true;
+         }
+         itr = _included_transactions.erase(itr);
+      }
+
+      if( changed )
+         schedule_dispatch();
+   }
+
+   void subscription_hub::schedule_dispatch()
+   {
+      if( _dispatch_changes_complete.valid() && !_dispatch_changes_complete.ready() )
+         return;
+      _dispatch_changes_complete = fc::async([this](){ dispatch_changes(); });
+   }
+
+   /** Subscribers are looked up here rather than when the changes are recorded, so those which unsubscribed in the
+    * meantime are skipped.  Each value is converted to a variant once, and that one copy is queued for every
+    * subscriber it is sent to, however many there are.  Its size on the wire is only worked out when the queues
+    * are limited.
+    */
+   void subscription_hub::dispatch_changes()
+   {
+      auto serialized_size = [this]( const fc::variant& value ) -> uint64_t {
+         return _max_queued_bytes ? fc::json::to_string( value ).size() : 0;
+      };
+
+      std::set<object_id_type> objects;
+      objects.swap( _pending_objects );
+      for( auto id : objects )
+      {
+         auto subscribers = _object_subscribers.find(id);
+         if( subscribers == _object_subscribers.end() )
+            continue;
+         const object* obj = _db.find_object(id);
+         if( !obj )
+            continue;
+         auto value = std::make_shared<const fc::variant>( obj->to_variant() );
+         uint64_t bytes = serialized_size( *value );
+         for( subscriber_id s : subscribers->second )
+            enqueue( s, _subscribers.at(s).objects.at(id), value, bytes, optional<object_id_type>(id) );
+      }
+
+      decltype(_pending_market_changes) markets;
+      markets.swap( _pending_market_changes );
+      for( const auto& item : markets )
+      {
+         auto subscribers = _market_subscribers.find(item.first);
+         if( subscribers == _market_subscribers.end() )
+            continue;
+         auto value = std::make_shared<const fc::variant>( item.second );
+         uint64_t bytes = serialized_size( *value );
+         for( subscriber_id s : subscribers->second )
+            enqueue( s, _subscribers.at(s).markets.at(item.first), value, bytes );
+      }
+
+      decltype(_pending_order_book_changes) books;
+      books.swap( _pending_order_book_changes );
+      for( const auto& item : books )
+      {
+         auto group = _order_book_groups.find(item.first);
+         if( group == _order_book_groups.end() )
+            continue;
+         auto value = std::make_shared<const fc::variant>( item.second );
+         uint64_t bytes = serialized_size( *value );
+         auto market = std::make_pair( std::get<0>(item.first), std::get<1>(item.first) );
+         for( subscriber_id s : group->second.subscribers )
+            enqueue( s, _subscribers.at(s).order_books.at(market).second, value, bytes );
+      }
+
+      decltype(_pending_confirmations) confirmations;
+      confirmations.swap( _pending_confirmations );
+      for( const auto& confirmation : confirmations )
+      {
+         auto subscribers = _transaction_subscribers.find(confirmation.id);
+         if( subscribers == _transaction_subscribers.end() )
+            continue;
+         auto value = std::make_shared<const fc::variant>( confirmation );
+         uint64_t bytes = serialized_size( *value );
+         // The subscription ends with the irreversible notification, so the subscribers are copied first
+         const std::set<subscriber_id> watching = subscribers->second;
+         for( subscriber_id s : watching )
+         {
+            enqueue( s, _subscribers.at(s).transactions.at(confirmation.id), value, bytes );
+            if( confirmation.irreversible )
+               unsubscribe_from_transaction( s, confirmation.id );
+         }
+      }
+
+      for( subscriber_id s : _overflowed_subscribers )
+      {
+         wlog("Canceling all subscriptions of subscriber ${s}, which is not keeping up", ("s", s));
+         cancel_all_subscriptions( s );
+         _subscribers.at(s).overflowing = false;
+      }
+      _overflowed_subscribers.clear();
+   }
+
+   void subscription_hub::enqueue(subscriber_id s, const callback_type& callback, const serialized_value& value,
+                                  uint64_t bytes, optional<object_id_type> object)
+   {
+      auto& sub = _subscribers.at(s);
+      if( object )
+      {
+         auto queued = sub.queued_objects.find( *object );
+         if( queued != sub.queued_objects.end() )
+         {
+            // The client hasn't been sent the previous version yet, so it gets this one in its place
+            notification& pending = sub.queue[queued->second - sub.dequeued];
+            sub.queued_bytes = sub.queued_bytes - pending.bytes + bytes;
+            pending.value = value;
+            pending.bytes = bytes;
+            return;
+         }
+      }
+
+      if( sub.overflowing && _overflow_policy == unsubscribe )
+         return;
+      if( _max_queued_bytes && sub.queued_bytes + bytes > _max_queued_bytes )
+      {
+         if( !sub.overflowing )
+            wlog("Subscriber ${s} has ${bytes} bytes of notifications queued, over the limit of ${limit}",
+                 ("s", s)("bytes", sub.queued_bytes)("limit", _max_queued_bytes));
+         sub.overflowing = true;
+         if( _overflow_policy == unsubscribe )
+         {
+            // The subscriber indexes are being iterated, so its subscriptions are canceled once the dispatch is done
+            _overflowed_subscribers.push_back( s );
+            return;
+         }
+         while( !sub.queue.empty() && sub.queued_bytes + bytes > _max_queued_bytes )
+            pop_notification( sub );
+      }
+
+      if( object )
+         sub.queued_objects[*object] = sub.dequeued + sub.queue.size();
+      notification next;
+      next.callback = callback;
+      next.value = value;
+      next.bytes = bytes;
+      next.object = object;
+      sub.queue.push_back( std::move(next) );
+      sub.queued_bytes += bytes;
+      if( !sub.delivery.valid() || sub.delivery.ready() )
+         sub.delivery = fc::async([this,s](){ deliver(s); });
+   }
+
+   subscription_hub::notification subscription_hub::pop_notification(subscriber& sub)
+   {
+      notification front = std::move( sub.queue.front() );
+      sub.queue.pop_front();
+      if( front.object )
+         sub.queued_objects.erase( *front.object );
+      sub.queued_bytes -= front.bytes;
+      ++sub.dequeued;
+      return front;
+   }
+
+   void subscription_hub::deliver(subscriber_id s)
+   {
+      for(;;)
+      {
+         // The callback may yield, during which s may be removed
+         auto itr = _subscribers.find(s);
+         if( itr == _subscribers.end() )
+            return;
+         if( itr->second.queue.empty() )
+         {
+            itr->second.overflowing = false;
+            return;
+         }
+         notification next = pop_notification( itr->second );
+         try {
+            next.callback( *next.value );
+         } catch (const fc::canceled_exception&)
+         {
+            throw;
+         } catch (const fc::exception& e)
+         {
+            wlog("${e}", ("e",e.to_detail_string()));
+         }
+      }
+   }
+
+} }
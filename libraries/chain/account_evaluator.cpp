@@ -178,6 +178,8 @@ object_id_type account_update_evaluator::do_evaluate( const account_update_opera
 }
 object_id_type account_update_evaluator::do_apply( const account_update_operation& o )
 {
+   if( o.owner || o.active )
+      db().invalidate_authority_cache();
    db().modify( *acnt, [&]( account_object& a  ){
           if( o.owner ) a.owner = *o.owner;
           if( o.active ) a.active = *o.active;
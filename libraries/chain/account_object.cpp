@@ -19,6 +19,8 @@
 #include <graphene/chain/asset_object.hpp>
 #include <fc/uint128.hpp>
 
+#include <limits>
+
 namespace graphene { namespace chain {
 
 bool account_object::is_authorized_asset(const asset_object& asset_obj) const {
@@ -36,4 +38,153 @@ void account_balance_object::adjust_balance(const asset& delta)
    balance += delta.amount;
 }
 
+const account_balance_object* account_balance_table::find( account_id_type owner, asset_id_type asset_type )const
+{
+   if( _entries.empty() )
+      return nullptr;
+   const uint64_t owner_instance = owner.instance.value;
+   const uint64_t asset_instance = asset_type.instance.value;
+   const size_t mask = _entries.size() - 1;
+   for( size_t i = home( owner_instance, asset_instance ); _entries[i].balance; i = (i + 1) & mask )
+      if( _entries[i].owner == owner_instance && _entries[i].asset == asset_instance )
+         return _entries[i].balance;
+   return nullptr;
+}
+
+void account_balance_table::on_add( const graphene::db::object& obj )
+{
+   const auto& balance = static_cast<const account_balance_object&>( obj );
+   // Keep the load factor at or below 3/4
+   if( (_size + 1) * 4 > _entries.size() * 3 )
+      grow();
+   entry e;
+   e.owner = balance.owner.instance.value;
+   e.asset = balance.asset_type.instance.value;
+   e.balance = &balance;
+   place( e );
+   ++_size;
+}
+
+void account_balance_table::on_remove( const graphene::db::object& obj )
+{
+   if( _entries.empty() )
+      return;
+   const auto& balance = static_cast<const account_balance_object&>( obj );
+   const size_t mask = _entries.size() - 1;
+   size_t i = home( balance.owner.instance.value, balance.asset_type.instance.value );
+   while( _entries[i].balance && _entries[i].balance != &balance )
+      i = (i + 1) & mask;
+   if( !_entries[i].balance )
+      return;
+
+   // Shift back every following entry of the run which may not sit between its home and the hole
+   for( size_t j = (i + 1) & mask; _entries[j].balance; j = (j + 1) & mask )
+   {
+      size_t k = home( _entries[j].owner, _entries[j].asset );
+      bool stays = i <= j ? ( i < k && k <= j ) : ( i < k || k <= j );
+      if( !stays )
+      {
+         _entries[i] = _entries[j];
+         i = j;
+      }
+   }
+   _entries[i] = entry();
+   --_size;
+}
+
+size_t account_balance_table::home( uint64_t owner, uint64_t asset )const
+{
+   // The finalizer of splitmix64, so that consecutive instances spread over the table
+   uint64_t h = owner * 0x9e3779b97f4a7c15ull + asset;
+   h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+   h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+   h ^= h >> 31;
+   return h & (_entries.size() - 1);
+}
+
+void account_balance_table::place( const entry& e )
+{
+   const size_t mask = _entries.size() - 1;
+   size_t i = home( e.owner, e.asset );
+   while( _entries[i].balance )
+      i = (i + 1) & mask;
+   _entries[i] = e;
+}
+
+void account_balance_table::grow()
+{
+   vector<entry> old_entries( std::max<size_t>( 64, _entries.size() * 2 ) );
+   old_entries.swap( _entries );
+   for( const auto& e : old_entries )
+      if( e.balance )
+         place( e );
+}
+
+void account_name_table::on_add( const graphene::db::object& obj )
+{
+   const auto& account = static_cast<const account_object&>( obj );
+   _recent.emplace( account.name, account.get_id() );
+   if( _recent.size() > std::max<size_t>( 1024, _sorted.size() / 8 ) )
+      merge();
+}
+
+void account_name_table::on_remove( const graphene::db::object& obj )
+{
+   const auto& account = static_cast<const account_object&>( obj );
+   auto recent_itr = _recent.find( account.name );
+   if( recent_itr != _recent.end() && recent_itr->second == account.id )
+   {
+      _recent.erase( recent_itr );
+      return;
+   }
+
+   const string& name = account.name;
+   auto itr = std::lower_bound( _sorted.begin(), _sorted.end(), name, [this]( const entry& e, const string& n ) {
+      return compare( e, n.data(), n.size() ) < 0;
+   } );
+   if( itr == _sorted.end() || itr->id != account.id || compare( *itr, name.data(), name.size() ) != 0 )
+      return;
+   // Only the creation of an account is ever undone, so this is usually the last name merged in
+   if( itr->offset + itr->size == _names.size() )
+      _names.resize( itr->offset );
+   _sorted.erase( itr );
+}
+
+int account_name_table::compare( const entry& e, const char* name, size_t name_size )const
+{
+   int result = std::char_traits<char>::compare( _names.data() + e.offset, name, std::min<size_t>( e.size, name_size ) );
+   if( result != 0 )
+      return result;
+   return e.size < name_size ? -1 : ( e.size > name_size ? 1 : 0 );
+}
+
+void account_name_table::merge()
+{
+   vector<char> names;
+   vector<entry> sorted;
+   sorted.reserve( size() );
+   size_t name_bytes = 0;
+   for( const auto& e : _sorted )
+      name_bytes += e.size;
+   for( const auto& item : _recent )
+      name_bytes += item.first.size();
+   FC_ASSERT( name_bytes <= std::numeric_limits<uint32_t>::max() );
+   names.reserve( name_bytes );
+
+   auto append = [&]( const char* name, size_t name_size, account_id_type id ) {
+      entry e;
+      e.offset = names.size();
+      e.size = name_size;
+      e.id = id;
+      names.insert( names.end(), name, name + name_size );
+      sorted.push_back( e );
+      return true;
+   };
+   visit_from( string(), append );
+
+   _names.swap( names );
+   _sorted.swap( sorted );
+   _recent.clear();
+}
+
 } } // graphene::chain
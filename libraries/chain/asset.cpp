@@ -16,7 +16,7 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <graphene/chain/asset.hpp>
-#include <fc/uint128.hpp>
+#include <graphene/chain/wide_arithmetic.hpp>
 
 namespace graphene { namespace chain {
       bool operator < ( const asset& a, const asset& b )
@@ -33,8 +33,8 @@ namespace graphene { namespace chain {
          if( a.base.asset_id > b.base.asset_id ) return false;
          if( a.quote.asset_id < b.quote.asset_id ) return true;
          if( a.quote.asset_id > b.quote.asset_id ) return false;
-         auto amult = fc::uint128(b.quote.amount.value) * a.base.amount.value;
-         auto bmult = fc::uint128(a.quote.amount.value) * b.base.amount.value;
+         auto amult = multiply( uint64_t(b.quote.amount.value), uint64_t(a.base.amount.value) );
+         auto bmult = multiply( uint64_t(a.quote.amount.value), uint64_t(b.base.amount.value) );
          assert( (a.to_real() < b.to_real()) == (amult < bmult) );
          return amult < bmult;
       }
@@ -44,8 +44,8 @@ namespace graphene { namespace chain {
          if( a.base.asset_id > b.base.asset_id ) return false;
          if( a.quote.asset_id < b.quote.asset_id ) return true;
          if( a.quote.asset_id > b.quote.asset_id ) return false;
-         auto amult = fc::uint128(b.quote.amount.value) * a.base.amount.value;
-         auto bmult = fc::uint128(a.quote.amount.value) * b.base.amount.value;
+         auto amult = multiply( uint64_t(b.quote.amount.value), uint64_t(a.base.amount.value) );
+         auto bmult = multiply( uint64_t(a.quote.amount.value), uint64_t(b.base.amount.value) );
          assert( (a.to_real() <= b.to_real()) == (amult <= bmult) );
          return amult <= bmult;
       }
@@ -55,8 +55,8 @@ namespace graphene { namespace chain {
          if( a.base.asset_id > b.base.asset_id ) return false;
          if( a.quote.asset_id < b.quote.asset_id ) return true;
          if( a.quote.asset_id > b.quote.asset_id ) return false;
-         auto amult = fc::uint128(a.quote.amount.value) * b.base.amount.value;
-         auto bmult = fc::uint128(b.quote.amount.value) * a.base.amount.value;
+         auto amult = multiply( uint64_t(a.quote.amount.value), uint64_t(b.base.amount.value) );
+         auto bmult = multiply( uint64_t(b.quote.amount.value), uint64_t(a.base.amount.value) );
          return amult == bmult;
       }
       bool operator != ( const price& a, const price& b )
@@ -78,16 +78,20 @@ namespace graphene { namespace chain {
          if( a.asset_id == b.base.asset_id )
          {
             FC_ASSERT( b.base.amount.value > 0 );
-            auto result = (fc::uint128(a.amount.value) * b.quote.amount.value)/b.base.amount.value;
-            FC_ASSERT( result <= GRAPHENE_MAX_SHARE_SUPPLY );
-            return asset( result.to_uint64(), b.quote.asset_id );
+            uint64_t result;
+            FC_ASSERT( multiply_divide( uint64_t(a.amount.value), uint64_t(b.quote.amount.value),
+                                        uint64_t(b.base.amount.value), result ) &&
+                       result <= GRAPHENE_MAX_SHARE_SUPPLY );
+            return asset( result, b.quote.asset_id );
          }
          else if( a.asset_id == b.quote.asset_id )
          {
             FC_ASSERT( b.quote.amount.value > 0 );
-            auto result = (fc::uint128(a.amount.value) * b.base.amount.value)/b.quote.amount.value;
-            FC_ASSERT( result <= GRAPHENE_MAX_SHARE_SUPPLY );
-            return asset( result.to_uint64(), b.base.asset_id );
+            uint64_t result;
+            FC_ASSERT( multiply_divide( uint64_t(a.amount.value), uint64_t(b.base.amount.value),
+                                        uint64_t(b.quote.amount.value), result ) &&
+                       result <= GRAPHENE_MAX_SHARE_SUPPLY );
+            return asset( result, b.base.asset_id );
          }
          FC_ASSERT( !"invalid asset * price", "", ("asset",a)("price",b) );
       }
@@ -102,11 +106,10 @@ namespace graphene { namespace chain {
 
       price price::call_price(const asset& debt, const asset& collateral, uint16_t collateral_ratio)
       {
-         fc::uint128 tmp( collateral.amount.value );
-         tmp *= collateral_ratio - 1000;
-         tmp /= 1000;
-         FC_ASSERT( tmp <= GRAPHENE_MAX_SHARE_SUPPLY );
-         return asset( tmp.to_uint64(), collateral.asset_id) / debt;
+         uint64_t tmp;
+         FC_ASSERT( multiply_divide( uint64_t(collateral.amount.value), uint64_t(collateral_ratio - 1000), 1000, tmp ) &&
+                    tmp <= GRAPHENE_MAX_SHARE_SUPPLY );
+         return asset( tmp, collateral.asset_id) / debt;
       }
 
       bool price::is_null() const { return *this == price(); }
@@ -38,7 +38,7 @@ object_id_type asset_create_evaluator::do_evaluate( const asset_create_operation
    for( auto id : op.common_options.blacklist_authorities )
       d.get_object(id);
 
-   auto& asset_indx = db().get_index_type<asset_index>().indices().get<by_symbol>();
+   auto& asset_indx = db().get_index_type<asset_index>().indices().get<by_exact_symbol>();
    auto asset_symbol_itr = asset_indx.find( op.symbol );
    FC_ASSERT( asset_symbol_itr == asset_indx.end() );
 
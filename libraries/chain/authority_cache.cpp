@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/authority_cache.hpp>
+
+#include <boost/functional/hash.hpp>
+
+namespace graphene { namespace chain {
+
+bool authority_cache::is_approved( account_id_type account, authority::classification auth_class,
+                                   const vector<key_id_type>& keys, int depth )const
+{
+   auto itr = _entries.find( entry_key{ account, auth_class, keys } );
+   return itr != _entries.end() && depth <= itr->second;
+}
+
+void authority_cache::approve( account_id_type account, authority::classification auth_class,
+                               const vector<key_id_type>& keys, int depth )
+{
+   auto result = _entries.emplace( entry_key{ account, auth_class, keys }, depth );
+   if( !result.second )
+      result.first->second = std::max( result.first->second, depth );
+}
+
+size_t authority_cache::entry_key_hash::operator()( const entry_key& k )const
+{
+   size_t seed = 0;
+   boost::hash_combine( seed, k.account.instance.value );
+   boost::hash_combine( seed, int(k.auth_class) );
+   for( const auto& key : k.keys )
+      boost::hash_combine( seed, key.instance.value );
+   return seed;
+}
+
+} } // graphene::chain
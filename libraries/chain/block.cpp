@@ -50,22 +50,77 @@ namespace graphene { namespace chain {
       return signee() == expected_signee;
    }
 
+   void merkle_accumulator::append( const digest_type& leaf )
+   {
+      // Like incrementing a binary counter: merge with every complete subtree of the same size
+      digest_type node = leaf;
+      uint32_t level = 0;
+      for( ; _size & (1u << level); ++level )
+         node = digest_type::hash( std::make_pair( _subtrees[level], node ) );
+      if( level == _subtrees.size() )
+         _subtrees.push_back( node );
+      else
+         _subtrees[level] = node;
+      ++_size;
+   }
+
+   checksum_type merkle_accumulator::root()const
+   {
+      if( _size == 0 ) return checksum_type();
+
+      // The smaller subtrees are the ones carried up the tree, so fold them in from the right
+      optional<digest_type> node;
+      for( uint32_t level = 0; level < _subtrees.size(); ++level )
+      {
+         if( !(_size & (1u << level)) ) continue;
+         if( node )
+            node = digest_type::hash( std::make_pair( _subtrees[level], *node ) );
+         else
+            node = _subtrees[level];
+      }
+      return checksum_type::hash( *node );
+   }
+
+   void merkle_accumulator::clear()
+   {
+      _subtrees.clear();
+      _size = 0;
+   }
+
    checksum_type signed_block::calculate_merkle_root()const
    {
-      if( transactions.size() == 0 ) return checksum_type();
+      merkle_accumulator merkle;
+      for( const auto& trx : transactions )
+         merkle.append( trx.merkle_digest() );
+      return merkle.root();
+   }
 
-      vector<digest_type>  ids;
-      ids.resize( ((transactions.size() + 1)/2)*2 );
-      for( uint32_t i = 0; i < transactions.size(); ++i )
-         ids[i] = transactions[i].merkle_digest();
+   checksum_type signed_block::calculate_merkle_root( const utilities::thread_group& threads )const
+   {
+      size_t thread_count = std::min( threads.size(), transactions.size() );
+      if( thread_count <= 1 )
+         return calculate_merkle_root();
 
-      while( ids.size() > 1 )
+      vector<digest_type> leaves( transactions.size() );
+      size_t chunk_size = (transactions.size() + thread_count - 1) / thread_count;
+      vector<fc::future<void>> workers;
+      workers.reserve( thread_count );
+      for( size_t t = 0; t < thread_count; ++t )
       {
-         for( uint32_t i = 0; i < transactions.size(); i += 2 )
-            ids[i/2] = digest_type::hash( std::make_pair( ids[i], ids[i+1] ) );
-         ids.resize( ids.size() / 2 );
+         size_t begin = t * chunk_size;
+         size_t end = std::min( begin + chunk_size, transactions.size() );
+         workers.push_back( threads[t]->async( [this, &leaves, begin, end]() {
+            for( size_t i = begin; i < end; ++i )
+               leaves[i] = transactions[i].merkle_digest();
+         }, "calculate_merkle_root" ) );
       }
-      return checksum_type::hash( ids[0] );
+      for( auto& worker : workers )
+         worker.wait();
+
+      merkle_accumulator merkle;
+      for( const auto& leaf : leaves )
+         merkle.append( leaf );
+      return merkle.root();
    }
 
 } }
@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/block_database.hpp>
+#include <graphene/chain/block_view.hpp>
+
+#include <graphene/utilities/lz_compression.hpp>
+
+#include <fc/io/fstream.hpp>
+#include <fc/io/raw.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace graphene { namespace chain {
+
+namespace bip = boost::interprocess;
+
+block_database::block_database(){}
+block_database::~block_database(){}
+
+void block_database::open( const fc::path& dir )
+{ try {
+   fc::create_directories( dir );
+   _dir = dir;
+   const auto blocks_path = (dir / "blocks").generic_string();
+   const auto index_path = (dir / "index").generic_string();
+   if( !fc::exists( dir / "blocks" ) || !fc::exists( dir / "index" ) )
+   {
+      std::ofstream( blocks_path, std::ios::out | std::ios::binary | std::ios::trunc );
+      std::ofstream( index_path, std::ios::out | std::ios::binary | std::ios::trunc );
+   }
+   // Block files written before compression have no dictionary, nor any compressed block
+   if( !fc::exists( dir / "dictionary" ) )
+   {
+      const vector<char> dictionary = default_dictionary();
+      std::ofstream( (dir / "dictionary").generic_string(), std::ios::out | std::ios::binary | std::ios::trunc )
+         .write( dictionary.data(), dictionary.size() );
+   }
+   std::string dictionary;
+   fc::read_file_contents( dir / "dictionary", dictionary );
+   _dictionary.assign( dictionary.begin(), dictionary.end() );
+
+   _blocks.open( blocks_path, std::ios::in | std::ios::out | std::ios::binary );
+   _index.open( index_path, std::ios::in | std::ios::out | std::ios::binary );
+   FC_ASSERT( _blocks.good() && _index.good(), "Unable to open the block database" );
+
+   _blocks_size = boost::filesystem::file_size( blocks_path );
+   _entry_count = boost::filesystem::file_size( index_path ) / sizeof(index_entry);
+
+   // The whole index is read at once to keep the id of every block in memory
+   vector<index_entry> entries( _entry_count );
+   if( !entries.empty() )
+   {
+      _index.seekg( 0 );
+      _index.read( reinterpret_cast<char*>(entries.data()), entries.size() * sizeof(index_entry) );
+      FC_ASSERT( _index.good(), "Unable to read the block index" );
+   }
+   _block_ids.clear();
+   _block_ids.reserve( entries.size() );
+   _pruned_below = 0;
+   for( const index_entry& e : entries )
+   {
+      // A pruned block keeps its id without a body
+      if( e.size == 0 && e.id != block_id_type() )
+         _pruned_below = _block_ids.size() + 1;
+      _block_ids.push_back( e.id );
+   }
+   _released_until = 0;
+
+   // Drop the entries of blocks which were not completely written
+   uint32_t valid_count = _entry_count;
+   while( valid_count > 0 )
+   {
+      const index_entry& e = entries[valid_count - 1];
+      if( e.size == 0 || e.offset + e.stored_size() <= _blocks_size )
+         break;
+      --valid_count;
+   }
+   truncate( valid_count );
+} FC_CAPTURE_AND_RETHROW( (dir) ) }
+
+void block_database::open_in_memory()
+{
+   close();
+   _in_memory = true;
+   _dictionary = default_dictionary();
+}
+
+bool block_database::is_open()const
+{
+   return _in_memory || _blocks.is_open();
+}
+
+void block_database::flush()
+{
+   if( _in_memory )
+      return;
+   _blocks.flush();
+   _index.flush();
+}
+
+void block_database::sync()
+{
+   if( _in_memory )
+      return;
+   flush();
+#ifdef __linux__
+   // A block is on disk before its entry, as when they are written
+   for( const char* name : { "blocks", "index" } )
+   {
+      int fd = ::open( (_dir / name).generic_string().c_str(), O_RDONLY );
+      if( fd < 0 || ::fsync( fd ) != 0 )
+         wlog( "Unable to sync the block database ${name}: ${e}", ("name", name)("e", strerror(errno)) );
+      if( fd >= 0 )
+         ::close( fd );
+   }
+#endif
+}
+
+void block_database::close()
+{
+   unmap_blocks();
+   _blocks.close();
+   _index.close();
+   _entry_count = 0;
+   _blocks_size = 0;
+   _block_ids.clear();
+   _recent_headers.clear();
+   _pruned_below = 0;
+   _released_until = 0;
+   _in_memory = false;
+   _memory_index.clear();
+   _memory_blocks.clear();
+}
+
+void block_database::store( const block_id_type& id, const signed_block& b )
+{ try {
+   const uint32_t num = block_header::num_from_id( id );
+   if( num < _entry_count )
+      truncate( num );
+
+   vector<char> data = fc::raw::pack( b );
+   FC_ASSERT( data.size() < index_entry::compressed_flag, "Block is too large to store" );
+   block_header_summary summary;
+   summary.header = b;
+   summary.transaction_count = b.transactions.size();
+   summary.size = data.size();
+   index_entry e;
+   e.offset = _blocks_size;
+   e.size = data.size();
+   e.id = id;
+   if( _compress )
+   {
+      // The compressed block follows its size unpacked, and is only kept if it is smaller
+      vector<char> compressed = fc::raw::pack( e.size );
+      const vector<char> body = graphene::utilities::lz_compress( data.data(), data.size(), _dictionary );
+      compressed.insert( compressed.end(), body.begin(), body.end() );
+      if( compressed.size() < data.size() )
+      {
+         data = std::move( compressed );
+         e.size = data.size() | index_entry::compressed_flag;
+      }
+   }
+
+   if( _in_memory )
+   {
+      _memory_blocks.insert( _memory_blocks.end(), data.begin(), data.end() );
+      _memory_index.resize( num );
+      _memory_index.push_back( e );
+      _entry_count = num;
+   }
+   else
+   {
+      _blocks.seekp( _blocks_size );
+      _blocks.write( data.data(), data.size() );
+      _blocks.flush();
+      FC_ASSERT( _blocks.good(), "Unable to write the block" );
+
+      _index.seekp( uint64_t(_entry_count) * sizeof(index_entry) );
+      const index_entry empty;
+      for( ; _entry_count < num; ++_entry_count )
+         _index.write( reinterpret_cast<const char*>(&empty), sizeof(empty) );
+      _index.write( reinterpret_cast<const char*>(&e), sizeof(e) );
+      _index.flush();
+      FC_ASSERT( _index.good(), "Unable to write the block index" );
+   }
+   _blocks_size += data.size();
+   ++_entry_count;
+   _block_ids.resize( num );
+   _block_ids.push_back( id );
+
+   if( !_recent_headers.empty() && _recent_headers.back().header.block_num() + 1 != num )
+      _recent_headers.clear();
+   _recent_headers.push_back( std::move(summary) );
+   if( _recent_headers.size() > recent_headers_kept )
+      _recent_headers.pop_front();
+
+   if( _keep_blocks && num >= _keep_blocks )
+      prune( num - _keep_blocks + 1 );
+} FC_CAPTURE_AND_RETHROW( (id) ) }
+
+void block_database::remove( const block_id_type& id )
+{ try {
+   if( contains( id ) )
+      truncate( block_header::num_from_id( id ) );
+} FC_CAPTURE_AND_RETHROW( (id) ) }
+
+bool block_database::contains( const block_id_type& id )const
+{
+   const uint32_t num = block_header::num_from_id( id );
+   return num < _block_ids.size() && _block_ids[num] != block_id_type() && _block_ids[num] == id;
+}
+
+block_id_type block_database::fetch_block_id( uint32_t block_num )const
+{
+   FC_ASSERT( block_num < _block_ids.size() && _block_ids[block_num] != block_id_type(),
+              "Block ${n} is not stored", ("n",block_num) );
+   return _block_ids[block_num];
+}
+
+vector<block_id_type> block_database::fetch_block_ids( uint32_t first_num, uint32_t count )const
+{
+   vector<block_id_type> result;
+   result.reserve( std::min<size_t>( count, _block_ids.size() ) );
+   for( uint64_t num = first_num; num < uint64_t(first_num) + count && num < _block_ids.size(); ++num )
+   {
+      if( _block_ids[num] == block_id_type() )
+         break;
+      result.push_back( _block_ids[num] );
+   }
+   return result;
+}
+
+optional<signed_block> block_database::fetch_optional( const block_id_type& id )const
+{ try {
+   const index_entry e = read_entry( block_header::num_from_id( id ) );
+   if( e.size == 0 || e.id != id )
+      return optional<signed_block>();
+   return read_block( e );
+} FC_CAPTURE_AND_RETHROW( (id) ) }
+
+optional<signed_block> block_database::fetch_by_number( uint32_t block_num )const
+{ try {
+   return read_block( read_entry( block_num ) );
+} FC_CAPTURE_AND_RETHROW( (block_num) ) }
+
+optional<signed_block> block_database::last()const
+{ try {
+   for( uint32_t num = _entry_count; num-- > 0; )
+   {
+      const index_entry e = read_entry( num );
+      if( e.size != 0 )
+         return read_block( e );
+   }
+   return optional<signed_block>();
+} FC_CAPTURE_AND_RETHROW() }
+
+block_database::index_entry block_database::read_entry( uint32_t block_num )const
+{
+   index_entry e;
+   if( block_num >= _entry_count )
+      return e;
+   if( _in_memory )
+      return _memory_index[block_num];
+   _index.seekg( uint64_t(block_num) * sizeof(index_entry) );
+   _index.read( reinterpret_cast<char*>(&e), sizeof(e) );
+   FC_ASSERT( _index.good(), "Unable to read the block index", ("block_num",block_num) );
+   return e;
+}
+
+optional<signed_block> block_database::read_block( const index_entry& e )const
+{
+   if( e.size == 0 )
+      return optional<signed_block>();
+   vector<char> buffer;
+   const auto packed = packed_block( e, buffer );
+   fc::datastream<const char*> ds( packed.first, packed.second );
+   signed_block b;
+   fc::raw::unpack( ds, b );
+   return b;
+}
+
+bool block_database::fetch_packed( const block_id_type& id, vector<char>& packed )const
+{ try {
+   const index_entry e = read_entry( block_header::num_from_id( id ) );
+   if( e.size == 0 || e.id != id )
+      return false;
+   vector<char> buffer;
+   const auto data = packed_block( e, buffer );
+   packed.insert( packed.end(), data.first, data.first + data.second );
+   return true;
+} FC_CAPTURE_AND_RETHROW( (id) ) }
+
+optional<signed_block_header> block_database::fetch_header_by_number( uint32_t block_num )const
+{ try {
+   if( const block_header_summary* recent = recent_header( block_num ) )
+      return recent->header;
+   const index_entry e = read_entry( block_num );
+   if( e.size == 0 )
+      return optional<signed_block_header>();
+   vector<char> buffer;
+   const auto packed = packed_block( e, buffer );
+   return signed_block_view( packed.first, packed.second ).header();
+} FC_CAPTURE_AND_RETHROW( (block_num) ) }
+
+optional<block_header_summary> block_database::fetch_header_summary_by_number( uint32_t block_num )const
+{ try {
+   if( const block_header_summary* recent = recent_header( block_num ) )
+      return *recent;
+   const index_entry e = read_entry( block_num );
+   if( e.size == 0 )
+      return optional<block_header_summary>();
+   vector<char> buffer;
+   const auto packed = packed_block( e, buffer );
+   signed_block_view view( packed.first, packed.second );
+   block_header_summary summary;
+   summary.header = view.header();
+   summary.transaction_count = view.transaction_count();
+   summary.size = packed.second;
+   return summary;
+} FC_CAPTURE_AND_RETHROW( (block_num) ) }
+
+const block_header_summary* block_database::recent_header( uint32_t block_num )const
+{
+   if( _recent_headers.empty() )
+      return nullptr;
+   const uint32_t first = _recent_headers.front().header.block_num();
+   if( block_num < first || block_num - first >= _recent_headers.size() )
+      return nullptr;
+   return &_recent_headers[block_num - first];
+}
+
+const char* block_database::map_block( const index_entry& e )const
+{
+   FC_ASSERT( e.offset + e.stored_size() <= _blocks_size, "Block is past the end of the block file",
+              ("offset",e.offset)("size",e.stored_size())("blocks_size",_blocks_size) );
+   if( _in_memory )
+      return _memory_blocks.data() + e.offset;
+   if( !_blocks_region || _blocks_region->get_size() < e.offset + e.stored_size() )
+   {
+      // Map everything stored so far, so that appending a few blocks does not remap on every read
+      _blocks_region.reset();
+      if( !_blocks_mapping )
+         _blocks_mapping.reset( new bip::file_mapping( (_dir / "blocks").generic_string().c_str(), bip::read_only ) );
+      _blocks_region.reset( new bip::mapped_region( *_blocks_mapping, bip::read_only, 0, _blocks_size ) );
+   }
+   return static_cast<const char*>( _blocks_region->get_address() ) + e.offset;
+}
+
+std::pair<const char*,size_t> block_database::packed_block( const index_entry& e, vector<char>& buffer )const
+{
+   const char* data = map_block( e );
+   if( !e.compressed() )
+      return std::make_pair( data, size_t(e.size) );
+
+   fc::datastream<const char*> ds( data, e.stored_size() );
+   uint32_t size;
+   fc::raw::unpack( ds, size );
+   buffer = graphene::utilities::lz_decompress( data + ds.tellp(), e.stored_size() - ds.tellp(), size, _dictionary );
+   return std::make_pair( buffer.data(), buffer.size() );
+}
+
+vector<char> block_database::default_dictionary()
+{
+   processed_transaction trx;
+   for( int i = 0; i < operation::count(); ++i )
+   {
+      operation op;
+      op.set_which( i );
+      trx.operations.push_back( op );
+   }
+   signed_block b;
+   b.transactions.push_back( trx );
+   return fc::raw::pack( b );
+}
+
+void block_database::unmap_blocks()const
+{
+   _blocks_region.reset();
+   _blocks_mapping.reset();
+}
+
+void block_database::truncate( uint32_t block_num )
+{
+   // Blocks are stored in the order of their entries, so the first block dropped starts where the others end
+   uint64_t blocks_end = 0;
+   const index_entry first_dropped = read_entry( block_num );
+   if( first_dropped.size != 0 )
+      blocks_end = first_dropped.offset;
+   else
+   {
+      for( uint32_t num = std::min( block_num, _entry_count ); num-- > _pruned_below; )
+      {
+         const index_entry e = read_entry( num );
+         if( e.size != 0 )
+         {
+            blocks_end = e.offset + e.stored_size();
+            break;
+         }
+      }
+   }
+
+   // The mapping must not extend past the end of the file
+   unmap_blocks();
+   flush();
+   _entry_count = std::min( block_num, _entry_count );
+   _blocks_size = blocks_end;
+   _block_ids.resize( _entry_count );
+   while( !_recent_headers.empty() && _recent_headers.back().header.block_num() >= block_num )
+      _recent_headers.pop_back();
+   _pruned_below = std::min( _pruned_below, _entry_count );
+   _released_until = std::min( _released_until, _blocks_size );
+   if( _in_memory )
+   {
+      _memory_index.resize( _entry_count );
+      _memory_blocks.resize( _blocks_size );
+      return;
+   }
+   boost::filesystem::resize_file( (_dir / "index").generic_string(), uint64_t(_entry_count) * sizeof(index_entry) );
+   boost::filesystem::resize_file( (_dir / "blocks").generic_string(), _blocks_size );
+}
+
+void block_database::prune( uint32_t block_num )
+{
+   block_num = std::min( block_num, _entry_count );
+   for( ; _pruned_below < block_num; ++_pruned_below )
+   {
+      index_entry e = read_entry( _pruned_below );
+      if( e.size == 0 )
+         continue;
+      e.offset = 0;
+      e.size = 0;
+      write_entry( _pruned_below, e );
+   }
+   if( !_in_memory )
+      _index.flush();
+   release_pruned_space();
+}
+
+void block_database::write_entry( uint32_t block_num, const index_entry& e )
+{
+   if( _in_memory )
+   {
+      _memory_index[block_num] = e;
+      return;
+   }
+   _index.seekp( uint64_t(block_num) * sizeof(index_entry) );
+   _index.write( reinterpret_cast<const char*>(&e), sizeof(e) );
+   FC_ASSERT( _index.good(), "Unable to write the block index", ("block_num",block_num) );
+}
+
+void block_database::release_pruned_space()
+{
+   // The blocks are stored in order, so everything before the first block kept belongs to pruned blocks.  The space
+   // is released a megabyte at a time, punching a hole in the file so that the offsets of the other blocks stay put
+   const uint64_t chunk = 1 << 20;
+   const index_entry first_kept = read_entry( _pruned_below );
+   const uint64_t pruned_end = (first_kept.size != 0 ? first_kept.offset : _blocks_size) / chunk * chunk;
+   if( _in_memory || pruned_end <= _released_until )
+      return;
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+   int fd = ::open( (_dir / "blocks").generic_string().c_str(), O_WRONLY );
+   if( fd < 0 || fallocate( fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, _released_until, pruned_end - _released_until ) != 0 )
+      wlog( "Unable to release the space of the pruned blocks: ${e}", ("e", strerror(errno)) );
+   if( fd >= 0 )
+      ::close( fd );
+#endif
+   _released_until = pruned_end;
+}
+
+} } // graphene::chain
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/block_view.hpp>
+
+#include <fc/io/raw.hpp>
+
+namespace graphene { namespace chain {
+
+signed_block_view::signed_block_view( const char* data, size_t size )
+   : _data( data ), _size( size )
+{ try {
+   fc::datastream<const char*> ds( data, size );
+   fc::raw::unpack( ds, _header );
+   _header_size = ds.tellp();
+   fc::unsigned_int count;
+   fc::raw::unpack( ds, count );
+   _transaction_count = count.value;
+   _transactions_offset = ds.tellp();
+   // Every transaction takes at least a byte, so a bad count is caught before anything is allocated for it
+   FC_ASSERT( _transaction_count <= size - _transactions_offset, "Block has more transactions than bytes",
+              ("transaction_count",_transaction_count) );
+} FC_CAPTURE_AND_RETHROW( (size) ) }
+
+signed_block_view::signed_block_view( const vector<char>& packed )
+   : signed_block_view( packed.data(), packed.size() )
+{}
+
+block_id_type signed_block_view::id()const
+{
+   // Same as signed_block_header::id(), over the header as it was packed
+   auto tmp = fc::sha224::hash( _data, _header_size );
+   tmp._hash[0] = htonl( block_num() );
+   block_id_type result;
+   memcpy( result._hash, tmp._hash, std::min( sizeof(result), sizeof(tmp) ) );
+   return result;
+}
+
+digest_type signed_block_view::digest()const
+{
+   // A block_header is packed as the signed_block_header without the signature at its end
+   return digest_type::hash( _data, _header_size - sizeof(signature_type) );
+}
+
+fc::ecc::public_key signed_block_view::signee()const
+{
+   return fc::ecc::public_key( _header.delegate_signature, digest(), true/*enforce canonical*/ );
+}
+
+void signed_block_view::for_each_transaction(
+      const std::function<void(const processed_transaction&, const char*, size_t)>& f )const
+{
+   fc::datastream<const char*> ds( _data + _transactions_offset, _size - _transactions_offset );
+   processed_transaction trx;
+   for( uint32_t i = 0; i < _transaction_count; ++i )
+   {
+      const size_t begin = ds.tellp();
+      trx = processed_transaction();
+      fc::raw::unpack( ds, trx );
+      f( trx, _data + _transactions_offset + begin, ds.tellp() - begin );
+   }
+}
+
+checksum_type signed_block_view::calculate_merkle_root()const
+{
+   merkle_accumulator merkle;
+   for_each_transaction( [&merkle]( const processed_transaction&, const char* data, size_t size ) {
+      merkle.append( digest_type::hash( data, size ) );
+   } );
+   return merkle.root();
+}
+
+signed_block signed_block_view::unpack()const
+{
+   signed_block result;
+   static_cast<signed_block_header&>( result ) = _header;
+   fc::datastream<const char*> ds( _data + _transactions_offset, _size - _transactions_offset );
+   result.transactions.resize( _transaction_count );
+   for( auto& trx : result.transactions )
+      fc::raw::unpack( ds, trx );
+   return result;
+}
+
+} } // graphene::chain
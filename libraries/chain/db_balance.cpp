@@ -26,11 +26,10 @@ namespace graphene { namespace chain {
 
 asset database::get_balance(account_id_type owner, asset_id_type asset_id) const
 {
-   auto& index = get_index_type<account_balance_index>().indices().get<by_balance>();
-   auto itr = index.find(boost::make_tuple(owner, asset_id));
-   if( itr == index.end() )
+   const account_balance_object* balance = _balances->find(owner, asset_id);
+   if( !balance )
       return asset(0, asset_id);
-   return itr->get_balance();
+   return balance->get_balance();
 }
 
 asset database::get_balance(const account_object& owner, const asset_object& asset_obj) const
@@ -49,9 +48,8 @@ void database::adjust_balance(account_id_type account, asset delta )
    if( delta.amount == 0 )
       return;
 
-   auto& index = get_index_type<account_balance_index>().indices().get<by_balance>();
-   auto itr = index.find(boost::make_tuple(account, delta.asset_id));
-   if(itr == index.end())
+   const account_balance_object* balance = _balances->find(account, delta.asset_id);
+   if( !balance )
    {
       FC_ASSERT(delta.amount > 0);
       create<account_balance_object>([account,&delta](account_balance_object& b) {
@@ -60,8 +58,8 @@ void database::adjust_balance(account_id_type account, asset delta )
          b.balance = delta.amount.value;
       });
    } else {
-      FC_ASSERT(delta.amount > 0 || itr->get_balance() >= -delta);
-      modify(*itr, [delta](account_balance_object& b) {
+      FC_ASSERT(delta.amount > 0 || balance->get_balance() >= -delta);
+      modify(*balance, [delta](account_balance_object& b) {
          b.adjust_balance(delta);
       });
    }
@@ -110,10 +108,13 @@ void database::deposit_cashback( const account_object& acct, share_type amount )
       if( cashback_vb.policy.get< cdd_vesting_policy >().vesting_seconds != global_vesting_seconds )
          break;
 
-      modify( cashback_vb, [&]( vesting_balance_object& obj )
-      {
-         obj.deposit( now, amount );
-      } );
+      if( _defer_fees )
+         _deferred_fees.cashback[vesting_balance_id_type(cashback_vb.id)] += amount;
+      else
+         modify( cashback_vb, [&]( vesting_balance_object& obj )
+         {
+            obj.deposit( now, amount );
+         } );
       return;
    }
 
@@ -138,4 +139,65 @@ void database::deposit_cashback( const account_object& acct, share_type amount )
    return;
 }
 
+void database::apply_deferred_cashback( const vesting_balance_object& vbo )
+{
+   auto itr = _deferred_fees.cashback.find( vesting_balance_id_type(vbo.id) );
+   if( itr == _deferred_fees.cashback.end() )
+      return;
+   const share_type amount = itr->second;
+   _deferred_fees.cashback.erase( itr );
+   modify( vbo, [&]( vesting_balance_object& obj ){
+      obj.deposit( head_block_time(), amount );
+   });
+}
+
+void database::add_accumulated_fees( const asset_dynamic_data_object& dyn_data, share_type amount )
+{
+   if( amount == 0 )
+      return;
+   if( _defer_fees )
+      _deferred_fees.accumulated_fees[dynamic_asset_data_id_type(dyn_data.id)] += amount;
+   else
+      modify( dyn_data, [&]( asset_dynamic_data_object& obj ){
+         obj.accumulated_fees += amount;
+      });
+}
+
+void database::add_lifetime_fees_paid( const account_statistics_object& stats, share_type amount )
+{
+   if( amount == 0 )
+      return;
+   if( _defer_fees )
+      _deferred_fees.lifetime_fees_paid[account_statistics_id_type(stats.id)] += amount;
+   else
+      modify( stats, [&]( account_statistics_object& s ){
+         s.lifetime_fees_paid += amount;
+      });
+}
+
+share_type database::get_lifetime_fees_paid( const account_statistics_object& stats )const
+{
+   auto itr = _deferred_fees.lifetime_fees_paid.find( account_statistics_id_type(stats.id) );
+   return itr == _deferred_fees.lifetime_fees_paid.end() ? stats.lifetime_fees_paid
+                                                         : stats.lifetime_fees_paid + itr->second;
+}
+
+void database::flush_deferred_fees()
+{
+   for( const auto& fees : _deferred_fees.accumulated_fees )
+      modify( fees.first(*this), [&]( asset_dynamic_data_object& obj ){
+         obj.accumulated_fees += fees.second;
+      });
+   for( const auto& fees : _deferred_fees.lifetime_fees_paid )
+      modify( fees.first(*this), [&]( account_statistics_object& s ){
+         s.lifetime_fees_paid += fees.second;
+      });
+   const fc::time_point_sec now = head_block_time();
+   for( const auto& cashback : _deferred_fees.cashback )
+      modify( cashback.first(*this), [&]( vesting_balance_object& obj ){
+         obj.deposit( now, cashback.second );
+      });
+   _deferred_fees.clear();
+}
+
 } }
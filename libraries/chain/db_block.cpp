@@ -24,13 +24,94 @@
 #include <graphene/chain/operation_history_object.hpp>
 #include <graphene/chain/proposal_object.hpp>
 #include <graphene/chain/transaction_object.hpp>
+#include <graphene/chain/vesting_balance_object.hpp>
 #include <graphene/chain/witness_object.hpp>
 
+#include <graphene/utilities/metrics.hpp>
+#include <graphene/utilities/trace_log.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <queue>
+
 namespace graphene { namespace chain {
 
+namespace {
+   /// Enables the hash cache of every transaction in a block for as long as the block is being pushed
+   struct block_hash_cache_scope
+   {
+      block_hash_cache_scope( const signed_block& b ) : block( b )
+      {
+         for( const auto& trx : block.transactions )
+            trx.set_hash_cache_enabled( true );
+      }
+      ~block_hash_cache_scope()
+      {
+         for( const auto& trx : block.transactions )
+            trx.set_hash_cache_enabled( false );
+      }
+
+      const signed_block& block;
+   };
+
+   /// The metrics every database of the process adds to, looked up in the registry once
+   struct chain_metrics
+   {
+      chain_metrics()
+      : blocks( utilities::metrics().get_counter( "graphene_blocks_applied_total", "Blocks applied" ) ),
+        transactions( utilities::metrics().get_counter( "graphene_block_transactions_total",
+                                                        "Transactions applied as part of blocks" ) ),
+        transactions_pushed( utilities::metrics().get_counter( "graphene_transactions_pushed_total",
+                                                               "Transactions pushed to the pending block" ) ),
+        block_apply_us( utilities::metrics().get_histogram( "graphene_block_apply_microseconds",
+                                                            "Time to apply a block",
+                                                            utilities::exponential_bounds( 100, 2, 10000000 ) ) ),
+        head_block_num( utilities::metrics().get_gauge( "graphene_head_block_number", "Number of the head block" ) ),
+        undo_depth( utilities::metrics().get_gauge( "graphene_undo_stack_depth", "Entries on the undo stack" ) ),
+        fork_db_size( utilities::metrics().get_gauge( "graphene_fork_database_blocks", "Blocks in the fork database" ) ),
+        pending_transactions( utilities::metrics().get_gauge( "graphene_pending_transactions",
+                                                              "Transactions waiting for a block" ) )
+      {}
+
+      utilities::counter&   blocks;
+      utilities::counter&   transactions;
+      utilities::counter&   transactions_pushed;
+      utilities::histogram& block_apply_us;
+      utilities::gauge&     head_block_num;
+      utilities::gauge&     undo_depth;
+      utilities::gauge&     fork_db_size;
+      utilities::gauge&     pending_transactions;
+   };
+
+   chain_metrics& get_chain_metrics()
+   {
+      static chain_metrics metrics;
+      return metrics;
+   }
+
+   struct operation_get_fee
+   {
+      typedef asset result_type;
+      template<typename T>
+      asset operator()( const T& v )const { return v.fee; }
+   };
+   struct operation_get_fee_payer
+   {
+      typedef account_id_type result_type;
+      template<typename T>
+      account_id_type operator()( const T& v )const { return v.fee_payer(); }
+   };
+}
+
+void database::add_block_checkpoints( const flat_map<uint32_t,block_id_type>& checkpoints )
+{
+   for( const auto& checkpoint : checkpoints )
+      _block_checkpoints[checkpoint.first] = checkpoint.second;
+}
+
 bool database::is_known_block( const block_id_type& id )const
 {
-   return _fork_db.is_known_block(id) || _block_id_to_block.find(id).valid();
+   return _fork_db.is_known_block(id) || _block_id_to_block.contains(id);
 }
 /**
  * Only return true *if* the transaction has not expired or been invalidated. If this
@@ -45,12 +126,14 @@ bool database::is_known_transaction( const transaction_id_type& id )const
 
 block_id_type  database::get_block_id_for_num( uint32_t block_num )const
 { try {
-   block_id_type lb; lb._hash[0] = htonl(block_num);
-   auto itr = _block_id_to_block.lower_bound( lb );
-   FC_ASSERT( itr.valid() && itr.key()._hash[0] == lb._hash[0] );
-   return itr.key();
+   return _block_id_to_block.fetch_block_id( block_num );
 } FC_CAPTURE_AND_RETHROW( (block_num) ) }
 
+vector<block_id_type> database::get_block_ids_for_nums( uint32_t first_num, uint32_t count )const
+{
+   return _block_id_to_block.fetch_block_ids( first_num, count );
+}
+
 optional<signed_block> database::fetch_block_by_id( const block_id_type& id )const
 {
    auto b = _fork_db.fetch_block( id );
@@ -59,27 +142,68 @@ optional<signed_block> database::fetch_block_by_id( const block_id_type& id )con
    return b->data;
 }
 
+bool database::fetch_packed_block_by_id( const block_id_type& id, vector<char>& packed )const
+{
+   return _block_id_to_block.fetch_packed( id, packed );
+}
+
 optional<signed_block> database::fetch_block_by_number( uint32_t num )const
 {
    auto results = _fork_db.fetch_block_by_number(num);
    if( results.size() == 1 )
       return results[0]->data;
-   else
+   return _block_id_to_block.fetch_by_number( num );
+}
+
+optional<signed_block_header> database::fetch_block_header_by_id( const block_id_type& id )const
+{
+   auto b = _fork_db.fetch_block( id );
+   if( b )
+      return signed_block_header( b->data );
+   if( !_block_id_to_block.contains( id ) )
+      return optional<signed_block_header>();
+   return _block_id_to_block.fetch_header_by_number( block_header::num_from_id( id ) );
+}
+
+optional<signed_block_header> database::fetch_block_header_by_number( uint32_t num )const
+{
+   auto results = _fork_db.fetch_block_by_number(num);
+   if( results.size() == 1 )
+      return signed_block_header( results[0]->data );
+   return _block_id_to_block.fetch_header_by_number( num );
+}
+
+vector<block_header_summary> database::fetch_block_header_summaries( uint32_t first_num, uint32_t count )const
+{
+   vector<block_header_summary> result;
+   for( uint64_t num = first_num; num < uint64_t(first_num) + count; ++num )
    {
-      block_id_type lb; lb._hash[0] = htonl(num);
-      auto itr = _block_id_to_block.lower_bound( lb );
-      if( itr.valid() && itr.key()._hash[0] == lb._hash[0] )
-         return itr.value();
+      auto summary = _block_id_to_block.fetch_header_summary_by_number( num );
+      if( !summary )
+         break;
+      result.push_back( std::move(*summary) );
    }
-   return optional<signed_block>();
+   return result;
 }
 
-const signed_transaction& database::get_recent_transaction(const transaction_id_type& trx_id) const
+signed_transaction database::get_recent_transaction(const transaction_id_type& trx_id) const
 {
+   // Peers mostly ask for the transactions which are not in a block yet, which the pending pool holds
+   const auto& pending = _pending_transactions.get<by_trx_id>();
+   auto pending_itr = pending.find( trx_id );
+   if( pending_itr != pending.end() )
+      return pending_itr->trx;
+
    auto& index = get_index_type<transaction_index>().indices().get<by_trx_id>();
    auto itr = index.find(trx_id);
    FC_ASSERT(itr != index.end());
-   return itr->trx;
+   optional<signed_block> block = fetch_block_by_number( itr->block_num );
+   FC_ASSERT( block, "The block of a recent transaction is missing", ("trx_id",trx_id)("block_num",itr->block_num) );
+   auto trx = std::find_if( block->transactions.begin(), block->transactions.end(),
+                            [&trx_id]( const processed_transaction& t ) { return t.id() == trx_id; } );
+   FC_ASSERT( trx != block->transactions.end(), "Recent transaction not found in its block",
+              ("trx_id",trx_id)("block_num",itr->block_num) );
+   return *trx;
 }
 
 /**
@@ -90,10 +214,37 @@ const signed_transaction& database::get_recent_transaction(const transaction_id_
  */
 bool database::push_block( const signed_block& new_block, uint32_t skip )
 { try {
+   block_hash_cache_scope hash_cache_scope( new_block );
+
+   if( before_last_block_checkpoint( new_block.block_num() ) )
+   {
+      auto checkpoint = _block_checkpoints.find( new_block.block_num() );
+      FC_ASSERT( checkpoint == _block_checkpoints.end() || checkpoint->second == new_block.id(),
+                 "Block does not match the checkpoint", ("checkpoint",*checkpoint)("block_id",new_block.id()) );
+      skip |= skip_transaction_signatures | skip_authority_check;
+   }
+
+   // Recover the signatures before touching any state; waiting on the worker threads yields.
+   optional<recovered_block_signatures> recovered = recover_block_signatures( new_block, skip );
+
+   // Likewise check the merkle root here, where the transactions can be hashed on the signature threads
+   uint32_t new_block_skip = skip;
+   if( !(skip & skip_merkle_check) )
+   {
+      FC_ASSERT( new_block.transaction_merkle_root == new_block.calculate_merkle_root( _signature_threads ) );
+      new_block_skip |= skip_merkle_check;
+   }
+
    if( !(skip&skip_fork_db) )
    {
-      wdump((new_block.id())(new_block.previous));
+      tdump((new_block.id())(new_block.previous));
       auto new_head = _fork_db.push_block( new_block );
+      // A block which does not become the head now may be switched to later, with these checks already done
+      if( auto item = _fork_db.fetch_block( new_block.id() ) )
+      {
+         item->merkle_checked = true;
+         item->recovered = recovered;
+      }
       //If the head block from the longest chain does not build off of the current head, we need to switch forks.
       if( new_head->data.previous != head_block_id() )
       {
@@ -116,14 +267,16 @@ bool database::push_block( const signed_block& new_block, uint32_t skip )
             while( head_block_id() != branches.second.back()->data.previous )
                pop_block();
 
-            // push all blocks on the new fork
+            // push all blocks on the new fork, reusing what was checked as they were pushed
             for( auto ritr = branches.first.rbegin(); ritr != branches.first.rend(); ++ritr )
             {
                 optional<fc::exception> except;
                 try {
+                   const fork_item& item = **ritr;
                    auto session = _undo_db.start_undo_session();
-                   apply_block( (*ritr)->data, skip );
-                   _block_id_to_block.store( new_block.id(), (*ritr)->data );
+                   apply_block( item.data, skip | (item.merkle_checked ? skip_merkle_check : 0),
+                                item.recovered ? &*item.recovered : nullptr );
+                   _block_id_to_block.store( (*ritr)->id, (*ritr)->data );
                    session.commit();
                 }
                 catch ( const fc::exception& e ) { except = e; }
@@ -143,17 +296,24 @@ bool database::push_block( const signed_block& new_block, uint32_t skip )
                    while( head_block_id() != branches.second.back()->data.previous )
                       pop_block();
 
-                   // restore all blocks from the good fork
+                   // restore all blocks from the good fork.  Each is applied to the very state it was applied to
+                   // before, so the checks it passed then need not be made again.
+                   const uint32_t restore_skip = skip | skip_delegate_signature | skip_transaction_signatures
+                                                      | skip_authority_check | skip_merkle_check;
                    for( auto ritr = branches.second.rbegin(); ritr != branches.second.rend(); ++ritr )
                    {
                       auto session = _undo_db.start_undo_session();
-                      apply_block( (*ritr)->data, skip );
-                      _block_id_to_block.store( new_block.id(), (*ritr)->data );
+                      apply_block( (*ritr)->data, restore_skip );
+                      _block_id_to_block.store( (*ritr)->id, (*ritr)->data );
                       session.commit();
                    }
+                   if( !_defer_pending_restore )
+                      restore_pending_transactions();
                    throw *except;
                 }
             }
+            if( !_defer_pending_restore )
+               restore_pending_transactions();
             return true;
          }
          else return false;
@@ -161,24 +321,65 @@ bool database::push_block( const signed_block& new_block, uint32_t skip )
    }
 
    // If there is a pending block session, then the database state is dirty with pending transactions.
-   // Drop the pending session to reset the database to a clean head block state.
-   // TODO: Preserve pending transactions, and re-apply any which weren't included in the new block.
-   clear_pending();
+   // Drop the pending session to reset the database to a clean head block state.  The pending transactions are
+   // applied again once the block is.
+   reset_pending_block();
 
    try {
+      precheck_block( new_block, new_block_skip, recovered ? &*recovered : nullptr );
       auto session = _undo_db.start_undo_session();
-      apply_block( new_block, skip );
+      apply_block( new_block, new_block_skip, recovered ? &*recovered : nullptr );
       _block_id_to_block.store( new_block.id(), new_block );
       session.commit();
    } catch ( const fc::exception& e ) {
       elog("Failed to push new block:\n${e}", ("e", e.to_detail_string()));
       _fork_db.remove(new_block.id());
+      if( !_defer_pending_restore )
+         restore_pending_transactions();
       throw;
    }
 
+   if( !_defer_pending_restore )
+      restore_pending_transactions();
    return false;
 } FC_CAPTURE_AND_RETHROW( (new_block) ) }
 
+uint32_t database::push_blocks( const vector<const signed_block*>& blocks, uint32_t skip )
+{
+   bool linear = !_fork_db.head() || _fork_db.head()->id == head_block_id();
+   block_id_type previous = head_block_id();
+   for( auto itr = blocks.begin(); linear && itr != blocks.end(); ++itr )
+   {
+      linear = (*itr)->previous == previous;
+      previous = (*itr)->id();
+   }
+   const size_t first_in_fork_db = linear && blocks.size() > _fork_db.max_size() ? blocks.size() - _fork_db.max_size() : 0;
+
+   uint32_t pushed = 0;
+   _defer_pending_restore = true;
+   try {
+      for( ; pushed < blocks.size(); ++pushed )
+      {
+         const signed_block& b = *blocks[pushed];
+         if( pushed < first_in_fork_db )
+            push_block( b, skip | skip_fork_db );
+         else if( pushed == first_in_fork_db && first_in_fork_db > 0 )
+         {
+            push_block( b, skip | skip_fork_db );
+            // The rest of the run links to this block in the fork database
+            _fork_db.start_block( b );
+         }
+         else
+            push_block( b, skip );
+      }
+   } catch( const fc::exception& e ) {
+      elog( "Stopped pushing a run of blocks at block ${n}: ${e}", ("n",blocks[pushed]->block_num())("e",e.to_string()) );
+   }
+   _defer_pending_restore = false;
+   restore_pending_transactions();
+   return pushed;
+}
+
 /**
  * Attempts to push the transaction into the pending queue
  *
@@ -195,17 +396,195 @@ processed_transaction database::push_transaction( const signed_transaction& trx,
    // This allows us to quickly rewind to the clean state of the head block, in case a new block arrives.
    if( !_pending_block_session ) _pending_block_session = _undo_db.start_undo_session();
    auto session = _undo_db.start_undo_session();
-   auto processed_trx = apply_transaction( trx, skip );
-   _pending_block.transactions.push_back(processed_trx);
 
-   FC_ASSERT( (skip & skip_block_size_check) ||
-              fc::raw::pack_size(_pending_block) <= get_global_properties().parameters.maximum_block_size );
+   // The operations are numbered as in the block they are pending for, so that generating it can keep them
+   const size_t applied_ops = _applied_ops.size();
+   _current_block_num    = head_block_num() + 1;
+   _current_trx_in_block = _pending_block.transactions.size();
+   // A processed transaction packs as the signed transaction followed by its results, so it is only sized once
+   const uint64_t packed_size = fc::raw::pack_size( trx );
+   try {
+      const auto& results = evaluate_transaction( trx, skip );
+      const uint64_t trx_size = packed_size + fc::raw::pack_size( results );
+      // The transaction is copied once, into the pending block
+      _pending_block.transactions.emplace_back( trx );
+      _pending_block.transactions.back().operation_results = results;
+      _pending_block_transactions_size += trx_size;
+
+      if( !(skip & skip_block_size_check) &&
+          pending_block_size() > get_global_properties().parameters.maximum_block_size )
+      {
+         _pending_block.transactions.pop_back();
+         _pending_block_transactions_size -= trx_size;
+         FC_ASSERT( false, "Transaction would exceed the maximum block size" );
+      }
+   } catch( ... ) {
+      _applied_ops.erase( _applied_ops.begin() + applied_ops, _applied_ops.end() );
+      throw;
+   }
+   const processed_transaction& processed_trx = _pending_block.transactions.back();
+   _pending_block_merkle.append( processed_trx.merkle_digest() );
 
    // The transaction applied successfully. Merge its changes into the pending block session.
    session.merge();
+   publish_read_view();
+
+   // Keep the transaction to apply it again on the next head, unless that is what is being done
+   auto trx_id = trx.id();
+   if( !_pending_transactions.get<by_trx_id>().count( trx_id ) )
+   {
+      pending_transaction pending;
+      pending.trx_id = trx_id;
+      pending.trx = trx;
+      const auto& dupes = get_index_type<transaction_index>().indices().get<by_trx_id>();
+      auto dupe = dupes.find( trx_id );
+      pending.expiration = dupe != dupes.end() ? dupe->expiration
+                           : _pending_block.timestamp + get_global_properties().parameters.maximum_time_until_expiration;
+      pending.skip = skip;
+      pending.packed_size = packed_size;
+      if( !trx.operations.empty() )
+         pending.fee_payer = dispatch( trx.operations.front(), operation_get_fee_payer() );
+      for( const auto& op : trx.operations )
+      {
+         asset fee = dispatch( op, operation_get_fee() );
+         if( fee.asset_id != asset_id_type() )
+            fee = fee * fee.asset_id(*this).options.core_exchange_rate;
+         pending.fee += fee.amount;
+      }
+      _pending_transactions.push_back( std::move( pending ) );
+   }
+   get_chain_metrics().transactions_pushed.increment();
+   get_chain_metrics().pending_transactions.set( _pending_transactions.size() );
    return processed_trx;
 }
 
+void database::select_pending_transactions_by_fee()
+{
+   reset_pending_block();
+
+   // An account's transactions go in their order of arrival, as each may depend on the ones before it
+   struct candidate
+   {
+      uint32_t                           turn;
+      uint64_t                           fee_rate;
+      uint64_t                           arrival;
+      const pending_transaction*         trx;
+   };
+   map<account_id_type, vector<std::pair<uint64_t, const pending_transaction*>>> by_payer;
+   uint64_t arrival = 0;
+   for( const auto& pending : _pending_transactions.get<by_arrival>() )
+      by_payer[pending.fee_payer].emplace_back( arrival++, &pending );
+
+   // Earlier turns first, then the higher fee rate, then the earlier arrival
+   auto later = []( const candidate& a, const candidate& b ) {
+      if( a.turn != b.turn ) return a.turn > b.turn;
+      if( a.fee_rate != b.fee_rate ) return a.fee_rate < b.fee_rate;
+      return a.arrival > b.arrival;
+   };
+   std::priority_queue<candidate, vector<candidate>, decltype(later)> queue( later );
+   map<account_id_type, size_t> next;
+   for( const auto& payer : by_payer )
+   {
+      const auto& first = payer.second.front();
+      queue.push( candidate{ 0, first.second->fee_rate(), first.first, first.second } );
+      next[payer.first] = 1;
+   }
+
+   const uint64_t max_block_size = get_global_properties().parameters.maximum_block_size;
+   while( !queue.empty() )
+   {
+      candidate c = queue.top();
+      queue.pop();
+      const auto& payer_trxs = by_payer[c.trx->fee_payer];
+      size_t& n = next[c.trx->fee_payer];
+      if( n < payer_trxs.size() )
+      {
+         const auto& following = payer_trxs[n++];
+         queue.push( candidate{ c.turn + 1, following.second->fee_rate(), following.first, following.second } );
+      }
+
+      // Leave what does not fit for a later block
+      if( pending_block_size() + c.trx->packed_size > max_block_size )
+         continue;
+      try {
+         push_transaction( c.trx->trx, c.trx->skip | skip_transaction_signatures );
+      } catch( const fc::exception& e ) {
+         tlog( "Leaving out pending transaction ${id}: ${e}", ("id",c.trx->trx_id)("e",e.to_string()) );
+      }
+   }
+}
+
+void database::restore_pending_transactions()
+{
+   auto& expiring = _pending_transactions.get<by_expiration>();
+   expiring.erase( expiring.begin(), expiring.lower_bound( _pending_block.timestamp ) );
+
+   auto& arrivals = _pending_transactions.get<by_arrival>();
+   for( auto itr = arrivals.begin(); itr != arrivals.end(); )
+   {
+      // Included in one of the blocks just applied
+      if( is_known_transaction( itr->trx_id ) )
+      {
+         itr = arrivals.erase( itr );
+         continue;
+      }
+      try {
+         push_transaction( itr->trx, itr->skip | skip_transaction_signatures );
+         ++itr;
+      } catch( const fc::exception& e ) {
+         tlog( "Dropping pending transaction ${id}: ${e}", ("id",itr->trx_id)("e",e.to_string()) );
+         itr = arrivals.erase( itr );
+      }
+   }
+   // Every push of blocks ends here, so read views see the new head along with what is pending on it
+   publish_read_view();
+   get_chain_metrics().pending_transactions.set( _pending_transactions.size() );
+}
+
+void database::precheck_transaction( const signed_transaction& trx )
+{ try {
+   if( _signature_threads.empty() )
+      return;
+
+   // Take everything the checks need from the database here, on the chain thread
+   const chain_parameters& params = get_global_properties().parameters;
+   uint32_t max_trx_size = params.maximum_transaction_size;
+   bool check_expiration = head_block_num() > 0;
+   fc::time_point_sec now = _pending_block.timestamp;
+   fc::time_point_sec max_expiration = now + params.maximum_time_until_expiration;
+   optional<block_id_type> ref_block_id;
+   if( trx.relative_expiration != 0 && check_expiration )
+   {
+      const auto* summary = find( block_summary_id_type( trx.ref_block_num ) );
+      FC_ASSERT( summary && trx.ref_block_prefix == summary->block_id._hash[1], "Unknown reference block" );
+      FC_ASSERT( now <= summary->timestamp + params.block_interval * trx.relative_expiration, "Transaction is expired" );
+      ref_block_id = summary->block_id;
+   }
+   vector<address> key_addresses;
+   key_addresses.reserve( trx.signatures.size() );
+   for( const auto& sig : trx.signatures )
+      key_addresses.push_back( _key_addresses->get( *this, sig.first ) );
+
+   auto& thread = _signature_threads[_next_precheck_thread++ % _signature_threads.size()];
+   thread->async( [&]() {
+      trx.validate();
+      FC_ASSERT( fc::raw::pack_size( trx ) <= max_trx_size, "Transaction is too large" );
+      if( trx.relative_expiration == 0 && check_expiration )
+      {
+         fc::time_point_sec expiration( trx.ref_block_prefix );
+         FC_ASSERT( now <= expiration && expiration <= max_expiration, "Invalid expiration time" );
+      }
+      if( trx.relative_expiration != 0 && !ref_block_id )
+         return;
+
+      digest_type digest = ref_block_id ? trx.digest( *ref_block_id ) : trx.digest();
+      uint32_t i = 0;
+      for( const auto& sig : trx.signatures )
+         FC_ASSERT( _signature_cache.recover( digest, sig.second ) == key_addresses[i++], "Invalid signature",
+                    ("key", sig.first) );
+   }, "precheck_transaction" ).wait();
+} FC_CAPTURE_AND_RETHROW( (trx) ) }
+
 processed_transaction database::push_proposal(const proposal_object& proposal)
 {
    transaction_evaluation_state eval_state(this);
@@ -225,18 +604,25 @@ processed_transaction database::push_proposal(const proposal_object& proposal)
                      return std::make_pair(id, authority::owner);
                   });
 
-   ilog("Attempting to push proposal ${prop}", ("prop", proposal));
-   idump((eval_state.approved_by));
+   tlog("Attempting to push proposal ${prop}", ("prop", proposal));
+   tdump((eval_state.approved_by));
 
    eval_state.operation_results.reserve(proposal.proposed_transaction.operations.size());
    processed_transaction ptrx(proposal.proposed_transaction);
    eval_state._trx = &ptrx;
 
-   auto session = _undo_db.start_undo_session();
-   for( auto& op : proposal.proposed_transaction.operations )
-      eval_state.operation_results.emplace_back(apply_operation(eval_state, op));
-   remove(proposal);
-   session.merge();
+   // The fees deferred by a proposal which fails must be dropped along with its session
+   auto deferred_fees = _deferred_fees;
+   try {
+      auto session = _undo_db.start_undo_session();
+      for( auto& op : proposal.proposed_transaction.operations )
+         eval_state.operation_results.emplace_back(apply_operation(eval_state, op));
+      remove(proposal);
+      session.merge();
+   } catch( ... ) {
+      _deferred_fees = std::move( deferred_fees );
+      throw;
+   }
 
    ptrx.operation_results = std::move(eval_state.operation_results);
    return ptrx;
@@ -248,6 +634,18 @@ signed_block database::generate_block(
    const fc::ecc::private_key& block_signing_private_key,
    uint32_t skip /* = 0 */
    )
+{ try {
+   signed_block block = build_block( when, witness_id, block_signing_private_key, skip );
+   push_generated_block( block, skip );
+   return block;
+} FC_CAPTURE_AND_RETHROW( (witness_id) ) }
+
+signed_block database::build_block(
+   fc::time_point_sec when,
+   witness_id_type witness_id,
+   const fc::ecc::private_key& block_signing_private_key,
+   uint32_t skip /* = 0 */
+   )
 {
    try {
    uint32_t slot_num = get_slot_at_time( when );
@@ -259,7 +657,19 @@ signed_block database::generate_block(
    if( !(skip & skip_delegate_signature) )
       FC_ASSERT( witness_obj.signing_key(*this).key() == block_signing_private_key.get_public_key() );
 
-   _pending_block.timestamp = when;
+   // The pending transactions were applied for the time of the next slot, which is not the time of this one if the
+   // slots in between were missed
+   if( _prioritize_transactions_by_fee )
+   {
+      _pending_block.timestamp = when;
+      select_pending_transactions_by_fee();
+   }
+   else if( _pending_block.timestamp != when )
+   {
+      _pending_block.timestamp = when;
+      reset_pending_block();
+      restore_pending_transactions();
+   }
 
    secret_hash_type::encoder last_enc;
    fc::raw::pack( last_enc, block_signing_private_key );
@@ -271,43 +681,114 @@ signed_block database::generate_block(
    fc::raw::pack( next_enc, _pending_block.previous_secret );
    _pending_block.next_secret_hash = secret_hash_type::hash(next_enc.result());
 
-   _pending_block.transaction_merkle_root = _pending_block.calculate_merkle_root();
+   _pending_block.transaction_merkle_root = _pending_block_merkle.root();
 
    _pending_block.witness = witness_id;
    if( !(skip & skip_delegate_signature) ) _pending_block.sign( block_signing_private_key );
 
-   FC_ASSERT( fc::raw::pack_size(_pending_block) <= get_global_properties().parameters.maximum_block_size );
-   //This line used to std::move(_pending_block) but this is unsafe as _pending_block is later referenced without being
-   //reinitialized. Future optimization could be to move it, then reinitialize it with the values we need to preserve.
-   signed_block tmp = _pending_block;
-   tmp.transaction_merkle_root = tmp.calculate_merkle_root();
-   _pending_block.transactions.clear();
-   push_block( tmp, skip );
-   return tmp;
+   FC_ASSERT( pending_block_size() <= get_global_properties().parameters.maximum_block_size );
+   return _pending_block;
 } FC_CAPTURE_AND_RETHROW( (witness_id) ) }
 
+bool database::is_pending_block( const signed_block& block )const
+{
+   return block.previous == head_block_id()
+       && block.timestamp == _pending_block.timestamp
+       && block.transactions.size() == _pending_block.transactions.size()
+       && block.transaction_merkle_root == _pending_block_merkle.root();
+}
+
+void database::push_generated_block( const signed_block& block, uint32_t skip /* = 0 */ )
+{ try {
+   // Its transactions were applied in order on this very head when it was built, so they still apply. Those pushed
+   // since are left pending for the next block.
+   FC_ASSERT( block.previous == head_block_id(), "The head block changed since the block was built" );
+   // Every pending transaction had its signatures checked when it was pushed, and build_block made the merkle root
+   // and checked the size of the block from the sizes of its transactions.
+   skip |= skip_transaction_signatures | skip_merkle_check | skip_block_size_check;
+
+   if( !is_pending_block( block ) || before_last_block_checkpoint( block.block_num() ) ||
+       ( !(skip & skip_fork_db) && _fork_db.head() && _fork_db.head()->id != head_block_id() ) )
+   {
+      push_block( block, skip );
+      return;
+   }
+
+   // The block is exactly the pending transactions, which are applied already. Their session becomes the one of the
+   // block, and only what follows the transactions of a block is left to apply.
+   block_hash_cache_scope hash_cache_scope( block );
+   if( !(skip & skip_fork_db) )
+      _fork_db.push_block( block );
+   try {
+      precheck_block( block, skip | skip_transaction_dupe_check, nullptr );
+      if( !_pending_block_session )
+         _pending_block_session = _undo_db.start_undo_session();
+      auto session = std::move( *_pending_block_session );
+      _pending_block_session.reset();
+      _pending_block.transactions.clear();
+      _pending_block_merkle.clear();
+      _pending_block_transactions_size = 0;
+      apply_pending_block( block, skip );
+      _block_id_to_block.store( block.id(), block );
+      session.commit();
+   } catch ( const fc::exception& e ) {
+      elog("Failed to push generated block:\n${e}", ("e", e.to_detail_string()));
+      _fork_db.remove(block.id());
+      reset_pending_block();
+      if( !_defer_pending_restore )
+         restore_pending_transactions();
+      throw;
+   }
+
+   if( !_defer_pending_restore )
+      restore_pending_transactions();
+} FC_CAPTURE_AND_RETHROW( (block.block_num()) ) }
+
 /**
  * Removes the most recent block from the database and
  * undoes any changes it made.
  */
 void database::pop_block()
 { try {
-   _pending_block_session.reset();
+   reset_pending_block();
    _block_id_to_block.remove( _pending_block.previous );
    pop_undo();
    _pending_block.previous  = head_block_id();
    _pending_block.timestamp = head_block_time();
    _fork_db.pop_block();
+
+   // Checkpoints of popped blocks are never written, so their objects need writing by a later one
+   while( !_checkpoints.empty() && _checkpoints.back().first > head_block_num() )
+   {
+      discard_changes( *_checkpoints.back().second );
+      _checkpoints.pop_back();
+   }
 } FC_CAPTURE_AND_RETHROW() }
 
 void database::clear_pending()
+{ try {
+   reset_pending_block();
+   _pending_transactions.clear();
+} FC_CAPTURE_AND_RETHROW() }
+
+void database::reset_pending_block()
 { try {
    _pending_block.transactions.clear();
+   _pending_block_merkle.clear();
+   _pending_block_transactions_size = 0;
    _pending_block_session.reset();
+   _applied_ops.clear();
+   _batched_markets.clear();
 } FC_CAPTURE_AND_RETHROW() }
 
 uint32_t database::push_applied_operation( const operation& op )
 {
+   if( !applied_operations_tracked() )
+   {
+      // The virtual operations keep their numbering whether or not anyone records them
+      ++_current_virtual_op;
+      return untracked_operation;
+   }
    _applied_ops.emplace_back(op);
    auto& oh = _applied_ops.back();
    oh.block_num    = _current_block_num;
@@ -318,6 +799,8 @@ uint32_t database::push_applied_operation( const operation& op )
 }
 void database::set_applied_operation_result( uint32_t op_id, const operation_result& result )
 {
+   if( op_id == untracked_operation )
+      return;
    assert( op_id < _applied_ops.size() );
    _applied_ops[op_id].result = result;
 }
@@ -327,36 +810,260 @@ const vector<operation_history_object>& database::get_applied_operations() const
    return _applied_ops;
 }
 
+void database::add_applied_operations_consumer()
+{
+   ++_applied_operations_consumers;
+}
+
+void database::remove_applied_operations_consumer()
+{
+   assert( _applied_operations_consumers > 0 );
+   if( --_applied_operations_consumers == 0 )
+      _applied_ops.clear();
+}
+
 //////////////////// private methods ////////////////////
 
-void database::apply_block( const signed_block& next_block, uint32_t skip )
+void database::apply_block( const signed_block& next_block, uint32_t skip, const recovered_block_signatures* recovered )
 { try {
    _applied_ops.clear();
+   // Markets deferred while building the pending block are matched, or not, by the blocks themselves
+   _batched_markets.clear();
 
    FC_ASSERT( (skip & skip_merkle_check) || next_block.transaction_merkle_root == next_block.calculate_merkle_root() );
 
-   const witness_object& signing_witness = validate_block_header(skip, next_block);
-   const auto& global_props = get_global_properties();
-   const auto& dynamic_global_props = get<dynamic_global_property_object>(dynamic_global_property_id_type());
+   const witness_object& signing_witness = validate_block_header( skip, next_block,
+                                                                  recovered ? recovered->signee : optional<address>() );
 
    _current_block_num    = next_block.block_num();
    _current_trx_in_block = 0;
 
-   for( const auto& trx : next_block.transactions )
+   // The transactions of a block share their authority approvals. The block either applies entirely or not at all,
+   // so the approvals can't outlive the state they were found in.
+   _authority_cache.clear();
+   _authority_cache_enabled = true;
+   // The market fees, and the operation fees no evaluator reads, are added to their objects once, after the last
+   // transaction
+   _deferred_fees.clear();
+   _defer_fees = true;
+   const bool track_conflicts = _track_transaction_conflicts && _undo_db.enabled();
+   _block_written_objects.clear();
+   _transaction_schedule_slots.clear();
+   if( track_conflicts )
+   {
+      // Scheduled against the state before the block, as a parallel apply would be
+      const auto stages = schedule_block_transactions( next_block );
+      _transaction_schedule_slots.resize( next_block.transactions.size() );
+      for( uint32_t stage = 0; stage < stages.size(); ++stage )
+         for( uint32_t group = 0; group < stages[stage].groups.size(); ++group )
+            for( uint32_t trx_num : stages[stage].groups[group] )
+               _transaction_schedule_slots[trx_num] = std::make_pair( stage, group );
+      _transaction_conflict_stats.scheduled_stages += stages.size();
+      for( const auto& stage : stages )
+         _transaction_conflict_stats.scheduled_groups += stage.groups.size();
+   }
+   auto transactions_start = std::chrono::steady_clock::now();
+   try {
+      for( const auto& trx : next_block.transactions )
+      {
+         /* We do not need to push the undo state for each transaction
+          * because they either all apply and are valid or the
+          * entire block fails to apply.  We only need an "undo" state
+          * for transactions when validating broadcast transactions or
+          * when building a block.
+          */
+         const recovered_signatures* trx_recovered = recovered && _current_trx_in_block < recovered->transactions.size()
+                                                     ? &recovered->transactions[_current_trx_in_block] : nullptr;
+         if( track_conflicts )
+         {
+            // Only to find the objects this transaction writes
+            auto trx_session = _undo_db.start_undo_session();
+            evaluate_transaction( trx, skip, trx_recovered );
+            record_transaction_writes( _undo_db.head_changes() );
+            trx_session.merge();
+         }
+         else
+            evaluate_transaction( trx, skip, trx_recovered );
+         ++_current_trx_in_block;
+      }
+   } catch( ... ) {
+      invalidate_authority_cache();
+      _defer_fees = false;
+      _deferred_fees.clear();
+      throw;
+   }
+   invalidate_authority_cache();
+   _defer_fees = false;
+   flush_deferred_fees();
+   if( track_conflicts )
+   {
+      ++_transaction_conflict_stats.blocks;
+      _block_written_objects.clear();
+      _transaction_schedule_slots.clear();
+   }
+
+   apply_block_updates( next_block, signing_witness, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - transactions_start ).count() );
+} FC_CAPTURE_AND_RETHROW( (next_block.block_num())(skip) )  }
+
+void database::record_transaction_writes( const undo_changes& changes )
+{
+   const vector<object_id_type> written = changes.affected();
+   const uint32_t trx_num = _current_trx_in_block;
+   bool conflict = false;
+   bool missed = false;
+   for( const auto& id : written )
+   {
+      auto result = _block_written_objects.emplace( id, trx_num );
+      if( result.second )
+         continue;
+      conflict = true;
+      if( trx_num < _transaction_schedule_slots.size() )
+      {
+         const auto& earlier = _transaction_schedule_slots[result.first->second];
+         const auto& current = _transaction_schedule_slots[trx_num];
+         missed |= earlier.first == current.first && earlier.second != current.second;
+      }
+      result.first->second = trx_num;
+   }
+   ++_transaction_conflict_stats.transactions;
+   if( conflict )
+      ++_transaction_conflict_stats.conflicting_transactions;
+   if( missed )
+      ++_transaction_conflict_stats.footprint_misses;
+   _transaction_conflict_stats.objects_written += written.size();
+}
+
+namespace {
+   struct operation_fee
+   {
+      typedef std::pair<account_id_type, asset> result_type;
+      template<typename T>
+      result_type operator()( const T& op )const { return std::make_pair( op.fee_payer(), op.fee ); }
+   };
+}
+
+operation_footprint database::get_transaction_footprint( const transaction& trx, bool refine_orders )const
+{
+   const chain_parameters& params = get_global_properties().parameters;
+   operation_footprint footprint;
+   for( const auto& op : trx.operations )
+   {
+      operation_footprint op_footprint;
+      op.visit( operation_get_footprint( op_footprint ) );
+
+      // A fee pays cashback to the payer, when it is prime, or else to its referrer, whose vesting balance is
+      // created or replaced unless it has one with the current vesting period
+      auto fee = op.visit( operation_fee() );
+      if( fee.second.amount > 0 && params.witness_percent_of_fee + params.burn_percent_of_fee < GRAPHENE_100_PERCENT )
+      {
+         const account_object* payer = find( fee.first );
+         if( payer == nullptr )
+            op_footprint.unbounded = true;
+         else
+         {
+            const account_object* target = payer->is_prime() ? payer : find( payer->referrer );
+            if( target == nullptr )
+               op_footprint.unbounded = true;
+            else
+            {
+               op_footprint.accounts.insert( target->id );
+               const vesting_balance_object* vb = target->cashback_vb ? find( *target->cashback_vb ) : nullptr;
+               if( vb == nullptr || vb->policy.which() != vesting_policy::tag<cdd_vesting_policy>::value
+                   || vb->policy.get<cdd_vesting_policy>().vesting_seconds != params.cashback_vesting_period_seconds )
+                  op_footprint.created.insert( object_id_type( protocol_ids, vesting_balance_object_type, 0 ) );
+            }
+         }
+      }
+
+      // An object which does not exist yet can only be named once an earlier transaction created it
+      auto require = [&]( object_id_type id ) {
+         if( find_object( id ) == nullptr )
+            op_footprint.created.insert( object_id_type( id.space(), id.type(), 0 ) );
+      };
+      for( const auto& id : op_footprint.accounts )
+         require( id );
+      for( const auto& id : op_footprint.objects )
+         require( id );
+      for( const auto& id : op_footprint.assets_read )
+         require( id );
+      for( const auto& id : op_footprint.assets_written )
+         require( id );
+
+      if( op.which() == operation::tag<transfer_operation>::value )
+      {
+         // Balances are never removed, so one held before the block is only ever modified
+         const auto& transfer = op.get<transfer_operation>();
+         if( _balances->find( transfer.to, transfer.amount.asset_id ) != nullptr )
+            op_footprint.created.erase( object_id_type( implementation_ids, impl_account_balance_object_type, 0 ) );
+      }
+      else if( refine_orders && op.which() == operation::tag<limit_order_create_operation>::value )
+      {
+         // An order in a market matched in batches only joins the book until the end of the block
+         const auto& order = op.get<limit_order_create_operation>();
+         const asset_object* sell = find( order.amount_to_sell.asset_id );
+         const asset_object* receive = find( order.min_to_receive.asset_id );
+         if( sell && receive && ( sell->matches_in_batches() || receive->matches_in_batches() )
+             && !sell->is_market_issued() && !receive->is_market_issued() && !order.fill_or_kill )
+            op_footprint.unbounded = false;
+      }
+      footprint.merge( op_footprint );
+   }
+   return footprint;
+}
+
+vector<transaction_stage> database::schedule_block_transactions( const signed_block& block )const
+{
+   vector<operation_footprint> footprints;
+   footprints.reserve( block.transactions.size() );
+   bool after_unbounded = false;
+   for( const auto& trx : block.transactions )
    {
-      /* We do not need to push the undo state for each transaction
-       * because they either all apply and are valid or the
-       * entire block fails to apply.  We only need an "undo" state
-       * for transactions when validating broadcast transactions or
-       * when building a block.
-       */
-      apply_transaction( trx, skip | skip_transaction_signatures );
-      ++_current_trx_in_block;
+      // An unbounded transaction may change whether later orders' markets are matched in batches
+      footprints.push_back( get_transaction_footprint( trx, !after_unbounded ) );
+      after_unbounded |= footprints.back().unbounded;
    }
+   return schedule_transactions( footprints );
+}
+
+void database::apply_pending_block( const signed_block& next_block, uint32_t skip )
+{ try {
+   const witness_object& signing_witness = validate_block_header( skip, next_block, optional<address>() );
+   _current_block_num    = next_block.block_num();
+   _current_trx_in_block = next_block.transactions.size();
+
+   apply_block_updates( next_block, signing_witness );
+} FC_CAPTURE_AND_RETHROW( (next_block.block_num())(skip) )  }
+
+void database::apply_block_updates( const signed_block& next_block, const witness_object& signing_witness,
+                                    uint64_t transactions_ns )
+{
+   const auto& global_props = get_global_properties();
+   const auto& dynamic_global_props = get<dynamic_global_property_object>(dynamic_global_property_id_type());
+
+   // Each call moves the end of the previous phase to now and stores its length in phase
+   block_timing timing;
+   auto phase_start = std::chrono::steady_clock::now();
+   const auto updates_start = phase_start;
+   auto end_phase = [&]( uint64_t& phase ) {
+      if( _block_timing_history == 0 )
+         return;
+      auto now = std::chrono::steady_clock::now();
+      phase = std::chrono::duration_cast<std::chrono::nanoseconds>( now - phase_start ).count();
+      timing.total_ns += phase;
+      phase_start = now;
+   };
+
+   match_batched_markets();
+   end_phase( timing.match_markets_ns );
 
    update_witness_schedule(next_block);
+   end_phase( timing.witness_schedule_ns );
    update_global_dynamic_data(next_block);
+   end_phase( timing.global_dynamic_data_ns );
    update_signing_witness(signing_witness, next_block);
+   update_last_irreversible_block();
+   end_phase( timing.signing_witness_ns );
 
    auto current_block_interval = global_props.parameters.block_interval;
 
@@ -364,51 +1071,108 @@ void database::apply_block( const signed_block& next_block, uint32_t skip )
    if( dynamic_global_props.next_maintenance_time <= next_block.timestamp )
       // This will update _pending_block.timestamp if the block interval has changed
       perform_chain_maintenance(next_block, global_props);
+   end_phase( timing.maintenance_ns );
 
    create_block_summary(next_block);
+   end_phase( timing.block_summary_ns );
    clear_expired_transactions();
    clear_expired_proposals();
    clear_expired_orders();
+   end_phase( timing.clear_expired_ns );
    update_expired_feeds();
+   end_phase( timing.expired_feeds_ns );
    update_withdraw_permissions();
+   end_phase( timing.withdraw_permissions_ns );
 
    // notify observers that the block has been applied
+   publish_changes();
+   if( state_hash_enabled() )
+      record_state_hash( next_block.block_num() );
+   _applied_block_observers_ns.clear();
    applied_block( next_block ); //emit
    _applied_ops.clear();
+   end_phase( timing.applied_block_ns );
 
-   const auto& head_undo = _undo_db.head();
-   vector<object_id_type> changed_ids;  changed_ids.reserve(head_undo.old_values.size());
-   for( const auto& item : head_undo.old_values ) changed_ids.push_back(item.first);
-   changed_objects(changed_ids);
+   // Nothing is tracked while the blocks are replayed with the undo history disabled
+   _changed_objects_observers_ns.clear();
+   if( _undo_db.enabled() )
+   {
+      // One walk of the head undo state sorts the ids by kind for every observer
+      const undo_changes changes = _undo_db.head_changes();
+      changed_objects( changes.modified );
+      if( !affected_objects.empty() )
+         affected_objects( changes.affected() );
+   }
+   end_phase( timing.changed_objects_ns );
 
+   const bool sync = sync_due();
+   if( sync )
+      _block_id_to_block.sync();
+   if( _checkpoint_interval )
+   {
+      if( next_block.block_num() % _checkpoint_interval == 0 )
+         _checkpoints.emplace_back( next_block.block_num(), capture_changes() );
+      if( sync || !sync_enabled() )
+         write_irreversible_checkpoints( sync );
+   }
+   else if( _flush_interval && next_block.block_num() % _flush_interval == 0 )
+      flush( sync_enabled() );
+   end_phase( timing.flush_ns );
 
    update_pending_block(next_block, current_block_interval);
-} FC_CAPTURE_AND_RETHROW( (next_block.block_num())(skip) )  }
+   end_phase( timing.pending_block_ns );
+
+   // The metrics are kept whether or not the timing history is
+   chain_metrics& metrics = get_chain_metrics();
+   const uint64_t updates_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now() - updates_start ).count();
+   metrics.blocks.increment();
+   metrics.transactions.increment( next_block.transactions.size() );
+   metrics.block_apply_us.observe( (transactions_ns + updates_ns) / 1000 );
+   metrics.head_block_num.set( next_block.block_num() );
+   metrics.undo_depth.set( _undo_db.size() );
+   metrics.fork_db_size.set( _fork_db.size() );
+
+   if( _block_timing_history )
+   {
+      timing.block_num = next_block.block_num();
+      timing.transactions = next_block.transactions.size();
+      timing.transactions_ns = transactions_ns;
+      timing.total_ns += transactions_ns;
+      timing.applied_block_observers_ns = std::move( _applied_block_observers_ns );
+      timing.changed_objects_observers_ns = std::move( _changed_objects_observers_ns );
+      _block_timings.push_back( std::move(timing) );
+      while( _block_timings.size() > _block_timing_history )
+         _block_timings.pop_front();
+   }
+}
 
-processed_transaction database::apply_transaction( const signed_transaction& trx, uint32_t skip )
+processed_transaction database::apply_transaction( const signed_transaction& trx, uint32_t skip, const recovered_signatures* recovered )
+{
+   const auto& results = evaluate_transaction( trx, skip, recovered );
+   processed_transaction ptrx( trx );
+   ptrx.operation_results = results;
+   return ptrx;
+}
+
+const vector<operation_result>& database::evaluate_transaction( const signed_transaction& trx, uint32_t skip,
+                                                                const recovered_signatures* recovered )
 { try {
    trx.validate();
    auto& trx_idx = get_mutable_index_type<transaction_index>();
    auto trx_id = trx.id();
    FC_ASSERT( (skip & skip_transaction_dupe_check) ||
               trx_idx.indices().get<by_trx_id>().find(trx_id) == trx_idx.indices().get<by_trx_id>().end() );
-   transaction_evaluation_state eval_state(this, skip&skip_authority_check );
+   transaction_evaluation_state& eval_state = _trx_eval_state;
+   eval_state.reset( this, skip&skip_authority_check );
+   if( _authority_cache_enabled )
+      eval_state._authority_cache = &_authority_cache;
    const chain_parameters& chain_parameters = get_global_properties().parameters;
    eval_state._trx = &trx;
 
    //This check is used only if this transaction has an absolute expiration time.
    if( !(skip & skip_transaction_signatures) && trx.relative_expiration == 0 )
-   {
-      for( const auto& sig : trx.signatures )
-      {
-         FC_ASSERT( sig.first(*this).key_address() == fc::ecc::public_key( sig.second, trx.digest() ), "",
-                    ("trx",trx)
-                    ("digest",trx.digest())
-                    ("sig.first",sig.first)
-                    ("key_address",sig.first(*this).key_address())
-                    ("addr", address(fc::ecc::public_key( sig.second, trx.digest() ))) );
-      }
-   }
+      check_transaction_signatures( trx, trx.digest(), recovered );
 
    //If we're skipping tapos check, but not dupe check, assume all transactions have maximum expiration time.
    fc::time_point_sec trx_expiration = _pending_block.timestamp + chain_parameters.maximum_time_until_expiration;
@@ -421,25 +1185,15 @@ processed_transaction database::apply_transaction( const signed_transaction& trx
       {
          //Check the TaPoS reference and expiration time
          //Remember that the TaPoS block number is abbreviated; it contains only the lower 16 bits.
-         //Lookup TaPoS block summary by block number (remember block summary instances are the block numbers)
+         //Lookup TaPoS block summary by block number (remember block summary instances are the lower 16 bits of
+         //the block numbers)
          const block_summary_object& tapos_block_summary
                = static_cast<const block_summary_object&>(get_index<block_summary_object>()
-                                                          .get(block_summary_id_type((head_block_num() & ~0xffff)
-                                                                                     + trx.ref_block_num)));
+                                                          .get(block_summary_id_type(trx.ref_block_num)));
 
          //This is the signature check for transactions with relative expiration.
          if( !(skip & skip_transaction_signatures) )
-         {
-            for( const auto& sig : trx.signatures )
-            {
-               address trx_addr = fc::ecc::public_key(sig.second, trx.digest(tapos_block_summary.block_id));
-               FC_ASSERT(sig.first(*this).key_address() == trx_addr,
-                          "",
-                          ("sig.first",sig.first)
-                          ("key_address",sig.first(*this).key_address())
-                          ("addr", trx_addr));
-            }
-         }
+            check_transaction_signatures( trx, trx.digest(tapos_block_summary.block_id), recovered );
 
          //Verify TaPoS block summary has correct ID prefix, and that this block's time is not past the expiration
          FC_ASSERT( trx.ref_block_prefix == tapos_block_summary.block_id._hash[1] );
@@ -459,22 +1213,20 @@ processed_transaction database::apply_transaction( const signed_transaction& trx
       create<transaction_object>([&](transaction_object& transaction) {
          transaction.expiration = trx_expiration;
          transaction.trx_id = trx_id;
-         transaction.trx = trx;
+         transaction.block_num = _current_block_num;
       });
    }
 
    eval_state.operation_results.reserve( trx.operations.size() );
 
-   processed_transaction ptrx(trx);
    _current_op_in_trx = 0;
-   for( const auto& op : ptrx.operations )
+   for( const auto& op : trx.operations )
    {
       eval_state.operation_results.emplace_back(apply_operation(eval_state, op));
       ++_current_op_in_trx;
    }
-   ptrx.operation_results = std::move( eval_state.operation_results );
 
-   return ptrx;
+   return eval_state.operation_results;
 } FC_CAPTURE_AND_RETHROW( (trx) ) }
 
 operation_result database::apply_operation(transaction_evaluation_state& eval_state, const operation& op)
@@ -494,14 +1246,17 @@ operation_result database::apply_operation(transaction_evaluation_state& eval_st
    return result;
 }
 
-const witness_object& database::validate_block_header( uint32_t skip, const signed_block& next_block )const
+const witness_object& database::validate_block_header( uint32_t skip, const signed_block& next_block,
+                                                       const optional<address>& signee )const
 {
    FC_ASSERT( _pending_block.previous == next_block.previous, "", ("pending.prev",_pending_block.previous)("next.prev",next_block.previous) );
    FC_ASSERT( _pending_block.timestamp <= next_block.timestamp, "", ("_pending_block.timestamp",_pending_block.timestamp)("next",next_block.timestamp)("blocknum",next_block.block_num()) );
    const witness_object& witness = next_block.witness(*this);
    FC_ASSERT( secret_hash_type::hash(next_block.previous_secret) == witness.next_secret, "",
               ("previous_secret", next_block.previous_secret)("next_secret", witness.next_secret));
-   if( !(skip&skip_delegate_signature) ) FC_ASSERT( next_block.validate_signee( witness.signing_key(*this).key() ) );
+   if( !(skip&skip_delegate_signature) )
+      FC_ASSERT( signee ? *signee == address( witness.signing_key(*this).key() )
+                        : next_block.validate_signee( witness.signing_key(*this).key() ) );
 
    uint32_t slot_num = get_slot_at_time( next_block.timestamp );
    FC_ASSERT( slot_num > 0 );
@@ -512,13 +1267,260 @@ const witness_object& database::validate_block_header( uint32_t skip, const sign
    return witness;
 }
 
+optional<recovered_block_signatures> database::recover_block_signatures( const signed_block& next_block, uint32_t skip )
+{
+   if( _batch_signature_verification )
+      return verify_block_signature_batch( next_block, skip );
+
+   if( (skip & skip_transaction_signatures) || _signature_threads.empty() || next_block.transactions.empty() )
+      return optional<recovered_block_signatures>();
+
+   const auto& transactions = next_block.transactions;
+   vector<optional<block_id_type>> ref_block_ids = resolve_reference_blocks( next_block );
+
+   recovered_block_signatures recovered;
+   auto& result = recovered.transactions;
+   result.resize( transactions.size() );
+   size_t thread_count = std::min( _signature_threads.size(), transactions.size() );
+   size_t chunk_size = (transactions.size() + thread_count - 1) / thread_count;
+
+   vector<fc::future<void>> workers;
+   workers.reserve( thread_count );
+   for( size_t t = 0; t < thread_count; ++t )
+   {
+      size_t begin = t * chunk_size;
+      size_t end = std::min( begin + chunk_size, transactions.size() );
+      workers.push_back( _signature_threads[t]->async( [this, &transactions, &ref_block_ids, &result, begin, end]() {
+         for( size_t i = begin; i < end; ++i )
+         {
+            const signed_transaction& trx = transactions[i];
+            recovered_signatures& out = result[i];
+            try {
+               if( trx.relative_expiration == 0 )
+                  out.digest = trx.digest();
+               else if( ref_block_ids[i] )
+                  out.digest = trx.digest( *ref_block_ids[i] );
+               else
+                  continue;
+
+               out.signers.reserve( trx.signatures.size() );
+               for( const auto& sig : trx.signatures )
+                  out.signers.push_back( _signature_cache.recover( out.digest, sig.second ) );
+            } catch( const fc::exception& ) {
+               // Leave this transaction to apply_transaction, which will report the bad signature.
+               out.signers.clear();
+            }
+         }
+      }, "recover_block_signatures" ) );
+   }
+   for( auto& worker : workers )
+      worker.wait();
+
+   return recovered;
+}
+
+optional<recovered_block_signatures> database::verify_block_signature_batch( const signed_block& next_block, uint32_t skip )
+{
+   bool check_signee = !(skip & skip_delegate_signature);
+   bool check_transactions = !(skip & skip_transaction_signatures) && !next_block.transactions.empty();
+   if( !check_signee && !check_transactions )
+      return optional<recovered_block_signatures>();
+
+   signature_batch batch;
+   if( check_signee )
+      batch.add( next_block.digest(), next_block.delegate_signature, true );
+
+   // Digests are computed here so the batch is a flat list of signatures, which spreads evenly over the threads
+   recovered_block_signatures recovered;
+   vector<optional<uint32_t>> first_signer( next_block.transactions.size() );
+   if( check_transactions )
+   {
+      vector<optional<block_id_type>> ref_block_ids = resolve_reference_blocks( next_block );
+      recovered.transactions.resize( next_block.transactions.size() );
+      for( uint32_t i = 0; i < next_block.transactions.size(); ++i )
+      {
+         const signed_transaction& trx = next_block.transactions[i];
+         // apply_transaction will reject the unknown reference block
+         if( trx.relative_expiration != 0 && !ref_block_ids[i] )
+            continue;
+         recovered.transactions[i].digest = trx.relative_expiration == 0 ? trx.digest() : trx.digest( *ref_block_ids[i] );
+         first_signer[i] = batch.size();
+         for( const auto& sig : trx.signatures )
+            batch.add( recovered.transactions[i].digest, sig.second );
+      }
+   }
+
+   if( !batch.verify( _signature_threads, &_signature_cache ) )
+   {
+      wlog( "Signature batch for block ${n} failed, falling back to checking signatures individually",
+            ("n", next_block.block_num()) );
+      return optional<recovered_block_signatures>();
+   }
+
+   const auto& signers = batch.signers();
+   if( check_signee )
+      recovered.signee = signers[0];
+   for( uint32_t i = 0; i < recovered.transactions.size(); ++i )
+   {
+      if( !first_signer[i] )
+         continue;
+      auto first = signers.begin() + *first_signer[i];
+      recovered.transactions[i].signers.assign( first, first + next_block.transactions[i].signatures.size() );
+   }
+   return recovered;
+}
+
+void database::precheck_block( const signed_block& next_block, uint32_t skip, const recovered_block_signatures* recovered )
+{ try {
+   // The checks below are made against the head block state, so they only hold for a block which builds on it
+   if( next_block.previous != head_block_id() )
+      return;
+
+   const chain_parameters& params = get_global_properties().parameters;
+   FC_ASSERT( (skip & skip_block_size_check) || fc::raw::pack_size( next_block ) <= params.maximum_block_size,
+              "Block is too large" );
+
+   const auto& trx_idx = get_index_type<transaction_index>().indices().get<by_trx_id>();
+   flat_set<transaction_id_type> trx_ids;
+   for( uint32_t i = 0; i < next_block.transactions.size(); ++i )
+   {
+      const signed_transaction& trx = next_block.transactions[i];
+      trx.validate();
+
+      auto trx_id = trx.id();
+      FC_ASSERT( (skip & skip_transaction_dupe_check) ||
+                 (trx_idx.find( trx_id ) == trx_idx.end() && trx_ids.insert( trx_id ).second),
+                 "Duplicate transaction", ("trx_in_block", i) );
+
+      // Every check apply_transaction makes on the expiration, and nothing more
+      optional<block_id_type> ref_block_id;
+      if( head_block_num() > 0 )
+      {
+         fc::time_point_sec trx_expiration = _pending_block.timestamp + params.maximum_time_until_expiration;
+         if( !(skip & skip_tapos_check) && trx.relative_expiration != 0 )
+         {
+            const auto* summary = find( block_summary_id_type( trx.ref_block_num ) );
+            FC_ASSERT( summary && trx.ref_block_prefix == summary->block_id._hash[1], "Unknown reference block",
+                       ("trx_in_block", i) );
+            ref_block_id = summary->block_id;
+            trx_expiration = summary->timestamp + params.block_interval*trx.relative_expiration;
+         } else if( trx.relative_expiration == 0 ) {
+            trx_expiration = fc::time_point_sec( trx.ref_block_prefix );
+            FC_ASSERT( trx_expiration <= _pending_block.timestamp + params.maximum_time_until_expiration,
+                       "Expiration too far in the future", ("trx_in_block", i) );
+         }
+         FC_ASSERT( _pending_block.timestamp <= trx_expiration, "Transaction is expired", ("trx_in_block", i) );
+      } else if( !(skip & skip_transaction_signatures) ) {
+         FC_ASSERT( trx.relative_expiration == 0, "May not use transactions with a reference block in block 1!",
+                    ("trx_in_block", i) );
+      }
+
+      // Signatures are only compared if they were recovered ahead of time, against keys which already exist. Keys
+      // created earlier in this block are left to apply_transaction.
+      if( (skip & skip_transaction_signatures) || !recovered || i >= recovered->transactions.size() )
+         continue;
+      if( trx.relative_expiration != 0 && !ref_block_id )
+         continue;
+      const auto& signers = recovered->transactions[i];
+      digest_type digest = ref_block_id ? trx.digest( *ref_block_id ) : trx.digest();
+      if( signers.digest != digest || signers.signers.size() != trx.signatures.size() )
+         continue;
+      uint32_t j = 0;
+      for( const auto& sig : trx.signatures )
+      {
+         if( find_object( sig.first ) )
+            FC_ASSERT( _key_addresses->get( *this, sig.first ) == signers.signers[j], "Invalid signature",
+                       ("trx_in_block", i)("key", sig.first) );
+         ++j;
+      }
+   }
+} FC_CAPTURE_AND_RETHROW( (next_block.block_num())(skip) ) }
+
+void database::invalidate_authority_cache()
+{
+   _authority_cache.clear();
+   _authority_cache_enabled = false;
+}
+
+vector<optional<block_id_type>> database::resolve_reference_blocks( const signed_block& next_block )const
+{
+   // The workers may not touch the object database, so resolve the TaPoS reference blocks here. They are resolved
+   // against the state of the block's parent, which is what apply_transaction will see unless we switch forks in between.
+   const auto& transactions = next_block.transactions;
+   vector<optional<block_id_type>> ref_block_ids( transactions.size() );
+   for( uint32_t i = 0; i < transactions.size(); ++i )
+   {
+      if( transactions[i].relative_expiration == 0 )
+         continue;
+      auto summary = find( block_summary_id_type( transactions[i].ref_block_num ) );
+      if( summary )
+         ref_block_ids[i] = summary->block_id;
+   }
+   return ref_block_ids;
+}
+
+void database::check_transaction_signatures( const signed_transaction& trx, const digest_type& digest,
+                                             const recovered_signatures* recovered )
+{
+   // The recovered signers are only usable if they were recovered against the digest we're checking
+   if( recovered && (recovered->digest != digest || recovered->signers.size() != trx.signatures.size()) )
+      recovered = nullptr;
+
+   uint32_t i = 0;
+   for( const auto& sig : trx.signatures )
+   {
+      address signer = recovered ? recovered->signers[i++] : _signature_cache.recover( digest, sig.second );
+      const address& key_address = _key_addresses->get( *this, sig.first );
+      FC_ASSERT( key_address == signer, "",
+                 ("trx",trx)
+                 ("digest",digest)
+                 ("sig.first",sig.first)
+                 ("key_address",key_address)
+                 ("addr", signer) );
+   }
+}
+
 void database::create_block_summary(const signed_block& next_block)
 {
-   const auto& sum = create<block_summary_object>( [&](block_summary_object& p) {
+   // The summary of the block GRAPHENE_BLOCK_SUMMARY_COUNT blocks back is overwritten, once there is one
+   block_summary_id_type sid( next_block.block_num() % GRAPHENE_BLOCK_SUMMARY_COUNT );
+   auto fill = [&](block_summary_object& p) {
          p.block_id = next_block.id();
          p.timestamp = next_block.timestamp;
-   });
-   FC_ASSERT( sum.id.instance() == next_block.block_num(), "", ("summary.id",sum.id)("next.block_num",next_block.block_num()) );
+   };
+   if( const block_summary_object* old_summary = find( sid ) )
+      modify( *old_summary, fill );
+   else
+   {
+      const auto& sum = create<block_summary_object>( fill );
+      FC_ASSERT( sum.id == sid, "", ("summary.id",sum.id)("next.block_num",next_block.block_num()) );
+   }
+}
+
+void database::write_irreversible_checkpoints( bool sync )
+{
+   // Every block still in the undo history may be popped
+   while( !_checkpoints.empty() && _checkpoints.front().first + _undo_db.size() <= head_block_num() )
+   {
+      write_changes( _checkpoints.front().second, sync );
+      _checkpoints.pop_front();
+   }
+}
+
+bool database::sync_due()
+{
+   if( !sync_enabled() )
+      return false;
+   ++_blocks_since_sync;
+   const fc::time_point now = fc::time_point::now();
+   if( (_sync_blocks && _blocks_since_sync >= _sync_blocks) ||
+       (_sync_milliseconds && now - _last_sync >= fc::milliseconds( _sync_milliseconds )) )
+   {
+      _blocks_since_sync = 0;
+      _last_sync = now;
+      return true;
+   }
+   return false;
 }
 
 } }
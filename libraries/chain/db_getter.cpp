@@ -30,11 +30,15 @@ const asset_object& database::get_core_asset() const
 
 const global_property_object& database::get_global_properties()const
 {
+   if( const global_property_object* properties = _global_properties->get() )
+      return *properties;
    return get( global_property_id_type() );
 }
 
 const dynamic_global_property_object&database::get_dynamic_global_properties() const
 {
+   if( const dynamic_global_property_object* properties = _dynamic_global_properties->get() )
+      return *properties;
    return get( dynamic_global_property_id_type() );
 }
 
@@ -45,17 +49,17 @@ const fee_schedule_type&  database::current_fee_schedule()const
 
 time_point_sec database::head_block_time()const
 {
-   return get( dynamic_global_property_id_type() ).time;
+   return get_dynamic_global_properties().time;
 }
 
 uint32_t database::head_block_num()const
 {
-   return get( dynamic_global_property_id_type() ).head_block_number;
+   return get_dynamic_global_properties().head_block_number;
 }
 
 block_id_type database::head_block_id()const
 {
-   return get( dynamic_global_property_id_type() ).head_block_id;
+   return get_dynamic_global_properties().head_block_id;
 }
 
 decltype( chain_parameters::block_interval ) database::block_interval( )const
@@ -58,9 +58,48 @@
 
 namespace graphene { namespace chain {
 
+namespace {
+   struct operation_name
+   {
+      typedef string result_type;
+      template<typename T>
+      string operator()( const T& )const { return fc::get_typename<T>::name(); }
+   };
+
+   /** The name of the account holding an initial allocation, derived from its key or address */
+   string genesis_account_name( const genesis_allocation::value_type::first_type& key )
+   {
+      typedef genesis_allocation::value_type::first_type key_type;
+      string addr = key.which() == key_type::tag<address>::value ? string( key.get<address>() )
+                                                                 : string( key.get<public_key_type>() );
+      string result = "bts";
+      string key_string = addr.substr(sizeof(GRAPHENE_ADDRESS_PREFIX)-1);
+      for( char c : key_string )
+      {
+         if( isupper(c) )
+            result += string("-") + char(tolower(c));
+         else
+            result += c;
+      }
+      return result;
+   }
+}
+
+void database::reset_evaluator_stats()
+{
+   _evaluator_stats.assign( operation::count(), evaluator_stats() );
+   for( int i = 0; i < operation::count(); ++i )
+   {
+      operation op;
+      op.set_which( i );
+      _evaluator_stats[i].operation = op.visit( operation_name() );
+   }
+}
+
 void database::initialize_evaluators()
 {
    _operation_evaluators.resize(255);
+   reset_evaluator_stats();
    register_evaluator<key_create_evaluator>();
    register_evaluator<account_create_evaluator>();
    register_evaluator<account_update_evaluator>();
@@ -95,6 +134,7 @@ void database::initialize_evaluators()
    register_evaluator<bond_claim_collateral_evaluator>();
    register_evaluator<vesting_balance_create_evaluator>();
    register_evaluator<vesting_balance_withdraw_evaluator>();
+   register_evaluator<vesting_balance_withdraw_all_evaluator>();
    register_evaluator<withdraw_permission_create_evaluator>();
    register_evaluator<withdraw_permission_claim_evaluator>();
    register_evaluator<withdraw_permission_update_evaluator>();
@@ -110,30 +150,56 @@ void database::initialize_indexes()
    add_index< primary_index<asset_index> >();
    add_index< primary_index<force_settlement_index> >();
    add_index< primary_index<account_index> >();
+   _account_names = std::make_shared<account_name_table>();
+   get_mutable_index<account_object>().add_observer( _account_names );
    add_index< primary_index<simple_index<key_object>> >();
-   add_index< primary_index<simple_index<delegate_object>> >();
-   add_index< primary_index<simple_index<witness_object>> >();
+   _key_addresses = std::make_shared<key_address_table>();
+   get_mutable_index( protocol_ids, key_object_type ).add_observer( _key_addresses );
+   add_index< primary_index<delegate_index> >();
+   add_index< primary_index<witness_index> >();
    add_index< primary_index<limit_order_index > >();
+   _limit_book = std::make_shared<market_order_book<limit_order_object>>();
+   get_mutable_index<limit_order_object>().add_observer( _limit_book );
    add_index< primary_index<short_order_index > >();
+   _short_book = std::make_shared<market_order_book<short_order_object>>();
+   get_mutable_index<short_order_object>().add_observer( _short_book );
    add_index< primary_index<call_order_index > >();
+   _margin_calls = std::make_shared<margin_call_tracker>();
+   get_mutable_index<limit_order_object>().add_observer( _margin_calls );
+   get_mutable_index<short_order_object>().add_observer( _margin_calls );
+   get_mutable_index<call_order_object>().add_observer( _margin_calls );
    add_index< primary_index<proposal_index > >();
    add_index< primary_index<withdraw_permission_index > >();
    add_index< primary_index<bond_index > >();
    add_index< primary_index<bond_offer_index > >();
    add_index< primary_index<file_object_index> >();
-   add_index< primary_index<simple_index<vesting_balance_object> > >();
+   add_index< primary_index<vesting_balance_index> >();
    add_index< primary_index<worker_index> >();
 
    //Implementation object indexes
    add_index< primary_index<transaction_index                             > >();
    add_index< primary_index<account_balance_index                         > >();
+   _balances = std::make_shared<account_balance_table>();
+   get_mutable_index( implementation_ids, impl_account_balance_object_type ).add_observer( _balances );
    add_index< primary_index<asset_bitasset_data_index                     > >();
+   get_mutable_index<asset_bitasset_data_object>().add_observer( _margin_calls );
    add_index< primary_index<simple_index< global_property_object         >> >();
+   _global_properties = std::make_shared<singleton_object_cache<global_property_object>>();
+   get_mutable_index<global_property_object>().add_observer( _global_properties );
    add_index< primary_index<simple_index< dynamic_global_property_object >> >();
+   _dynamic_global_properties = std::make_shared<singleton_object_cache<dynamic_global_property_object>>();
+   get_mutable_index<dynamic_global_property_object>().add_observer( _dynamic_global_properties );
    add_index< primary_index<simple_index< account_statistics_object      >> >();
-   add_index< primary_index<simple_index< asset_dynamic_data_object      >> >();
+   add_index< primary_index<flat_index<   asset_dynamic_data_object      >> >();
    add_index< primary_index<flat_index<   block_summary_object           >> >();
+   get_mutable_index_type< primary_index<flat_index<block_summary_object>> >().reserve( 0, GRAPHENE_BLOCK_SUMMARY_COUNT );
    add_index< primary_index< simple_index< witness_schedule_object       > > >();
+
+   _vote_table = std::make_shared<vote_table>( *this );
+   get_mutable_index<account_object>().add_observer( _vote_table );
+   get_mutable_index<account_statistics_object>().add_observer( _vote_table );
+   get_mutable_index<account_balance_object>().add_observer( _vote_table );
+   get_mutable_index<vesting_balance_object>().add_observer( _vote_table );
 }
 
 void database::init_genesis(const genesis_allocation& initial_allocation)
@@ -259,25 +325,51 @@ void database::init_genesis(const genesis_allocation& initial_allocation)
       for( const auto& handout : initial_allocation )
          total_allocation += handout.second;
 
-      auto mangle_to_name = [](const fc::static_variant<public_key_type, address>& key) {
-         string addr = string(key.which() == std::decay<decltype(key)>::type::tag<address>::value? key.get<address>()
-                                                                                                 : key.get<public_key_type>());
-         string result = "bts";
-         string key_string = string(addr).substr(sizeof(GRAPHENE_ADDRESS_PREFIX)-1);
-         for( char c : key_string )
+      fc::time_point start_time = fc::time_point::now();
+
+      // Converting the keys to names is most of the work, and each one is independent of the others
+      vector<string> names( initial_allocation.size() );
+      size_t thread_count = std::min<size_t>( _signature_threads.size(), initial_allocation.size() / 1000 );
+      if( thread_count < 2 )
+      {
+         for( size_t i = 0; i < initial_allocation.size(); ++i )
+            names[i] = genesis_account_name( initial_allocation[i].first );
+      }
+      else
+      {
+         size_t chunk_size = (initial_allocation.size() + thread_count - 1) / thread_count;
+         vector<fc::future<void>> workers;
+         workers.reserve( thread_count );
+         for( size_t t = 0; t < thread_count; ++t )
          {
-            if( isupper(c) )
-               result += string("-") + char(tolower(c));
-            else
-               result += c;
+            size_t begin = t * chunk_size;
+            size_t end = std::min( begin + chunk_size, initial_allocation.size() );
+            workers.push_back( _signature_threads[t]->async( [&initial_allocation, &names, begin, end]() {
+               for( size_t i = begin; i < end; ++i )
+                  names[i] = genesis_account_name( initial_allocation[i].first );
+            }, "genesis_account_name" ) );
          }
-         return result;
-      };
-
-      fc::time_point start_time = fc::time_point::now();
+         for( auto& worker : workers )
+            worker.wait();
+      }
 
-      for( const auto& handout : initial_allocation )
+      uint32_t count = initial_allocation.size();
+      get_mutable_index_type<simple_index<key_object>>()
+            .reserve( count, get_index<key_object>().get_next_id().instance() + count );
+      get_mutable_index_type<simple_index<account_statistics_object>>()
+            .reserve( count, get_index<account_statistics_object>().get_next_id().instance() + count );
+      get_mutable_index_type<account_index>().reserve( count, 0 );
+      get_mutable_index_type<account_balance_index>().reserve( count, 0 );
+
+      // The objects are created as key_create, account_create and transfer operations from genesis would create them,
+      // in the same order, without building and evaluating a transaction for each account
+      const account_object& registrar = account_id_type(1)(*this);
+      const account_create_operation defaults;
+      const auto& accounts_by_name = get_index_type<account_index>().indices().get<by_name>();
+      share_type total_handed_out = 0;
+      for( size_t i = 0; i < initial_allocation.size(); ++i )
       {
+         const auto& handout = initial_allocation[i];
          asset amount(handout.second);
          amount.amount = ((fc::uint128(amount.amount.value) * GRAPHENE_INITIAL_SUPPLY)/total_allocation.value).to_uint64();
          if( amount.amount == 0 )
@@ -285,36 +377,48 @@ void database::init_genesis(const genesis_allocation& initial_allocation)
             wlog("Skipping zero allocation to ${k}", ("k", handout.first));
             continue;
          }
+         // The checks account_create_evaluator makes which can fail for these names
+         FC_ASSERT( is_valid_name( names[i] ), "", ("name", names[i]) );
+         FC_ASSERT( accounts_by_name.find( names[i] ) == accounts_by_name.end(), "", ("name", names[i]) );
+         FC_ASSERT( accounts_by_name.find( "bts-" + names[i] ) == accounts_by_name.end(), "", ("name", names[i]) );
 
-         signed_transaction trx;
-         trx.operations.emplace_back(key_create_operation({asset(), genesis_account.id, handout.first}));
-         relative_key_id_type key_id(0);
-         authority account_authority(1, key_id, 1);
-         account_create_operation cop;
-         cop.name = mangle_to_name(handout.first);
-         cop.registrar = account_id_type(1);
-         cop.active = account_authority;
-         cop.owner = account_authority;
-         cop.memo_key = key_id;
-         trx.operations.push_back(cop);
-         trx.validate();
-         auto ptrx = apply_transaction(trx, ~0);
-         trx = signed_transaction();
-         account_id_type account_id(ptrx.operation_results.back().get<object_id_type>());
-         trx.operations.emplace_back(transfer_operation({  asset(),
-                                                           genesis_account.id,
-                                                           account_id,
-                                                           amount,
-                                                           memo_data()//vector<char>()
-                                                        }));
-         trx.validate();
-         apply_transaction(trx, ~0);
+         const key_object& key = create<key_object>( [&handout]( key_object& k ) {
+            k.key_data = handout.first;
+         });
+         const account_statistics_object& stats = create<account_statistics_object>( []( account_statistics_object& ){
+         });
+         const account_object& account = create<account_object>( [&]( account_object& a ) {
+            if( registrar.is_prime() )
+            {
+               a.registrar        = registrar.id;
+               a.referrer         = defaults.referrer;
+               a.referrer_percent = defaults.referrer_percent;
+            }
+            else
+            {
+               a.registrar        = registrar.registrar;
+               a.referrer         = registrar.referrer;
+               a.referrer_percent = registrar.referrer_percent;
+            }
+            a.name           = std::move( names[i] );
+            a.owner          = authority( 1, key_id_type( key.id ), 1 );
+            a.active         = a.owner;
+            a.statistics     = stats.id;
+            a.memo_key       = key.id;
+            a.voting_account = defaults.voting_account;
+            a.votes          = defaults.vote;
+            a.num_witness    = defaults.num_witness;
+            a.num_committee  = defaults.num_committee;
+         });
+         adjust_balance( account.id, amount );
+         total_handed_out += amount.amount;
       }
+      adjust_balance( genesis_account.id, -asset( total_handed_out ) );
 
       asset leftovers = get_balance(account_id_type(), asset_id_type());
       if( leftovers.amount > 0 )
       {
-         modify(*get_index_type<account_balance_index>().indices().get<by_balance>().find(boost::make_tuple(account_id_type(), asset_id_type())),
+         modify(*_balances->find(account_id_type(), asset_id_type()),
                 [](account_balance_object& b) {
             b.adjust_balance(-b.get_balance());
          });
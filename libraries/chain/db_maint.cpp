@@ -27,14 +27,15 @@
 #include <graphene/chain/witness_schedule_object.hpp>
 #include <graphene/chain/worker_object.hpp>
 
-#include <fc/uint128.hpp>
+#include <graphene/chain/wide_arithmetic.hpp>
 
 namespace graphene { namespace chain {
 
 template<class ObjectType>
 vector<std::reference_wrapper<const ObjectType>> database::sort_votable_objects(size_t count) const
 {
-   const auto& all_objects = dynamic_cast<const simple_index<ObjectType>&>(get_index<ObjectType>());
+   typedef typename graphene::db::object_index_type<ObjectType>::type index_type;
+   const auto& all_objects = get_index_type<index_type>();
    count = std::min(count, all_objects.size());
    vector<std::reference_wrapper<const ObjectType>> refs;
    refs.reserve(all_objects.size());
@@ -50,31 +51,53 @@ vector<std::reference_wrapper<const ObjectType>> database::sort_votable_objects(
    return refs;
 }
 
+namespace {
+   /**
+    * The number of members to elect: twice the smallest count which more than half of the voting stake voted for
+    * at least, plus one, and at least min_count
+    */
+   size_t elected_count( const vector<uint64_t>& count_histogram, uint64_t total_voting_stake, size_t min_count )
+   {
+      assert( count_histogram.size() > 0 );
+      uint64_t stake_target = total_voting_stake / 2;
+      uint64_t stake_tally = count_histogram[0];
+      size_t count = 0;
+      while( count < count_histogram.size() && stake_tally <= stake_target )
+         if( ++count < count_histogram.size() )
+            stake_tally += count_histogram[count];
+      return std::max( count*2+1, min_count );
+   }
+}
+
 void database::pay_workers( share_type& budget )
 {
    ilog("Processing payroll! Available budget is ${b}", ("b", budget));
-   vector<std::reference_wrapper<const worker_object>> active_workers;
-   get_index_type<worker_index>().inspect_all_objects([this, &active_workers](const object& o) {
-      const worker_object& w = static_cast<const worker_object&>(o);
-      auto now = _pending_block.timestamp;
-      if( w.is_active(now) && w.approving_stake(_vote_tally_buffer) > 0 )
-         active_workers.emplace_back(w);
-   });
-
-   std::sort(active_workers.begin(), active_workers.end(), [this](const worker_object& wa, const worker_object& wb) {
-      return wa.approving_stake(_vote_tally_buffer) > wb.approving_stake(_vote_tally_buffer);
+   const auto now = _pending_block.timestamp;
+   // The approving stake of each active worker is computed once, and ties are paid in the order of creation
+   vector<std::pair<share_type, worker_id_type>> stakes;
+   const auto& workers_by_end = get_index_type<worker_index>().indices().get<by_end_date>();
+   for( auto itr = workers_by_end.lower_bound( now ); itr != workers_by_end.end(); ++itr )
+   {
+      share_type stake = itr->approving_stake(_vote_tally_buffer);
+      if( itr->is_active(now) && stake > 0 )
+         stakes.emplace_back(stake, itr->id);
+   }
+   std::sort(stakes.begin(), stakes.end(), [](const std::pair<share_type, worker_id_type>& a,
+                                               const std::pair<share_type, worker_id_type>& b) {
+      return a.first > b.first || (a.first == b.first && a.second < b.second);
    });
 
-   for( int i = 0; i < active_workers.size() && budget > 0; ++i )
+   for( size_t i = 0; i < stakes.size() && budget > 0; ++i )
    {
-      const worker_object& active_worker = active_workers[i];
+      const worker_object& active_worker = stakes[i].second(*this);
       share_type requested_pay = active_worker.daily_pay;
       if( _pending_block.timestamp - get_dynamic_global_properties().last_budget_time != fc::days(1) )
       {
-         fc::uint128 pay(requested_pay.value);
-         pay *= (_pending_block.timestamp - get_dynamic_global_properties().last_budget_time).count();
-         pay /= fc::days(1).count();
-         requested_pay = pay.to_uint64();
+         uint64_t pay;
+         FC_ASSERT( multiply_divide( uint64_t(requested_pay.value),
+                                     uint64_t((_pending_block.timestamp - get_dynamic_global_properties().last_budget_time).count()),
+                                     uint64_t(fc::days(1).count()), pay ) );
+         requested_pay = pay;
       }
 
       share_type actual_pay = std::min(budget, requested_pay);
@@ -87,17 +110,8 @@ void database::pay_workers( share_type& budget )
    }
 }
 
-void database::update_active_witnesses()
+void database::update_active_witnesses( const vector<std::reference_wrapper<const witness_object>>& wits )
 { try {
-   assert( _witness_count_histogram_buffer.size() > 0 );
-   share_type stake_target = _total_voting_stake / 2;
-   share_type stake_tally = _witness_count_histogram_buffer[0];
-   int witness_count = 0;
-   while( (size_t(witness_count) < _witness_count_histogram_buffer.size())
-          && (stake_tally <= stake_target) )
-      stake_tally += _witness_count_histogram_buffer[++witness_count];
-
-   auto wits = sort_votable_objects<witness_object>(std::max(witness_count*2+1, GRAPHENE_MIN_WITNESS_COUNT));
    const global_property_object& gpo = get_global_properties();
 
    modify( gpo, [&]( global_property_object& gp ){
@@ -125,18 +139,8 @@ void database::update_active_witnesses()
 
 } FC_CAPTURE_AND_RETHROW() }
 
-void database::update_active_delegates()
+void database::update_active_delegates( const vector<std::reference_wrapper<const delegate_object>>& delegates )
 { try {
-   assert( _committee_count_histogram_buffer.size() > 0 );
-   uint64_t stake_target = _total_voting_stake / 2;
-   uint64_t stake_tally = _committee_count_histogram_buffer[0];
-   int delegate_count = 0;
-   while( (size_t(delegate_count) < _committee_count_histogram_buffer.size())
-          && (stake_tally <= stake_target) )
-      stake_tally += _committee_count_histogram_buffer[++delegate_count];
-
-   auto delegates = sort_votable_objects<delegate_object>(std::max(delegate_count*2+1, GRAPHENE_MIN_DELEGATE_COUNT));
-
    // Update genesis authorities
    if( !delegates.empty() )
       modify( get(account_id_type()), [&]( account_object& a ) {
@@ -184,65 +188,11 @@ void database::update_vote_totals(const global_property_object& props)
    _witness_count_histogram_buffer.resize(props.parameters.maximum_witness_count / 2 + 1);
    _committee_count_histogram_buffer.resize(props.parameters.maximum_committee_count / 2 + 1);
 
-   const account_index& account_idx = get_index_type<account_index>();
    _total_voting_stake = 0;
 
-   bool count_non_prime_votes = props.parameters.count_non_prime_votes;
    auto timestamp = fc::time_point::now();
-   for( const account_object& stake_account : account_idx.indices() )
-   {
-      if( count_non_prime_votes || stake_account.is_prime() )
-      {
-         // There may be a difference between the account whose stake is voting and the one specifying opinions.
-         // Usually they're the same, but if the stake account has specified a voting_account, that account is the one
-         // specifying the opinions.
-         const account_object& opinion_account =
-               (stake_account.voting_account == account_id_type())? stake_account
-                                                                  : get(stake_account.voting_account);
-
-         const auto& stats = stake_account.statistics(*this);
-         uint64_t voting_stake = stats.total_core_in_orders.value
-               + (stake_account.cashback_vb.valid() ? (*stake_account.cashback_vb)(*this).balance.amount.value: 0)
-               + get_balance(stake_account.get_id(), asset_id_type()).amount.value;
-
-         for( vote_id_type id : opinion_account.votes )
-         {
-            uint32_t offset = id.instance();
-            // if they somehow managed to specify an illegal offset, ignore it.
-            if( offset < _vote_tally_buffer.size() )
-               _vote_tally_buffer[ offset ] += voting_stake;
-         }
-
-         if( opinion_account.num_witness <= props.parameters.maximum_witness_count )
-         {
-            uint16_t offset = std::min(size_t(opinion_account.num_witness/2),
-                                       _witness_count_histogram_buffer.size() - 1);
-            //
-            // votes for a number greater than maximum_witness_count
-            // are turned into votes for maximum_witness_count.
-            //
-            // in particular, this takes care of the case where a
-            // member was voting for a high number, then the
-            // parameter was lowered.
-            //
-            _witness_count_histogram_buffer[ offset ] += voting_stake;
-         }
-         if( opinion_account.num_committee <= props.parameters.maximum_committee_count )
-         {
-            uint16_t offset = std::min(size_t(opinion_account.num_committee/2),
-                                       _committee_count_histogram_buffer.size() - 1);
-            //
-            // votes for a number greater than maximum_committee_count
-            // are turned into votes for maximum_committee_count.
-            //
-            // same rationale as for witnesses
-            //
-            _committee_count_histogram_buffer[ offset ] += voting_stake;
-         }
-
-         _total_voting_stake += voting_stake;
-      }
-   }
+   _vote_table->tally( props.parameters, _vote_tally_buffer, _witness_count_histogram_buffer,
+                       _committee_count_histogram_buffer, _total_voting_stake );
    ilog("Tallied votes in ${time} milliseconds.", ("time", (fc::time_point::now() - timestamp).count() / 1000.0));
 } FC_CAPTURE_AND_RETHROW() }
 
@@ -266,19 +216,20 @@ share_type database::get_max_budget( fc::time_point_sec now )const
    // in core.burned().
    share_type reserve = core.burned(*this) + core_dd.accumulated_fees;
 
-   fc::uint128_t budget_u128 = reserve.value;
-   budget_u128 *= uint64_t(dt);
-   budget_u128 *= GRAPHENE_CORE_ASSET_CYCLE_RATE;
-   //round up to the nearest satoshi -- this is necessary to ensure
-   //   there isn't an "untouchable" reserve, and we will eventually
-   //   be able to use the entire reserve
-   budget_u128 += ((uint64_t(1) << GRAPHENE_CORE_ASSET_CYCLE_RATE_BITS) - 1);
-   budget_u128 >>= GRAPHENE_CORE_ASSET_CYCLE_RATE_BITS;
-   share_type budget;
-   if( budget_u128 < reserve.value )
-      budget = share_type(budget_u128.to_uint64());
-   else
-      budget = reserve;
+   // dt is at most a maintenance interval, so its product with the cycle rate fits in 64 bits
+   uint64_t budget_u64, budget_remainder;
+   share_type budget = reserve;
+   if( multiply_divide( uint64_t(reserve.value), uint64_t(dt) * GRAPHENE_CORE_ASSET_CYCLE_RATE,
+                        uint64_t(1) << GRAPHENE_CORE_ASSET_CYCLE_RATE_BITS, budget_u64, &budget_remainder ) )
+   {
+      //round up to the nearest satoshi -- this is necessary to ensure
+      //   there isn't an "untouchable" reserve, and we will eventually
+      //   be able to use the entire reserve
+      if( budget_remainder != 0 )
+         ++budget_u64;
+      if( budget_u64 < uint64_t(reserve.value) )
+         budget = share_type(budget_u64);
+   }
 
    return budget;
 }
@@ -320,15 +271,12 @@ void database::process_budget()
       witness_budget = std::min( witness_budget, available_funds );
       available_funds -= witness_budget;
 
-      fc::uint128_t worker_budget_u128 = gpo.parameters.worker_budget_per_day.value;
-      worker_budget_u128 *= uint64_t(time_to_maint);
-      worker_budget_u128 /= 60*60*24;
-
-      share_type worker_budget;
-      if( worker_budget_u128 >= available_funds.value )
-         worker_budget = available_funds;
-      else
-         worker_budget = worker_budget_u128.to_uint64();
+      uint64_t worker_budget_u64;
+      share_type worker_budget = available_funds;
+      if( multiply_divide( uint64_t(gpo.parameters.worker_budget_per_day.value), uint64_t(time_to_maint), 60*60*24,
+                           worker_budget_u64 ) &&
+          worker_budget_u64 < uint64_t(available_funds.value) )
+         worker_budget = worker_budget_u64;
       available_funds -= worker_budget;
 
       share_type leftover_worker_funds = worker_budget;
@@ -368,15 +316,41 @@ void database::perform_chain_maintenance(const signed_block& next_block, const g
                 b(_committee_count_histogram_buffer),
                 c(_vote_tally_buffer);
 
-   update_active_witnesses();
-   update_active_delegates();
+   // Witnesses and delegates are sorted by votes at the same time, the witnesses on a signature thread if there is
+   // one; nothing is modified until both are sorted
+   const size_t witness_count = elected_count( _witness_count_histogram_buffer, _total_voting_stake,
+                                               GRAPHENE_MIN_WITNESS_COUNT );
+   const size_t delegate_count = elected_count( _committee_count_histogram_buffer, _total_voting_stake,
+                                                GRAPHENE_MIN_DELEGATE_COUNT );
+   vector<std::reference_wrapper<const witness_object>> witnesses;
+   vector<std::reference_wrapper<const delegate_object>> delegates;
+   if( _signature_threads.empty() )
+   {
+      witnesses = sort_votable_objects<witness_object>( witness_count );
+      delegates = sort_votable_objects<delegate_object>( delegate_count );
+   }
+   else
+   {
+      auto sorted_witnesses = _signature_threads[0]->async( [this, witness_count]() {
+         return sort_votable_objects<witness_object>( witness_count );
+      }, "sort_witnesses" );
+      delegates = sort_votable_objects<delegate_object>( delegate_count );
+      witnesses = sorted_witnesses.wait();
+   }
+
+   update_active_witnesses( witnesses );
+   update_active_delegates( delegates );
 
    const global_property_object& global_properties = get_global_properties();
    if( global_properties.pending_parameters )
+   {
       modify(get_global_properties(), [](global_property_object& p) {
          p.parameters = std::move(*p.pending_parameters);
          p.pending_parameters.reset();
       });
+      _undo_db.set_max_size( global_properties.parameters.maximum_undo_history );
+      _fork_db.set_max_size( std::max<uint32_t>( global_properties.parameters.maximum_undo_history, 1 ) );
+   }
 
    auto new_block_interval = global_props.parameters.block_interval;
 
@@ -409,8 +383,8 @@ void database::perform_chain_maintenance(const signed_block& next_block, const g
    });
 
    // Reset all BitAsset force settlement volumes to zero
-   for( const asset_bitasset_data_object* d : get_index_type<asset_bitasset_data_index>() )
-      modify(*d, [](asset_bitasset_data_object& d) { d.force_settled_volume = 0; });
+   for( const asset_bitasset_data_object& d : get_index_type<asset_bitasset_data_index>().indices() )
+      modify(d, [](asset_bitasset_data_object& d) { d.force_settled_volume = 0; });
 
    // process_budget needs to run at the bottom because
    //   it needs to know the next_maintenance_time
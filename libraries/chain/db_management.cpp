@@ -26,6 +26,16 @@ database::database()
 {
    initialize_indexes();
    initialize_evaluators();
+   set_block_timing_history( GRAPHENE_DEFAULT_BLOCK_TIMING_HISTORY );
+}
+
+void database::set_block_timing_history( size_t history_size )
+{
+   _block_timing_history = history_size;
+   while( _block_timings.size() > _block_timing_history )
+      _block_timings.pop_front();
+   applied_block.set_combiner( timed_slots( history_size ? &_applied_block_observers_ns : nullptr ) );
+   changed_objects.set_combiner( timed_slots( history_size ? &_changed_objects_observers_ns : nullptr ) );
 }
 
 database::~database(){
@@ -38,43 +48,302 @@ void database::open( const fc::path& data_dir, const genesis_allocation& initial
    ilog("Open database in ${d}", ("d", data_dir));
    object_database::open( data_dir );
 
-   _block_id_to_block.open( data_dir / "database" / "block_num_to_block" );
+   open_block_database( data_dir );
 
    if( !find(global_property_id_type()) )
       init_genesis(initial_allocation);
+   open_head_block();
+   replay_blocks();
+   publish_read_view();
+} FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+
+void database::set_block_pruning( uint32_t keep_blocks )
+{
+   FC_ASSERT( keep_blocks == 0 || keep_blocks >= GRAPHENE_DEFAULT_MAX_UNDO_HISTORY,
+              "At least the last ${n} blocks must be kept", ("n", GRAPHENE_DEFAULT_MAX_UNDO_HISTORY) );
+   _block_id_to_block.set_pruning( keep_blocks );
+}
+
+void database::enable_state_hash()
+{
+   enable_state_hash_of( { protocol_ids, implementation_ids } );
+}
+
+fc::sha256 database::get_state_hash()const
+{
+   FC_ASSERT( state_hash_enabled(), "The state is not hashed" );
+   return get_state_hash_object()->result();
+}
+
+optional<fc::sha256> database::get_state_hash_at( uint32_t block_num )const
+{
+   // Most lookups are for the latest blocks, which are at the back
+   for( auto itr = _state_hashes.rbegin(); itr != _state_hashes.rend(); ++itr )
+   {
+      if( itr->first == block_num )
+         return itr->second;
+      if( itr->first < block_num )
+         break;
+   }
+   return optional<fc::sha256>();
+}
+
+void database::record_state_hash( uint32_t block_num )
+{
+   // A block applied again after a fork switch replaces the hashes of the blocks it was popped back past
+   while( !_state_hashes.empty() && _state_hashes.back().first >= block_num )
+      _state_hashes.pop_back();
+   _state_hashes.emplace_back( block_num, get_state_hash_object()->result() );
+   while( _state_hashes.size() > state_hashes_kept )
+      _state_hashes.pop_front();
+}
+
+void database::open_head_block()
+{
+   _undo_db.set_max_size( get_global_properties().parameters.maximum_undo_history );
+   _fork_db.set_max_size( std::max<uint32_t>( get_global_properties().parameters.maximum_undo_history, 1 ) );
 
    _pending_block.previous  = head_block_id();
    _pending_block.timestamp = head_block_time();
 
-   auto last_block_itr = _block_id_to_block.last();
-   if( last_block_itr.valid() )
-      _fork_db.start_block( last_block_itr.value() );
+   auto last_block = _block_id_to_block.last();
+   if( last_block )
+      _fork_db.start_block( *last_block );
+}
 
-} FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+void database::open_block_database( const fc::path& data_dir )
+{
+   _block_id_to_block.open( data_dir / "database" / "blocks" );
+
+   // Blocks used to be kept in a level_map, which is imported once and removed
+   const fc::path old_blocks = data_dir / "database" / "block_num_to_block";
+   if( fc::exists( old_blocks ) )
+   {
+      ilog( "Importing blocks from ${d}", ("d", old_blocks) );
+      graphene::db::level_map<block_id_type, signed_block> old_block_id_to_block;
+      old_block_id_to_block.open( old_blocks, false, 0, graphene::db::sequential_scan );
+      for( auto itr = old_block_id_to_block.begin(); itr.valid(); ++itr )
+         _block_id_to_block.store( itr.key(), itr.value() );
+      old_block_id_to_block.close();
+      fc::remove_all( old_blocks );
+   }
+}
+
+namespace {
+   /// The number of blocks read and checked ahead of the block being applied during a replay
+   const uint32_t replay_batch_size = 1024;
+   /// Seconds between two progress reports during a replay
+   const int64_t  replay_report_interval = 10;
+}
+
+/**
+ * The blocks are read and unpacked by a reader thread one batch ahead of the block being applied, and their merkle
+ * roots are checked there, on the signature threads when there are any.  Nothing can be undone during a replay,
+ * so the undo history is disabled, and the state is written once when the last block has been applied.
+ */
+void database::replay_blocks()
+{
+   FC_ASSERT( head_block_num() == 0 || _block_id_to_block.contains( head_block_id() ),
+              "The saved state does not match the block database, it needs to be reindexed",
+              ("head_block_num",head_block_num())("head_block_id",head_block_id()) );
+   FC_ASSERT( _block_id_to_block.pruned_below() <= head_block_num() + 1,
+              "The blocks to replay onto the saved state have been pruned",
+              ("head_block_num",head_block_num())("pruned_below",_block_id_to_block.pruned_below()) );
+
+   // Reads the blocks from begin up to the first missing one, at most replay_batch_size of them
+   fc::thread reader( "block_reader" );
+   auto read_batch = [this, &reader]( uint32_t begin ) {
+      return reader.async( [this, begin]() -> vector<signed_block> {
+         vector<signed_block> blocks;
+         blocks.reserve( replay_batch_size );
+         for( uint32_t num = begin; blocks.size() < replay_batch_size; ++num )
+         {
+            optional<signed_block> block = _block_id_to_block.fetch_by_number( num );
+            if( !block )
+               break;
+            blocks.push_back( std::move( *block ) );
+         }
+
+         auto check_merkle_roots = [&blocks]( size_t first, size_t last ) {
+            for( size_t i = first; i < last; ++i )
+               FC_ASSERT( blocks[i].transaction_merkle_root == blocks[i].calculate_merkle_root(),
+                          "Block ${n} does not match its merkle root", ("n",blocks[i].block_num()) );
+         };
+         if( _signature_threads.empty() || blocks.empty() )
+            check_merkle_roots( 0, blocks.size() );
+         else
+         {
+            size_t thread_count = std::min( _signature_threads.size(), blocks.size() );
+            size_t chunk_size = (blocks.size() + thread_count - 1) / thread_count;
+            vector<fc::future<void>> workers;
+            workers.reserve( thread_count );
+            for( size_t t = 0; t < thread_count; ++t )
+            {
+               size_t first = t * chunk_size;
+               size_t last = std::min( first + chunk_size, blocks.size() );
+               workers.push_back( _signature_threads[t]->async( [&check_merkle_roots, first, last]() {
+                  check_merkle_roots( first, last );
+               }, "check_merkle_roots" ) );
+            }
+            for( auto& worker : workers )
+               worker.wait();
+         }
+         return blocks;
+      }, "read_blocks" );
+   };
+
+   const uint32_t first_block_num = head_block_num() + 1;
+   vector<signed_block> blocks = read_batch( first_block_num ).wait();
+   if( blocks.empty() )
+      return;
+
+   uint32_t skip = skip_delegate_signature |
+                   skip_undo_block |
+                   skip_undo_transaction |
+                   skip_transaction_dupe_check |
+                   skip_tapos_check |
+                   skip_merkle_check;
+   if( _trusted_replay )
+      skip |= skip_transaction_signatures | skip_authority_check;
+
+   // The state is only written once the replay is over, and the undo history is back on even if a block fails
+   struct replay_scope
+   {
+      replay_scope( database& db ) : db( db ), flush_interval( db._flush_interval ),
+                                     checkpoint_interval( db._checkpoint_interval )
+      {
+         db._flush_interval = 0;
+         db._checkpoint_interval = 0;
+         db._undo_db.disable();
+      }
+      ~replay_scope()
+      {
+         db._undo_db.enable();
+         db._flush_interval = flush_interval;
+         db._checkpoint_interval = checkpoint_interval;
+      }
+
+      database& db;
+      uint32_t  flush_interval;
+      uint32_t  checkpoint_interval;
+   };
+
+   ilog( "Replaying blocks after ${n}", ("n",head_block_num()) );
+   const auto start = fc::time_point::now();
+   auto last_report = start;
+   uint32_t reported_block_num = head_block_num();
+   {
+      replay_scope scope( *this );
+      while( !blocks.empty() )
+      {
+         // The next batch is read and checked while this one is applied
+         fc::future<vector<signed_block>> next_batch;
+         if( blocks.size() == replay_batch_size )
+            next_batch = read_batch( blocks.back().block_num() + 1 );
+
+         for( const auto& block : blocks )
+         {
+            uint32_t block_skip = skip;
+            if( before_last_block_checkpoint( block.block_num() ) )
+               block_skip |= skip_transaction_signatures | skip_authority_check;
+            optional<recovered_block_signatures> recovered = recover_block_signatures( block, block_skip );
+            apply_block( block, block_skip, recovered ? &*recovered : nullptr );
+         }
+
+         const auto now = fc::time_point::now();
+         if( now - last_report >= fc::seconds( replay_report_interval ) )
+         {
+            ilog( "Replayed up to block ${n} at ${rate} blocks/sec", ("n",head_block_num())
+                  ("rate",uint64_t(head_block_num() - reported_block_num) * 1000000 / (now - last_report).count()) );
+            last_report = now;
+            reported_block_num = head_block_num();
+         }
+         blocks = next_batch.valid() ? next_batch.wait() : vector<signed_block>();
+      }
+   }
+   flush();
+
+   const auto elapsed = fc::time_point::now() - start;
+   ilog( "Replayed ${count} blocks in ${sec} sec, ${rate} blocks/sec", ("count",head_block_num() - first_block_num + 1)
+         ("sec",elapsed.count() / 1000000.0)
+         ("rate",uint64_t(head_block_num() - first_block_num + 1) * 1000000 / std::max<int64_t>( elapsed.count(), 1 )) );
+}
+
+void database::snapshot( const fc::path& file )
+{ try {
+   auto old_pending_trx = std::move(_pending_block.transactions);
+   clear_pending();
+   auto push_pending = [&]() {
+      for( const auto& trx : old_pending_trx )
+         push_transaction( trx );
+   };
+
+   try {
+      optional<signed_block> head_block;
+      if( head_block_num() > 0 )
+         head_block = fetch_block_by_id( head_block_id() );
+      write_snapshot( file, fc::raw::pack( head_block ) );
+   } catch( ... ) {
+      push_pending();
+      throw;
+   }
+   push_pending();
+} FC_CAPTURE_AND_RETHROW( (file) ) }
+
+void database::open_from_snapshot( const fc::path& file, const fc::path& data_dir )
+{ try {
+   FC_ASSERT( !find(global_property_id_type()), "A snapshot can only be opened by an empty database" );
+   ilog("Open database in ${d} from snapshot ${f}", ("d", data_dir)("f", file));
+   wipe( data_dir, true );
+   object_database::open( data_dir );
+   auto head_block = fc::raw::unpack<optional<signed_block>>( load_snapshot( file ) );
+   flush();
+
+   open_block_database( data_dir );
+   if( head_block )
+      _block_id_to_block.store( head_block->id(), *head_block );
+   open_head_block();
+   publish_read_view();
+} FC_CAPTURE_AND_RETHROW( (file)(data_dir) ) }
+
+void database::open_in_memory( const genesis_allocation& initial_allocation )
+{ try {
+   // The object store is left closed, so changes are never written
+   _block_id_to_block.open_in_memory();
+   if( !find(global_property_id_type()) )
+      init_genesis(initial_allocation);
+   open_head_block();
+   publish_read_view();
+} FC_CAPTURE_AND_RETHROW() }
+
+void database::open_in_memory_from_snapshot( const fc::path& file )
+{ try {
+   FC_ASSERT( !find(global_property_id_type()), "A snapshot can only be opened by an empty database" );
+   auto head_block = fc::raw::unpack<optional<signed_block>>( load_snapshot( file ) );
+   _block_id_to_block.open_in_memory();
+   if( head_block )
+      _block_id_to_block.store( head_block->id(), *head_block );
+   open_head_block();
+   publish_read_view();
+} FC_CAPTURE_AND_RETHROW( (file) ) }
+
+void database::reset_to_snapshot( const fc::path& file, const fc::path& data_dir )
+{ try {
+   FC_ASSERT( head_block_num() == 0, "Only a database which has applied no blocks can be reset to a snapshot" );
+   clear_pending();
+   // The genesis state is not undone into, so its removal is not recorded
+   _undo_db.discard_oldest( 0 );
+   _undo_db.disable();
+   remove_all_objects();
+   _undo_db.enable();
+   open_from_snapshot( file, data_dir );
+} FC_CAPTURE_AND_RETHROW( (file)(data_dir) ) }
 
 void database::reindex(fc::path data_dir, const genesis_allocation& initial_allocation)
 { try {
    wipe(data_dir, false);
+   // With the state wiped, open applies every block
    open(data_dir, initial_allocation);
-
-   auto start = fc::time_point::now();
-   auto itr = _block_id_to_block.begin();
-   // TODO: disable undo tracking durring reindex, this currently causes crashes in the benchmark test
-   //_undo_db.disable();
-   while( itr.valid() )
-   {
-      apply_block( itr.value(), skip_delegate_signature |
-                                skip_transaction_signatures |
-                                skip_undo_block |
-                                skip_undo_transaction |
-                                skip_transaction_dupe_check |
-                                skip_tapos_check |
-                                skip_authority_check );
-      ++itr;
-   }
-   //_undo_db.enable();
-   auto end = fc::time_point::now();
-   wdump( ((end-start).count()/1000000.0) );
 } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
 
 void database::wipe(const fc::path& data_dir, bool include_blocks)
@@ -93,6 +362,10 @@ void database::close(uint32_t blocks_to_rewind)
    for(uint32_t i = 0; i < blocks_to_rewind && head_block_num() > 0; ++i)
       pop_block();
 
+   // The state is written as of the head block on close, so every checkpoint before it goes out first
+   for( const auto& checkpoint : _checkpoints )
+      write_changes( checkpoint.second );
+   _checkpoints.clear();
    object_database::close();
 
    if( _block_id_to_block.is_open() )
@@ -101,4 +374,17 @@ void database::close(uint32_t blocks_to_rewind)
    _fork_db.reset();
 }
 
+void database::set_signature_thread_count( uint32_t thread_count )
+{
+   _signature_threads.clear();
+   _signature_threads.reserve( thread_count );
+   for( uint32_t i = 0; i < thread_count; ++i )
+      _signature_threads.emplace_back( new fc::thread( "sigcheck" + fc::to_string(i) ) );
+}
+
+void database::set_signature_threads( const utilities::thread_group& threads )
+{
+   _signature_threads = threads;
+}
+
 } }
@@ -24,7 +24,9 @@
 #include <graphene/chain/limit_order_object.hpp>
 #include <graphene/chain/short_order_object.hpp>
 
-#include <fc/uint128.hpp>
+#include <graphene/chain/wide_arithmetic.hpp>
+
+#include <graphene/utilities/trace_log.hpp>
 
 namespace graphene { namespace chain {
 
@@ -41,139 +43,99 @@ namespace graphene { namespace chain {
 */
 void database::globally_settle_asset( const asset_object& mia, const price& settlement_price )
 { try {
-   elog( "BLACK SWAN!" );
-   debug_dump();
-
-   edump( (mia.symbol)(settlement_price) );
+   elog( "BLACK SWAN in ${asset} at ${price}", ("asset",mia.symbol)("price",settlement_price) );
 
    const asset_bitasset_data_object& bitasset = mia.bitasset_data(*this);
    const asset_object& backing_asset = bitasset.options.short_backing_asset(*this);
    asset collateral_gathered = backing_asset.amount(0);
 
+   // The accumulated fees of the asset are settled below
+   flush_deferred_fees();
+
    const asset_dynamic_data_object& mia_dyn = mia.dynamic_asset_data_id(*this);
    auto original_mia_supply = mia_dyn.current_supply;
 
    const call_order_index& call_index = get_index_type<call_order_index>();
    const auto& call_price_index = call_index.indices().get<by_price>();
 
-    auto call_itr = call_price_index.lower_bound( price::min( bitasset.options.short_backing_asset, mia.id ) );
-    auto call_end = call_price_index.upper_bound( price::max( bitasset.options.short_backing_asset, mia.id ) );
-    while( call_itr != call_end )
-    {
-       auto pays = call_itr->get_debt() * settlement_price;
-       wdump( (call_itr->get_debt() ) );
-       collateral_gathered += pays;
-       const auto&  order = *call_itr;
-       ++call_itr;
-       FC_ASSERT( fill_order( order, pays, order.get_debt() ) );
-    }
-
-   const limit_order_index& limit_index = get_index_type<limit_order_index>();
-   const auto& limit_price_index = limit_index.indices().get<by_price>();
-
-    // cancel all orders selling the market issued asset
-    auto limit_itr = limit_price_index.lower_bound(price::max(mia.id, bitasset.options.short_backing_asset));
-    auto limit_end = limit_price_index.upper_bound(~bitasset.current_feed.call_limit);
-    while( limit_itr != limit_end )
-    {
-       const auto& order = *limit_itr;
-       ilog( "CANCEL LIMIT ORDER" );
-        idump((order));
-       ++limit_itr;
-       cancel_order( order );
-    }
-
-    limit_itr = limit_price_index.begin();
-    while( limit_itr != limit_end )
-    {
-       if( limit_itr->amount_for_sale().asset_id == mia.id )
-       {
-          const auto& order = *limit_itr;
-          ilog( "CANCEL_AGAIN" );
-          edump((order));
-          ++limit_itr;
-          cancel_order( order );
-       }
-    }
-
-   limit_itr = limit_price_index.begin();
-   while( limit_itr != limit_end )
+   auto call_itr = call_price_index.lower_bound( price::min( bitasset.options.short_backing_asset, mia.id ) );
+   auto call_end = call_price_index.upper_bound( price::max( bitasset.options.short_backing_asset, mia.id ) );
+   while( call_itr != call_end )
    {
-      if( limit_itr->amount_for_sale().asset_id == mia.id )
-      {
-         const auto& order = *limit_itr;
-         edump((order));
-         ++limit_itr;
-         cancel_order( order );
-      }
+      auto pays = call_itr->get_debt() * settlement_price;
+      collateral_gathered += pays;
+      const auto&  order = *call_itr;
+      ++call_itr;
+      FC_ASSERT( fill_order( order, pays, order.get_debt() ) );
    }
 
-    // settle all balances
-    asset total_mia_settled = mia.amount(0);
+   // cancel all orders selling the market issued asset, in every market, which refunds it to the balances settled
+   // below
+   for( const limit_order_object* order : _limit_book->orders_selling( mia.id ) )
+      cancel_order( *order );
+
+   // settle all balances
+   asset total_mia_settled = mia.amount(0);
 
    // convert collateral held in bonds
-    const auto& bond_idx = get_index_type<bond_index>().indices().get<by_collateral>();
-    auto bond_itr = bond_idx.find( bitasset.id );
-    while( bond_itr != bond_idx.end() )
-    {
-       if( bond_itr->collateral.asset_id == bitasset.id )
-       {
-          auto settled_amount = bond_itr->collateral * settlement_price;
-          total_mia_settled += bond_itr->collateral;
-          collateral_gathered -= settled_amount;
-          modify( *bond_itr, [&]( bond_object& obj ) {
-                  obj.collateral = settled_amount;
-                  });
-       }
-       else break;
-    }
+   const auto& bond_idx = get_index_type<bond_index>().indices().get<by_collateral>();
+   auto bond_range = bond_idx.equal_range( mia.id );
+   // Converting the collateral moves a bond out of the range
+   vector<const bond_object*> bonds;
+   for( auto itr = bond_range.first; itr != bond_range.second; ++itr )
+      bonds.push_back( &*itr );
+   for( const bond_object* bond : bonds )
+   {
+      auto settled_amount = bond->collateral * settlement_price;
+      total_mia_settled += bond->collateral;
+      collateral_gathered -= settled_amount;
+      modify( *bond, [&]( bond_object& obj ) {
+         obj.collateral = settled_amount;
+      });
+   }
 
-    // cancel all bond offers holding the bitasset and refund the offer
-    const auto& bond_offer_idx = get_index_type<bond_offer_index>().indices().get<by_asset>();
-    auto bond_offer_itr = bond_offer_idx.find( bitasset.id );
-    while( bond_offer_itr != bond_offer_idx.end() )
-    {
-       if( bond_offer_itr->amount.asset_id == bitasset.id )
-       {
-          adjust_balance( bond_offer_itr->offered_by_account, bond_offer_itr->amount );
-          auto old_itr = bond_offer_itr;
-          bond_offer_itr++;
-          remove( *old_itr );
-       }
-       else break;
-    }
+   // cancel all bond offers holding the bitasset and refund the offer
+   const auto& bond_offer_idx = get_index_type<bond_offer_index>().indices().get<by_asset>();
+   auto bond_offer_range = bond_offer_idx.equal_range( mia.id );
+   for( auto itr = bond_offer_range.first; itr != bond_offer_range.second; )
+   {
+      const bond_offer_object& offer = *itr;
+      ++itr;
+      adjust_balance( offer.offered_by_account, offer.amount );
+      remove( offer );
+   }
 
-    const auto& index = get_index_type<account_balance_index>().indices().get<by_asset>();
-    auto range = index.equal_range(mia.get_id());
-    for( auto itr = range.first; itr != range.second; ++itr )
-    {
-       auto mia_balance = itr->get_balance();
-       if( mia_balance.amount > 0 )
-       {
-          adjust_balance(itr->owner, -mia_balance);
-          auto settled_amount = mia_balance * settlement_price;
-          idump( (mia_balance)(settled_amount)(settlement_price) );
-          adjust_balance(itr->owner, settled_amount);
-          total_mia_settled += mia_balance;
-          collateral_gathered -= settled_amount;
-       }
-    }
+   // Every balance of the asset is emptied in place, rather than looked up again through adjust_balance
+   const auto& index = get_index_type<account_balance_index>().indices().get<by_asset>();
+   auto range = index.equal_range(mia.get_id());
+   for( auto itr = range.first; itr != range.second; ++itr )
+   {
+      auto mia_balance = itr->get_balance();
+      if( mia_balance.amount > 0 )
+      {
+         modify( *itr, [&]( account_balance_object& b ) {
+            b.adjust_balance( -mia_balance );
+         });
+         auto settled_amount = mia_balance * settlement_price;
+         adjust_balance(itr->owner, settled_amount);
+         total_mia_settled += mia_balance;
+         collateral_gathered -= settled_amount;
+      }
+   }
 
-    // TODO: convert payments held in escrow
+   // TODO: convert payments held in escrow
 
-    modify( mia_dyn, [&]( asset_dynamic_data_object& obj ){
-       total_mia_settled.amount += obj.accumulated_fees;
-       obj.accumulated_fees = 0;
-    });
+   modify( mia_dyn, [&]( asset_dynamic_data_object& obj ){
+      total_mia_settled.amount += obj.accumulated_fees;
+      obj.accumulated_fees = 0;
+   });
 
-    wlog( "====================== AFTER SETTLE BLACK SWAN UNCLAIMED SETTLEMENT FUNDS ==============\n" );
-    wdump((collateral_gathered)(total_mia_settled)(original_mia_supply)(mia_dyn.current_supply));
-    modify( bitasset.options.short_backing_asset(*this).dynamic_asset_data_id(*this), [&]( asset_dynamic_data_object& obj ){
-       obj.accumulated_fees += collateral_gathered.amount;
-    });
+   modify( backing_asset.dynamic_asset_data_id(*this), [&]( asset_dynamic_data_object& obj ){
+      obj.accumulated_fees += collateral_gathered.amount;
+   });
 
-    FC_ASSERT( total_mia_settled.amount == original_mia_supply, "", ("total_settled",total_mia_settled)("original",original_mia_supply) );
-   } FC_CAPTURE_AND_RETHROW( (mia)(settlement_price) ) }
+   FC_ASSERT( total_mia_settled.amount == original_mia_supply, "", ("total_settled",total_mia_settled)("original",original_mia_supply) );
+} FC_CAPTURE_AND_RETHROW( (mia)(settlement_price) ) }
 
 void database::cancel_order(const force_settlement_object& order, bool create_virtual_op)
 {
@@ -204,6 +166,21 @@ void database::cancel_order( const limit_order_object& order, bool create_virtua
    remove( order );
 }
 
+void database::cancel_order( const short_order_object& order )
+{
+   auto refunded = order.get_collateral();
+   adjust_balance(order.seller, refunded);
+
+   if( refunded.asset_id == asset_id_type() )
+   {
+      modify( order.seller(*this).statistics(*this), [&]( account_statistics_object& obj ){
+         obj.total_core_in_orders -= refunded.amount;
+      });
+   }
+
+   remove( order );
+}
+
 /**
  *  Matches the two orders,
  *
@@ -428,7 +405,7 @@ bool database::fill_order( const short_order_object& order, const asset& pays, c
 
 bool database::fill_order( const call_order_object& order, const asset& pays, const asset& receives )
 { try {
-   idump((pays)(receives)(order));
+   tdump((pays)(receives)(order));
    assert( order.get_debt().asset_id == receives.asset_id );
    assert( order.get_collateral().asset_id == pays.asset_id );
    assert( order.get_collateral() >= pays );
@@ -449,7 +426,7 @@ bool database::fill_order( const call_order_object& order, const asset& pays, co
    const asset_dynamic_data_object& mia_ddo = mia.dynamic_asset_data_id(*this);
 
    modify( mia_ddo, [&]( asset_dynamic_data_object& ao ){
-       idump((receives));
+       tdump((receives));
         ao.current_supply -= receives.amount;
       });
 
@@ -510,24 +487,19 @@ bool database::check_call_orders( const asset_object& mia )
     const asset_bitasset_data_object& bitasset = mia.bitasset_data(*this);
     if( bitasset.current_feed.call_limit.is_null() ) return false;
     if( bitasset.is_prediction_market ) return false;
+    if( !_margin_calls->needs_check( mia.id ) ) return false;
 
     const call_order_index& call_index = get_index_type<call_order_index>();
     const auto& call_price_index = call_index.indices().get<by_price>();
 
-    const limit_order_index& limit_index = get_index_type<limit_order_index>();
-    const auto& limit_price_index = limit_index.indices().get<by_price>();
-
-    const short_order_index& short_index = get_index_type<short_order_index>();
-    const auto& short_price_index = short_index.indices().get<by_price>();
-
-    auto short_itr = short_price_index.lower_bound( price::max( mia.id, bitasset.options.short_backing_asset ) );
-    auto short_end = short_price_index.upper_bound( ~bitasset.current_feed.call_limit );
-
-    auto limit_itr = limit_price_index.lower_bound( price::max( mia.id, bitasset.options.short_backing_asset ) );
-    auto limit_end = limit_price_index.upper_bound( ~bitasset.current_feed.call_limit );
+    // Orders selling the asset at the call limit or better, looked up afresh as every fill removes the order or
+    // the call
+    const price order_limit = ~bitasset.current_feed.call_limit;
 
+    // Every match is at order_limit or better, so a position whose call price is above the call limit can never be
+    // called; stopping the walk at the call limit leaves the safe positions, and the books, alone after a feed update
     auto call_itr = call_price_index.lower_bound( price::min( bitasset.options.short_backing_asset, mia.id ) );
-    auto call_end = call_price_index.upper_bound( price::max( bitasset.options.short_backing_asset, mia.id ) );
+    auto call_end = call_price_index.upper_bound( bitasset.current_feed.call_limit );
 
     bool filled_short_or_limit = false;
 
@@ -537,36 +509,40 @@ bool database::check_call_orders( const asset_object& mia )
        bool  filled_call      = false;
        price match_price;
        asset usd_for_sale;
-       if( limit_itr != limit_end )
+       const limit_order_object* limit = _limit_book->best( order_limit );
+       const short_order_object* short_order = _short_book->best( order_limit );
+       if( limit )
        {
-          assert( limit_itr != limit_price_index.end() );
-          if( short_itr != short_end && limit_itr->sell_price < short_itr->sell_price )
+          if( short_order && limit->sell_price < short_order->sell_price )
           {
-             assert( short_itr != short_price_index.end() );
              current_is_limit = false;
-             match_price      = short_itr->sell_price;
-             usd_for_sale     = short_itr->amount_for_sale();
+             match_price      = short_order->sell_price;
+             usd_for_sale     = short_order->amount_for_sale();
           }
           else
           {
              current_is_limit = true;
-             match_price      = limit_itr->sell_price;
-             usd_for_sale     = limit_itr->amount_for_sale();
+             match_price      = limit->sell_price;
+             usd_for_sale     = limit->amount_for_sale();
           }
        }
-       else if( short_itr != short_end )
+       else if( short_order )
        {
-          assert( short_itr != short_price_index.end() );
           current_is_limit = false;
-          match_price      = short_itr->sell_price;
-          usd_for_sale     = short_itr->amount_for_sale();
+          match_price      = short_order->sell_price;
+          usd_for_sale     = short_order->amount_for_sale();
+       }
+       else
+       {
+          _margin_calls->set_checked( mia.id );
+          return filled_short_or_limit;
        }
-       else return filled_short_or_limit;
 
        match_price.validate();
 
        if( match_price > ~call_itr->call_price )
        {
+          _margin_calls->set_checked( mia.id );
           return filled_short_or_limit;
        }
 
@@ -604,20 +580,42 @@ bool database::check_call_orders( const asset_object& mia )
        if( filled_call ) ++call_itr;
        fill_order( *old_call_itr, call_pays, call_receives );
        if( current_is_limit )
-       {
-          auto old_limit_itr = !filled_call ? limit_itr++ : limit_itr;
-          fill_order( *old_limit_itr, order_pays, order_receives );
-       }
+          fill_order( *limit, order_pays, order_receives );
        else
-       {
-          auto old_short_itr = !filled_call ? short_itr++ : short_itr;
-          fill_order( *old_short_itr, order_pays, order_receives );
-       }
+          fill_order( *short_order, order_pays, order_receives );
     } // whlie call_itr != call_end
 
+    _margin_calls->set_checked( mia.id );
     return filled_short_or_limit;
 } FC_CAPTURE_AND_RETHROW() }
 
+void database::defer_matching( asset_id_type a, asset_id_type b )
+{
+   _batched_markets.insert( std::make_pair( std::min( a, b ), std::max( a, b ) ) );
+}
+
+void database::match_batched_markets()
+{ try {
+   for( const auto& market : _batched_markets )
+   {
+      const price any_ask = price::min( market.first, market.second );
+      const price any_bid = price::min( market.second, market.first );
+      while( true )
+      {
+         const limit_order_object* ask = _limit_book->best( any_ask );
+         const limit_order_object* bid = _limit_book->best( any_bid );
+         if( !ask || !bid || ask->sell_price < ~bid->sell_price )
+            break;
+         int filled = ask->id < bid->id ? match( *bid, *ask, ask->sell_price )
+                                        : match( *ask, *bid, bid->sell_price );
+         // Neither order could trade a single unit at the price
+         if( filled == 0 )
+            break;
+      }
+   }
+   _batched_markets.clear();
+} FC_CAPTURE_AND_RETHROW() }
+
 void database::pay_order( const account_object& receiver, const asset& receives, const asset& pays )
 {
    const auto& balances = receiver.statistics(*this);
@@ -647,10 +645,10 @@ asset database::calculate_market_fee( const asset_object& trade_asset, const ass
    if( trade_asset.options.market_fee_percent == 0 )
       return trade_asset.amount(trade_asset.options.min_market_fee);
 
-   fc::uint128 a(trade_amount.amount.value);
-   a *= trade_asset.options.market_fee_percent;
-   a /= GRAPHENE_100_PERCENT;
-   asset percent_fee = trade_asset.amount(a.to_uint64());
+   uint64_t a;
+   FC_ASSERT( multiply_divide( uint64_t(trade_amount.amount.value), trade_asset.options.market_fee_percent,
+                               GRAPHENE_100_PERCENT, a ) );
+   asset percent_fee = trade_asset.amount(a);
 
    if( percent_fee.amount > trade_asset.options.max_market_fee )
       percent_fee.amount = trade_asset.options.max_market_fee;
@@ -667,13 +665,7 @@ asset database::pay_market_fees( const asset_object& recv_asset, const asset& re
 
    //Don't dirty undo state if not actually collecting any fees
    if( issuer_fees.amount > 0 )
-   {
-      const auto& recv_dyn_data = recv_asset.dynamic_asset_data_id(*this);
-      modify( recv_dyn_data, [&]( asset_dynamic_data_object& obj ){
-                   idump((issuer_fees));
-         obj.accumulated_fees += issuer_fees.amount;
-      });
-   }
+      add_accumulated_fees( recv_asset.dynamic_asset_data_id(*this), issuer_fees.amount );
 
    return issuer_fees;
 }
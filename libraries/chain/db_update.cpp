@@ -27,7 +27,11 @@
 #include <graphene/chain/withdraw_permission_object.hpp>
 #include <graphene/chain/witness_object.hpp>
 
-#include <fc/uint128.hpp>
+#include <graphene/chain/wide_arithmetic.hpp>
+
+#include <graphene/utilities/trace_log.hpp>
+
+#include <algorithm>
 
 namespace graphene { namespace chain {
 
@@ -68,17 +72,54 @@ void database::update_signing_witness(const witness_object& signing_witness, con
       _wit.last_secret = new_block.previous_secret;
       _wit.next_secret = new_block.next_secret_hash;
       _wit.accumulated_income += witness_pay;
+      _wit.last_confirmed_block_num = new_block.block_num();
+   } );
+}
+
+void database::update_last_irreversible_block()
+{
+   const global_property_object& gpo = get_global_properties();
+   const dynamic_global_property_object& dpo = get_dynamic_global_properties();
+
+   vector<uint32_t> confirmed;
+   confirmed.reserve( gpo.active_witnesses.size() );
+   for( witness_id_type wid : gpo.active_witnesses )
+      confirmed.push_back( wid(*this).last_confirmed_block_num );
+   if( confirmed.empty() )
+      return;
+
+   // At least GRAPHENE_IRREVERSIBLE_THRESHOLD of the witnesses have confirmed the block at offset and after
+   size_t offset = (GRAPHENE_100_PERCENT - GRAPHENE_IRREVERSIBLE_THRESHOLD) * confirmed.size() / GRAPHENE_100_PERCENT;
+   std::nth_element( confirmed.begin(), confirmed.begin() + offset, confirmed.end() );
+   const uint32_t last_irreversible = confirmed[offset];
+   if( last_irreversible <= dpo.last_irreversible_block_num )
+      return;
+
+   modify( dpo, [&]( dynamic_global_property_object& _dpo ) {
+      _dpo.last_irreversible_block_num = last_irreversible;
    } );
+
+   // Nothing at or below the last irreversible block can be popped or forked from
+   _undo_db.discard_oldest( head_block_num() - last_irreversible );
+   if( last_irreversible > 0 )
+      _fork_db.prune( last_irreversible - 1 );
 }
 
 void database::update_pending_block(const signed_block& next_block, uint8_t current_block_interval)
 {
    _pending_block.timestamp = next_block.timestamp + current_block_interval;
    _pending_block.previous = next_block.id();
-   auto old_pending_trx = std::move(_pending_block.transactions);
+   // push_block applies the pending transactions again once the block is done
    _pending_block.transactions.clear();
-   for( auto old_trx : old_pending_trx )
-      push_transaction( old_trx );
+   _pending_block_merkle.clear();
+   _pending_block_transactions_size = 0;
+}
+
+uint64_t database::pending_block_size()const
+{
+   return fc::raw::pack_size( static_cast<const signed_block_header&>( _pending_block ) )
+        + fc::raw::pack_size( fc::unsigned_int( _pending_block.transactions.size() ) )
+        + _pending_block_transactions_size;
 }
 
 void database::clear_expired_transactions()
@@ -118,7 +159,16 @@ void database::clear_expired_proposals()
 
 void database::clear_expired_orders()
 {
-   transaction_evaluation_state cancel_context(this, true);
+   // Expired orders need no authority and pay no fee, so they are canceled directly rather than through the cancel
+   // evaluators, recording the same operations and results
+   auto cancel_expired = [&]( const operation& canceler, const asset& refunded, const price& sell_price,
+                              const std::function<void()>& cancel ) {
+      auto op_id = push_applied_operation( canceler );
+      cancel();
+      check_call_orders( sell_price.base.asset_id(*this) );
+      check_call_orders( sell_price.quote.asset_id(*this) );
+      set_applied_operation_result( op_id, refunded );
+   };
 
    //Cancel expired limit orders
    auto& limit_index = get_index_type<limit_order_index>().indices().get<by_expiration>();
@@ -128,7 +178,8 @@ void database::clear_expired_orders()
       const limit_order_object& order = *limit_index.begin();
       canceler.fee_paying_account = order.seller;
       canceler.order = order.id;
-      apply_operation(cancel_context, canceler);
+      const price sell_price = order.sell_price;
+      cancel_expired( canceler, order.amount_for_sale(), sell_price, [&]{ cancel_order( order, false ); } );
    }
 
    //Cancel expired short orders
@@ -139,42 +190,38 @@ void database::clear_expired_orders()
       short_order_cancel_operation canceler;
       canceler.fee_paying_account = order.seller;
       canceler.order = order.id;
-      apply_operation(cancel_context, canceler);
+      const price sell_price = order.sell_price;
+      cancel_expired( canceler, order.get_collateral(), sell_price, [&]{ cancel_order( order ); } );
    }
 
    //Process expired force settlement orders
-   auto& settlement_index = get_index_type<force_settlement_index>().indices().get<by_expiration>();
-   if( !settlement_index.empty() )
+   // Only the assets with a due settlement are visited, in asset order. Each asset's requests are executed from its
+   // own queue in settlement date order until the first one not yet due, or until the asset's volume budget for this
+   // maintenance interval is spent
+   const auto& settlement_index = get_index_type<force_settlement_index>().indices();
+   const auto& due_index = settlement_index.get<by_settlement_date>();
+   flat_set<asset_id_type> due_assets;
+   for( auto itr = due_index.begin(); itr != due_index.end() && itr->settlement_date <= head_block_time(); ++itr )
+      due_assets.insert( itr->settlement_asset_id() );
+
+   const auto& queue_index = settlement_index.get<by_expiration>();
+   const auto& call_index = get_index_type<call_order_index>().indices().get<by_collateral>();
+   for( const asset_id_type current_asset : due_assets )
    {
-      asset_id_type current_asset = settlement_index.begin()->settlement_asset_id();
-      asset max_settlement_volume;
-
-      auto next_asset = [&current_asset, &settlement_index] {
-         auto bound = settlement_index.upper_bound(current_asset);
-         if( bound == settlement_index.end() )
-            return false;
-         current_asset = bound->settlement_asset_id();
-         return true;
-      };
-
-      // At each iteration, we either consume the current order and remove it, or we move to the next asset
-      for( auto itr = settlement_index.lower_bound(current_asset);
-           itr != settlement_index.end();
-           itr = settlement_index.lower_bound(current_asset) )
+      const asset_object& mia_object = get(current_asset);
+      const asset_bitasset_data_object& mia = mia_object.bitasset_data(*this);
+      const asset max_settlement_volume =
+            mia_object.amount(mia.max_force_settlement_volume(mia_object.dynamic_data(*this).current_supply));
+      asset settled = mia_object.amount(mia.force_settled_volume);
+
+      for( auto itr = queue_index.lower_bound(current_asset);
+           itr != queue_index.end() && itr->settlement_asset_id() == current_asset
+              && itr->settlement_date <= head_block_time();
+           itr = queue_index.lower_bound(current_asset) )
       {
          const force_settlement_object& order = *itr;
          auto order_id = order.id;
-         current_asset = order.settlement_asset_id();
-         const asset_object& mia_object = get(current_asset);
-         const asset_bitasset_data_object mia = mia_object.bitasset_data(*this);
 
-         // Has this order not reached its settlement date?
-         if( order.settlement_date > head_block_time() )
-         {
-            if( next_asset() )
-               continue;
-            break;
-         }
          // Can we still settle in this asset?
          if( mia.current_feed.settlement_price.is_null() )
          {
@@ -183,53 +230,52 @@ void database::clear_expired_orders()
             cancel_order(order);
             continue;
          }
-         if( max_settlement_volume.asset_id != current_asset )
-            max_settlement_volume = mia_object.amount(mia.max_force_settlement_volume(mia_object.dynamic_data(*this).current_supply));
-         if( mia.force_settled_volume >= max_settlement_volume.amount )
+         if( settled >= max_settlement_volume )
          {
-            ilog("Skipping force settlement in ${asset}; settled ${settled_volume} / ${max_volume}",
-                 ("asset", mia_object.symbol)("settlement_price_null",mia.current_feed.settlement_price.is_null())
-                 ("settled_volume", mia.force_settled_volume)("max_volume", max_settlement_volume));
-            if( next_asset() )
-               continue;
+            tlog("Skipping force settlement in ${asset}; settled ${settled_volume} / ${max_volume}",
+                 ("asset", mia_object.symbol)("settled_volume", settled)("max_volume", max_settlement_volume));
             break;
          }
 
          auto& pays = order.balance;
          auto receives = (order.balance * mia.current_feed.settlement_price);
-         receives.amount = (fc::uint128_t(receives.amount.value) *
-                            (GRAPHENE_100_PERCENT - mia.options.force_settlement_offset_percent) / GRAPHENE_100_PERCENT).to_uint64();
+         uint64_t offset_receives;
+         FC_ASSERT( multiply_divide( uint64_t(receives.amount.value),
+                                     GRAPHENE_100_PERCENT - mia.options.force_settlement_offset_percent,
+                                     GRAPHENE_100_PERCENT, offset_receives ) );
+         receives.amount = offset_receives;
          assert(receives <= order.balance * mia.current_feed.settlement_price);
 
          price settlement_price = pays / receives;
 
-         auto& call_index = get_index_type<call_order_index>().indices().get<by_collateral>();
-         asset settled = mia_object.amount(mia.force_settled_volume);
          // Match against the least collateralized short until the settlement is finished or we reach max settlements
          while( settled < max_settlement_volume && find_object(order_id) )
          {
-            auto itr = call_index.lower_bound(boost::make_tuple(price::min(mia_object.bitasset_data(*this).options.short_backing_asset,
-                                                                           mia_object.get_id())));
+            auto call_itr = call_index.lower_bound(boost::make_tuple(price::min(mia.options.short_backing_asset,
+                                                                                mia_object.get_id())));
             // There should always be a call order, since asset exists!
-            assert(itr != call_index.end() && itr->debt_type() == mia_object.get_id());
+            assert(call_itr != call_index.end() && call_itr->debt_type() == mia_object.get_id());
             asset max_settlement = max_settlement_volume - settled;
-            settled += match(*itr, order, settlement_price, max_settlement);
+            settled += match(*call_itr, order, settlement_price, max_settlement);
          }
-         modify(mia, [settled](asset_bitasset_data_object& b) {
+      }
+
+      if( settled.amount != mia.force_settled_volume )
+         modify(mia, [&settled](asset_bitasset_data_object& b) {
             b.force_settled_volume = settled.amount;
          });
-      }
    }
 }
 
 void database::update_expired_feeds()
 {
-   auto& asset_idx = get_index_type<asset_bitasset_data_index>();
-   for( const asset_bitasset_data_object* b : asset_idx )
-      if( b->feed_is_expired(head_block_time()) )
-         modify(*b, [this](asset_bitasset_data_object& a) {
-            a.update_median_feeds(head_block_time());
-         });
+   // Only the bitassets whose oldest feed in the median has expired are visited, and updating the median moves
+   // each one past the head block time
+   const auto& feed_index = get_index_type<asset_bitasset_data_index>().indices().get<by_feed_expiration>();
+   while( !feed_index.empty() && feed_index.begin()->feed_is_expired(head_block_time()) )
+      modify(*feed_index.begin(), [this](asset_bitasset_data_object& a) {
+         a.update_median_feeds(head_block_time());
+      });
 }
 
 void database::update_withdraw_permissions()
@@ -40,14 +40,18 @@ pair<witness_id_type, bool> database::get_scheduled_witness(uint32_t slot_num)co
    {
       // if the near scheduler doesn't know, we have to extend it to
       //   a far scheduler.
-      // n.b. instantiating it is slow, but block gaps long enough to
-      //   need it are likely pretty rare.
-
-      witness_scheduler_rng far_rng(wso.rng_seed.begin(), GRAPHENE_FAR_SCHEDULE_CTR_IV);
-
-      far_future_witness_scheduler far_scheduler =
-         far_future_witness_scheduler(wso.scheduler, far_rng);
-      if( !far_scheduler.get_slot(slot_num, wid) )
+      // n.b. instantiating it is slow, and after a long gap block
+      //   production asks for many far slots, so it is kept until the
+      //   near schedule or the seed changes.
+      if( !_far_witness_schedule.valid() || _far_witness_schedule_seed != wso.rng_seed ||
+          !(_far_witness_schedule_base == wso.scheduler) )
+      {
+         witness_scheduler_rng far_rng(wso.rng_seed.begin(), GRAPHENE_FAR_SCHEDULE_CTR_IV);
+         _far_witness_schedule = far_future_witness_scheduler(wso.scheduler, far_rng);
+         _far_witness_schedule_base = wso.scheduler;
+         _far_witness_schedule_seed = wso.rng_seed;
+      }
+      if( !_far_witness_schedule->get_slot(slot_num, wid) )
       {
          // no scheduled witness -- somebody set up us the bomb
          // n.b. this code path is impossible, the present
@@ -93,7 +97,7 @@ vector<witness_id_type> database::get_near_witness_schedule()const
    return result;
 }
 
-void database::update_witness_schedule(signed_block next_block)
+void database::update_witness_schedule(const signed_block& next_block)
 {
    const global_property_object& gpo = get_global_properties();
    const witness_schedule_object& wso = get(witness_schedule_id_type());
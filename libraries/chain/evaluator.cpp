@@ -24,18 +24,37 @@
 #include <graphene/chain/delegate_object.hpp>
 #include <graphene/chain/limit_order_object.hpp>
 #include <graphene/chain/short_order_object.hpp>
+#include <graphene/chain/wide_arithmetic.hpp>
 
-#include <fc/uint128.hpp>
+#include <chrono>
 
 namespace graphene { namespace chain {
    database& generic_evaluator::db()const { return trx_state->db(); }
    operation_result generic_evaluator::start_evaluate( transaction_evaluation_state& eval_state, const operation& op, bool apply )
    {
       trx_state   = &eval_state;
+      evaluator_stats* stats = db().count_evaluation( get_type() );
+      if( stats == nullptr )
+      {
+         check_required_authorities(op);
+         auto result = evaluate( op );
+
+         if( apply ) result = this->apply( op );
+         return result;
+      }
+
+      typedef std::chrono::steady_clock clock;
+      auto to_ns = []( clock::duration d ) { return uint64_t( std::chrono::duration_cast<std::chrono::nanoseconds>( d ).count() ); };
+      uint64_t undo_clones = db().get_undo_saved_objects();
+      auto start = clock::now();
       check_required_authorities(op);
       auto result = evaluate( op );
+      auto evaluated = clock::now();
 
       if( apply ) result = this->apply( op );
+      auto applied = clock::now();
+      stats->record( to_ns( evaluated - start ), to_ns( applied - evaluated ),
+                     db().get_undo_saved_objects() - undo_clones );
       return result;
    }
 
@@ -63,33 +82,42 @@ namespace graphene { namespace chain {
    { try {
       asset core_fee_subtotal(core_fee_paid);
       const auto& gp = db().get_global_properties();
+      auto& d = db();
+      share_type lifetime_fees_paid = d.get_lifetime_fees_paid(*fee_paying_account_statistics);
       share_type bulk_cashback  = share_type(0);
-      if( fee_paying_account_statistics->lifetime_fees_paid > gp.parameters.bulk_discount_threshold_min &&
+      if( lifetime_fees_paid > gp.parameters.bulk_discount_threshold_min &&
           fee_paying_account->is_prime() )
       {
          uint64_t bulk_discount_percent = 0;
-         if( fee_paying_account_statistics->lifetime_fees_paid > gp.parameters.bulk_discount_threshold_max )
+         if( lifetime_fees_paid > gp.parameters.bulk_discount_threshold_max )
             bulk_discount_percent = gp.parameters.max_bulk_discount_percent_of_fee;
          else if(gp.parameters.bulk_discount_threshold_max.value - gp.parameters.bulk_discount_threshold_min.value != 0)
          {
-            bulk_discount_percent =
-                  (gp.parameters.max_bulk_discount_percent_of_fee *
-                            (fee_paying_account_statistics->lifetime_fees_paid.value -
-                             gp.parameters.bulk_discount_threshold_min.value)) /
-                  (gp.parameters.bulk_discount_threshold_max.value - gp.parameters.bulk_discount_threshold_min.value);
+            // The products of the amounts and percentages may not fit in 64 bits
+            FC_ASSERT( multiply_divide( gp.parameters.max_bulk_discount_percent_of_fee,
+                                        uint64_t(lifetime_fees_paid.value - gp.parameters.bulk_discount_threshold_min.value),
+                                        uint64_t(gp.parameters.bulk_discount_threshold_max.value -
+                                                 gp.parameters.bulk_discount_threshold_min.value),
+                                        bulk_discount_percent ) );
          }
          assert( bulk_discount_percent <= GRAPHENE_100_PERCENT );
-         assert( bulk_discount_percent >= 0 );
 
-         bulk_cashback = (core_fee_subtotal.amount.value * bulk_discount_percent) / GRAPHENE_100_PERCENT;
+         uint64_t cashback;
+         FC_ASSERT( multiply_divide( uint64_t(core_fee_subtotal.amount.value), bulk_discount_percent,
+                                     GRAPHENE_100_PERCENT, cashback ) );
+         bulk_cashback = cashback;
          assert( bulk_cashback <= core_fee_subtotal.amount );
       }
 
       share_type core_fee_total = core_fee_subtotal.amount - bulk_cashback;
-      share_type accumulated = (core_fee_total.value  * gp.parameters.witness_percent_of_fee)/GRAPHENE_100_PERCENT;
-      share_type burned     = (core_fee_total.value  * gp.parameters.burn_percent_of_fee)/GRAPHENE_100_PERCENT;
+      uint64_t accumulated_amount, burned_amount;
+      FC_ASSERT( multiply_divide( uint64_t(core_fee_total.value), gp.parameters.witness_percent_of_fee,
+                                  GRAPHENE_100_PERCENT, accumulated_amount ) &&
+                 multiply_divide( uint64_t(core_fee_total.value), gp.parameters.burn_percent_of_fee,
+                                  GRAPHENE_100_PERCENT, burned_amount ) );
+      share_type accumulated = accumulated_amount;
+      share_type burned     = burned_amount;
       share_type referral   = core_fee_total.value - accumulated - burned;
-      auto& d = db();
 
       assert( accumulated + burned <= core_fee_total );
 
@@ -98,16 +126,18 @@ namespace graphene { namespace chain {
             d.accumulated_fees += fee_from_account.amount;
             d.fee_pool -= core_fee_paid;
          });
-      d.modify(dynamic_asset_data_id_type()(d), [burned,accumulated](asset_dynamic_data_object& d) {
-         d.accumulated_fees += accumulated + burned;
-      });
-
-      d.modify(fee_paying_account->statistics(d), [core_fee_total](account_statistics_object& s) {
-         s.lifetime_fees_paid += core_fee_total;
-      });
-
-      d.deposit_cashback( fee_paying_account->referrer(d), referral );
-      d.deposit_cashback( *fee_paying_account, bulk_cashback );
+      // Only pay_fee reads these, so they are deferred to the end of the transactions of a block
+      d.add_accumulated_fees( dynamic_asset_data_id_type()(d), accumulated + burned );
+      d.add_lifetime_fees_paid( *fee_paying_account_statistics, core_fee_total );
+
+      // Both deposits go to the same vesting balance when the account is its own referrer
+      if( fee_paying_account->is_prime() )
+         d.deposit_cashback( *fee_paying_account, referral + bulk_cashback );
+      else
+      {
+         d.deposit_cashback( fee_paying_account->referrer(d), referral );
+         d.deposit_cashback( *fee_paying_account, bulk_cashback );
+      }
 
       assert( referral + bulk_cashback + accumulated + burned == core_fee_subtotal.amount );
    } FC_CAPTURE_AND_RETHROW() }
@@ -118,17 +148,29 @@ namespace graphene { namespace chain {
    }
    void generic_evaluator::check_required_authorities(const operation& op)
    {
-      flat_set<account_id_type> active_auths;
-      flat_set<account_id_type> owner_auths;
-      op.visit(operation_get_required_auths(active_auths, owner_auths));
+      if( trx_state->_skip_authority_check )
+         return;
+
+      auto& active_auths = trx_state->required_active_auths;
+      auto& owner_auths = trx_state->required_owner_auths;
+      active_auths.clear();
+      owner_auths.clear();
+      dispatch(op, operation_get_required_auths(active_auths, owner_auths));
 
+      // The operations of a transaction often share their authorities, so most are already approved and need not
+      // even be looked up
       for( auto id : active_auths )
       {
-         FC_ASSERT(verify_authority(id(db()), authority::active) ||
-                   verify_authority(id(db()), authority::owner), "", ("id", id));
+         if( trx_state->is_approved(id, authority::active) || trx_state->is_approved(id, authority::owner) )
+            continue;
+         const account_object& account = id(db());
+         FC_ASSERT(verify_authority(account, authority::active) ||
+                   verify_authority(account, authority::owner), "", ("id", id));
       }
       for( auto id : owner_auths )
       {
+         if( trx_state->is_approved(id, authority::owner) )
+            continue;
          FC_ASSERT(verify_authority(id(db()), authority::owner), "", ("id", id));
       }
    }
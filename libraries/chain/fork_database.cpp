@@ -17,6 +17,8 @@
  */
 #include <graphene/chain/fork_database.hpp>
 
+#include <algorithm>
+
 
 namespace graphene { namespace chain {
 fork_database::fork_database()
@@ -28,26 +30,34 @@ void fork_database::reset()
    _index.clear();
 }
 
+void fork_database::set_max_size( uint32_t max_size )
+{
+   FC_ASSERT( max_size > 0 );
+   _max_size = max_size;
+   if( _head && _head->num > _max_size )
+      prune( _head->num - _max_size );
+}
+
 void fork_database::pop_block()
 {
-   if( _head ) _head = _head->prev.lock();
+   if( _head ) _head = _head->prev;
 }
 
 void     fork_database::start_block( signed_block b )
 {
-   auto item = std::make_shared<fork_item>( std::move(b) );
+   auto item = make_item( std::move(b) );
    _index.insert( item );
    _head = item;
 }
 
 shared_ptr<fork_item>  fork_database::push_block( signed_block b )
 {
-   auto item = std::make_shared<fork_item>( std::move(b) );
+   auto item = make_item( std::move(b) );
    //wdump((item->num)(_head?_head->num:0));
 
-   if( _head && b.previous != block_id_type() )
+   if( _head && item->data.previous != block_id_type() )
    {
-      auto itr = _index.get<block_id>().find( b.previous );
+      auto itr = _index.get<block_id>().find( item->data.previous );
       FC_ASSERT( itr != _index.get<block_id>().end() );
       FC_ASSERT( !(*itr)->invalid );
       item->prev = *itr;
@@ -58,10 +68,28 @@ shared_ptr<fork_item>  fork_database::push_block( signed_block b )
    else if( item->num > _head->num )
    {
       _head = item;
-      _index.get<block_num>().erase( _head->num - 1024 );
+      if( _head->num > _max_size )
+         prune( _head->num - _max_size );
    }
    return _head;
 }
+
+item_ptr fork_database::make_item( signed_block b )
+{
+   return std::allocate_shared<fork_item>( item_allocator(), std::move(b) );
+}
+
+void fork_database::prune( uint32_t block_num )
+{
+   auto& by_num = _index.get<block_num>();
+   auto end = by_num.upper_bound( block_num );
+   if( end == by_num.begin() )
+      return;
+   by_num.erase( by_num.begin(), end );
+   // The oldest remaining blocks would otherwise keep the pruned ones alive
+   for( auto itr = by_num.begin(); itr != by_num.end() && (*itr)->num == block_num + 1; ++itr )
+      (*itr)->prev.reset();
+}
 bool fork_database::is_known_block( const block_id_type& id )const
 {
    auto& index = _index.get<block_id>();
@@ -103,22 +131,25 @@ pair<fork_database::branch_type,fork_database::branch_type>
    auto second_branch = *second_branch_itr;
 
 
-   while( first_branch->data.block_num() > second_branch->data.block_num() )
+   // Each branch holds at least the blocks above the lower head
+   result.first.reserve( first_branch->num - std::min( first_branch->num, second_branch->num ) + 1 );
+   result.second.reserve( second_branch->num - std::min( first_branch->num, second_branch->num ) + 1 );
+   while( first_branch->num > second_branch->num )
    {
       result.first.push_back( first_branch );
-      first_branch = first_branch->prev.lock(); FC_ASSERT( first_branch );
+      first_branch = first_branch->prev; FC_ASSERT( first_branch );
    }
-   while( second_branch->data.block_num() > first_branch->data.block_num() )
+   while( second_branch->num > first_branch->num )
    {
       result.second.push_back( second_branch );
-      second_branch = second_branch->prev.lock(); FC_ASSERT( second_branch );
+      second_branch = second_branch->prev; FC_ASSERT( second_branch );
    }
    while( first_branch->data.previous != second_branch->data.previous )
    {
       result.first.push_back( first_branch );
       result.second.push_back( second_branch );
-      first_branch = first_branch->prev.lock(); FC_ASSERT( first_branch );
-      second_branch = second_branch->prev.lock(); FC_ASSERT( second_branch );
+      first_branch = first_branch->prev; FC_ASSERT( first_branch );
+      second_branch = second_branch->prev; FC_ASSERT( second_branch );
    }
    if( first_branch && second_branch )
    {
@@ -134,7 +165,28 @@ void fork_database::set_head( shared_ptr<fork_item> h )
 
 void fork_database::remove( block_id_type id )
 {
-   _index.get<block_id>().erase(id);
+   auto& by_id = _index.get<block_id>();
+   auto itr = by_id.find(id);
+   if( itr == by_id.end() )
+      return;
+
+   // Blocks built on a removed block can never be applied either
+   flat_set<const fork_item*> removed;
+   removed.insert( itr->get() );
+   const uint32_t num = (*itr)->num;
+   by_id.erase( itr );
+
+   auto& by_num = _index.get<block_num>();
+   for( auto child = by_num.upper_bound( num ); child != by_num.end(); )
+   {
+      if( removed.count( (*child)->prev.get() ) )
+      {
+         removed.insert( child->get() );
+         child = by_num.erase( child );
+      }
+      else
+         ++child;
+   }
 }
 
 } } // graphene::chain
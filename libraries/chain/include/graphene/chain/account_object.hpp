@@ -19,6 +19,7 @@
 #include <graphene/chain/authority.hpp>
 #include <graphene/chain/asset.hpp>
 #include <graphene/db/generic_index.hpp>
+#include <graphene/db/simple_index.hpp>
 #include <boost/multi_index/composite_key.hpp>
 
 namespace graphene { namespace chain {
@@ -88,6 +89,43 @@ namespace graphene { namespace chain {
          void  adjust_balance(const asset& delta);
    };
 
+   /**
+    * @class account_balance_table
+    * @brief Finds the balance object of an account in an asset with a single probe
+    *
+    * An open addressing hash table with linear probing, keyed on the owner and asset of each balance object in
+    * account_balance_index.  A balance object never changes its owner or asset, so the table only follows objects being
+    * added and removed.  Removal shifts the following entries back rather than leaving tombstones, so lookups never get
+    * slower as balances come and go.  Duplicate keys are tolerated; find() returns whichever was added first.
+    */
+   class account_balance_table : public graphene::db::index_observer
+   {
+      public:
+         /// @return the balance object of owner in asset_type, or nullptr if there is none
+         const account_balance_object* find( account_id_type owner, asset_id_type asset_type )const;
+
+         virtual void on_add( const graphene::db::object& obj ) override;
+         virtual void on_remove( const graphene::db::object& obj ) override;
+
+         size_t size()const { return _size; }
+
+      private:
+         struct entry
+         {
+            uint64_t                      owner   = 0;
+            uint64_t                      asset   = 0;
+            const account_balance_object* balance = nullptr; ///< nullptr if the entry is empty
+         };
+
+         size_t home( uint64_t owner, uint64_t asset )const;
+         void   place( const entry& e );
+         void   grow();
+
+         /// The capacity is always a power of two
+         vector<entry> _entries;
+         size_t        _size = 0;
+   };
+
 
    /**
     * @brief This class represents an account on the object graph
@@ -211,7 +249,6 @@ namespace graphene { namespace chain {
 
    struct by_asset;
    struct by_account;
-   struct by_balance;
    /**
     * @ingroup object_index
     */
@@ -219,11 +256,6 @@ namespace graphene { namespace chain {
       account_balance_object,
       indexed_by<
          ordered_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
-         hashed_unique< tag<by_balance>, composite_key<
-            account_balance_object,
-            member<account_balance_object, account_id_type, &account_balance_object::owner>,
-            member<account_balance_object, asset_id_type, &account_balance_object::asset_type> >
-         >,
          ordered_non_unique< tag<by_account>, member<account_balance_object, account_id_type, &account_balance_object::owner> >,
          ordered_non_unique< tag<by_asset>, member<account_balance_object, asset_id_type, &account_balance_object::asset_type> >
       >
@@ -238,12 +270,14 @@ namespace graphene { namespace chain {
 
    /**
     * @ingroup object_index
+    *
+    * Names are only ever looked up exactly here, so they are hashed; account_name_table serves the ranges in name order.
     */
    typedef multi_index_container<
       account_object,
       indexed_by<
          hashed_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
-         ordered_non_unique< tag<by_name>, member<account_object, string, &account_object::name> >
+         hashed_non_unique< tag<by_name>, member<account_object, string, &account_object::name> >
       >
    > account_object_multi_index_type;
 
@@ -252,7 +286,79 @@ namespace graphene { namespace chain {
     */
    typedef generic_index<account_object, account_object_multi_index_type> account_index;
 
+   /**
+    * @class account_name_table
+    * @brief Keeps the names of all accounts sorted in flat arrays for name range and prefix lookups
+    *
+    * The bulk of the names are packed back to back in one buffer with a sorted vector of (offset, size, id) entries, so
+    * walking a range of names touches contiguous memory rather than the nodes of account_index.  Names added since the
+    * last merge are kept in a small ordered map, which is merged into the flat arrays once it grows past an eighth of
+    * them; loading every account at startup therefore costs a few linear merges instead of an insertion into the middle
+    * of the arrays per account.  An account's name never changes, so only accounts being added and removed are
+    * followed.
+    */
+   class account_name_table : public graphene::db::index_observer
+   {
+      public:
+         virtual void on_add( const graphene::db::object& obj ) override;
+         virtual void on_remove( const graphene::db::object& obj ) override;
+
+         /**
+          * Calls visit( const char* name, size_t name_size, account_id_type id ) for each account in name order,
+          * starting with the first name not less than lower_bound, for as long as it returns true
+          */
+         template<typename Visitor>
+         void visit_from( const string& lower_bound, Visitor&& visit )const
+         {
+            auto sorted_itr = std::lower_bound( _sorted.begin(), _sorted.end(), lower_bound,
+                                                [this]( const entry& e, const string& name ) {
+                                                   return compare( e, name.data(), name.size() ) < 0;
+                                                } );
+            auto recent_itr = _recent.lower_bound( lower_bound );
+            while( sorted_itr != _sorted.end() || recent_itr != _recent.end() )
+            {
+               if( recent_itr == _recent.end() ||
+                   ( sorted_itr != _sorted.end() &&
+                     compare( *sorted_itr, recent_itr->first.data(), recent_itr->first.size() ) < 0 ) )
+               {
+                  if( !visit( _names.data() + sorted_itr->offset, size_t(sorted_itr->size), sorted_itr->id ) )
+                     return;
+                  ++sorted_itr;
+               }
+               else
+               {
+                  if( !visit( recent_itr->first.data(), recent_itr->first.size(), recent_itr->second ) )
+                     return;
+                  ++recent_itr;
+               }
+            }
+         }
+
+         size_t size()const { return _sorted.size() + _recent.size(); }
+
+      private:
+         struct entry
+         {
+            uint32_t        offset = 0;
+            uint32_t        size   = 0;
+            account_id_type id;
+         };
+
+         /// Compares the name of e with the given name as std::string does
+         int  compare( const entry& e, const char* name, size_t name_size )const;
+         /// Merges _recent into the flat arrays, dropping the bytes of removed names from the buffer
+         void merge();
+
+         vector<char>                     _names;
+         vector<entry>                    _sorted;
+         map<string,account_id_type>      _recent;
+   };
+
 }}
+GRAPHENE_DB_OBJECT_INDEX( graphene::chain::account_balance_object, graphene::chain::account_balance_index )
+GRAPHENE_DB_OBJECT_INDEX( graphene::chain::account_statistics_object,
+                          graphene::db::simple_index<graphene::chain::account_statistics_object> )
+
 FC_REFLECT_DERIVED( graphene::chain::account_object,
                     (graphene::db::annotated_object<graphene::chain::account_object>),
                     (registrar)(referrer)(referrer_percent)(name)(owner)(active)(memo_key)(voting_account)(num_witness)(num_committee)(votes)
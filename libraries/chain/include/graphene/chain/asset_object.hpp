@@ -89,6 +89,8 @@ namespace graphene { namespace chain {
          bool charges_market_fees()const { return options.flags & charge_market_fee; }
          /// @return true if this asset may only be transferred to/from the issuer or market orders
          bool is_transfer_restricted()const { return options.flags & transfer_restricted; }
+         /// @return true if the limit orders in the markets of this asset are left to match at the end of the block
+         bool matches_in_batches()const { return options.flags & batch_matching; }
 
          /// Helper function to get an asset object with the given amount in this asset's type
          asset amount(share_type a)const { return asset(a, id); }
@@ -202,6 +204,9 @@ namespace graphene { namespace chain {
                FC_ASSERT(!(options.flags & disable_force_settle || options.flags & global_settle));
                FC_ASSERT(!(options.issuer_permissions & disable_force_settle || options.issuer_permissions & global_settle));
             }
+            // Shorts and margin calls match orders as soon as they arrive
+            else
+               FC_ASSERT(!(options.flags & batch_matching));
          }
 
          template<class DB>
@@ -250,10 +255,18 @@ namespace graphene { namespace chain {
          /// Calculate the maximum force settlement volume per maintenance interval, given the current share supply
          share_type max_force_settlement_volume(share_type current_supply)const;
 
+         /// The time at which the oldest feed factored into current_feed outlives the feed lifetime
          time_point_sec feed_expiration_time()const
          { return current_feed_publication_time + options.feed_lifetime_sec; }
          bool feed_is_expired(time_point_sec current_time)const
-         { return feed_expiration_time() >= current_time; }
+         { return feed_expiration_time() <= current_time; }
+         /**
+          * Sets current_feed to the median of each field over the feeds which are still live at current_time.
+          *
+          * There are at most maximum_asset_feed_publishers feeds, and each median is a linear selection rather than a
+          * sort, so this costs a few passes over a short array. It is only called when a feed is published, the
+          * producers or options change, or the oldest live feed expires.
+          */
          void update_median_feeds(time_point_sec current_time);
    };
 
@@ -268,20 +281,27 @@ namespace graphene { namespace chain {
          >
       >
    > asset_bitasset_data_object_multi_index_type;
-   typedef flat_index<asset_bitasset_data_object> asset_bitasset_data_index;
+   typedef generic_index<asset_bitasset_data_object, asset_bitasset_data_object_multi_index_type> asset_bitasset_data_index;
 
    struct by_symbol;
+   /// Hashed, for looking symbols up exactly; by_symbol serves the ranges in symbol order
+   struct by_exact_symbol;
    typedef multi_index_container<
       asset_object,
       indexed_by<
          hashed_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
-         ordered_unique< tag<by_symbol>, member<asset_object, string, &asset_object::symbol> >
+         ordered_unique< tag<by_symbol>, member<asset_object, string, &asset_object::symbol> >,
+         hashed_unique< tag<by_exact_symbol>, member<asset_object, string, &asset_object::symbol> >
       >
    > asset_object_multi_index_type;
    typedef generic_index<asset_object, asset_object_multi_index_type> asset_index;
 
 
 } } // graphene::chain
+GRAPHENE_DB_OBJECT_INDEX( graphene::chain::asset_dynamic_data_object,
+                          graphene::db::flat_index<graphene::chain::asset_dynamic_data_object> )
+GRAPHENE_DB_OBJECT_INDEX( graphene::chain::asset_bitasset_data_object, graphene::chain::asset_bitasset_data_index )
+
 FC_REFLECT_DERIVED( graphene::chain::asset_dynamic_data_object, (graphene::db::object),
                     (current_supply)(accumulated_fees)(fee_pool) )
 
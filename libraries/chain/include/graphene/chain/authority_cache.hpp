@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/chain/authority.hpp>
+
+#include <unordered_map>
+
+namespace graphene { namespace chain {
+
+   /**
+    *  @class authority_cache
+    *  @brief Remembers which account authorities were satisfied by a set of signing keys
+    *
+    *  Blocks frequently contain many transactions signed by the same keys on behalf of the same accounts, and each of
+    *  them would otherwise walk the same authority tree. Entries are only valid while no account authority changes, so
+    *  the database only uses the cache while applying the transactions of a block, clears it before and after, and
+    *  stops using it for the rest of the block once any account authority is updated.
+    *
+    *  Only approvals are remembered. An approval found at a given recursion depth also holds at any lesser depth.
+    */
+   class authority_cache
+   {
+      public:
+         bool is_approved( account_id_type account, authority::classification auth_class,
+                           const vector<key_id_type>& keys, int depth )const;
+         void approve( account_id_type account, authority::classification auth_class,
+                       const vector<key_id_type>& keys, int depth );
+
+         void   clear() { _entries.clear(); }
+         size_t size()const { return _entries.size(); }
+
+      private:
+         struct entry_key
+         {
+            account_id_type            account;
+            authority::classification  auth_class;
+            vector<key_id_type>        keys;
+
+            friend bool operator == ( const entry_key& a, const entry_key& b )
+            {
+               return a.account == b.account && a.auth_class == b.auth_class && a.keys == b.keys;
+            }
+         };
+         struct entry_key_hash
+         {
+            size_t operator()( const entry_key& k )const;
+         };
+
+         /// The greatest recursion depth each approval was found at
+         std::unordered_map<entry_key, int, entry_key_hash> _entries;
+   };
+
+} } // graphene::chain
@@ -19,6 +19,8 @@
 #include <graphene/chain/types.hpp>
 #include <graphene/chain/transaction.hpp>
 
+#include <graphene/utilities/thread_pools.hpp>
+
 namespace graphene { namespace chain {
 
    struct void_header{};
@@ -49,9 +51,32 @@ namespace graphene { namespace chain {
       signature_type             delegate_signature;
    };
 
+   /**
+    *  @brief Computes a transaction merkle root one leaf at a time
+    *
+    *  Nodes are hashed in pairs level by level, and the last node of a level with an odd number of nodes is carried
+    *  up to the next level unchanged. Only the roots of the complete subtrees seen so far are kept, so appending a
+    *  leaf costs O(log n) hashes and the root may be taken at any point.
+    */
+   class merkle_accumulator
+   {
+      public:
+         void          append( const digest_type& leaf );
+         checksum_type root()const;
+         uint32_t      size()const { return _size; }
+         void          clear();
+
+      private:
+         /// _subtrees[k] is the root of a complete subtree of 2^k leaves if bit k of _size is set
+         vector<digest_type> _subtrees;
+         uint32_t            _size = 0;
+   };
+
    struct signed_block : public signed_block_header
    {
       checksum_type calculate_merkle_root()const;
+      /// Hashes the transactions on the given threads. Waiting on the threads yields the current task.
+      checksum_type calculate_merkle_root( const utilities::thread_group& threads )const;
       vector<processed_transaction> transactions;
    };
 
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/chain/block.hpp>
+
+#include <deque>
+#include <fstream>
+#include <memory>
+
+namespace boost { namespace interprocess {
+   class file_mapping;
+   class mapped_region;
+} }
+
+namespace graphene { namespace chain {
+
+   /// What a light client needs to know of a block, without its transactions
+   struct block_header_summary
+   {
+      signed_block_header header;
+      uint32_t            transaction_count = 0;
+      /// Size of the packed block, as it was before any compression
+      uint32_t            size = 0;
+   };
+
+   /**
+    *  @class block_database
+    *  @brief Stores blocks in an append-only file, along with an index of fixed-width entries by block number
+    *
+    *  Each entry of the index holds the offset, size and id of the packed block stored for its number, so finding a
+    *  block by number takes a single read, and a block id is checked against the entry for the number it encodes.
+    *  Blocks are only ever appended; storing a block at or below the last number, as when switching forks, drops
+    *  every block from that number on first.  A number without a block, such as those below the head block of a
+    *  snapshot, has an empty entry.
+    *
+    *  The id of every stored block is also kept in memory by number, so that finding an id, or checking whether a
+    *  block is stored, does not read the index; this takes the size of an id per block.
+    *
+    *  A block is written before its entry, so an entry left pointing past the end of the blocks after a crash is
+    *  dropped on open.
+    *
+    *  Blocks are read from a read-only mapping of the block file, which is extended as blocks are appended, so a
+    *  packed block can be copied out without going through a stream or being unpacked.
+    *
+    *  With compression enabled, blocks which get smaller are stored compressed against a dictionary holding every
+    *  operation type, which is written with the block file when it is created so that it never changes under the
+    *  blocks compressed with it.  Compressed and uncompressed blocks can be mixed, and are read the same way.
+    *
+    *  Opened in memory, the blocks and the index are kept in buffers laid out like the files, and are lost on close.
+    *
+    *  The header summaries of the last recent_headers_kept blocks stored are also kept in memory, so the headers
+    *  most often asked for are answered without reading or decoding the blocks.
+    *
+    *  With pruning enabled, only the last blocks stored keep their bodies.  The entry of an older block keeps its id
+    *  but loses its offset and size, so the block is still known by id and number but can no longer be fetched, and
+    *  the space of the pruned blocks at the start of the block file is given back to the file system.
+    */
+   class block_database
+   {
+      public:
+         static const uint32_t recent_headers_kept = 2048;
+
+         block_database();
+         ~block_database();
+
+         void open( const fc::path& dir );
+         /** Opens an empty block database which keeps everything in memory, for tests and benchmarks */
+         void open_in_memory();
+         bool is_open()const;
+         void flush();
+         /// Flushes, then returns once the blocks and the index are on disk
+         void sync();
+         void close();
+         /// Compress the blocks stored from now on
+         void set_compression( bool enabled ) { _compress = enabled; }
+         /// Keep the bodies of only the last keep_blocks blocks, starting with the next block stored; 0 keeps them all
+         void set_pruning( uint32_t keep_blocks ) { _keep_blocks = keep_blocks; }
+         /// @return the number of the first block whose body has not been pruned
+         uint32_t pruned_below()const { return _pruned_below; }
+
+         void store( const block_id_type& id, const signed_block& b );
+         /** Removes the block with id, and every block after it */
+         void remove( const block_id_type& id );
+
+         bool                   contains( const block_id_type& id )const;
+         block_id_type          fetch_block_id( uint32_t block_num )const;
+         /// @return the ids of the blocks numbered from first_num, up to count of them, until a number without a block
+         vector<block_id_type>  fetch_block_ids( uint32_t first_num, uint32_t count )const;
+         optional<signed_block> fetch_optional( const block_id_type& id )const;
+         optional<signed_block> fetch_by_number( uint32_t block_num )const;
+         /// @return the block with the greatest number
+         optional<signed_block> last()const;
+         /**
+          * Appends the block with id to packed, serialized as it was stored, without unpacking it
+          * @return false if there is no such block
+          */
+         bool                   fetch_packed( const block_id_type& id, vector<char>& packed )const;
+         /// @return the header of the block numbered block_num, decoded without its transactions
+         optional<signed_block_header> fetch_header_by_number( uint32_t block_num )const;
+         optional<block_header_summary> fetch_header_summary_by_number( uint32_t block_num )const;
+
+      private:
+         struct index_entry
+         {
+            /// Set in size when the block is stored compressed
+            static const uint32_t compressed_flag = 0x80000000;
+
+            uint64_t       offset = 0;
+            uint32_t       size = 0;
+            block_id_type  id;
+
+            uint32_t stored_size()const { return size & ~compressed_flag; }
+            bool     compressed()const { return size & compressed_flag; }
+         };
+
+         index_entry read_entry( uint32_t block_num )const;
+         /// @return the summary of block_num if it is among the recent headers, or nullptr
+         const block_header_summary* recent_header( uint32_t block_num )const;
+         optional<signed_block> read_block( const index_entry& e )const;
+         /// @return the packed block of e, which stays valid until blocks are stored or removed
+         const char* map_block( const index_entry& e )const;
+         /**
+          * @return the packed block of e and its size, decompressed into buffer if it was stored compressed
+          */
+         std::pair<const char*,size_t> packed_block( const index_entry& e, vector<char>& buffer )const;
+         /// A packed block with one operation of each type
+         static vector<char> default_dictionary();
+         void unmap_blocks()const;
+         /** Drops the entries from block_num on, and the blocks they point to */
+         void truncate( uint32_t block_num );
+         /** Prunes the bodies of the blocks below block_num */
+         void prune( uint32_t block_num );
+         void write_entry( uint32_t block_num, const index_entry& e );
+         /// Gives the space of the pruned blocks which start the block file back to the file system
+         void release_pruned_space();
+
+         fc::path              _dir;
+         mutable std::fstream  _blocks;
+         mutable std::fstream  _index;
+         /// Number of entries in the index, including the empty entry of block 0
+         uint32_t              _entry_count = 0;
+         /// End of the last block stored
+         uint64_t              _blocks_size = 0;
+         bool                  _compress = false;
+         uint32_t              _keep_blocks = 0;
+         uint32_t              _pruned_below = 0;
+         /// The block file has been released up to here
+         uint64_t              _released_until = 0;
+         vector<char>          _dictionary;
+         /// Id of the block stored for each entry, which is empty for the empty entries
+         vector<block_id_type> _block_ids;
+         /// Summaries of the last blocks stored, by consecutive numbers ending at the last block
+         std::deque<block_header_summary> _recent_headers;
+
+         /// Whether the blocks and the index are kept in the buffers below rather than files
+         bool                  _in_memory = false;
+         vector<index_entry>   _memory_index;
+         vector<char>          _memory_blocks;
+
+         mutable std::unique_ptr<boost::interprocess::file_mapping>   _blocks_mapping;
+         mutable std::unique_ptr<boost::interprocess::mapped_region>  _blocks_region;
+   };
+
+} } // graphene::chain
+
+FC_REFLECT( graphene::chain::block_header_summary, (header)(transaction_count)(size) )
@@ -17,6 +17,7 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <graphene/db/flat_index.hpp>
 
 namespace graphene { namespace chain {
    using namespace graphene::db;
@@ -29,6 +30,12 @@ namespace graphene { namespace chain {
     *  lookup a past block and check its block hash and the time it occurred
     *  so we can calculate whether the current transaction is valid and at
     *  what time it should expire.
+    *
+    *  Transactions only carry the lower 16 bits of the number of their reference
+    *  block, so only the last GRAPHENE_BLOCK_SUMMARY_COUNT blocks can be referenced.
+    *  The summaries form a ring: the summary of a block has the lower 16 bits of
+    *  the block number as its instance, and is overwritten by the summary of the
+    *  block GRAPHENE_BLOCK_SUMMARY_COUNT blocks later.
     */
    class block_summary_object : public abstract_object<block_summary_object>
    {
@@ -42,4 +49,7 @@ namespace graphene { namespace chain {
 
 } }
 
+GRAPHENE_DB_OBJECT_INDEX( graphene::chain::block_summary_object,
+                          graphene::db::flat_index<graphene::chain::block_summary_object> )
+
 FC_REFLECT_DERIVED( graphene::chain::block_summary_object, (graphene::db::object), (block_id) )
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/chain/types.hpp>
+
+#include <chrono>
+
+namespace graphene { namespace chain {
+
+   /**
+    * How long each phase of applying one block took, in nanoseconds, see @ref database::get_block_timings
+    *
+    * A block built by this node has its transactions applied as they are pushed, so its transactions phase is 0.
+    */
+   struct block_timing
+   {
+      uint32_t         block_num = 0;
+      uint32_t         transactions = 0;
+      uint64_t         transactions_ns = 0;
+      uint64_t         match_markets_ns = 0;
+      uint64_t         witness_schedule_ns = 0;
+      uint64_t         global_dynamic_data_ns = 0;
+      uint64_t         signing_witness_ns = 0;       ///< including the last irreversible block
+      uint64_t         maintenance_ns = 0;
+      uint64_t         block_summary_ns = 0;
+      uint64_t         clear_expired_ns = 0;         ///< of transactions, proposals and orders
+      uint64_t         expired_feeds_ns = 0;
+      uint64_t         withdraw_permissions_ns = 0;
+      uint64_t         applied_block_ns = 0;
+      uint64_t         changed_objects_ns = 0;
+      uint64_t         flush_ns = 0;                 ///< writing checkpoints or flushing the state
+      uint64_t         pending_block_ns = 0;
+      uint64_t         total_ns = 0;
+      /// The time taken by each applied_block observer, in the order they were connected
+      vector<uint64_t> applied_block_observers_ns;
+      /// The time taken by each changed_objects observer, in the order they were connected
+      vector<uint64_t> changed_objects_observers_ns;
+   };
+
+   /**
+    * A signals2 combiner which calls every slot in turn, recording in times how long each one took when it is set
+    */
+   struct timed_slots
+   {
+      typedef void result_type;
+
+      timed_slots( vector<uint64_t>* t = nullptr ):times(t){}
+
+      template<typename InputIterator>
+      void operator()( InputIterator first, InputIterator last )const
+      {
+         if( times == nullptr )
+         {
+            for( ; first != last; ++first )
+               *first;
+            return;
+         }
+         times->clear();
+         for( ; first != last; ++first )
+         {
+            auto start = std::chrono::steady_clock::now();
+            *first;
+            times->push_back( std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now() - start ).count() );
+         }
+      }
+
+      vector<uint64_t>* times;
+   };
+
+} } // graphene::chain
+
+FC_REFLECT( graphene::chain::block_timing,
+            (block_num)(transactions)(transactions_ns)(match_markets_ns)(witness_schedule_ns)
+            (global_dynamic_data_ns)(signing_witness_ns)(maintenance_ns)(block_summary_ns)(clear_expired_ns)
+            (expired_feeds_ns)(withdraw_permissions_ns)(applied_block_ns)(changed_objects_ns)(flush_ns)
+            (pending_block_ns)(total_ns)(applied_block_observers_ns)(changed_objects_observers_ns) )
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/chain/block.hpp>
+
+#include <functional>
+
+namespace graphene { namespace chain {
+
+   /**
+    *  @class signed_block_view
+    *  @brief Reads a packed signed_block in place, decoding only its header
+    *
+    *  A packed block starts with its packed signed_block_header, followed by the number of transactions, so the
+    *  header is decoded on construction and the id and digest are hashed straight from the packed bytes, without
+    *  packing the header again. Transactions are decoded only when asked for, one at a time; as operations are
+    *  packed without their size, reaching a transaction decodes the ones before it.
+    *
+    *  The view does not copy the packed block, which must outlive it.
+    */
+   class signed_block_view
+   {
+      public:
+         signed_block_view( const char* data, size_t size );
+         explicit signed_block_view( const vector<char>& packed );
+
+         const signed_block_header& header()const { return _header; }
+         uint32_t                   block_num()const { return _header.block_num(); }
+         block_id_type              id()const;
+         digest_type                digest()const;
+         fc::ecc::public_key        signee()const;
+         uint32_t                   transaction_count()const { return _transaction_count; }
+
+         /**
+          * Decodes the transactions in order, passing each one with its packed bytes; the transaction passed is
+          * reused for the next one
+          */
+         void for_each_transaction( const std::function<void(const processed_transaction&, const char*, size_t)>& f )const;
+         /// Hashes each packed transaction where it lies, rather than packing it again
+         checksum_type calculate_merkle_root()const;
+         signed_block  unpack()const;
+
+      private:
+         const char*          _data;
+         size_t               _size;
+         /// Size of the packed header, which the transaction count follows
+         size_t               _header_size;
+         /// Where the first transaction starts
+         size_t               _transactions_offset;
+         uint32_t             _transaction_count;
+         signed_block_header  _header;
+   };
+
+} } // graphene::chain
@@ -22,6 +22,8 @@
 #include <graphene/chain/asset.hpp>
 #include <graphene/db/generic_index.hpp>
 
+#include <boost/multi_index/composite_key.hpp>
+
 namespace graphene { namespace chain {
 
   /**
@@ -60,6 +62,11 @@ namespace graphene { namespace chain {
         static const uint8_t type_id  = bond_offer_object_type;
 
         asset_id_type asset_type()const { return amount.asset_id; }
+        share_type    amount_offered()const { return amount.amount; }
+        /** Lower is better for the other side: the lowest rate for a borrower taking an offer to lend, and the
+         * highest rate for a lender taking an offer to borrow
+         */
+        int32_t       rate_rank()const { return offer_to_borrow ? -int32_t(interest_apr) : int32_t(interest_apr); }
 
         account_id_type offered_by_account;
         bool            offer_to_borrow = false; // Offer to borrow if true, and offer to lend otherwise
@@ -76,6 +83,7 @@ namespace graphene { namespace chain {
   struct by_offerer;
   struct by_collateral; /// needed for blackswan resolution
   struct by_asset; /// needed for blackswan resolution
+  struct by_best_rate;
 
   typedef multi_index_container<
      bond_object,
@@ -90,7 +98,9 @@ namespace graphene { namespace chain {
   typedef generic_index<bond_object, bond_object_multi_index_type> bond_index;
 
   /**
-   *  Todo: consider adding index of tuple<collateral_type,loan_asset_type,interest_rate>
+   *  by_best_rate orders the offers of each asset by side, offers to lend first, then best rate first and the largest
+   *  amount first at the same rate, so the best offers on either side are found without scanning the others.
+   *
    *  Todo: consider adding index of tuple<collateral_type,loan_asset_type,period>
    */
   typedef multi_index_container<
@@ -98,7 +108,23 @@ namespace graphene { namespace chain {
      indexed_by<
         hashed_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
         ordered_non_unique< tag<by_offerer>, member<bond_offer_object, account_id_type, &bond_offer_object::offered_by_account> >,
-        hashed_non_unique< tag<by_asset>, const_mem_fun<bond_offer_object, asset_id_type, &bond_offer_object::asset_type> >
+        hashed_non_unique< tag<by_asset>, const_mem_fun<bond_offer_object, asset_id_type, &bond_offer_object::asset_type> >,
+        ordered_unique< tag<by_best_rate>,
+           composite_key< bond_offer_object,
+              const_mem_fun<bond_offer_object, asset_id_type, &bond_offer_object::asset_type>,
+              member<bond_offer_object, bool, &bond_offer_object::offer_to_borrow>,
+              const_mem_fun<bond_offer_object, int32_t, &bond_offer_object::rate_rank>,
+              const_mem_fun<bond_offer_object, share_type, &bond_offer_object::amount_offered>,
+              member< object, object_id_type, &object::id >
+           >,
+           composite_key_compare<
+              std::less<asset_id_type>,
+              std::less<bool>,
+              std::less<int32_t>,
+              std::greater<share_type>,
+              std::less<object_id_type>
+           >
+        >
      >
   > bond_offer_object_multi_index_type;
 
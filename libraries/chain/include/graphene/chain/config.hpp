@@ -39,6 +39,7 @@
 #define GRAPHENE_DEFAULT_MAX_TIME_UNTIL_EXPIRATION (60*60*24) // seconds,  aka: 1 day
 #define GRAPHENE_DEFAULT_MAINTENANCE_INTERVAL  (60*60*24) // seconds, aka: 1 day
 #define GRAPHENE_DEFAULT_MAX_UNDO_HISTORY 1024
+#define GRAPHENE_BLOCK_SUMMARY_COUNT 0x10000 ///< one for every value of transaction::ref_block_num
 
 #define GRAPHENE_MIN_BLOCK_SIZE_LIMIT (GRAPHENE_MIN_TRANSACTION_SIZE_LIMIT*5) // 5 transactions per block
 #define GRAPHENE_MIN_TRANSACTION_EXPIRATION_LIMIT (GRAPHENE_MAX_BLOCK_INTERVAL * 5) // 5 transactions per block
@@ -49,6 +50,8 @@
 #define GRAPHENE_DEFAULT_TRANSFER_FEE                           (1*GRAPHENE_BLOCKCHAIN_PRECISION)
 #define GRAPHENE_MAX_INSTANCE_ID                                (uint64_t(-1)>>16)
 #define GRAPHENE_100_PERCENT                                    10000
+/** A block is irreversible once this share of the active witnesses has built on it */
+#define GRAPHENE_IRREVERSIBLE_THRESHOLD                         (70 * GRAPHENE_100_PERCENT / 100)
 /** NOTE: making this a power of 2 (say 2^15) would greatly accelerate fee calcs */
 #define GRAPHENE_MAX_MARKET_FEE_PERCENT                         GRAPHENE_100_PERCENT
 #define GRAPHENE_DEFAULT_FORCE_SETTLEMENT_DELAY                 (60*60*24) ///< 1 day
@@ -109,6 +112,15 @@
 #define GRAPHENE_DEFAULT_WITNESS_PAY_PER_BLOCK            (GRAPHENE_BLOCKCHAIN_PRECISION * int64_t( 10) )
 #define GRAPHENE_DEFAULT_WORKER_BUDGET_PER_DAY            (GRAPHENE_BLOCKCHAIN_PRECISION * int64_t(500) * 1000 )
 
+/**
+ * Number of recovered signature addresses kept by each database, see @ref signature_cache
+ */
+#define GRAPHENE_DEFAULT_SIGNATURE_CACHE_SIZE                (1024*64)
+/**
+ * Number of applied blocks whose phase timings are kept by each database, see @ref block_timing
+ */
+#define GRAPHENE_DEFAULT_BLOCK_TIMING_HISTORY                128
+
 #define GRAPHENE_MAX_INTEREST_APR                            uint16_t( 10000 )
 #define GRAPHENE_LEGACY_NAME_IMPORT_PERIOD                   3000000 /** 3 million blocks */
 
@@ -18,10 +18,22 @@
 #pragma once
 #include <graphene/chain/evaluator.hpp>
 #include <graphene/chain/block.hpp>
+#include <graphene/chain/block_database.hpp>
+#include <graphene/chain/block_timing.hpp>
+#include <graphene/chain/account_object.hpp>
 #include <graphene/chain/asset.hpp>
 #include <graphene/chain/global_property_object.hpp>
 #include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/fork_database.hpp>
+#include <graphene/chain/key_object.hpp>
+#include <graphene/chain/pending_transaction_pool.hpp>
+#include <graphene/chain/signature_batch.hpp>
+#include <graphene/chain/transaction_conflicts.hpp>
+#include <graphene/chain/transaction_evaluation_state.hpp>
+#include <graphene/chain/vote_table.hpp>
+#include <graphene/chain/witness_schedule_object.hpp>
+#include <graphene/chain/margin_call_tracker.hpp>
+#include <graphene/chain/market_order_book.hpp>
 
 #include <graphene/db/object_database.hpp>
 #include <graphene/db/object.hpp>
@@ -29,10 +41,13 @@
 #include <graphene/db/level_pod_map.hpp>
 #include <graphene/db/simple_index.hpp>
 #include <fc/signals.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <fc/log/logger.hpp>
 
+#include <deque>
 #include <map>
+#include <unordered_map>
 
 namespace graphene { namespace chain {
    using graphene::db::abstract_object;
@@ -85,6 +100,206 @@ namespace graphene { namespace chain {
          void wipe(const fc::path& data_dir, bool include_blocks);
          void close(uint32_t blocks_to_rewind = 0);
 
+         /**
+          * @brief Write the state as of the head block, along with the head block itself, to a snapshot file
+          *
+          * Pending transactions are left out of the snapshot, and pushed again once it is written.
+          */
+         void snapshot( const fc::path& file );
+         /**
+          * @brief Open a new database in data_dir with the state of a snapshot file
+          *
+          * Anything in data_dir is wiped, including the blocks.  The database only holds the head block of the
+          * snapshot afterwards, so earlier blocks must be fetched from peers.
+          */
+         void open_from_snapshot( const fc::path& file, const fc::path& data_dir );
+
+         /**
+          * @brief Open the database without any storage on disk, for tests and benchmarks
+          *
+          * The chain state and the blocks are kept in memory only, and are lost when the database is closed.  The
+          * genesis state is created if there is no state yet.
+          */
+         void open_in_memory( const genesis_allocation& initial_allocation = genesis_allocation() );
+         /** Like @ref open_from_snapshot, into a database opened in memory */
+         void open_in_memory_from_snapshot( const fc::path& file );
+         /**
+          * @brief Replace the state of a database which has applied no blocks with the state of a snapshot file
+          *
+          * Lets a node opened from genesis bootstrap from a snapshot it received, as by @ref open_from_snapshot.
+          * The objects are removed through the indexes, so their observers see the old state go.
+          */
+         void reset_to_snapshot( const fc::path& file, const fc::path& data_dir );
+
+         /**
+          * @brief Set the number of worker threads used to recover transaction signatures in incoming blocks
+          *
+          * When this is zero (the default), signatures are recovered serially on the calling thread while the block
+          * is applied.
+          */
+         void set_signature_thread_count( uint32_t thread_count );
+         /** Like @ref set_signature_thread_count, using threads which belong to a pool shared with others */
+         void set_signature_threads( const utilities::thread_group& threads );
+         uint32_t get_signature_thread_count()const { return _signature_threads.size(); }
+
+         /**
+          * @brief Set the maximum number of recovered signatures remembered between transaction and block checks
+          */
+         void set_signature_cache_size( uint32_t max_size ) { _signature_cache.set_max_size( max_size ); }
+         signature_cache_stats get_signature_cache_stats()const { return _signature_cache.get_stats(); }
+
+         /**
+          * @brief Bound the memory held by the undo history, in addition to its maximum_undo_history depth
+          *
+          * Once the undo history holds more than max_bytes, the oldest states are dropped.  0 means no bound.
+          */
+         void set_undo_history_max_bytes( uint64_t max_bytes ) { _undo_db.set_max_bytes( max_bytes ); }
+         undo_stats get_undo_stats()const { return _undo_db.get_stats(); }
+         /// The number of objects saved to the undo history so far
+         uint64_t get_undo_saved_objects()const { return _undo_db.saved_objects(); }
+         /// The number of blocks held by the fork database, including those of forks not switched to
+         size_t get_fork_db_size()const { return _fork_db.size(); }
+
+         /**
+          * @brief Keep the phase timings of the last history_size applied blocks; 0 stops timing them
+          */
+         void set_block_timing_history( size_t history_size );
+         /// The phase timings of the most recently applied blocks, the oldest first
+         const std::deque<block_timing>& get_block_timings()const { return _block_timings; }
+
+         /**
+          * @brief Track the objects written by each transaction of the applied blocks, to count those which write an
+          * object an earlier transaction of their block wrote
+          *
+          * Each transaction is applied in an undo session of its own while this is on, so it has a cost.  Nothing is
+          * tracked while the undo history is disabled, as during a replay.
+          */
+         void set_transaction_conflict_tracking( bool enabled ) { _track_transaction_conflicts = enabled; }
+         const transaction_conflict_stats& get_transaction_conflict_stats()const { return _transaction_conflict_stats; }
+
+         /**
+          * The footprint of trx, from its operations and the current state.  The state is used to narrow the
+          * footprint of fees, of transfers to existing balances and, when refine_orders is set, of orders in markets
+          * matched in batches.
+          */
+         operation_footprint get_transaction_footprint( const transaction& trx, bool refine_orders = true )const;
+         /// Schedules the transactions of block from their footprints in the current state, see schedule_transactions
+         vector<transaction_stage> schedule_block_transactions( const signed_block& block )const;
+
+         /**
+          * @brief Time one in every sample_interval evaluations of each operation type; 0 times none
+          *
+          * Evaluations are counted whether or not they are timed.
+          */
+         void set_evaluator_sample_interval( uint32_t sample_interval ) { _evaluator_sample_interval = sample_interval; }
+         uint32_t get_evaluator_sample_interval()const { return _evaluator_sample_interval; }
+         /// Indexed by operation tag
+         const vector<evaluator_stats>& get_evaluator_stats()const { return _evaluator_stats; }
+         void reset_evaluator_stats();
+         /// Counts an evaluation of the operation with tag; returns its stats when the evaluation should be timed
+         evaluator_stats* count_evaluation( int tag )
+         {
+            evaluator_stats& stats = _evaluator_stats[tag];
+            ++stats.calls;
+            if( _evaluator_sample_interval == 0 || stats.calls % _evaluator_sample_interval != 0 )
+               return nullptr;
+            return &stats;
+         }
+
+         /**
+          * @brief Add known block ids which pushed blocks must match
+          *
+          * Blocks at or below the last checkpoint are linked to it by their ids, so their transaction signatures and
+          * authorities are not checked.  A block whose number has a checkpoint is rejected unless its id matches.
+          */
+         void add_block_checkpoints( const flat_map<uint32_t,block_id_type>& checkpoints );
+         const flat_map<uint32_t,block_id_type>& get_block_checkpoints()const { return _block_checkpoints; }
+         /// True when there is a checkpoint at or above block_num
+         bool before_last_block_checkpoint( uint32_t block_num )const
+         {
+            return !_block_checkpoints.empty() && block_num <= _block_checkpoints.rbegin()->first;
+         }
+
+         /// Compress the blocks stored in the block database from now on, when it makes them smaller
+         void set_block_compression( bool enabled ) { _block_id_to_block.set_compression( enabled ); }
+         /**
+          * @brief Keep the bodies of only the last keep_blocks blocks in the block database, 0 keeping them all
+          *
+          * Older blocks stay known by id and number, but can no longer be fetched, so they are not served to peers
+          * and the state can not be reindexed.  At least the undo history must be kept, so that any block which may
+          * still be popped can be.
+          */
+         void set_block_pruning( uint32_t keep_blocks );
+
+         /**
+          * @brief Keep a hash of the chain state, brought up to date as each block is applied
+          *
+          * The hash covers the protocol and implementation objects, not those of the plugins, so two nodes which
+          * agree on the chain state agree on it whatever their plugins.  Hashing what changes makes each block
+          * cost more to apply, so it is off unless enabled, which should be done between blocks.
+          */
+         void enable_state_hash();
+         bool state_hash_enabled()const { return get_state_hash_object() != nullptr; }
+         /// The hash of the state as of the head block; the state must be hashed
+         fc::sha256 get_state_hash()const;
+         /// The hash of the state as of block_num, if it is one of the recently applied blocks and was hashed
+         optional<fc::sha256> get_state_hash_at( uint32_t block_num )const;
+
+         /**
+          * @brief Trust the blocks already in the block database when they are replayed
+          *
+          * Replayed blocks are always checked against their merkle roots.  When trusted (the default), the
+          * transaction signatures and authorities are not checked again.
+          */
+         void set_trusted_replay( bool trusted ) { _trusted_replay = trusted; }
+
+         /**
+          * @brief Write the objects changed since the last flush to disk every flush_interval blocks
+          *
+          * 0 means the state is only written when the database is closed.
+          */
+         void set_flush_interval( uint32_t flush_interval ) { _flush_interval = flush_interval; }
+         /**
+          * @brief Capture the objects changed since the last checkpoint every checkpoint_interval blocks
+          *
+          * A checkpoint is written to disk on a background thread once its block can no longer be undone, so the state
+          * on disk always matches a block in the block database.  After a crash, open resumes from the last written
+          * checkpoint and applies the blocks after it.  When set, this replaces the flush interval.  0 disables
+          * checkpoints.
+          */
+         void set_checkpoint_interval( uint32_t checkpoint_interval ) { _checkpoint_interval = checkpoint_interval; }
+         /**
+          * @brief Make the stored blocks and state durable as a group, every sync_blocks blocks or sync_milliseconds
+          * milliseconds, whichever comes first
+          *
+          * Each sync writes the block database to disk, then writes the checkpoints which have become irreversible
+          * since the last sync, or the flushed state, in batches which are only done once on disk.  Between syncs,
+          * checkpoints wait to be written with the next one, so a crash loses at most the blocks and state of one
+          * group, and open resumes from the last checkpoint synced.  0 for both leaves writes to the operating system,
+          * as before.
+          */
+         void set_sync_interval( uint32_t sync_blocks, uint32_t sync_milliseconds )
+         {
+            _sync_blocks = sync_blocks;
+            _sync_milliseconds = sync_milliseconds;
+         }
+
+         /**
+          * @brief Verify all signatures of an incoming block, including the witness signature, as a single batch
+          *
+          * If any signature in the batch fails, the block falls back to having its signatures checked one at a time
+          * to report which one is bad.
+          */
+         void set_batch_signature_verification( bool enabled ) { _batch_signature_verification = enabled; }
+         bool get_batch_signature_verification()const { return _batch_signature_verification; }
+
+         /**
+          * @brief Stop sharing authority approvals between the remaining transactions of the block being applied
+          *
+          * Must be called whenever an account authority changes.
+          */
+         void invalidate_authority_cache();
+
          //////////////////// db_block.cpp ////////////////////
 
          /**
@@ -94,12 +309,49 @@ namespace graphene { namespace chain {
          bool                       is_known_block( const block_id_type& id )const;
          bool                       is_known_transaction( const transaction_id_type& id )const;
          block_id_type              get_block_id_for_num( uint32_t block_num )const;
+         /// @return the ids of up to count blocks numbered from first_num, stopping at the first which is not stored
+         vector<block_id_type>      get_block_ids_for_nums( uint32_t first_num, uint32_t count )const;
          optional<signed_block>     fetch_block_by_id( const block_id_type& id )const;
          optional<signed_block>     fetch_block_by_number( uint32_t num )const;
-         const signed_transaction&  get_recent_transaction( const transaction_id_type& trx_id )const;
+         /// Like fetch_block_by_id and fetch_block_by_number, but a stored block has only its header decoded
+         optional<signed_block_header> fetch_block_header_by_id( const block_id_type& id )const;
+         optional<signed_block_header> fetch_block_header_by_number( uint32_t num )const;
+         /// @return the header summaries of the stored blocks numbered from first_num, up to count of them, until a
+         /// number without a block
+         vector<block_header_summary> fetch_block_header_summaries( uint32_t first_num, uint32_t count )const;
+         /**
+          * Appends the block with id to packed, serialized, straight from the block store without unpacking it
+          * @return false if the block is not stored, as for blocks only known to the fork database
+          */
+         bool                       fetch_packed_block_by_id( const block_id_type& id, vector<char>& packed )const;
+         /**
+          * A transaction which is pending or in a block that is still deduplicated against.  Only the id of those
+          * in blocks is kept in memory, so they are read back from their block.
+          */
+         signed_transaction         get_recent_transaction( const transaction_id_type& trx_id )const;
 
          bool push_block( const signed_block& b, uint32_t skip = skip_nothing );
+         /**
+          * @brief Push a run of blocks, as push_block() would one at a time, restoring the pending transactions once
+          *
+          * When the first block builds on the head block, each of the others on the one before it, and no longer fork
+          * is known, there is no fork to switch to, so the blocks are applied as with skip_fork_db.  Only those within the
+          * size of the fork database from the last one are recorded in it, as the others would be pruned from it anyway.
+          *
+          * @return the number of blocks pushed, which stops at the first block which fails
+          */
+         uint32_t push_blocks( const vector<const signed_block*>& blocks, uint32_t skip = skip_nothing );
          processed_transaction push_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing );
+         /**
+          * @brief Cheaply reject a transaction before it is pushed, doing the expensive checks on a signature thread
+          *
+          * Checks the transaction's structure, size, expiration and signatures against a snapshot of the current state.
+          * Passing says nothing about whether push_transaction will accept it, but the recovered signatures are cached
+          * for it. Does nothing if there are no signature threads. Waiting on the thread yields the current task.
+          *
+          * @throws fc::exception if the transaction can not possibly be pushed
+          */
+         void precheck_transaction( const signed_transaction& trx );
          ///@throws fc::exception if the proposed transaction fails to apply.
          processed_transaction push_proposal( const proposal_object& proposal );
 
@@ -109,9 +361,54 @@ namespace graphene { namespace chain {
             const fc::ecc::private_key& block_signing_private_key,
             uint32_t skip = 0
             );
+         /**
+          * @brief Assembles and signs a block of the pending transactions, without applying it
+          *
+          * This is the first half of generate_block, so that a witness can prepare its block ahead of its slot. The
+          * block is stamped with @p when, and can be pushed by push_generated_block for as long as the head block
+          * does not change.
+          */
+         signed_block build_block(
+            const fc::time_point_sec when,
+            witness_id_type witness_id,
+            const fc::ecc::private_key& block_signing_private_key,
+            uint32_t skip = 0
+            );
+         /// True if @p block is made of exactly the transactions pending now, on the head block and at its time
+         bool is_pending_block( const signed_block& block )const;
+         /**
+          * Applies a block made by build_block on the current head; transactions pushed since stay pending. If none
+          * were, the changes of the pending transactions are kept as those of the block rather than applied again.
+          */
+         void push_generated_block( const signed_block& block, uint32_t skip = 0 );
 
          void pop_block();
+         /// Drops the pending block along with every pending transaction
          void clear_pending();
+         /**
+          * Calls f on the state of the head block, with the pending transactions set aside and applied again
+          * afterwards, so what f changes stays with the head block rather than being undone along with them
+          */
+         template<typename Function>
+         void without_pending_transactions( Function&& f )
+         {
+            reset_pending_block();
+            try {
+               f();
+            } catch( ... ) {
+               restore_pending_transactions();
+               throw;
+            }
+            restore_pending_transactions();
+         }
+         const pending_transaction_pool& get_pending_transactions()const { return _pending_transactions; }
+         /**
+          * @brief Choose the transactions of generated blocks by the fee they pay per byte, rather than by arrival
+          *
+          * Every account paying fees gets one transaction into the block before any gets a second, and the
+          * transactions of one account keep their order of arrival.
+          */
+         void set_prioritize_transactions_by_fee( bool enabled ) { _prioritize_transactions_by_fee = enabled; }
 
          /**
           *  This method is used to track appied operations during the evaluation of a block, these
@@ -126,6 +423,16 @@ namespace graphene { namespace chain {
          void      set_applied_operation_result( uint32_t op_id, const operation_result& r );
          const vector<operation_history_object>& get_applied_operations()const;
 
+         /**
+          *  Operations are only captured while something reads get_applied_operations(). Each consumer, such as a
+          *  history plugin or a market subscription, registers itself while it needs them; with none registered
+          *  push_applied_operation() copies nothing and returns untracked_operation.
+          */
+         void      add_applied_operations_consumer();
+         void      remove_applied_operations_consumer();
+         bool      applied_operations_tracked()const { return _applied_operations_consumers > 0; }
+         static const uint32_t untracked_operation = uint32_t(-1);
+
          /**
           *  This signal is emitted after all operations and virtual operation for a
           *  block have been applied but before the get_applied_operations() are cleared.
@@ -134,13 +441,19 @@ namespace graphene { namespace chain {
           *  the write lock and may be in an "inconstant state" until after it is
           *  released.
           */
-         fc::signal<void(const signed_block&)>           applied_block;
+         boost::signals2::signal<void(const signed_block&), timed_slots> applied_block;
 
          /**
           *  After a block has been applied and committed.  The callback
           *  should not yield and should execute quickly.
           */
-         fc::signal<void(const vector<object_id_type>&)> changed_objects;
+         boost::signals2::signal<void(const vector<object_id_type>&), timed_slots> changed_objects;
+
+         /**
+          *  Emitted along with changed_objects, with the ids of every object the block created,
+          *  modified or removed, for observers which keep a copy of the state.
+          */
+         fc::signal<void(const vector<object_id_type>&)> affected_objects;
 
          //////////////////// db_witness_schedule.cpp ////////////////////
 
@@ -200,11 +513,20 @@ namespace graphene { namespace chain {
 
          decltype( chain_parameters::block_interval ) block_interval( )const;
 
+         /// The names of all accounts, in order
+         const account_name_table& get_account_name_table()const { return *_account_names; }
+
          //////////////////// db_init.cpp ////////////////////
 
          void initialize_evaluators();
          /// Reset the object graph in-memory
          void initialize_indexes();
+         /// Sets up everything which depends on the head block once the state has been opened
+         void open_head_block();
+         /// Opens the block store, importing the blocks of the level_map it replaced
+         void open_block_database( const fc::path& data_dir );
+         /// Applies the blocks after the head block of the state
+         void replay_blocks();
          void init_genesis(const genesis_allocation& initial_allocation = genesis_allocation());
 
          template<typename EvaluatorType>
@@ -252,8 +574,26 @@ namespace graphene { namespace chain {
           */
          void adjust_core_in_orders( const account_object& acnt, asset delta );
 
-         // helper to handle cashback rewards
+         /**
+          * Credits cashback to the vesting balance of an account.  While the transactions of a block are applied, a
+          * deposit into an existing vesting balance is deferred until flush_deferred_fees like the other fees.  All of
+          * them are made at the head block time, so folding them into one deposit earns the same coin seconds.
+          */
          void deposit_cashback( const account_object& acct, share_type amount );
+         /// Deposits the cashback deferred for vbo, before it is withdrawn from
+         void apply_deferred_cashback( const vesting_balance_object& vbo );
+
+         /**
+          * Adds amount to the accumulated fees of an asset. While the transactions of a block are applied, this is
+          * deferred until flush_deferred_fees.
+          */
+         void add_accumulated_fees( const asset_dynamic_data_object& dyn_data, share_type amount );
+         /// Adds amount to the lifetime fees paid by an account, deferred like add_accumulated_fees
+         void add_lifetime_fees_paid( const account_statistics_object& stats, share_type amount );
+         /// The lifetime fees paid by an account, including the deferred ones
+         share_type get_lifetime_fees_paid( const account_statistics_object& stats )const;
+         /// Applies the fees deferred since the last call to their objects
+         void flush_deferred_fees();
 
          //////////////////// db_debug.cpp ////////////////////
 
@@ -262,9 +602,15 @@ namespace graphene { namespace chain {
          //////////////////// db_market.cpp ////////////////////
 
          /// @{ @group Market Helpers
+         /// The open limit orders of every market, best price first
+         const market_order_book<limit_order_object>& get_limit_order_book()const { return *_limit_book; }
+         const market_order_book<short_order_object>& get_short_order_book()const { return *_short_book; }
+
          void globally_settle_asset( const asset_object& bitasset, const price& settle_price );
          void cancel_order(const force_settlement_object& order, bool create_virtual_op = true);
          void cancel_order(const limit_order_object& order, bool create_virtual_op = true);
+         /// Refunds the collateral of the short order and removes it
+         void cancel_order(const short_order_object& order);
 
          /**
           * Matches the two orders,
@@ -296,8 +642,20 @@ namespace graphene { namespace chain {
          bool fill_order( const call_order_object& order, const asset& pays, const asset& receives );
          bool fill_order( const force_settlement_object& settle, const asset& pays, const asset& receives );
 
+         /**
+          * Calls every call order of mia which the best orders selling it for its backing asset can cover.  Returns
+          * at once when nothing changed since the last check found nothing to call.
+          */
          bool check_call_orders( const asset_object& mia );
 
+         /// Leaves the limit orders of the market between a and b to match_batched_markets
+         void defer_matching( asset_id_type a, asset_id_type b );
+         /**
+          * Crosses the limit orders of every market which was passed to defer_matching since the last call, each
+          * pair at the price of the older order as if the newer one had been matched on arrival
+          */
+         void match_batched_markets();
+
          // helpers to fill_order
          void pay_order( const account_object& receiver, const asset& receives, const asset& pays );
 
@@ -317,26 +675,91 @@ namespace graphene { namespace chain {
       private:
          optional<undo_database::session>       _pending_block_session;
          vector< unique_ptr<op_evaluator> >     _operation_evaluators;
+         /// Reused by evaluate_transaction for every transaction, so that its containers keep their storage
+         transaction_evaluation_state           _trx_eval_state;
+         vector< evaluator_stats >              _evaluator_stats;
+         uint32_t                               _evaluator_sample_interval = 0;
+
+         /// the state hash after each of the last state_hashes_kept applied blocks, by block number
+         std::deque<std::pair<uint32_t, fc::sha256>> _state_hashes;
+         static const size_t                    state_hashes_kept = 1024;
+         void record_state_hash( uint32_t block_num );
+
+         std::deque<block_timing>               _block_timings;
+         size_t                                 _block_timing_history = 0;
+         vector<uint64_t>                       _applied_block_observers_ns;
+         vector<uint64_t>                       _changed_objects_observers_ns;
 
          template<class ObjectType>
          vector<std::reference_wrapper<const ObjectType>> sort_votable_objects(size_t count)const;
 
          //////////////////// db_block.cpp ////////////////////
 
-         void                  apply_block( const signed_block& next_block, uint32_t skip = skip_nothing );
-         processed_transaction apply_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing );
+         void                  apply_block( const signed_block& next_block, uint32_t skip = skip_nothing,
+                                            const recovered_block_signatures* recovered = nullptr );
+         processed_transaction apply_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing,
+                                                  const recovered_signatures* recovered = nullptr );
+         /**
+          * Applies trx as apply_transaction does, without copying it into a processed_transaction
+          * @return the results of the operations, valid until the next transaction is evaluated
+          */
+         const vector<operation_result>& evaluate_transaction( const signed_transaction& trx, uint32_t skip,
+                                                               const recovered_signatures* recovered = nullptr );
          operation_result      apply_operation( transaction_evaluation_state& eval_state, const operation& op );
+         /// Applies a block of exactly the pending transactions, whose changes are already in the head undo session
+         void                  apply_pending_block( const signed_block& next_block, uint32_t skip );
 
          ///Steps involved in applying a new block
          ///@{
 
-         const witness_object& validate_block_header( uint32_t skip, const signed_block& next_block )const;
+         /**
+          *  Runs the cheap checks on every transaction of next_block against the head block state, so
+          *  an invalid block is rejected before any of it is applied.  Only rejects blocks which
+          *  apply_block would reject.
+          */
+         void precheck_block( const signed_block& next_block, uint32_t skip, const recovered_block_signatures* recovered );
+         const witness_object& validate_block_header( uint32_t skip, const signed_block& next_block,
+                                                      const optional<address>& signee = optional<address>() )const;
+         /// Everything apply_block does after the transactions of the block
+         /// Counts the transaction which made changes in the conflict stats, and remembers the objects it wrote
+         void record_transaction_writes( const undo_changes& changes );
+         void apply_block_updates( const signed_block& next_block, const witness_object& signing_witness,
+                                   uint64_t transactions_ns = 0 );
          void create_block_summary(const signed_block& next_block);
+         /// Writes the captured checkpoints whose blocks are out of reach of the undo history
+         void write_irreversible_checkpoints( bool sync = false );
+         bool sync_enabled()const { return _sync_blocks || _sync_milliseconds; }
+         /// Counts the block just applied toward the sync interval, @return true if a sync is due with it
+         bool sync_due();
+
+         /**
+          *  Recovers the signing addresses of next_block ahead of applying it, either as a single
+          *  batch or per transaction on the signature worker threads.  This must be called before
+          *  any state is modified because it waits on the workers, which yields the current task.
+          *
+          *  @return nothing if the signatures should be recovered while the block is applied
+          */
+         optional<recovered_block_signatures> recover_block_signatures( const signed_block& next_block, uint32_t skip );
+         optional<recovered_block_signatures> verify_block_signature_batch( const signed_block& next_block, uint32_t skip );
+         /// The TaPoS reference block of each transaction in next_block, if it is known
+         vector<optional<block_id_type>> resolve_reference_blocks( const signed_block& next_block )const;
+         void check_transaction_signatures( const signed_transaction& trx, const digest_type& digest,
+                                            const recovered_signatures* recovered );
 
          //////////////////// db_update.cpp ////////////////////
          void update_global_dynamic_data( const signed_block& b );
          void update_signing_witness(const witness_object& signing_witness, const signed_block& new_block);
+         /// Advances the last irreversible block, and drops the undo states and forks below it
+         void update_last_irreversible_block();
          void update_pending_block(const signed_block& next_block, uint8_t current_block_interval);
+         /// The packed size of _pending_block, without packing its transactions again
+         uint64_t pending_block_size()const;
+         /// Drops the pending block and its state, but keeps the pending transactions to be restored
+         void reset_pending_block();
+         /// Applies the pending transactions which are neither included in a block nor expired on the new head
+         void restore_pending_transactions();
+         /// Rebuilds the pending block from the pending transactions, taking those paying the most per byte first
+         void select_pending_transactions_by_fee();
          void clear_expired_transactions();
          void clear_expired_proposals();
          void clear_expired_orders();
@@ -344,7 +767,7 @@ namespace graphene { namespace chain {
          void update_withdraw_permissions();
 
          //////////////////// db_witness_schedule.cpp ////////////////////
-         void update_witness_schedule(signed_block next_block);    /// no-op except for scheduling blocks
+         void update_witness_schedule(const signed_block& next_block);    /// no-op except for scheduling blocks
 
          ///Steps performed only at maintenance intervals
          ///@{
@@ -355,13 +778,22 @@ namespace graphene { namespace chain {
          void process_budget();
          void pay_workers( share_type& budget );
          void perform_chain_maintenance(const signed_block& next_block, const global_property_object& global_props);
-         void update_active_witnesses();
-         void update_active_delegates();
+         /// Elects the witnesses and delegates given, sorted by votes
+         void update_active_witnesses( const vector<std::reference_wrapper<const witness_object>>& witnesses );
+         void update_active_delegates( const vector<std::reference_wrapper<const delegate_object>>& delegates );
          void update_vote_totals(const global_property_object& props);
          ///@}
          ///@}
 
          signed_block                           _pending_block;
+         /// The merkle tree of _pending_block.transactions, kept up to date as transactions are pushed
+         merkle_accumulator                     _pending_block_merkle;
+         /// The packed size of _pending_block.transactions, kept up to date as transactions are pushed
+         uint64_t                               _pending_block_transactions_size = 0;
+         pending_transaction_pool               _pending_transactions;
+         bool                                   _prioritize_transactions_by_fee = false;
+         /// Set by push_blocks, which restores the pending transactions once all its blocks are pushed
+         bool                                   _defer_pending_restore = false;
          fork_database                          _fork_db;
 
          /**
@@ -373,7 +805,7 @@ namespace graphene { namespace chain {
           *  until the fork is resolved.  This should make maintaining
           *  the fork tree relatively simple.
           */
-         graphene::db::level_map<block_id_type, signed_block>   _block_id_to_block;
+         block_database                                         _block_id_to_block;
 
          /**
           * Contains the set of ops that are in the process of being applied from
@@ -382,12 +814,71 @@ namespace graphene { namespace chain {
           * emited.
           */
          vector<operation_history_object>  _applied_ops;
+         uint32_t                          _applied_operations_consumers = 0;
 
          uint32_t                          _current_block_num    = 0;
          uint16_t                          _current_trx_in_block = 0;
          uint16_t                          _current_op_in_trx    = 0;
          uint16_t                          _current_virtual_op   = 0;
 
+         utilities::thread_group           _signature_threads;
+         uint32_t                          _next_precheck_thread = 0;
+         /**
+          * The far future schedule last built by get_scheduled_witness, with the near schedule and seed it was built
+          * from, so that it is only built again once a block changes them
+          */
+         mutable optional<far_future_witness_scheduler>     _far_witness_schedule;
+         mutable witness_scheduler                           _far_witness_schedule_base;
+         mutable fc::array<char, GRAPHENE_RNG_SEED_LENGTH>   _far_witness_schedule_seed;
+         signature_cache                   _signature_cache;
+         bool                              _batch_signature_verification = false;
+         authority_cache                   _authority_cache;
+         /// The global properties are read by almost every operation, so they are kept at hand rather than looked up
+         shared_ptr<singleton_object_cache<global_property_object>>         _global_properties;
+         shared_ptr<singleton_object_cache<dynamic_global_property_object>> _dynamic_global_properties;
+         shared_ptr<key_address_table>     _key_addresses;
+         shared_ptr<account_balance_table> _balances;
+         shared_ptr<account_name_table>    _account_names;
+         shared_ptr<vote_table>            _vote_table;
+         shared_ptr<margin_call_tracker>   _margin_calls;
+         shared_ptr<market_order_book<limit_order_object>> _limit_book;
+         shared_ptr<market_order_book<short_order_object>> _short_book;
+         /// The markets to match at the end of the block, lower asset id first
+         flat_set<std::pair<asset_id_type,asset_id_type>>  _batched_markets;
+         /**
+          * While the transactions of a block are applied, the market fees and operation fees which no evaluator reads
+          * are collected here rather than modifying their object on every fill and operation
+          */
+         struct deferred_fees
+         {
+            flat_map<dynamic_asset_data_id_type, share_type>  accumulated_fees;
+            std::map<account_statistics_id_type, share_type>  lifetime_fees_paid;
+            /// Cashback for vesting balances which existed when it was paid; they are all deposited at the same time
+            std::map<vesting_balance_id_type, share_type>     cashback;
+
+            void clear() { accumulated_fees.clear(); lifetime_fees_paid.clear(); cashback.clear(); }
+         };
+         bool                                              _defer_fees = false;
+         deferred_fees                                     _deferred_fees;
+         bool                              _authority_cache_enabled = false;
+         bool                              _track_transaction_conflicts = false;
+         transaction_conflict_stats        _transaction_conflict_stats;
+         /// The objects written by the transactions of the block being applied so far, with the last transaction to
+         /// write each, while conflicts are tracked
+         std::unordered_map<object_id_type, uint32_t> _block_written_objects;
+         /// The stage and group each transaction of the block being applied was scheduled in
+         vector<std::pair<uint32_t,uint32_t>> _transaction_schedule_slots;
+         uint32_t                          _flush_interval = 0;
+         bool                              _trusted_replay = true;
+         flat_map<uint32_t,block_id_type>  _block_checkpoints;
+         uint32_t                          _checkpoint_interval = 0;
+         /// Captured checkpoints which are not written yet, by block number
+         std::deque<std::pair<uint32_t, shared_ptr<db::object_changes>>> _checkpoints;
+         uint32_t                          _sync_blocks = 0;
+         uint32_t                          _sync_milliseconds = 0;
+         uint32_t                          _blocks_since_sync = 0;
+         fc::time_point                    _last_sync;
+
          vector<uint64_t>                  _vote_tally_buffer;
          vector<uint64_t>                  _witness_count_histogram_buffer;
          vector<uint64_t>                  _committee_count_histogram_buffer;
@@ -18,6 +18,7 @@
 #pragma once
 #include <graphene/chain/asset.hpp>
 #include <graphene/db/object.hpp>
+#include <graphene/db/slab_index.hpp>
 
 namespace graphene { namespace chain {
    using namespace graphene::db;
@@ -45,8 +46,13 @@ namespace graphene { namespace chain {
          vote_id_type                   vote_id;
    };
 
+   /// Delegates are scanned in full at every maintenance interval
+   typedef slab_index<delegate_object> delegate_index;
+
 } } // graphene::chain
 
+GRAPHENE_DB_OBJECT_INDEX( graphene::chain::delegate_object, graphene::chain::delegate_index )
+
 FC_REFLECT_DERIVED( graphene::chain::delegate_object, (graphene::db::object),
                     (delegate_account)
                     (vote_id) )
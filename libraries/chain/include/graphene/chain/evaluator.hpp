@@ -40,6 +40,34 @@ namespace graphene { namespace chain {
     * evaluation_failed() is a cleanup method which notifies
     * the subclass to "throw away" the diff.
     */
+   /**
+    * The number of evaluations of one operation type, and the time taken by those which were sampled,
+    * see @ref database::set_evaluator_sample_interval
+    *
+    * The times of an operation include those of the operations it evaluates itself, as a proposal does.
+    */
+   struct evaluator_stats
+   {
+      string   operation;
+      uint64_t calls = 0;
+      uint64_t sampled_calls = 0;
+      uint64_t evaluate_ns = 0;     ///< total over the sampled calls
+      uint64_t max_evaluate_ns = 0;
+      uint64_t apply_ns = 0;        ///< total over the sampled calls
+      uint64_t max_apply_ns = 0;
+      uint64_t undo_clones = 0;     ///< objects saved to the undo history by the sampled calls
+
+      void record( uint64_t evaluate, uint64_t apply, uint64_t clones )
+      {
+         ++sampled_calls;
+         evaluate_ns += evaluate;
+         max_evaluate_ns = std::max( max_evaluate_ns, evaluate );
+         apply_ns += apply;
+         max_apply_ns = std::max( max_apply_ns, apply );
+         undo_clones += clones;
+      }
+   };
+
    class evaluation_observer
    {
       public:
@@ -128,6 +156,15 @@ namespace graphene { namespace chain {
       public:
          virtual operation_result evaluate( transaction_evaluation_state& eval_state, const operation& op, bool apply = true ) override
          {
+             // The evaluator lives on the stack and allocates nothing until it evaluates, so it is cheaper to build
+             // one per operation than to reset a pooled one. Nested evaluations, as of the operations of a
+             // proposal, each get their own.
+             if( eval_observers.empty() )
+             {
+                T eval;
+                return eval.start_evaluate( eval_state, op, apply );
+             }
+
              // fc::exception from observers are suppressed.
              // fc::exception from evaluation is deferred (re-thrown
              // after all observers receive evaluation_failed)
@@ -213,3 +250,6 @@ namespace graphene { namespace chain {
          }
    };
 } }
+
+FC_REFLECT( graphene::chain::evaluator_stats,
+            (operation)(calls)(sampled_calls)(evaluate_ns)(max_evaluate_ns)(apply_ns)(max_apply_ns)(undo_clones) )
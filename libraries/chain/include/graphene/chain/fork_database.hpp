@@ -16,6 +16,7 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #pragma once
+#include <graphene/chain/address.hpp>
 #include <graphene/chain/block.hpp>
 #include <graphene/chain/types.hpp>
 
@@ -23,17 +24,41 @@
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/hashed_index.hpp>
+#include <boost/pool/pool_alloc.hpp>
 
 namespace graphene { namespace chain {
    using boost::multi_index_container;
    using namespace boost::multi_index;
 
+   /**
+    *  The signing addresses of a transaction, recovered ahead of applying it.  The
+    *  signers are in the same order as signed_transaction::signatures, and are only
+    *  meaningful if digest matches the digest the transaction is checked against.
+    */
+   struct recovered_signatures
+   {
+      digest_type       digest;
+      vector<address>   signers;
+   };
+
+   /**
+    *  The signatures of a block recovered ahead of applying it.  The signee is
+    *  only set if the block header signature was recovered as well, and there is
+    *  one entry in transactions per transaction in the block.
+    */
+   struct recovered_block_signatures
+   {
+      optional<address>              signee;
+      vector<recovered_signatures>   transactions;
+   };
+
    struct fork_item
    {
       fork_item( signed_block d )
       :num(d.block_num()),id(d.id()),data( std::move(d) ){}
 
-      weak_ptr< fork_item > prev;
+      /// Reset when the previous block is pruned, so that pruned items are freed
+      shared_ptr< fork_item > prev;
       uint32_t              num;
       /**
        * Used to flag a block as invalid and prevent other blocks from
@@ -42,6 +67,11 @@ namespace graphene { namespace chain {
       bool                  invalid = false;
       block_id_type         id;
       signed_block          data;
+
+      /// @{ What was checked when the block was pushed, so that switching to its fork later need not check it again
+      bool                                  merkle_checked = false;
+      optional<recovered_block_signatures>  recovered;
+      /// @}
    };
    typedef shared_ptr<fork_item> item_ptr;
 
@@ -49,11 +79,16 @@ namespace graphene { namespace chain {
     *  As long as blocks are pushed in order the fork
     *  database will maintain a linked tree of all blocks
     *  that branch from the start_block.  The tree will
-    *  have a maximum depth of 1024 blocks after which
-    *  the database will start lopping off forks.
+    *  have a maximum depth of max_size blocks, below which
+    *  every block is lopped off, however far the head moves.
     *
     *  Every time a block is pushed into the fork DB the
     *  block with the highest block_num will be returned.
+    *
+    *  Items are allocated from a pool, as they come and go
+    *  with every block.  Each item keeps its own copy of the
+    *  block, because switching forks drops the blocks of the
+    *  old fork from the block database.
     */
    class fork_database
    {
@@ -63,6 +98,14 @@ namespace graphene { namespace chain {
          fork_database();
          void reset();
 
+         /// Blocks more than max_size below the head are pruned, as they are past the undo history
+         void                             set_max_size( uint32_t max_size );
+         uint32_t                         max_size()const { return _max_size; }
+         /// The number of blocks held, on every branch
+         size_t                           size()const { return _index.size(); }
+         /// Removes the blocks at or below block_num
+         void                             prune( uint32_t block_num );
+
          void                             start_block( signed_block b );
          void                             remove( block_id_type b );
          void                             set_head( shared_ptr<fork_item> h );
@@ -92,7 +135,13 @@ namespace graphene { namespace chain {
          > fork_multi_index_type;
 
       private:
+         typedef boost::fast_pool_allocator<fork_item, boost::default_user_allocator_new_delete,
+                                            boost::details::pool::null_mutex> item_allocator;
+
+         item_ptr                 make_item( signed_block b );
+
          fork_multi_index_type    _index;
          shared_ptr<fork_item>    _head;
+         uint32_t                 _max_size = 1024;
    };
 } } // graphene::chain
@@ -20,6 +20,7 @@
 #include <graphene/chain/authority.hpp>
 #include <graphene/chain/asset.hpp>
 #include <graphene/db/object.hpp>
+#include <graphene/db/simple_index.hpp>
 
 namespace graphene { namespace chain {
 
@@ -76,9 +77,41 @@ namespace graphene { namespace chain {
          time_point_sec    next_maintenance_time;
          time_point_sec    last_budget_time;
          share_type        witness_budget;
+         /// The last block confirmed by GRAPHENE_IRREVERSIBLE_THRESHOLD of the active witnesses
+         uint32_t          last_irreversible_block_num = 0;
+   };
+
+   /**
+    * @class singleton_object_cache
+    * @brief Keeps a direct pointer to the only object of an index, so that it is read without an index lookup
+    *
+    * Objects are modified in place, so the pointer stays valid until the object is removed, which only happens when
+    * its creation is undone or the state is replaced; it is set again when the object is created or loaded.
+    */
+   template<typename ObjectType>
+   class singleton_object_cache : public graphene::db::index_observer
+   {
+      public:
+         /// @return the object, or nullptr while the index is empty
+         const ObjectType* get()const { return _object; }
+
+         virtual void on_add( const graphene::db::object& obj ) override
+         {
+            _object = &static_cast<const ObjectType&>(obj);
+         }
+         virtual void on_remove( const graphene::db::object& obj ) override
+         {
+            if( _object == &obj )
+               _object = nullptr;
+         }
+
+      private:
+         const ObjectType* _object = nullptr;
    };
 }}
 
+GRAPHENE_DB_OBJECT_INDEX( graphene::chain::dynamic_global_property_object,
+                          graphene::db::simple_index<graphene::chain::dynamic_global_property_object> )
 
 FC_REFLECT_DERIVED( graphene::chain::dynamic_global_property_object, (graphene::db::object),
                     (random)
@@ -88,6 +121,7 @@ FC_REFLECT_DERIVED( graphene::chain::dynamic_global_property_object, (graphene::
                     (current_witness)
                     (next_maintenance_time)
                     (witness_budget)
+                    (last_irreversible_block_num)
                   )
 
 FC_REFLECT_DERIVED( graphene::chain::global_property_object, (graphene::db::object),
@@ -17,6 +17,7 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <graphene/db/index.hpp>
 #include <graphene/chain/address.hpp>
 #include <fc/static_variant.hpp>
 #include <graphene/chain/types.hpp>
@@ -35,10 +36,37 @@ namespace graphene { namespace chain {
          static const uint8_t type_id  = key_object_type;
 
          key_id_type get_id()const  { return key_id_type( id.instance() ); }
-         address key_address()const;
+         /// Derived from key_data on the first call and remembered, so key_data must not change once it is set
+         const address& key_address()const;
          const public_key_type& key()const { return key_data.get<public_key_type>(); }
 
          static_variant<address,public_key_type> key_data;
+
+      private:
+         mutable optional<address> _address;
+   };
+
+   /**
+    * @class key_address_table
+    * @brief Maps key ids straight to their addresses for the transaction signature checks
+    *
+    * Key ids are allocated sequentially, so the addresses are kept in a flat vector indexed by key instance and filled
+    * in as keys are looked up. An entry is dropped when its key is modified or removed, which only happens when its
+    * creation is undone, so a different key created later with the same id is never confused with it.
+    */
+   class key_address_table : public graphene::db::index_observer
+   {
+      public:
+         /// @return the address of the key, looking it up in db the first time
+         const address& get( const graphene::db::object_database& db, key_id_type id );
+
+         virtual void on_modify( const graphene::db::object& obj ) override { forget( obj.id ); }
+         virtual void on_remove( const graphene::db::object& obj ) override { forget( obj.id ); }
+
+      private:
+         void forget( object_id_type id );
+
+         vector<optional<address>> _addresses;
    };
 } }
 
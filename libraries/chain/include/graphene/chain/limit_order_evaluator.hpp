@@ -36,6 +36,8 @@ namespace graphene { namespace chain {
          const account_object*               _seller        = nullptr;
          const asset_object*                 _sell_asset    = nullptr;
          const asset_object*                 _receive_asset = nullptr;
+         /// True if the order is left for database::match_batched_markets
+         bool                                _batched       = false;
    };
 
    class limit_order_cancel_evaluator : public evaluator<limit_order_cancel_evaluator>
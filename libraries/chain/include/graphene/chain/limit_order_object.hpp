@@ -64,13 +64,16 @@ namespace graphene { namespace chain {
            >,
            composite_key_compare< std::greater<price>, std::less<object_id_type> >
         >
-     >
+     >,
+     graphene::db::pool_allocator<limit_order_object>
   > limit_order_multi_index_type;
 
   typedef generic_index<limit_order_object, limit_order_multi_index_type> limit_order_index;
 
 } }
 
+GRAPHENE_DB_OBJECT_INDEX( graphene::chain::limit_order_object, graphene::chain::limit_order_index )
+
 FC_REFLECT_DERIVED( graphene::chain::limit_order_object,
                     (graphene::db::object),
                     (expiration)(seller)(for_sale)(sell_price)
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/chain/types.hpp>
+#include <graphene/db/index.hpp>
+
+namespace graphene { namespace chain {
+
+   /**
+    *  @class margin_call_tracker
+    *  @brief Remembers the market issued assets whose call orders are known not to be callable
+    *
+    *  database::check_call_orders looks the top of the call book up against the best orders selling the asset for
+    *  its backing asset every time an order is placed or canceled.  Once it has found nothing to call, nothing
+    *  can be called again until an order or call order of the asset is added or modified, or its feed changes, so
+    *  this observer records every asset checked without a call and forgets it as soon as one of those happens.
+    *  Removing orders or call orders never makes a call possible, and undo puts objects back through add and
+    *  modify, so the assets it remembers are always safe to skip.
+    *
+    *  It must be observing the limit order, short order, call order and bitasset data indexes.
+    */
+   class margin_call_tracker : public graphene::db::index_observer
+   {
+      public:
+         virtual void on_add( const graphene::db::object& obj ) override;
+         virtual void on_modify( const graphene::db::object& obj ) override;
+
+         /// @return false if check_call_orders found nothing to call in mia and nothing changed since
+         bool needs_check( asset_id_type mia )const { return _settled.find( mia ) == _settled.end(); }
+         /// Called by check_call_orders after it found nothing, or nothing more, to call in mia
+         void set_checked( asset_id_type mia ) { _settled.insert( mia ); }
+
+      private:
+         void changed( asset_id_type a, asset_id_type b );
+
+         flat_set<asset_id_type> _settled;
+   };
+
+} } // graphene::chain
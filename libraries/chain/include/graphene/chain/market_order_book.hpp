@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/chain/asset.hpp>
+#include <graphene/db/index.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+
+namespace graphene { namespace chain {
+
+   /**
+    *  @class market_order_book
+    *  @brief Keeps the orders of one type in a book per market, each a list of price levels holding its orders
+    *         oldest first
+    *
+    *  The order indexes sort the orders of every market in one tree, so each step of matching an order searches
+    *  among all the orders on the chain.  This observer follows the order index as objects are added and removed,
+    *  undo and loading included, and keeps the orders selling each asset for each other asset apart, best price
+    *  first and by id within a price, the same order as the by_price index.  Finding the best order of a market
+    *  then only depends on the number of markets and the levels of the touched one.
+    *
+    *  The sell price of an order never changes once it is created, so modifying an order leaves the book alone.
+    */
+   template<typename OrderType>
+   class market_order_book : public graphene::db::index_observer
+   {
+      public:
+         /// Orders selling the same amount at one price, in the order they were created
+         typedef vector<const OrderType*>                          level_type;
+         typedef std::map<price, level_type, std::greater<price>>  levels_type;
+
+         virtual void on_add( const graphene::db::object& obj ) override
+         {
+            const auto& order = static_cast<const OrderType&>( obj );
+            auto& level = _markets[market_of( order )][order.sell_price];
+            // Ids only grow, so an order goes at the back unless undo brings an older one back
+            auto pos = level.end();
+            if( !level.empty() && order.id < level.back()->id )
+               pos = std::lower_bound( level.begin(), level.end(), &order, &older );
+            level.insert( pos, &order );
+         }
+
+         virtual void on_remove( const graphene::db::object& obj ) override
+         {
+            const auto& order = static_cast<const OrderType&>( obj );
+            auto market = _markets.find( market_of( order ) );
+            if( market == _markets.end() ) return;
+            auto level = market->second.find( order.sell_price );
+            if( level == market->second.end() ) return;
+
+            auto& orders = level->second;
+            auto pos = std::lower_bound( orders.begin(), orders.end(), &order, &older );
+            if( pos != orders.end() && *pos == &order )
+               orders.erase( pos );
+            if( orders.empty() )
+            {
+               market->second.erase( level );
+               if( market->second.empty() )
+                  _markets.erase( market );
+            }
+         }
+
+         /**
+          * @return the oldest order at the best price selling base for quote, if it sells at limit or better, or
+          * nullptr
+          */
+         const OrderType* best( const price& limit )const
+         {
+            auto market = _markets.find( std::make_pair( limit.base.asset_id, limit.quote.asset_id ) );
+            if( market == _markets.end() ) return nullptr;
+            const auto& top = *market->second.begin();
+            if( top.first < limit ) return nullptr;
+            return top.second.front();
+         }
+
+         /// @return the price levels selling base for quote, best first, or nullptr if there are no such orders
+         const levels_type* levels( asset_id_type base, asset_id_type quote )const
+         {
+            auto market = _markets.find( std::make_pair( base, quote ) );
+            return market == _markets.end() ? nullptr : &market->second;
+         }
+
+         /// @return every order selling base, in any market, for the caller to remove
+         vector<const OrderType*> orders_selling( asset_id_type base )const
+         {
+            vector<const OrderType*> orders;
+            for( auto market = _markets.lower_bound( std::make_pair( base, asset_id_type() ) );
+                 market != _markets.end() && market->first.first == base; ++market )
+               for( const auto& level : market->second )
+                  orders.insert( orders.end(), level.second.begin(), level.second.end() );
+            return orders;
+         }
+
+      private:
+         static std::pair<asset_id_type,asset_id_type> market_of( const OrderType& order )
+         {
+            return std::make_pair( order.sell_price.base.asset_id, order.sell_price.quote.asset_id );
+         }
+         static bool older( const OrderType* a, const OrderType* b ) { return a->id < b->id; }
+
+         std::map<std::pair<asset_id_type,asset_id_type>, levels_type> _markets;
+   };
+
+} } // graphene::chain
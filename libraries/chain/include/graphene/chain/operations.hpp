@@ -26,6 +26,7 @@
 #include <graphene/chain/asset.hpp>
 #include <graphene/chain/authority.hpp>
 #include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/static_variant_dispatch.hpp>
 #include <graphene/chain/worker_object.hpp>
 
 #include <fc/static_variant.hpp>
@@ -1482,6 +1483,33 @@ namespace graphene { namespace chain {
       }
    };
 
+   /**
+    * @brief Withdraw all that may be withdrawn from the vesting balances an account holds in an asset
+    * @ingroup operations
+    *
+    * Accounts paid through many vesting balances, such as by cashback and worker pay, collect them with one operation
+    * rather than one per vesting balance.  Each vesting balance gives up as much as its policy allows at the time,
+    * and those which allow nothing yet are left alone.
+    *
+    * @return The total amount withdrawn
+    */
+   struct vesting_balance_withdraw_all_operation
+   {
+      asset                   fee;
+      account_id_type         owner;
+      asset_id_type           asset_type; ///< Only the vesting balances in this asset are withdrawn from
+
+      account_id_type   fee_payer()const { return owner; }
+      void              get_required_auth(flat_set<account_id_type>& active_auth_set, flat_set<account_id_type>&)const;
+      void              validate()const;
+      share_type        calculate_fee( const fee_schedule_type& k )const;
+      void              get_balance_delta( balance_accumulator& acc, const operation_result& result = asset())const
+      {
+         acc.adjust( fee_payer(), -fee );
+         acc.adjust( owner, result.get<asset>() );
+      }
+   };
+
    /**
     * @defgroup workers The Blockchain Worker System
     * @ingroup operations
@@ -1603,7 +1631,8 @@ namespace graphene { namespace chain {
             bond_accept_offer_operation,
             bond_claim_collateral_operation,
             worker_create_operation,
-            custom_operation
+            custom_operation,
+            vesting_balance_withdraw_all_operation
          > operation;
 
    /// @} // operations group
@@ -1720,12 +1749,12 @@ namespace graphene { namespace chain {
       op_wrapper(const operation& op = operation()):op(op){}
       operation op;
 
-      void       validate()const { op.visit( operation_validator() ); }
+      void       validate()const { dispatch( op, operation_validator() ); }
       void       get_required_auth(flat_set<account_id_type>& active, flat_set<account_id_type>& owner) {
-         op.visit(operation_get_required_auths(active, owner));
+         dispatch(op, operation_get_required_auths(active, owner));
       }
-      asset      set_fee( const fee_schedule_type& k ) { return op.visit( operation_set_fee( k ) ); }
-      share_type calculate_fee( const fee_schedule_type& k )const { return op.visit( operation_calculate_fee( k ) ); }
+      asset      set_fee( const fee_schedule_type& k ) { return dispatch( op, operation_set_fee( k ) ); }
+      share_type calculate_fee( const fee_schedule_type& k )const { return dispatch( op, operation_calculate_fee( k ) ); }
    };
 
 } } // graphene::chain
@@ -1839,6 +1868,7 @@ FC_REFLECT( graphene::chain::bond_claim_collateral_operation, (fee)(claimer)(len
 
 FC_REFLECT( graphene::chain::vesting_balance_create_operation, (fee)(creator)(owner)(amount)(vesting_seconds) )
 FC_REFLECT( graphene::chain::vesting_balance_withdraw_operation, (fee)(vesting_balance)(owner)(amount) )
+FC_REFLECT( graphene::chain::vesting_balance_withdraw_all_operation, (fee)(owner)(asset_type) )
 
 FC_REFLECT( graphene::chain::worker_create_operation,
             (fee)(owner)(work_begin_date)(work_end_date)(daily_pay)(initializer) )
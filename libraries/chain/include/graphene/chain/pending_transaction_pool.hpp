@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/chain/transaction.hpp>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+
+namespace graphene { namespace chain {
+   using boost::multi_index_container;
+   using namespace boost::multi_index;
+
+   /**
+    *  A transaction accepted into the pending block, which is kept until it is included in a block, expires, or
+    *  no longer applies.  When a new block arrives, the pending state is dropped and the transactions which
+    *  remain are applied again on top of it.
+    */
+   struct pending_transaction
+   {
+      transaction_id_type  trx_id;
+      signed_transaction   trx;
+      time_point_sec       expiration;
+      /// The checks skipped when the transaction was first pushed; its signatures are never checked again
+      uint32_t             skip = 0;
+      /// The account paying the fee of the first operation
+      account_id_type      fee_payer;
+      /// The fees paid by every operation, in CORE at the exchange rates of the fee assets
+      share_type           fee;
+      uint32_t             packed_size = 0;
+
+      /// CORE paid per kilobyte of the block taken
+      uint64_t fee_rate()const { return packed_size ? uint64_t(fee.value) * 1024 / packed_size : 0; }
+   };
+
+   struct by_trx_id;
+   struct by_expiration;
+   struct by_arrival;
+   typedef multi_index_container<
+      pending_transaction,
+      indexed_by<
+         sequenced< tag<by_arrival> >,
+         hashed_unique< tag<by_trx_id>, member< pending_transaction, transaction_id_type, &pending_transaction::trx_id >,
+                        std::hash<transaction_id_type> >,
+         ordered_non_unique< tag<by_expiration>, member< pending_transaction, time_point_sec, &pending_transaction::expiration > >
+      >
+   > pending_transaction_pool;
+
+} }
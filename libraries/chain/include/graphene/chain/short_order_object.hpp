@@ -133,7 +133,8 @@ namespace graphene { namespace chain {
            >,
            composite_key_compare< std::greater<price>, std::less<object_id_type> >
         >
-     >
+     >,
+     graphene::db::pool_allocator<short_order_object>
   > short_order_multi_index_type;
 
    typedef multi_index_container<
@@ -160,11 +161,18 @@ namespace graphene { namespace chain {
                member< object, object_id_type, &object::id >
             >
          >
-      >
+      >,
+      graphene::db::pool_allocator<call_order_object>
    > call_order_multi_index_type;
 
    struct by_account;
    struct by_expiration;
+   struct by_settlement_date;
+   /**
+    *  @ref by_expiration keeps one queue per asset ordered by settlement date, which is the order settlements are
+    *  executed in; @ref by_settlement_date orders all requests by date alone so that the assets with due settlements
+    *  can be found without visiting the others.
+    */
    typedef multi_index_container<
       force_settlement_object,
       indexed_by<
@@ -177,8 +185,12 @@ namespace graphene { namespace chain {
                const_mem_fun<force_settlement_object, asset_id_type, &force_settlement_object::settlement_asset_id>,
                member<force_settlement_object, time_point_sec, &force_settlement_object::settlement_date>
             >
+         >,
+         ordered_non_unique< tag<by_settlement_date>,
+            member<force_settlement_object, time_point_sec, &force_settlement_object::settlement_date>
          >
-      >
+      >,
+      graphene::db::pool_allocator<force_settlement_object>
    > force_settlement_object_multi_index_type;
 
 
@@ -187,6 +199,8 @@ namespace graphene { namespace chain {
   typedef generic_index<force_settlement_object, force_settlement_object_multi_index_type>   force_settlement_index;
 } } // graphene::chain
 
+GRAPHENE_DB_OBJECT_INDEX( graphene::chain::call_order_object, graphene::chain::call_order_index )
+
 FC_REFLECT_DERIVED( graphene::chain::short_order_object, (graphene::db::object),
                     (expiration)(seller)(for_sale)(available_collateral)(sell_price)
                     (call_price)(initial_collateral_ratio)(maintenance_collateral_ratio)
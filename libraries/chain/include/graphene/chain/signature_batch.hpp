@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/chain/signature_cache.hpp>
+
+#include <graphene/utilities/thread_pools.hpp>
+
+#include <atomic>
+
+namespace graphene { namespace chain {
+
+   /**
+    *  @class signature_batch
+    *  @brief Recovers a set of signatures together, with a single pass/fail result
+    *
+    *  The signatures are spread evenly over the given worker threads. As soon as one of them fails to recover, the
+    *  rest of the batch is abandoned; callers are expected to fall back to checking the signatures one at a time,
+    *  which identifies the culprit. A successful batch only proves that every signature is well formed: comparing
+    *  the recovered signers against the expected keys is left to the caller.
+    */
+   class signature_batch
+   {
+      public:
+         /**
+          * @param enforce_canonical reject non-canonical signatures, as block header signatures must be
+          * @return the index of the signer in signers()
+          */
+         uint32_t add( const digest_type& digest, const signature_type& signature, bool enforce_canonical = false );
+         uint32_t size()const { return _items.size(); }
+         void clear();
+
+         /**
+          * @param threads the threads to verify the batch on; if empty, it is verified on the calling thread
+          * @param cache if not null, the non-canonical signatures are looked up in and added to this cache
+          * @return true if every signature in the batch was recovered
+          *
+          * Waiting on the worker threads yields the current task.
+          */
+         bool verify( const utilities::thread_group& threads, signature_cache* cache = nullptr );
+
+         /// The recovered signers, in the order they were added. Only meaningful after verify() succeeds.
+         const vector<address>& signers()const { return _signers; }
+
+      private:
+         struct item
+         {
+            digest_type    digest;
+            signature_type signature;
+            bool           enforce_canonical;
+         };
+
+         void verify_range( size_t begin, size_t end, signature_cache* cache, std::atomic<bool>& failed );
+
+         vector<item>    _items;
+         vector<address> _signers;
+   };
+
+} } // graphene::chain
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/chain/types.hpp>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+
+#include <mutex>
+
+namespace graphene { namespace chain {
+   using boost::multi_index_container;
+   using namespace boost::multi_index;
+
+   struct signature_cache_stats
+   {
+      uint64_t hits     = 0;
+      uint64_t misses   = 0;
+      uint32_t size     = 0;
+      uint32_t max_size = 0;
+   };
+
+   /**
+    *  @class signature_cache
+    *  @brief A bounded cache of the addresses recovered from (digest, signature) pairs
+    *
+    *  A transaction typically has its signatures checked when it is first pushed, again every time the pending
+    *  block is rebuilt, and once more when it arrives in a block. Recovering a public key is by far the most
+    *  expensive part of each check, so the result is remembered here. Once max_size entries are cached, the oldest
+    *  are evicted first.
+    *
+    *  The cache may be used concurrently from the signature worker threads.
+    */
+   class signature_cache
+   {
+      public:
+         signature_cache( uint32_t max_size = GRAPHENE_DEFAULT_SIGNATURE_CACHE_SIZE ):_max_size(max_size){}
+
+         /**
+          * @return the address of the key which produced signature over digest
+          * @throws fc::exception if no key can be recovered from the signature
+          */
+         address recover( const digest_type& digest, const signature_type& signature );
+
+         void set_max_size( uint32_t max_size );
+         void clear();
+         signature_cache_stats get_stats()const;
+
+      private:
+         struct signature_key
+         {
+            digest_type    digest;
+            signature_type signature;
+
+            friend bool operator == ( const signature_key& a, const signature_key& b )
+            {
+               return a.digest == b.digest && a.signature == b.signature;
+            }
+         };
+         struct signature_key_hash
+         {
+            /// Both halves are already uniformly distributed; skip the recovery id byte of the signature
+            size_t operator()( const signature_key& k )const
+            {
+               size_t d, s;
+               memcpy( &d, k.digest.data(), sizeof(d) );
+               memcpy( &s, k.signature.begin() + 1, sizeof(s) );
+               return d ^ s;
+            }
+         };
+         struct cache_entry
+         {
+            signature_key key;
+            address       signer;
+         };
+         struct by_key{};
+         typedef multi_index_container<
+            cache_entry,
+            indexed_by<
+               sequenced<>,
+               hashed_unique< tag<by_key>, member< cache_entry, signature_key, &cache_entry::key >, signature_key_hash >
+            >
+         > cache_type;
+
+         void evict();
+
+         mutable std::mutex _mutex;
+         cache_type         _entries;
+         uint32_t           _max_size;
+         uint64_t           _hits = 0;
+         uint64_t           _misses = 0;
+   };
+
+} } // graphene::chain
+
+FC_REFLECT( graphene::chain::signature_cache_stats, (hits)(misses)(size)(max_size) )
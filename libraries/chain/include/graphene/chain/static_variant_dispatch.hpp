@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <fc/static_variant.hpp>
+
+#include <type_traits>
+
+namespace graphene { namespace chain {
+
+   namespace detail {
+      template<typename T, typename Visitor, typename Variant>
+      typename Visitor::result_type visit_alternative( Variant& v, Visitor& visitor )
+      {
+         return visitor( v.template get<T>() );
+      }
+   }
+
+   /**
+    * Calls visitor with the value held by v, as v.visit( visitor ) does
+    *
+    * static_variant::visit finds the type of the value by comparing the tag with each type in turn, which takes as
+    * many steps as the position of the type in the list. This indexes a table of one function per type instead, built
+    * at compile time for each visitor, so visiting any type of a long variant such as @ref operation costs one
+    * indirect call.
+    */
+   template<typename Visitor, typename... Types>
+   typename std::remove_reference<Visitor>::type::result_type
+   dispatch( const fc::static_variant<Types...>& v, Visitor&& visitor )
+   {
+      typedef typename std::remove_reference<Visitor>::type visitor_type;
+      typedef const fc::static_variant<Types...> variant_type;
+      typedef typename visitor_type::result_type (*entry)( variant_type&, visitor_type& );
+      static constexpr entry table[] = { &detail::visit_alternative<Types, visitor_type, variant_type>... };
+      return table[v.which()]( v, visitor );
+   }
+
+   template<typename Visitor, typename... Types>
+   typename std::remove_reference<Visitor>::type::result_type
+   dispatch( fc::static_variant<Types...>& v, Visitor&& visitor )
+   {
+      typedef typename std::remove_reference<Visitor>::type visitor_type;
+      typedef fc::static_variant<Types...> variant_type;
+      typedef typename visitor_type::result_type (*entry)( variant_type&, visitor_type& );
+      static constexpr entry table[] = { &detail::visit_alternative<Types, visitor_type, variant_type>... };
+      return table[v.which()]( v, visitor );
+   }
+
+} } // graphene::chain
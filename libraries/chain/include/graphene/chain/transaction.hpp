@@ -74,6 +74,31 @@ namespace graphene { namespace chain {
    /**
     *  @brief groups operations that should be applied atomically
     */
+   namespace detail {
+      /**
+       * Hashes remembered by a transaction while its hash cache is enabled. Copies start out empty and disabled, so
+       * a copy which is then modified never reports the hashes of the original.
+       */
+      struct transaction_hash_cache
+      {
+         transaction_hash_cache(){}
+         transaction_hash_cache( const transaction_hash_cache& ){}
+         transaction_hash_cache& operator=( const transaction_hash_cache& ){ reset(); enabled = false; return *this; }
+
+         void reset()
+         {
+            digest.reset();
+            ref_digest.reset();
+            merkle_digest.reset();
+         }
+
+         bool                                              enabled = false;
+         optional<digest_type>                             digest;
+         optional<std::pair<block_id_type,digest_type>>   ref_digest;
+         optional<digest_type>                             merkle_digest;
+      };
+   }
+
    struct transaction
    {
       /**
@@ -103,12 +128,24 @@ namespace graphene { namespace chain {
       transaction_id_type id()const;
       void validate() const;
 
+      /**
+       * While the hash cache is enabled, id(), digest() and processed_transaction::merkle_digest() serialize and hash
+       * the transaction only once. The member functions which modify the transaction drop the cached hashes, but the
+       * public fields must not be modified directly while the cache is enabled. Disabling the cache discards it.
+       */
+      void set_hash_cache_enabled( bool enabled )const
+      {
+         _hash_cache.reset();
+         _hash_cache.enabled = enabled;
+      }
+
       void set_expiration( fc::time_point_sec expiration_time )
       {
          ref_block_num = 0;
          relative_expiration = 0;
          ref_block_prefix = expiration_time.sec_since_epoch();
          block_id_cache.reset();
+         _hash_cache.reset();
       }
       void set_expiration( const block_id_type& reference_block, unsigned_int lifetime_intervals = 3 )
       {
@@ -116,19 +153,22 @@ namespace graphene { namespace chain {
          ref_block_prefix = reference_block._hash[1];
          relative_expiration = lifetime_intervals;
          block_id_cache = reference_block;
+         _hash_cache.reset();
       }
 
       /// visit all operations
       template<typename Visitor>
       void visit( Visitor&& visitor )
       {
+         _hash_cache.reset();
          for( auto& op : operations )
-            op.visit( std::forward<Visitor>( visitor ) );
+            dispatch( op, visitor );
       }
 
    protected:
       // Intentionally unreflected: does not go on wire
       optional<block_id_type> block_id_cache;
+      mutable detail::transaction_hash_cache _hash_cache;
    };
 
    /**
@@ -143,7 +183,7 @@ namespace graphene { namespace chain {
       flat_map<key_id_type,signature_type> signatures;
 
       /// Removes all operations and signatures
-      void clear() { operations.clear(); signatures.clear(); }
+      void clear() { operations.clear(); signatures.clear(); _hash_cache.reset(); }
    };
 
    /**
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/chain/operations.hpp>
+#include <graphene/chain/transaction.hpp>
+
+namespace graphene { namespace chain {
+
+   /**
+    * How often the transactions of the applied blocks wrote an object an earlier transaction of the same block had
+    * written, see @ref database::set_transaction_conflict_tracking
+    *
+    * A transaction which conflicts could not have been applied in parallel with the earlier ones and give the same
+    * state.  Only writes are tracked, so a transaction which reads what an earlier one wrote is not counted; this is
+    * a lower bound on the transactions which would have to be applied again.
+    */
+   struct transaction_conflict_stats
+   {
+      uint64_t blocks = 0;
+      uint64_t transactions = 0;
+      uint64_t conflicting_transactions = 0;
+      uint64_t objects_written = 0;          ///< created, modified or removed, counted once per transaction
+      /// Stages and groups the transactions were scheduled in from their footprints, see @ref schedule_transactions
+      uint64_t scheduled_stages = 0;
+      uint64_t scheduled_groups = 0;
+      /// Conflicting transactions which were scheduled in different groups of the same stage; a footprint is wrong
+      uint64_t footprint_misses = 0;
+   };
+
+   /**
+    * A conservative bound on the state an operation or transaction may read or write, found from its fields alone
+    *
+    * Two footprints conflict when they name the same account, object, market or created object type, when one writes
+    * an asset the other reads or writes, or when either is unbounded.  Everything held by an account, such as its
+    * balances and statistics, is covered by the account.
+    */
+   struct operation_footprint
+   {
+      flat_set<account_id_type>                     accounts;
+      /// Objects named by the operation which are not covered by an account
+      flat_set<object_id_type>                      objects;
+      flat_set<asset_id_type>                       assets_read;
+      /// Assets whose objects, dynamic data or bitasset data may change
+      flat_set<asset_id_type>                       assets_written;
+      /// Markets whose order books may change, lower asset id first
+      flat_set<std::pair<asset_id_type,asset_id_type>> markets;
+      /// The spaces and types of the objects which may be created, with an instance of 0, as their ids are given out
+      /// in order
+      flat_set<object_id_type>                      created;
+      /// May touch state which is not named by the operation, such as the orders an order is matched against
+      bool                                          unbounded = false;
+
+      void add_market( asset_id_type a, asset_id_type b );
+      void merge( const operation_footprint& other );
+      bool conflicts_with( const operation_footprint& other )const;
+   };
+
+   /**
+    * @brief Used to find the footprint of operations in a polymorphic manner
+    *
+    * The fee payer always belongs to the footprint, and a fee not paid in the core asset writes its asset's fee pool.
+    * Operations with no rule of their own, and those which may match orders, trigger margin calls, execute other
+    * operations or change chain parameters, are unbounded.
+    */
+   struct operation_get_footprint
+   {
+      operation_footprint& footprint;
+      operation_get_footprint( operation_footprint& f ):footprint(f){}
+
+      typedef void result_type;
+      template<typename T>
+      void operator()( const T& op )const
+      {
+         add_fee( op.fee_payer(), op.fee );
+         add( op );
+      }
+
+      void add_fee( account_id_type payer, const asset& fee )const;
+
+      void add( const transfer_operation& op )const;
+      void add( const limit_order_create_operation& op )const;
+      void add( const limit_order_cancel_operation& op )const;
+      void add( const key_create_operation& op )const;
+      void add( const account_create_operation& op )const;
+      void add( const account_update_operation& op )const;
+      void add( const account_whitelist_operation& op )const;
+      void add( const asset_issue_operation& op )const;
+      void add( const asset_burn_operation& op )const;
+      void add( const asset_fund_fee_pool_operation& op )const;
+      void add( const vesting_balance_create_operation& op )const;
+      void add( const vesting_balance_withdraw_operation& op )const;
+      void add( const withdraw_permission_claim_operation& op )const;
+      void add( const witness_withdraw_pay_operation& op )const;
+      void add( const custom_operation& op )const;
+      template<typename T>
+      void add( const T& )const { footprint.unbounded = true; }
+   };
+
+   operation_footprint get_transaction_footprint( const transaction& trx );
+
+   /**
+    * The transactions of one stage of a schedule, in groups which touch disjoint state
+    *
+    * Each group holds the indexes of its transactions in block order.  The groups of a stage may be applied at
+    * the same time, each in order, once every earlier stage has been applied.
+    */
+   struct transaction_stage
+   {
+      vector<vector<uint32_t>> groups;
+   };
+
+   /**
+    * Partitions transactions with the given footprints into stages of non-conflicting groups, such that applying the
+    * stages in order, and the groups of each stage in any order, gives the same state as applying the transactions in
+    * order.  An unbounded transaction has a stage to itself.  Transactions which conflict directly or through other
+    * transactions share a group.
+    *
+    * The transaction_object each transaction creates for the duplicate check is not part of any footprint; they
+    * must be created in block order.
+    */
+   vector<transaction_stage> schedule_transactions( const vector<operation_footprint>& footprints );
+
+} } // graphene::chain
+
+FC_REFLECT( graphene::chain::transaction_conflict_stats,
+            (blocks)(transactions)(conflicting_transactions)(objects_written)
+            (scheduled_stages)(scheduled_groups)(footprint_misses) )
+FC_REFLECT( graphene::chain::operation_footprint,
+            (accounts)(objects)(assets_read)(assets_written)(markets)(created)(unbounded) )
+FC_REFLECT( graphene::chain::transaction_stage, (groups) )
@@ -18,6 +18,7 @@
 #pragma once
 #include <graphene/chain/operations.hpp>
 #include <graphene/chain/authority.hpp>
+#include <graphene/chain/authority_cache.hpp>
 #include <graphene/chain/asset.hpp>
 
 namespace graphene { namespace chain {
@@ -36,11 +37,19 @@ namespace graphene { namespace chain {
          transaction_evaluation_state( database* db = nullptr, bool skip_authority_check = false )
          :_db(db),_skip_authority_check(skip_authority_check){}
 
+         /// Prepares the state to evaluate another transaction, keeping the storage of its containers
+         void reset( database* db, bool skip_authority_check );
+
          bool check_authority( const account_object&, authority::classification auth_class = authority::active, int depth = 0 );
 
          database& db()const { FC_ASSERT( _db ); return *_db; }
 
          bool signed_by( key_id_type id )const;
+         /// True if the authority of id was already verified for an earlier operation of the transaction
+         bool is_approved( object_id_type id, authority::classification auth_class )const
+         {
+            return approved_by.find( std::make_pair(id, auth_class) ) != approved_by.end();
+         }
 
          /** derived from signatures on transaction
          flat_set<address>                                          signed_by;
@@ -53,9 +62,22 @@ namespace graphene { namespace chain {
           */
          vector<operation_result>   operation_results;
 
+         /** The authorities required by the operation being evaluated, kept to reuse their storage */
+         flat_set<account_id_type>  required_active_auths;
+         flat_set<account_id_type>  required_owner_auths;
+
          const signed_transaction* _trx = nullptr;
          database*                 _db = nullptr;
          bool                      _skip_authority_check = false;
          bool                      _is_proposed_trx = false;
+         /** approvals shared with the other transactions of the block being applied, if any */
+         authority_cache*          _authority_cache = nullptr;
+
+      private:
+         /** the keys which signed _trx, in order, as used to look up the authority cache */
+         const vector<key_id_type>& signing_keys();
+
+         vector<key_id_type>        _signing_keys;
+         bool                       _signing_keys_valid = false;
    };
 } } // namespace graphene::chain
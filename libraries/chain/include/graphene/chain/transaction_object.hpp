@@ -40,6 +40,10 @@ namespace graphene { namespace chain {
     *  added.  At the end of block processing all
     *  transaction_objects that have expired can
     *  be removed from the index.
+    *
+    *  Only the id of the transaction is kept, along with the
+    *  number of the block it is in, which holds the rest of
+    *  it; see database::get_recent_transaction.
     */
    class transaction_object : public abstract_object<transaction_object>
    {
@@ -47,9 +51,10 @@ namespace graphene { namespace chain {
          static const uint8_t space_id = implementation_ids;
          static const uint8_t type_id  = impl_transaction_object_type;
 
-         signed_transaction  trx;
          time_point_sec      expiration;
          transaction_id_type trx_id;
+         /// the block the transaction is in, or is pending for
+         uint32_t            block_num = 0;
    };
 
 
@@ -62,11 +67,12 @@ namespace graphene { namespace chain {
          hashed_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
          hashed_unique< tag<by_trx_id>, BOOST_MULTI_INDEX_MEMBER(transaction_object, transaction_id_type, trx_id), std::hash<transaction_id_type> >,
          ordered_non_unique< tag<by_expiration>, BOOST_MULTI_INDEX_MEMBER(transaction_object, time_point_sec, expiration)>
-      >
+      >,
+      graphene::db::pool_allocator<transaction_object>
    > transaction_multi_index_type;
 
    typedef generic_index<transaction_object, transaction_multi_index_type> transaction_index;
 
 } }
 
-FC_REFLECT_DERIVED( graphene::chain::transaction_object, (graphene::db::object), (trx)(expiration) )
+FC_REFLECT_DERIVED( graphene::chain::transaction_object, (graphene::db::object), (expiration)(trx_id)(block_num) )
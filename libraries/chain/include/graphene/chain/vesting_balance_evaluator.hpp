@@ -23,6 +23,7 @@ namespace graphene { namespace chain {
 
 class vesting_balance_create_evaluator;
 class vesting_balance_withdraw_evaluator;
+class vesting_balance_withdraw_all_evaluator;
 
 class vesting_balance_create_evaluator : public evaluator<vesting_balance_create_evaluator>
 {
@@ -42,4 +43,17 @@ class vesting_balance_withdraw_evaluator : public evaluator<vesting_balance_with
         object_id_type do_apply( const vesting_balance_withdraw_operation& op );
 };
 
+class vesting_balance_withdraw_all_evaluator : public evaluator<vesting_balance_withdraw_all_evaluator>
+{
+    public:
+        typedef vesting_balance_withdraw_all_operation operation_type;
+
+        asset do_evaluate( const vesting_balance_withdraw_all_operation& op );
+        asset do_apply( const vesting_balance_withdraw_all_operation& op );
+
+        /// The vesting balances to withdraw from, with the amount each allows
+        vector<std::pair<const vesting_balance_object*, asset>> _withdrawals;
+        asset                                                    _total;
+};
+
 } } // graphene::chain
@@ -24,6 +24,9 @@
 
 #include <graphene/chain/asset.hpp>
 #include <graphene/db/object.hpp>
+#include <graphene/db/generic_index.hpp>
+
+#include <boost/multi_index/composite_key.hpp>
 
 namespace graphene { namespace chain {
    using namespace graphene::db;
@@ -124,10 +127,35 @@ namespace graphene { namespace chain {
           */
          void withdraw( const fc::time_point_sec& now, const asset& amount );
          bool is_withdraw_allowed( const fc::time_point_sec& now, const asset& amount )const;
+         /// The most which may be withdrawn at now
+         asset get_allowed_withdraw( const fc::time_point_sec& now )const;
    };
 
+   struct by_account;
+
+   /**
+    * The vesting balances of an account are found through by_account, in the order they were created.  The owner of a
+    * vesting balance never changes.
+    */
+   typedef multi_index_container<
+      vesting_balance_object,
+      indexed_by<
+         hashed_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
+         ordered_unique< tag<by_account>,
+            composite_key< vesting_balance_object,
+               member< vesting_balance_object, account_id_type, &vesting_balance_object::owner >,
+               member< object, object_id_type, &object::id >
+            >
+         >
+      >
+   > vesting_balance_multi_index_type;
+
+   typedef generic_index<vesting_balance_object, vesting_balance_multi_index_type> vesting_balance_index;
+
 } } // graphene::chain
 
+GRAPHENE_DB_OBJECT_INDEX( graphene::chain::vesting_balance_object, graphene::chain::vesting_balance_index )
+
 FC_REFLECT( graphene::chain::linear_vesting_policy,
    (vesting_seconds)
    (begin_date)
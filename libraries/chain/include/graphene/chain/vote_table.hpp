@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/chain/types.hpp>
+#include <graphene/db/index.hpp>
+
+#include <unordered_map>
+
+namespace graphene { namespace chain {
+
+   class database;
+   class account_object;
+
+   /**
+    *  @class vote_table
+    *  @brief Keeps the stake and opinions of every account in flat columns, for the maintenance vote tally
+    *
+    *  Tallying votes straight from the account index means looking up the statistics, cashback vesting balance and
+    *  core balance of each account, then its votes, all scattered across the heap.  This table follows those objects
+    *  as they are added, modified and removed, and keeps for each account instance its voting stake, the instance of
+    *  the account specifying its opinions and the vote set holding its opinions.
+    *
+    *  Vote sets are interned: accounts voting for the same votes and the same witness and committee counts, as is
+    *  common with default slates, share one set, whose votes are kept once in a single pool.  Sets are counted by
+    *  the accounts referring to them and reused once none does.
+    *
+    *  The totals are kept up to date as well: every change to an account takes its old contribution out of them and
+    *  puts the new one in, so a tally only copies them into the maintenance buffers.  The stake of the accounts whose
+    *  opinions an account specifies is summed into its weight, so that a change to its votes only touches the
+    *  totals once.  Totals are only rebuilt from the columns when count_non_prime_votes changes.
+    *
+    *  It must be observing the account, account statistics, account balance and vesting balance indexes, and be
+    *  added to the account balance index after the database's account_balance_table.
+    */
+   class vote_table : public graphene::db::index_observer
+   {
+      public:
+         explicit vote_table( const database& db );
+
+         virtual void on_add( const graphene::db::object& obj ) override;
+         virtual void on_remove( const graphene::db::object& obj ) override;
+         virtual void on_modify( const graphene::db::object& obj ) override;
+
+         /**
+          * Adds the stake of every counted account to the votes and the witness and committee counts chosen by
+          * the account specifying its opinions.  The buffers must already be sized for params.
+          */
+         void tally( const chain_parameters& params, vector<uint64_t>& votes, vector<uint64_t>& witness_histogram,
+                     vector<uint64_t>& committee_histogram, uint64_t& total_voting_stake );
+
+         /// @return the voting stake of account, as of the last change to any of the objects it is made of
+         uint64_t voting_stake( account_id_type account )const;
+
+      private:
+         enum account_flags : uint8_t
+         {
+            account_present = 1,
+            account_prime   = 2
+         };
+
+         /// Reads every column of the account again, ignoring removed, which is about to leave its index
+         void update_account( uint64_t instance, const graphene::db::object* removed = nullptr );
+         void clear_account( uint64_t instance );
+         void reserve_accounts( uint64_t instance );
+         bool is_counted( uint64_t instance )const;
+         /// Adds amount, which wraps around to take it out, to the votes and counts of instance
+         void add_opinions( uint64_t instance, uint64_t amount );
+         void add_stake( uint64_t instance, uint64_t amount );
+         /// Computes every total from the columns again
+         void rebuild_totals();
+         /// Adds amount, which wraps around to take it out, to the votes and counts of a vote set
+         void add_set_opinions( uint32_t set, uint64_t amount );
+         /// Points instance at the interned set of its opinions, releasing the set it had
+         void set_votes( uint64_t instance, const account_object& account );
+         /// @return the set holding the opinions in _scratch_votes, adding a reference to it
+         uint32_t intern_votes( uint16_t num_witness, uint16_t num_committee );
+         void release_votes( uint32_t set );
+         /// Moves the spans still in use to the front of the pool once more than half of it is unused
+         void compact_votes();
+
+         const database&     _db;
+
+         vector<uint8_t>     _flags;
+         vector<uint64_t>    _stake;
+         vector<uint32_t>    _opinion;
+         vector<uint32_t>    _vote_set;
+         /// The stake of the counted accounts whose opinions each account specifies
+         vector<uint64_t>    _weight;
+
+         /// Set 0 holds no votes and no counts, and is never released
+         vector<uint32_t>    _set_begin;
+         vector<uint32_t>    _set_size;
+         vector<uint16_t>    _set_num_witness;
+         vector<uint16_t>    _set_num_committee;
+         vector<uint32_t>    _set_refs;
+         vector<size_t>      _set_hash;
+         vector<uint32_t>    _free_sets;
+         std::unordered_multimap<size_t, uint32_t> _sets_by_hash;
+
+         /// The offsets of the votes of every set, in spans indexed by _set_begin and _set_size
+         vector<uint32_t>    _votes;
+         size_t              _unused_votes = 0;
+         vector<uint32_t>    _scratch_votes;
+
+         bool                _count_non_prime_votes = true;
+         /// Stake by vote offset, and by the number of witnesses and committee members voted for
+         vector<uint64_t>    _vote_totals;
+         vector<uint64_t>    _witness_count_totals;
+         vector<uint64_t>    _committee_count_totals;
+         uint64_t            _total_voting_stake = 0;
+
+         /// The account instance owning each statistics instance, plus one, or zero if unknown
+         vector<uint64_t>    _statistics_owner;
+   };
+
+} } // graphene::chain
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <cstdint>
+
+/**
+ * GRAPHENE_NATIVE_INT128 is set when the compiler provides a 128 bit integer, unless GRAPHENE_NO_NATIVE_INT128 is
+ * defined to build the portable routines instead.
+ */
+#if defined(__SIZEOF_INT128__) && !defined(GRAPHENE_NO_NATIVE_INT128)
+#define GRAPHENE_NATIVE_INT128 1
+#endif
+
+namespace graphene { namespace chain {
+
+   /**
+    * The 128 bit products and quotients of share amounts, which prices, fees and budgets are calculated with.
+    *
+    * The amounts are never negative nor above GRAPHENE_MAX_SHARE_SUPPLY, so two of them multiply without overflow
+    * in 128 bits.  The native integer is used where the compiler has one; the portable routines in detail are
+    * constexpr, so that their results can be checked at compile time, and also give the same results as the native
+    * integer.
+    */
+   namespace detail {
+
+      struct portable_uint128
+      {
+         uint64_t hi;
+         uint64_t lo;
+      };
+
+      constexpr bool operator == ( const portable_uint128& a, const portable_uint128& b )
+      {
+         return a.hi == b.hi && a.lo == b.lo;
+      }
+      constexpr bool operator < ( const portable_uint128& a, const portable_uint128& b )
+      {
+         return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+      }
+      constexpr bool operator != ( const portable_uint128& a, const portable_uint128& b ) { return !(a == b); }
+      constexpr bool operator <= ( const portable_uint128& a, const portable_uint128& b ) { return !(b < a); }
+      constexpr bool operator >  ( const portable_uint128& a, const portable_uint128& b ) { return b < a; }
+      constexpr bool operator >= ( const portable_uint128& a, const portable_uint128& b ) { return !(a < b); }
+
+      constexpr uint64_t low_half( uint64_t x ) { return x & 0xffffffff; }
+      constexpr uint64_t high_half( uint64_t x ) { return x >> 32; }
+
+      /// The sum of the partial products which make up bits 32 to 95 of a * b, which fits in 64 bits
+      constexpr uint64_t product_middle( uint64_t a, uint64_t b )
+      {
+         return high_half( low_half(a) * low_half(b) ) + low_half( low_half(a) * high_half(b) )
+              + low_half( high_half(a) * low_half(b) );
+      }
+
+      constexpr portable_uint128 portable_multiply( uint64_t a, uint64_t b )
+      {
+         return portable_uint128{ high_half(a) * high_half(b) + high_half( low_half(a) * high_half(b) )
+                                     + high_half( high_half(a) * low_half(b) ) + high_half( product_middle(a, b) ),
+                                  (product_middle(a, b) << 32) | low_half( low_half(a) * low_half(b) ) };
+      }
+
+      struct portable_quotient
+      {
+         uint64_t quotient;
+         uint64_t remainder;
+      };
+
+      /// Whether the bit of the dividend shifted into the remainder brings it up to the divisor
+      constexpr bool division_step_subtracts( uint64_t remainder, uint64_t lo, uint64_t divisor )
+      {
+         return (remainder >> 63) != 0 || ((remainder << 1) | (lo >> 63)) >= divisor;
+      }
+
+      /// Shifts the dividend into the remainder a bit at a time, as long division does
+      constexpr portable_quotient long_divide( uint64_t remainder, uint64_t lo, uint64_t divisor, int bits,
+                                               uint64_t quotient )
+      {
+         return bits == 0 ? portable_quotient{ quotient, remainder }
+                          : long_divide( ((remainder << 1) | (lo >> 63))
+                                            - (division_step_subtracts(remainder, lo, divisor) ? divisor : 0),
+                                         lo << 1, divisor, bits - 1,
+                                         (quotient << 1) | (division_step_subtracts(remainder, lo, divisor) ? 1 : 0) );
+      }
+
+      /// The quotient only fits in 64 bits when the high half of the dividend is below the divisor
+      constexpr bool portable_quotient_fits( const portable_uint128& dividend, uint64_t divisor )
+      {
+         return dividend.hi < divisor;
+      }
+
+      /// @pre portable_quotient_fits( dividend, divisor )
+      constexpr portable_quotient portable_divide( const portable_uint128& dividend, uint64_t divisor )
+      {
+         return long_divide( dividend.hi, dividend.lo, divisor, 64, 0 );
+      }
+
+   } // detail
+
+#ifdef GRAPHENE_NATIVE_INT128
+   typedef unsigned __int128 uint128_product;
+
+   inline uint128_product multiply( uint64_t a, uint64_t b )
+   {
+      return uint128_product(a) * b;
+   }
+
+   /**
+    * Sets quotient to a * b / divisor, and remainder to what is left over when it is not null
+    * @return false, leaving quotient unset, when the quotient does not fit in 64 bits
+    */
+   inline bool multiply_divide( uint64_t a, uint64_t b, uint64_t divisor, uint64_t& quotient,
+                                uint64_t* remainder = nullptr )
+   {
+      const uint128_product product = multiply( a, b );
+      const uint128_product result = product / divisor;
+      if( (result >> 64) != 0 )
+         return false;
+      quotient = uint64_t(result);
+      if( remainder )
+         *remainder = uint64_t(product % divisor);
+      return true;
+   }
+#else
+   typedef detail::portable_uint128 uint128_product;
+
+   inline uint128_product multiply( uint64_t a, uint64_t b )
+   {
+      return detail::portable_multiply( a, b );
+   }
+
+   /**
+    * Sets quotient to a * b / divisor, and remainder to what is left over when it is not null
+    * @return false, leaving quotient unset, when the quotient does not fit in 64 bits
+    */
+   inline bool multiply_divide( uint64_t a, uint64_t b, uint64_t divisor, uint64_t& quotient,
+                                uint64_t* remainder = nullptr )
+   {
+      const uint128_product product = multiply( a, b );
+      if( !detail::portable_quotient_fits( product, divisor ) )
+         return false;
+      const detail::portable_quotient result = detail::portable_divide( product, divisor );
+      quotient = result.quotient;
+      if( remainder )
+         *remainder = result.remainder;
+      return true;
+   }
+#endif
+
+} } // graphene::chain
@@ -18,6 +18,7 @@
 #pragma once
 #include <graphene/chain/asset.hpp>
 #include <graphene/db/object.hpp>
+#include <graphene/db/slab_index.hpp>
 
 namespace graphene { namespace chain {
    using namespace graphene::db;
@@ -36,17 +37,25 @@ namespace graphene { namespace chain {
          secret_hash_type               last_secret;
          share_type                     accumulated_income;
          vote_id_type                   vote_id;
+         /// The last block signed by this witness, which confirms every block before it
+         uint32_t                       last_confirmed_block_num = 0;
 
          witness_object() : vote_id(vote_id_type::witness) {}
    };
 
+   /// Witnesses are scanned in full at every maintenance interval
+   typedef slab_index<witness_object> witness_index;
+
 } } // graphene::chain
 
+GRAPHENE_DB_OBJECT_INDEX( graphene::chain::witness_object, graphene::chain::witness_index )
+
 FC_REFLECT_DERIVED( graphene::chain::witness_object, (graphene::db::object),
                     (witness_account)
                     (signing_key)
                     (next_secret)
                     (last_secret)
                     (accumulated_income)
-                    (vote_id) )
+                    (vote_id)
+                    (last_confirmed_block_num) )
 
@@ -31,12 +31,13 @@ typedef hash_ctr_rng<
    /* SeedLength = */ GRAPHENE_RNG_SEED_LENGTH
    > witness_scheduler_rng;
 
+// The schedulers run without checking their invariant, which walks every witness after each step
 typedef generic_witness_scheduler<
    /* WitnessID  = */ witness_id_type,
    /* RNG        = */ witness_scheduler_rng,
    /* CountType  = */ decltype( chain_parameters::maximum_witness_count ),
    /* OffsetType = */ uint32_t,
-   /* debug      = */ true
+   /* debug      = */ false
    > witness_scheduler;
 
 typedef generic_far_future_witness_scheduler<
@@ -44,7 +45,7 @@ typedef generic_far_future_witness_scheduler<
    /* RNG        = */ witness_scheduler_rng,
    /* CountType  = */ decltype( chain_parameters::maximum_witness_count ),
    /* OffsetType = */ uint32_t,
-   /* debug      = */ true
+   /* debug      = */ false
    > far_future_witness_scheduler;
 
 class witness_schedule_object : public abstract_object<witness_schedule_object>
@@ -238,44 +238,39 @@ class generic_witness_scheduler
        * Convenience function to call insert_all() and remove_all()
        * as needed to update to the given revised_set.
        *
-       * This function calls find() on revised_set for all current
-       * witnesses.  Running time is O(n*log(n)) if the revised_set
-       * implementation of find() is O(log(n)).
-       *
-       * TODO:  Rewriting to use std::set_difference may marginally
-       * increase efficiency, but a benchmark is needed to justify this.
+       * The current witnesses are sorted once into sets rather than
+       * inserted one by one, and the sets are filled in order, so
+       * running time is O(n*log(n)) if the revised_set implementation
+       * of find() is O(log(n)).
        */
       template< typename T >
       void update( const T& revised_set )
       {
-         flat_set< WitnessID > current_set;
-         flat_set< WitnessID > schedule_set;
-
-         current_set.reserve(
+         std::vector< WitnessID > current;
+         current.reserve(
               _ineligible_waiting_for_token.size()
             + _ineligible_no_turn.size()
             + _eligible.size()
             + _schedule.size() );
          for( const auto& item : _ineligible_waiting_for_token )
-            current_set.insert( item.first );
-         for( const WitnessID& item : _ineligible_no_turn )
-            current_set.insert( item );
-         for( const WitnessID& item : _eligible )
-            current_set.insert( item );
-         for( const WitnessID& item : _schedule )
-         {
-            current_set.insert( item );
-            schedule_set.insert( item );
-         }
-
-         flat_set< WitnessID > insertion_set;
-         insertion_set.reserve( revised_set.size() );
+            current.push_back( item.first );
+         current.insert( current.end(), _ineligible_no_turn.begin(), _ineligible_no_turn.end() );
+         current.insert( current.end(), _eligible.begin(), _eligible.end() );
+         current.insert( current.end(), _schedule.begin(), _schedule.end() );
+         const flat_set< WitnessID > current_set = sorted_set( std::move( current ) );
+         const flat_set< WitnessID > schedule_set =
+            sorted_set( std::vector< WitnessID >( _schedule.begin(), _schedule.end() ) );
+
+         std::vector< WitnessID > inserted;
+         inserted.reserve( revised_set.size() );
          for( const WitnessID& item : revised_set )
          {
             if( current_set.find( item ) == current_set.end() )
-               insertion_set.insert( item );
+               inserted.push_back( item );
          }
+         const flat_set< WitnessID > insertion_set = sorted_set( std::move( inserted ) );
 
+         // current_set is walked in order, so each removal goes at the end
          flat_set< WitnessID > removal_set;
          removal_set.reserve( current_set.size() );
          for( const WitnessID& item : current_set )
@@ -283,7 +278,7 @@ class generic_witness_scheduler
             if( revised_set.find( item ) == revised_set.end() )
             {
                if( schedule_set.find( item ) == schedule_set.end() )
-                  removal_set.insert( item );
+                  removal_set.insert( removal_set.end(), item );
                else
                   _lame_duck.insert( item );
             }
@@ -312,6 +307,21 @@ class generic_witness_scheduler
          return true;
       }
 
+      bool operator==( const generic_witness_scheduler& other )const
+      {
+         return _turns == other._turns && _tokens == other._tokens && _min_token_count == other._min_token_count &&
+                _ineligible_waiting_for_token == other._ineligible_waiting_for_token &&
+                _ineligible_no_turn == other._ineligible_no_turn && _eligible == other._eligible &&
+                _schedule == other._schedule && _lame_duck == other._lame_duck;
+      }
+
+      static flat_set< WitnessID > sorted_set( std::vector< WitnessID > items )
+      {
+         std::sort( items.begin(), items.end() );
+         items.erase( std::unique( items.begin(), items.end() ), items.end() );
+         return flat_set< WitnessID >( boost::container::ordered_unique_range, items.begin(), items.end() );
+      }
+
       // keep track of total turns / tokens in existence
       CountType _turns = 0;
       CountType _tokens = 0;
@@ -19,6 +19,9 @@
 
 #include <boost/multiprecision/integer.hpp>
 
+#include <algorithm>
+#include <cstring>
+
 namespace graphene { namespace chain {
 
 /**
@@ -37,6 +40,11 @@ class nullary_rng
 /**
  * The sha256_ctr_rng generates bits using SHA256 in counter (CTR)
  * mode.
+ *
+ * Bit i of the output is bit (i % 8) of byte (i / 8) of the hash of the
+ * seed and the counter, with the counter advancing every 256 bits.  The
+ * hash of a counter is only computed once bits are drawn from it, so an
+ * rng which is constructed but never drawn from costs nothing.
  */
 template< class HashClass, int SeedLength=32 >
 class hash_ctr_rng
@@ -46,7 +54,6 @@ class hash_ctr_rng
          : _counter( counter ), _current_offset( 0 )
       {
          memcpy( _seed, seed, SeedLength );
-         _reset_current_value();
          return;
       }
 
@@ -55,28 +62,24 @@ class hash_ctr_rng
       uint64_t get_bits( uint8_t count )
       {
          uint64_t result = 0;
-         uint64_t mask = 1;
-         // grab the requested number of bits
+         uint8_t filled = 0;
+         // grab the requested number of bits, as many at a time as are left in the current byte
          while( count > 0 )
          {
-            result |=
-               (
-                  (
-                     (
-                        _current_value.data()[ (_current_offset >> 3) & 0x1F ]
-                        & ( 1 << (_current_offset & 0x07) )
-                     )
-                     != 0
-                  ) ? mask : 0
-               );
-            mask += mask;
-            --count;
-            ++_current_offset;
+            if( !_has_current_value )
+               _reset_current_value();
+            const uint8_t bit = _current_offset & 0x07;
+            const uint8_t taken = std::min< uint8_t >( count, 8 - bit );
+            const uint8_t byte = uint8_t( _current_value.data()[ (_current_offset >> 3) & 0x1F ] );
+            result |= uint64_t( (byte >> bit) & ((1u << taken) - 1) ) << filled;
+            filled += taken;
+            count -= taken;
+            _current_offset += taken;
             if( _current_offset == (_current_value.data_size() << 3) )
             {
                _counter++;
                _current_offset = 0;
-               _reset_current_value();
+               _has_current_value = false;
             }
          }
          return result;
@@ -86,26 +89,30 @@ class hash_ctr_rng
       {
          if( bound <= 1 )
             return 0;
-#ifdef __GNUC__
-         uint8_t bitcount( 64 - __builtin_clzll( bound ) );
-#else
-         uint8_t bitcount( 64 - boost::multiprecision::detail::find_msb( bound ) );
-#endif
-
-         // probability of loop exiting is >= 1/2, so probability of
-         // running N times is bounded above by (1/2)^N
-         while( true )
-         {
-            uint64_t result = get_bits( bitcount );
-            if( result < bound )
-               return result;
-         }
+         return _draw( bound, _bitcount( bound ) );
       }
 
       // convenience method which does casting for types other than uint64_t
       template< typename T > T operator()( T bound )
       {  return (T) ( (*this)(uint64_t( bound )) );   }
 
+      /**
+       * Fills draws with count values below bound, the same values as count
+       * calls of operator() would return, working out the number of bits of
+       * bound once for all of them
+       */
+      void draw( uint64_t bound, uint64_t* draws, size_t count )
+      {
+         if( bound <= 1 )
+         {
+            std::fill( draws, draws + count, 0 );
+            return;
+         }
+         const uint8_t bitcount = _bitcount( bound );
+         for( size_t i = 0; i < count; ++i )
+            draws[i] = _draw( bound, bitcount );
+      }
+
       void _reset_current_value()
       {
          // internal implementation detail, called to update
@@ -114,6 +121,7 @@ class hash_ctr_rng
          enc.write(           _seed   , SeedLength );
          enc.write( (char *) &_counter,          8 );
          _current_value = enc.result();
+         _has_current_value = true;
          return;
       }
 
@@ -121,8 +129,31 @@ class hash_ctr_rng
       char _seed[ SeedLength ];
       HashClass _current_value;
       uint16_t _current_offset;
+      bool _has_current_value = false;
 
       static const int seed_length = SeedLength;
+
+   private:
+      static uint8_t _bitcount( uint64_t bound )
+      {
+#ifdef __GNUC__
+         return uint8_t( 64 - __builtin_clzll( bound ) );
+#else
+         return uint8_t( 64 - boost::multiprecision::detail::find_msb( bound ) );
+#endif
+      }
+
+      uint64_t _draw( uint64_t bound, uint8_t bitcount )
+      {
+         // probability of loop exiting is >= 1/2, so probability of
+         // running N times is bounded above by (1/2)^N
+         while( true )
+         {
+            uint64_t result = get_bits( bitcount );
+            if( result < bound )
+               return result;
+         }
+      }
 } ;
 
 } }
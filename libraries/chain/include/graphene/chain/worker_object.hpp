@@ -19,7 +19,7 @@
 #include <graphene/chain/asset.hpp>
 #include <graphene/db/object.hpp>
 
-#include <graphene/db/flat_index.hpp>
+#include <graphene/db/generic_index.hpp>
 
 #include <fc/static_variant.hpp>
 
@@ -180,7 +180,17 @@ namespace graphene { namespace chain {
          }
    };
 
-   typedef flat_index<worker_object> worker_index;
+   struct by_end_date;
+   typedef multi_index_container<
+      worker_object,
+      indexed_by<
+         hashed_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
+         ordered_non_unique< tag<by_end_date>, member< worker_object, time_point_sec, &worker_object::work_end_date > >
+      >
+   > worker_object_multi_index_type;
+
+   /// Workers by the end of their work, so that payroll skips those whose work is over
+   typedef generic_index<worker_object, worker_object_multi_index_type> worker_index;
 
 } } // graphene::chain
 
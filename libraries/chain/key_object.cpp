@@ -17,19 +17,44 @@
  */
 #include <graphene/chain/key_object.hpp>
 #include <graphene/chain/types.hpp>
+#include <graphene/db/object_database.hpp>
 
 namespace graphene { namespace chain {
-   address key_object::key_address()const
+   const address& key_object::key_address()const
    {
       typedef  static_variant<address,public_key_type> address_or_key;
 
+      if( _address )
+         return *_address;
       switch( key_data.which() )
       {
          case address_or_key::tag<address>::value:
-            return key_data.get<address>();
+            _address = key_data.get<address>();
+            break;
          case address_or_key::tag<public_key_type>::value:
          default:
-            return key_data.get<public_key_type>();
+            _address = address( key_data.get<public_key_type>() );
       }
+      return *_address;
+   }
+
+   const address& key_address_table::get( const graphene::db::object_database& db, key_id_type id )
+   {
+      auto instance = id.instance.value;
+      if( instance < _addresses.size() && _addresses[instance] )
+         return *_addresses[instance];
+
+      // Look the key up first, so a bogus id fails without growing the table
+      const address& key_address = id(db).key_address();
+      if( instance >= _addresses.size() )
+         _addresses.resize( instance + 1 );
+      _addresses[instance] = key_address;
+      return *_addresses[instance];
+   }
+
+   void key_address_table::forget( object_id_type id )
+   {
+      if( id.instance() < _addresses.size() )
+         _addresses[id.instance()].reset();
    }
 } }
@@ -37,6 +37,10 @@ object_id_type limit_order_create_evaluator::do_evaluate( const limit_order_crea
    if( _sell_asset->options.blacklist_markets.size() )
       FC_ASSERT( _sell_asset->options.blacklist_markets.find( _receive_asset->id ) == _sell_asset->options.blacklist_markets.end() );
 
+   _batched = ( _sell_asset->matches_in_batches() || _receive_asset->matches_in_batches() )
+              && !_sell_asset->is_market_issued() && !_receive_asset->is_market_issued();
+   FC_ASSERT( !_batched || !op.fill_or_kill, "orders in batch matched markets are only matched at the end of the block" );
+
    if( _sell_asset->enforce_white_list() ) FC_ASSERT( _seller->is_authorized_asset( *_sell_asset ) );
    if( _receive_asset->enforce_white_list() ) FC_ASSERT( _seller->is_authorized_asset( *_receive_asset ) );
 
@@ -68,30 +72,24 @@ object_id_type limit_order_create_evaluator::do_apply( const limit_order_create_
    });
    limit_order_id_type result = new_order_object.id; // save this because we may remove the object by filling it
 
-   // Possible optimization: We only need to check calls if both are true:
-   //  - The new order is at the front of the book
-   //  - The new order is below the call limit price
+   if( _batched )
+   {
+      db().defer_matching( _sell_asset->id, _receive_asset->id );
+      return result;
+   }
+
+   // check_call_orders returns at once unless an order, call order or feed of the asset changed since it last found
+   // nothing to call
    bool called_some = db().check_call_orders(*_sell_asset);
    called_some |= db().check_call_orders(*_receive_asset);
    if( called_some && !db().find(result) ) // then we were filled by call order
       return result;
 
-   const auto& limit_order_idx = db().get_index_type<limit_order_index>();
-   const auto& limit_price_idx = limit_order_idx.indices().get<by_price>();
-
-   // TODO: it should be possible to simply check the NEXT/PREV iterator after new_order_object to
-   // determine whether or not this order has "changed the book" in a way that requires us to
-   // check orders.   For now I just lookup the lower bound and check for equality... this is log(n) vs
-   // constant time check. Potential optimization.
+   const auto& limit_book = db().get_limit_order_book();
 
+   // Each match either fills the new order or removes the best order of the book, so the best order is looked up
+   // afresh every time
    auto max_price  = ~op.get_price(); //op.min_to_receive / op.amount_to_sell;
-   auto limit_itr = limit_price_idx.lower_bound( max_price.max() );
-   auto limit_end = limit_price_idx.upper_bound( max_price );
-
-   for( auto tmp = limit_itr; tmp != limit_end; ++tmp )
-   {
-      assert( tmp != limit_price_idx.end() );
-   }
 
    bool filled = false;
    //if( new_order_object.amount_to_receive().asset_id(db()).is_market_issued() )
@@ -104,47 +102,26 @@ object_id_type limit_order_create_evaluator::do_apply( const limit_order_create_
          if( converted_some && !db().find(result) ) // then we were filled by call order
             return result;
       }
-      const auto& short_order_idx = db().get_index_type<short_order_index>();
-      const auto& sell_price_idx = short_order_idx.indices().get<by_price>();
-
-      FC_ASSERT( max_price.max() >= max_price );
-      auto short_itr = sell_price_idx.lower_bound( max_price.max() );
-      auto short_end = sell_price_idx.upper_bound( max_price );
+      const auto& short_book = db().get_short_order_book();
 
       while( !filled )
       {
-         if( limit_itr != limit_end )
-         {
-            if( short_itr != short_end && limit_itr->sell_price < short_itr->sell_price )
-            {
-               auto old_short_itr = short_itr;
-               ++short_itr;
-               filled = (db().match( new_order_object, *old_short_itr, old_short_itr->sell_price ) != 2 );
-            }
-            else
-            {
-               auto old_limit_itr = limit_itr;
-               ++limit_itr;
-               filled = (db().match( new_order_object, *old_limit_itr, old_limit_itr->sell_price ) != 2 );
-            }
-         }
-         else if( short_itr != short_end  )
-         {
-            auto old_short_itr = short_itr;
-            ++short_itr;
-            filled = (db().match( new_order_object, *old_short_itr, old_short_itr->sell_price ) != 2 );
-         }
+         const limit_order_object* limit = limit_book.best( max_price );
+         const short_order_object* short_order = short_book.best( max_price );
+         if( short_order && ( !limit || limit->sell_price < short_order->sell_price ) )
+            filled = (db().match( new_order_object, *short_order, short_order->sell_price ) != 2 );
+         else if( limit )
+            filled = (db().match( new_order_object, *limit, limit->sell_price ) != 2 );
          else break;
       }
    }
-   else while( !filled && limit_itr != limit_end  )
+   else while( !filled )
    {
-         auto old_itr = limit_itr;
-         ++limit_itr;
-         filled = (db().match( new_order_object, *old_itr, old_itr->sell_price ) != 2);
+         const limit_order_object* limit = limit_book.best( max_price );
+         if( !limit ) break;
+         filled = (db().match( new_order_object, *limit, limit->sell_price ) != 2);
    }
 
-   //Possible optimization: only check calls if the new order completely filled some old order
    //Do I need to check both assets?
    db().check_call_orders(*_sell_asset);
    db().check_call_orders(*_receive_asset);
@@ -176,7 +153,7 @@ asset limit_order_cancel_evaluator::do_apply( const limit_order_cancel_operation
 
    db().cancel_order( *_order, false /* don't create a virtual op*/ );
 
-   // Possible optimization: order can be called by canceling a limit order iff the canceled order was at the top of the book.
+   // Canceling an order never makes a call possible, so these return at once unless something else changed.
    // Do I need to check calls in both assets?
    db().check_call_orders(base_asset(d));
    db().check_call_orders(quote_asset(d));
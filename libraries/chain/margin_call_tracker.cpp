@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/margin_call_tracker.hpp>
+#include <graphene/chain/limit_order_object.hpp>
+#include <graphene/chain/short_order_object.hpp>
+
+namespace graphene { namespace chain {
+
+void margin_call_tracker::on_add( const graphene::db::object& obj )
+{
+   on_modify( obj );
+}
+
+void margin_call_tracker::on_modify( const graphene::db::object& obj )
+{
+   if( obj.id.space() == protocol_ids )
+   {
+      switch( obj.id.type() )
+      {
+         case limit_order_object_type:
+         {
+            const auto& order = static_cast<const limit_order_object&>( obj );
+            changed( order.sell_price.base.asset_id, order.sell_price.quote.asset_id );
+            break;
+         }
+         case short_order_object_type:
+         {
+            const auto& order = static_cast<const short_order_object&>( obj );
+            changed( order.sell_price.base.asset_id, order.sell_price.quote.asset_id );
+            break;
+         }
+         case call_order_object_type:
+         {
+            const auto& call = static_cast<const call_order_object&>( obj );
+            changed( call.call_price.base.asset_id, call.call_price.quote.asset_id );
+            break;
+         }
+         default:
+            break;
+      }
+   }
+   else if( obj.id.space() == implementation_ids && obj.id.type() == impl_asset_bitasset_data_type )
+   {
+      // The bitasset data does not name its asset, and feeds change seldom enough to forget them all
+      _settled.clear();
+   }
+}
+
+void margin_call_tracker::changed( asset_id_type a, asset_id_type b )
+{
+   _settled.erase( a );
+   _settled.erase( b );
+}
+
+} } // graphene::chain
@@ -755,6 +755,21 @@ share_type vesting_balance_withdraw_operation::calculate_fee( const fee_schedule
    return k.at( vesting_balance_withdraw_fee_type );
 }
 
+void vesting_balance_withdraw_all_operation::get_required_auth(flat_set<account_id_type>& active_auth_set, flat_set<account_id_type>&)const
+{
+   active_auth_set.insert( owner );
+}
+
+void vesting_balance_withdraw_all_operation::validate()const
+{
+   FC_ASSERT( fee.amount >= 0 );
+}
+
+share_type vesting_balance_withdraw_all_operation::calculate_fee( const fee_schedule_type& k )const
+{
+   return k.at( vesting_balance_withdraw_fee_type );
+}
+
 void memo_data::set_message( const fc::ecc::private_key& priv,
                              const fc::ecc::public_key& pub, const string& msg )
 {
@@ -23,6 +23,13 @@ namespace graphene { namespace chain {
 
 bool proposal_object::is_authorized_to_execute(database* db) const
 {
+   // Most proposals are approved directly by every account they need, which the dry run would accept on sight
+   if( std::includes(available_active_approvals.begin(), available_active_approvals.end(),
+                     required_active_approvals.begin(), required_active_approvals.end()) &&
+       std::includes(available_owner_approvals.begin(), available_owner_approvals.end(),
+                     required_owner_approvals.begin(), required_owner_approvals.end()) )
+      return true;
+
    transaction_evaluation_state dry_run_eval(db);
    dry_run_eval._is_proposed_trx = true;
    std::transform(available_active_approvals.begin(), available_active_approvals.end(),
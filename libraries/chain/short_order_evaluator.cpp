@@ -87,31 +87,23 @@ object_id_type short_order_create_evaluator::do_apply( const short_order_create_
       });
    }
 
-   // Possible optimization: We only need to check calls if both are true:
-   //  - The new order is at the front of the book
-   //  - The new order is below the call limit price
+   // check_call_orders returns at once unless an order, call order or feed of the asset changed since it last found
+   // nothing to call
    db().check_call_orders(*_sell_asset);
 
    if( !db().find(new_id) ) // then we were filled by call order
       return new_id;
 
-   const auto& limit_order_idx = db().get_index_type<limit_order_index>();
-   const auto& limit_price_idx = limit_order_idx.indices().get<by_price>();
+   const auto& limit_book = db().get_limit_order_book();
 
    auto min_limit_price  = ~op.sell_price();
 
-   auto itr = limit_price_idx.lower_bound( min_limit_price.max() );
-   auto end = limit_price_idx.upper_bound( min_limit_price );
-
-   while( itr != end )
+   while( const limit_order_object* limit = limit_book.best( min_limit_price ) )
    {
-      auto old_itr = itr;
-      ++itr;
-      if( db().match( *old_itr, new_order_object, old_itr->sell_price ) != 1 )
+      if( db().match( *limit, new_order_object, limit->sell_price ) != 1 )
          break; // 1 means ONLY old iter filled
    }
 
-   //Possible optimization: only check calls if the new order completely filled some old order
    //Do I need to check both assets?
    db().check_call_orders(*_sell_asset);
    db().check_call_orders(*_receive_asset);
@@ -135,21 +127,12 @@ asset short_order_cancel_evaluator::do_apply( const short_order_cancel_operation
    database&   d = db();
 
    auto refunded = _order->get_collateral();
-   d.adjust_balance(o.fee_paying_account, refunded);
    auto base_asset = _order->sell_price.base.asset_id;
    auto quote_asset = _order->sell_price.quote.asset_id;
 
-   d.remove( *_order );
-
-   if( refunded.asset_id == asset_id_type() )
-   {
-      auto& stats_obj = fee_paying_account->statistics(d);
-      d.modify( stats_obj, [&]( account_statistics_object& obj ){
-          obj.total_core_in_orders -= refunded.amount;
-      });
-   }
+   d.cancel_order( *_order );
 
-   // Possible optimization: order can be called by canceling a short order iff the canceled order was at the top of the book.
+   // Canceling an order never makes a call possible, so these return at once unless something else changed.
    // Do I need to check calls in both assets?
    db().check_call_orders(base_asset(d));
    db().check_call_orders(quote_asset(d));
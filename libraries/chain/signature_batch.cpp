@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/signature_batch.hpp>
+
+namespace graphene { namespace chain {
+
+uint32_t signature_batch::add( const digest_type& digest, const signature_type& signature, bool enforce_canonical )
+{
+   _items.push_back( item{ digest, signature, enforce_canonical } );
+   return _items.size() - 1;
+}
+
+void signature_batch::clear()
+{
+   _items.clear();
+   _signers.clear();
+}
+
+bool signature_batch::verify( const utilities::thread_group& threads, signature_cache* cache )
+{
+   _signers.resize( _items.size() );
+   std::atomic<bool> failed( false );
+
+   size_t thread_count = std::min( threads.size(), _items.size() );
+   if( thread_count == 0 )
+   {
+      verify_range( 0, _items.size(), cache, failed );
+      return !failed;
+   }
+
+   size_t chunk_size = (_items.size() + thread_count - 1) / thread_count;
+   vector<fc::future<void>> workers;
+   workers.reserve( thread_count );
+   for( size_t t = 0; t < thread_count; ++t )
+   {
+      size_t begin = t * chunk_size;
+      size_t end = std::min( begin + chunk_size, _items.size() );
+      workers.push_back( threads[t]->async( [this, begin, end, cache, &failed]() {
+         verify_range( begin, end, cache, failed );
+      }, "signature_batch::verify" ) );
+   }
+   for( auto& worker : workers )
+      worker.wait();
+
+   return !failed;
+}
+
+void signature_batch::verify_range( size_t begin, size_t end, signature_cache* cache, std::atomic<bool>& failed )
+{
+   for( size_t i = begin; i < end && !failed; ++i )
+   {
+      const item& it = _items[i];
+      try {
+         if( it.enforce_canonical )
+            _signers[i] = fc::ecc::public_key( it.signature, it.digest, true );
+         else if( cache )
+            _signers[i] = cache->recover( it.digest, it.signature );
+         else
+            _signers[i] = fc::ecc::public_key( it.signature, it.digest );
+      } catch( const fc::exception& ) {
+         failed = true;
+      }
+   }
+}
+
+} } // graphene::chain
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/signature_cache.hpp>
+
+namespace graphene { namespace chain {
+
+address signature_cache::recover( const digest_type& digest, const signature_type& signature )
+{
+   signature_key key{ digest, signature };
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      auto& by_key_idx = _entries.get<by_key>();
+      auto itr = by_key_idx.find( key );
+      if( itr != by_key_idx.end() )
+      {
+         ++_hits;
+         return itr->signer;
+      }
+      ++_misses;
+   }
+
+   // Don't hold the lock while recovering the key, that is what the other threads are waiting to do too
+   address signer = fc::ecc::public_key( signature, digest );
+
+   std::lock_guard<std::mutex> lock( _mutex );
+   if( _max_size == 0 )
+      return signer;
+   _entries.push_back( cache_entry{ key, signer } );
+   evict();
+   return signer;
+}
+
+void signature_cache::set_max_size( uint32_t max_size )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   _max_size = max_size;
+   evict();
+}
+
+void signature_cache::clear()
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   _entries.clear();
+   _hits = 0;
+   _misses = 0;
+}
+
+signature_cache_stats signature_cache::get_stats()const
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   signature_cache_stats stats;
+   stats.hits = _hits;
+   stats.misses = _misses;
+   stats.size = _entries.size();
+   stats.max_size = _max_size;
+   return stats;
+}
+
+void signature_cache::evict()
+{
+   while( _entries.size() > _max_size )
+      _entries.pop_front();
+}
+
+} } // graphene::chain
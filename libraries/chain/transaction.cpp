@@ -22,15 +22,38 @@ namespace graphene { namespace chain {
 
 digest_type transaction::digest(const block_id_type& ref_block_id) const
 {
+   if( _hash_cache.ref_digest && _hash_cache.ref_digest->first == ref_block_id )
+      return _hash_cache.ref_digest->second;
    digest_type::encoder enc;
    fc::raw::pack( enc, ref_block_id );
    fc::raw::pack( enc, *this );
-   return enc.result();
+   auto result = enc.result();
+   if( _hash_cache.enabled )
+      _hash_cache.ref_digest = std::make_pair( ref_block_id, result );
+   return result;
 }
 
 digest_type processed_transaction::merkle_digest()const
 {
-   return digest_type::hash(*this);
+   if( _hash_cache.merkle_digest )
+      return *_hash_cache.merkle_digest;
+   auto result = digest_type::hash(*this);
+   if( _hash_cache.enabled )
+      _hash_cache.merkle_digest = result;
+   return result;
+}
+
+/// The hash of the serialized transaction, shared by id() and digest()
+static digest_type transaction_hash( const transaction& trx, detail::transaction_hash_cache& cache )
+{
+   if( cache.digest )
+      return *cache.digest;
+   digest_type::encoder enc;
+   fc::raw::pack( enc, trx );
+   auto result = enc.result();
+   if( cache.enabled )
+      cache.digest = result;
+   return result;
 }
 
 digest_type transaction::digest()const
@@ -38,9 +61,7 @@ digest_type transaction::digest()const
    //Only use this digest() for transactions with absolute expiration times.
    if( relative_expiration != 0 ) edump((*this));
    assert(relative_expiration == 0);
-   digest_type::encoder enc;
-   fc::raw::pack( enc, *this );
-   return enc.result();
+   return transaction_hash( *this, _hash_cache );
 }
 void transaction::validate() const
 {
@@ -48,20 +69,20 @@ void transaction::validate() const
       FC_ASSERT( ref_block_num == 0 && ref_block_prefix > 0 );
 
    for( const auto& op : operations )
-      op.visit(operation_validator());
+      dispatch(op, operation_validator());
 }
 
 graphene::chain::transaction_id_type graphene::chain::transaction::id() const
 {
-   digest_type::encoder enc;
-   fc::raw::pack(enc, *this);
-   auto hash = enc.result();
+   auto hash = transaction_hash( *this, _hash_cache );
    transaction_id_type result;
    memcpy(result._hash, hash._hash, std::min(sizeof(result), sizeof(hash)));
    return result;
 }
 void graphene::chain::signed_transaction::sign( key_id_type id, const private_key_type& key )
 {
+   // The signatures are part of the merkle digest
+   _hash_cache.merkle_digest.reset();
    if( relative_expiration != 0 )
    {
       if( !block_id_cache.valid() ) edump((*this));
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/transaction_conflicts.hpp>
+
+#include <algorithm>
+#include <map>
+
+namespace graphene { namespace chain {
+
+namespace {
+   template<typename Set>
+   bool intersects( const Set& a, const Set& b )
+   {
+      auto i = a.begin();
+      auto j = b.begin();
+      while( i != a.end() && j != b.end() )
+      {
+         if( *i < *j )
+            ++i;
+         else if( *j < *i )
+            ++j;
+         else
+            return true;
+      }
+      return false;
+   }
+
+   /// Union-find over the transactions of one stage
+   struct transaction_sets
+   {
+      vector<uint32_t> parent;
+
+      uint32_t add()
+      {
+         parent.push_back( parent.size() );
+         return parent.back();
+      }
+      uint32_t find( uint32_t i )
+      {
+         while( parent[i] != i )
+            i = parent[i] = parent[parent[i]];
+         return i;
+      }
+      void join( uint32_t a, uint32_t b )
+      {
+         a = find( a );
+         b = find( b );
+         // The earlier transaction stays the root, so groups are found in the order of their first transaction
+         if( a != b )
+            parent[std::max( a, b )] = std::min( a, b );
+      }
+   };
+
+   /// Joins transaction i with the last earlier transaction of the stage holding key
+   template<typename Key>
+   void claim( std::map<Key, uint32_t>& owners, const Key& key, uint32_t i, transaction_sets& sets )
+   {
+      auto itr = owners.find( key );
+      if( itr != owners.end() )
+         sets.join( itr->second, i );
+      else
+         owners.emplace( key, i );
+   }
+}
+
+void operation_footprint::add_market( asset_id_type a, asset_id_type b )
+{
+   markets.insert( std::make_pair( std::min( a, b ), std::max( a, b ) ) );
+}
+
+void operation_footprint::merge( const operation_footprint& other )
+{
+   accounts.insert( other.accounts.begin(), other.accounts.end() );
+   objects.insert( other.objects.begin(), other.objects.end() );
+   assets_read.insert( other.assets_read.begin(), other.assets_read.end() );
+   assets_written.insert( other.assets_written.begin(), other.assets_written.end() );
+   markets.insert( other.markets.begin(), other.markets.end() );
+   created.insert( other.created.begin(), other.created.end() );
+   unbounded |= other.unbounded;
+}
+
+bool operation_footprint::conflicts_with( const operation_footprint& other )const
+{
+   return unbounded || other.unbounded
+       || intersects( accounts, other.accounts )
+       || intersects( objects, other.objects )
+       || intersects( markets, other.markets )
+       || intersects( created, other.created )
+       || intersects( assets_written, other.assets_written )
+       || intersects( assets_written, other.assets_read )
+       || intersects( assets_read, other.assets_written );
+}
+
+void operation_get_footprint::add_fee( account_id_type payer, const asset& fee )const
+{
+   footprint.accounts.insert( payer );
+   if( fee.asset_id != asset_id_type() )
+      footprint.assets_written.insert( fee.asset_id );
+}
+
+void operation_get_footprint::add( const transfer_operation& op )const
+{
+   footprint.accounts.insert( op.to );
+   footprint.assets_read.insert( op.amount.asset_id );
+   footprint.created.insert( object_id_type( implementation_ids, impl_account_balance_object_type, 0 ) );
+}
+
+void operation_get_footprint::add( const limit_order_create_operation& op )const
+{
+   footprint.assets_read.insert( op.amount_to_sell.asset_id );
+   footprint.assets_read.insert( op.min_to_receive.asset_id );
+   footprint.add_market( op.amount_to_sell.asset_id, op.min_to_receive.asset_id );
+   footprint.created.insert( object_id_type( protocol_ids, limit_order_object_type, 0 ) );
+   // Unless the market is matched in batches, the order is matched at once against orders of other accounts
+   footprint.unbounded = true;
+}
+
+void operation_get_footprint::add( const limit_order_cancel_operation& op )const
+{
+   footprint.objects.insert( op.order );
+}
+
+void operation_get_footprint::add( const key_create_operation& op )const
+{
+   footprint.created.insert( object_id_type( protocol_ids, key_object_type, 0 ) );
+}
+
+void operation_get_footprint::add( const account_create_operation& op )const
+{
+   footprint.accounts.insert( op.referrer );
+   // Names are unique, and the account and its statistics take the next ids
+   footprint.created.insert( object_id_type( protocol_ids, account_object_type, 0 ) );
+   footprint.created.insert( object_id_type( implementation_ids, impl_account_statistics_object_type, 0 ) );
+}
+
+void operation_get_footprint::add( const account_update_operation& op )const
+{
+   if( op.upgrade_to_prime )
+      footprint.created.insert( object_id_type( protocol_ids, vesting_balance_object_type, 0 ) );
+}
+
+void operation_get_footprint::add( const account_whitelist_operation& op )const
+{
+   footprint.accounts.insert( op.account_to_list );
+}
+
+void operation_get_footprint::add( const asset_issue_operation& op )const
+{
+   footprint.accounts.insert( op.issue_to_account );
+   footprint.assets_written.insert( op.asset_to_issue.asset_id );
+   footprint.created.insert( object_id_type( implementation_ids, impl_account_balance_object_type, 0 ) );
+}
+
+void operation_get_footprint::add( const asset_burn_operation& op )const
+{
+   footprint.assets_written.insert( op.amount_to_burn.asset_id );
+}
+
+void operation_get_footprint::add( const asset_fund_fee_pool_operation& op )const
+{
+   footprint.assets_written.insert( op.asset_id );
+}
+
+void operation_get_footprint::add( const vesting_balance_create_operation& op )const
+{
+   footprint.accounts.insert( op.owner );
+   footprint.assets_read.insert( op.amount.asset_id );
+   footprint.created.insert( object_id_type( protocol_ids, vesting_balance_object_type, 0 ) );
+}
+
+void operation_get_footprint::add( const vesting_balance_withdraw_operation& op )const
+{
+   footprint.objects.insert( op.vesting_balance );
+   footprint.assets_read.insert( op.amount.asset_id );
+   footprint.created.insert( object_id_type( implementation_ids, impl_account_balance_object_type, 0 ) );
+}
+
+void operation_get_footprint::add( const withdraw_permission_claim_operation& op )const
+{
+   footprint.accounts.insert( op.withdraw_from_account );
+   footprint.objects.insert( op.withdraw_permission );
+   footprint.assets_read.insert( op.amount_to_withdraw.asset_id );
+   footprint.created.insert( object_id_type( implementation_ids, impl_account_balance_object_type, 0 ) );
+}
+
+void operation_get_footprint::add( const witness_withdraw_pay_operation& op )const
+{
+   footprint.objects.insert( op.from_witness );
+   footprint.created.insert( object_id_type( implementation_ids, impl_account_balance_object_type, 0 ) );
+}
+
+void operation_get_footprint::add( const custom_operation& op )const
+{
+}
+
+operation_footprint get_transaction_footprint( const transaction& trx )
+{
+   operation_footprint footprint;
+   for( const auto& op : trx.operations )
+      op.visit( operation_get_footprint( footprint ) );
+   return footprint;
+}
+
+vector<transaction_stage> schedule_transactions( const vector<operation_footprint>& footprints )
+{
+   vector<transaction_stage> stages;
+   vector<uint32_t> members;
+   transaction_sets sets;
+   std::map<account_id_type, uint32_t> accounts;
+   std::map<object_id_type, uint32_t> objects;
+   std::map<std::pair<asset_id_type,asset_id_type>, uint32_t> markets;
+   std::map<object_id_type, uint32_t> created;
+   std::map<asset_id_type, uint32_t> asset_writers;
+   std::map<asset_id_type, vector<uint32_t>> asset_readers;
+
+   auto close_stage = [&]() {
+      if( members.empty() )
+         return;
+      transaction_stage stage;
+      std::map<uint32_t, size_t> group_of_root;
+      for( uint32_t i = 0; i < members.size(); ++i )
+      {
+         auto itr = group_of_root.emplace( sets.find( i ), stage.groups.size() ).first;
+         if( itr->second == stage.groups.size() )
+            stage.groups.emplace_back();
+         stage.groups[itr->second].push_back( members[i] );
+      }
+      stages.push_back( std::move( stage ) );
+      members.clear();
+      sets = transaction_sets();
+      accounts.clear();
+      objects.clear();
+      markets.clear();
+      created.clear();
+      asset_writers.clear();
+      asset_readers.clear();
+   };
+
+   for( uint32_t t = 0; t < footprints.size(); ++t )
+   {
+      const operation_footprint& footprint = footprints[t];
+      if( footprint.unbounded )
+      {
+         close_stage();
+         transaction_stage stage;
+         stage.groups.push_back( vector<uint32_t>( 1, t ) );
+         stages.push_back( std::move( stage ) );
+         continue;
+      }
+
+      uint32_t i = sets.add();
+      members.push_back( t );
+      for( const auto& id : footprint.accounts )
+         claim( accounts, id, i, sets );
+      for( const auto& id : footprint.objects )
+         claim( objects, id, i, sets );
+      for( const auto& market : footprint.markets )
+         claim( markets, market, i, sets );
+      for( const auto& type : footprint.created )
+         claim( created, type, i, sets );
+      for( const auto& id : footprint.assets_written )
+      {
+         claim( asset_writers, id, i, sets );
+         auto readers = asset_readers.find( id );
+         if( readers != asset_readers.end() )
+         {
+            for( uint32_t reader : readers->second )
+               sets.join( reader, i );
+            asset_readers.erase( readers );
+         }
+      }
+      for( const auto& id : footprint.assets_read )
+      {
+         auto writer = asset_writers.find( id );
+         if( writer != asset_writers.end() )
+            sets.join( writer->second, i );
+         else if( !footprint.assets_written.count( id ) )
+            asset_readers[id].push_back( i );
+      }
+   }
+   close_stage();
+   return stages;
+}
+
+} } // graphene::chain
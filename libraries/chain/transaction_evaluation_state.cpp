@@ -28,6 +28,14 @@ namespace graphene { namespace chain {
       if( _skip_authority_check || approved_by.find(make_pair(account.id, auth_class)) != approved_by.end() )
          return true;
 
+      // Proposed transactions start out with approvals which didn't come from signatures, so they can't share them
+      authority_cache* cache = _is_proposed_trx ? nullptr : _authority_cache;
+      if( cache && cache->is_approved( account.id, auth_class, signing_keys(), depth ) )
+      {
+         approved_by.insert( std::make_pair(account.id, auth_class) );
+         return true;
+      }
+
       FC_ASSERT( account.id.instance() != 0 || _is_proposed_trx );
 
       const authority* au = nullptr;
@@ -83,6 +91,8 @@ namespace graphene { namespace chain {
          if( total_weight >= au->weight_threshold )
          {
             approved_by.insert( std::make_pair(account.id, auth_class) );
+            if( cache )
+               cache->approve( account.id, auth_class, signing_keys(), depth );
             return true;
          }
       }
@@ -94,4 +104,32 @@ namespace graphene { namespace chain {
       return _trx->signatures.find(id) != _trx->signatures.end();
    }
 
+   const vector<key_id_type>& transaction_evaluation_state::signing_keys()
+   {
+      assert(_trx);
+      if( !_signing_keys_valid )
+      {
+         _signing_keys.clear();
+         _signing_keys.reserve( _trx->signatures.size() );
+         for( const auto& sig : _trx->signatures )
+            _signing_keys.push_back( sig.first );
+         _signing_keys_valid = true;
+      }
+      return _signing_keys;
+   }
+
+   void transaction_evaluation_state::reset( database* db, bool skip_authority_check )
+   {
+      approved_by.clear();
+      operation_results.clear();
+      required_active_auths.clear();
+      required_owner_auths.clear();
+      _trx = nullptr;
+      _db = db;
+      _skip_authority_check = skip_authority_check;
+      _is_proposed_trx = false;
+      _authority_cache = nullptr;
+      _signing_keys_valid = false;
+   }
+
 } } // namespace graphene::chain
@@ -75,6 +75,8 @@ object_id_type vesting_balance_withdraw_evaluator::do_evaluate( const vesting_ba
    const time_point_sec now = d.head_block_time();
 
    const vesting_balance_object& vbo = op.vesting_balance( d );
+   // Cashback paid earlier in the block may be withdrawn, as if it had been deposited when it was paid
+   db().apply_deferred_cashback( vbo );
    FC_ASSERT( op.owner == vbo.owner );
    FC_ASSERT( vbo.is_withdraw_allowed( now, op.amount ) );
    assert( op.amount <= vbo.balance );      // is_withdraw_allowed should fail before this check is reached
@@ -106,4 +108,51 @@ object_id_type vesting_balance_withdraw_evaluator::do_apply( const vesting_balan
    return object_id_type();
 }
 
+asset vesting_balance_withdraw_all_evaluator::do_evaluate( const vesting_balance_withdraw_all_operation& op )
+{
+   database& d = db();
+   const time_point_sec now = d.head_block_time();
+
+   /* const account_object& owner_account = */ op.owner( d );
+
+   const auto& by_owner = d.get_index_type<vesting_balance_index>().indices().get<by_account>();
+   vector<vesting_balance_id_type> owned;
+   for( auto itr = by_owner.lower_bound( op.owner ); itr != by_owner.end() && itr->owner == op.owner; ++itr )
+      if( itr->balance.asset_id == op.asset_type )
+         owned.push_back( itr->id );
+
+   _total = asset( 0, op.asset_type );
+   for( const vesting_balance_id_type& id : owned )
+   {
+      const vesting_balance_object& vbo = id( d );
+      // Cashback paid earlier in the block may be withdrawn, as if it had been deposited when it was paid
+      d.apply_deferred_cashback( vbo );
+      const asset allowed = vbo.get_allowed_withdraw( now );
+      if( allowed.amount == 0 )
+         continue;
+      _withdrawals.emplace_back( &vbo, allowed );
+      _total += allowed;
+   }
+   FC_ASSERT( _total.amount > 0, "Nothing may be withdrawn yet" );
+
+   // TODO: Check asset authorizations and withdrawals
+   return _total;
+}
+
+asset vesting_balance_withdraw_all_evaluator::do_apply( const vesting_balance_withdraw_all_operation& op )
+{
+   database& d = db();
+   const time_point_sec now = d.head_block_time();
+
+   for( const auto& w : _withdrawals )
+      d.modify( *w.first, [&]( vesting_balance_object& vbo )
+      {
+         vbo.withdraw( now, w.second );
+      } );
+
+   d.adjust_balance( op.owner, _total );
+
+   return _total;
+}
+
 } } // graphene::chain
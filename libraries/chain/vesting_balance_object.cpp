@@ -167,6 +167,7 @@ VESTING_VISITOR( on_deposit, );
 VESTING_VISITOR( on_withdraw, );
 VESTING_VISITOR( is_deposit_allowed, const );
 VESTING_VISITOR( is_withdraw_allowed, const );
+VESTING_VISITOR( get_allowed_withdraw, const );
 
 bool vesting_balance_object::is_deposit_allowed(const time_point_sec& now, const asset& amount)const
 {
@@ -182,6 +183,11 @@ bool vesting_balance_object::is_withdraw_allowed(const time_point_sec& now, cons
    return result;
 }
 
+asset vesting_balance_object::get_allowed_withdraw(const time_point_sec& now)const
+{
+   return policy.visit( get_allowed_withdraw_visitor( balance, now, asset( 0, balance.asset_id ) ) );
+}
+
 void vesting_balance_object::deposit(const time_point_sec& now, const asset& amount)
 {
    on_deposit_visitor vtor( balance, now, amount );
@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/vote_table.hpp>
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/account_object.hpp>
+#include <graphene/chain/vesting_balance_object.hpp>
+
+#include <boost/functional/hash.hpp>
+
+#include <algorithm>
+
+namespace graphene { namespace chain {
+
+namespace {
+   /// Finds the account whose voting stake or opinions depend on obj
+   bool affected_account( const graphene::db::object& obj, uint64_t& instance )
+   {
+      if( obj.id.space() == protocol_ids )
+      {
+         if( obj.id.type() == account_object_type )
+            instance = obj.id.instance();
+         else if( obj.id.type() == vesting_balance_object_type )
+            instance = static_cast<const vesting_balance_object&>( obj ).owner.instance.value;
+         else
+            return false;
+         return true;
+      }
+      if( obj.id.space() == implementation_ids && obj.id.type() == impl_account_balance_object_type )
+      {
+         const auto& balance = static_cast<const account_balance_object&>( obj );
+         instance = balance.owner.instance.value;
+         return balance.asset_type == asset_id_type();
+      }
+      return false;
+   }
+
+   bool is_statistics( const graphene::db::object& obj )
+   {
+      return obj.id.space() == implementation_ids && obj.id.type() == impl_account_statistics_object_type;
+   }
+}
+
+vote_table::vote_table( const database& db )
+   :_db(db)
+{
+   // Set 0, for the accounts with no opinions
+   _set_begin.push_back( 0 );
+   _set_size.push_back( 0 );
+   _set_num_witness.push_back( 0 );
+   _set_num_committee.push_back( 0 );
+   _set_refs.push_back( 1 );
+   _set_hash.push_back( 0 );
+}
+
+void vote_table::on_add( const graphene::db::object& obj )
+{
+   on_modify( obj );
+}
+
+void vote_table::on_modify( const graphene::db::object& obj )
+{
+   uint64_t instance;
+   if( affected_account( obj, instance ) )
+      update_account( instance );
+   else if( is_statistics( obj ) )
+   {
+      const uint64_t statistics = obj.id.instance();
+      if( statistics < _statistics_owner.size() && _statistics_owner[statistics] )
+         update_account( _statistics_owner[statistics] - 1 );
+   }
+}
+
+void vote_table::on_remove( const graphene::db::object& obj )
+{
+   uint64_t instance;
+   if( affected_account( obj, instance ) )
+      update_account( instance, &obj );
+   else if( is_statistics( obj ) )
+   {
+      const uint64_t statistics = obj.id.instance();
+      if( statistics < _statistics_owner.size() && _statistics_owner[statistics] )
+         update_account( _statistics_owner[statistics] - 1, &obj );
+   }
+}
+
+void vote_table::update_account( uint64_t instance, const graphene::db::object* removed )
+{
+   const account_object* account = _db.find( account_id_type( instance ) );
+   if( !account || account == removed )
+   {
+      clear_account( instance );
+      return;
+   }
+
+   uint64_t stake = _db.get_balance( account->get_id(), asset_id_type() ).amount.value;
+
+   const uint64_t statistics = account->statistics.instance.value;
+   if( _statistics_owner.size() <= statistics )
+      _statistics_owner.resize( statistics + 1 );
+   _statistics_owner[statistics] = instance + 1;
+   const account_statistics_object* stats = _db.find( account->statistics );
+   if( stats && stats != removed )
+      stake += stats->total_core_in_orders.value;
+
+   if( account->cashback_vb.valid() )
+   {
+      const vesting_balance_object* cashback = _db.find( *account->cashback_vb );
+      if( cashback && cashback != removed )
+         stake += cashback->balance.amount.value;
+   }
+
+   const uint64_t opinion = account->voting_account == account_id_type() ? instance
+                                                                        : account->voting_account.instance.value;
+   reserve_accounts( std::max( instance, opinion ) );
+
+   // Take the old contributions of the account out of the totals, then put the new ones in
+   if( is_counted( instance ) )
+      add_stake( instance, 0 - _stake[instance] );
+   add_opinions( instance, 0 - _weight[instance] );
+
+   _flags[instance] = account_present | (account->is_prime() ? account_prime : 0);
+   _stake[instance] = stake;
+   _opinion[instance] = opinion;
+   set_votes( instance, *account );
+
+   add_opinions( instance, _weight[instance] );
+   if( is_counted( instance ) )
+      add_stake( instance, _stake[instance] );
+}
+
+void vote_table::clear_account( uint64_t instance )
+{
+   if( _flags.size() <= instance )
+      return;
+   if( is_counted( instance ) )
+      add_stake( instance, 0 - _stake[instance] );
+   add_opinions( instance, 0 - _weight[instance] );
+
+   _flags[instance] = 0;
+   _stake[instance] = 0;
+   _opinion[instance] = instance;
+   release_votes( _vote_set[instance] );
+   _vote_set[instance] = 0;
+
+   // Accounts may still name this one to specify their opinions, with no votes and no counts for now
+   add_opinions( instance, _weight[instance] );
+}
+
+void vote_table::reserve_accounts( uint64_t instance )
+{
+   if( _flags.size() > instance )
+      return;
+   const size_t old_size = _flags.size();
+   const size_t size = instance + 1;
+   _flags.resize( size );
+   _stake.resize( size );
+   _opinion.resize( size );
+   _vote_set.resize( size );
+   _weight.resize( size );
+   for( size_t i = old_size; i < size; ++i )
+      _opinion[i] = i;
+}
+
+bool vote_table::is_counted( uint64_t instance )const
+{
+   return (_flags[instance] & account_present) && (_count_non_prime_votes || (_flags[instance] & account_prime));
+}
+
+void vote_table::add_opinions( uint64_t instance, uint64_t amount )
+{
+   add_set_opinions( _vote_set[instance], amount );
+}
+
+void vote_table::add_set_opinions( uint32_t set, uint64_t amount )
+{
+   if( amount == 0 )
+      return;
+   const uint32_t* vote = _votes.data() + _set_begin[set];
+   const uint32_t* end = vote + _set_size[set];
+   for( ; vote != end; ++vote )
+   {
+      if( _vote_totals.size() <= *vote )
+         _vote_totals.resize( *vote + 1 );
+      _vote_totals[*vote] += amount;
+   }
+
+   const uint16_t num_witness = _set_num_witness[set];
+   if( _witness_count_totals.size() <= num_witness )
+      _witness_count_totals.resize( num_witness + 1 );
+   _witness_count_totals[num_witness] += amount;
+
+   const uint16_t num_committee = _set_num_committee[set];
+   if( _committee_count_totals.size() <= num_committee )
+      _committee_count_totals.resize( num_committee + 1 );
+   _committee_count_totals[num_committee] += amount;
+}
+
+void vote_table::add_stake( uint64_t instance, uint64_t amount )
+{
+   const uint32_t opinion = _opinion[instance];
+   add_opinions( opinion, amount );
+   _weight[opinion] += amount;
+   _total_voting_stake += amount;
+}
+
+void vote_table::rebuild_totals()
+{
+   _vote_totals.clear();
+   _witness_count_totals.clear();
+   _committee_count_totals.clear();
+   _total_voting_stake = 0;
+   std::fill( _weight.begin(), _weight.end(), 0 );
+
+   for( size_t i = 0; i < _flags.size(); ++i )
+      if( is_counted( i ) )
+      {
+         _weight[_opinion[i]] += _stake[i];
+         _total_voting_stake += _stake[i];
+      }
+
+   // Accounts sharing a set are tallied once, by the set
+   vector<uint64_t> set_weight( _set_refs.size() );
+   for( size_t i = 0; i < _flags.size(); ++i )
+      set_weight[_vote_set[i]] += _weight[i];
+   for( uint32_t set = 0; set < set_weight.size(); ++set )
+      add_set_opinions( set, set_weight[set] );
+}
+
+void vote_table::set_votes( uint64_t instance, const account_object& account )
+{
+   _scratch_votes.clear();
+   for( const vote_id_type& id : account.votes )
+      _scratch_votes.push_back( id.instance() );
+
+   // Intern before releasing, so an account keeping its opinions keeps its set
+   const uint32_t set = intern_votes( account.num_witness, account.num_committee );
+   release_votes( _vote_set[instance] );
+   _vote_set[instance] = set;
+}
+
+uint32_t vote_table::intern_votes( uint16_t num_witness, uint16_t num_committee )
+{
+   if( _scratch_votes.empty() && num_witness == 0 && num_committee == 0 )
+      return 0;
+
+   size_t hash = 0;
+   boost::hash_combine( hash, num_witness );
+   boost::hash_combine( hash, num_committee );
+   for( uint32_t vote : _scratch_votes )
+      boost::hash_combine( hash, vote );
+
+   auto range = _sets_by_hash.equal_range( hash );
+   for( auto itr = range.first; itr != range.second; ++itr )
+   {
+      const uint32_t set = itr->second;
+      if( _set_num_witness[set] == num_witness && _set_num_committee[set] == num_committee &&
+          _set_size[set] == _scratch_votes.size() &&
+          std::equal( _scratch_votes.begin(), _scratch_votes.end(), _votes.begin() + _set_begin[set] ) )
+      {
+         ++_set_refs[set];
+         return set;
+      }
+   }
+
+   uint32_t set;
+   if( _free_sets.empty() )
+   {
+      set = _set_refs.size();
+      _set_begin.push_back( 0 );
+      _set_size.push_back( 0 );
+      _set_num_witness.push_back( 0 );
+      _set_num_committee.push_back( 0 );
+      _set_refs.push_back( 0 );
+      _set_hash.push_back( 0 );
+   }
+   else
+   {
+      set = _free_sets.back();
+      _free_sets.pop_back();
+   }
+   _set_begin[set] = _votes.size();
+   _set_size[set] = _scratch_votes.size();
+   _set_num_witness[set] = num_witness;
+   _set_num_committee[set] = num_committee;
+   _set_refs[set] = 1;
+   _set_hash[set] = hash;
+   _votes.insert( _votes.end(), _scratch_votes.begin(), _scratch_votes.end() );
+   _sets_by_hash.emplace( hash, set );
+   return set;
+}
+
+void vote_table::release_votes( uint32_t set )
+{
+   if( set == 0 || --_set_refs[set] > 0 )
+      return;
+
+   auto range = _sets_by_hash.equal_range( _set_hash[set] );
+   for( auto itr = range.first; itr != range.second; ++itr )
+      if( itr->second == set )
+      {
+         _sets_by_hash.erase( itr );
+         break;
+      }
+   _unused_votes += _set_size[set];
+   _set_size[set] = 0;
+   _set_num_witness[set] = 0;
+   _set_num_committee[set] = 0;
+   _free_sets.push_back( set );
+
+   if( _unused_votes * 2 > _votes.size() )
+      compact_votes();
+}
+
+void vote_table::compact_votes()
+{
+   vector<uint32_t> votes;
+   votes.reserve( _votes.size() - _unused_votes );
+   for( size_t set = 0; set < _set_size.size(); ++set )
+   {
+      const uint32_t begin = _set_begin[set];
+      _set_begin[set] = votes.size();
+      votes.insert( votes.end(), _votes.begin() + begin, _votes.begin() + begin + _set_size[set] );
+   }
+   _votes = std::move( votes );
+   _unused_votes = 0;
+}
+
+void vote_table::tally( const chain_parameters& params, vector<uint64_t>& votes, vector<uint64_t>& witness_histogram,
+                        vector<uint64_t>& committee_histogram, uint64_t& total_voting_stake )
+{
+   if( params.count_non_prime_votes != _count_non_prime_votes )
+   {
+      _count_non_prime_votes = params.count_non_prime_votes;
+      rebuild_totals();
+   }
+
+   // if they somehow managed to specify an illegal offset, ignore it.
+   const size_t vote_count = std::min( votes.size(), _vote_totals.size() );
+   for( size_t i = 0; i < vote_count; ++i )
+      votes[i] += _vote_totals[i];
+
+   // votes for a number greater than the maximum are ignored, and the histograms have a bucket for every two
+   for( size_t n = 0; n < _witness_count_totals.size() && n <= params.maximum_witness_count; ++n )
+      witness_histogram[ std::min( n / 2, witness_histogram.size() - 1 ) ] += _witness_count_totals[n];
+   for( size_t n = 0; n < _committee_count_totals.size() && n <= params.maximum_committee_count; ++n )
+      committee_histogram[ std::min( n / 2, committee_histogram.size() - 1 ) ] += _committee_count_totals[n];
+
+   total_voting_stake += _total_voting_stake;
+}
+
+uint64_t vote_table::voting_stake( account_id_type account )const
+{
+   const uint64_t instance = account.instance.value;
+   return instance < _stake.size() ? _stake[instance] : 0;
+}
+
+} } // graphene::chain
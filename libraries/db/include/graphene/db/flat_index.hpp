@@ -18,17 +18,24 @@
 #pragma once
 #include <graphene/db/index.hpp>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace graphene { namespace db {
 
    /**
     *  @class flat_index
-    *  @brief A flat index uses a vector<T> to store data
+    *  @brief A flat index stores objects by value in an array indexed by instance
     *
-    *  This index is preferred in situations where the data will never be
-    *  removed from main memory and when lots of small objects that
-    *  are accessed in order are required.
+    *  This index is preferred for lots of small objects with dense instances that
+    *  are accessed by ID or scanned in order.  The array is made of chunks of
+    *  2^ChunkBits objects which are never moved, so objects keep their address as
+    *  the index grows, and a bitmap tracks which instances hold an object.  Every
+    *  instance up to the highest one takes room whether or not it holds an object,
+    *  so types whose objects are often removed are better kept in another index.
     */
-   template<typename T>
+   template<typename T, uint32_t ChunkBits = 8>
    class flat_index : public index
    {
       public:
@@ -38,33 +45,58 @@ namespace graphene { namespace db {
          {
              auto id = get_next_id();
              auto instance = id.instance();
-             if( instance >= _objects.size() ) _objects.resize( instance + 1 );
-             _objects[instance].id = id;
-             constructor( _objects[instance] );
+             grow( instance + 1 );
+             T& obj = slot( instance );
+             assert( !is_occupied( instance ) );
+             obj.id = id;
+             try {
+                constructor( obj );
+             } catch( ... ) {
+                obj = T();
+                throw;
+             }
+             obj.id = id; // just in case it changed
+             set_occupied( instance, true );
              use_next_id();
-             return _objects[instance];
+             return obj;
          }
 
          virtual void modify( const object& obj, const std::function<void(object&)>& modify_callback ) override
          {
-            assert( obj.id.instance() < _objects.size() );
-            modify_callback( _objects[obj.id.instance()] );
+            assert( is_occupied( obj.id.instance() ) );
+            modify_callback( slot( obj.id.instance() ) );
          }
 
-         virtual const object& insert( object&& obj )
+         template<typename Lambda>
+         void modify_typed( const T& obj, const Lambda& m )
+         {
+            assert( is_occupied( obj.id.instance() ) );
+            m( slot( obj.id.instance() ) );
+         }
+
+         virtual const object& insert( object&& obj ) override
          {
             auto instance = obj.id.instance();
             assert( nullptr != dynamic_cast<T*>(&obj) );
-            if( _objects.size() <= instance ) _objects.resize( instance+1 );
-            _objects[instance] = std::move( static_cast<T&>(obj) );
-            return _objects[instance];
+            grow( instance + 1 );
+            FC_ASSERT( !is_occupied( instance ), "Object already exists", ("id",obj.id) );
+            T& result = slot( instance );
+            result = std::move( static_cast<T&>(obj) );
+            set_occupied( instance, true );
+            return result;
          }
 
+         /** Makes room for instance_count instances ahead of inserting many objects */
+         void reserve( size_t object_count, size_t instance_count ) { grow( instance_count ); }
+
          virtual void remove( const object& obj ) override
          {
             assert( nullptr != dynamic_cast<const T*>(&obj) );
             const auto instance = obj.id.instance();
-            _objects[instance] = T();
+            assert( is_occupied( instance ) );
+            // Resetting the slot releases whatever the object holds
+            slot( instance ) = T();
+            set_occupied( instance, false );
          }
 
          virtual const object* find( object_id_type id )const override
@@ -73,40 +105,127 @@ namespace graphene { namespace db {
             assert( id.type() == T::type_id );
 
             const auto instance = id.instance();
-            if( instance >= _objects.size() ) return nullptr;
-            return &_objects[instance];
+            if( !is_occupied( instance ) ) return nullptr;
+            return &slot( instance );
          }
 
-         void inspect_all_objects(std::function<void (const object&)> inspector)const
+         void inspect_all_objects(std::function<void (const object&)> inspector)const override
          {
             try {
-               for( const auto& ptr : _objects )
-               {
-                  inspector(ptr);
-               }
+               for( auto itr = begin(); itr != end(); ++itr )
+                  inspector( **itr );
             } FC_CAPTURE_AND_RETHROW()
          }
 
+         /** Visits the instances which hold an object in order, a word of the bitmap at a time */
          class const_iterator
          {
             public:
                const_iterator(){}
-               const_iterator( const typename vector<T>::const_iterator& a ):_itr(a){}
-               friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a._itr == b._itr; }
-               friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a._itr != b._itr; }
-               const T* operator*()const { return static_cast<const T*>(&*_itr); }
-               const_iterator& operator++(int){ ++_itr; return *this; }
-               const_iterator& operator++()   { ++_itr; return *this; }
+               const_iterator( const flat_index* idx, uint64_t instance ):_index(idx),_instance(instance)
+               {
+                  skip_empty();
+               }
+               friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a._instance == b._instance; }
+               friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a._instance != b._instance; }
+               const T* operator*()const { return &_index->slot( _instance ); }
+               const_iterator operator++(int)
+               {
+                  const_iterator result( *this );
+                  ++(*this);
+                  return result;
+               }
+               const_iterator& operator++()
+               {
+                  ++_instance;
+                  skip_empty();
+                  return *this;
+               }
             private:
-               typename vector<T>::const_iterator _itr;
+               void skip_empty()
+               {
+                  const auto& words = _index->_occupied;
+                  uint64_t end = _index->capacity();
+                  while( _instance < end )
+                  {
+                     uint64_t word = words[_instance / 64] >> (_instance % 64);
+                     if( word )
+                     {
+                        _instance += lowest_set_bit( word );
+                        return;
+                     }
+                     _instance = (_instance / 64 + 1) * 64;
+                  }
+                  _instance = end;
+               }
+
+               static uint32_t lowest_set_bit( uint64_t word )
+               {
+#ifdef _MSC_VER
+                  unsigned long bit;
+                  _BitScanForward64( &bit, word );
+                  return bit;
+#else
+                  return __builtin_ctzll( word );
+#endif
+               }
+
+               const flat_index* _index = nullptr;
+               uint64_t          _instance = 0;
          };
-         const_iterator begin()const { return const_iterator(_objects.begin()); }
-         const_iterator end()const   { return const_iterator(_objects.end());   }
+         const_iterator begin()const { return const_iterator( this, 0 );          }
+         const_iterator end()const   { return const_iterator( this, capacity() ); }
 
-         size_t size()const{ return _objects.size(); }
+         /// Number of objects in the index
+         size_t size()const{ return _count; }
+
+         virtual index_stats stats()const override
+         {
+            index_stats result = index::stats();
+            result.container_bytes += (capacity() - _count) * sizeof(T)
+                                    + _chunks.capacity() * sizeof(_chunks[0])
+                                    + _occupied.capacity() * sizeof(_occupied[0]);
+            return result;
+         }
 
       private:
-         vector< T > _objects;
+         enum { chunk_size = 1u << ChunkBits };
+
+         uint64_t capacity()const { return uint64_t(_chunks.size()) << ChunkBits; }
+
+         T&       slot( uint64_t instance )      { return _chunks[instance >> ChunkBits][instance & (chunk_size - 1)]; }
+         const T& slot( uint64_t instance )const { return _chunks[instance >> ChunkBits][instance & (chunk_size - 1)]; }
+
+         bool is_occupied( uint64_t instance )const
+         {
+            return instance < capacity() && ( _occupied[instance / 64] >> (instance % 64) ) & 1;
+         }
+         void set_occupied( uint64_t instance, bool occupied )
+         {
+            if( occupied )
+            {
+               _occupied[instance / 64] |= uint64_t(1) << (instance % 64);
+               ++_count;
+            }
+            else
+            {
+               _occupied[instance / 64] &= ~( uint64_t(1) << (instance % 64) );
+               --_count;
+            }
+         }
+
+         /** Adds chunks until there is room for instance_count instances */
+         void grow( uint64_t instance_count )
+         {
+            while( capacity() < instance_count )
+               _chunks.emplace_back( new T[chunk_size] );
+            _occupied.resize( (capacity() + 63) / 64, 0 );
+         }
+
+         vector< unique_ptr<T[]> >  _chunks;
+         /// One bit per instance, set if the instance holds an object
+         vector< uint64_t >         _occupied;
+         size_t                     _count = 0;
    };
 
 } } // graphene::db
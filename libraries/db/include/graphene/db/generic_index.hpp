@@ -17,11 +17,13 @@
  */
 #pragma once
 #include <graphene/db/index.hpp>
+#include <graphene/db/object_pool.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
+#include <boost/mpl/size.hpp>
 
 namespace graphene { namespace chain {
 
@@ -29,10 +31,39 @@ namespace graphene { namespace chain {
    using namespace boost::multi_index;
 
    struct by_id{};
+
+   namespace detail {
+      /** Makes room for count elements if Index is a hashed index */
+      template<typename Index>
+      auto reserve_index( Index& idx, size_t count, int ) -> decltype( idx.rehash( count ), void() )
+      {
+         idx.rehash( size_t( count / idx.max_load_factor() ) + 1 );
+      }
+      template<typename Index>
+      void reserve_index( Index&, size_t, long ) {}
+
+      /** Builds the allocator of a container, bound to the index's pool if it is a pool_allocator */
+      template<typename Allocator>
+      struct index_allocator
+      {
+         static Allocator make( graphene::db::object_pool& ) { return Allocator(); }
+      };
+      template<typename T>
+      struct index_allocator< graphene::db::pool_allocator<T> >
+      {
+         static graphene::db::pool_allocator<T> make( graphene::db::object_pool& pool )
+         {
+            return graphene::db::pool_allocator<T>( pool );
+         }
+      };
+   }
    /**
     *  Almost all objects can be tracked and managed via a boost::multi_index container that uses
     *  an unordered_unique key on the object ID.  This template class adapts the generic index interface
     *  to work with arbitrary boost multi_index containers on the same type.
+    *
+    *  A container whose allocator is a graphene::db::pool_allocator allocates its nodes from a pool owned
+    *  by the index, which keeps the memory of removed objects for the objects created after them.
     */
    template<typename ObjectType, typename MultiIndexType>
    class generic_index : public index
@@ -41,6 +72,10 @@ namespace graphene { namespace chain {
          typedef MultiIndexType index_type;
          typedef ObjectType     object_type;
 
+         generic_index()
+            : _indices( typename index_type::ctor_args_list(),
+                        detail::index_allocator<typename index_type::allocator_type>::make( _pool ) ) {}
+
          virtual const object& insert( object&& obj )
          {
             assert( nullptr != dynamic_cast<ObjectType*>(&obj) );
@@ -68,6 +103,19 @@ namespace graphene { namespace chain {
             FC_ASSERT( ok, "Could not modify object, most likely a index constraint was violated" );
          }
 
+         template<typename Lambda>
+         void modify_typed( const ObjectType& obj, const Lambda& m )
+         {
+            auto ok = _indices.modify( _indices.iterator_to( obj ), [&m]( ObjectType& o ){ m(o); } );
+            FC_ASSERT( ok, "Could not modify object, most likely a index constraint was violated" );
+         }
+
+         /** Makes room for object_count objects in the primary index, if it is hashed */
+         void reserve( size_t object_count, size_t instance_count )
+         {
+            detail::reserve_index( _indices.template get<0>(), _indices.size() + object_count, 0 );
+         }
+
          virtual void remove( const object& obj )override
          {
             _indices.erase( _indices.iterator_to( static_cast<const ObjectType&>(obj) ) );
@@ -88,10 +136,25 @@ namespace graphene { namespace chain {
             } FC_CAPTURE_AND_RETHROW()
          }
 
+         /** Estimates the nodes of every index of the container at three pointers per object */
+         virtual index_stats stats()const override
+         {
+            index_stats result = index::stats();
+            result.container_bytes += result.object_count * index_count * 3 * sizeof(void*);
+            const graphene::db::pool_stats pool = _pool.stats();
+            result.pool_used_bytes = pool.used_bytes;
+            result.pool_free_bytes = pool.free_bytes;
+            return result;
+         }
+
          const index_type& indices()const { return _indices; }
 
       private:
-         index_type _indices;
+         enum { index_count = boost::mpl::size<typename index_type::index_type_list>::value };
+
+         /// declared ahead of _indices, so that it outlives the nodes
+         graphene::db::object_pool _pool;
+         index_type                _indices;
    };
 
    /**
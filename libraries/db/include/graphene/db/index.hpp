@@ -19,6 +19,10 @@
 #include <graphene/db/object.hpp>
 #include <graphene/db/level_map.hpp>
 
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
 namespace graphene { namespace db {
    class object_database;
 
@@ -38,6 +42,53 @@ namespace graphene { namespace db {
          virtual void on_modify( const object& obj ){}
    };
 
+   /** An object which changed since the changes of its index were last published */
+   struct object_change
+   {
+      object_id_type      id;
+      shared_ptr<object>  before; ///< a copy of the object before its first change, or nullptr if it was added
+      const object*       after = nullptr; ///< the object now, or nullptr if it was removed
+   };
+
+   /**
+    * @class batched_index_observer
+    * @brief used to get the changes to an index all at once, rather than a callback for every change
+    *
+    * The changes are collected while objects change and published by object_database::publish_changes, which the
+    * chain calls once per block.  An object added and removed again in between is left out, but an object which was
+    * modified and then changed back, for instance by undo, is still reported as modified.
+    */
+   class batched_index_observer
+   {
+      public:
+         virtual ~batched_index_observer(){}
+         /** called with every object of the index which changed, in no particular order */
+         virtual void on_changes( const vector<object_change>& changes ) = 0;
+   };
+
+   /** The memory held by an index, as reported by index::stats */
+   struct index_stats
+   {
+      uint8_t   space_id = 0;
+      uint8_t   type_id = 0;
+      uint64_t  object_count = 0;
+      /// the objects themselves, including the memory their members allocate
+      uint64_t  object_bytes = 0;
+      /// an estimate of the memory the index holds on top of its objects
+      uint64_t  container_bytes = 0;
+      /// the memory of the index's object pool held by live elements, and held for elements to come
+      uint64_t  pool_used_bytes = 0;
+      uint64_t  pool_free_bytes = 0;
+   };
+
+   /**
+    *  Objects read from disk by index::unpack_objects, to be inserted by index::insert_objects
+    */
+   struct unpacked_objects
+   {
+      virtual ~unpacked_objects(){}
+   };
+
    /**
     *  @class index
     *  @brief abstract base class for accessing objects indexed in various ways.
@@ -53,6 +104,11 @@ namespace graphene { namespace db {
     *  which means that they can covnert a reference to an object to an iterator.  When
     *  at all possible save a pointer/reference to your objects rather than constantly
     *  looking them up by ID.
+    *
+    *  Because such references are kept across calls to modify, an object must stay at the
+    *  same address from the time it is created until it is removed.  An index may not
+    *  replace an object by a new copy to modify it, so undoing a change restores the old
+    *  value into the existing object.
     */
    class index
    {
@@ -84,6 +140,18 @@ namespace graphene { namespace db {
           */
          virtual void open( const shared_ptr<graphene::db::level_map<object_id_type, vector<char> >>& db ){}
 
+         /**
+          *  Reads and unpacks the objects of this index from a level_db database without touching the index, so
+          *  that it may run on another thread while other indexes are being loaded.
+          *  @return nullptr if this index does not support loading in two steps, in which case open is used
+          */
+         virtual shared_ptr<unpacked_objects> unpack_objects(
+               const shared_ptr<graphene::db::level_map<object_id_type, vector<char> >>& db )const { return nullptr; }
+         /** Unpacks objects which were packed back to back into data, as in a snapshot */
+         virtual shared_ptr<unpacked_objects> unpack_objects( const char* data, size_t size )const { return nullptr; }
+         /** Inserts the objects returned by unpack_objects */
+         virtual void insert_objects( unpacked_objects& objects ){}
+
          /** @return the object with id or nullptr if not found */
          virtual const object*      find( object_id_type id )const = 0;
 
@@ -101,6 +169,34 @@ namespace graphene { namespace db {
          virtual void               modify( const object& obj, const std::function<void(object&)>& ) = 0;
          virtual void               remove( const object& obj ) = 0;
 
+         /// The contents an object of this index is restored to, packed as object::pack_into packs them
+         struct packed_contents
+         {
+            object_id_type id;
+            const char*    data;
+            size_t         size;
+         };
+         /**
+          * Restores each of the objects in [first, last), which must exist, to its packed contents, as modify would
+          * with object::unpack_from.  Indexes which know their object type unpack the whole batch with it.
+          */
+         virtual void               restore_objects( const packed_contents* first, const packed_contents* last )
+         {
+            for( ; first != last; ++first )
+            {
+               const packed_contents& item = *first;
+               modify( get( item.id ), std::function<void(object&)>( [&]( object& obj ) {
+                  obj.unpack_from( item.data, item.size );
+               }) );
+            }
+         }
+         /** Removes each of the objects with the ids in [first, last), which must exist */
+         virtual void               remove_objects( const object_id_type* first, const object_id_type* last )
+         {
+            for( ; first != last; ++first )
+               remove( get( *first ) );
+         }
+
          /**
           *   When forming your lambda to modify obj, it is natural to have Object& be the signature, but
           *   that is not compatible with the type erasue required by the virtual method.  This method
@@ -113,8 +209,64 @@ namespace graphene { namespace db {
          }
 
          virtual void               inspect_all_objects(std::function<void(const object&)> inspector)const = 0;
+
+         typedef vector<pair<object_id_type, vector<char>>> packed_objects;
+         /**
+          * Appends the objects of this index with the ids in [first, last) to stored, packed, and the ids which are
+          * not found to missing.  Indexes which know their object type pack the whole batch with it, rather than
+          * through the virtual methods of every object.
+          */
+         virtual void               pack_objects( const object_id_type* first, const object_id_type* last,
+                                                  packed_objects& stored, vector<object_id_type>& missing )const
+         {
+            for( ; first != last; ++first )
+               if( const object* obj = find( *first ) )
+                  stored.emplace_back( *first, obj->pack() );
+               else
+                  missing.push_back( *first );
+         }
+         /** Appends every object of this index to stored, packed */
+         virtual void               pack_all_objects( packed_objects& stored )const
+         {
+            inspect_all_objects( [&]( const object& obj ) { stored.emplace_back( obj.id, obj.pack() ); } );
+         }
+
          virtual void               add_observer( const shared_ptr<index_observer>& ) = 0;
+         virtual void               add_batched_observer( const shared_ptr<batched_index_observer>& ) {}
+         /** Hands the changes collected since the last call to the batched observers */
+         virtual void               publish_changes() {}
 
+         /**
+          * Starts keeping copies of the objects for object_database::get_read_view.  The copies are published by
+          * publish_versions, so they only change at the boundaries the owner of the database chooses.
+          */
+         virtual void               enable_versions() {}
+         /** Copies the objects changed since the last call, to be seen by the read views of epoch and later ones */
+         virtual void               publish_versions( uint64_t epoch ) {}
+         /** Releases the copies which no read view of oldest_epoch or a later one can see anymore */
+         virtual void               reclaim_versions( uint64_t oldest_epoch ) {}
+         /**
+          * @return the copy of the object with id that the read views of epoch see, or nullptr if it did not exist
+          * then.  Unlike the other methods, this may be called from any thread.
+          */
+         virtual shared_ptr<const object> find_version( object_id_type id, uint64_t epoch )const
+         { return shared_ptr<const object>(); }
+
+         /**
+          * Visits every object to add up its memory.  Implementations add the memory held by their containers, which
+          * only they know of.
+          */
+         virtual index_stats        stats()const
+         {
+            index_stats result;
+            result.space_id = object_space_id();
+            result.type_id = object_type_id();
+            inspect_all_objects( [&]( const object& obj ) {
+               ++result.object_count;
+               result.object_bytes += obj.memory_usage();
+            });
+            return result;
+         }
    };
 
    /**
@@ -131,6 +283,12 @@ namespace graphene { namespace db {
          /** called just after the object is added */
          void on_add( const object& obj );
 
+         /**
+          * called just after an object is inserted as it was, by undo or while loading, which only notifies the
+          * observers
+          */
+         void on_insert( const object& obj );
+
          /** called just before obj is removed */
          void on_remove( const object& obj );
 
@@ -138,10 +296,33 @@ namespace graphene { namespace db {
          void on_modify( const object& obj );
 
       protected:
-         vector< shared_ptr<index_observer> > _observers;
+         vector< shared_ptr<index_observer> >         _observers;
+         vector< shared_ptr<batched_index_observer> > _batched_observers;
+         /// Changes collected for the batched observers, only while there are any
+         std::unordered_map<object_id_type, object_change> _changes;
+
+         void publish_collected_changes();
+
+         typedef vector<pair<uint64_t, shared_ptr<const object>>> object_versions;
+
+         /// Whether copies of the objects are kept for read views
+         bool                                               _versioned = false;
+         /// Objects changed since their copies were last published
+         std::unordered_set<object_id_type>                 _unversioned;
+
+         /** Publishes copies made by the derived index, where a nullptr copy means the object was removed */
+         void add_versions( vector<pair<object_id_type, shared_ptr<const object>>>& versions, uint64_t epoch );
+         shared_ptr<const object> find_version_of( object_id_type id, uint64_t epoch )const;
+         void reclaim_versions_before( uint64_t oldest_epoch );
 
       private:
          object_database& _db;
+
+         /// The published copies of every object, oldest first, guarded by _versions_mutex for the readers
+         std::unordered_map<object_id_type, object_versions> _versions;
+         /// Objects with copies which may be reclaimed, either superseded or removed
+         std::unordered_set<object_id_type>                 _superseded;
+         mutable std::mutex                                 _versions_mutex;
    };
 
    /**
@@ -172,23 +353,92 @@ namespace graphene { namespace db {
 
          virtual const object&  load( const std::vector<char>& data )
          {
-            return DerivedIndex::insert( fc::raw::unpack<object_type>( data ) );
+            return insert( fc::raw::unpack<object_type>( data ) );
+         }
+
+         virtual const object& insert( object&& obj ) override
+         {
+            const auto& result = DerivedIndex::insert( std::move(obj) );
+            if( !_batched_observers.empty() )
+               collect_add( result );
+            on_insert( result );
+            return result;
+         }
+
+         virtual void pack_objects( const object_id_type* first, const object_id_type* last,
+                                    packed_objects& stored, vector<object_id_type>& missing )const override
+         {
+            for( ; first != last; ++first )
+               if( const object* obj = DerivedIndex::find( *first ) )
+                  stored.emplace_back( *first, fc::raw::pack( static_cast<const object_type&>(*obj) ) );
+               else
+                  missing.push_back( *first );
+         }
+
+         virtual void pack_all_objects( packed_objects& stored )const override
+         {
+            DerivedIndex::inspect_all_objects( [&]( const object& obj ) {
+               stored.emplace_back( obj.id, fc::raw::pack( static_cast<const object_type&>(obj) ) );
+            });
          }
 
          virtual void open( const shared_ptr<graphene::db::level_map<object_id_type, vector<char> >>& db )
          {
+            insert_objects( *unpack_objects( db ) );
+         }
+
+         struct unpacked : public unpacked_objects
+         {
+            vector<object_type> objects;
+         };
+
+         virtual shared_ptr<unpacked_objects> unpack_objects(
+               const shared_ptr<graphene::db::level_map<object_id_type, vector<char> >>& db )const override
+         {
+            auto result = std::make_shared<unpacked>();
             auto first = object_id_type( DerivedIndex::object_type::space_id, DerivedIndex::object_type::type_id, 0 );
             auto last = object_id_type( DerivedIndex::object_type::space_id, DerivedIndex::object_type::type_id+1, 0 );
             auto itr = db->lower_bound( first );
             while( itr.valid() && itr.key() < last )
             {
-               load( itr.value() );
+               // Values are stored as packed vector<char>, so unpack the object straight out of it
+               auto ds = itr.value_stream();
+               fc::unsigned_int size;
+               fc::raw::unpack( ds, size );
+               result->objects.emplace_back();
+               fc::raw::unpack( ds, result->objects.back() );
                ++itr;
             }
+            return result;
+         }
+
+         virtual shared_ptr<unpacked_objects> unpack_objects( const char* data, size_t size )const override
+         {
+            auto result = std::make_shared<unpacked>();
+            fc::datastream<const char*> ds( data, size );
+            while( ds.remaining() )
+            {
+               result->objects.emplace_back();
+               fc::raw::unpack( ds, result->objects.back() );
+            }
+            return result;
+         }
+
+         virtual void insert_objects( unpacked_objects& objects ) override
+         {
+            auto& unpacked_objects = static_cast<unpacked&>(objects).objects;
+            uint64_t instance_count = 0;
+            for( const auto& obj : unpacked_objects )
+               instance_count = std::max( instance_count, obj.id.instance() + 1 );
+            DerivedIndex::reserve( unpacked_objects.size(), instance_count );
+            for( auto& obj : unpacked_objects )
+               on_insert( DerivedIndex::insert( std::move(obj) ) );
          }
          virtual const object&  create(const std::function<void(object&)>& constructor )
          {
             const auto& result = DerivedIndex::create( constructor );
+            if( !_batched_observers.empty() )
+               collect_add( result );
             on_add( result );
             return result;
          }
@@ -196,23 +446,171 @@ namespace graphene { namespace db {
          virtual void  remove( const object& obj ) override
          {
             on_remove(obj);
+            if( !_batched_observers.empty() )
+               collect_remove( obj );
             DerivedIndex::remove(obj);
          }
 
+         virtual void restore_objects( const packed_contents* first, const packed_contents* last ) override
+         {
+            for( ; first != last; ++first )
+            {
+               const object* obj = DerivedIndex::find( first->id );
+               FC_ASSERT( obj != nullptr, "Unable to find Object", ("id",first->id) );
+               object_type restored;
+               fc::datastream<const char*> ds( first->data, first->size );
+               fc::raw::unpack( ds, restored );
+               modify_typed( static_cast<const object_type&>(*obj), [&]( object_type& o ) { o = std::move( restored ); } );
+            }
+         }
+
+         virtual void remove_objects( const object_id_type* first, const object_id_type* last ) override
+         {
+            for( ; first != last; ++first )
+            {
+               const object* obj = DerivedIndex::find( *first );
+               FC_ASSERT( obj != nullptr, "Unable to find Object", ("id",*first) );
+               primary_index::remove( *obj );
+            }
+         }
+
          virtual void modify( const object& obj, const std::function<void(object&)>& m )override
          {
             save_undo( obj );
+            if( !_batched_observers.empty() )
+               collect_modify( obj );
             DerivedIndex::modify( obj, m );
             on_modify( obj );
          }
 
+         /**
+          *  Same as modify, but calls m directly rather than through a virtual call and a std::function.
+          *  @note Lambda should have the signature:  void(object_type&)
+          */
+         template<typename Lambda>
+         void modify_typed( const object_type& obj, const Lambda& m )
+         {
+            save_undo( obj );
+            if( !_batched_observers.empty() )
+               collect_modify( obj );
+            DerivedIndex::modify_typed( obj, m );
+            on_modify( obj );
+         }
+
          virtual void add_observer( const shared_ptr<index_observer>& o ) override
          {
             _observers.emplace_back( o );
          }
 
+         virtual void add_batched_observer( const shared_ptr<batched_index_observer>& o ) override
+         {
+            _batched_observers.emplace_back( o );
+         }
+
+         virtual void publish_changes() override { publish_collected_changes(); }
+
+         virtual void enable_versions() override
+         {
+            if( _versioned )
+               return;
+            _versioned = true;
+            DerivedIndex::inspect_all_objects( [this]( const object& obj ) { _unversioned.insert( obj.id ); } );
+         }
+
+         virtual void publish_versions( uint64_t epoch ) override
+         {
+            if( _unversioned.empty() )
+               return;
+            // The copies are made before taking the lock, so readers only wait while they are put in place
+            vector<pair<object_id_type, shared_ptr<const object>>> versions;
+            versions.reserve( _unversioned.size() );
+            for( auto id : _unversioned )
+            {
+               const object* obj = DerivedIndex::find( id );
+               if( obj )
+                  versions.emplace_back( id, std::make_shared<object_type>( static_cast<const object_type&>(*obj) ) );
+               else
+                  versions.emplace_back( id, shared_ptr<const object>() );
+            }
+            _unversioned.clear();
+            add_versions( versions, epoch );
+         }
+
+         virtual void reclaim_versions( uint64_t oldest_epoch ) override { reclaim_versions_before( oldest_epoch ); }
+
+         virtual shared_ptr<const object> find_version( object_id_type id, uint64_t epoch )const override
+         {
+            return find_version_of( id, epoch );
+         }
+
+         virtual index_stats stats()const override
+         {
+            index_stats result = DerivedIndex::stats();
+            result.container_bytes += _observers.capacity() * sizeof(_observers[0])
+                                    + _batched_observers.capacity() * sizeof(_batched_observers[0])
+                                    + _changes.bucket_count() * sizeof(void*);
+            for( const auto& change : _changes )
+               result.container_bytes += sizeof(change) + 2 * sizeof(void*)
+                                       + (change.second.before ? change.second.before->memory_usage() : 0);
+            return result;
+         }
+
       private:
+         void collect_add( const object& obj )
+         {
+            auto& change = _changes[obj.id];
+            change.id = obj.id;
+            change.after = &obj;
+         }
+         void collect_modify( const object& obj )
+         {
+            auto itr = _changes.find( obj.id );
+            if( itr != _changes.end() )
+               return;
+            auto& change = _changes[obj.id];
+            change.id = obj.id;
+            change.before = std::make_shared<object_type>( static_cast<const object_type&>(obj) );
+            change.after = &obj;
+         }
+         void collect_remove( const object& obj )
+         {
+            auto itr = _changes.find( obj.id );
+            if( itr == _changes.end() )
+            {
+               auto& change = _changes[obj.id];
+               change.id = obj.id;
+               change.before = std::make_shared<object_type>( static_cast<const object_type&>(obj) );
+            }
+            else if( !itr->second.before )
+            {
+               // Added since the last publish, so there is nothing to tell
+               _changes.erase( itr );
+               return;
+            }
+            else
+               itr->second.after = nullptr;
+         }
+
          object_id_type _next_id;
    };
 
+   /**
+    *  Names the index type an object type is stored in, as passed to primary_index when the index is added, so
+    *  that object_database::modify can call it without type erasure.  Object types which are not declared with
+    *  GRAPHENE_DB_OBJECT_INDEX are modified through the virtual index interface.
+    */
+   template<typename ObjectType>
+   struct object_index_type { typedef void type; };
+
 } } // graphene::db
+
+/**
+ *  Declares that OBJECT is stored in primary_index<INDEX>.  Like FC_REFLECT, this must be used in the global
+ *  namespace, right after OBJECT and INDEX are declared.
+ */
+#define GRAPHENE_DB_OBJECT_INDEX( OBJECT, INDEX ) \
+   namespace graphene { namespace db { \
+      template<> struct object_index_type<OBJECT> { typedef INDEX type; }; \
+   } }
+
+FC_REFLECT( graphene::db::index_stats, (space_id)(type_id)(object_count)(object_bytes)(container_bytes)(pool_used_bytes)(pool_free_bytes) )
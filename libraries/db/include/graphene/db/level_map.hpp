@@ -23,6 +23,7 @@
 #include <leveldb/write_batch.h>
 
 #include <graphene/db/exception.hpp>
+#include <graphene/db/level_options.hpp>
 #include <graphene/db/upgrade_leveldb.hpp>
 
 #include <fc/filesystem.hpp>
@@ -43,22 +44,15 @@ namespace graphene { namespace db {
   class level_map
   {
      public:
-        void open( const fc::path& dir, bool create = true, size_t cache_size = 0 )
+        void open( const fc::path& dir, bool create = true, size_t cache_size = 0,
+                   level_profile profile = default_profile )
         { try {
            FC_ASSERT( !is_open(), "Database is already open!" );
 
            ldb::Options opts;
            opts.comparator = &_comparer;
            opts.create_if_missing = create;
-           opts.max_open_files = 64;
-           opts.compression = leveldb::kNoCompression;
-
-           if( cache_size > 0 )
-           {
-               opts.write_buffer_size = cache_size / 4; // up to two write buffers may be held in memory simultaneously
-               _cache.reset( leveldb::NewLRUCache( cache_size / 2 ) );
-               opts.block_cache = _cache.get();
-           }
+           detail::set_level_options( opts, profile, cache_size, _cache, _filter_policy );
 
            if( ldb::kMajorVersion > 1 || ( leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16 ) )
            {
@@ -87,7 +81,7 @@ namespace graphene { namespace db {
            _db.reset( ndb );
 
            try_upgrade_db( dir, ndb, fc::get_typename<Value>::name(), sizeof( Value ) );
-        } FC_CAPTURE_AND_RETHROW( (dir)(create)(cache_size) ) }
+        } FC_CAPTURE_AND_RETHROW( (dir)(create)(cache_size)(profile) ) }
 
         bool is_open()const
         {
@@ -98,6 +92,7 @@ namespace graphene { namespace db {
         {
           _db.reset();
           _cache.reset();
+          _filter_policy.reset();
         }
 
         fc::optional<Value> fetch_optional( const Key& k )const
@@ -156,6 +151,12 @@ namespace graphene { namespace db {
                return tmp_val;
              }
 
+             /** The serialized value, which is only valid until the iterator is moved */
+             fc::datastream<const char*> value_stream()const
+             {
+               return fc::datastream<const char*>( _it->value().data(), _it->value().size() );
+             }
+
              iterator& operator++()    { _it->Next(); return *this; }
              iterator& operator--()    { _it->Prev(); return *this; }
 
@@ -295,6 +296,8 @@ namespace graphene { namespace db {
                 leveldb::WriteBatch   _batch;
                 level_map*            _map = nullptr;
                 leveldb::WriteOptions _write_options;
+                std::vector<char>     _key_buffer;
+                std::vector<char>     _value_buffer;
 
                 friend class level_map;
                 write_batch( level_map* map, bool sync = false ) : _map(map)
@@ -339,20 +342,13 @@ namespace graphene { namespace db {
 
                 void store( const Key& k, const Value& v )
                 {
-                  std::vector<char> kslice = fc::raw::pack(k);
-                  ldb::Slice ks(kslice.data(), kslice.size());
-
-                  auto vec = fc::raw::pack(v);
-                  ldb::Slice vs(vec.data(), vec.size());
-
-                  _batch.Put(ks, vs);
+                  // Put copies the slices, so the buffers are reused for every item of the batch
+                  _batch.Put( pack_slice( k, _key_buffer ), pack_slice( v, _value_buffer ) );
                 }
 
                 void remove( const Key& k )
                 {
-                  std::vector<char> kslice = fc::raw::pack(k);
-                  ldb::Slice ks(kslice.data(), kslice.size());
-                  _batch.Delete(ks);
+                  _batch.Delete( pack_slice( k, _key_buffer ) );
                 }
         };
 
@@ -428,6 +424,16 @@ namespace graphene { namespace db {
         }
 
      private:
+        /// Packs v into buffer, keeping the storage buffer already has, and returns a slice of it
+        template<typename T>
+        static ldb::Slice pack_slice( const T& v, std::vector<char>& buffer )
+        {
+           buffer.resize( fc::raw::pack_size( v ) );
+           fc::datastream<char*> ds( buffer.data(), buffer.size() );
+           fc::raw::pack( ds, v );
+           return ldb::Slice( buffer.data(), buffer.size() );
+        }
+
         class key_compare : public leveldb::Comparator
         {
           public:
@@ -451,6 +457,7 @@ namespace graphene { namespace db {
 
         std::unique_ptr<leveldb::DB>    _db;
         std::unique_ptr<leveldb::Cache> _cache;
+        std::unique_ptr<const leveldb::FilterPolicy> _filter_policy;
         key_compare                     _comparer;
 
         ldb::ReadOptions                _read_options;
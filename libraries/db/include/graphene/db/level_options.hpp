@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <leveldb/cache.h>
+#include <leveldb/filter_policy.h>
+#include <leveldb/options.h>
+
+#include <fc/reflect/reflect.hpp>
+
+#include <algorithm>
+#include <memory>
+
+namespace graphene { namespace db {
+
+  /**
+   *  The LevelDB settings suited to the way a store is used, chosen when a level_map or level_pod_map is opened.  The
+   *  cache size given with the profile is shared between the block cache and the write buffers as the profile favors
+   *  reads or writes.
+   */
+  enum level_profile
+  {
+     default_profile, ///< Uncompressed, a block cache of half the cache size and write buffers of a quarter
+     point_lookup,    ///< Random reads of single keys: a bloom filter, small blocks and most of the cache for blocks
+     sequential_scan, ///< Whole ranges read in order: large compressed blocks, which are not worth caching
+     write_heavy      ///< Mostly writes: large write buffers, so fewer and larger level 0 files are compacted
+  };
+
+  namespace detail {
+     /**
+      *  Fills opts for profile.  The block cache and filter policy this needs are returned in cache and filter, and
+      *  must outlive the database opened with opts.
+      */
+     inline void set_level_options( leveldb::Options& opts, level_profile profile, size_t cache_size,
+                                    std::unique_ptr<leveldb::Cache>& cache,
+                                    std::unique_ptr<const leveldb::FilterPolicy>& filter )
+     {
+        opts.max_open_files = 64;
+        opts.compression = leveldb::kNoCompression;
+
+        size_t block_cache_size = cache_size / 2;
+        if( cache_size > 0 )
+           opts.write_buffer_size = cache_size / 4; // up to two write buffers may be held in memory simultaneously
+
+        switch( profile )
+        {
+           case point_lookup:
+              filter.reset( leveldb::NewBloomFilterPolicy( 10 ) );
+              opts.filter_policy = filter.get();
+              opts.block_size = 4 * 1024;
+              opts.max_open_files = 256;
+              if( cache_size > 0 )
+              {
+                 block_cache_size = cache_size / 4 * 3;
+                 opts.write_buffer_size = std::max<size_t>( cache_size / 8, 1024 * 1024 );
+              }
+              break;
+           case sequential_scan:
+              opts.block_size = 64 * 1024;
+              opts.compression = leveldb::kSnappyCompression;
+              if( cache_size > 0 )
+              {
+                 block_cache_size = cache_size / 4;
+                 opts.write_buffer_size = cache_size / 4;
+              }
+              break;
+           case write_heavy:
+              opts.write_buffer_size = std::max<size_t>( cache_size / 3, 16 * 1024 * 1024 );
+              block_cache_size = cache_size / 4;
+              break;
+           case default_profile:
+              break;
+        }
+
+        if( block_cache_size > 0 )
+        {
+           cache.reset( leveldb::NewLRUCache( block_cache_size ) );
+           opts.block_cache = cache.get();
+        }
+     }
+  }
+
+} } // graphene::db
+
+FC_REFLECT_ENUM( graphene::db::level_profile, (default_profile)(point_lookup)(sequential_scan)(write_heavy) )
@@ -22,6 +22,7 @@
 #include <leveldb/db.h>
 
 #include <graphene/db/exception.hpp>
+#include <graphene/db/level_options.hpp>
 #include <graphene/db/upgrade_leveldb.hpp>
 
 #include <fc/filesystem.hpp>
@@ -40,22 +41,15 @@ namespace graphene { namespace db {
   class level_pod_map
   {
      public:
-        void open( const fc::path& dir, bool create = true, size_t cache_size = 0 )
+        void open( const fc::path& dir, bool create = true, size_t cache_size = 0,
+                   level_profile profile = default_profile )
         { try {
            FC_ASSERT( !is_open(), "Database is already open!" );
 
            ldb::Options opts;
            opts.comparator = &_comparer;
            opts.create_if_missing = create;
-           opts.max_open_files = 64;
-           opts.compression = leveldb::kNoCompression;
-
-           if( cache_size > 0 )
-           {
-               opts.write_buffer_size = cache_size / 4; // up to two write buffers may be held in memory simultaneously
-               _cache.reset( leveldb::NewLRUCache( cache_size / 2 ) );
-               opts.block_cache = _cache.get();
-           }
+           detail::set_level_options( opts, profile, cache_size, _cache, _filter_policy );
 
            if( ldb::kMajorVersion > 1 || ( leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16 ) )
            {
@@ -84,7 +78,7 @@ namespace graphene { namespace db {
            _db.reset( ndb );
 
            try_upgrade_db( dir, ndb, fc::get_typename<Value>::name(), sizeof( Value ) );
-        } FC_CAPTURE_AND_RETHROW( (dir)(create)(cache_size) ) }
+        } FC_CAPTURE_AND_RETHROW( (dir)(create)(cache_size)(profile) ) }
 
         bool is_open()const
         {
@@ -95,6 +89,7 @@ namespace graphene { namespace db {
         {
           _db.reset();
           _cache.reset();
+          _filter_policy.reset();
         }
 
         fc::optional<Value> fetch_optional( const Key& k )
@@ -298,6 +293,7 @@ namespace graphene { namespace db {
 
         std::unique_ptr<leveldb::DB>    _db;
         std::unique_ptr<leveldb::Cache> _cache;
+        std::unique_ptr<const leveldb::FilterPolicy> _filter_policy;
         key_compare                     _comparer;
 
         ldb::ReadOptions                _read_options;
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/db/level_map.hpp>
+
+#include <list>
+#include <map>
+#include <set>
+
+namespace graphene { namespace db {
+
+   struct lru_cache_stats
+   {
+      uint64_t hits = 0;
+      uint64_t misses = 0;      ///< lookups of keys not in the cache, whether or not LevelDB has them
+      uint64_t evictions = 0;
+      uint64_t entries = 0;
+      uint64_t dirty = 0;       ///< entries stored but not yet written to LevelDB
+      uint64_t bytes = 0;       ///< packed size of the cached keys and values
+      uint64_t byte_budget = 0;
+   };
+
+   /**
+    *  @class lru_level_map
+    *  @brief a level_map with a bounded cache of recently used entries in front of it
+    *
+    *  Unlike cached_level_map, which loads the whole database on open, entries are read from LevelDB the first time
+    *  they are looked up, and the least recently used ones are dropped once the packed size of the cache exceeds its
+    *  byte budget, so the database may be far larger than memory.  Stores and removals are kept in the cache and
+    *  written to LevelDB in a single batch by flush, which is also called when a dirty entry would be evicted.
+    */
+   template<typename Key, typename Value>
+   class lru_level_map
+   {
+      public:
+        void open( const fc::path& dir, size_t byte_budget, bool create = true, size_t leveldb_cache_size = 0,
+                   level_profile profile = point_lookup )
+        { try {
+            _db.open( dir, create, leveldb_cache_size, profile );
+            _stats = lru_cache_stats();
+            _stats.byte_budget = byte_budget;
+        } FC_CAPTURE_AND_RETHROW( (dir)(byte_budget)(create)(leveldb_cache_size)(profile) ) }
+
+        bool is_open()const { return _db.is_open(); }
+
+        void close()
+        { try {
+            if( _db.is_open() ) flush();
+            _db.close();
+            _lru.clear();
+            _entries.clear();
+            _dirty_store.clear();
+            _dirty_remove.clear();
+            _stats.entries = _stats.dirty = _stats.bytes = 0;
+        } FC_CAPTURE_AND_RETHROW() }
+
+        /** Writes every dirty entry and removal in one batch.  The entries stay cached. */
+        void flush()
+        { try {
+            if( _dirty_store.empty() && _dirty_remove.empty() )
+                return;
+            typename level_map<Key, Value>::write_batch batch = _db.create_batch();
+            for( const auto& key : _dirty_store )
+                batch.store( key, _entries.at( key )->value );
+            for( const auto& key : _dirty_remove )
+                batch.remove( key );
+            batch.commit();
+
+            _dirty_store.clear();
+            _dirty_remove.clear();
+            _stats.dirty = 0;
+        } FC_CAPTURE_AND_RETHROW() }
+
+        void set_byte_budget( size_t byte_budget )
+        { try {
+            _stats.byte_budget = byte_budget;
+            evict();
+        } FC_CAPTURE_AND_RETHROW( (byte_budget) ) }
+
+        fc::optional<Value> fetch_optional( const Key& key )
+        { try {
+            return lookup( key );
+        } FC_CAPTURE_AND_RETHROW( (key) ) }
+
+        Value fetch( const Key& key )
+        { try {
+            auto value = lookup( key );
+            if( value )
+                return *value;
+            FC_CAPTURE_AND_THROW( fc::key_not_found_exception, (key) );
+        } FC_CAPTURE_AND_RETHROW( (key) ) }
+
+        void store( const Key& key, const Value& value )
+        { try {
+            auto itr = _entries.find( key );
+            if( itr != _entries.end() )
+            {
+                _stats.bytes -= itr->second->bytes;
+                itr->second->value = value;
+                itr->second->bytes = fc::raw::pack_size( key ) + fc::raw::pack_size( value );
+                _stats.bytes += itr->second->bytes;
+                _lru.splice( _lru.begin(), _lru, itr->second );
+            }
+            else
+                insert( key, value );
+            if( _dirty_store.insert( key ).second )
+                ++_stats.dirty;
+            _dirty_remove.erase( key );
+            evict();
+        } FC_CAPTURE_AND_RETHROW( (key)(value) ) }
+
+        void remove( const Key& key )
+        { try {
+            auto itr = _entries.find( key );
+            if( itr != _entries.end() )
+            {
+                _stats.bytes -= itr->second->bytes;
+                _lru.erase( itr->second );
+                _entries.erase( itr );
+                --_stats.entries;
+            }
+            if( _dirty_store.erase( key ) )
+                --_stats.dirty;
+            _dirty_remove.insert( key );
+        } FC_CAPTURE_AND_RETHROW( (key) ) }
+
+        const lru_cache_stats& get_stats()const { return _stats; }
+
+      private:
+        struct entry
+        {
+            Key    key;
+            Value  value;
+            size_t bytes;
+        };
+        typedef std::list<entry> entry_list;
+
+        /// The value of key, which is read from LevelDB and cached on a miss
+        fc::optional<Value> lookup( const Key& key )
+        {
+            auto itr = _entries.find( key );
+            if( itr != _entries.end() )
+            {
+                ++_stats.hits;
+                _lru.splice( _lru.begin(), _lru, itr->second );
+                return itr->second->value;
+            }
+            ++_stats.misses;
+            if( _dirty_remove.count( key ) )
+                return fc::optional<Value>();
+            auto value = _db.fetch_optional( key );
+            if( value )
+            {
+                insert( key, *value );
+                evict();
+            }
+            return value;
+        }
+
+        void insert( const Key& key, const Value& value )
+        {
+            _lru.push_front( entry{ key, value, fc::raw::pack_size( key ) + fc::raw::pack_size( value ) } );
+            _entries[key] = _lru.begin();
+            _stats.bytes += _lru.front().bytes;
+            ++_stats.entries;
+        }
+
+        /// Drops the least recently used entries until the cache fits its budget, writing dirty entries first
+        void evict()
+        {
+            while( _stats.bytes > _stats.byte_budget && !_lru.empty() )
+            {
+                const entry& victim = _lru.back();
+                if( _dirty_store.count( victim.key ) )
+                    flush();
+                _stats.bytes -= victim.bytes;
+                _entries.erase( victim.key );
+                _lru.pop_back();
+                --_stats.entries;
+                ++_stats.evictions;
+            }
+        }
+
+        level_map<Key, Value>                              _db;
+        entry_list                                         _lru; ///< the most recently used first
+        std::map<Key, typename entry_list::iterator>       _entries;
+        std::set<Key>                                      _dirty_store;
+        std::set<Key>                                      _dirty_remove;
+        lru_cache_stats                                    _stats;
+   };
+
+} }
+
+FC_REFLECT( graphene::db::lru_cache_stats, (hits)(misses)(evictions)(entries)(dirty)(bytes)(byte_budget) )
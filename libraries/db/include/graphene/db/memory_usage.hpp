@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <fc/container/flat_fwd.hpp>
+#include <fc/optional.hpp>
+#include <fc/reflect/reflect.hpp>
+#include <fc/static_variant.hpp>
+
+#include <map>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   /**
+    *  @return an estimate of the heap memory owned by value, not counting sizeof(value) itself
+    *
+    *  Reflected structs add up the memory of their members, containers add their allocated capacity and the memory
+    *  of their elements, and everything else is assumed to own none.  Tree nodes are assumed to hold three pointers
+    *  and a color alongside their value.
+    */
+   template<typename T>
+   size_t dynamic_memory_usage( const T& value );
+
+   inline size_t dynamic_memory_usage( const std::string& value )
+   {
+      // Short strings are assumed to be stored inside the string
+      return value.capacity() < sizeof(std::string) ? 0 : value.capacity() + 1;
+   }
+   template<typename T, typename A>
+   size_t dynamic_memory_usage( const std::vector<T,A>& value );
+   template<typename T, typename C, typename A>
+   size_t dynamic_memory_usage( const boost::container::flat_set<T,C,A>& value );
+   template<typename K, typename V, typename C, typename A>
+   size_t dynamic_memory_usage( const boost::container::flat_map<K,V,C,A>& value );
+   template<typename T, typename C, typename A>
+   size_t dynamic_memory_usage( const std::set<T,C,A>& value );
+   template<typename K, typename V, typename C, typename A>
+   size_t dynamic_memory_usage( const std::map<K,V,C,A>& value );
+   template<typename K, typename V>
+   size_t dynamic_memory_usage( const std::pair<K,V>& value );
+   template<typename T>
+   size_t dynamic_memory_usage( const fc::optional<T>& value );
+   template<typename... Types>
+   size_t dynamic_memory_usage( const fc::static_variant<Types...>& value );
+
+   namespace detail {
+      static const size_t tree_node_overhead = 4 * sizeof(void*);
+
+      template<typename Iterator>
+      size_t elements_memory_usage( Iterator begin, Iterator end )
+      {
+         size_t usage = 0;
+         for( ; begin != end; ++begin )
+            usage += dynamic_memory_usage( *begin );
+         return usage;
+      }
+
+      template<typename T>
+      struct member_memory_usage_visitor
+      {
+         member_memory_usage_visitor( const T& v, size_t& u ):value(v),usage(u){}
+
+         template<typename Member, class Class, Member (Class::*member)>
+         void operator()( const char* name )const
+         {
+            usage += dynamic_memory_usage( value.*member );
+         }
+
+         const T& value;
+         size_t&  usage;
+      };
+
+      struct variant_memory_usage_visitor
+      {
+         typedef size_t result_type;
+         template<typename T>
+         size_t operator()( const T& value )const { return dynamic_memory_usage( value ); }
+      };
+
+      template<typename T>
+      size_t reflected_memory_usage( const T& value, std::true_type )
+      {
+         size_t usage = 0;
+         fc::reflector<T>::visit( member_memory_usage_visitor<T>( value, usage ) );
+         return usage;
+      }
+      template<typename T>
+      size_t reflected_memory_usage( const T&, std::false_type ) { return 0; }
+   }
+
+   template<typename T>
+   size_t dynamic_memory_usage( const T& value )
+   {
+      typedef std::integral_constant<bool, std::is_class<T>::value && fc::reflector<T>::is_defined::value> is_reflected;
+      return detail::reflected_memory_usage( value, is_reflected() );
+   }
+   template<typename T, typename A>
+   size_t dynamic_memory_usage( const std::vector<T,A>& value )
+   {
+      return value.capacity() * sizeof(T) + detail::elements_memory_usage( value.begin(), value.end() );
+   }
+   template<typename T, typename C, typename A>
+   size_t dynamic_memory_usage( const boost::container::flat_set<T,C,A>& value )
+   {
+      return value.capacity() * sizeof(T) + detail::elements_memory_usage( value.begin(), value.end() );
+   }
+   template<typename K, typename V, typename C, typename A>
+   size_t dynamic_memory_usage( const boost::container::flat_map<K,V,C,A>& value )
+   {
+      return value.capacity() * sizeof(std::pair<K,V>) + detail::elements_memory_usage( value.begin(), value.end() );
+   }
+   template<typename T, typename C, typename A>
+   size_t dynamic_memory_usage( const std::set<T,C,A>& value )
+   {
+      return value.size() * (sizeof(T) + detail::tree_node_overhead)
+             + detail::elements_memory_usage( value.begin(), value.end() );
+   }
+   template<typename K, typename V, typename C, typename A>
+   size_t dynamic_memory_usage( const std::map<K,V,C,A>& value )
+   {
+      return value.size() * (sizeof(std::pair<const K,V>) + detail::tree_node_overhead)
+             + detail::elements_memory_usage( value.begin(), value.end() );
+   }
+   template<typename K, typename V>
+   size_t dynamic_memory_usage( const std::pair<K,V>& value )
+   {
+      return dynamic_memory_usage( value.first ) + dynamic_memory_usage( value.second );
+   }
+   template<typename T>
+   size_t dynamic_memory_usage( const fc::optional<T>& value )
+   {
+      return value.valid() ? dynamic_memory_usage( *value ) : 0;
+   }
+   template<typename... Types>
+   size_t dynamic_memory_usage( const fc::static_variant<Types...>& value )
+   {
+      return value.visit( detail::variant_memory_usage_visitor() );
+   }
+
+} } // graphene::db
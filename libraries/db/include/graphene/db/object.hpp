@@ -16,6 +16,7 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #pragma once
+#include <graphene/db/memory_usage.hpp>
 #include <graphene/db/object_id.hpp>
 #include <fc/io/raw.hpp>
 
@@ -64,6 +65,16 @@ namespace graphene { namespace db {
 
          /// these methods are implemented for derived classes by inheriting abstract_object<DerivedClass>
          virtual unique_ptr<object> clone()const = 0;
+         /// copy constructs this object into storage of at least object_size() bytes
+         virtual object*            clone_into( void* storage )const = 0;
+         virtual size_t             object_size()const = 0;
+         /// an estimate of the memory held by this object, including what its members allocate
+         virtual size_t             memory_usage()const = 0;
+         /// serializes this object into data, which must hold packed_size() bytes
+         virtual size_t             packed_size()const = 0;
+         virtual void               pack_into( char* data, size_t size )const = 0;
+         /// replaces the contents of this object with the result of pack_into()
+         virtual void               unpack_from( const char* data, size_t size ) = 0;
          virtual void               move_from( object& obj ) = 0;
          virtual variant            to_variant()const  = 0;
          virtual vector<char>       pack()const = 0;
@@ -84,6 +95,15 @@ namespace graphene { namespace db {
          {
             return unique_ptr<object>(new DerivedClass( *static_cast<const DerivedClass*>(this) ));
          }
+         virtual object* clone_into( void* storage )const
+         {
+            return new (storage) DerivedClass( *static_cast<const DerivedClass*>(this) );
+         }
+         virtual size_t  object_size()const { return sizeof(DerivedClass); }
+         virtual size_t  memory_usage()const
+         {
+            return sizeof(DerivedClass) + dynamic_memory_usage( static_cast<const DerivedClass&>(*this) );
+         }
 
          virtual void    move_from( object& obj )
          {
@@ -91,6 +111,19 @@ namespace graphene { namespace db {
          }
          virtual variant to_variant()const { return variant( static_cast<const DerivedClass&>(*this) ); }
          virtual vector<char> pack()const  { return fc::raw::pack( static_cast<const DerivedClass&>(*this) ); }
+         virtual size_t  packed_size()const { return fc::raw::pack_size( static_cast<const DerivedClass&>(*this) ); }
+         virtual void    pack_into( char* data, size_t size )const
+         {
+            fc::datastream<char*> ds( data, size );
+            fc::raw::pack( ds, static_cast<const DerivedClass&>(*this) );
+         }
+         virtual void    unpack_from( const char* data, size_t size )
+         {
+            fc::datastream<const char*> ds( data, size );
+            DerivedClass tmp;
+            fc::raw::unpack( ds, tmp );
+            static_cast<DerivedClass&>(*this) = std::move( tmp );
+         }
    };
 
    /**
@@ -19,16 +19,119 @@
 #include <graphene/db/object.hpp>
 #include <graphene/db/index.hpp>
 #include <graphene/db/undo_database.hpp>
+#include <graphene/db/state_hash.hpp>
 
 #include <graphene/db/level_map.hpp>
 #include <graphene/db/level_pod_map.hpp>
 
+#include <fc/crypto/sha256.hpp>
 #include <fc/log/logger.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <map>
+#include <mutex>
+#include <type_traits>
+#include <unordered_set>
 
 namespace graphene { namespace db {
 
+   /**
+    *  A snapshot file starts with this header, followed by the table of its sections, the extra data saved along
+    *  with it, and finally the objects of every section packed back to back.  The checksum covers everything after
+    *  the header.
+    */
+   struct snapshot_header
+   {
+      static const uint64_t expected_magic  = 0x50414e5348505247ull; // "GRPHSNAP" in little endian order
+      static const uint32_t current_version = 1;
+
+      uint64_t    magic = expected_magic;
+      uint32_t    version = current_version;
+      fc::sha256  checksum;
+   };
+
+   /** Locates the objects of one index in a snapshot file */
+   struct snapshot_section
+   {
+      uint8_t         space_id = 0;
+      uint8_t         type_id = 0;
+      object_id_type  next_id;
+      uint64_t        offset = 0; ///< from the start of the file
+      uint64_t        size = 0;
+   };
+
+   /**
+    *  The objects created, modified and removed over a span of time, serialized so that they can be written to disk
+    *  while the objects themselves keep changing.
+    */
+   struct object_changes
+   {
+      vector<pair<object_id_type, vector<char>>> stored;
+      vector<object_id_type>                     removed;
+      vector<object_id_type>                     next_ids;
+   };
+
+   namespace detail {
+      size_t next_index_slot();
+
+      /**
+       * Every space and type gets a slot of its own the first time it is used, so that the index of an object_id
+       * type can be found at a fixed offset rather than through the space and type tables.
+       */
+      template<uint8_t SpaceID, uint8_t TypeID>
+      size_t index_slot()
+      {
+         static const size_t slot = next_index_slot();
+         return slot;
+      }
+   }
+
+   class object_database;
+
+   /**
+    *  @class read_view
+    *  @brief reads the objects of an object_database as they were when it last published them, from any thread
+    *
+    *  A read view belongs to the epoch published last when it was taken, and keeps seeing that epoch while the
+    *  database goes on changing.  The copies it may see are only released once every read view of their epoch is
+    *  gone, so views should not be held for longer than the reads take.
+    */
+   class read_view
+   {
+      public:
+         read_view( read_view&& other );
+         ~read_view();
+
+         uint64_t epoch()const { return _epoch; }
+
+         /** @return the object with id, or nullptr if it did not exist in this epoch */
+         shared_ptr<const object> find_object( object_id_type id )const;
+
+         template<typename T>
+         shared_ptr<const T> find( object_id_type id )const
+         {
+            shared_ptr<const object> obj = find_object( id );
+            assert( !obj || nullptr != dynamic_cast<const T*>(obj.get()) );
+            return std::static_pointer_cast<const T>( obj );
+         }
+         template<typename T>
+         shared_ptr<const T> get( object_id_type id )const
+         {
+            shared_ptr<const T> obj = find<T>( id );
+            FC_ASSERT( obj, "Unable to find Object", ("id",id)("epoch",_epoch) );
+            return obj;
+         }
+
+      private:
+         friend class object_database;
+         read_view( const object_database& db, uint64_t epoch ):_db(&db),_epoch(epoch){}
+         read_view( const read_view& ) = delete;
+         read_view& operator=( const read_view& ) = delete;
+
+         const object_database* _db;
+         uint64_t               _epoch;
+   };
+
    /**
     *   @class object_database
     *   @brief maintains a set of indexed objects that can be modified with multi-level rollback support
@@ -39,17 +142,77 @@ namespace graphene { namespace db {
          object_database();
          ~object_database();
 
-         void reset_indexes() { _index.clear(); _index.resize(255); }
+         void reset_indexes() { _index.clear(); _index.resize(255); _index_by_slot.clear(); }
 
          void open(const fc::path& data_dir );
+         /**
+          * The LevelDB profile and cache size of the object store, which take effect when it is opened.  The store is
+          * read from start to end when it is opened and written in batches after that.
+          */
+         void set_store_options( level_profile profile, size_t cache_size )
+         {
+            _store_profile = profile;
+            _store_cache_size = cache_size;
+         }
 
          /**
-          * Saves the complete state of the object_database to disk, this could take a while
+          * Saves the state of the object_database to disk.  Only the objects created, modified or removed since the
+          * last flush are written, in a single batch.  With sync, it returns once the batch is on disk.
           */
-         void flush();
+         void flush( bool sync = false );
          void wipe(const fc::path& data_dir); // remove from disk
          void close();
 
+         /**
+          * Serializes the objects changed since the last flush or capture, and clears them from the changed set.
+          * Nothing is written until the changes are passed to write_changes.
+          */
+         shared_ptr<object_changes> capture_changes();
+         /**
+          * Writes captured changes to disk in a single batch on a background thread.  Changes are written in the
+          * order they are passed, and before any later flush.  With sync, the batch and every one written before it
+          * are on disk once the write finishes.  Does nothing if the database is not open.
+          */
+         void write_changes( const shared_ptr<const object_changes>& changes, bool sync = false );
+         /** Puts the objects of captured changes which will never be written back in the changed set */
+         void discard_changes( const object_changes& changes );
+         /** Waits for every write started by write_changes to finish */
+         void wait_for_writes();
+
+         /**
+          * Serializes the objects with the given ids as they are now, listing those which no longer exist as
+          * removed.  Unlike capture_changes, this leaves the changed set alone.
+          */
+         shared_ptr<object_changes> pack_objects( const vector<object_id_type>& ids )const;
+         /** Serializes every object, as the changes which bring a database with the same empty indexes up to this one */
+         shared_ptr<object_changes> pack_all_objects()const;
+         /**
+          * Applies changes packed from another database, then hands them to the batched observers.  Objects of
+          * indexes this database lacks are skipped.  Inside an undo session, the changes are undone with it,
+          * including the objects created.
+          */
+         void apply_changes( const object_changes& changes );
+         /**
+          * Replaces the state with state, as packed by pack_all_objects: the objects it lacks are removed, then it is
+          * applied as by apply_changes.  Indexes this database lacks are skipped, and those state lacks are emptied.
+          */
+         void replace_all_objects( const object_changes& state );
+         /** Removes every object and starts every index over from its first id, so that a snapshot can be loaded */
+         void remove_all_objects();
+
+         /**
+          * Writes every object and the next id of every index to a single snapshot file, along with extra data
+          * which is returned as is by load_snapshot.
+          */
+         void write_snapshot( const fc::path& file, const vector<char>& extra )const;
+         /**
+          * Loads the objects of a snapshot file into the indexes, which must be empty.  The objects are written to
+          * disk by the next flush.
+          *
+          * @return the extra data passed to write_snapshot
+          */
+         vector<char> load_snapshot( const fc::path& file );
+
          template<typename T, typename F>
          const T& create( F&& constructor )
          {
@@ -66,12 +229,25 @@ namespace graphene { namespace db {
          template<typename IndexType>
          const IndexType& get_index_type()const {
             static_assert( std::is_base_of<index,IndexType>::value, "Type must be an index type" );
-            return static_cast<const IndexType&>( get_index( IndexType::object_type::space_id, IndexType::object_type::type_id ) );
+            typedef typename IndexType::object_type object_type;
+            const index& idx = get_index<object_type::space_id, object_type::type_id>();
+            assert( nullptr != dynamic_cast<const IndexType*>(&idx) );
+            return static_cast<const IndexType&>( idx );
          }
          template<typename T>
-         const index&  get_index()const { return get_index(T::space_id,T::type_id); }
+         const index&  get_index()const { return get_index<T::space_id,T::type_id>(); }
+         /** Checks that the index exists in debug builds only */
+         template<uint8_t SpaceID, uint8_t TypeID>
+         const index&  get_index()const
+         {
+            const size_t slot = detail::index_slot<SpaceID,TypeID>();
+            assert( slot < _index_by_slot.size() && _index_by_slot[slot] );
+            return *_index_by_slot[slot];
+         }
          const index&  get_index(uint8_t space_id, uint8_t type_id)const;
          const index&  get_index(object_id_type id)const { return get_index(id.space(),id.type()); }
+         /// @return the index of objects like id, or nullptr if there is none
+         const index*  find_index(object_id_type id)const;
          /// @}
 
          const object& get_object( object_id_type id )const;
@@ -81,11 +257,20 @@ namespace graphene { namespace db {
          /// in order to maintain proper undo history.
          ///@{
 
-         const object& insert( object&& obj ) { return get_mutable_index(obj.id).insert( std::move(obj) ); }
+         const object& insert( object&& obj )
+         {
+            mark_dirty( obj.id );
+            return get_mutable_index(obj.id).insert( std::move(obj) );
+         }
          void          remove( const object& obj ) { get_mutable_index(obj.id).remove( obj ); }
+         /**
+          * If the index of T is declared with GRAPHENE_DB_OBJECT_INDEX, m is called on the concrete index type
+          * without type erasure.
+          */
          template<typename T, typename Lambda>
          void modify( const T& obj, const Lambda& m ) {
-            get_mutable_index(obj.id).modify(obj,m);
+            typedef typename object_index_type<T>::type index_type;
+            modify( obj, m, static_cast<index_type*>(nullptr), std::is_void<index_type>() );
          }
 
          ///@}
@@ -106,10 +291,20 @@ namespace graphene { namespace db {
          }
 
          template<uint8_t SpaceID, uint8_t TypeID, typename T>
-         const T* find( object_id<SpaceID,TypeID,T> id )const { return find<T>(id); }
+         const T* find( object_id<SpaceID,TypeID,T> id )const
+         {
+            const object* obj = get_index<SpaceID,TypeID>().find( id );
+            assert(  !obj || nullptr != dynamic_cast<const T*>(obj) );
+            return static_cast<const T*>(obj);
+         }
 
          template<uint8_t SpaceID, uint8_t TypeID, typename T>
-         const T& get( object_id<SpaceID,TypeID,T> id )const { return get<T>(id); }
+         const T& get( object_id<SpaceID,TypeID,T> id )const
+         {
+            const object& obj = get_index<SpaceID,TypeID>().get( id );
+            assert( nullptr != dynamic_cast<const T*>(&obj) );
+            return static_cast<const T&>(obj);
+         }
 
          template<typename IndexType>
          const IndexType* add_index()
@@ -119,12 +314,54 @@ namespace graphene { namespace db {
                 _index[ObjectType::space_id].resize( 255 );
             assert(!_index[ObjectType::space_id][ObjectType::type_id]);
             unique_ptr<index> indexptr( new IndexType(*this) );
+            const size_t slot = detail::index_slot<ObjectType::space_id, ObjectType::type_id>();
+            if( _index_by_slot.size() <= slot )
+               _index_by_slot.resize( slot + 1 );
+            _index_by_slot[slot] = indexptr.get();
+            if( _read_views_enabled )
+               indexptr->enable_versions();
             _index[ObjectType::space_id][ObjectType::type_id] = std::move(indexptr);
             return static_cast<const IndexType*>(_index[ObjectType::space_id][ObjectType::type_id].get());
          }
 
          void pop_undo();
 
+         /** Registers an observer for the changes to the objects of type T, which are handed over all at once */
+         template<typename T>
+         void add_batched_observer( const shared_ptr<batched_index_observer>& observer )
+         {
+            get_mutable_index<T>().add_batched_observer( observer );
+         }
+         /** Hands the changes collected by every index to its batched observers */
+         void publish_changes();
+
+         /**
+          * Starts keeping copies of every object for read views, which other threads may then take while the
+          * database changes.  Indexes added later keep copies as well, and the current state is published at once.
+          */
+         void enable_read_views();
+         bool read_views_enabled()const { return _read_views_enabled; }
+         /**
+          * Publishes the objects changed since the last call as a new epoch, which read views taken from then on
+          * see, and releases the copies which no read view can see anymore.  Does nothing unless read views are
+          * enabled.
+          */
+         void publish_read_view();
+         /** Takes a read view of the last published epoch.  This may be called from any thread. */
+         read_view get_read_view()const;
+
+         /**
+          * Starts keeping a state_hash of the objects of the indexes of space_ids, hashing every object they hold now.
+          * The hash is brought up to date by publish_changes, so this should be called when no change is pending, and
+          * indexes added to those spaces later are not covered.
+          */
+         void enable_state_hash_of( const vector<uint8_t>& space_ids );
+         /// @return the hash of the covered objects as of the last publish_changes, or nullptr if it is not kept
+         const state_hash* get_state_hash_object()const { return _state_hash.get(); }
+
+         /** Reports the memory held by every index.  This visits every object, so it is slow on large databases. */
+         vector<index_stats> get_index_stats()const;
+
          fc::path get_data_dir()const { return _data_dir; }
 
          /** public for testing purposes only... should be private in practice. */
@@ -132,15 +369,24 @@ namespace graphene { namespace db {
      protected:
          template<typename IndexType>
          IndexType&    get_mutable_index_type() {
-            static_assert( std::is_base_of<index,IndexType>::value, "Type must be an index type" );
-            return static_cast<IndexType&>( get_mutable_index( IndexType::object_type::space_id, IndexType::object_type::type_id ) );
+            return const_cast<IndexType&>( get_index_type<IndexType>() );
          }
          template<typename T>
-         index& get_mutable_index()                   { return get_mutable_index(T::space_id,T::type_id); }
+         index& get_mutable_index()                   { return const_cast<index&>( get_index<T>() ); }
          index& get_mutable_index(object_id_type id)  { return get_mutable_index(id.space(),id.type());   }
          index& get_mutable_index(uint8_t space_id, uint8_t type_id);
 
      private:
+         template<typename T, typename Lambda, typename IndexType>
+         void modify( const T& obj, const Lambda& m, IndexType*, std::true_type ) {
+            get_mutable_index(obj.id).modify(obj,m);
+         }
+         template<typename T, typename Lambda, typename IndexType>
+         void modify( const T& obj, const Lambda& m, IndexType*, std::false_type ) {
+            index& idx = get_mutable_index<T>();
+            assert( nullptr != dynamic_cast<primary_index<IndexType>*>(&idx) );
+            static_cast<primary_index<IndexType>&>(idx).modify_typed( obj, m );
+         }
 
          friend class base_primary_index;
          friend class undo_database;
@@ -148,11 +394,54 @@ namespace graphene { namespace db {
          void save_undo_add( const object& obj );
          void save_undo_remove( const object& obj );
 
+         /// Dirty objects are only tracked while the database is open, as only then is there anything to flush
+         void mark_dirty( object_id_type id );
+         void mark_removed( object_id_type id );
+
+         /**
+          * Unpacks the objects of several indexes on worker threads, inserting those of each index on the calling
+          * thread once they are ready.  If an index has nothing to unpack, fallback is called for it instead.
+          */
+         void load_indexes( const vector<index*>& indexes,
+                            const std::function<shared_ptr<unpacked_objects>(const index&)>& unpack,
+                            const std::function<void(index&)>& fallback );
+
+         /// Packs the objects with ids into changes.stored, a batch per index, adding those not found to changes.removed
+         void pack_by_index( vector<object_id_type>& ids, object_changes& changes )const;
+
+         static void store_changes( db::level_map<object_id_type, vector<char>>& db, const object_changes& changes,
+                                    bool sync );
+
          fc::path                                                  _data_dir;
          vector< vector< unique_ptr<index> > >                     _index;
+         /// The same indexes by detail::index_slot, for lookups through a typed object_id
+         vector< index* >                                          _index_by_slot;
          shared_ptr<db::level_map<object_id_type, vector<char> >>  _object_id_to_object;
+         level_profile                                             _store_profile = default_profile;
+         size_t                                                    _store_cache_size = 0;
+         /// Objects created or modified since the last flush
+         std::unordered_set<object_id_type>                        _dirty_objects;
+         /// Objects removed since the last flush
+         std::unordered_set<object_id_type>                        _removed_objects;
+         unique_ptr<fc::thread>                                    _write_thread;
+         fc::future<void>                                          _pending_write;
+
+         friend class read_view;
+         void release_read_view( uint64_t epoch )const;
+
+         shared_ptr<state_hash>                                    _state_hash;
+
+         bool                                                      _read_views_enabled = false;
+         /// The epoch of new read views, and the number of read views of every epoch, guarded by _read_view_mutex
+         uint64_t                                                  _published_epoch = 0;
+         mutable std::map<uint64_t, uint32_t>                      _read_views;
+         mutable std::mutex                                        _read_view_mutex;
    };
 
 } } // graphene::db
 
+FC_REFLECT( graphene::db::object_changes, (stored)(removed)(next_ids) )
+FC_REFLECT( graphene::db::snapshot_header, (magic)(version)(checksum) )
+FC_REFLECT( graphene::db::snapshot_section, (space_id)(type_id)(next_id)(offset)(size) )
+
 
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/db/page_arena.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace graphene { namespace db {
+
+   /** The memory of an object_pool */
+   struct pool_stats
+   {
+      uint64_t element_size = 0;
+      /// held by elements handed out
+      uint64_t used_bytes = 0;
+      /// held by the pool for elements to come, freed ones included
+      uint64_t free_bytes = 0;
+   };
+
+   /**
+    * @class object_pool
+    * @brief hands out memory for elements of one size from chunks which are kept until the pool is destroyed
+    *
+    * The size is that of the first allocation.  Freed elements are reused by later allocations of the same size
+    * rather than returned to the global allocator, so an index which keeps creating and removing objects of one
+    * type reuses its own memory instead of fragmenting the heap.  Allocations of any other size go to the global
+    * allocator.  Elements are aligned for any type, like those of operator new.  Chunks come from a page_arena,
+    * so they are backed by huge pages when those are enabled.
+    *
+    * A pool belongs to the index which owns it, and is not thread safe.
+    */
+   class object_pool
+   {
+      public:
+         static const size_t elements_per_chunk = 256;
+
+         object_pool(){}
+         object_pool( const object_pool& ) = delete;
+         object_pool& operator=( const object_pool& ) = delete;
+
+         void* allocate( size_t size )
+         {
+            if( _element_size == 0 )
+            {
+               _element_size = size;
+               const size_t min_stride = std::max( size, sizeof(free_element) );
+               _stride = (min_stride + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+            }
+            if( size != _element_size )
+               return ::operator new( size );
+
+            ++_used;
+            if( _free )
+            {
+               free_element* result = _free;
+               _free = _free->next;
+                  return result;
+            }
+            if( _chunk == nullptr || _next_in_chunk == elements_per_chunk )
+            {
+               // the arena aligns its chunks for any object, so every element at a multiple of the stride is aligned
+               _chunk = static_cast<char*>( _arena.allocate( _stride * elements_per_chunk ) );
+               ++_chunk_count;
+               _next_in_chunk = 0;
+            }
+            return _chunk + _stride * _next_in_chunk++;
+         }
+
+         void deallocate( void* p, size_t size )
+         {
+            if( size != _element_size || _element_size == 0 )
+            {
+               ::operator delete( p );
+               return;
+            }
+            free_element* element = static_cast<free_element*>( p );
+            element->next = _free;
+            _free = element;
+            --_used;
+         }
+
+         pool_stats stats()const
+         {
+            pool_stats result;
+            result.element_size = _element_size;
+            result.used_bytes = _used * _stride;
+            result.free_bytes = _chunk_count * elements_per_chunk * _stride - result.used_bytes;
+            return result;
+         }
+
+      private:
+         struct free_element { free_element* next; };
+
+         size_t                          _element_size = 0;
+         size_t                          _stride = 0;
+         page_arena                      _arena;
+         char*                           _chunk = nullptr;
+         uint64_t                        _chunk_count = 0;
+         /// elements of _chunk handed out at least once
+         size_t                          _next_in_chunk = 0;
+         free_element*                   _free = nullptr;
+         uint64_t                        _used = 0;
+   };
+
+   /**
+    * Allocates single elements from an object_pool, and arrays from the global allocator.  Containers rebind it to
+    * their node types, which then share the pool; the node type allocated first is the one pooled.
+    */
+   template<typename T>
+   struct pool_allocator
+   {
+      typedef T               value_type;
+      typedef T*              pointer;
+      typedef const T*        const_pointer;
+      typedef T&              reference;
+      typedef const T&        const_reference;
+      typedef std::size_t     size_type;
+      typedef std::ptrdiff_t  difference_type;
+      template<typename U> struct rebind { typedef pool_allocator<U> other; };
+
+      pool_allocator( object_pool& p ):pool(&p){}
+      template<typename U>
+      pool_allocator( const pool_allocator<U>& other ):pool(other.pool){}
+
+      T* allocate( size_t n, const void* = nullptr )
+      {
+         if( n == 1 )
+            return static_cast<T*>( pool->allocate( sizeof(T) ) );
+         return static_cast<T*>( ::operator new( n * sizeof(T) ) );
+      }
+      void deallocate( T* p, size_t n )
+      {
+         if( n == 1 )
+            pool->deallocate( p, sizeof(T) );
+         else
+            ::operator delete( p );
+      }
+
+      size_type max_size()const { return size_type(-1) / sizeof(T); }
+      pointer       address( reference r )const { return std::addressof( r ); }
+      const_pointer address( const_reference r )const { return std::addressof( r ); }
+      template<typename U, typename... Args>
+      void construct( U* p, Args&&... args ) { ::new( static_cast<void*>(p) ) U( std::forward<Args>(args)... ); }
+      template<typename U>
+      void destroy( U* p ) { p->~U(); }
+
+      template<typename U>
+      bool operator == ( const pool_allocator<U>& other )const { return pool == other.pool; }
+      template<typename U>
+      bool operator != ( const pool_allocator<U>& other )const { return pool != other.pool; }
+
+      object_pool* pool;
+   };
+
+} } // graphene::db
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   /** How page_arena backs the memory of the indexes */
+   enum huge_page_mode
+   {
+      no_huge_pages,
+      /// regions are mapped 2MB aligned and marked for transparent huge pages
+      transparent_huge_pages,
+      /// regions are mapped from the kernel's reserved huge pages, or as transparent ones if none are left
+      explicit_huge_pages
+   };
+
+   /** Applies to the regions page arenas map from now on */
+   void           set_huge_page_mode( huge_page_mode mode );
+   huge_page_mode get_huge_page_mode();
+   huge_page_mode huge_page_mode_from_string( const std::string& name );
+   std::string    to_string( huge_page_mode mode );
+
+   /**
+    * @class page_arena
+    * @brief hands out the chunks of one index from large regions, which may be backed by huge pages
+    *
+    * Slab and pool chunks are kept for the life of their index, so nothing is freed before the arena is destroyed.
+    * With huge pages off, every chunk is allocated on its own from the heap.  Otherwise chunks are carved from
+    * regions of at least region_size bytes, so that an index spanning many chunks needs few TLB entries.
+    */
+   class page_arena
+   {
+      public:
+         static const size_t region_size = 2*1024*1024;
+
+         page_arena(){}
+         page_arena( const page_arena& ) = delete;
+         page_arena& operator=( const page_arena& ) = delete;
+         ~page_arena();
+
+         /** The result is aligned for any type */
+         void* allocate( size_t bytes );
+
+         /** The bytes held by the arena, and the part of them mapped with huge pages requested */
+         uint64_t reserved_bytes()const { return _reserved_bytes; }
+         uint64_t huge_page_bytes()const { return _huge_page_bytes; }
+
+      private:
+         struct region
+         {
+            char*  data = nullptr;
+            size_t size = 0;
+            /// whether data came from mmap rather than new[]
+            bool   mapped = false;
+         };
+
+         std::vector<region> _regions;
+         /// the part of the last mapped region handed out
+         size_t              _offset = 0;
+         uint64_t            _reserved_bytes = 0;
+         uint64_t            _huge_page_bytes = 0;
+   };
+
+} } // graphene::db
@@ -17,6 +17,7 @@
  */
 #pragma once
 #include <graphene/db/index.hpp>
+#include <graphene/db/object_pool.hpp>
 
 namespace graphene { namespace db {
 
@@ -27,6 +28,8 @@ namespace graphene { namespace db {
     *  This index is preferred in situations where the data will never be
     *  removed from main memory and when access by ID is the only kind
     *  of access that is necessary.
+    *
+    *  The objects are allocated from a pool owned by the index.
     */
    template<typename T>
    class simple_index : public index
@@ -34,12 +37,25 @@ namespace graphene { namespace db {
       public:
          typedef T object_type;
 
+         /** Returns the memory of an object to the pool it came from */
+         struct pool_deleter
+         {
+            pool_deleter( object_pool* p = nullptr ):pool(p){}
+            void operator()( object* p )const
+            {
+               p->~object();
+               pool->deallocate( p, sizeof(T) );
+            }
+            object_pool* pool;
+         };
+         typedef unique_ptr<object, pool_deleter> object_ptr;
+
          virtual const object&  create( const std::function<void(object&)>& constructor ) override
          {
              auto id = get_next_id();
              auto instance = id.instance();
              if( instance >= _objects.size() ) _objects.resize( instance + 1 );
-             _objects[instance].reset(new T);
+             _objects[instance] = make_object();
              _objects[instance]->id = id;
              constructor( *_objects[instance] );
              _objects[instance]->id = id; // just in case it changed
@@ -53,16 +69,26 @@ namespace graphene { namespace db {
             modify_callback( *_objects[obj.id.instance()] );
          }
 
+         template<typename Lambda>
+         void modify_typed( const T& obj, const Lambda& m )
+         {
+            assert( obj.id.instance() < _objects.size() );
+            m( *_objects[obj.id.instance()] );
+         }
+
          virtual const object& insert( object&& obj )
          {
             auto instance = obj.id.instance();
             assert( nullptr != dynamic_cast<T*>(&obj) );
             if( _objects.size() <= instance ) _objects.resize( instance+1 );
             assert( !_objects[instance] );
-            _objects[instance].reset( new T( std::move( static_cast<T&>(obj) ) ) );
+            _objects[instance] = make_object( std::move( static_cast<T&>(obj) ) );
             return *_objects[instance];
          }
 
+         /** Makes room for instance_count instances ahead of inserting many objects */
+         void reserve( size_t object_count, size_t instance_count ) { _objects.reserve( instance_count ); }
+
          virtual void remove( const object& obj ) override
          {
             assert( nullptr != dynamic_cast<const T*>(&obj) );
@@ -93,13 +119,23 @@ namespace graphene { namespace db {
             } FC_CAPTURE_AND_RETHROW()
          }
 
+         virtual index_stats stats()const override
+         {
+            index_stats result = index::stats();
+            result.container_bytes += _objects.capacity() * sizeof(_objects[0]);
+            const pool_stats pool = _pool.stats();
+            result.pool_used_bytes = pool.used_bytes;
+            result.pool_free_bytes = pool.free_bytes;
+            return result;
+         }
+
          class const_iterator
          {
             public:
-               const_iterator( const vector<unique_ptr<object>>& objects ):_objects(objects) {}
+               const_iterator( const vector<object_ptr>& objects ):_objects(objects) {}
                const_iterator(
-                  const vector<unique_ptr<object>>& objects,
-                  const vector<unique_ptr<object>>::const_iterator& a ):_itr(a),_objects(objects){}
+                  const vector<object_ptr>& objects,
+                  const vector<object_ptr>::const_iterator& a ):_itr(a),_objects(objects){}
                friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a._itr == b._itr; }
                friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a._itr != b._itr; }
                const T& operator*()const { return static_cast<const T&>(*_itr->get()); }
@@ -117,20 +153,34 @@ namespace graphene { namespace db {
                   return *this;
                }
                typedef std::forward_iterator_tag iterator_category;
-               typedef vector<unique_ptr<object> >::value_type value_type;
-               typedef vector<unique_ptr<object> >::difference_type difference_type;
-               typedef vector<unique_ptr<object> >::pointer pointer;
-               typedef vector<unique_ptr<object> >::reference reference;
+               typedef vector<object_ptr>::value_type value_type;
+               typedef vector<object_ptr>::difference_type difference_type;
+               typedef vector<object_ptr>::pointer pointer;
+               typedef vector<object_ptr>::reference reference;
             private:
-               vector<unique_ptr<object>>::const_iterator _itr;
-               const vector<unique_ptr<object>>& _objects;
+               vector<object_ptr>::const_iterator _itr;
+               const vector<object_ptr>& _objects;
          };
          const_iterator begin()const { return const_iterator(_objects, _objects.begin()); }
          const_iterator end()const   { return const_iterator(_objects, _objects.end());   }
 
          size_t size()const { return _objects.size(); }
       private:
-         vector< unique_ptr<object> > _objects;
+         template<typename... Args>
+         object_ptr make_object( Args&&... args )
+         {
+            void* memory = _pool.allocate( sizeof(T) );
+            try {
+               return object_ptr( new (memory) T( std::forward<Args>(args)... ), pool_deleter( &_pool ) );
+            } catch( ... ) {
+               _pool.deallocate( memory, sizeof(T) );
+               throw;
+            }
+         }
+
+         /// declared ahead of _objects, so that it outlives them
+         object_pool          _pool;
+         vector< object_ptr > _objects;
    };
 
 } } // graphene::db
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/db/index.hpp>
+#include <graphene/db/page_arena.hpp>
+
+#include <type_traits>
+
+namespace graphene { namespace db {
+
+   /**
+    *  @class slab_index
+    *  @brief A slab index stores objects back to back in fixed size chunks
+    *
+    *  Like simple_index, this index is addressed by instance only, but objects are
+    *  not allocated one at a time.  They are placed in chunks of ChunkSize objects
+    *  which are never moved, so addresses stay stable, and objects created one after
+    *  the other sit next to each other in memory.  This makes scans over all of the
+    *  objects of dense, id addressed types cheap.  The slot of a removed object is
+    *  reused by the next object created or inserted.  Chunks come from a page_arena,
+    *  so they are backed by huge pages when those are enabled.
+    */
+   template<typename T, uint32_t ChunkSize = 256>
+   class slab_index : public index
+   {
+      public:
+         typedef T object_type;
+
+         slab_index() = default;
+         slab_index( const slab_index& ) = delete;
+         slab_index& operator = ( const slab_index& ) = delete;
+
+         ~slab_index()
+         {
+            for( T* obj : _objects )
+               if( obj )
+                  obj->~T();
+         }
+
+         virtual const object&  create( const std::function<void(object&)>& constructor ) override
+         {
+             auto id = get_next_id();
+             auto instance = id.instance();
+             if( instance >= _objects.size() ) _objects.resize( instance + 1 );
+             T* obj = new (allocate_slot()) T;
+             obj->id = id;
+             try {
+                constructor( *obj );
+             } catch( ... ) {
+                release_slot( obj );
+                throw;
+             }
+             obj->id = id; // just in case it changed
+             _objects[instance] = obj;
+             use_next_id();
+             return *obj;
+         }
+
+         virtual void modify( const object& obj, const std::function<void(object&)>& modify_callback ) override
+         {
+            assert( obj.id.instance() < _objects.size() );
+            modify_callback( *_objects[obj.id.instance()] );
+         }
+
+         template<typename Lambda>
+         void modify_typed( const T& obj, const Lambda& m )
+         {
+            assert( obj.id.instance() < _objects.size() );
+            m( *_objects[obj.id.instance()] );
+         }
+
+         virtual const object& insert( object&& obj ) override
+         {
+            auto instance = obj.id.instance();
+            assert( nullptr != dynamic_cast<T*>(&obj) );
+            if( _objects.size() <= instance ) _objects.resize( instance+1 );
+            assert( !_objects[instance] );
+            void* s = allocate_slot();
+            try {
+               _objects[instance] = new (s) T( std::move( static_cast<T&>(obj) ) );
+            } catch( ... ) {
+               _free_slots.push_back( s );
+               throw;
+            }
+            return *_objects[instance];
+         }
+
+         /** Makes room for instance_count instances ahead of inserting many objects */
+         void reserve( size_t object_count, size_t instance_count )
+         {
+            _objects.reserve( instance_count );
+            _chunks.reserve( (_used_slots + object_count + ChunkSize - 1) / ChunkSize );
+         }
+
+         virtual void remove( const object& obj ) override
+         {
+            assert( nullptr != dynamic_cast<const T*>(&obj) );
+            const auto instance = obj.id.instance();
+            release_slot( _objects[instance] );
+            _objects[instance] = nullptr;
+            while( (_objects.size() > 0) && (_objects.back() == nullptr) )
+               _objects.pop_back();
+         }
+
+         virtual const object* find( object_id_type id )const override
+         {
+            assert( id.space() == T::space_id );
+            assert( id.type() == T::type_id );
+
+            const auto instance = id.instance();
+            if( instance >= _objects.size() ) return nullptr;
+            return _objects[instance];
+         }
+
+         virtual void inspect_all_objects(std::function<void (const object&)> inspector)const override
+         {
+            try {
+               for( const T* obj : _objects )
+               {
+                  if( obj )
+                     inspector(*obj);
+               }
+            } FC_CAPTURE_AND_RETHROW()
+         }
+
+         virtual index_stats stats()const override
+         {
+            index_stats result = index::stats();
+            result.container_bytes += _chunks.size() * ChunkSize * sizeof(slot) - result.object_count * sizeof(T)
+                                    + _chunks.capacity() * sizeof(_chunks[0])
+                                    + _objects.capacity() * sizeof(_objects[0])
+                                    + _free_slots.capacity() * sizeof(_free_slots[0]);
+            return result;
+         }
+
+         class const_iterator
+         {
+            public:
+               const_iterator( const vector<T*>& objects ):_objects(objects) {}
+               const_iterator( const vector<T*>& objects, const typename vector<T*>::const_iterator& a )
+               :_itr(a),_objects(objects)
+               {
+                  skip_removed();
+               }
+               friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a._itr == b._itr; }
+               friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a._itr != b._itr; }
+               const T& operator*()const { return **_itr; }
+               const_iterator operator++(int)     // postfix
+               {
+                  const_iterator result( *this );
+                  ++(*this);
+                  return result;
+               }
+               const_iterator& operator++()       // prefix
+               {
+                  ++_itr;
+                  skip_removed();
+                  return *this;
+               }
+               typedef std::forward_iterator_tag iterator_category;
+               typedef T value_type;
+               typedef std::ptrdiff_t difference_type;
+               typedef const T* pointer;
+               typedef const T& reference;
+            private:
+               void skip_removed()
+               {
+                  while( (_itr != _objects.end()) && ( (*_itr) == nullptr ) )
+                     ++_itr;
+               }
+
+               typename vector<T*>::const_iterator _itr;
+               const vector<T*>& _objects;
+         };
+         const_iterator begin()const { return const_iterator(_objects, _objects.begin()); }
+         const_iterator end()const   { return const_iterator(_objects, _objects.end());   }
+
+         size_t size()const { return _objects.size(); }
+      private:
+         typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type slot;
+
+         void* allocate_slot()
+         {
+            if( !_free_slots.empty() )
+            {
+               void* s = _free_slots.back();
+               _free_slots.pop_back();
+               return s;
+            }
+            if( _used_slots == _chunks.size() * ChunkSize )
+               _chunks.push_back( static_cast<slot*>( _arena.allocate( sizeof(slot) * ChunkSize ) ) );
+            void* s = &_chunks[_used_slots / ChunkSize][_used_slots % ChunkSize];
+            ++_used_slots;
+            return s;
+         }
+         void release_slot( T* obj )
+         {
+            obj->~T();
+            _free_slots.push_back( obj );
+         }
+
+         /// The object of each instance, or nullptr if there is none
+         vector< T* >                  _objects;
+         page_arena                    _arena;
+         vector< slot* >               _chunks;
+         /// Number of slots of _chunks handed out, removed objects included
+         size_t                        _used_slots = 0;
+         /// Slots of removed objects, reused before new ones
+         vector< void* >               _free_slots;
+   };
+
+} } // graphene::db
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/db/index.hpp>
+
+#include <fc/crypto/sha256.hpp>
+
+namespace graphene { namespace db {
+
+   /**
+    *  @class state_hash
+    *  @brief an order independent hash of a set of objects, updated as the objects change
+    *
+    *  The hash is the sum, modulo 2^256, of the sha256 of every object packed.  Adding and removing an object are
+    *  each one digest, so keeping it up to date costs in proportion to what changes rather than to the size of the
+    *  state, and two sets of objects hash the same regardless of the order they were built in.
+    *
+    *  Registered as the batched observer of the indexes it covers, it sees each object which changed in a block
+    *  once, with its copy from before the block, so an object changed many times is only hashed twice per block.
+    */
+   class state_hash : public batched_index_observer
+   {
+      public:
+         void add( const object& obj )    { accumulate( digest_of( obj ), false ); }
+         void remove( const object& obj ) { accumulate( digest_of( obj ), true ); }
+
+         virtual void on_changes( const vector<object_change>& changes ) override;
+
+         fc::sha256 result()const { return _sum; }
+
+      private:
+         static fc::sha256 digest_of( const object& obj );
+         void accumulate( const fc::sha256& digest, bool subtract );
+
+         fc::sha256 _sum;
+   };
+
+} } // graphene::db
@@ -18,6 +18,7 @@
 #pragma once
 #include <graphene/db/object.hpp>
 #include <deque>
+#include <unordered_set>
 #include <fc/exception/exception.hpp>
 
 namespace graphene { namespace db {
@@ -26,12 +27,152 @@ namespace graphene { namespace db {
    using fc::flat_set;
    class object_database;
 
+   struct undo_stats
+   {
+      uint32_t         depth = 0;
+      uint32_t         max_depth = 0;
+      uint64_t         bytes = 0;          ///< memory held by the states on the stack
+      uint64_t         max_bytes = 0;      ///< 0 if the stack is only bounded by depth
+      uint64_t         reserved_bytes = 0; ///< memory held by the undo arena, including free blocks
+      vector<uint64_t> session_bytes;      ///< memory held by each entry of the stack, the oldest first
+   };
+
+   /**
+    * The ids recorded by the head of the undo stack, by the kind of change, each sorted.  An object may appear in
+    * more than one list when several merged sessions touched it, e.g. one created it and a later one modified it.
+    */
+   struct undo_changes
+   {
+      vector<object_id_type> created;
+      vector<object_id_type> modified;
+      vector<object_id_type> removed;
+
+      /** The union of the three lists, sorted */
+      vector<object_id_type> affected()const;
+   };
+
+   /**
+    * @class undo_arena
+    * @brief bump allocator holding the contents of every undo_state on the stack
+    *
+    * Undo states are created and destroyed in stack order, except for the oldest one which is dropped once the stack
+    * grows past its maximum size.  Each state remembers the top of the arena when it was started, so undoing it
+    * rewinds the arena to that mark and dropping the oldest state releases the blocks below the next state's mark.
+    * Nothing is freed individually.  Released blocks are kept for reuse by later sessions.
+    */
+   class undo_arena
+   {
+      public:
+         struct mark
+         {
+            mark( uint64_t b = 0, size_t o = 0 ):block(b),offset(o){}
+
+            uint64_t block;  ///< number of blocks in use, counting released ones
+            size_t   offset; ///< offset into the last block in use
+         };
+
+         /// Calls the destructor of an object in the arena without freeing its storage
+         struct destroyer
+         {
+            void operator()( object* obj )const { obj->~object(); }
+         };
+
+         static const size_t block_size = 64*1024;
+         static const size_t max_free_blocks = 64;
+
+         undo_arena(){}
+         undo_arena( const undo_arena& ) = delete;
+         undo_arena& operator=( const undo_arena& ) = delete;
+
+         void* allocate( size_t size, size_t align = alignof(std::max_align_t) );
+         mark  top()const { return mark( _first_block + _blocks.size(), _offset ); }
+         /** Releases everything allocated since m was taken */
+         void  rewind( const mark& m );
+         /** Releases the blocks which lie entirely below m */
+         void  release_before( const mark& m );
+
+         /** The number of bytes allocated between a and b, including what was lost to alignment and block ends */
+         uint64_t bytes_between( const mark& a, const mark& b )const;
+         /** The number of bytes held by the arena, including free blocks */
+         uint64_t reserved_bytes()const;
+
+      private:
+         struct block
+         {
+            unique_ptr<char[]> data;
+            size_t             size = 0;
+         };
+         void          release_block( block&& b );
+
+         std::deque<block> _blocks;
+         uint64_t          _first_block = 0;
+         size_t            _offset = 0;
+         vector<block>     _free_blocks;
+   };
+
+   /**
+    * Allocates from an undo_arena.  Deallocation does nothing; the memory is reclaimed when the undo_state it belongs
+    * to is undone, popped or dropped.
+    */
+   template<typename T>
+   struct undo_allocator
+   {
+      typedef T value_type;
+
+      undo_allocator( undo_arena& a ):arena(&a){}
+      template<typename U>
+      undo_allocator( const undo_allocator<U>& other ):arena(other.arena){}
+
+      T*   allocate( size_t n ) { return static_cast<T*>( arena->allocate( n * sizeof(T), alignof(T) ) ); }
+      void deallocate( T*, size_t ) {}
+
+      template<typename U>
+      bool operator == ( const undo_allocator<U>& other )const { return arena == other.arena; }
+      template<typename U>
+      bool operator != ( const undo_allocator<U>& other )const { return arena != other.arena; }
+
+      undo_arena* arena;
+   };
+
+   template<typename Key, typename Value>
+   using undo_map = unordered_map<Key, Value, std::hash<Key>, std::equal_to<Key>,
+                                  undo_allocator<std::pair<const Key, Value>>>;
+
+   /**
+    * The changes made by one session.  A session which is merged into the one below it keeps its own undo_state,
+    * linked on top of those of the session below, so a single entry of the undo stack may be made of several of them.
+    */
    struct undo_state
    {
-      unordered_map<object_id_type, unique_ptr<object> > old_values;
-      unordered_map<object_id_type, object_id_type>      old_index_next_ids;
-      std::unordered_set<object_id_type>                 new_ids;
-      unordered_map<object_id_type, unique_ptr<object> > removed;
+      typedef unique_ptr<object, undo_arena::destroyer> object_ptr;
+
+      /// The fc::raw serialization of an object, stored in the arena
+      struct packed_object
+      {
+         packed_object( const char* d = nullptr, size_t s = 0 ):data(d),size(s){}
+
+         const char* data;
+         size_t      size;
+      };
+
+      undo_state( undo_arena& arena, const undo_arena::mark& start )
+         :start( start ),
+          old_values( 0, std::hash<object_id_type>(), std::equal_to<object_id_type>(), arena ),
+          old_index_next_ids( 0, std::hash<object_id_type>(), std::equal_to<object_id_type>(), arena ),
+          new_ids( 0, std::hash<object_id_type>(), std::equal_to<object_id_type>(), arena ),
+          removed( 0, std::hash<object_id_type>(), std::equal_to<object_id_type>(), arena )
+      {}
+
+      /// The top of the arena when this state was started
+      undo_arena::mark                                    start;
+      /// The state merged before this one into the same stack entry, which is undone after this one
+      undo_state*                                         older = nullptr;
+      /// Modified objects are stored packed, which is far more compact than a copy of objects holding containers
+      undo_map<object_id_type, packed_object>             old_values;
+      undo_map<object_id_type, object_id_type>            old_index_next_ids;
+      std::unordered_set<object_id_type, std::hash<object_id_type>, std::equal_to<object_id_type>,
+                         undo_allocator<object_id_type>>  new_ids;
+      undo_map<object_id_type, object_ptr>                removed;
    };
 
 
@@ -44,6 +185,7 @@ namespace graphene { namespace db {
    {
       public:
          undo_database( object_database& db ):_db(db){}
+         ~undo_database();
 
          class session
          {
@@ -85,6 +227,7 @@ namespace graphene { namespace db {
 
          void    disable();
          void    enable();
+         bool    enabled()const { return !_disabled; }
 
          session start_undo_session();
          /**
@@ -120,19 +263,62 @@ namespace graphene { namespace db {
          std::size_t size()const { return _stack.size(); }
          void set_max_size(size_t new_max_size) { _max_size = new_max_size; }
          size_t max_size()const { return _max_size; }
+         /**
+          * Bounds the memory held by the stack as well as its depth.  Once the stack holds more than max_bytes,
+          * the oldest states are dropped as new sessions are started.  0 means no bound.
+          */
+         void set_max_bytes(uint64_t max_bytes) { _max_bytes = max_bytes; }
+         uint64_t max_bytes()const { return _max_bytes; }
+         /** The memory held by all states on the stack */
+         uint64_t bytes()const;
+         undo_stats get_stats()const;
+         /** The number of objects saved by on_modify and on_remove so far */
+         uint64_t saved_objects()const { return _saved_objects; }
+
+         /**
+          * Drops the oldest states until at most keep remain, as when the blocks they undo are irreversible.
+          * The states of active sessions are always kept.
+          */
+         void discard_oldest( size_t keep );
 
-         const undo_state& head()const;
+         /** The ids of the objects created, modified and removed since the head of the stack was started */
+         undo_changes head_changes()const;
+         /** The ids of the objects modified since the head of the stack was started */
+         vector<object_id_type> head_modified_ids()const { return head_changes().modified; }
+         /** The ids of the objects created, modified or removed since the head of the stack was started, sorted */
+         vector<object_id_type> head_affected_ids()const { return head_changes().affected(); }
 
       private:
+         /// The states of one entry of the stack, linked from the newest to the oldest through undo_state::older
+         struct stack_entry
+         {
+            undo_state* newest;
+            undo_state* oldest;
+         };
+
          void undo();
          void merge();
          void commit();
 
+         void                    undo_layer( undo_state& state );
+         undo_state&             back();
+         void                    push_back();
+         void                    pop_back();
+         void                    destroy_layers( const stack_entry& entry );
+         undo_state::object_ptr  snapshot( const object& obj );
+         undo_state::packed_object pack( const object& obj );
+
          uint32_t                _active_sessions = 0;
          bool                    _disabled = true;
-         std::deque<undo_state>  _stack;
+         /// Holds the states on the stack along with everything they record
+         undo_arena              _arena;
+         std::deque<stack_entry> _stack;
          object_database&        _db;
          size_t                  _max_size = 256;
+         uint64_t                _max_bytes = 0;
+         uint64_t                _saved_objects = 0;
    };
 
 } } // graphene::db
+
+FC_REFLECT( graphene::db::undo_stats, (depth)(max_depth)(bytes)(max_bytes)(reserved_bytes)(session_bytes) )
@@ -26,12 +26,107 @@ namespace graphene { namespace db {
    void base_primary_index::on_add( const object& obj )
    {
       _db.save_undo_add( obj );
+      if( _versioned )
+         _unversioned.insert( obj.id );
+      for( auto ob : _observers ) ob->on_add( obj );
+   }
+
+   void base_primary_index::on_insert( const object& obj )
+   {
+      if( _versioned )
+         _unversioned.insert( obj.id );
       for( auto ob : _observers ) ob->on_add( obj );
    }
 
    void base_primary_index::on_remove( const object& obj )
-   { _db.save_undo_remove( obj ); for( auto ob : _observers ) ob->on_remove( obj ); }
+   {
+      _db.save_undo_remove( obj );
+      if( _versioned )
+         _unversioned.insert( obj.id );
+      for( auto ob : _observers ) ob->on_remove( obj );
+   }
 
    void base_primary_index::on_modify( const object& obj )
-   {for( auto ob : _observers ) ob->on_modify(  obj ); }
-} } // graphene::chain
+   {
+      if( _versioned )
+         _unversioned.insert( obj.id );
+      for( auto ob : _observers ) ob->on_modify(  obj );
+   }
+
+   void base_primary_index::publish_collected_changes()
+   {
+      if( _changes.empty() )
+         return;
+      vector<object_change> changes;
+      changes.reserve( _changes.size() );
+      for( auto& item : _changes )
+         changes.push_back( std::move( item.second ) );
+      _changes.clear();
+      for( const auto& ob : _batched_observers )
+         ob->on_changes( changes );
+   }
+
+   void base_primary_index::add_versions( vector<pair<object_id_type, shared_ptr<const object>>>& versions,
+                                          uint64_t epoch )
+   {
+      std::lock_guard<std::mutex> lock( _versions_mutex );
+      for( auto& item : versions )
+      {
+         auto itr = _versions.find( item.first );
+         if( itr == _versions.end() )
+         {
+            // Added and removed again since the last publish
+            if( !item.second )
+               continue;
+            itr = _versions.emplace( item.first, object_versions() ).first;
+         }
+         else
+            _superseded.insert( item.first );
+         const bool removed = !item.second;
+         itr->second.emplace_back( epoch, std::move( item.second ) );
+         if( removed )
+            _superseded.insert( item.first );
+      }
+   }
+
+   shared_ptr<const object> base_primary_index::find_version_of( object_id_type id, uint64_t epoch )const
+   {
+      std::lock_guard<std::mutex> lock( _versions_mutex );
+      auto itr = _versions.find( id );
+      if( itr == _versions.end() )
+         return shared_ptr<const object>();
+      for( auto version = itr->second.rbegin(); version != itr->second.rend(); ++version )
+         if( version->first <= epoch )
+            return version->second;
+      return shared_ptr<const object>();
+   }
+
+   void base_primary_index::reclaim_versions_before( uint64_t oldest_epoch )
+   {
+      // Copies are released once the lock is dropped, so that readers do not wait on their destructors
+      vector<shared_ptr<const object>> reclaimed;
+      std::lock_guard<std::mutex> lock( _versions_mutex );
+      for( auto id = _superseded.begin(); id != _superseded.end(); )
+      {
+         auto itr = _versions.find( *id );
+         object_versions& versions = itr->second;
+         // Every reader sees the newest version published by oldest_epoch or a later one
+         auto first_kept = versions.begin();
+         while( first_kept + 1 != versions.end() && (first_kept + 1)->first <= oldest_epoch )
+            ++first_kept;
+         for( auto version = versions.begin(); version != first_kept; ++version )
+            reclaimed.push_back( std::move( version->second ) );
+         versions.erase( versions.begin(), first_kept );
+
+         if( versions.size() == 1 && versions.front().second )
+            id = _superseded.erase( id );
+         else if( versions.size() == 1 && versions.front().first <= oldest_epoch )
+         {
+            _versions.erase( itr );
+            id = _superseded.erase( id );
+         }
+         else
+            ++id;
+      }
+   }
+} } // graphene::db
@@ -19,10 +19,25 @@
 
 #include <fc/io/raw.hpp>
 #include <fc/container/flat.hpp>
+#include <fc/thread/thread.hpp>
 #include <fc/uint128.hpp>
 
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <thread>
+
 namespace graphene { namespace db {
 
+size_t detail::next_index_slot()
+{
+   static std::atomic<size_t> next_slot( 0 );
+   return next_slot++;
+}
+
 object_database::object_database()
 :_undo_db(*this)
 {
@@ -32,7 +47,14 @@ object_database::object_database()
    _object_id_to_object = std::make_shared<db::level_map<object_id_type,vector<char>>>();
 }
 
-object_database::~object_database(){}
+object_database::~object_database()
+{
+   try {
+      wait_for_writes();
+   } catch( const fc::exception& e ) {
+      elog( "Failed to write object changes: ${e}", ("e",e.to_detail_string()) );
+   }
+}
 
 void object_database::close()
 {
@@ -61,6 +83,12 @@ const index& object_database::get_index(uint8_t space_id, uint8_t type_id)const
    FC_ASSERT( tmp );
    return *tmp;
 }
+const index* object_database::find_index(object_id_type id)const
+{
+   if( _index.size() <= id.space() || _index[id.space()].size() <= id.type() )
+      return nullptr;
+   return _index[id.space()][id.type()].get();
+}
 index& object_database::get_mutable_index(uint8_t space_id, uint8_t type_id)
 {
    FC_ASSERT( _index.size() > space_id, "", ("space_id",space_id)("type_id",type_id)("index.size",_index.size()) );
@@ -70,28 +98,180 @@ index& object_database::get_mutable_index(uint8_t space_id, uint8_t type_id)
    return *idx;
 }
 
-void object_database::flush()
+void object_database::flush( bool sync )
 {
    if( !_object_id_to_object->is_open() )
       return;
 
-   vector<object_id_type> next_ids;
+   wait_for_writes();
+   store_changes( *_object_id_to_object, *capture_changes(), sync );
+}
+
+void object_database::pack_by_index( vector<object_id_type>& ids, object_changes& changes )const
+{
+   // The space and type are the high bits of an id, so sorting brings the ids of each index together
+   std::sort( ids.begin(), ids.end() );
+   changes.stored.reserve( changes.stored.size() + ids.size() );
+   auto first = ids.begin();
+   while( first != ids.end() )
+   {
+      auto last = first;
+      while( last != ids.end() && last->space() == first->space() && last->type() == first->type() )
+         ++last;
+      get_index( first->space(), first->type() ).pack_objects( &*first, &*first + (last - first),
+                                                              changes.stored, changes.removed );
+      first = last;
+   }
+}
+
+shared_ptr<object_changes> object_database::capture_changes()
+{
+   auto changes = std::make_shared<object_changes>();
+   changes->removed.assign( _removed_objects.begin(), _removed_objects.end() );
+   vector<object_id_type> dirty( _dirty_objects.begin(), _dirty_objects.end() );
+   pack_by_index( dirty, *changes );
+   for( auto& space : _index )
+      for( const unique_ptr<index>& type_index : space )
+         if( type_index )
+            changes->next_ids.push_back( type_index->get_next_id() );
+
+   _dirty_objects.clear();
+   _removed_objects.clear();
+   return changes;
+}
+
+void object_database::write_changes( const shared_ptr<const object_changes>& changes, bool sync )
+{
+   if( !_object_id_to_object->is_open() )
+      return;
+
+   // Only one write is in flight at a time, which keeps them in order
+   wait_for_writes();
+   if( !_write_thread )
+      _write_thread.reset( new fc::thread( "object_writer" ) );
+   auto db = _object_id_to_object;
+   _pending_write = _write_thread->async( [db,changes,sync]() { store_changes( *db, *changes, sync ); } );
+}
+
+void object_database::discard_changes( const object_changes& changes )
+{
+   for( const auto& item : changes.stored )
+      if( find_object( item.first ) )
+         mark_dirty( item.first );
+      else
+         mark_removed( item.first );
+   for( auto id : changes.removed )
+      if( find_object( id ) )
+         mark_dirty( id );
+      else
+         mark_removed( id );
+}
+
+shared_ptr<object_changes> object_database::pack_objects( const vector<object_id_type>& ids )const
+{
+   auto changes = std::make_shared<object_changes>();
+   vector<object_id_type> sorted_ids( ids );
+   pack_by_index( sorted_ids, *changes );
+   for( auto& space : _index )
+      for( const unique_ptr<index>& type_index : space )
+         if( type_index )
+            changes->next_ids.push_back( type_index->get_next_id() );
+   return changes;
+}
+
+shared_ptr<object_changes> object_database::pack_all_objects()const
+{
+   auto changes = std::make_shared<object_changes>();
    for( auto& space : _index )
       for( const unique_ptr<index>& type_index : space )
          if( type_index )
          {
-            type_index->inspect_all_objects([&] (const object& obj) {
-               _object_id_to_object->store(obj.id, obj.pack());
-            });
-            next_ids.push_back( type_index->get_next_id() );
+            type_index->pack_all_objects( changes->stored );
+            changes->next_ids.push_back( type_index->get_next_id() );
          }
-   _object_id_to_object->store( object_id_type(), fc::raw::pack(next_ids) );
+   return changes;
+}
+
+void object_database::apply_changes( const object_changes& changes )
+{
+   for( auto id : changes.removed )
+      if( find_index( id ) )
+         if( const object* obj = find_object( id ) )
+            get_mutable_index( id ).remove( *obj );
+   for( const auto& item : changes.stored )
+   {
+      if( !find_index( item.first ) )
+         continue;
+      index& idx = get_mutable_index( item.first );
+      const vector<char>& data = item.second;
+      if( const object* obj = idx.find( item.first ) )
+         idx.modify( *obj, [&]( object& o ) { o.unpack_from( data.data(), data.size() ); } );
+      else
+         save_undo_add( idx.load( data ) );
+   }
+   for( auto id : changes.next_ids )
+      if( find_index( id ) )
+         get_mutable_index( id ).set_next_id( id );
+   publish_changes();
+}
+
+void object_database::replace_all_objects( const object_changes& state )
+{
+   std::unordered_set<object_id_type> kept;
+   kept.reserve( state.stored.size() );
+   for( const auto& item : state.stored )
+      kept.insert( item.first );
+
+   object_changes removals;
+   for( auto& space : _index )
+      for( const unique_ptr<index>& type_index : space )
+         if( type_index )
+            type_index->inspect_all_objects( [&]( const object& obj ) {
+               if( !kept.count( obj.id ) )
+                  removals.removed.push_back( obj.id );
+            });
+   apply_changes( removals );
+   apply_changes( state );
+}
+
+void object_database::remove_all_objects()
+{
+   object_changes empty_state;
+   for( auto& space : _index )
+      for( const unique_ptr<index>& type_index : space )
+         if( type_index )
+            empty_state.next_ids.push_back( object_id_type( type_index->object_space_id(), type_index->object_type_id(), 0 ) );
+   replace_all_objects( empty_state );
+}
+
+void object_database::wait_for_writes()
+{
+   if( _pending_write.valid() )
+   {
+      auto pending = std::move( _pending_write );
+      pending.wait();
+   }
+}
+
+void object_database::store_changes( db::level_map<object_id_type, vector<char>>& db, const object_changes& changes,
+                                     bool sync )
+{
+   // An object may have been removed and then inserted again, so removals are written first
+   auto batch = db.create_batch( sync );
+   for( auto id : changes.removed )
+      batch.remove( id );
+   for( const auto& item : changes.stored )
+      batch.store( item.first, item.second );
+   batch.store( object_id_type(), fc::raw::pack(changes.next_ids) );
+   batch.commit();
 }
 
 void object_database::wipe(const fc::path& data_dir)
 {
    close();
    ilog("Wiping object_database.");
+   _dirty_objects.clear();
+   _removed_objects.clear();
    fc::remove_all(data_dir / "object_database");
    assert(!fc::exists(data_dir / "object_database"));
 }
@@ -100,18 +280,17 @@ void object_database::open( const fc::path& data_dir )
 { try {
    ilog("Open object_database in ${d}", ("d", data_dir));
 
-   _object_id_to_object->open( data_dir / "object_database" / "objects" );
+   _object_id_to_object->open( data_dir / "object_database" / "objects", true, _store_cache_size, _store_profile );
 
+   vector<index*> indexes;
    for( auto& space : _index )
-   {
       for( auto& type_index : space )
-      {
          if( type_index )
-         {
-            type_index->open( _object_id_to_object );
-         }
-      }
-   }
+            indexes.push_back( type_index.get() );
+
+   load_indexes( indexes,
+                 [this]( const index& idx ) { return idx.unpack_objects( _object_id_to_object ); },
+                 [this]( index& idx ) { idx.open( _object_id_to_object ); } );
    try {
       auto next_ids = fc::raw::unpack<vector<object_id_type>>( _object_id_to_object->fetch( object_id_type() ) );
       wdump((next_ids));
@@ -131,6 +310,263 @@ void object_database::open( const fc::path& data_dir )
 } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
 
 
+void object_database::load_indexes( const vector<index*>& indexes,
+                                    const std::function<shared_ptr<unpacked_objects>(const index&)>& unpack,
+                                    const std::function<void(index&)>& fallback )
+{
+   // Every index is unpacked on a worker thread, and inserted on this one as soon as it is ready
+   uint32_t thread_count = std::min<uint32_t>( indexes.size(), std::max( 1u, std::thread::hardware_concurrency() ) );
+   vector<unique_ptr<fc::thread>> threads;
+   for( uint32_t i = 0; i < thread_count; ++i )
+      threads.emplace_back( new fc::thread( "load" + fc::to_string( uint64_t(i) ) ) );
+
+   vector<fc::future<shared_ptr<unpacked_objects>>> unpacked;
+   unpacked.reserve( indexes.size() );
+   for( size_t i = 0; i < indexes.size(); ++i )
+   {
+      const index* idx = indexes[i];
+      unpacked.push_back( threads[i % thread_count]->async( [&unpack,idx]() { return unpack( *idx ); } ) );
+   }
+   for( size_t i = 0; i < indexes.size(); ++i )
+   {
+      auto objects = unpacked[i].wait();
+      unpacked[i] = fc::future<shared_ptr<unpacked_objects>>();
+      if( objects )
+         indexes[i]->insert_objects( *objects );
+      else
+         fallback( *indexes[i] );
+   }
+}
+
+void object_database::write_snapshot( const fc::path& file, const vector<char>& extra )const
+{ try {
+   vector<const index*> indexes;
+   vector<snapshot_section> sections;
+   for( auto& space : _index )
+      for( auto& type_index : space )
+         if( type_index )
+         {
+            indexes.push_back( type_index.get() );
+            snapshot_section section;
+            section.space_id = type_index->object_space_id();
+            section.type_id = type_index->object_type_id();
+            section.next_id = type_index->get_next_id();
+            type_index->inspect_all_objects( [&]( const object& obj ) { section.size += obj.packed_size(); } );
+            sections.push_back( section );
+         }
+
+   // Every field of a section has a fixed size, so the table can be sized before the offsets are known
+   snapshot_header header;
+   uint64_t offset = fc::raw::pack_size( header ) + fc::raw::pack_size( sections ) + fc::raw::pack_size( extra );
+   for( auto& section : sections )
+   {
+      section.offset = offset;
+      offset += section.size;
+   }
+
+   std::ofstream out( file.generic_string(), std::ios::binary | std::ios::trunc );
+   FC_ASSERT( out, "Unable to create snapshot file" );
+   fc::sha256::encoder enc;
+   auto write = [&]( const char* data, size_t size ) {
+      out.write( data, size );
+      enc.write( data, size );
+   };
+
+   auto packed_header = fc::raw::pack( header );
+   out.write( packed_header.data(), packed_header.size() );
+   auto packed_table = fc::raw::pack( sections );
+   write( packed_table.data(), packed_table.size() );
+   auto packed_extra = fc::raw::pack( extra );
+   write( packed_extra.data(), packed_extra.size() );
+
+   vector<char> buffer;
+   for( auto idx : indexes )
+      idx->inspect_all_objects( [&]( const object& obj ) {
+         buffer.resize( obj.packed_size() );
+         obj.pack_into( buffer.data(), buffer.size() );
+         write( buffer.data(), buffer.size() );
+      });
+
+   header.checksum = enc.result();
+   packed_header = fc::raw::pack( header );
+   out.seekp( 0 );
+   out.write( packed_header.data(), packed_header.size() );
+   out.close();
+   FC_ASSERT( !out.fail(), "Unable to write snapshot file" );
+} FC_CAPTURE_AND_RETHROW( (file) ) }
+
+vector<char> object_database::load_snapshot( const fc::path& file )
+{ try {
+   namespace bip = boost::interprocess;
+   bip::file_mapping mapping( file.generic_string().c_str(), bip::read_only );
+   bip::mapped_region region( mapping, bip::read_only );
+   const char* data = static_cast<const char*>( region.get_address() );
+   size_t size = region.get_size();
+
+   fc::datastream<const char*> ds( data, size );
+   snapshot_header header;
+   fc::raw::unpack( ds, header );
+   FC_ASSERT( header.magic == snapshot_header::expected_magic, "Not a snapshot file" );
+   FC_ASSERT( header.version == snapshot_header::current_version, "Unsupported snapshot version",
+              ("version",header.version) );
+
+   const size_t header_size = fc::raw::pack_size( header );
+   fc::sha256::encoder enc;
+   for( size_t pos = header_size; pos < size; )
+   {
+      // The encoder takes at most 4GiB at once
+      size_t chunk = std::min<size_t>( size - pos, 1u << 30 );
+      enc.write( data + pos, chunk );
+      pos += chunk;
+   }
+   FC_ASSERT( enc.result() == header.checksum, "Snapshot checksum mismatch" );
+
+   vector<snapshot_section> sections;
+   vector<char> extra;
+   fc::raw::unpack( ds, sections );
+   fc::raw::unpack( ds, extra );
+
+   vector<index*> indexes;
+   for( const auto& section : sections )
+   {
+      FC_ASSERT( section.offset <= size && section.size <= size - section.offset, "Snapshot section out of range",
+                 ("space",section.space_id)("type",section.type_id) );
+      if( _index.size() <= section.space_id || _index[section.space_id].size() <= section.type_id ||
+          !_index[section.space_id][section.type_id] )
+      {
+         wlog( "Skipping snapshot section of unknown index ${s}.${t}", ("s",section.space_id)("t",section.type_id) );
+         continue;
+      }
+      index& idx = get_mutable_index( section.space_id, section.type_id );
+      FC_ASSERT( idx.get_next_id().instance() == 0, "Snapshots can only be loaded into empty indexes" );
+      idx.set_next_id( section.next_id );
+      indexes.push_back( &idx );
+   }
+
+   load_indexes( indexes,
+                 [&]( const index& idx ) {
+                    auto section = std::find_if( sections.begin(), sections.end(), [&]( const snapshot_section& s ) {
+                       return s.space_id == idx.object_space_id() && s.type_id == idx.object_type_id();
+                    });
+                    return idx.unpack_objects( data + section->offset, section->size );
+                 },
+                 []( index& idx ) { FC_THROW( "Index does not support loading from a snapshot" ); } );
+
+   for( auto idx : indexes )
+      idx->inspect_all_objects( [&]( const object& obj ) { mark_dirty( obj.id ); } );
+   return extra;
+} FC_CAPTURE_AND_RETHROW( (file) ) }
+
+void object_database::publish_changes()
+{
+   for( auto& space : _index )
+      for( auto& type_index : space )
+         if( type_index )
+            type_index->publish_changes();
+}
+
+void object_database::enable_read_views()
+{
+   if( _read_views_enabled )
+      return;
+   _read_views_enabled = true;
+   for( auto& space : _index )
+      for( auto& type_index : space )
+         if( type_index )
+            type_index->enable_versions();
+   publish_read_view();
+}
+
+void object_database::enable_state_hash_of( const vector<uint8_t>& space_ids )
+{
+   if( _state_hash )
+      return;
+   _state_hash = std::make_shared<state_hash>();
+   for( uint8_t space_id : space_ids )
+   {
+      if( space_id >= _index.size() )
+         continue;
+      for( auto& type_index : _index[space_id] )
+         if( type_index )
+         {
+            type_index->inspect_all_objects( [this]( const object& obj ) { _state_hash->add( obj ); } );
+            type_index->add_batched_observer( _state_hash );
+         }
+   }
+}
+
+void object_database::publish_read_view()
+{
+   if( !_read_views_enabled )
+      return;
+
+   // Only this thread changes the epoch, so it is read without the lock
+   const uint64_t epoch = _published_epoch + 1;
+   for( auto& space : _index )
+      for( auto& type_index : space )
+         if( type_index )
+            type_index->publish_versions( epoch );
+
+   uint64_t oldest_epoch;
+   {
+      std::lock_guard<std::mutex> lock( _read_view_mutex );
+      _published_epoch = epoch;
+      oldest_epoch = _read_views.empty() ? epoch : _read_views.begin()->first;
+   }
+   for( auto& space : _index )
+      for( auto& type_index : space )
+         if( type_index )
+            type_index->reclaim_versions( oldest_epoch );
+}
+
+read_view object_database::get_read_view()const
+{
+   FC_ASSERT( _read_views_enabled, "Read views are not enabled" );
+   std::lock_guard<std::mutex> lock( _read_view_mutex );
+   ++_read_views[_published_epoch];
+   return read_view( *this, _published_epoch );
+}
+
+void object_database::release_read_view( uint64_t epoch )const
+{
+   std::lock_guard<std::mutex> lock( _read_view_mutex );
+   auto itr = _read_views.find( epoch );
+   assert( itr != _read_views.end() );
+   if( --itr->second == 0 )
+      _read_views.erase( itr );
+}
+
+read_view::read_view( read_view&& other )
+:_db(other._db),_epoch(other._epoch)
+{
+   other._db = nullptr;
+}
+
+read_view::~read_view()
+{
+   if( _db )
+      _db->release_read_view( _epoch );
+}
+
+shared_ptr<const object> read_view::find_object( object_id_type id )const
+{
+   // Indexes are only added while the database is set up, before any read view is taken
+   const index* idx = _db->find_index( id );
+   if( !idx )
+      return shared_ptr<const object>();
+   return idx->find_version( id, _epoch );
+}
+
+vector<index_stats> object_database::get_index_stats()const
+{
+   vector<index_stats> result;
+   for( const auto& space : _index )
+      for( const unique_ptr<index>& type_index : space )
+         if( type_index )
+            result.push_back( type_index->stats() );
+   return result;
+}
+
 void object_database::pop_undo()
 { try {
    _undo_db.pop_commit();
@@ -139,16 +575,34 @@ void object_database::pop_undo()
 void object_database::save_undo( const object& obj )
 {
    _undo_db.on_modify( obj );
+   mark_dirty( obj.id );
 }
 
 void object_database::save_undo_add( const object& obj )
 {
    _undo_db.on_create( obj );
+   mark_dirty( obj.id );
 }
 
 void object_database::save_undo_remove(const object& obj)
 {
    _undo_db.on_remove( obj );
+   mark_removed( obj.id );
+}
+
+void object_database::mark_dirty( object_id_type id )
+{
+   if( !_object_id_to_object->is_open() )
+      return;
+   _dirty_objects.insert( id );
+}
+
+void object_database::mark_removed( object_id_type id )
+{
+   if( !_object_id_to_object->is_open() )
+      return;
+   _dirty_objects.erase( id );
+   _removed_objects.insert( id );
 }
 
 } } // namespace graphene::db
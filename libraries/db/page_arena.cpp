@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/db/page_arena.hpp>
+#include <fc/exception/exception.hpp>
+
+#include <atomic>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace graphene { namespace db {
+
+namespace {
+   std::atomic<int> current_huge_page_mode( no_huge_pages );
+
+   size_t round_up( size_t bytes, size_t multiple )
+   {
+      return (bytes + multiple - 1) / multiple * multiple;
+   }
+
+#ifdef __linux__
+   /** Maps bytes, a multiple of the region size, at an address aligned to it */
+   char* map_aligned( size_t bytes )
+   {
+      const size_t padded = bytes + page_arena::region_size;
+      void* p = mmap( nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+      if( p == MAP_FAILED )
+         return nullptr;
+      char* start = static_cast<char*>( p );
+      char* aligned = reinterpret_cast<char*>( round_up( reinterpret_cast<uintptr_t>( start ), page_arena::region_size ) );
+      if( aligned != start )
+         munmap( start, aligned - start );
+      if( aligned + bytes != start + padded )
+         munmap( aligned + bytes, start + padded - (aligned + bytes) );
+      return aligned;
+   }
+#endif
+}
+
+const size_t page_arena::region_size;
+
+void set_huge_page_mode( huge_page_mode mode )
+{
+   current_huge_page_mode = mode;
+}
+
+huge_page_mode get_huge_page_mode()
+{
+   return huge_page_mode( current_huge_page_mode.load() );
+}
+
+huge_page_mode huge_page_mode_from_string( const std::string& name )
+{
+   if( name == "none" ) return no_huge_pages;
+   if( name == "transparent" ) return transparent_huge_pages;
+   if( name == "explicit" ) return explicit_huge_pages;
+   FC_THROW_EXCEPTION( fc::invalid_arg_exception, "Unknown huge page mode ${name}, expected none, transparent or explicit",
+                       ("name", name) );
+}
+
+std::string to_string( huge_page_mode mode )
+{
+   switch( mode )
+   {
+      case transparent_huge_pages: return "transparent";
+      case explicit_huge_pages:    return "explicit";
+      default:                     return "none";
+   }
+}
+
+page_arena::~page_arena()
+{
+   for( const region& r : _regions )
+   {
+#ifdef __linux__
+      if( r.mapped )
+      {
+         munmap( r.data, r.size );
+         continue;
+      }
+#endif
+      delete[] r.data;
+   }
+}
+
+void* page_arena::allocate( size_t bytes )
+{
+   bytes = round_up( bytes, alignof(std::max_align_t) );
+#ifdef __linux__
+   const huge_page_mode mode = get_huge_page_mode();
+   if( mode != no_huge_pages )
+   {
+      if( !_regions.empty() && _regions.back().mapped && _regions.back().size - _offset >= bytes )
+      {
+         char* result = _regions.back().data + _offset;
+         _offset += bytes;
+         return result;
+      }
+
+      region r;
+      r.size = round_up( bytes, region_size );
+      if( mode == explicit_huge_pages )
+      {
+         void* p = mmap( nullptr, r.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+         if( p != MAP_FAILED )
+            r.data = static_cast<char*>( p );
+      }
+      if( r.data == nullptr )
+      {
+         r.data = map_aligned( r.size );
+#ifdef MADV_HUGEPAGE
+         if( r.data )
+            madvise( r.data, r.size, MADV_HUGEPAGE );
+#endif
+      }
+      if( r.data )
+      {
+         r.mapped = true;
+         _regions.push_back( r );
+         _offset = bytes;
+         _reserved_bytes += r.size;
+         _huge_page_bytes += r.size;
+         return r.data;
+      }
+      // Out of address space for mappings: fall back to the heap like the other modes
+   }
+#endif
+
+   region r;
+   r.data = new char[bytes];
+   r.size = bytes;
+   _regions.push_back( r );
+   _reserved_bytes += bytes;
+   return r.data;
+}
+
+} } // graphene::db
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/db/state_hash.hpp>
+
+namespace graphene { namespace db {
+
+void state_hash::on_changes( const vector<object_change>& changes )
+{
+   for( const object_change& change : changes )
+   {
+      if( change.before )
+         remove( *change.before );
+      if( change.after )
+         add( *change.after );
+   }
+}
+
+fc::sha256 state_hash::digest_of( const object& obj )
+{
+   vector<char> packed( obj.packed_size() );
+   obj.pack_into( packed.data(), packed.size() );
+   return fc::sha256::hash( packed.data(), packed.size() );
+}
+
+void state_hash::accumulate( const fc::sha256& digest, bool subtract )
+{
+   // The four words of the digest are added or subtracted as one 256 bit number, least significant word first
+   uint64_t carry = 0;
+   for( int i = 0; i < 4; ++i )
+   {
+      const uint64_t word = digest._hash[i];
+      uint64_t& sum = _sum._hash[i];
+      if( subtract )
+      {
+         const uint64_t result = sum - word - carry;
+         carry = ( sum < word || (sum == word && carry) ) ? 1 : 0;
+         sum = result;
+      }
+      else
+      {
+         const uint64_t result = sum + word + carry;
+         carry = ( result < sum || (result == sum && carry) ) ? 1 : 0;
+         sum = result;
+      }
+   }
+}
+
+} } // graphene::db
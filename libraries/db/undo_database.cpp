@@ -19,8 +19,90 @@
 #include <graphene/db/undo_database.hpp>
 #include <fc/reflect/variant.hpp>
 
+#include <algorithm>
+
 namespace graphene { namespace db {
 
+const size_t undo_arena::block_size;
+const size_t undo_arena::max_free_blocks;
+
+void* undo_arena::allocate( size_t size, size_t align )
+{
+   size_t offset = (_offset + align - 1) & ~(align - 1);
+   if( _blocks.empty() || offset + size > _blocks.back().size )
+   {
+      block b;
+      if( size <= block_size && !_free_blocks.empty() )
+      {
+         b = std::move( _free_blocks.back() );
+         _free_blocks.pop_back();
+      }
+      else
+      {
+         b.size = std::max( size, block_size );
+         b.data.reset( new char[b.size] );
+      }
+      _blocks.push_back( std::move(b) );
+      offset = 0;
+   }
+   _offset = offset + size;
+   return _blocks.back().data.get() + offset;
+}
+
+void undo_arena::rewind( const mark& m )
+{
+   while( _first_block + _blocks.size() > m.block )
+   {
+      release_block( std::move(_blocks.back()) );
+      _blocks.pop_back();
+   }
+   _offset = m.offset;
+}
+
+void undo_arena::release_before( const mark& m )
+{
+   // The block the mark points into is still in use
+   while( !_blocks.empty() && _first_block + 1 < m.block )
+   {
+      release_block( std::move(_blocks.front()) );
+      _blocks.pop_front();
+      ++_first_block;
+   }
+}
+
+uint64_t undo_arena::bytes_between( const mark& a, const mark& b )const
+{
+   if( a.block == b.block )
+      return b.offset - a.offset;
+   // A mark taken before any block was allocated has no partially used block
+   uint64_t bytes = a.block ? _blocks[a.block - 1 - _first_block].size - a.offset : 0;
+   for( uint64_t i = a.block; i + 1 < b.block; ++i )
+      bytes += _blocks[i - _first_block].size;
+   return bytes + b.offset;
+}
+
+uint64_t undo_arena::reserved_bytes()const
+{
+   uint64_t bytes = 0;
+   for( const auto& b : _blocks )
+      bytes += b.size;
+   for( const auto& b : _free_blocks )
+      bytes += b.size;
+   return bytes;
+}
+
+void undo_arena::release_block( block&& b )
+{
+   if( b.size == block_size && _free_blocks.size() < max_free_blocks )
+      _free_blocks.push_back( std::move(b) );
+}
+
+undo_database::~undo_database()
+{
+   for( const auto& entry : _stack )
+      destroy_layers( entry );
+}
+
 void undo_database::enable()  { _disabled = false; }
 void undo_database::disable() { _disabled = true; }
 
@@ -28,10 +110,15 @@ undo_database::session undo_database::start_undo_session()
 {
    if( _disabled ) return session(*this);
 
-   if( size() == max_size() )
+   while( !_stack.empty() && (size() >= max_size() || (_max_bytes && bytes() > _max_bytes)) )
+   {
+      destroy_layers( _stack.front() );
       _stack.pop_front();
+      if( !_stack.empty() )
+         _arena.release_before( _stack.front().oldest->start );
+   }
 
-   _stack.emplace_back();
+   push_back();
    ++_active_sessions;
    return session(*this);
 }
@@ -39,9 +126,7 @@ void undo_database::on_create( const object& obj )
 {
    if( _disabled ) return;
 
-   if( _stack.empty() )
-      _stack.emplace_back();
-   auto& state = _stack.back();
+   auto& state = back();
    auto index_id = object_id_type( obj.id.space(), obj.id.type(), 0 );
    auto itr = state.old_index_next_ids.find( index_id );
    if( itr == state.old_index_next_ids.end() )
@@ -52,35 +137,49 @@ void undo_database::on_modify( const object& obj )
 {
    if( _disabled ) return;
 
-   if( _stack.empty() )
-      _stack.emplace_back();
-   auto& state = _stack.back();
+   auto& state = back();
    if( state.new_ids.find(obj.id) != state.new_ids.end() )
       return;
    auto itr =  state.old_values.find(obj.id);
    if( itr != state.old_values.end() ) return;
-   state.old_values[obj.id] = obj.clone();
+   state.old_values[obj.id] = pack( obj );
+   ++_saved_objects;
 }
 void undo_database::on_remove( const object& obj )
 {
    if( _disabled ) return;
 
-   if( _stack.empty() )
-      _stack.emplace_back();
-   undo_state& state = _stack.back();
+   undo_state& state = back();
    if( state.new_ids.count(obj.id) )
    {
       state.new_ids.erase(obj.id);
       return;
    }
-   if( state.old_values.count(obj.id) )
+   auto itr = state.old_values.find(obj.id);
+   if( itr != state.old_values.end() )
    {
-      state.removed[obj.id] = std::move(state.old_values[obj.id]);
-      state.old_values.erase(obj.id);
+      // The object must be restored as it was before it was modified
+      auto removed = snapshot( obj );
+      removed->unpack_from( itr->second.data, itr->second.size );
+      state.removed[obj.id] = std::move(removed);
+      state.old_values.erase(itr);
       return;
    }
    if( state.removed.count(obj.id) ) return;
-   state.removed[obj.id] = obj.clone();
+   state.removed[obj.id] = snapshot( obj );
+   ++_saved_objects;
+}
+
+void undo_database::discard_oldest( size_t keep )
+{
+   keep = std::max<size_t>( keep, _active_sessions );
+   while( _stack.size() > keep )
+   {
+      destroy_layers( _stack.front() );
+      _stack.pop_front();
+      if( !_stack.empty() )
+         _arena.release_before( _stack.front().oldest->start );
+   }
 }
 
 void undo_database::undo()
@@ -89,28 +188,12 @@ void undo_database::undo()
    FC_ASSERT( _active_sessions > 0 );
    disable();
 
-   auto& state = _stack.back();
-   for( auto& item : state.old_values )
-   {
-      _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
-   }
-
-   for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
-   {
-      _db.remove( _db.get_object(*ritr) );
-   }
+   for( undo_state* state = _stack.back().newest; state != nullptr; state = state->older )
+      undo_layer( *state );
 
-   for( auto& item : state.old_index_next_ids )
-   {
-      _db.get_mutable_index( item.first.space(), item.first.type() ).set_next_id( item.second );
-   }
-
-   for( auto& item : state.removed )
-      _db.insert( std::move(*item.second) );
-
-   _stack.pop_back();
+   pop_back();
    if( _stack.empty() )
-      _stack.emplace_back();
+      push_back();
    enable();
    --_active_sessions;
 } FC_CAPTURE_AND_RETHROW() }
@@ -119,27 +202,12 @@ void undo_database::merge()
 {
    FC_ASSERT( _active_sessions > 0 );
    FC_ASSERT( _stack.size() >=2 );
-   auto& state = _stack.back();
-   auto& prev_state = _stack[_stack.size()-2];
-   for( auto& obj : state.old_values )
-   {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
-         continue;
-      if( prev_state.old_values.find(obj.second->id) == prev_state.old_values.end() )
-         prev_state.old_values[obj.second->id] = std::move(obj.second);
-   }
-   for( auto id : state.new_ids )
-      prev_state.new_ids.insert(id);
-   for( auto& item : state.old_index_next_ids )
-   {
-      if( prev_state.old_index_next_ids.find( item.first ) == prev_state.old_index_next_ids.end() )
-         prev_state.old_index_next_ids[item.first] = item.second;
-   }
-   for( auto& obj : state.removed )
-      if( prev_state.new_ids.find(obj.second->id) == prev_state.new_ids.end() )
-         prev_state.removed[obj.second->id] = std::move(obj.second);
-      else
-         prev_state.new_ids.erase(obj.second->id);
+   // The merged layers are undone before those of the session below, just as they would have been as a session of
+   // their own, so nothing needs to be folded together.
+   auto& entry = _stack.back();
+   auto& prev_entry = _stack[_stack.size()-2];
+   entry.oldest->older = prev_entry.newest;
+   prev_entry.newest = entry.newest;
    _stack.pop_back();
    --_active_sessions;
 }
@@ -156,40 +224,177 @@ void undo_database::pop_commit()
 
    disable();
    try {
-      auto& state = _stack.back();
+      for( undo_state* state = _stack.back().newest; state != nullptr; state = state->older )
+         undo_layer( *state );
 
-      for( auto& item : state.old_values )
-      {
-         _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
-      }
+      pop_back();
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "error popping commit ${e}", ("e", e.to_detail_string() )  );
+      enable();
+      throw;
+   }
+   enable();
+}
 
-      for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
+namespace {
+   /**
+    * Sorts items by id, which brings those of each index together as the space and type are the high bits, and calls
+    * apply( space, type, first, last ) for the items of each index
+    */
+   template<typename Item, typename IdOf, typename Apply>
+   void for_each_index_batch( vector<Item>& items, const IdOf& id_of, const Apply& apply )
+   {
+      std::sort( items.begin(), items.end(), [&]( const Item& a, const Item& b ) { return id_of( a ) < id_of( b ); } );
+      size_t first = 0;
+      while( first < items.size() )
       {
-         _db.remove( _db.get_object(*ritr) );
+         const object_id_type id = id_of( items[first] );
+         size_t last = first + 1;
+         while( last < items.size() && id_of( items[last] ).space() == id.space()
+                                    && id_of( items[last] ).type() == id.type() )
+            ++last;
+         apply( id.space(), id.type(), items.data() + first, items.data() + last );
+         first = last;
       }
+   }
+}
 
-      for( auto& item : state.old_index_next_ids )
-      {
-         _db.get_mutable_index( item.first.space(), item.first.type() ).set_next_id( item.second );
-      }
+void undo_database::undo_layer( undo_state& state )
+{
+   // The objects are handed to their indexes a batch per index, which restore them with their type known
+   vector<index::packed_contents> modified;
+   modified.reserve( state.old_values.size() );
+   for( auto& item : state.old_values )
+      modified.push_back( index::packed_contents{ item.first, item.second.data, item.second.size } );
+   for_each_index_batch( modified,
+      []( const index::packed_contents& item ) { return item.id; },
+      [&]( uint8_t space, uint8_t type, const index::packed_contents* first, const index::packed_contents* last ) {
+         _db.get_mutable_index( space, type ).restore_objects( first, last );
+      } );
 
-      for( auto& item : state.removed )
-         _db.insert( std::move(*item.second) );
+   vector<object_id_type> created( state.new_ids.begin(), state.new_ids.end() );
+   for_each_index_batch( created,
+      []( const object_id_type& id ) { return id; },
+      [&]( uint8_t space, uint8_t type, const object_id_type* first, const object_id_type* last ) {
+         _db.get_mutable_index( space, type ).remove_objects( first, last );
+      } );
 
-      _stack.pop_back();
+   for( auto& item : state.old_index_next_ids )
+   {
+      _db.get_mutable_index( item.first.space(), item.first.type() ).set_next_id( item.second );
    }
-   catch ( const fc::exception& e )
+
+   for( auto& item : state.removed )
+      _db.insert( std::move(*item.second) );
+}
+
+undo_state& undo_database::back()
+{
+   if( _stack.empty() )
+      push_back();
+   return *_stack.back().newest;
+}
+
+void undo_database::push_back()
+{
+   auto start = _arena.top();
+   undo_state* state = new (_arena.allocate( sizeof(undo_state), alignof(undo_state) )) undo_state( _arena, start );
+   _stack.push_back( stack_entry{ state, state } );
+}
+
+void undo_database::pop_back()
+{
+   auto start = _stack.back().oldest->start;
+   destroy_layers( _stack.back() );
+   _stack.pop_back();
+   _arena.rewind( start );
+}
+
+void undo_database::destroy_layers( const stack_entry& entry )
+{
+   for( undo_state* state = entry.newest; state != nullptr; )
    {
-      elog( "error popping commit ${e}", ("e", e.to_detail_string() )  );
-      enable();
-      throw;
+      undo_state* older = state->older;
+      state->~undo_state();
+      state = older;
    }
-   enable();
 }
-const undo_state& undo_database::head()const
+
+undo_state::object_ptr undo_database::snapshot( const object& obj )
+{
+   return undo_state::object_ptr( obj.clone_into( _arena.allocate( obj.object_size() ) ) );
+}
+
+undo_state::packed_object undo_database::pack( const object& obj )
+{
+   size_t size = obj.packed_size();
+   char* data = static_cast<char*>( _arena.allocate( size, 1 ) );
+   obj.pack_into( data, size );
+   return undo_state::packed_object( data, size );
+}
+
+uint64_t undo_database::bytes()const
+{
+   if( _stack.empty() )
+      return 0;
+   return _arena.bytes_between( _stack.front().oldest->start, _arena.top() );
+}
+
+undo_stats undo_database::get_stats()const
+{
+   undo_stats stats;
+   stats.depth = _stack.size();
+   stats.max_depth = _max_size;
+   stats.max_bytes = _max_bytes;
+   stats.reserved_bytes = _arena.reserved_bytes();
+   stats.session_bytes.reserve( _stack.size() );
+   for( size_t i = 0; i < _stack.size(); ++i )
+   {
+      auto end = i + 1 < _stack.size() ? _stack[i+1].oldest->start : _arena.top();
+      stats.session_bytes.push_back( _arena.bytes_between( _stack[i].oldest->start, end ) );
+      stats.bytes += stats.session_bytes.back();
+   }
+   return stats;
+}
+
+namespace {
+   void sort_unique( vector<object_id_type>& ids )
+   {
+      std::sort( ids.begin(), ids.end() );
+      ids.erase( std::unique( ids.begin(), ids.end() ), ids.end() );
+   }
+}
+
+vector<object_id_type> undo_changes::affected()const
+{
+   vector<object_id_type> ids;
+   ids.reserve( created.size() + modified.size() + removed.size() );
+   ids.insert( ids.end(), created.begin(), created.end() );
+   ids.insert( ids.end(), modified.begin(), modified.end() );
+   ids.insert( ids.end(), removed.begin(), removed.end() );
+   sort_unique( ids );
+   return ids;
+}
+
+undo_changes undo_database::head_changes()const
 {
    FC_ASSERT( !_stack.empty() );
-   return _stack.back();
+   undo_changes changes;
+   for( const undo_state* state = _stack.back().newest; state != nullptr; state = state->older )
+   {
+      for( const auto& item : state->old_values )
+         changes.modified.push_back( item.first );
+      changes.created.insert( changes.created.end(), state->new_ids.begin(), state->new_ids.end() );
+      for( const auto& item : state->removed )
+         changes.removed.push_back( item.first );
+   }
+   // The states merged into one entry each hold the ids once, but hash order is not sorted
+   sort_unique( changes.created );
+   sort_unique( changes.modified );
+   sort_unique( changes.removed );
+   return changes;
 }
 
 } } // graphene::db
@@ -16,6 +16,9 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <graphene/net/core_messages.hpp>
+#include <graphene/utilities/lz_compression.hpp>
+
+#include <algorithm>
 
 
 namespace graphene { namespace net {
@@ -39,6 +42,48 @@ namespace graphene { namespace net {
   const core_message_type_enum check_firewall_reply_message::type            = core_message_type_enum::check_firewall_reply_message_type;
   const core_message_type_enum get_current_connections_request_message::type = core_message_type_enum::get_current_connections_request_message_type;
   const core_message_type_enum get_current_connections_reply_message::type   = core_message_type_enum::get_current_connections_reply_message_type;
+  const core_message_type_enum compact_block_message::type                   = core_message_type_enum::compact_block_message_type;
+  const core_message_type_enum fetch_compact_block_transactions_message::type = core_message_type_enum::fetch_compact_block_transactions_message_type;
+  const core_message_type_enum compact_block_transactions_message::type      = core_message_type_enum::compact_block_transactions_message_type;
+  const core_message_type_enum item_batch_message::type                      = core_message_type_enum::item_batch_message_type;
+  const core_message_type_enum compressed_message::type                      = core_message_type_enum::compressed_message_type;
+  const core_message_type_enum fetch_state_snapshot_manifest_message::type   = core_message_type_enum::fetch_state_snapshot_manifest_message_type;
+  const core_message_type_enum state_snapshot_manifest_message::type         = core_message_type_enum::state_snapshot_manifest_message_type;
+  const core_message_type_enum fetch_state_snapshot_chunk_message::type      = core_message_type_enum::fetch_state_snapshot_chunk_message_type;
+  const core_message_type_enum state_snapshot_chunk_message::type            = core_message_type_enum::state_snapshot_chunk_message_type;
+
+  compressed_message::compressed_message(const message& message_to_compress) :
+    msg_type(message_to_compress.msg_type),
+    uncompressed_size(message_to_compress.size),
+    compressed_data(graphene::utilities::lz_compress(message_to_compress.data.data(), message_to_compress.data.size()))
+  {}
+
+  message compressed_message::decompress() const
+  {
+    FC_ASSERT( uncompressed_size <= MAX_MESSAGE_SIZE, "", ("uncompressed_size", uncompressed_size)("MAX_MESSAGE_SIZE", MAX_MESSAGE_SIZE) );
+    FC_ASSERT( msg_type != compressed_message_type, "compressed messages don't nest" );
+    message decompressed_message;
+    decompressed_message.msg_type = msg_type;
+    decompressed_message.data = graphene::utilities::lz_decompress(compressed_data.data(), compressed_data.size(), uncompressed_size);
+    decompressed_message.size = (uint32_t)decompressed_message.data.size();
+    return decompressed_message;
+  }
+
+  uint32_t state_snapshot_manifest_message::size_of_chunk(uint32_t chunk_index) const
+  {
+    uint64_t chunk_start = uint64_t(chunk_index) * chunk_size;
+    if (chunk_start >= snapshot_size)
+      return 0;
+    return (uint32_t)std::min<uint64_t>(chunk_size, snapshot_size - chunk_start);
+  }
+
+  fc::sha256 state_snapshot_manifest_message::commit_to_chunk(const fc::sha256& previous_commitment, const char* data, size_t size)
+  {
+    fc::sha256::encoder enc;
+    fc::raw::pack(enc, previous_commitment);
+    enc.write(data, size);
+    return enc.result();
+  }
 
 } } // graphene::net
 
@@ -31,6 +31,19 @@
  * 2MiB
  */
 #define MAX_MESSAGE_SIZE                                1024*1024*2
+
+/**
+ * How much a connection reads from its socket at once.  Small messages arriving
+ * together are framed out of one read, larger ones are read straight into
+ * the message once this much of them has been read.  Must be a multiple of 16.
+ */
+#define GRAPHENE_NET_READ_BUFFER_SIZE                   (64*1024)
+/**
+ * How much encrypted data a connection gathers before writing it to its socket.  A message
+ * is written out whole when it's flushed, so one that fits goes out in one write.  Must be
+ * a multiple of 16.
+ */
+#define GRAPHENE_NET_WRITE_BUFFER_SIZE                  (64*1024)
 #define GRAPHENE_NET_DEFAULT_PEER_CONNECTION_RETRY_TIME      30 // seconds
 
 /**
@@ -50,7 +63,69 @@
 #define GRAPHENE_NET_DELEGATE_DESIRED_CONNECTIONS            50
 #define GRAPHENE_NET_DEFAULT_MAX_CONNECTIONS                 200
 
-#define GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES        (1024 * 1024)
+/**
+ * Number of threads the peer connections are spread over for their socket reads
+ * and writes and the encryption of their streams.  The logic of the node stays
+ * on its own thread.  With 0 everything runs on the node's thread.
+ */
+#define GRAPHENE_NET_DEFAULT_IO_THREADS                      2
+
+/**
+ * Each peer's messages wait in three send queues, each with its own limit; a peer whose
+ * queue grows past its limit is disconnected.  Blocks, sync replies and the connection's own
+ * messages go out first, then inventory, then transactions, so a flood of transaction relays
+ * can't hold back a block
+ */
+#define GRAPHENE_NET_MAXIMUM_QUEUED_BLOCK_MESSAGES_IN_BYTES       (2 * MAX_MESSAGE_SIZE)
+#define GRAPHENE_NET_MAXIMUM_QUEUED_INVENTORY_MESSAGES_IN_BYTES   (256 * 1024)
+#define GRAPHENE_NET_MAXIMUM_QUEUED_TRANSACTION_MESSAGES_IN_BYTES (1024 * 1024)
+
+/**
+ * When an upload limit is set, the peers syncing from us and the peers in sync with us are
+ * shaped as two groups.  The in-sync peers get a little more than they used in the last
+ * second, but never less than the relay share of the limit, and the syncing peers get the
+ * rest, but never less than the sync share
+ */
+#define GRAPHENE_NET_MIN_RELAY_UPLOAD_SHARE_PERCENT          50
+#define GRAPHENE_NET_MIN_SYNC_UPLOAD_SHARE_PERCENT           10
+
+/**
+ * The most the bodies of the messages we keep to serve to our peers may add up to.  Messages
+ * normally expire a couple of blocks after they were broadcast; past this, the oldest go first
+ */
+#define GRAPHENE_NET_MESSAGE_CACHE_MAX_BYTES                 (64 * 1024 * 1024)
+
+/**
+ * Peers which support it get the answer to a fetch_items_message for several items packed into
+ * item_batch_messages of at most this many items, and of about this many bytes (a batch always
+ * holds at least one item, however large)
+ */
+#define GRAPHENE_NET_MAX_ITEMS_PER_BATCH                     50
+#define GRAPHENE_NET_MAX_ITEM_BATCH_SIZE_IN_BYTES            (MAX_MESSAGE_SIZE / 2)
+
+/**
+ * Peers which say in their hello they can take compressed_messages get the messages of at
+ * least this many bytes compressed, when that makes them smaller
+ */
+#define GRAPHENE_NET_COMPRESSION_THRESHOLD_IN_BYTES          1024
+
+/**
+ * New transactions are advertised at most this often, so a peer gets all those of an interval in
+ * one inventory message, and fetches them with one fetch_items_message of up to
+ * GRAPHENE_NET_MAX_ITEMS_PER_BATCH items.  A transaction after a quiet interval goes out at once
+ */
+#define GRAPHENE_NET_TRANSACTION_ADVERTISE_INTERVAL_MS       50
+
+/**
+ * During sync, up to this many blocks which each build on the one before are handed to the client
+ * at once, so they cross to its thread together and are applied as one run
+ */
+#define GRAPHENE_NET_SYNC_BLOCKS_PER_BATCH                   50
+
+/**
+ * The propagation traces of this many of the most recent blocks are kept
+ */
+#define GRAPHENE_NET_BLOCK_PROPAGATION_TRACES_KEPT           1000
 
 /**
  * We prevent a peer from offering us a list of blocks which, if we fetched them
@@ -63,10 +138,35 @@
 
 #define GRAPHENE_NET_INSUFFICIENT_RELAY_FEE_PENALTY_SEC      15
 
+/**
+ * Each peer may send us this many transactions per second on average, in bursts of up to
+ * GRAPHENE_NET_PEER_TRANSACTION_BURST.  Transactions beyond that are dropped before they reach
+ * the client, and fetching transactions from the peer is inhibited as for an insufficient relay fee
+ */
+#define GRAPHENE_NET_PEER_TRANSACTIONS_PER_SECOND            100
+#define GRAPHENE_NET_PEER_TRANSACTION_BURST                  500
+
+/**
+ * Transactions arriving while the client's thread is busy with the ones before them are handed to it
+ * in batches of up to this many, each handled in a single task on the client's thread
+ */
+#define GRAPHENE_NET_MAX_TRANSACTIONS_PER_HANDOFF            100
+
 #define GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES           2
 
 #define GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING      100
 
+/**
+ * During sync, each peer is kept a window of outstanding block requests, which starts at
+ * maximum_blocks_per_peer_during_syncing.  A block arriving in under half the target latency
+ * widens the peer's window by one, and one arriving later than the target narrows it by one,
+ * so each peer carries a share of the sync in proportion to how fast it delivers.  The window
+ * is refilled when half of it has arrived, so downloading never waits on a round trip
+ */
+#define GRAPHENE_NET_MIN_SYNC_WINDOW_BLOCKS                  10
+#define GRAPHENE_NET_MAX_SYNC_WINDOW_BLOCKS                  1000
+#define GRAPHENE_NET_SYNC_WINDOW_TARGET_LATENCY_MS           2000
+
 /**
  * Instead of fetching all item IDs from a peer, then fetching all blocks
  * from a peer, we will interleave them.  Fetch at least this many block IDs,
@@ -75,4 +175,12 @@
  */
 #define GRAPHENE_NET_MIN_BLOCK_IDS_TO_PREFETCH               10000
 
+/**
+ * A state snapshot is served to the peers bootstrapping from it in chunks of this many bytes.  Each
+ * peer serving the snapshot is kept this many chunk requests at once, so the snapshot downloads from
+ * all of them in parallel
+ */
+#define GRAPHENE_NET_STATE_SNAPSHOT_CHUNK_SIZE               (1024*1024)
+#define GRAPHENE_NET_STATE_SNAPSHOT_CHUNKS_PER_PEER          4
+
 #define GRAPHENE_NET_MAX_TRX_PER_SECOND                      1000
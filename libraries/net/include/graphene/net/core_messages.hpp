@@ -18,6 +18,7 @@
 #pragma once
 
 #include <graphene/net/config.hpp>
+#include <graphene/net/message.hpp>
 #include <graphene/chain/block.hpp>
 
 #include <fc/crypto/ripemd160.hpp>
@@ -38,6 +39,8 @@ namespace graphene { namespace net {
   using graphene::chain::block_id_type;
   using graphene::chain::transaction_id_type;
   using graphene::chain::signed_block;
+  using graphene::chain::signed_block_header;
+  using graphene::chain::operation_result;
 
   typedef fc::ecc::public_key_data node_id_t;
   typedef fc::ripemd160 item_hash_t;
@@ -80,6 +83,15 @@ namespace graphene { namespace net {
     check_firewall_reply_message_type            = 5015,
     get_current_connections_request_message_type = 5016,
     get_current_connections_reply_message_type   = 5017,
+    compact_block_message_type                   = 5018,
+    fetch_compact_block_transactions_message_type = 5019,
+    compact_block_transactions_message_type      = 5020,
+    item_batch_message_type                      = 5021,
+    compressed_message_type                      = 5022,
+    fetch_state_snapshot_manifest_message_type   = 5023,
+    state_snapshot_manifest_message_type         = 5024,
+    fetch_state_snapshot_chunk_message_type      = 5025,
+    state_snapshot_chunk_message_type            = 5026,
     core_message_type_last                       = 5099
   };
 
@@ -109,6 +121,68 @@ namespace graphene { namespace net {
 
    };
 
+  /**
+   * A block with each transaction replaced by its id, for peers which have almost always seen the
+   * transactions already.  It is requested with a fetch_items_message of compact_block_message_type
+   * for the hash of the block_message, and the receiver rebuilds the block_message from the
+   * transactions it has cached, asking for the ones it lacks with a
+   * fetch_compact_block_transactions_message.
+   */
+  struct compact_block_message
+  {
+    static const core_message_type_enum type;
+
+    struct compact_transaction
+    {
+      transaction_id_type           id;
+      std::vector<operation_result> operation_results;
+    };
+
+    item_hash_t                      block_message_hash;
+    block_id_type                    block_id;
+    signed_block_header              block_header;
+    std::vector<compact_transaction> transactions;
+
+    compact_block_message() {}
+    compact_block_message(const item_hash_t& block_message_hash, const signed_block& block) :
+      block_message_hash(block_message_hash),
+      block_id(block.id()),
+      block_header(block)
+    {
+      transactions.reserve(block.transactions.size());
+      for (const auto& trx : block.transactions)
+        transactions.push_back(compact_transaction{trx.id(), trx.operation_results});
+    }
+  };
+
+  struct fetch_compact_block_transactions_message
+  {
+    static const core_message_type_enum type;
+
+    item_hash_t           block_message_hash;
+    std::vector<uint32_t> transaction_indices;
+
+    fetch_compact_block_transactions_message() {}
+    fetch_compact_block_transactions_message(const item_hash_t& block_message_hash,
+                                             std::vector<uint32_t> transaction_indices) :
+      block_message_hash(block_message_hash),
+      transaction_indices(std::move(transaction_indices))
+    {}
+  };
+
+  struct compact_block_transactions_message
+  {
+    static const core_message_type_enum type;
+
+    item_hash_t                     block_message_hash;
+    std::vector<signed_transaction> transactions; ///< in the order they were asked for
+
+    compact_block_transactions_message() {}
+    compact_block_transactions_message(const item_hash_t& block_message_hash) :
+      block_message_hash(block_message_hash)
+    {}
+  };
+
   struct item_ids_inventory_message
   {
     static const core_message_type_enum type;
@@ -181,6 +255,33 @@ namespace graphene { namespace net {
     {}
   };
 
+  /// several trx_messages, block_messages or item_not_available_messages answering one fetch_items_message
+  struct item_batch_message
+  {
+    static const core_message_type_enum type;
+
+    std::vector<message> items;
+  };
+
+  /**
+   * Another message, compressed; sent only to peers which said in their hello they can take it.
+   * The message it unpacks to is handled as if it had been sent as it is
+   */
+  struct compressed_message
+  {
+    static const core_message_type_enum type;
+
+    uint32_t          msg_type;
+    uint32_t          uncompressed_size;
+    std::vector<char> compressed_data;
+
+    compressed_message() : msg_type(0), uncompressed_size(0) {}
+    explicit compressed_message(const message& message_to_compress);
+
+    /** @throws fc::exception if the compressed data is corrupt */
+    message decompress() const;
+  };
+
   struct hello_message
   {
     static const core_message_type_enum type;
@@ -315,6 +416,80 @@ namespace graphene { namespace net {
     {}
   };
 
+  /// asks a peer which state snapshot it serves, answered with a state_snapshot_manifest_message
+  struct fetch_state_snapshot_manifest_message
+  {
+    static const core_message_type_enum type;
+  };
+
+  /**
+   * Describes the snapshot of the state as of block_id which a peer serves, or nothing if chunk_commitments
+   * is empty.  The snapshot is split into chunks of chunk_size bytes, the last of them possibly shorter.  The
+   * commitment to each chunk is the hash of the commitment to the chunk before it and the chunk itself, so
+   * each chunk can be checked as soon as it arrives, and the last commitment covers the whole snapshot.
+   * head_block_header is the header of block_id as its witness signed it, and state_hash the hash of the
+   * state after it.
+   */
+  struct state_snapshot_manifest_message
+  {
+    static const core_message_type_enum type;
+
+    block_id_type           block_id;
+    signed_block_header     head_block_header;
+    fc::sha256              state_hash;
+    uint64_t                snapshot_size;
+    uint32_t                chunk_size;
+    std::vector<fc::sha256> chunk_commitments;
+
+    state_snapshot_manifest_message() :
+      snapshot_size(0),
+      chunk_size(0)
+    {}
+
+    bool serves_snapshot() const { return !chunk_commitments.empty(); }
+    /// the size chunk_index should have, given the size of the snapshot
+    uint32_t size_of_chunk(uint32_t chunk_index) const;
+    /// the commitment to a chunk which follows the chunk committed to by previous_commitment
+    static fc::sha256 commit_to_chunk(const fc::sha256& previous_commitment, const char* data, size_t size);
+
+    friend bool operator==(const state_snapshot_manifest_message& a, const state_snapshot_manifest_message& b)
+    {
+      return a.block_id == b.block_id && a.state_hash == b.state_hash && a.snapshot_size == b.snapshot_size &&
+             a.chunk_size == b.chunk_size && a.chunk_commitments == b.chunk_commitments;
+    }
+  };
+
+  struct fetch_state_snapshot_chunk_message
+  {
+    static const core_message_type_enum type;
+
+    block_id_type block_id;
+    uint32_t      chunk_index;
+
+    fetch_state_snapshot_chunk_message() : chunk_index(0) {}
+    fetch_state_snapshot_chunk_message(const block_id_type& block_id, uint32_t chunk_index) :
+      block_id(block_id),
+      chunk_index(chunk_index)
+    {}
+  };
+
+  /// a chunk of a state snapshot, which is empty if the peer no longer serves the snapshot
+  struct state_snapshot_chunk_message
+  {
+    static const core_message_type_enum type;
+
+    block_id_type     block_id;
+    uint32_t          chunk_index;
+    std::vector<char> data;
+
+    state_snapshot_chunk_message() : chunk_index(0) {}
+    state_snapshot_chunk_message(const block_id_type& block_id, uint32_t chunk_index, std::vector<char> data) :
+      block_id(block_id),
+      chunk_index(chunk_index),
+      data(std::move(data))
+    {}
+  };
+
   struct current_time_request_message
   {
     static const core_message_type_enum type;
@@ -418,10 +593,23 @@ FC_REFLECT_ENUM( graphene::net::core_message_type_enum,
                  (check_firewall_reply_message_type)
                  (get_current_connections_request_message_type)
                  (get_current_connections_reply_message_type)
+                 (compact_block_message_type)
+                 (fetch_compact_block_transactions_message_type)
+                 (compact_block_transactions_message_type)
+                 (item_batch_message_type)
+                 (compressed_message_type)
+                 (fetch_state_snapshot_manifest_message_type)
+                 (state_snapshot_manifest_message_type)
+                 (fetch_state_snapshot_chunk_message_type)
+                 (state_snapshot_chunk_message_type)
                  (core_message_type_last) )
 
 FC_REFLECT( graphene::net::trx_message, (trx) )
 FC_REFLECT( graphene::net::block_message, (block)(block_id) )
+FC_REFLECT( graphene::net::compact_block_message::compact_transaction, (id)(operation_results) )
+FC_REFLECT( graphene::net::compact_block_message, (block_message_hash)(block_id)(block_header)(transactions) )
+FC_REFLECT( graphene::net::fetch_compact_block_transactions_message, (block_message_hash)(transaction_indices) )
+FC_REFLECT( graphene::net::compact_block_transactions_message, (block_message_hash)(transactions) )
 
 FC_REFLECT( graphene::net::item_id, (item_type)
                                (item_hash) )
@@ -435,6 +623,17 @@ FC_REFLECT( graphene::net::fetch_blockchain_item_ids_message, (item_type)
 FC_REFLECT( graphene::net::fetch_items_message, (item_type)
                                            (items_to_fetch) )
 FC_REFLECT( graphene::net::item_not_available_message, (requested_item) )
+FC_REFLECT( graphene::net::item_batch_message, (items) )
+FC_REFLECT( graphene::net::compressed_message, (msg_type)(uncompressed_size)(compressed_data) )
+FC_REFLECT_EMPTY( graphene::net::fetch_state_snapshot_manifest_message )
+FC_REFLECT( graphene::net::state_snapshot_manifest_message, (block_id)
+                                                       (head_block_header)
+                                                       (state_hash)
+                                                       (snapshot_size)
+                                                       (chunk_size)
+                                                       (chunk_commitments) )
+FC_REFLECT( graphene::net::fetch_state_snapshot_chunk_message, (block_id)(chunk_index) )
+FC_REFLECT( graphene::net::state_snapshot_chunk_message, (block_id)(chunk_index)(data) )
 FC_REFLECT( graphene::net::hello_message, (user_agent)
                                      (core_protocol_version)
                                      (inbound_address)
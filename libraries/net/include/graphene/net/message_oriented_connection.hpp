@@ -19,6 +19,8 @@
 #include <fc/network/tcp_socket.hpp>
 #include <graphene/net/message.hpp>
 
+namespace fc { class thread; }
+
 namespace graphene { namespace net {
 
   namespace detail { class message_oriented_connection_impl; }
@@ -33,11 +35,15 @@ namespace graphene { namespace net {
     virtual void on_connection_closed(message_oriented_connection* originating_connection) = 0;
   };
 
-  /** uses a secure socket to create a connection that reads and writes a stream of `fc::net::message` objects */
+  /** uses a secure socket to create a connection that reads and writes a stream of `fc::net::message` objects
+   *
+   * If given an io_thread, the socket reads and writes and the encryption of the stream run on that thread, and
+   * only the decoded messages are passed over to the delegate on the thread which created the connection.
+   */
   class message_oriented_connection
   {
   public:
-    message_oriented_connection(message_oriented_connection_delegate* delegate = nullptr);
+    message_oriented_connection(message_oriented_connection_delegate* delegate = nullptr, fc::thread* io_thread = nullptr);
     ~message_oriented_connection();
     fc::tcp_socket& get_socket();
     void accept();
@@ -45,6 +51,11 @@ namespace graphene { namespace net {
     void connect_to(const fc::ip::endpoint& remote_endpoint);
 
     void send_message(const message& message_to_send);
+    /** sends a message which may be shared with other connections; it is not copied, only encrypted as it is
+     * written out */
+    void send_message(const std::shared_ptr<const message>& message_to_send);
+    /** from now on, messages of at least threshold bytes are sent compressed if that makes them smaller */
+    void enable_compression(size_t threshold);
     void close_connection();
     void destroy_connection();
 
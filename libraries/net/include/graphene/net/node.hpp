@@ -23,6 +23,8 @@
 
 #include <graphene/chain/types.hpp>
 
+#include <fc/thread/thread.hpp>
+
 #include <list>
 
 namespace graphene { namespace net {
@@ -47,6 +49,21 @@ namespace graphene { namespace net {
     node_id_t originating_peer;
   };
 
+  /**
+   *  What this node saw of a block on its way through, kept for the most recent blocks so the
+   *  propagation of a block can be followed from the witness which produced it to every node.
+   *  The times are this node's clock, and those which never happened are left at their default.
+   */
+  struct block_propagation_trace
+  {
+    graphene::chain::block_id_type block_id;
+    fc::time_point first_seen_time;    /// when a peer first advertised the block or sent it to us
+    node_id_t      source_peer;        /// the peer which sent us the block, or this node if it produced it
+    fc::time_point received_time;      /// when the block arrived
+    fc::time_point applied_time;       /// when the client accepted the block
+    fc::time_point first_relayed_time; /// when we first advertised the block to a peer
+  };
+
    /**
     *  @class node_delegate
     *  @brief used by node reports status to client or fetch data from client
@@ -61,6 +78,12 @@ namespace graphene { namespace net {
           */
          virtual bool has_item( const net::item_id& id ) = 0;
 
+         /**
+          *  Answers has_item() without touching the delegate's own state, so it may be called from any
+          *  thread.  Returns false if the delegate can't be sure, and has_item() must be asked instead.
+          */
+         virtual bool has_item_on_any_thread( const net::item_id& id, bool& has_the_item ) { return false; }
+
          /**
           *  @brief allows the application to validate an item prior to
           *         broadcasting to peers.
@@ -74,6 +97,41 @@ namespace graphene { namespace net {
          virtual bool handle_block( const graphene::net::block_message& blk_msg, bool syncmode ) = 0;
          virtual bool handle_transaction( const graphene::net::trx_message& trx_msg, bool syncmode  ) = 0;
 
+         /**
+          *  Screens a transaction received from a peer before it is handed to handle_transaction(), without
+          *  touching the delegate's own state, so it may be called from any thread.  Returns false, with the
+          *  reason, for a transaction the delegate would certainly reject; such transactions are dropped
+          *  without being relayed.
+          */
+         virtual bool admit_transaction_on_any_thread( const graphene::net::trx_message& trx_msg, std::string& reason ) { return true; }
+
+         /**
+          *  Handles sync blocks, each of which builds on the one before it, in one call, stopping at the
+          *  first one the delegate doesn't accept.
+          *
+          *  @returns the number of blocks accepted
+          */
+         virtual uint32_t handle_sync_blocks( const std::vector<block_message>& blocks )
+         {
+            uint32_t accepted = 0;
+            try
+            {
+               for( const block_message& block : blocks )
+               {
+                  handle_block( block, true );
+                  ++accepted;
+               }
+            }
+            catch( const fc::canceled_exception& )
+            {
+               throw;
+            }
+            catch( const fc::exception& )
+            {
+            }
+            return accepted;
+         }
+
          virtual bool handle_message( const message& message_to_process, bool sync_mode )
          {
             switch( message_to_process.msg_type )
@@ -104,6 +162,51 @@ namespace graphene { namespace net {
           */
          virtual message get_item( const item_id& id ) = 0;
 
+         /**
+          *  Fetches several items at once, leaving the ones the delegate doesn't have empty.
+          */
+         virtual std::vector<fc::optional<message> > get_items( const std::vector<item_id>& ids )
+         {
+            std::vector<fc::optional<message> > items;
+            items.reserve( ids.size() );
+            for( const item_id& id : ids )
+            {
+               try
+               {
+                  items.emplace_back( get_item( id ) );
+               }
+               catch( const fc::exception& )
+               {
+                  items.emplace_back();
+               }
+            }
+            return items;
+         }
+
+         /**
+          *  Describes the state snapshot served to peers bootstrapping from one, or returns an empty
+          *  manifest if none is served.
+          */
+         virtual state_snapshot_manifest_message get_state_snapshot_manifest() { return state_snapshot_manifest_message(); }
+
+         /**
+          *  Returns a chunk of the snapshot of the state as of block_id, or nothing if that snapshot is no
+          *  longer served.
+          */
+         virtual std::vector<char> get_state_snapshot_chunk( const block_id_type& block_id, uint32_t chunk_index ) { return std::vector<char>(); }
+
+         /**
+          *  Replaces the state with a snapshot downloaded from peers, every chunk of which matched the
+          *  manifest that enough peers agreed on.
+          *
+          *  @throws exception if the snapshot is not acceptable, in which case the node bootstraps from
+          *          another one
+          */
+         virtual void handle_state_snapshot( const state_snapshot_manifest_message& manifest, const std::vector<char>& snapshot )
+         {
+            FC_THROW( "This client can't bootstrap from a state snapshot" );
+         }
+
          virtual fc::sha256 get_chain_id()const = 0;
 
          /**
@@ -256,12 +359,22 @@ namespace graphene { namespace net {
          */
         virtual void      sync_from(const item_id& current_head_block, const std::vector<uint32_t>& hard_fork_block_numbers);
 
+        /**
+         *  Has the node download the state as of a recent block from its peers, and hand it to the
+         *  delegate's handle_state_snapshot(), before it syncs the blocks after it.  A snapshot is only
+         *  downloaded once min_attesting_peers peers serve the same one.  Must be called before connecting
+         *  to the network.
+         */
+        void      bootstrap_state_from_peers(uint32_t min_attesting_peers);
+
         bool      is_connected() const;
 
         void set_advanced_node_parameters(const fc::variant_object& params);
         fc::variant_object get_advanced_node_parameters();
         message_propagation_data get_transaction_propagation_data(const graphene::chain::transaction_id_type& transaction_id);
         message_propagation_data get_block_propagation_data(const graphene::chain::block_id_type& block_id);
+        /** the traces of the most recent blocks this node has seen, oldest first */
+        std::vector<block_propagation_trace> get_block_propagation_traces() const;
         node_id_t get_node_id() const;
         void set_allowed_peers(const std::vector<node_id_t>& allowed_peers);
 
@@ -273,8 +386,23 @@ namespace graphene { namespace net {
 
         void set_total_bandwidth_limit(uint32_t upload_bytes_per_second, uint32_t download_bytes_per_second);
 
+        /**
+         * Pins the p2p thread and the I/O threads to the CPUs of a NUMA node, and places the memory they
+         * allocate from now on there.  Returns false if any of them could not be bound.
+         */
+        bool bind_to_numa_node(uint32_t numa_node);
+
+        /**
+         * Replaces the threads doing the socket I/O and encryption of the peer connections with threads which
+         * belong to a pool shared with others.  Must be called before any connection is made; with no threads,
+         * the I/O is done on the p2p thread.
+         */
+        void set_io_threads(const std::vector<std::shared_ptr<fc::thread> >& io_threads);
+
         fc::variant_object network_get_info() const;
         fc::variant_object network_get_usage_stats() const;
+        /** the upload limit and rate of each group of peers the upload limit is shared between, and each peer's rate */
+        fc::variant_object get_upload_rates() const;
 
         std::vector<potential_peer_record> get_potential_peers() const;
 
@@ -297,12 +425,21 @@ namespace graphene { namespace net {
 
       void      sync_from(const item_id& current_head_block, const std::vector<uint32_t>& hard_fork_block_numbers) override {}
       void      broadcast(const message& item_to_broadcast) override;
-      void      add_node_delegate(node_delegate* node_delegate_to_add);
+      /**
+       *  Messages reach the delegate latency after they've finished sending, and sending takes their size
+       *  divided by bytes_per_second, one message at a time.  A bytes_per_second of 0 sends instantly.
+       */
+      void      add_node_delegate(node_delegate* node_delegate_to_add,
+                                  fc::microseconds latency = fc::microseconds(),
+                                  uint64_t bytes_per_second = 0);
+      /** Sends to the one delegate instead of all of them */
+      void      send_message(node_delegate* destination, const message& message_to_send);
 
       virtual uint32_t get_connection_count() const override { return 8; }
     private:
       struct node_info;
       void message_sender(node_info* destination_node);
+      void queue_message(node_info* destination_node, const message& message_to_send);
       std::list<node_info*> network_nodes;
     };
 
@@ -313,4 +450,5 @@ namespace graphene { namespace net {
 } } // graphene::net
 
 FC_REFLECT(graphene::net::message_propagation_data, (received_time)(validated_time)(originating_peer));
+FC_REFLECT(graphene::net::block_propagation_trace, (block_id)(first_seen_time)(source_peer)(received_time)(applied_time)(first_relayed_time));
 FC_REFLECT( graphene::net::peer_status, (version)(host)(info) );
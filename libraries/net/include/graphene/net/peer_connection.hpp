@@ -22,6 +22,7 @@
 #include <graphene/net/message_oriented_connection.hpp>
 #include <graphene/net/stcp_socket.hpp>
 #include <graphene/net/config.hpp>
+#include <graphene/net/timestamped_item_set.hpp>
 
 #include <boost/tuple/tuple.hpp>
 
@@ -62,7 +63,11 @@ namespace graphene { namespace net
       virtual void on_message(peer_connection* originating_peer,
                               const message& received_message) = 0;
       virtual void on_connection_closed(peer_connection* originating_peer) = 0;
-      virtual message get_message_for_item(const item_id& item) = 0;
+      virtual std::shared_ptr<const message> get_message_for_item(const item_id& item) = 0;
+      /** packs items into an item_batch_message starting at next_item, which is advanced past the ones packed */
+      virtual std::shared_ptr<const message> get_message_for_items(const std::vector<item_id>& items, size_t& next_item) = 0;
+      /** @return the thread for a new connection's I/O, or nullptr to run it on the delegate's thread */
+      virtual fc::thread* get_io_thread() { return nullptr; }
     };
 
     class peer_connection;
@@ -117,29 +122,32 @@ namespace graphene { namespace net
           enqueue_time(enqueue_time)
         {}
 
-        virtual message get_message(peer_connection_delegate* node) = 0;
+        virtual std::shared_ptr<const message> get_message(peer_connection_delegate* node) = 0;
         /** returns roughly the number of bytes of memory the message is consuming while
          * it is sitting on the queue
          */
         virtual size_t get_size_in_queue() = 0;
+        /** false if the message must stay at the front of the queue to send more of itself */
+        virtual bool completely_sent() const { return true; }
         virtual ~queued_message() {}
       };
 
-      /* when you queue up a 'real_queued_message', a full copy of the message is
-       * stored on the heap until it is sent
+      /* when you queue up a 'real_queued_message', the message is held on the heap
+       * until it is sent.  The message is immutable, so the same copy can be queued
+       * to any number of peers
        */
       struct real_queued_message : queued_message
       {
-        message        message_to_send;
+        std::shared_ptr<const message> message_to_send;
         size_t         message_send_time_field_offset;
 
-        real_queued_message(message message_to_send,
+        real_queued_message(std::shared_ptr<const message> message_to_send,
                             size_t message_send_time_field_offset = (size_t)-1) :
           message_to_send(std::move(message_to_send)),
           message_send_time_field_offset(message_send_time_field_offset)
         {}
 
-        message get_message(peer_connection_delegate* node) override;
+        std::shared_ptr<const message> get_message(peer_connection_delegate* node) override;
         size_t get_size_in_queue() override;
       };
 
@@ -155,13 +163,46 @@ namespace graphene { namespace net
           item_to_send(std::move(item_to_send))
         {}
 
-        message get_message(peer_connection_delegate* node) override;
+        std::shared_ptr<const message> get_message(peer_connection_delegate* node) override;
         size_t get_size_in_queue() override;
       };
 
+      /* a 'batch_queued_message' is a list of items which are generated when they reach
+       * the top of the queue, and sent in as few item_batch_messages as they fit in
+       */
+      struct batch_queued_message : queued_message
+      {
+        std::vector<item_id> items_to_send;
+        size_t               next_item_to_send;
+
+        batch_queued_message(std::vector<item_id> items_to_send) :
+          items_to_send(std::move(items_to_send)),
+          next_item_to_send(0)
+        {}
+
+        std::shared_ptr<const message> get_message(peer_connection_delegate* node) override;
+        size_t get_size_in_queue() override;
+        bool completely_sent() const override { return next_item_to_send >= items_to_send.size(); }
+      };
+
+
+      /* messages are sent from the first nonempty queue, in this order */
+      enum send_queue_class
+      {
+        block_send_queue,       // blocks, sync replies, requests and the connection's own messages
+        inventory_send_queue,
+        transaction_send_queue,
+        number_of_send_queues
+      };
+      static send_queue_class get_send_queue_class(uint32_t message_or_item_type);
 
-      size_t _total_queued_messages_size;
-      std::queue<std::unique_ptr<queued_message>, std::list<std::unique_ptr<queued_message> > > _queued_messages;
+      struct send_queue
+      {
+        size_t total_queued_messages_size;
+        std::queue<std::unique_ptr<queued_message>, std::list<std::unique_ptr<queued_message> > > queued_messages;
+        send_queue() : total_queued_messages_size(0) {}
+      };
+      send_queue _send_queues[number_of_send_queues];
       fc::future<void> _send_queued_messages_done;
     public:
       fc::time_point connection_initiation_time;
@@ -173,6 +214,13 @@ namespace graphene { namespace net
       fc::microseconds clock_offset;
       fc::microseconds round_trip_delay;
 
+      /// upload scheduling, kept up to date by the node's bandwidth monitor
+      /// @{
+      bool     upload_scheduled_as_syncing; /// set while the socket is in the rate limiting group for peers syncing from us
+      uint64_t bytes_sent_at_last_upload_rate_update;
+      uint32_t upload_rate; /// bytes per second sent to this peer, over the last update interval
+      /// @}
+
       our_connection_state our_state;
       bool they_have_requested_close;
       their_connection_state their_state;
@@ -201,6 +249,9 @@ namespace graphene { namespace net
       fc::optional<fc::time_point_sec> fc_git_revision_unix_timestamp;
       fc::optional<std::string> platform;
       fc::optional<uint32_t> bitness;
+      bool             supports_compact_blocks; /// set if the hello says the peer can serve and rebuild compact_block_messages
+      bool             supports_item_batches; /// set if the hello says the peer can unpack item_batch_messages
+      bool             supports_compression; /// set if the hello says the peer can unpack compressed_messages
 
       // for inbound connections, these fields record what the peer sent us in
       // its hello message.  For outbound, they record what we sent the peer
@@ -221,38 +272,33 @@ namespace graphene { namespace net
       bool we_need_sync_items_from_peer;
       fc::optional<boost::tuple<item_id, fc::time_point> > item_ids_requested_from_peer; /// we check this to detect a timed-out request and in busy()
       item_to_time_map_type sync_items_requested_from_peer; /// ids of blocks we've requested from this peer during sync.  fetch from another peer if this peer disconnects
+      uint32_t sync_window; /// how many sync blocks we keep requested from this peer at once, adapted to how quickly it delivers them
       uint32_t last_block_number_delegate_has_seen; /// the number of the last block this peer has told us about that the delegate knows (ids_of_items_to_get[0] should be the id of block [this value + 1])
       item_hash_t last_block_delegate_has_seen; /// the hash of the last block  this peer has told us about that the peer knows
       fc::time_point_sec last_block_time_delegate_has_seen;
       bool inhibit_fetching_sync_blocks;
+      fc::optional<state_snapshot_manifest_message> state_snapshot_manifest; /// the state snapshot this peer serves, while we're bootstrapping from one
+      std::map<uint32_t, fc::time_point> state_snapshot_chunks_requested_from_peer; /// chunks of the state snapshot we've requested from this peer.  fetch from another peer if this peer disconnects
       /// @}
 
       /// non-synchronization state data
       /// @{
-      struct timestamped_item_id
-      {
-        item_id            item;
-        fc::time_point_sec timestamp;
-        timestamped_item_id(const item_id& item, const fc::time_point_sec timestamp) :
-          item(item),
-          timestamp(timestamp)
-        {}
-      };
-      struct timestamp_index{};
-      typedef boost::multi_index_container<timestamped_item_id,
-                                           boost::multi_index::indexed_by<boost::multi_index::hashed_unique<boost::multi_index::member<timestamped_item_id, item_id, &timestamped_item_id::item>,
-                                                                                                            std::hash<item_id> >,
-                                                                          boost::multi_index::ordered_non_unique<boost::multi_index::tag<timestamp_index>,
-                                                                                                                 boost::multi_index::member<timestamped_item_id, fc::time_point_sec, &timestamped_item_id::timestamp> > > > timestamped_items_set_type;
-      timestamped_items_set_type inventory_peer_advertised_to_us;
-      timestamped_items_set_type inventory_advertised_to_peer;
+      /// items are forgotten GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES after they were advertised
+      timestamped_item_set inventory_peer_advertised_to_us;
+      timestamped_item_set inventory_advertised_to_peer;
 
       item_to_time_map_type items_requested_from_peer;  /// items we've requested from this peer during normal operation.  fetch from another peer if this peer disconnects
+      /// compact blocks from this peer waiting on the transactions we asked it for, by the hash of the block_message
+      std::map<item_hash_t, std::pair<compact_block_message, std::vector<fc::optional<signed_transaction> > > > partial_compact_blocks;
       /// @}
 
       // if they're flooding us with transactions, we set this to avoid fetching for a few seconds to let the
       // blockchain catch up
       fc::time_point transaction_fetching_inhibited_until;
+      // token bucket limiting how many transactions this peer may hand to the client, refilled at
+      // GRAPHENE_NET_PEER_TRANSACTIONS_PER_SECOND
+      double transaction_tokens;
+      fc::time_point transaction_tokens_refilled;
 
       uint32_t last_known_fork_block_number;
 
@@ -278,9 +324,11 @@ namespace graphene { namespace net
       void on_message(message_oriented_connection* originating_connection, const message& received_message) override;
       void on_connection_closed(message_oriented_connection* originating_connection) override;
 
-      void send_queueable_message(std::unique_ptr<queued_message>&& message_to_send);
+      void send_queueable_message(std::unique_ptr<queued_message>&& message_to_send, send_queue_class queue_class);
       void send_message(const message& message_to_send, size_t message_send_time_field_offset = (size_t)-1);
+      void send_message(std::shared_ptr<const message> message_to_send, size_t message_send_time_field_offset = (size_t)-1);
       void send_item(const item_id& item_to_send);
+      void send_items(std::vector<item_id> items_to_send);
       void close_connection();
       void destroy_connection();
 
@@ -299,9 +347,13 @@ namespace graphene { namespace net
 
       bool is_transaction_fetching_inhibited() const;
       fc::sha512 get_shared_secret() const;
+      /** compresses the larger messages from now on, once the peer has said it can take them */
+      void enable_compression();
       void clear_old_inventory();
       bool is_inventory_advertised_to_us_list_full_for_transactions() const;
       bool is_inventory_advertised_to_us_list_full() const;
+      /** @returns roughly how many bytes the state kept for this peer takes, not counting its connection */
+      size_t get_memory_usage() const;
       bool performing_firewall_check() const;
       fc::optional<fc::ip::endpoint> get_endpoint_for_connecting() const;
     private:
@@ -333,5 +385,3 @@ FC_REFLECT_ENUM(graphene::net::peer_connection::connection_negotiation_status, (
                                                                           (negotiation_complete)
                                                                           (closing)
                                                                           (closed) )
-
-FC_REFLECT( graphene::net::peer_connection::timestamped_item_id, (item)(timestamp));
@@ -26,6 +26,8 @@
 #include <fc/exception/exception.hpp>
 #include <fc/io/raw.hpp>
 
+#include <functional>
+
 namespace graphene { namespace net {
 
   enum potential_peer_last_connection_disposition
@@ -104,6 +106,17 @@ namespace graphene { namespace net {
 
     std::vector<potential_peer_record> get_all()const;
 
+    /**
+     * Returns up to max_candidates peers we could try connecting to now, for which is_candidate returns true.
+     * Peers whose last connection attempt didn't fail come first, then the peers which failed and have waited
+     * out their retry delay of (number_of_failed_connection_attempts + 1) * retry_timeout_seconds, fewest
+     * failures first.  Only the peers returned and the peers skipped by is_candidate are visited.
+     */
+    std::vector<potential_peer_record> get_connection_candidates(fc::time_point_sec now,
+                                                                 uint32_t retry_timeout_seconds,
+                                                                 size_t max_candidates,
+                                                                 const std::function<bool(const potential_peer_record&)>& is_candidate) const;
+
     typedef detail::peer_database_iterator iterator;
     iterator begin() const;
     iterator end() const;
@@ -52,6 +52,7 @@ class stcp_socket : public virtual fc::iostream
     fc::sha512       get_shared_secret() const { return _shared_secret; }
   private:
     void do_key_exchange();
+    void write_buffered_data();
 
     fc::sha512           _shared_secret;
     fc::ecc::private_key _priv_key;
@@ -62,6 +63,7 @@ class stcp_socket : public virtual fc::iostream
     fc::aes_decoder      _recv_aes;
     std::shared_ptr<char> _read_buffer;
     std::shared_ptr<char> _write_buffer;
+    size_t                _write_buffer_used; ///< ciphertext waiting in _write_buffer for a flush
 #ifndef NDEBUG
     bool _read_buffer_in_use;
     bool _write_buffer_in_use;
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+#include <graphene/net/core_messages.hpp>
+
+#include <fc/time.hpp>
+
+#include <vector>
+
+namespace graphene { namespace net {
+
+  /**
+   *  A set of item ids which forgets each one some time after it was inserted.
+   *
+   *  Time is split into buckets, and every item remembers the bucket it was inserted in, so expiring
+   *  the items of a bucket is a matter of moving the oldest bucket kept, without visiting them; an
+   *  expired item's slot is reused by the next insert which lands on it, or dropped when the table is
+   *  rebuilt.  The items are kept in one open-addressed table of fixed-width slots rather than in
+   *  nodes, and the set never holds more than max_size items, so it can't grow past a fixed size
+   *  however fast a peer sends inventory.  When it is full, the oldest buckets are dropped early.
+   */
+  class timestamped_item_set
+  {
+  public:
+    /**
+     *  @param window_seconds how long an item is kept
+     *  @param max_size the most items kept at once
+     */
+    timestamped_item_set(uint32_t window_seconds, uint32_t max_size);
+
+    /// @returns false if the item was already in the set, or there's no room for it
+    bool insert(const item_id& item, fc::time_point_sec now);
+    bool contains(const item_id& item) const;
+    void erase(const item_id& item);
+    /// Forgets the items inserted more than the window before now
+    void expire(fc::time_point_sec now);
+    void clear();
+
+    uint32_t size() const { return _size; }
+    /// @returns the bytes allocated for the set
+    size_t memory_usage() const;
+
+  private:
+    struct slot
+    {
+      item_id  item;
+      /// the bucket the item was inserted in, or one of the values below
+      uint32_t bucket = empty_slot;
+    };
+    static const uint32_t empty_slot = 0;
+    static const uint32_t erased_slot = 1;
+    static const uint32_t number_of_buckets = 8;
+
+    uint32_t bucket_for(fc::time_point_sec time) const;
+    bool is_live(const slot& s) const { return s.bucket >= _oldest_bucket && s.bucket > erased_slot; }
+    static const size_t npos = size_t(-1);
+    /// @returns the index of the slot holding item, or npos
+    size_t find(const item_id& item) const;
+    void drop_buckets_before(uint32_t bucket);
+    /// Moves the live items to a table sized for them
+    void rebuild();
+
+    uint32_t _window_seconds;
+    uint32_t _bucket_seconds;
+    uint32_t _max_size;
+    std::vector<slot> _slots;
+    /// slots which are not empty, whether live, expired or erased
+    uint32_t _used_slots = 0;
+    uint32_t _size = 0;
+    uint32_t _oldest_bucket = erased_slot + 1;
+    uint32_t _newest_bucket = erased_slot + 1;
+    /// number of live items in each bucket from the oldest, by bucket modulo number_of_buckets
+    uint32_t _bucket_sizes[number_of_buckets] = {};
+  };
+
+} } // end namespace graphene::net
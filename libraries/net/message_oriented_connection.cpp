@@ -23,9 +23,13 @@
 #include <fc/io/enum_type.hpp>
 
 #include <graphene/net/message_oriented_connection.hpp>
+#include <graphene/net/core_messages.hpp>
 #include <graphene/net/stcp_socket.hpp>
 #include <graphene/net/config.hpp>
 
+#include <algorithm>
+#include <atomic>
+
 #ifdef DEFAULT_LOGGER
 # undef DEFAULT_LOGGER
 #endif
@@ -33,8 +37,10 @@
 
 #ifndef NDEBUG
 # define VERIFY_CORRECT_THREAD() assert(_thread->is_current())
+# define VERIFY_IO_THREAD() assert(io_thread()->is_current())
 #else
 # define VERIFY_CORRECT_THREAD() do {} while (0)
+# define VERIFY_IO_THREAD() do {} while (0)
 #endif
 
 namespace graphene { namespace net {
@@ -47,8 +53,9 @@ namespace graphene { namespace net {
       message_oriented_connection_delegate *_delegate;
       stcp_socket _sock;
       fc::future<void> _read_loop_done;
-      uint64_t _bytes_received;
-      uint64_t _bytes_sent;
+      std::atomic<uint64_t> _bytes_received;
+      std::atomic<uint64_t> _bytes_sent;
+      size_t _compression_threshold; /// 0 while the peer can't take compressed_messages
 
       fc::time_point _connected_time;
       fc::time_point _last_message_received_time;
@@ -56,12 +63,34 @@ namespace graphene { namespace net {
 
       bool _send_message_in_progress;
 
-#ifndef NDEBUG
+      /// the thread which created the connection; the delegate is always called on it
       fc::thread* _thread;
-#endif
+      /// if set, the thread doing the socket I/O and encryption
+      fc::thread* _io_thread;
+
+      fc::thread* io_thread() const { return _io_thread ? _io_thread : _thread; }
+      /** runs f on the I/O thread, waiting for it to finish */
+      template<typename Functor>
+      void run_on_io_thread(Functor&& f, const char* desc)
+      {
+        if (_io_thread)
+          _io_thread->async(std::forward<Functor>(f), desc).wait();
+        else
+          f();
+      }
+      /** runs f on the connection's thread, waiting for it to finish */
+      template<typename Functor>
+      void run_on_connection_thread(Functor&& f, const char* desc)
+      {
+        if (_io_thread)
+          _thread->async(std::forward<Functor>(f), desc).wait();
+        else
+          f();
+      }
 
       void read_loop();
       void start_read_loop();
+      void write_message(const message& message_to_write, bool compress);
     public:
       fc::tcp_socket& get_socket();
       void accept();
@@ -69,10 +98,12 @@ namespace graphene { namespace net {
       void bind(const fc::ip::endpoint& local_endpoint);
 
       message_oriented_connection_impl(message_oriented_connection* self,
-                                       message_oriented_connection_delegate* delegate = nullptr);
+                                       message_oriented_connection_delegate* delegate = nullptr,
+                                       fc::thread* io_thread = nullptr);
       ~message_oriented_connection_impl();
 
-      void send_message(const message& message_to_send);
+      void send_message(const std::shared_ptr<const message>& message_to_send);
+      void enable_compression(size_t threshold);
       void close_connection();
       void destroy_connection();
 
@@ -86,15 +117,16 @@ namespace graphene { namespace net {
     };
 
     message_oriented_connection_impl::message_oriented_connection_impl(message_oriented_connection* self,
-                                                                       message_oriented_connection_delegate* delegate)
+                                                                       message_oriented_connection_delegate* delegate,
+                                                                       fc::thread* io_thread)
     : _self(self),
       _delegate(delegate),
       _bytes_received(0),
       _bytes_sent(0),
-      _send_message_in_progress(false)
-#ifndef NDEBUG
-      ,_thread(&fc::thread::current())
-#endif
+      _compression_threshold(0),
+      _send_message_in_progress(false),
+      _thread(&fc::thread::current()),
+      _io_thread(io_thread && !io_thread->is_current() ? io_thread : nullptr)
     {
     }
     message_oriented_connection_impl::~message_oriented_connection_impl()
@@ -112,17 +144,23 @@ namespace graphene { namespace net {
     void message_oriented_connection_impl::accept()
     {
       VERIFY_CORRECT_THREAD();
-      _sock.accept();
-      assert(!_read_loop_done.valid()); // check to be sure we never launch two read loops
-      _read_loop_done = fc::async([=](){ read_loop(); }, "message read_loop");
+      run_on_io_thread([this](){ _sock.accept(); }, "key exchange");
+      start_read_loop();
     }
 
     void message_oriented_connection_impl::connect_to(const fc::ip::endpoint& remote_endpoint)
     {
       VERIFY_CORRECT_THREAD();
-      _sock.connect_to(remote_endpoint);
+      run_on_io_thread([this, remote_endpoint](){ _sock.connect_to(remote_endpoint); }, "connect_to");
+      start_read_loop();
+    }
+
+    void message_oriented_connection_impl::start_read_loop()
+    {
+      VERIFY_CORRECT_THREAD();
       assert(!_read_loop_done.valid()); // check to be sure we never launch two read loops
-      _read_loop_done = fc::async([=](){ read_loop(); }, "message read_loop");
+      _connected_time = fc::time_point::now();
+      _read_loop_done = io_thread()->async([=](){ read_loop(); }, "message read_loop");
     }
 
     void message_oriented_connection_impl::bind(const fc::ip::endpoint& local_endpoint)
@@ -134,44 +172,56 @@ namespace graphene { namespace net {
 
     void message_oriented_connection_impl::read_loop()
     {
-      VERIFY_CORRECT_THREAD();
-      const int BUFFER_SIZE = 16;
-      const int LEFTOVER = BUFFER_SIZE - sizeof(message_header);
-      static_assert(BUFFER_SIZE >= sizeof(message_header), "insufficient buffer");
-
-      _connected_time = fc::time_point::now();
+      VERIFY_IO_THREAD();
+      // Messages are padded to 16 bytes and the stream decrypts in 16 byte blocks, so every read ends on a block
+      // that a message ends on or runs past
+      const size_t BUFFER_SIZE = GRAPHENE_NET_READ_BUFFER_SIZE;
+      static_assert(BUFFER_SIZE % 16 == 0 && BUFFER_SIZE >= 16, "the buffer must hold whole blocks");
 
       fc::oexception exception_to_rethrow;
       bool call_on_connection_closed = false;
 
       try
       {
-        message m;
+        // decoded bytes read ahead of the messages framed so far are [buffer_start, buffer_end)
+        std::shared_ptr<char> buffer(new char[BUFFER_SIZE], [](char* p){ delete[] p; });
+        size_t buffer_start = 0;
+        size_t buffer_end = 0;
         while( true )
         {
-          char buffer[BUFFER_SIZE];
-          _sock.read(buffer, BUFFER_SIZE);
-          _bytes_received += BUFFER_SIZE;
-          memcpy((char*)&m, buffer, sizeof(message_header));
+          if (buffer_start == buffer_end)
+          {
+            buffer_start = 0;
+            buffer_end = _sock.readsome(buffer, BUFFER_SIZE, 0);
+            _bytes_received += buffer_end;
+          }
 
-          FC_ASSERT( m.size <= MAX_MESSAGE_SIZE, "", ("m.size",m.size)("MAX_MESSAGE_SIZE",MAX_MESSAGE_SIZE) );
+          std::shared_ptr<message> m = std::make_shared<message>();
+          memcpy((char*)m.get(), buffer.get() + buffer_start, sizeof(message_header));
+          FC_ASSERT( m->size <= MAX_MESSAGE_SIZE, "", ("m.size",m->size)("MAX_MESSAGE_SIZE",MAX_MESSAGE_SIZE) );
 
-          size_t remaining_bytes_with_padding = 16 * ((m.size - LEFTOVER + 15) / 16);
-          m.data.resize(LEFTOVER + remaining_bytes_with_padding); //give extra 16 bytes to allow for padding added in send call
-          std::copy(buffer + sizeof(message_header), buffer + sizeof(buffer), m.data.begin());
-          if (remaining_bytes_with_padding)
+          const size_t size_with_padding = 16 * ((sizeof(message_header) + m->size + 15) / 16);
+          const size_t buffered = std::min(size_with_padding, buffer_end - buffer_start);
+          m->data.resize(size_with_padding - sizeof(message_header));
+          memcpy(m->data.data(), buffer.get() + buffer_start + sizeof(message_header), buffered - sizeof(message_header));
+          buffer_start += buffered;
+          if (buffered < size_with_padding)
           {
-            _sock.read(&m.data[LEFTOVER], remaining_bytes_with_padding);
-            _bytes_received += remaining_bytes_with_padding;
+            // the rest of a message longer than what was read ahead is decrypted straight into it
+            _sock.read(&m->data[buffered - sizeof(message_header)], size_with_padding - buffered);
+            _bytes_received += size_with_padding - buffered;
           }
-          m.data.resize(m.size); // truncate off the padding bytes
-
-          _last_message_received_time = fc::time_point::now();
+          m->data.resize(m->size); // truncate off the padding bytes
+          if (m->msg_type == compressed_message_type)
+            m = std::make_shared<message>(m->as<compressed_message>().decompress());
 
           try
           {
             // message handling errors are warnings...
-            _delegate->on_message(_self, m);
+            run_on_connection_thread([this, m](){
+              _last_message_received_time = fc::time_point::now();
+              _delegate->on_message(_self, *m);
+            }, "deliver message");
           }
           /// Dedicated catches needed to distinguish from general fc::exception
           catch ( const fc::canceled_exception& e ) { throw e; }
@@ -214,13 +264,51 @@ namespace graphene { namespace net {
       }
 
       if (call_on_connection_closed)
-        _delegate->on_connection_closed(_self);
+        run_on_connection_thread([this](){ _delegate->on_connection_closed(_self); }, "connection closed");
 
       if (exception_to_rethrow)
         throw *exception_to_rethrow;
     }
 
-    void message_oriented_connection_impl::send_message(const message& message_to_send)
+    void message_oriented_connection_impl::write_message(const message& message_to_write, bool compress)
+    {
+      VERIFY_IO_THREAD();
+      if (compress)
+      {
+        // a message which doesn't shrink is sent as it is
+        message compressed_message_to_write = compressed_message(message_to_write);
+        if (compressed_message_to_write.size < message_to_write.size)
+        {
+          write_message(compressed_message_to_write, false);
+          return;
+        }
+      }
+
+      // The stream is encrypted in 16 byte blocks.  Only the block holding the header and the padded last block
+      // are staged here, the rest of the body is encrypted straight out of the message, which may be shared
+      char block[16];
+      const size_t head_size = std::min<size_t>(message_to_write.size, sizeof(block) - sizeof(message_header));
+      memset(block, 0, sizeof(block));
+      memcpy(block, (const char*)&message_to_write, sizeof(message_header));
+      memcpy(block + sizeof(message_header), message_to_write.data.data(), head_size);
+      _sock.write(block, sizeof(block));
+
+      const char* rest = message_to_write.data.data() + head_size;
+      const size_t rest_size = message_to_write.size - head_size;
+      const size_t whole_blocks_size = rest_size - rest_size % sizeof(block);
+      if (whole_blocks_size)
+        _sock.write(rest, whole_blocks_size);
+      if (rest_size > whole_blocks_size)
+      {
+        memset(block, 0, sizeof(block));
+        memcpy(block, rest + whole_blocks_size, rest_size - whole_blocks_size);
+        _sock.write(block, sizeof(block));
+      }
+      _sock.flush();
+      _bytes_sent += 16 * ((sizeof(message_header) + message_to_write.size + 15) / 16);
+    }
+
+    void message_oriented_connection_impl::send_message(const std::shared_ptr<const message>& message_to_send)
     {
       VERIFY_CORRECT_THREAD();
 #if 0 // this gets too verbose
@@ -249,25 +337,27 @@ namespace graphene { namespace net {
 
       try
       {
-        size_t size_of_message_and_header = sizeof(message_header) + message_to_send.size;
-        if( message_to_send.size > MAX_MESSAGE_SIZE )
+        if( message_to_send->size > MAX_MESSAGE_SIZE )
            elog("Trying to send a message larger than MAX_MESSAGE_SIZE. This probably won't work...");
-        //pad the message we send to a multiple of 16 bytes
-        size_t size_with_padding = 16 * ((size_of_message_and_header + 15) / 16);
-        std::unique_ptr<char[]> padded_message(new char[size_with_padding]);
-        memcpy(padded_message.get(), (char*)&message_to_send, sizeof(message_header));
-        memcpy(padded_message.get() + sizeof(message_header), message_to_send.data.data(), message_to_send.size );
-        _sock.write(padded_message.get(), size_with_padding);
-        _sock.flush();
-        _bytes_sent += size_with_padding;
+        // compression, like the encryption, runs on the I/O thread
+        const bool compress = _compression_threshold && message_to_send->size >= _compression_threshold &&
+                              message_to_send->msg_type != compressed_message_type;
+        // the message is held by value, as a canceled send may leave the write running after this returns
+        run_on_io_thread([this, message_to_send, compress](){ write_message(*message_to_send, compress); }, "send_message");
         _last_message_sent_time = fc::time_point::now();
       } FC_RETHROW_EXCEPTIONS( warn, "unable to send message" );
     }
 
+    void message_oriented_connection_impl::enable_compression(size_t threshold)
+    {
+      VERIFY_CORRECT_THREAD();
+      _compression_threshold = threshold;
+    }
+
     void message_oriented_connection_impl::close_connection()
     {
       VERIFY_CORRECT_THREAD();
-      _sock.close();
+      run_on_io_thread([this](){ _sock.close(); }, "close_connection");
     }
 
     void message_oriented_connection_impl::destroy_connection()
@@ -331,8 +421,8 @@ namespace graphene { namespace net {
   } // end namespace graphene::net::detail
 
 
-  message_oriented_connection::message_oriented_connection(message_oriented_connection_delegate* delegate) :
-    my(new detail::message_oriented_connection_impl(this, delegate))
+  message_oriented_connection::message_oriented_connection(message_oriented_connection_delegate* delegate, fc::thread* io_thread) :
+    my(new detail::message_oriented_connection_impl(this, delegate, io_thread))
   {
   }
 
@@ -361,10 +451,20 @@ namespace graphene { namespace net {
   }
 
   void message_oriented_connection::send_message(const message& message_to_send)
+  {
+    my->send_message(std::make_shared<const message>(message_to_send));
+  }
+
+  void message_oriented_connection::send_message(const std::shared_ptr<const message>& message_to_send)
   {
     my->send_message(message_to_send);
   }
 
+  void message_oriented_connection::enable_compression(size_t threshold)
+  {
+    my->enable_compression(threshold);
+  }
+
   void message_oriented_connection::close_connection()
   {
     my->close_connection();
@@ -72,6 +72,10 @@
 
 #include <graphene/chain/config.hpp>
 
+#include <graphene/utilities/metrics.hpp>
+#include <graphene/utilities/numa.hpp>
+#include <graphene/utilities/trace_log.hpp>
+
 #include <fc/git_revision.hpp>
 
 //#define ENABLE_DEBUG_ULOGS
@@ -115,6 +119,12 @@ namespace graphene { namespace net {
   namespace detail
   {
     namespace bmi = boost::multi_index;
+    /**
+     * Holds the messages we've broadcast for the last few blocks so we can serve them to peers.  Messages are
+     * found through hashed indices, and filed in one bucket per block so that expiring a block's messages
+     * when a new block is accepted only touches those messages.  The bodies are the shared copies queued to
+     * our peers, and the total of their sizes is capped.
+     */
     class blockchain_tied_message_cache
     {
     private:
@@ -122,12 +132,10 @@ namespace graphene { namespace net {
 
       struct message_hash_index{};
       struct message_contents_hash_index{};
-      struct block_clock_index{};
       struct message_info
       {
         message_hash_type message_hash;
-        message           message_body;
-        uint32_t          block_clock_when_received;
+        std::shared_ptr<const message> message_body; // shared by every peer the message is queued to
 
         // for network performance stats
         message_propagation_data propagation_data;
@@ -135,48 +143,94 @@ namespace graphene { namespace net {
 
         message_info( const message_hash_type& message_hash,
                       const message&           message_body,
-                      uint32_t                 block_clock_when_received,
                       const message_propagation_data& propagation_data,
                       fc::uint160_t            message_contents_hash ) :
           message_hash( message_hash ),
-          message_body( message_body ),
-          block_clock_when_received( block_clock_when_received ),
+          message_body( std::make_shared<const message>( message_body ) ),
           propagation_data( propagation_data ),
           message_contents_hash( message_contents_hash )
         {}
       };
+      struct ripemd160_hasher
+      {
+        size_t operator()( const fc::ripemd160& hash ) const
+        {
+          return fc::city_hash_size_t( hash.data(), hash.data_size() );
+        }
+      };
       typedef boost::multi_index_container
         < message_info,
-            bmi::indexed_by< bmi::ordered_unique< bmi::tag<message_hash_index>,
-                                                  bmi::member<message_info, message_hash_type, &message_info::message_hash> >,
-                             bmi::ordered_non_unique< bmi::tag<message_contents_hash_index>,
-                                                      bmi::member<message_info, fc::uint160_t, &message_info::message_contents_hash> >,
-                             bmi::ordered_non_unique< bmi::tag<block_clock_index>,
-                                                      bmi::member<message_info, uint32_t, &message_info::block_clock_when_received> > >
+            bmi::indexed_by< bmi::hashed_unique< bmi::tag<message_hash_index>,
+                                                 bmi::member<message_info, message_hash_type, &message_info::message_hash>,
+                                                 ripemd160_hasher >,
+                             bmi::hashed_non_unique< bmi::tag<message_contents_hash_index>,
+                                                     bmi::member<message_info, fc::uint160_t, &message_info::message_contents_hash>,
+                                                     ripemd160_hasher > >
         > message_cache_container;
 
       message_cache_container _message_cache;
 
-      uint32_t block_clock;
+      /// the hashes of the messages cached while each of the last few blocks was the newest, oldest block first
+      std::deque<std::deque<message_hash_type> > _messages_by_block;
+
+      size_t   _size_in_bytes;
+      uint64_t _hits;
+      uint64_t _misses;
+      uint64_t _evictions;
+
+      void evict_oldest_message();
 
     public:
       blockchain_tied_message_cache() :
-        block_clock( 0 )
+        _messages_by_block( 1 ),
+        _size_in_bytes( 0 ),
+        _hits( 0 ),
+        _misses( 0 ),
+        _evictions( 0 )
       {}
       void block_accepted();
       void cache_message( const message& message_to_cache, const message_hash_type& hash_of_message_to_cache,
                         const message_propagation_data& propagation_data, const fc::uint160_t& message_content_hash );
-      message get_message( const message_hash_type& hash_of_message_to_lookup );
+      std::shared_ptr<const message> get_message( const message_hash_type& hash_of_message_to_lookup );
       message_propagation_data get_message_propagation_data( const fc::uint160_t& hash_of_message_contents_to_lookup ) const;
+      fc::optional<signed_transaction> find_transaction( const transaction_id_type& transaction_id ) const;
       size_t size() const { return _message_cache.size(); }
+      fc::variant_object get_statistics() const;
     };
 
+    void blockchain_tied_message_cache::evict_oldest_message()
+    {
+      // empty buckets stay, so every block's messages still expire on time
+      auto bucket = std::find_if( _messages_by_block.begin(), _messages_by_block.end(),
+                                  []( const std::deque<message_hash_type>& hashes ){ return !hashes.empty(); } );
+      if( bucket == _messages_by_block.end() )
+        return;
+      auto iter = _message_cache.get<message_hash_index>().find( bucket->front() );
+      bucket->pop_front();
+      if( iter != _message_cache.get<message_hash_index>().end() )
+      {
+        _size_in_bytes -= iter->message_body->data.size();
+        _message_cache.get<message_hash_index>().erase( iter );
+        ++_evictions;
+      }
+    }
+
     void blockchain_tied_message_cache::block_accepted()
     {
-      ++block_clock;
-      if( block_clock > cache_duration_in_blocks )
-        _message_cache.get<block_clock_index>().erase(_message_cache.get<block_clock_index>().begin(),
-                                                      _message_cache.get<block_clock_index>().lower_bound(block_clock - cache_duration_in_blocks ) );
+      _messages_by_block.emplace_back();
+      while( _messages_by_block.size() > cache_duration_in_blocks + 1 )
+      {
+        for( const message_hash_type& expired_message_hash : _messages_by_block.front() )
+        {
+          auto iter = _message_cache.get<message_hash_index>().find( expired_message_hash );
+          if( iter != _message_cache.get<message_hash_index>().end() )
+          {
+            _size_in_bytes -= iter->message_body->data.size();
+            _message_cache.get<message_hash_index>().erase( iter );
+          }
+        }
+        _messages_by_block.pop_front();
+      }
     }
 
     void blockchain_tied_message_cache::cache_message( const message& message_to_cache,
@@ -184,19 +238,27 @@ namespace graphene { namespace net {
                                                      const message_propagation_data& propagation_data,
                                                      const fc::uint160_t& message_content_hash )
     {
-      _message_cache.insert( message_info(hash_of_message_to_cache,
-                                         message_to_cache,
-                                         block_clock,
-                                         propagation_data,
-                                         message_content_hash ) );
+      if( !_message_cache.insert( message_info(hash_of_message_to_cache,
+                                               message_to_cache,
+                                               propagation_data,
+                                               message_content_hash ) ).second )
+        return;
+      _messages_by_block.back().push_back( hash_of_message_to_cache );
+      _size_in_bytes += message_to_cache.data.size();
+      // past the cap, the oldest messages go first, but never the one we just cached
+      while( _size_in_bytes > GRAPHENE_NET_MESSAGE_CACHE_MAX_BYTES && _message_cache.size() > 1 )
+        evict_oldest_message();
     }
 
-    message blockchain_tied_message_cache::get_message( const message_hash_type& hash_of_message_to_lookup )
+    std::shared_ptr<const message> blockchain_tied_message_cache::get_message( const message_hash_type& hash_of_message_to_lookup )
     {
-      message_cache_container::index<message_hash_index>::type::const_iterator iter =
-         _message_cache.get<message_hash_index>().find(hash_of_message_to_lookup );
+      auto iter = _message_cache.get<message_hash_index>().find( hash_of_message_to_lookup );
       if( iter != _message_cache.get<message_hash_index>().end() )
+      {
+        ++_hits;
         return iter->message_body;
+      }
+      ++_misses;
       FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
     }
 
@@ -204,14 +266,33 @@ namespace graphene { namespace net {
     {
       if( hash_of_message_contents_to_lookup != fc::uint160_t() )
       {
-        message_cache_container::index<message_contents_hash_index>::type::const_iterator iter =
-           _message_cache.get<message_contents_hash_index>().find(hash_of_message_contents_to_lookup );
+        auto iter = _message_cache.get<message_contents_hash_index>().find( hash_of_message_contents_to_lookup );
         if( iter != _message_cache.get<message_contents_hash_index>().end() )
           return iter->propagation_data;
       }
       FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
     }
 
+    fc::optional<signed_transaction> blockchain_tied_message_cache::find_transaction( const transaction_id_type& transaction_id ) const
+    {
+      auto range = _message_cache.get<message_contents_hash_index>().equal_range( transaction_id );
+      for( auto iter = range.first; iter != range.second; ++iter )
+        if( iter->message_body->msg_type == trx_message_type )
+          return iter->message_body->as<trx_message>().trx;
+      return fc::optional<signed_transaction>();
+    }
+
+    fc::variant_object blockchain_tied_message_cache::get_statistics() const
+    {
+      fc::mutable_variant_object statistics;
+      statistics["messages"] = _message_cache.size();
+      statistics["bytes"] = _size_in_bytes;
+      statistics["hits"] = _hits;
+      statistics["misses"] = _misses;
+      statistics["evictions_over_size_cap"] = _evictions;
+      return statistics;
+    }
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
     // This specifies configuration info for the local node.  It's stored as JSON
@@ -275,8 +356,14 @@ namespace graphene { namespace net { namespace detail {
                                                                                        boost::accumulators::tag::count> > call_stats_accumulator;
 #define NODE_DELEGATE_METHOD_NAMES (has_item) \
                                    (handle_message) \
+                                   (handle_transaction_batch) \
+                                   (handle_sync_blocks) \
                                    (get_item_ids) \
                                    (get_item) \
+                                   (get_items) \
+                                   (get_state_snapshot_manifest) \
+                                   (get_state_snapshot_chunk) \
+                                   (handle_state_snapshot) \
                                    (get_chain_id) \
                                    (get_blockchain_synopsis) \
                                    (sync_status) \
@@ -290,7 +377,9 @@ namespace graphene { namespace net { namespace detail {
 #define DECLARE_ACCUMULATOR(r, data, method_name) \
       mutable call_stats_accumulator BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _execution_accumulator)); \
       mutable call_stats_accumulator BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _delay_before_accumulator)); \
-      mutable call_stats_accumulator BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _delay_after_accumulator));
+      mutable call_stats_accumulator BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _delay_after_accumulator)); \
+      graphene::utilities::histogram& BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _execution_histogram)); \
+      graphene::utilities::histogram& BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _delay_before_histogram));
       BOOST_PP_SEQ_FOR_EACH(DECLARE_ACCUMULATOR, unused, NODE_DELEGATE_METHOD_NAMES)
 #undef DECLARE_ACCUMULATOR
 
@@ -304,6 +393,8 @@ namespace graphene { namespace net { namespace detail {
         call_stats_accumulator* _execution_accumulator;
         call_stats_accumulator* _delay_before_accumulator;
         call_stats_accumulator* _delay_after_accumulator;
+        graphene::utilities::histogram* _execution_histogram;
+        graphene::utilities::histogram* _delay_before_histogram;
       public:
         class actual_execution_measurement_helper
         {
@@ -322,12 +413,16 @@ namespace graphene { namespace net { namespace detail {
         call_statistics_collector(const char* method_name,
                                   call_stats_accumulator* execution_accumulator,
                                   call_stats_accumulator* delay_before_accumulator,
-                                  call_stats_accumulator* delay_after_accumulator) :
+                                  call_stats_accumulator* delay_after_accumulator,
+                                  graphene::utilities::histogram* execution_histogram,
+                                  graphene::utilities::histogram* delay_before_histogram) :
           _call_requested_time(fc::time_point::now()),
           _method_name(method_name),
           _execution_accumulator(execution_accumulator),
           _delay_before_accumulator(delay_before_accumulator),
-          _delay_after_accumulator(delay_after_accumulator)
+          _delay_after_accumulator(delay_after_accumulator),
+          _execution_histogram(execution_histogram),
+          _delay_before_histogram(delay_before_histogram)
         {}
         ~call_statistics_collector()
         {
@@ -339,6 +434,8 @@ namespace graphene { namespace net { namespace detail {
           (*_execution_accumulator)(actual_execution_time.count());
           (*_delay_before_accumulator)(delay_before.count());
           (*_delay_after_accumulator)(delay_after.count());
+          _execution_histogram->observe(actual_execution_time.count());
+          _delay_before_histogram->observe(delay_before.count());
           if (total_duration > fc::milliseconds(500))
           {
             ilog("Call to method node_delegate::${method} took ${total_duration}us, longer than our target maximum of 500ms",
@@ -360,6 +457,26 @@ namespace graphene { namespace net { namespace detail {
           _execution_completed_time = fc::time_point::now();
         }
       };
+
+      /// transaction messages handed to the delegate thread together, in one task, as they arrive from the peers
+      struct transaction_batch
+      {
+        std::vector<message>           messages;
+        std::vector<fc::exception_ptr> errors;   ///< what handling each message threw, if anything
+        fc::exception_ptr              failure;  ///< set if the batch couldn't be handed off at all
+        fc::promise<void>::ptr         handled;
+
+        transaction_batch() :
+          handled(new fc::promise<void>("graphene::net::transaction_batch_handled"))
+        {}
+      };
+      /// batches waiting for the delegate thread, oldest first; there's one unless transactions are arriving
+      /// faster than the delegate thread handles them
+      std::deque<std::shared_ptr<transaction_batch> > _waiting_transaction_batches;
+      bool _handing_off_transactions;
+
+      bool handle_transaction_in_batch(const message& message_to_handle);
+      void hand_off_transaction_batches();
     public:
       statistics_gathering_node_delegate_wrapper(node_delegate* delegate, fc::thread* thread_for_delegate_calls);
 
@@ -369,11 +486,17 @@ namespace graphene { namespace net { namespace detail {
       bool handle_message( const message&, bool sync_mode ) override;
       bool handle_block( const graphene::net::block_message& blk_msg, bool syncmode ) override;
       bool handle_transaction( const graphene::net::trx_message& trx_msg, bool syncmode ) override;
+      bool admit_transaction_on_any_thread( const graphene::net::trx_message& trx_msg, std::string& reason ) override;
+      uint32_t handle_sync_blocks( const std::vector<block_message>& blocks ) override;
       std::vector<item_hash_t> get_item_ids(uint32_t item_type,
                                             const std::vector<item_hash_t>& blockchain_synopsis,
                                             uint32_t& remaining_item_count,
                                             uint32_t limit = 2000) override;
       message get_item( const item_id& id ) override;
+      std::vector<fc::optional<message> > get_items( const std::vector<item_id>& ids ) override;
+      state_snapshot_manifest_message get_state_snapshot_manifest() override;
+      std::vector<char> get_state_snapshot_chunk( const block_id_type& block_id, uint32_t chunk_index ) override;
+      void handle_state_snapshot( const state_snapshot_manifest_message& manifest, const std::vector<char>& snapshot ) override;
       fc::sha256 get_chain_id() const override;
       std::vector<item_hash_t> get_blockchain_synopsis(uint32_t item_type,
                                                        const graphene::net::item_hash_t& reference_point = graphene::net::item_hash_t(),
@@ -396,6 +519,10 @@ namespace graphene { namespace net { namespace detail {
 #ifdef P2P_IN_DEDICATED_THREAD
       std::shared_ptr<fc::thread> _thread;
 #endif // P2P_IN_DEDICATED_THREAD
+      /// threads doing the socket I/O and encryption of the peer connections, handed out in turn.  Declared before
+      /// the connections so they outlive them
+      std::vector<std::shared_ptr<fc::thread> > _io_threads;
+      size_t                                    _next_io_thread = 0;
       std::unique_ptr<statistics_gathering_node_delegate_wrapper> _delegate;
       fc::sha256           _chain_id;
 
@@ -441,6 +568,17 @@ namespace graphene { namespace net { namespace detail {
       fc::future<void> _process_backlog_of_sync_blocks_done;
       bool _suspend_fetching_sync_blocks;
 
+      /// used while bootstrapping the state from a snapshot our peers serve, before syncing the blocks after it
+      // @{
+      bool                     _bootstrapping_state; /// syncing is held off until the delegate has accepted a snapshot
+      uint32_t                 _min_state_snapshot_attestations; /// how many peers must serve a snapshot before it is downloaded
+      fc::optional<state_snapshot_manifest_message> _state_snapshot_manifest; /// the snapshot being downloaded
+      std::vector<std::vector<char> > _state_snapshot_chunks; /// the chunks of it received so far, the others are empty
+      uint32_t                 _state_snapshot_chunks_missing;
+      std::deque<uint32_t>     _state_snapshot_chunks_to_request; /// chunks which no peer has been asked for
+      std::set<block_id_type>  _rejected_state_snapshots; /// snapshots the delegate didn't accept, by the block they're of
+      // @}
+
       /// used by the task that fetches items during normal operation
       // @{
       fc::promise<void>::ptr _retrigger_fetch_item_loop_promise;
@@ -461,6 +599,8 @@ namespace graphene { namespace net { namespace detail {
       fc::promise<void>::ptr        _retrigger_advertise_inventory_loop_promise;
       fc::future<void>              _advertise_inventory_loop_done;
       std::unordered_set<item_id>   _new_inventory; /// list of items we have received but not yet advertised to our peers
+      std::unordered_set<item_id>   _transactions_waiting_to_be_advertised; /// new transactions held back until _next_transaction_advertise_time
+      fc::time_point                _next_transaction_advertise_time;
       // @}
 
       fc::future<void>     _terminate_inactive_connections_loop_done;
@@ -511,7 +651,10 @@ namespace graphene { namespace net { namespace detail {
 
       blockchain_tied_message_cache _message_cache; /// cache message we have received and might be required to provide to other peers via inventory requests
 
-      fc::rate_limiting_group _rate_limiter;
+      fc::rate_limiting_group _rate_limiter; /// shapes the peers in sync with us, and all peers until they're found to be syncing
+      fc::rate_limiting_group _sync_rate_limiter; /// shapes the peers syncing from us, so they can't crowd out block relay
+      uint32_t _total_upload_limit;
+      uint32_t _total_download_limit;
 
       uint32_t _last_reported_number_of_connections; // number of connections last reported to the client (to avoid sending duplicate messages)
 
@@ -559,6 +702,20 @@ namespace graphene { namespace net { namespace detail {
       unsigned _maximum_blocks_per_peer_during_syncing;
 
       std::list<fc::future<void> > _handle_message_calls_in_progress;
+      /// Sync blocks handed to the delegate in the calls of _handle_message_calls_in_progress
+      unsigned _number_of_sync_blocks_in_progress;
+
+      struct traced_block
+      {
+        message_hash_type message_hash;
+        mutable block_propagation_trace trace;
+      };
+      typedef boost::multi_index_container<traced_block,
+                                           boost::multi_index::indexed_by<boost::multi_index::sequenced<>,
+                                                                          boost::multi_index::hashed_unique<boost::multi_index::member<traced_block, message_hash_type, &traced_block::message_hash>,
+                                                                                                            std::hash<message_hash_type> > > > block_trace_container;
+      block_trace_container _block_propagation_traces; /// the traces of the most recent blocks, by the hash of their block_message, in the order they were first seen
+      bool _log_block_propagation_traces; /// log each trace once its block is first relayed, so traces can be collected from the logs
 
       node_impl(const std::string& user_agent);
       virtual ~node_impl();
@@ -571,6 +728,8 @@ namespace graphene { namespace net { namespace detail {
       bool have_already_received_sync_item( const item_hash_t& item_hash );
       void request_sync_item_from_peer( const peer_connection_ptr& peer, const item_hash_t& item_to_request );
       void request_sync_items_from_peer( const peer_connection_ptr& peer, const std::vector<item_hash_t>& items_to_request );
+      bool can_request_sync_items_from_peer( const peer_connection_ptr& peer );
+      void adjust_sync_window( peer_connection* peer, fc::microseconds block_latency );
       void fetch_sync_items_loop();
       void trigger_fetch_sync_items_loop();
 
@@ -659,9 +818,43 @@ namespace graphene { namespace net { namespace detail {
       void on_get_current_connections_reply_message(peer_connection* originating_peer,
                                                     const get_current_connections_reply_message& get_current_connections_reply_message_received);
 
+      void on_compact_block_message(peer_connection* originating_peer,
+                                    const compact_block_message& compact_block_message_received);
+
+      void on_fetch_compact_block_transactions_message(peer_connection* originating_peer,
+                                                       const fetch_compact_block_transactions_message& fetch_compact_block_transactions_message_received);
+
+      void on_compact_block_transactions_message(peer_connection* originating_peer,
+                                                 const compact_block_transactions_message& compact_block_transactions_message_received);
+
+      void rebuild_compact_block(peer_connection* originating_peer,
+                                 const compact_block_message& compact_block,
+                                 const std::vector<fc::optional<signed_transaction> >& transactions);
+
+      void on_fetch_state_snapshot_manifest_message(peer_connection* originating_peer,
+                                                    const fetch_state_snapshot_manifest_message& fetch_state_snapshot_manifest_message_received);
+
+      void on_state_snapshot_manifest_message(peer_connection* originating_peer,
+                                              const state_snapshot_manifest_message& state_snapshot_manifest_message_received);
+
+      void on_fetch_state_snapshot_chunk_message(peer_connection* originating_peer,
+                                                 const fetch_state_snapshot_chunk_message& fetch_state_snapshot_chunk_message_received);
+
+      void on_state_snapshot_chunk_message(peer_connection* originating_peer,
+                                           const state_snapshot_chunk_message& state_snapshot_chunk_message_received);
+
+      void choose_state_snapshot();
+      void request_state_snapshot_chunks(peer_connection* peer);
+      void stop_fetching_state_snapshot_from_peer(peer_connection* peer);
+      void finish_state_snapshot();
+
       void on_connection_closed(peer_connection* originating_peer) override;
+      fc::thread* get_io_thread() override;
 
       void send_sync_block_to_node_delegate(const graphene::net::block_message& block_message_to_send);
+      void send_sync_blocks_to_node_delegate(const std::vector<graphene::net::block_message>& blocks_to_send);
+      void process_sync_block_result(const graphene::net::block_message& block_message_sent, bool client_accepted_block,
+                                     bool discontinue_fetching_blocks_from_peer, const fc::oexception& handle_message_exception);
       void process_backlog_of_sync_blocks();
       void trigger_process_backlog_of_sync_blocks();
       void process_block_during_sync(peer_connection* originating_peer, const graphene::net::block_message& block_message, const message_hash_type& message_hash);
@@ -669,6 +862,7 @@ namespace graphene { namespace net { namespace detail {
       void process_block_message(peer_connection* originating_peer, const message& message_to_process, const message_hash_type& message_hash);
 
       void process_ordinary_message(peer_connection* originating_peer, const message& message_to_process, const message_hash_type& message_hash);
+      bool admit_transaction(peer_connection* originating_peer, const message& message_to_process);
 
       void start_synchronizing();
       void start_synchronizing_with_peer(const peer_connection_ptr& peer);
@@ -718,6 +912,7 @@ namespace graphene { namespace net { namespace detail {
       void broadcast(const message& item_to_broadcast, const message_propagation_data& propagation_data);
       void broadcast(const message& item_to_broadcast);
       void sync_from(const item_id& current_head_block, const std::vector<uint32_t>& hard_fork_block_numbers);
+      void bootstrap_state_from_peers(uint32_t min_attesting_peers);
       bool is_connected() const;
       std::vector<potential_peer_record> get_potential_peers() const;
       void set_advanced_node_parameters( const fc::variant_object& params );
@@ -725,17 +920,26 @@ namespace graphene { namespace net { namespace detail {
       fc::variant_object         get_advanced_node_parameters();
       message_propagation_data   get_transaction_propagation_data( const graphene::net::transaction_id_type& transaction_id );
       message_propagation_data   get_block_propagation_data( const graphene::net::block_id_type& block_id );
+      /// @returns the trace of the block in the block_message with message_hash, started now if there was none
+      block_propagation_trace&   trace_block( const message_hash_type& message_hash );
+      void                       note_block_relayed( const message_hash_type& message_hash, fc::time_point relay_time );
+      std::vector<block_propagation_trace> get_block_propagation_traces() const;
 
       node_id_t                  get_node_id() const;
       void                       set_allowed_peers( const std::vector<node_id_t>& allowed_peers );
       void                       clear_peer_database();
       void                       set_total_bandwidth_limit( uint32_t upload_bytes_per_second, uint32_t download_bytes_per_second );
+      bool                       bind_to_numa_node( uint32_t numa_node );
+      void                       set_io_threads( const std::vector<std::shared_ptr<fc::thread> >& io_threads );
       void                       disable_peer_advertising();
       fc::variant_object         get_call_statistics() const;
-      message                    get_message_for_item(const item_id& item) override;
+      std::shared_ptr<const message> get_message_for_item(const item_id& item) override;
+      std::shared_ptr<const message> get_message_for_items(const std::vector<item_id>& items, size_t& next_item) override;
 
       fc::variant_object         network_get_info() const;
       fc::variant_object         network_get_usage_stats() const;
+      fc::variant_object         get_upload_rates() const;
+      void                       schedule_uploads(uint32_t seconds_since_last_update);
 
       bool is_hard_fork_block(uint32_t block_number) const;
       uint32_t get_next_known_hard_fork_block_number(uint32_t block_number) const;
@@ -782,6 +986,9 @@ namespace graphene { namespace net { namespace detail {
       _potential_peer_database_updated(false),
       _sync_items_to_fetch_updated(false),
       _suspend_fetching_sync_blocks(false),
+      _bootstrapping_state(false),
+      _min_state_snapshot_attestations(1),
+      _state_snapshot_chunks_missing(0),
       _items_to_fetch_updated(false),
       _items_to_fetch_sequence_counter(0),
       _user_agent_string(user_agent),
@@ -792,6 +999,9 @@ namespace graphene { namespace net { namespace detail {
       _most_recent_blocks_accepted(_maximum_number_of_connections),
       _total_number_of_unfetched_items(0),
       _rate_limiter(0, 0),
+      _sync_rate_limiter(0, 0),
+      _total_upload_limit(0),
+      _total_download_limit(0),
       _last_reported_number_of_connections(0),
       _peer_advertising_disabled(false),
       _average_network_read_speed_seconds(60),
@@ -805,10 +1015,15 @@ namespace graphene { namespace net { namespace detail {
       _node_is_shutting_down(false),
       _maximum_number_of_blocks_to_handle_at_one_time(MAXIMUM_NUMBER_OF_BLOCKS_TO_HANDLE_AT_ONE_TIME),
       _maximum_number_of_sync_blocks_to_prefetch(MAXIMUM_NUMBER_OF_BLOCKS_TO_PREFETCH),
-      _maximum_blocks_per_peer_during_syncing(GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING)
+      _maximum_blocks_per_peer_during_syncing(GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING),
+      _number_of_sync_blocks_in_progress(0),
+      _log_block_propagation_traces(false)
     {
       _rate_limiter.set_actual_rate_time_constant(fc::seconds(2));
+      _sync_rate_limiter.set_actual_rate_time_constant(fc::seconds(2));
       fc::rand_pseudo_bytes(&_node_id.data[0], (int)_node_id.size());
+      for (unsigned i = 0; i < GRAPHENE_NET_DEFAULT_IO_THREADS; ++i)
+        _io_threads.push_back(std::make_shared<fc::thread>("p2p io " + std::to_string(i)));
     }
 
     node_impl::~node_impl()
@@ -901,21 +1116,19 @@ namespace graphene { namespace net { namespace detail {
             bool initiated_connection_this_pass = false;
             _potential_peer_database_updated = false;
 
-            for (peer_database::iterator iter = _potential_peer_db.begin();
-                 iter != _potential_peer_db.end() && is_wanting_new_connections();
-                 ++iter)
+            // connecting updates the peer database, so take the candidates out of it before connecting to any
+            std::vector<potential_peer_record> candidates =
+              _potential_peer_db.get_connection_candidates(fc::time_point::now(), _peer_connection_retry_timeout,
+                                                           _desired_number_of_connections - get_number_of_connections(),
+                                                           [this](const potential_peer_record& record) {
+                                                             return !is_connection_to_endpoint_in_progress(record.endpoint);
+                                                           });
+            for (const potential_peer_record& candidate : candidates)
             {
-              fc::microseconds delay_until_retry = fc::seconds((iter->number_of_failed_connection_attempts + 1) * _peer_connection_retry_timeout);
-
-              if (!is_connection_to_endpoint_in_progress(iter->endpoint) &&
-                  ((iter->last_connection_disposition != last_connection_failed &&
-                    iter->last_connection_disposition != last_connection_rejected &&
-                    iter->last_connection_disposition != last_connection_handshaking_failed) ||
-                   (fc::time_point::now() - iter->last_connection_attempt_time) > delay_until_retry))
-              {
-                connect_to_endpoint(iter->endpoint);
-                initiated_connection_this_pass = true;
-              }
+              if (!is_wanting_new_connections())
+                break;
+              connect_to_endpoint(candidate.endpoint);
+              initiated_connection_this_pass = true;
             }
 
             if (!initiated_connection_this_pass && !_potential_peer_database_updated)
@@ -983,7 +1196,7 @@ namespace graphene { namespace net { namespace detail {
     void node_impl::request_sync_item_from_peer( const peer_connection_ptr& peer, const item_hash_t& item_to_request )
     {
       VERIFY_CORRECT_THREAD();
-      dlog( "requesting item ${item_hash} from peer ${endpoint}", ("item_hash", item_to_request )("endpoint", peer->get_remote_endpoint() ) );
+      tlog( "requesting item ${item_hash} from peer ${endpoint}", ("item_hash", item_to_request )("endpoint", peer->get_remote_endpoint() ) );
       item_id item_id_to_request( graphene::net::block_message_type, item_to_request );
       _active_sync_requests.insert( active_sync_requests_map::value_type(item_to_request, fc::time_point::now() ) );
       peer->sync_items_requested_from_peer.insert( peer_connection::item_to_time_map_type::value_type(item_id_to_request, fc::time_point::now() ) );
@@ -994,7 +1207,7 @@ namespace graphene { namespace net { namespace detail {
     void node_impl::request_sync_items_from_peer( const peer_connection_ptr& peer, const std::vector<item_hash_t>& items_to_request )
     {
       VERIFY_CORRECT_THREAD();
-      dlog( "requesting ${item_count} item(s) ${items_to_request} from peer ${endpoint}",
+      tlog( "requesting ${item_count} item(s) ${items_to_request} from peer ${endpoint}",
             ("item_count", items_to_request.size())("items_to_request", items_to_request)("endpoint", peer->get_remote_endpoint()) );
       for (const item_hash_t& item_to_request : items_to_request)
       {
@@ -1005,13 +1218,37 @@ namespace graphene { namespace net { namespace detail {
       peer->send_message(fetch_items_message(graphene::net::block_message_type, items_to_request));
     }
 
+    bool node_impl::can_request_sync_items_from_peer( const peer_connection_ptr& peer )
+    {
+      VERIFY_CORRECT_THREAD();
+      if( !peer->sync_window )
+        peer->sync_window = std::max<uint32_t>( std::min<uint32_t>( _maximum_blocks_per_peer_during_syncing, GRAPHENE_NET_MAX_SYNC_WINDOW_BLOCKS ), 1 );
+      // top the window up once half of it has arrived, rather than waiting for the peer to go idle, so the
+      // next requests are already on their way when the last ones land
+      return peer->items_requested_from_peer.empty() && !peer->item_ids_requested_from_peer &&
+             peer->sync_items_requested_from_peer.size() <= peer->sync_window / 2;
+    }
+
+    void node_impl::adjust_sync_window( peer_connection* peer, fc::microseconds block_latency )
+    {
+      VERIFY_CORRECT_THREAD();
+      if( !peer->sync_window )
+        return; // requested outside of the sync window
+      // the last block of a window waits behind all the others, so holding the latency near the target
+      // sizes the window to what the peer can deliver in that time
+      if( block_latency < fc::milliseconds( GRAPHENE_NET_SYNC_WINDOW_TARGET_LATENCY_MS / 2 ) )
+        peer->sync_window = std::min<uint32_t>( peer->sync_window + 1, GRAPHENE_NET_MAX_SYNC_WINDOW_BLOCKS );
+      else if( block_latency > fc::milliseconds( GRAPHENE_NET_SYNC_WINDOW_TARGET_LATENCY_MS ) )
+        peer->sync_window = std::max<uint32_t>( peer->sync_window - 1, GRAPHENE_NET_MIN_SYNC_WINDOW_BLOCKS );
+    }
+
     void node_impl::fetch_sync_items_loop()
     {
       VERIFY_CORRECT_THREAD();
       while( !_fetch_sync_items_loop_done.canceled() )
       {
         _sync_items_to_fetch_updated = false;
-        dlog( "beginning another iteration of the sync items loop" );
+        tlog( "beginning another iteration of the sync items loop" );
 
         if (!_suspend_fetching_sync_blocks)
         {
@@ -1021,12 +1258,14 @@ namespace graphene { namespace net { namespace detail {
             ASSERT_TASK_NOT_PREEMPTED();
             std::set<item_hash_t> sync_items_to_request;
 
-            // for each idle peer that we're syncing with
+            // for each peer that we're syncing with which has room in its window.  Each peer is handed the
+            // earliest blocks it has that no other peer has been asked for, so the blocks are striped
+            // across all of the peers in proportion to their windows
             for( const peer_connection_ptr& peer : _active_connections )
             {
               if( peer->we_need_sync_items_from_peer &&
                   sync_item_requests_to_send.find(peer) == sync_item_requests_to_send.end() && // if we've already scheduled a request for this peer, don't consider scheduling another
-                  peer->idle() )
+                  can_request_sync_items_from_peer(peer) )
               {
                 if (!peer->inhibit_fetching_sync_blocks)
                 {
@@ -1042,7 +1281,7 @@ namespace graphene { namespace net { namespace detail {
                       // then schedule a request from this peer
                       sync_item_requests_to_send[peer].push_back(item_to_potentially_request);
                       sync_items_to_request.insert( item_to_potentially_request );
-                      if (sync_item_requests_to_send[peer].size() >= _maximum_blocks_per_peer_during_syncing)
+                      if (sync_item_requests_to_send[peer].size() + peer->sync_items_requested_from_peer.size() >= peer->sync_window)
                         break;
                     }
                   }
@@ -1061,7 +1300,7 @@ namespace graphene { namespace net { namespace detail {
 
         if( !_sync_items_to_fetch_updated )
         {
-          dlog( "no sync items to fetch right now, going to sleep" );
+          tlog( "no sync items to fetch right now, going to sleep" );
           _retrigger_fetch_sync_items_loop_promise = fc::promise<void>::ptr( new fc::promise<void>("graphene::net::retrigger_fetch_sync_items_loop") );
           _retrigger_fetch_sync_items_loop_promise->wait();
           _retrigger_fetch_sync_items_loop_promise.reset();
@@ -1082,7 +1321,7 @@ namespace graphene { namespace net { namespace detail {
     {
       for( const peer_connection_ptr& peer : _active_connections )
       {
-        if (peer->inventory_peer_advertised_to_us.find(item) != peer->inventory_peer_advertised_to_us.end() )
+        if (peer->inventory_peer_advertised_to_us.contains(item) )
           return true;
       }
       return false;
@@ -1094,32 +1333,37 @@ namespace graphene { namespace net { namespace detail {
       while (!_fetch_item_loop_done.canceled())
       {
         _items_to_fetch_updated = false;
-        dlog("beginning an iteration of fetch items (${count} items to fetch)",
+        tlog("beginning an iteration of fetch items (${count} items to fetch)",
              ("count", _items_to_fetch.size()));
 
         fc::time_point next_peer_unblocked_time = fc::time_point::maximum();
 
-        std::forward_list<std::pair<peer_connection_ptr, item_id> > fetch_messages_to_send;
-        std::vector<fc::future<void> >  write_ops;
+        // an idle peer is asked for one block, or for up to a batch of the transactions it has advertised
+        std::map<peer_connection_ptr, std::vector<item_id> > fetch_messages_to_send;
         for (auto iter = _items_to_fetch.begin(); iter != _items_to_fetch.end();)
         {
           bool item_fetched = false;
           for (const peer_connection_ptr& peer : _active_connections)
           {
-            if (peer->idle() &&
-                peer->inventory_peer_advertised_to_us.find(iter->item) != peer->inventory_peer_advertised_to_us.end())
+            auto items_for_peer = fetch_messages_to_send.find(peer);
+            bool peer_can_take_item = items_for_peer == fetch_messages_to_send.end() ?
+                                      peer->idle() :
+                                      iter->item.item_type == graphene::net::trx_message_type &&
+                                      items_for_peer->second.front().item_type == graphene::net::trx_message_type &&
+                                      items_for_peer->second.size() < GRAPHENE_NET_MAX_ITEMS_PER_BATCH;
+            if (peer_can_take_item &&
+                peer->inventory_peer_advertised_to_us.contains(iter->item))
             {
               if (peer->is_transaction_fetching_inhibited() && iter->item.item_type == graphene::net::trx_message_type)
                 next_peer_unblocked_time = std::min(peer->transaction_fetching_inhibited_until, next_peer_unblocked_time);
               else
               {
-                dlog("requesting item ${hash} from peer ${endpoint}",
+                tlog("requesting item ${hash} from peer ${endpoint}",
                      ("hash", iter->item.item_hash)("endpoint", peer->get_remote_endpoint()));
                 peer->items_requested_from_peer.insert(peer_connection::item_to_time_map_type::value_type(iter->item, fc::time_point::now()));
-                item_id item_id_to_fetch = iter->item;
+                fetch_messages_to_send[peer].push_back(iter->item);
                 iter = _items_to_fetch.erase(iter);
                 item_fetched = true;
-                fetch_messages_to_send.emplace_front(std::make_pair(peer, item_id_to_fetch));
                 break;
               }
             }
@@ -1128,9 +1372,19 @@ namespace graphene { namespace net { namespace detail {
             ++iter;
         }
 
-        for (const auto& peer_and_item : fetch_messages_to_send)
-          peer_and_item.first->send_message(fetch_items_message(peer_and_item.second.item_type,
-                                                                std::vector<item_hash_t>{peer_and_item.second.item_hash}));
+        for (const auto& peer_and_items : fetch_messages_to_send)
+        {
+          // peers which can serve compact blocks send us the block's transaction ids instead of the transactions,
+          // which we have almost always received already
+          uint32_t item_type_to_fetch = peer_and_items.second.front().item_type;
+          if (item_type_to_fetch == graphene::net::block_message_type && peer_and_items.first->supports_compact_blocks)
+            item_type_to_fetch = graphene::net::compact_block_message_type;
+          std::vector<item_hash_t> hashes_to_fetch;
+          hashes_to_fetch.reserve(peer_and_items.second.size());
+          for (const item_id& item_to_fetch : peer_and_items.second)
+            hashes_to_fetch.push_back(item_to_fetch.item_hash);
+          peer_and_items.first->send_message(fetch_items_message(item_type_to_fetch, hashes_to_fetch));
+        }
         fetch_messages_to_send.clear();
 
         if (!_items_to_fetch_updated)
@@ -1166,52 +1420,83 @@ namespace graphene { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       while (!_advertise_inventory_loop_done.canceled())
       {
-        dlog("beginning an iteration of advertise inventory");
+        tlog("beginning an iteration of advertise inventory");
         // swap inventory into local variable, clearing the node's copy
         std::unordered_set<item_id> inventory_to_advertise;
         inventory_to_advertise.swap(_new_inventory);
 
+        // blocks go out at once, transactions are gathered for up to an interval and go out together
+        for (auto iter = inventory_to_advertise.begin(); iter != inventory_to_advertise.end();)
+          if (iter->item_type == trx_message_type)
+          {
+            _transactions_waiting_to_be_advertised.insert(*iter);
+            iter = inventory_to_advertise.erase(iter);
+          }
+          else
+            ++iter;
+        if (!_transactions_waiting_to_be_advertised.empty() && fc::time_point::now() >= _next_transaction_advertise_time)
+        {
+          inventory_to_advertise.insert(_transactions_waiting_to_be_advertised.begin(), _transactions_waiting_to_be_advertised.end());
+          _transactions_waiting_to_be_advertised.clear();
+          _next_transaction_advertise_time = fc::time_point::now() + fc::milliseconds(GRAPHENE_NET_TRANSACTION_ADVERTISE_INTERVAL_MS);
+        }
+
+        // group the items by type, because we'll need to send one inventory message per type
+        std::map<uint32_t, std::vector<item_hash_t> > new_items_by_type;
+        for (const item_id& item_to_advertise : inventory_to_advertise)
+          new_items_by_type[item_to_advertise.item_type].push_back(item_to_advertise.item_hash);
+
+        // nearly every peer gets every new item, so each type's full inventory message is serialized once and
+        // shared.  Only a peer which already knows some of the items gets a message of its own
+        std::map<uint32_t, std::shared_ptr<const message> > full_inventory_messages;
+        for (const auto& items_group : new_items_by_type)
+          full_inventory_messages[items_group.first] =
+            std::make_shared<const message>(item_ids_inventory_message(items_group.first, items_group.second));
+
         // process all inventory to advertise and construct the inventory messages we'll send
         // first, then send them all in a batch (to avoid any fiber interruption points while
         // we're computing the messages)
-        std::list<std::pair<peer_connection_ptr, item_ids_inventory_message> > inventory_messages_to_send;
+        std::list<std::pair<peer_connection_ptr, std::shared_ptr<const message> > > inventory_messages_to_send;
+        const fc::time_point advertise_time = fc::time_point::now();
 
         for (const peer_connection_ptr& peer : _active_connections)
         {
           // only advertise to peers who are in sync with us
-           wdump((peer->peer_needs_sync_items_from_us));
           if( !peer->peer_needs_sync_items_from_us )
           {
-            std::map<uint32_t, std::vector<item_hash_t> > items_to_advertise_by_type;
-            // don't send the peer anything we've already advertised to it
-            // or anything it has advertised to us
-            // group the items we need to send by type, because we'll need to send one inventory message per type
             unsigned total_items_to_send_to_this_peer = 0;
-            wdump((inventory_to_advertise));
-            for (const item_id& item_to_advertise : inventory_to_advertise)
+            for (const auto& items_group : new_items_by_type)
             {
-              if (peer->inventory_advertised_to_peer.find(item_to_advertise) == peer->inventory_advertised_to_peer.end() )
-                 wdump((*peer->inventory_advertised_to_peer.find(item_to_advertise)));
-              if (peer->inventory_peer_advertised_to_us.find(item_to_advertise) == peer->inventory_peer_advertised_to_us.end() )
-                 wdump((*peer->inventory_peer_advertised_to_us.find(item_to_advertise)));
-
-              if (peer->inventory_advertised_to_peer.find(item_to_advertise) == peer->inventory_advertised_to_peer.end() &&
-                  peer->inventory_peer_advertised_to_us.find(item_to_advertise) == peer->inventory_peer_advertised_to_us.end())
+              // don't send the peer anything we've already advertised to it
+              // or anything it has advertised to us
+              std::vector<item_hash_t> items_for_this_peer;
+              items_for_this_peer.reserve(items_group.second.size());
+              for (const item_hash_t& item_hash : items_group.second)
               {
-                items_to_advertise_by_type[item_to_advertise.item_type].push_back(item_to_advertise.item_hash);
-                peer->inventory_advertised_to_peer.insert(peer_connection::timestamped_item_id(item_to_advertise, fc::time_point::now()));
-                ++total_items_to_send_to_this_peer;
-                if (item_to_advertise.item_type == trx_message_type)
-                  testnetlog("advertising transaction ${id} to peer ${endpoint}", ("id", item_to_advertise.item_hash)("endpoint", peer->get_remote_endpoint()));
-                dlog("advertising item ${id} to peer ${endpoint}", ("id", item_to_advertise.item_hash)("endpoint", peer->get_remote_endpoint()));
+                item_id item_to_advertise(items_group.first, item_hash);
+                if (!peer->inventory_advertised_to_peer.contains(item_to_advertise) &&
+                    !peer->inventory_peer_advertised_to_us.contains(item_to_advertise))
+                {
+                  items_for_this_peer.push_back(item_hash);
+                  peer->inventory_advertised_to_peer.insert(item_to_advertise, advertise_time);
+                  if (item_to_advertise.item_type == block_message_type)
+                    note_block_relayed(item_to_advertise.item_hash, advertise_time);
+                  if (item_to_advertise.item_type == trx_message_type)
+                    testnetlog("advertising transaction ${id} to peer ${endpoint}", ("id", item_to_advertise.item_hash)("endpoint", peer->get_remote_endpoint()));
+                }
               }
+              if (items_for_this_peer.empty())
+                continue;
+              total_items_to_send_to_this_peer += items_for_this_peer.size();
+              if (items_for_this_peer.size() == items_group.second.size())
+                inventory_messages_to_send.emplace_back(peer, full_inventory_messages[items_group.first]);
+              else
+                inventory_messages_to_send.emplace_back(peer, std::make_shared<const message>(item_ids_inventory_message(items_group.first,
+                                                                                                                             items_for_this_peer)));
             }
-              dlog("advertising ${count} new item(s) of ${types} type(s) to peer ${endpoint}",
-                   ("count", total_items_to_send_to_this_peer)
-                   ("types", items_to_advertise_by_type.size())
-                   ("endpoint", peer->get_remote_endpoint()));
-            for (auto items_group : items_to_advertise_by_type)
-              inventory_messages_to_send.push_back(std::make_pair(peer, item_ids_inventory_message(items_group.first, items_group.second)));
+            if (total_items_to_send_to_this_peer)
+              tlog("advertising ${count} new item(s) to peer ${endpoint}",
+                   ("count", total_items_to_send_to_this_peer)("endpoint", peer->get_remote_endpoint()));
           }
           peer->clear_old_inventory();
         }
@@ -1223,7 +1508,17 @@ namespace graphene { namespace net { namespace detail {
         if (_new_inventory.empty())
         {
           _retrigger_advertise_inventory_loop_promise = fc::promise<void>::ptr(new fc::promise<void>("graphene::net::retrigger_advertise_inventory_loop"));
-          _retrigger_advertise_inventory_loop_promise->wait();
+          fc::microseconds time_until_retrigger = fc::microseconds::maximum();
+          if (!_transactions_waiting_to_be_advertised.empty())
+            time_until_retrigger = _next_transaction_advertise_time - fc::time_point::now();
+          try
+          {
+            if (time_until_retrigger > fc::microseconds(0))
+              _retrigger_advertise_inventory_loop_promise->wait(time_until_retrigger);
+          }
+          catch (const fc::timeout_exception&)
+          {
+          }
           _retrigger_advertise_inventory_loop_promise.reset();
         }
       } // while(!canceled)
@@ -1320,6 +1615,15 @@ namespace graphene { namespace net { namespace detail {
                 disconnect_due_to_request_timeout = true;
                 break;
               }
+          if (!disconnect_due_to_request_timeout)
+            for (const auto& chunk_and_time : active_peer->state_snapshot_chunks_requested_from_peer)
+              if (chunk_and_time.second < active_ignored_request_threshold)
+              {
+                wlog("Disconnecting peer ${peer} because they didn't respond to my request for chunk ${index} of the state snapshot",
+                      ("peer", active_peer->get_remote_endpoint())("index", chunk_and_time.first));
+                disconnect_due_to_request_timeout = true;
+                break;
+              }
           if (disconnect_due_to_request_timeout)
           {
             // we should probably disconnect nicely and give them a reason, but right now the logic
@@ -1454,19 +1758,79 @@ namespace graphene { namespace net { namespace detail {
 
       uint32_t seconds_since_last_update = current_time.sec_since_epoch() - _bandwidth_monitor_last_update_time.sec_since_epoch();
       seconds_since_last_update = std::max(UINT32_C(1), seconds_since_last_update);
-      uint32_t bytes_read_this_second = _rate_limiter.get_actual_download_rate();
-      uint32_t bytes_written_this_second = _rate_limiter.get_actual_upload_rate();
+      uint32_t bytes_read_this_second = _rate_limiter.get_actual_download_rate() + _sync_rate_limiter.get_actual_download_rate();
+      uint32_t bytes_written_this_second = _rate_limiter.get_actual_upload_rate() + _sync_rate_limiter.get_actual_upload_rate();
       for (uint32_t i = 0; i < seconds_since_last_update - 1; ++i)
         update_bandwidth_data(0, 0);
       update_bandwidth_data(bytes_read_this_second, bytes_written_this_second);
       _bandwidth_monitor_last_update_time = current_time;
 
+      static graphene::utilities::gauge& read_rate = graphene::utilities::metrics().get_gauge(
+          "graphene_p2p_read_bytes_per_second", "Bytes read from peers over the last second");
+      static graphene::utilities::gauge& write_rate = graphene::utilities::metrics().get_gauge(
+          "graphene_p2p_written_bytes_per_second", "Bytes written to peers over the last second");
+      static graphene::utilities::gauge& connections = graphene::utilities::metrics().get_gauge(
+          "graphene_p2p_active_connections", "Peers the node is connected to");
+      read_rate.set(bytes_read_this_second);
+      write_rate.set(bytes_written_this_second);
+      connections.set(_active_connections.size());
+      schedule_uploads(seconds_since_last_update);
+
       if (!_node_is_shutting_down && !_bandwidth_monitor_loop_done.canceled())
         _bandwidth_monitor_loop_done = fc::schedule( [=](){ bandwidth_monitor_loop(); },
                                                      fc::time_point::now() + fc::seconds(1),
                                                      "bandwidth_monitor_loop" );
     }
 
+    void node_impl::schedule_uploads(uint32_t seconds_since_last_update)
+    {
+      VERIFY_CORRECT_THREAD();
+      uint32_t number_of_syncing_peers = 0;
+      for (const peer_connection_ptr& peer : _active_connections)
+      {
+        uint64_t bytes_sent = peer->get_total_bytes_sent();
+        peer->upload_rate = (uint32_t)((bytes_sent - peer->bytes_sent_at_last_upload_rate_update) / seconds_since_last_update);
+        peer->bytes_sent_at_last_upload_rate_update = bytes_sent;
+
+        if (peer->peer_needs_sync_items_from_us != peer->upload_scheduled_as_syncing)
+        {
+          fc::rate_limiting_group& old_group = peer->upload_scheduled_as_syncing ? _sync_rate_limiter : _rate_limiter;
+          fc::rate_limiting_group& new_group = peer->upload_scheduled_as_syncing ? _rate_limiter : _sync_rate_limiter;
+          old_group.remove_tcp_socket(&peer->get_socket());
+          new_group.add_tcp_socket(&peer->get_socket());
+          peer->upload_scheduled_as_syncing = peer->peer_needs_sync_items_from_us;
+        }
+        if (peer->upload_scheduled_as_syncing)
+          ++number_of_syncing_peers;
+      }
+
+      // with only one kind of peer connected, it gets the whole limit
+      uint64_t relay_share_in_bytes = _total_upload_limit;
+      if (number_of_syncing_peers && number_of_syncing_peers < _active_connections.size())
+      {
+        uint64_t minimum_relay_share_in_bytes = (uint64_t)_total_upload_limit * GRAPHENE_NET_MIN_RELAY_UPLOAD_SHARE_PERCENT / 100;
+        uint64_t maximum_relay_share_in_bytes = (uint64_t)_total_upload_limit * (100 - GRAPHENE_NET_MIN_SYNC_UPLOAD_SHARE_PERCENT) / 100;
+        uint64_t relay_demand_in_bytes = (uint64_t)_rate_limiter.get_actual_upload_rate() * 5 / 4;
+        relay_share_in_bytes = std::min(std::max(relay_demand_in_bytes, minimum_relay_share_in_bytes), maximum_relay_share_in_bytes);
+      }
+      uint64_t sync_share_in_bytes = _total_upload_limit && relay_share_in_bytes < _total_upload_limit ?
+                                     _total_upload_limit - relay_share_in_bytes : _total_upload_limit;
+
+      // a limit of 0 leaves the group unshaped; downloads are split in the same proportion
+      _rate_limiter.set_upload_limit((uint32_t)relay_share_in_bytes);
+      _sync_rate_limiter.set_upload_limit((uint32_t)sync_share_in_bytes);
+      if (_total_upload_limit && _total_download_limit)
+      {
+        _rate_limiter.set_download_limit((uint32_t)((uint64_t)_total_download_limit * relay_share_in_bytes / _total_upload_limit));
+        _sync_rate_limiter.set_download_limit((uint32_t)((uint64_t)_total_download_limit * sync_share_in_bytes / _total_upload_limit));
+      }
+      else
+      {
+        _rate_limiter.set_download_limit(_total_download_limit);
+        _sync_rate_limiter.set_download_limit(_total_download_limit);
+      }
+    }
+
     void node_impl::dump_node_status_task()
     {
       VERIFY_CORRECT_THREAD();
@@ -1639,7 +2003,7 @@ namespace graphene { namespace net { namespace detail {
     {
       VERIFY_CORRECT_THREAD();
       message_hash_type message_hash = received_message.id();
-      dlog("handling message ${type} ${hash} size ${size} from peer ${endpoint}",
+      tlog("handling message ${type} ${hash} size ${size} from peer ${endpoint}",
            ("type", graphene::net::core_message_type_enum(received_message.msg_type))("hash", message_hash)
            ("size", received_message.size)
            ("endpoint", originating_peer->get_remote_endpoint()));
@@ -1699,6 +2063,32 @@ namespace graphene { namespace net { namespace detail {
       case core_message_type_enum::get_current_connections_reply_message_type:
         on_get_current_connections_reply_message(originating_peer, received_message.as<get_current_connections_reply_message>());
         break;
+      case core_message_type_enum::compact_block_message_type:
+        on_compact_block_message(originating_peer, received_message.as<compact_block_message>());
+        break;
+      case core_message_type_enum::fetch_compact_block_transactions_message_type:
+        on_fetch_compact_block_transactions_message(originating_peer, received_message.as<fetch_compact_block_transactions_message>());
+        break;
+      case core_message_type_enum::compact_block_transactions_message_type:
+        on_compact_block_transactions_message(originating_peer, received_message.as<compact_block_transactions_message>());
+        break;
+      case core_message_type_enum::fetch_state_snapshot_manifest_message_type:
+        on_fetch_state_snapshot_manifest_message(originating_peer, received_message.as<fetch_state_snapshot_manifest_message>());
+        break;
+      case core_message_type_enum::state_snapshot_manifest_message_type:
+        on_state_snapshot_manifest_message(originating_peer, received_message.as<state_snapshot_manifest_message>());
+        break;
+      case core_message_type_enum::fetch_state_snapshot_chunk_message_type:
+        on_fetch_state_snapshot_chunk_message(originating_peer, received_message.as<fetch_state_snapshot_chunk_message>());
+        break;
+      case core_message_type_enum::state_snapshot_chunk_message_type:
+        on_state_snapshot_chunk_message(originating_peer, received_message.as<state_snapshot_chunk_message>());
+        break;
+      case core_message_type_enum::item_batch_message_type:
+        for (const message& item : received_message.as<item_batch_message>().items)
+          if (item.msg_type != core_message_type_enum::item_batch_message_type)
+            on_message(originating_peer, item);
+        break;
 
       default:
         // ignore any message in between core_message_type_first and _last that we don't handle above
@@ -1742,6 +2132,10 @@ namespace graphene { namespace net { namespace detail {
       if (!_hard_fork_block_numbers.empty())
         user_data["last_known_fork_block_number"] = _hard_fork_block_numbers.back();
 
+      user_data["compact_blocks"] = true;
+      user_data["item_batches"] = true;
+      user_data["compression"] = true;
+
       return user_data;
     }
     void node_impl::parse_hello_user_data_for_peer(peer_connection* originating_peer, const fc::variant_object& user_data)
@@ -1764,6 +2158,12 @@ namespace graphene { namespace net { namespace detail {
         originating_peer->node_id = user_data["node_id"].as<node_id_t>();
       if (user_data.contains("last_known_fork_block_number"))
         originating_peer->last_known_fork_block_number = user_data["last_known_fork_block_number"].as<uint32_t>();
+      if (user_data.contains("compact_blocks"))
+        originating_peer->supports_compact_blocks = user_data["compact_blocks"].as_bool();
+      if (user_data.contains("item_batches"))
+        originating_peer->supports_item_batches = user_data["item_batches"].as_bool();
+      if (user_data.contains("compression") && user_data["compression"].as_bool())
+        originating_peer->enable_compression();
     }
 
     void node_impl::on_hello_message( peer_connection* originating_peer, const hello_message& hello_message_received )
@@ -2295,7 +2695,7 @@ namespace graphene { namespace net { namespace detail {
       {
         originating_peer->item_ids_requested_from_peer.reset();
 
-        dlog( "sync: received a list of ${count} available items from ${peer_endpoint}",
+        tlog( "sync: received a list of ${count} available items from ${peer_endpoint}",
              ( "count", blockchain_item_ids_inventory_message_received.item_hashes_available.size() )
              ( "peer_endpoint", originating_peer->get_remote_endpoint() ) );
         //for( const item_hash_t& item_hash : blockchain_item_ids_inventory_message_received.item_hashes_available )
@@ -2336,13 +2736,13 @@ namespace graphene { namespace net { namespace detail {
                 !peer->ids_of_items_to_get.empty() &&
                 peer->ids_of_items_to_get.front() == blockchain_item_ids_inventory_message_received.item_hashes_available.front())
             {
-              dlog("The item ${newitem} is the first item for peer ${peer}",
+              tlog("The item ${newitem} is the first item for peer ${peer}",
                    ("newitem", blockchain_item_ids_inventory_message_received.item_hashes_available.front())
                    ("peer", peer->get_remote_endpoint()));
               is_first_item_for_other_peer = true;
               break;
             }
-          dlog("is_first_item_for_other_peer: ${is_first}.  item_hashes_received.size() = ${size}",
+          tlog("is_first_item_for_other_peer: ${is_first}.  item_hashes_received.size() = ${size}",
                ("is_first", is_first_item_for_other_peer)("size", item_hashes_received.size()));
           if (!is_first_item_for_other_peer)
           {
@@ -2354,11 +2754,11 @@ namespace graphene { namespace net { namespace detail {
               originating_peer->last_block_delegate_has_seen = item_hashes_received.front();
               ++originating_peer->last_block_number_delegate_has_seen;
               originating_peer->last_block_time_delegate_has_seen = _delegate->get_block_time(item_hashes_received.front());
-              dlog("popping item because delegate has already seen it.  peer's last block the delegate has seen is now ${block_id} (${block_num})",
+              tlog("popping item because delegate has already seen it.  peer's last block the delegate has seen is now ${block_id} (${block_num})",
                    ("block_id", originating_peer->last_block_delegate_has_seen )("block_num", originating_peer->last_block_number_delegate_has_seen));
               item_hashes_received.pop_front();
             }
-            dlog("after removing all items we have already seen, item_hashes_received.size() = ${size}", ("size", item_hashes_received.size()));
+            tlog("after removing all items we have already seen, item_hashes_received.size() = ${size}", ("size", item_hashes_received.size()));
           }
         }
         else if (!item_hashes_received.empty())
@@ -2476,7 +2876,15 @@ namespace graphene { namespace net { namespace detail {
       }
     }
 
-    message node_impl::get_message_for_item(const item_id& item)
+    fc::thread* node_impl::get_io_thread()
+    {
+      VERIFY_CORRECT_THREAD();
+      if (_io_threads.empty())
+        return nullptr;
+      return _io_threads[_next_io_thread++ % _io_threads.size()].get();
+    }
+
+    std::shared_ptr<const message> node_impl::get_message_for_item(const item_id& item)
     {
       try
       {
@@ -2486,32 +2894,130 @@ namespace graphene { namespace net { namespace detail {
       {}
       try
       {
-        return _delegate->get_item(item);
+        return std::make_shared<const message>(_delegate->get_item(item));
       }
       catch (fc::key_not_found_exception&)
       {}
-      return item_not_available_message(item);
+      return std::make_shared<const message>(item_not_available_message(item));
+    }
+
+    std::shared_ptr<const message> node_impl::get_message_for_items(const std::vector<item_id>& items, size_t& next_item)
+    {
+      VERIFY_CORRECT_THREAD();
+      const size_t end_of_batch = std::min(items.size(), next_item + GRAPHENE_NET_MAX_ITEMS_PER_BATCH);
+
+      // look in our cache first, and fetch whatever isn't there from the delegate in a single call
+      std::vector<std::shared_ptr<const message> > batch_items(end_of_batch - next_item);
+      std::vector<item_id> items_to_get_from_delegate;
+      for (size_t i = next_item; i < end_of_batch; ++i)
+      {
+        try
+        {
+          batch_items[i - next_item] = _message_cache.get_message(items[i].item_hash);
+        }
+        catch (fc::key_not_found_exception&)
+        {
+          items_to_get_from_delegate.push_back(items[i]);
+        }
+      }
+      if (!items_to_get_from_delegate.empty())
+      {
+        std::vector<fc::optional<message> > delegate_items = _delegate->get_items(items_to_get_from_delegate);
+        auto delegate_item_iter = delegate_items.begin();
+        for (size_t i = next_item; i < end_of_batch; ++i)
+          if (!batch_items[i - next_item])
+          {
+            if (delegate_item_iter != delegate_items.end() && *delegate_item_iter)
+              batch_items[i - next_item] = std::make_shared<const message>(std::move(**delegate_item_iter));
+            else
+              batch_items[i - next_item] = std::make_shared<const message>(item_not_available_message(items[i]));
+            if (delegate_item_iter != delegate_items.end())
+              ++delegate_item_iter;
+          }
+      }
+
+      // the rest wait for the next batch once this one is full
+      item_batch_message batch;
+      size_t batch_size = 0;
+      for (const std::shared_ptr<const message>& item : batch_items)
+      {
+        if (!batch.items.empty() && batch_size + item->size > GRAPHENE_NET_MAX_ITEM_BATCH_SIZE_IN_BYTES)
+          break;
+        batch_size += item->size;
+        batch.items.push_back(*item);
+        ++next_item;
+      }
+      return std::make_shared<const message>(batch);
     }
 
     void node_impl::on_fetch_items_message(peer_connection* originating_peer, const fetch_items_message& fetch_items_message_received)
     {
       VERIFY_CORRECT_THREAD();
-      dlog("received items request for ids ${ids} of type ${type} from peer ${endpoint}",
+      tlog("received items request for ids ${ids} of type ${type} from peer ${endpoint}",
            ("ids", fetch_items_message_received.items_to_fetch)
            ("type", fetch_items_message_received.item_type)
            ("endpoint", originating_peer->get_remote_endpoint()));
 
-      fc::optional<message> last_block_message_sent;
+      if (fetch_items_message_received.item_type == compact_block_message_type)
+      {
+        for (const item_hash_t& item_hash : fetch_items_message_received.items_to_fetch)
+        {
+          std::shared_ptr<const message> requested_message = get_message_for_item(item_id(block_message_type, item_hash));
+          if (requested_message->msg_type != block_message_type)
+          {
+            originating_peer->send_message(requested_message);
+            continue;
+          }
+          graphene::net::block_message block = requested_message->as<graphene::net::block_message>();
+          originating_peer->last_block_delegate_has_seen = block.block_id;
+          originating_peer->last_block_number_delegate_has_seen = _delegate->get_block_number(block.block_id);
+          originating_peer->last_block_time_delegate_has_seen = _delegate->get_block_time(block.block_id);
+          originating_peer->send_message(compact_block_message(item_hash, block.block));
+        }
+        return;
+      }
+
+      if (originating_peer->supports_item_batches && fetch_items_message_received.items_to_fetch.size() > 1)
+      {
+        // the items are generated as the batches reach the front of the send queue.  Items which aren't in our
+        // cache are asked for by block id, so the last one tells us the last block the peer will have seen
+        std::vector<item_id> items_to_send;
+        items_to_send.reserve(fetch_items_message_received.items_to_fetch.size());
+        for (const item_hash_t& item_hash : fetch_items_message_received.items_to_fetch)
+          items_to_send.emplace_back(fetch_items_message_received.item_type, item_hash);
+        if (fetch_items_message_received.item_type == block_message_type)
+        {
+          item_hash_t last_block_id = fetch_items_message_received.items_to_fetch.back();
+          try
+          {
+            last_block_id = _message_cache.get_message(last_block_id)->as<graphene::net::block_message>().block_id;
+          }
+          catch (fc::key_not_found_exception&)
+          {
+          }
+          fc::time_point_sec last_block_time = _delegate->get_block_time(last_block_id);
+          if (last_block_time != fc::time_point_sec::min())
+          {
+            originating_peer->last_block_delegate_has_seen = last_block_id;
+            originating_peer->last_block_number_delegate_has_seen = _delegate->get_block_number(last_block_id);
+            originating_peer->last_block_time_delegate_has_seen = last_block_time;
+          }
+        }
+        originating_peer->send_items(std::move(items_to_send));
+        return;
+      }
 
-      std::list<message> reply_messages;
+      std::shared_ptr<const message> last_block_message_sent;
+
+      std::list<std::shared_ptr<const message>> reply_messages;
       for (const item_hash_t& item_hash : fetch_items_message_received.items_to_fetch)
       {
         try
         {
-          message requested_message = _message_cache.get_message(item_hash);
-          dlog("received item request for item ${id} from peer ${endpoint}, returning the item from my message cache",
+          std::shared_ptr<const message> requested_message = _message_cache.get_message(item_hash);
+          tlog("received item request for item ${id} from peer ${endpoint}, returning the item from my message cache",
                ("endpoint", originating_peer->get_remote_endpoint())
-               ("id", requested_message.id()));
+               ("id", requested_message->id()));
           reply_messages.push_back(requested_message);
           if (fetch_items_message_received.item_type == block_message_type)
             last_block_message_sent = requested_message;
@@ -2525,10 +3031,10 @@ namespace graphene { namespace net { namespace detail {
         item_id item_to_fetch(fetch_items_message_received.item_type, item_hash);
         try
         {
-          message requested_message = _delegate->get_item(item_to_fetch);
-          dlog("received item request from peer ${endpoint}, returning the item from delegate with id ${id} size ${size}",
-               ("id", requested_message.id())
-               ("size", requested_message.size)
+          std::shared_ptr<const message> requested_message = std::make_shared<const message>(_delegate->get_item(item_to_fetch));
+          tlog("received item request from peer ${endpoint}, returning the item from delegate with id ${id} size ${size}",
+               ("id", requested_message->id())
+               ("size", requested_message->size)
                ("endpoint", originating_peer->get_remote_endpoint()));
           reply_messages.push_back(requested_message);
           if (fetch_items_message_received.item_type == block_message_type)
@@ -2537,8 +3043,8 @@ namespace graphene { namespace net { namespace detail {
         }
         catch (fc::key_not_found_exception&)
         {
-          reply_messages.push_back(item_not_available_message(item_to_fetch));
-          dlog("received item request from peer ${endpoint} but we don't have it",
+          reply_messages.push_back(std::make_shared<const message>(item_not_available_message(item_to_fetch)));
+          tlog("received item request from peer ${endpoint} but we don't have it",
                ("endpoint", originating_peer->get_remote_endpoint()));
         }
       }
@@ -2552,10 +3058,10 @@ namespace graphene { namespace net { namespace detail {
         originating_peer->last_block_time_delegate_has_seen = _delegate->get_block_time(block.block_id);
       }
 
-      for (const message& reply : reply_messages)
+      for (const std::shared_ptr<const message>& reply : reply_messages)
       {
-        if (reply.msg_type == block_message_type)
-          originating_peer->send_item(item_id(block_message_type, reply.as<graphene::net::block_message>().block_id));
+        if (reply->msg_type == block_message_type)
+          originating_peer->send_item(item_id(block_message_type, reply->as<graphene::net::block_message>().block_id));
         else
           originating_peer->send_message(reply);
       }
@@ -2601,10 +3107,15 @@ namespace graphene { namespace net { namespace detail {
     {
       VERIFY_CORRECT_THREAD();
 
+      // until the state has been bootstrapped, the delegate can't handle the blocks and transactions
+      // following the peer's head
+      if (_bootstrapping_state)
+        return;
+
       // expire old inventory so we'll be making decisions our about whether to fetch blocks below based only on recent inventory
       originating_peer->clear_old_inventory();
 
-      dlog( "received inventory of ${count} items from peer ${endpoint}",
+      tlog( "received inventory of ${count} items from peer ${endpoint}",
            ( "count", item_ids_inventory_message_received.item_hashes_available.size() )("endpoint", originating_peer->get_remote_endpoint() ) );
       for( const item_hash_t& item_hash : item_ids_inventory_message_received.item_hashes_available )
       {
@@ -2613,7 +3124,7 @@ namespace graphene { namespace net { namespace detail {
         bool we_requested_this_item_from_a_peer = false;
         for (const peer_connection_ptr peer : _active_connections)
         {
-          if (peer->inventory_advertised_to_peer.find(advertised_item_id) != peer->inventory_advertised_to_peer.end())
+          if (peer->inventory_advertised_to_peer.contains(advertised_item_id))
           {
             we_advertised_this_item_to_a_peer = true;
             break;
@@ -2632,13 +3143,15 @@ namespace graphene { namespace net { namespace detail {
                originating_peer->is_inventory_advertised_to_us_list_full_for_transactions()) ||
               originating_peer->is_inventory_advertised_to_us_list_full())
             break;
-          originating_peer->inventory_peer_advertised_to_us.insert(peer_connection::timestamped_item_id(advertised_item_id, fc::time_point::now()));
+          originating_peer->inventory_peer_advertised_to_us.insert(advertised_item_id, fc::time_point::now());
+          if (advertised_item_id.item_type == graphene::net::block_message_type)
+            trace_block(advertised_item_id.item_hash);
           if (!we_requested_this_item_from_a_peer)
           {
             auto insert_result = _items_to_fetch.insert(prioritized_item_id(advertised_item_id, _items_to_fetch_sequence_counter++));
             if (insert_result.second)
             {
-              dlog("adding item ${item_hash} from inventory message to our list of items to fetch",
+              tlog("adding item ${item_hash} from inventory message to our list of items to fetch",
                    ("item_hash", item_hash));
               trigger_fetch_items_loop();
             }
@@ -2683,7 +3196,10 @@ namespace graphene { namespace net { namespace detail {
     {
       VERIFY_CORRECT_THREAD();
       peer_connection_ptr originating_peer_ptr = originating_peer->shared_from_this();
-      _rate_limiter.remove_tcp_socket( &originating_peer->get_socket() );
+      if (originating_peer->upload_scheduled_as_syncing)
+        _sync_rate_limiter.remove_tcp_socket( &originating_peer->get_socket() );
+      else
+        _rate_limiter.remove_tcp_socket( &originating_peer->get_socket() );
 
       // if we closed the connection (due to timeout or handshake failure), we should have recorded an
       // error message to store in the peer database when we closed the connection
@@ -2716,6 +3232,8 @@ namespace graphene { namespace net { namespace detail {
         }
       }
 
+      stop_fetching_state_snapshot_from_peer(originating_peer);
+
       ilog("Remote peer ${endpoint} closed their connection to us", ("endpoint", originating_peer->get_remote_endpoint()));
       display_current_connections();
       trigger_p2p_network_connect_loop();
@@ -2769,7 +3287,7 @@ namespace graphene { namespace net { namespace detail {
 
     void node_impl::send_sync_block_to_node_delegate(const graphene::net::block_message& block_message_to_send)
     {
-      dlog("in send_sync_block_to_node_delegate()");
+      tlog("in send_sync_block_to_node_delegate()");
       bool client_accepted_block = false;
       bool discontinue_fetching_blocks_from_peer = false;
 
@@ -2781,8 +3299,6 @@ namespace graphene { namespace net { namespace detail {
         ilog("Successfully pushed sync block ${num} (id:${id})",
              ("num", block_message_to_send.block.block_num())
              ("id", block_message_to_send.block_id));
-        _most_recent_blocks_accepted.push_back(block_message_to_send.block_id);
-
         client_accepted_block = true;
       }
       catch (const block_older_than_undo_history& e)
@@ -2808,6 +3324,52 @@ namespace graphene { namespace net { namespace detail {
         handle_message_exception = e;
       }
 
+      process_sync_block_result(block_message_to_send, client_accepted_block, discontinue_fetching_blocks_from_peer,
+                                handle_message_exception);
+      tlog("Leaving send_sync_block_to_node_delegate");
+    }
+
+    void node_impl::send_sync_blocks_to_node_delegate(const std::vector<graphene::net::block_message>& blocks_to_send)
+    {
+      tlog("in send_sync_blocks_to_node_delegate(), ${count} blocks", ("count", blocks_to_send.size()));
+      uint32_t blocks_accepted = 0;
+      try
+      {
+        blocks_accepted = _delegate->handle_sync_blocks(blocks_to_send);
+      }
+      catch (const fc::canceled_exception&)
+      {
+        _number_of_sync_blocks_in_progress -= blocks_to_send.size();
+        throw;
+      }
+      catch (const fc::exception& e)
+      {
+        wlog("Failed to push sync blocks: ${e}", ("e", e));
+      }
+
+      for (uint32_t i = 0; i < blocks_accepted; ++i)
+      {
+        ilog("Successfully pushed sync block ${num} (id:${id})",
+             ("num", blocks_to_send[i].block.block_num())
+             ("id", blocks_to_send[i].block_id));
+        process_sync_block_result(blocks_to_send[i], true, false, fc::oexception());
+        --_number_of_sync_blocks_in_progress;
+      }
+      // The block the delegate stopped at is pushed again on its own to find out why it was rejected,
+      // then each one after it, just as if they had never been batched
+      for (uint32_t i = blocks_accepted; i < blocks_to_send.size(); ++i)
+      {
+        send_sync_block_to_node_delegate(blocks_to_send[i]);
+        --_number_of_sync_blocks_in_progress;
+      }
+
+      tlog("Leaving send_sync_blocks_to_node_delegate");
+      trigger_process_backlog_of_sync_blocks();
+    }
+
+    void node_impl::process_sync_block_result(const graphene::net::block_message& block_message_to_send, bool client_accepted_block,
+                                              bool discontinue_fetching_blocks_from_peer, const fc::oexception& handle_message_exception)
+    {
       // build up lists for any potentially-blocking operations we need to do, then do them
       // at the end of this function
       std::set<peer_connection_ptr> peers_with_newly_empty_item_lists;
@@ -2816,8 +3378,9 @@ namespace graphene { namespace net { namespace detail {
 
       if( client_accepted_block )
       {
+        _most_recent_blocks_accepted.push_back(block_message_to_send.block_id);
         --_total_number_of_unfetched_items;
-        dlog("sync: client accpted the block, we now have only ${count} items left to fetch before we're in sync",
+        tlog("sync: client accpted the block, we now have only ${count} items left to fetch before we're in sync",
               ("count", _total_number_of_unfetched_items));
         bool is_fork_block = is_hard_fork_block(block_message_to_send.block.block_num());
         for (const peer_connection_ptr& peer : _active_connections)
@@ -2874,7 +3437,7 @@ namespace graphene { namespace net { namespace detail {
               peer->last_block_time_delegate_has_seen = block_message_to_send.block.timestamp;
 
               peer->ids_of_items_being_processed.erase(items_being_processed_iter);
-              dlog("Removed item from ${endpoint}'s list of items being processed, still processing ${len} blocks",
+              tlog("Removed item from ${endpoint}'s list of items being processed, still processing ${len} blocks",
                    ("endpoint", peer->get_remote_endpoint())("len", peer->ids_of_items_being_processed.size()));
 
               // if we just received the last item in our list from this peer, we will want to
@@ -2927,14 +3490,6 @@ namespace graphene { namespace net { namespace detail {
 
       for (const peer_connection_ptr& peer : peers_we_need_to_sync_to)
         start_synchronizing_with_peer(peer);
-
-      dlog("Leaving send_sync_block_to_node_delegate");
-
-      if (// _suspend_fetching_sync_blocks && <-- you can use this if "maximum_number_of_blocks_to_handle_at_one_time" == "maximum_number_of_sync_blocks_to_prefetch"
-          !_node_is_shutting_down &&
-          (!_process_backlog_of_sync_blocks_done.valid() || _process_backlog_of_sync_blocks_done.ready()))
-        _process_backlog_of_sync_blocks_done = fc::async([=](){ process_backlog_of_sync_blocks(); },
-                                                         "process_backlog_of_sync_blocks");
     }
 
     void node_impl::process_backlog_of_sync_blocks()
@@ -2950,19 +3505,19 @@ namespace graphene { namespace net { namespace detail {
           ++calls_iter;
       }
 
-      dlog("in process_backlog_of_sync_blocks");
-      if (_handle_message_calls_in_progress.size() >= _maximum_number_of_blocks_to_handle_at_one_time)
+      tlog("in process_backlog_of_sync_blocks");
+      if (_number_of_sync_blocks_in_progress >= _maximum_number_of_blocks_to_handle_at_one_time)
       {
         dlog("leaving process_backlog_of_sync_blocks because we're already processing too many blocks");
         return; // we will be rescheduled when the next block finishes its processing
       }
-      dlog("currently ${count} blocks in the process of being handled", ("count", _handle_message_calls_in_progress.size()));
+      tlog("currently ${count} blocks in the process of being handled", ("count", _number_of_sync_blocks_in_progress));
 
 
       if (_suspend_fetching_sync_blocks)
       {
         dlog("resuming processing sync block backlog because we only ${count} blocks in progress",
-             ("count", _handle_message_calls_in_progress.size()));
+             ("count", _number_of_sync_blocks_in_progress));
         _suspend_fetching_sync_blocks = false;
       }
 
@@ -2976,9 +3531,20 @@ namespace graphene { namespace net { namespace detail {
       bool block_processed_this_iteration;
       unsigned blocks_processed = 0;
 
-      std::set<peer_connection_ptr> peers_with_newly_empty_item_lists;
-      std::set<peer_connection_ptr> peers_we_need_to_sync_to;
-      std::map<peer_connection_ptr, fc::oexception> peers_with_rejected_block;
+      // Blocks which each build on the one before are handed to the delegate together, so a batch
+      // crosses to its thread once, and our thread goes on collecting the next batch meanwhile
+      std::vector<graphene::net::block_message> batch;
+      auto send_batch = [&]() {
+        if (batch.empty())
+          return;
+        _number_of_sync_blocks_in_progress += batch.size();
+        std::shared_ptr<std::vector<graphene::net::block_message> > blocks_to_send =
+            std::make_shared<std::vector<graphene::net::block_message> >(std::move(batch));
+        batch.clear();
+        _handle_message_calls_in_progress.emplace_back(fc::async([this, blocks_to_send](){
+          send_sync_blocks_to_node_delegate(*blocks_to_send);
+        }, "send_sync_blocks_to_node_delegate"));
+      };
 
       do
       {
@@ -2986,7 +3552,7 @@ namespace graphene { namespace net { namespace detail {
                   std::make_move_iterator(_new_received_sync_items.end()),
                   std::front_inserter(_received_sync_items));
         _new_received_sync_items.clear();
-        dlog("currently ${count} sync items to consider", ("count", _received_sync_items.size()));
+        tlog("currently ${count} sync items to consider", ("count", _received_sync_items.size()));
 
         block_processed_this_iteration = false;
         for (auto received_block_iter = _received_sync_items.begin();
@@ -3020,11 +3586,12 @@ namespace graphene { namespace net { namespace detail {
             if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
                           received_block_iter->block_id) == _most_recent_blocks_accepted.end())
             {
-              graphene::net::block_message block_message_to_process = *received_block_iter;
+              if (!batch.empty() && received_block_iter->block.previous != batch.back().block_id)
+                send_batch();
+              batch.push_back(std::move(*received_block_iter));
               _received_sync_items.erase(received_block_iter);
-              _handle_message_calls_in_progress.emplace_back(fc::async([this, block_message_to_process](){
-                send_sync_block_to_node_delegate(block_message_to_process);
-              }, "send_sync_block_to_node_delegate"));
+              if (batch.size() >= GRAPHENE_NET_SYNC_BLOCKS_PER_BATCH)
+                send_batch();
               ++blocks_processed;
               block_processed_this_iteration = true;
             }
@@ -3035,10 +3602,10 @@ namespace graphene { namespace net { namespace detail {
           } // end if potential_first_block
         } // end for each block in _received_sync_items
 
-        if (_handle_message_calls_in_progress.size() >= _maximum_number_of_blocks_to_handle_at_one_time)
+        if (_number_of_sync_blocks_in_progress + batch.size() >= _maximum_number_of_blocks_to_handle_at_one_time)
         {
           dlog("stopping processing sync block backlog because we have ${count} blocks in progress",
-               ("count", _handle_message_calls_in_progress.size()));
+               ("count", _number_of_sync_blocks_in_progress + batch.size()));
           //ulog("stopping processing sync block backlog because we have ${count} blocks in progress, total on hand: ${received}",
           //     ("count", _handle_message_calls_in_progress.size())("received", _received_sync_items.size()));
           if (_received_sync_items.size() >= _maximum_number_of_sync_blocks_to_prefetch)
@@ -3046,8 +3613,9 @@ namespace graphene { namespace net { namespace detail {
           break;
         }
       } while (block_processed_this_iteration);
+      send_batch();
 
-      dlog("leaving process_backlog_of_sync_blocks, ${count} processed", ("count", blocks_processed));
+      tlog("leaving process_backlog_of_sync_blocks, ${count} processed", ("count", blocks_processed));
 
       if (!_suspend_fetching_sync_blocks)
         trigger_fetch_sync_items_loop();
@@ -3064,7 +3632,7 @@ namespace graphene { namespace net { namespace detail {
                                                const graphene::net::block_message& block_message_to_process, const message_hash_type& message_hash )
     {
       VERIFY_CORRECT_THREAD();
-      dlog( "received a sync block from peer ${endpoint}", ("endpoint", originating_peer->get_remote_endpoint() ) );
+      tlog( "received a sync block from peer ${endpoint}", ("endpoint", originating_peer->get_remote_endpoint() ) );
 
       // add it to the front of _received_sync_items, then process _received_sync_items to try to
       // pass as many messages as possible to the client.
@@ -3077,8 +3645,15 @@ namespace graphene { namespace net { namespace detail {
                                                            const message_hash_type& message_hash )
     {
       fc::time_point message_receive_time = fc::time_point::now();
+      block_propagation_trace& trace = trace_block(message_hash);
+      trace.block_id = block_message_to_process.block_id;
+      if (trace.received_time == fc::time_point())
+      {
+        trace.received_time = message_receive_time;
+        trace.source_peer = originating_peer->node_id;
+      }
 
-      dlog( "received a block from peer ${endpoint}, passing it to client", ("endpoint", originating_peer->get_remote_endpoint() ) );
+      tlog( "received a block from peer ${endpoint}, passing it to client", ("endpoint", originating_peer->get_remote_endpoint() ) );
       std::list<peer_connection_ptr> peers_to_disconnect;
       std::string disconnect_reason;
       fc::oexception disconnect_exception;
@@ -3097,6 +3672,8 @@ namespace graphene { namespace net { namespace detail {
         {
           _delegate->handle_block(block_message_to_process, false);
           message_validated_time = fc::time_point::now();
+          // looked up again, as the trace may have been dropped while the client was busy
+          trace_block(message_hash).applied_time = message_validated_time;
           ilog("Successfully pushed block ${num} (id:${id})",
                ("num", block_message_to_process.block.block_num())
                ("id", block_message_to_process.block_id));
@@ -3105,7 +3682,7 @@ namespace graphene { namespace net { namespace detail {
         else
           dlog( "Already received and accepted this block (presumably through sync mechanism), treating it as accepted" );
 
-        dlog( "client validated the block, advertising it to other peers" );
+        tlog( "client validated the block, advertising it to other peers" );
 
         item_id block_message_item_id(core_message_type_enum::block_message_type, message_hash);
         uint32_t block_number = block_message_to_process.block.block_num();
@@ -3115,8 +3692,7 @@ namespace graphene { namespace net { namespace detail {
         {
           ASSERT_TASK_NOT_PREEMPTED(); // don't yield while iterating over _active_connections
 
-          auto iter = peer->inventory_peer_advertised_to_us.find(block_message_item_id);
-          if (iter != peer->inventory_peer_advertised_to_us.end())
+          if (peer->inventory_peer_advertised_to_us.contains(block_message_item_id))
           {
             // this peer offered us the item.  It will eventually expire from the peer's
             // inventory_peer_advertised_to_us list after some time has passed (currently 2 minutes).
@@ -3211,6 +3787,7 @@ namespace graphene { namespace net { namespace detail {
                                                                                             block_message_to_process.block_id));
         if (sync_item_iter != originating_peer->sync_items_requested_from_peer.end())
         {
+          adjust_sync_window(originating_peer, fc::time_point::now() - sync_item_iter->second);
           originating_peer->sync_items_requested_from_peer.erase(sync_item_iter);
           _active_sync_requests.erase(block_message_to_process.block_id);
           process_block_during_sync(originating_peer, block_message_to_process, message_hash);
@@ -3224,6 +3801,8 @@ namespace graphene { namespace net { namespace detail {
             else
               trigger_fetch_sync_items_loop();
           }
+          else if (originating_peer->sync_items_requested_from_peer.size() <= originating_peer->sync_window / 2)
+            trigger_fetch_sync_items_loop(); // half the window has arrived, top it up
           return;
         }
       }
@@ -3500,6 +4079,366 @@ namespace graphene { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
     }
 
+    void node_impl::on_compact_block_message(peer_connection* originating_peer,
+                                             const compact_block_message& compact_block_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      const item_hash_t& block_message_hash = compact_block_message_received.block_message_hash;
+      if (originating_peer->items_requested_from_peer.find(item_id(block_message_type, block_message_hash)) ==
+          originating_peer->items_requested_from_peer.end())
+      {
+        wlog("received a compact block ${block_id} I didn't ask for from peer ${endpoint}, disconnecting from peer",
+             ("endpoint", originating_peer->get_remote_endpoint())
+             ("block_id", compact_block_message_received.block_id));
+        fc::exception detailed_error(FC_LOG_MESSAGE(error, "You sent me a compact block that I didn't ask for, block_id: ${block_id}",
+                                                    ("block_id", compact_block_message_received.block_id)));
+        disconnect_from_peer(originating_peer, "You sent me a compact block that I didn't ask for", true, detailed_error);
+        return;
+      }
+
+      // fill in what we can from the transactions we've relayed recently, and ask the peer for the rest
+      std::vector<fc::optional<signed_transaction> > transactions;
+      std::vector<uint32_t> missing_transaction_indices;
+      transactions.reserve(compact_block_message_received.transactions.size());
+      for (const compact_block_message::compact_transaction& compact_transaction : compact_block_message_received.transactions)
+      {
+        transactions.push_back(_message_cache.find_transaction(compact_transaction.id));
+        if (!transactions.back())
+          missing_transaction_indices.push_back((uint32_t)(transactions.size() - 1));
+      }
+
+      if (missing_transaction_indices.empty())
+      {
+        rebuild_compact_block(originating_peer, compact_block_message_received, transactions);
+        return;
+      }
+
+      dlog("missing ${missing} of the ${count} transactions in compact block ${block_id} from peer ${endpoint}, requesting them",
+           ("missing", missing_transaction_indices.size())("count", transactions.size())
+           ("block_id", compact_block_message_received.block_id)("endpoint", originating_peer->get_remote_endpoint()));
+      originating_peer->partial_compact_blocks[block_message_hash] = std::make_pair(compact_block_message_received, std::move(transactions));
+      originating_peer->send_message(fetch_compact_block_transactions_message(block_message_hash, std::move(missing_transaction_indices)));
+    }
+
+    void node_impl::on_fetch_compact_block_transactions_message(peer_connection* originating_peer,
+                                                                const fetch_compact_block_transactions_message& fetch_compact_block_transactions_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      std::shared_ptr<const message> requested_message =
+        get_message_for_item(item_id(block_message_type, fetch_compact_block_transactions_message_received.block_message_hash));
+      if (requested_message->msg_type != block_message_type)
+      {
+        originating_peer->send_message(requested_message);
+        return;
+      }
+
+      graphene::net::block_message block = requested_message->as<graphene::net::block_message>();
+      compact_block_transactions_message reply(fetch_compact_block_transactions_message_received.block_message_hash);
+      reply.transactions.reserve(fetch_compact_block_transactions_message_received.transaction_indices.size());
+      for (uint32_t transaction_index : fetch_compact_block_transactions_message_received.transaction_indices)
+      {
+        if (transaction_index >= block.block.transactions.size())
+        {
+          fc::exception detailed_error(FC_LOG_MESSAGE(error, "You asked for transaction ${index} of block ${block_id}, which only has ${count}",
+                                                      ("index", transaction_index)("block_id", block.block_id)
+                                                      ("count", block.block.transactions.size())));
+          disconnect_from_peer(originating_peer, "You asked for a transaction that isn't in the block", true, detailed_error);
+          return;
+        }
+        reply.transactions.push_back(block.block.transactions[transaction_index]);
+      }
+      originating_peer->send_message(reply);
+    }
+
+    void node_impl::on_compact_block_transactions_message(peer_connection* originating_peer,
+                                                          const compact_block_transactions_message& compact_block_transactions_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      auto partial_block_iter = originating_peer->partial_compact_blocks.find(compact_block_transactions_message_received.block_message_hash);
+      if (partial_block_iter == originating_peer->partial_compact_blocks.end())
+      {
+        wlog("received transactions for a compact block I'm not rebuilding from peer ${endpoint}, ignoring them",
+             ("endpoint", originating_peer->get_remote_endpoint()));
+        return;
+      }
+
+      compact_block_message compact_block = std::move(partial_block_iter->second.first);
+      std::vector<fc::optional<signed_transaction> > transactions = std::move(partial_block_iter->second.second);
+      originating_peer->partial_compact_blocks.erase(partial_block_iter);
+
+      // the transactions come back in the order we asked for them, which is the order of the gaps
+      auto next_transaction = compact_block_transactions_message_received.transactions.begin();
+      for (fc::optional<signed_transaction>& transaction : transactions)
+        if (!transaction && next_transaction != compact_block_transactions_message_received.transactions.end())
+          transaction = *next_transaction++;
+
+      rebuild_compact_block(originating_peer, compact_block, transactions);
+    }
+
+    void node_impl::rebuild_compact_block(peer_connection* originating_peer,
+                                          const compact_block_message& compact_block,
+                                          const std::vector<fc::optional<signed_transaction> >& transactions)
+    {
+      VERIFY_CORRECT_THREAD();
+      signed_block block;
+      static_cast<signed_block_header&>(block) = compact_block.block_header;
+      bool all_transactions_match = transactions.size() == compact_block.transactions.size();
+      block.transactions.reserve(transactions.size());
+      for (size_t i = 0; all_transactions_match && i < transactions.size(); ++i)
+      {
+        all_transactions_match = transactions[i] && transactions[i]->id() == compact_block.transactions[i].id;
+        if (all_transactions_match)
+        {
+          graphene::chain::processed_transaction transaction(*transactions[i]);
+          transaction.operation_results = compact_block.transactions[i].operation_results;
+          block.transactions.emplace_back(std::move(transaction));
+        }
+      }
+
+      if (all_transactions_match)
+      {
+        // the rebuilt block only counts if it packs to exactly the block_message we asked for
+        message block_message_to_process = graphene::net::block_message(block);
+        message_hash_type block_message_hash = block_message_to_process.id();
+        if (block_message_hash == compact_block.block_message_hash)
+        {
+          process_block_message(originating_peer, block_message_to_process, block_message_hash);
+          return;
+        }
+      }
+
+      wlog("unable to rebuild compact block ${block_id} from peer ${endpoint}, fetching the full block",
+           ("block_id", compact_block.block_id)("endpoint", originating_peer->get_remote_endpoint()));
+      originating_peer->send_message(fetch_items_message(block_message_type, std::vector<item_hash_t>{compact_block.block_message_hash}));
+    }
+
+    void node_impl::on_fetch_state_snapshot_manifest_message(peer_connection* originating_peer,
+                                                             const fetch_state_snapshot_manifest_message& fetch_state_snapshot_manifest_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      originating_peer->send_message(_delegate->get_state_snapshot_manifest());
+    }
+
+    void node_impl::on_state_snapshot_manifest_message(peer_connection* originating_peer,
+                                                       const state_snapshot_manifest_message& state_snapshot_manifest_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      const state_snapshot_manifest_message& manifest = state_snapshot_manifest_message_received;
+      if (!_bootstrapping_state || !manifest.serves_snapshot())
+        return;
+
+      uint64_t chunk_count = manifest.chunk_size ? (manifest.snapshot_size + manifest.chunk_size - 1) / manifest.chunk_size : 0;
+      if (manifest.chunk_size > GRAPHENE_NET_STATE_SNAPSHOT_CHUNK_SIZE ||
+          chunk_count != manifest.chunk_commitments.size() ||
+          manifest.head_block_header.id() != manifest.block_id)
+      {
+        fc::exception detailed_error(FC_LOG_MESSAGE(error, "The manifest of the state snapshot of block ${block_id} doesn't match its chunks or its block header",
+                                                    ("block_id", manifest.block_id)));
+        disconnect_from_peer(originating_peer, "You sent me an inconsistent state snapshot manifest", true, detailed_error);
+        return;
+      }
+      if (_rejected_state_snapshots.find(manifest.block_id) != _rejected_state_snapshots.end())
+        return;
+
+      dlog("peer ${endpoint} serves a state snapshot of block ${num} of ${size} bytes",
+           ("endpoint", originating_peer->get_remote_endpoint())
+           ("num", manifest.head_block_header.block_num())("size", manifest.snapshot_size));
+      originating_peer->state_snapshot_manifest = manifest;
+      if (!_state_snapshot_manifest)
+        choose_state_snapshot();
+      else if (manifest == *_state_snapshot_manifest)
+        request_state_snapshot_chunks(originating_peer);
+    }
+
+    void node_impl::choose_state_snapshot()
+    {
+      VERIFY_CORRECT_THREAD();
+      // peers may have taken their snapshots at different blocks, the most recent one enough of them serve is used
+      const state_snapshot_manifest_message* chosen_manifest = nullptr;
+      for (const peer_connection_ptr& peer : _active_connections)
+      {
+        if (!peer->state_snapshot_manifest ||
+            (chosen_manifest && peer->state_snapshot_manifest->head_block_header.block_num() <= chosen_manifest->head_block_header.block_num()))
+          continue;
+        const state_snapshot_manifest_message& candidate = *peer->state_snapshot_manifest;
+        uint32_t attestations = (uint32_t)std::count_if(_active_connections.begin(), _active_connections.end(),
+                                                        [&](const peer_connection_ptr& other_peer) {
+                                                          return other_peer->state_snapshot_manifest && *other_peer->state_snapshot_manifest == candidate;
+                                                        });
+        if (attestations >= _min_state_snapshot_attestations)
+          chosen_manifest = &candidate;
+      }
+      if (!chosen_manifest)
+        return;
+
+      _state_snapshot_manifest = *chosen_manifest;
+      uint32_t chunk_count = (uint32_t)_state_snapshot_manifest->chunk_commitments.size();
+      ilog("Bootstrapping the state from the snapshot of block ${num}, ${size} bytes in ${count} chunks",
+           ("num", _state_snapshot_manifest->head_block_header.block_num())
+           ("size", _state_snapshot_manifest->snapshot_size)("count", chunk_count));
+      _state_snapshot_chunks.assign(chunk_count, std::vector<char>());
+      _state_snapshot_chunks_missing = chunk_count;
+      _state_snapshot_chunks_to_request.clear();
+      for (uint32_t chunk_index = 0; chunk_index < chunk_count; ++chunk_index)
+        _state_snapshot_chunks_to_request.push_back(chunk_index);
+
+      for (const peer_connection_ptr& peer : _active_connections)
+        if (peer->state_snapshot_manifest && *peer->state_snapshot_manifest == *_state_snapshot_manifest)
+          request_state_snapshot_chunks(peer.get());
+    }
+
+    void node_impl::request_state_snapshot_chunks(peer_connection* peer)
+    {
+      VERIFY_CORRECT_THREAD();
+      while (peer->state_snapshot_chunks_requested_from_peer.size() < GRAPHENE_NET_STATE_SNAPSHOT_CHUNKS_PER_PEER &&
+             !_state_snapshot_chunks_to_request.empty())
+      {
+        uint32_t chunk_index = _state_snapshot_chunks_to_request.front();
+        _state_snapshot_chunks_to_request.pop_front();
+        peer->state_snapshot_chunks_requested_from_peer[chunk_index] = fc::time_point::now();
+        peer->send_message(fetch_state_snapshot_chunk_message(_state_snapshot_manifest->block_id, chunk_index));
+      }
+    }
+
+    void node_impl::stop_fetching_state_snapshot_from_peer(peer_connection* peer)
+    {
+      VERIFY_CORRECT_THREAD();
+      for (const auto& chunk_and_time : peer->state_snapshot_chunks_requested_from_peer)
+        _state_snapshot_chunks_to_request.push_front(chunk_and_time.first);
+      peer->state_snapshot_chunks_requested_from_peer.clear();
+      peer->state_snapshot_manifest.reset();
+
+      if (!_state_snapshot_manifest || _state_snapshot_chunks_missing == 0)
+        return;
+      for (const peer_connection_ptr& other_peer : _active_connections)
+        if (other_peer->state_snapshot_manifest && *other_peer->state_snapshot_manifest == *_state_snapshot_manifest)
+        {
+          request_state_snapshot_chunks(other_peer.get());
+          return;
+        }
+
+      wlog("No peer serves the state snapshot of block ${num} any more, looking for another one",
+           ("num", _state_snapshot_manifest->head_block_header.block_num()));
+      _state_snapshot_manifest.reset();
+      _state_snapshot_chunks.clear();
+      _state_snapshot_chunks_missing = 0;
+      _state_snapshot_chunks_to_request.clear();
+      for (const peer_connection_ptr& other_peer : _active_connections)
+        other_peer->state_snapshot_chunks_requested_from_peer.clear();
+      choose_state_snapshot();
+    }
+
+    void node_impl::on_fetch_state_snapshot_chunk_message(peer_connection* originating_peer,
+                                                          const fetch_state_snapshot_chunk_message& fetch_state_snapshot_chunk_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      std::vector<char> data = _delegate->get_state_snapshot_chunk(fetch_state_snapshot_chunk_message_received.block_id,
+                                                                   fetch_state_snapshot_chunk_message_received.chunk_index);
+      originating_peer->send_message(state_snapshot_chunk_message(fetch_state_snapshot_chunk_message_received.block_id,
+                                                                  fetch_state_snapshot_chunk_message_received.chunk_index,
+                                                                  std::move(data)));
+    }
+
+    void node_impl::on_state_snapshot_chunk_message(peer_connection* originating_peer,
+                                                    const state_snapshot_chunk_message& state_snapshot_chunk_message_received)
+    {
+      VERIFY_CORRECT_THREAD();
+      const state_snapshot_chunk_message& chunk = state_snapshot_chunk_message_received;
+      if (!_state_snapshot_manifest || chunk.block_id != _state_snapshot_manifest->block_id ||
+          !originating_peer->state_snapshot_chunks_requested_from_peer.erase(chunk.chunk_index))
+      {
+        wlog("received chunk ${index} of a state snapshot I didn't ask peer ${endpoint} for, ignoring it",
+             ("index", chunk.chunk_index)("endpoint", originating_peer->get_remote_endpoint()));
+        return;
+      }
+
+      if (chunk.data.empty())
+      {
+        wlog("peer ${endpoint} no longer serves the state snapshot of block ${num}",
+             ("endpoint", originating_peer->get_remote_endpoint())("num", _state_snapshot_manifest->head_block_header.block_num()));
+        _state_snapshot_chunks_to_request.push_front(chunk.chunk_index);
+        stop_fetching_state_snapshot_from_peer(originating_peer);
+        return;
+      }
+
+      const state_snapshot_manifest_message& manifest = *_state_snapshot_manifest;
+      fc::sha256 previous_commitment = chunk.chunk_index == 0 ? fc::sha256() : manifest.chunk_commitments[chunk.chunk_index - 1];
+      if (chunk.data.size() != manifest.size_of_chunk(chunk.chunk_index) ||
+          state_snapshot_manifest_message::commit_to_chunk(previous_commitment, chunk.data.data(), chunk.data.size()) !=
+            manifest.chunk_commitments[chunk.chunk_index])
+      {
+        fc::exception detailed_error(FC_LOG_MESSAGE(error, "Chunk ${index} of the state snapshot of block ${block_id} doesn't match its commitment",
+                                                    ("index", chunk.chunk_index)("block_id", chunk.block_id)));
+        _state_snapshot_chunks_to_request.push_front(chunk.chunk_index);
+        stop_fetching_state_snapshot_from_peer(originating_peer);
+        disconnect_from_peer(originating_peer, "You sent me a state snapshot chunk which doesn't match its commitment", true, detailed_error);
+        return;
+      }
+
+      _state_snapshot_chunks[chunk.chunk_index] = chunk.data;
+      if (--_state_snapshot_chunks_missing == 0)
+        finish_state_snapshot();
+      else
+        request_state_snapshot_chunks(originating_peer);
+    }
+
+    void node_impl::finish_state_snapshot()
+    {
+      VERIFY_CORRECT_THREAD();
+      state_snapshot_manifest_message manifest = *_state_snapshot_manifest;
+      std::vector<char> snapshot;
+      snapshot.reserve(manifest.snapshot_size);
+      for (std::vector<char>& chunk : _state_snapshot_chunks)
+      {
+        snapshot.insert(snapshot.end(), chunk.begin(), chunk.end());
+        std::vector<char>().swap(chunk);
+      }
+      _state_snapshot_chunks.clear();
+
+      ilog("Downloaded the state snapshot of block ${num}, handing it to the client", ("num", manifest.head_block_header.block_num()));
+      try
+      {
+        _delegate->handle_state_snapshot(manifest, snapshot);
+      }
+      catch (const fc::canceled_exception&)
+      {
+        throw;
+      }
+      catch (const fc::exception& e)
+      {
+        wlog("Client rejected the state snapshot of block ${num}: ${e}", ("num", manifest.head_block_header.block_num())("e", e.to_detail_string()));
+        _rejected_state_snapshots.insert(manifest.block_id);
+        _state_snapshot_manifest.reset();
+
+        // every peer serving the snapshot vouched for it
+        std::list<peer_connection_ptr> peers_to_disconnect;
+        for (const peer_connection_ptr& peer : _active_connections)
+          if (peer->state_snapshot_manifest && *peer->state_snapshot_manifest == manifest)
+            peers_to_disconnect.push_back(peer);
+        for (const peer_connection_ptr& peer : peers_to_disconnect)
+        {
+          peer->state_snapshot_manifest.reset();
+          disconnect_from_peer(peer.get(), "You served me a state snapshot that I have deemed to be invalid", true, e);
+        }
+        choose_state_snapshot();
+        return;
+      }
+
+      ilog("Bootstrapped the state from the snapshot of block ${num}, syncing the blocks after it", ("num", manifest.head_block_header.block_num()));
+      _bootstrapping_state = false;
+      _state_snapshot_manifest.reset();
+      _state_snapshot_chunks_to_request.clear();
+      _rejected_state_snapshots.clear();
+      for (const peer_connection_ptr& peer : _active_connections)
+      {
+        peer->state_snapshot_manifest.reset();
+        peer->state_snapshot_chunks_requested_from_peer.clear();
+      }
+      _most_recent_blocks_accepted.clear();
+      _most_recent_blocks_accepted.push_back(manifest.block_id);
+      start_synchronizing();
+    }
+
 
     // this handles any message we get that doesn't require any special processing.
     // currently, this is any message other than block messages and p2p-specific
@@ -3529,6 +4468,10 @@ namespace graphene { namespace net { namespace detail {
         if (originating_peer->idle())
           trigger_fetch_items_loop();
 
+        if (message_to_process.msg_type == graphene::net::trx_message_type &&
+            !admit_transaction(originating_peer, message_to_process))
+          return;
+
         // Next: have the delegate process the message
         fc::time_point message_validated_time;
         try
@@ -3560,9 +4503,47 @@ namespace graphene { namespace net { namespace detail {
       }
     }
 
+    // sheds transaction floods here on the p2p thread, before the client spends any time on them.
+    // the peer's token bucket is charged first, then the delegate screens the transaction against
+    // what it can check without its own thread
+    bool node_impl::admit_transaction( peer_connection* originating_peer, const message& message_to_process )
+    {
+      VERIFY_CORRECT_THREAD();
+      fc::time_point now = fc::time_point::now();
+      double elapsed_seconds = (double)(now - originating_peer->transaction_tokens_refilled).count() / fc::seconds(1).count();
+      originating_peer->transaction_tokens = std::min<double>(GRAPHENE_NET_PEER_TRANSACTION_BURST,
+                                                              originating_peer->transaction_tokens +
+                                                              elapsed_seconds * GRAPHENE_NET_PEER_TRANSACTIONS_PER_SECOND);
+      originating_peer->transaction_tokens_refilled = now;
+      if (originating_peer->transaction_tokens < 1)
+      {
+        tlog("peer ${peer} is sending transactions faster than we admit them, dropping one",
+             ("peer", originating_peer->get_remote_endpoint()));
+        originating_peer->transaction_fetching_inhibited_until = now + fc::seconds(GRAPHENE_NET_INSUFFICIENT_RELAY_FEE_PENALTY_SEC);
+        return false;
+      }
+      originating_peer->transaction_tokens -= 1;
+
+      std::string reason;
+      try
+      {
+        if (_delegate->admit_transaction_on_any_thread(message_to_process.as<trx_message>(), reason))
+          return true;
+      }
+      catch (const fc::exception& e)
+      {
+        reason = e.to_string();
+      }
+      tlog("dropping transaction from peer ${peer} before handing it to the client: ${reason}",
+           ("peer", originating_peer->get_remote_endpoint())("reason", reason));
+      return false;
+    }
+
     void node_impl::start_synchronizing_with_peer( const peer_connection_ptr& peer )
     {
       VERIFY_CORRECT_THREAD();
+      if (_bootstrapping_state)
+        return; // every peer is synchronized with once the delegate has accepted a state snapshot
       peer->ids_of_items_to_get.clear();
       peer->number_of_unfetched_item_ids = 0;
       peer->we_need_sync_items_from_peer = true;
@@ -3584,6 +4565,8 @@ namespace graphene { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       peer->send_message(current_time_request_message(),
                          offsetof(current_time_request_message, request_sent_time));
+      if (_bootstrapping_state)
+        peer->send_message(fetch_state_snapshot_manifest_message());
       start_synchronizing_with_peer( peer );
       if( _active_connections.size() != _last_reported_number_of_connections )
       {
@@ -4388,7 +5371,7 @@ namespace graphene { namespace net { namespace detail {
       ilog( "node._new_received_sync_items size: ${size}", ("size", _new_received_sync_items.size() ) );
       ilog( "node._items_to_fetch size: ${size}", ("size", _items_to_fetch.size() ) );
       ilog( "node._new_inventory size: ${size}", ("size", _new_inventory.size() ) );
-      ilog( "node._message_cache size: ${size}", ("size", _message_cache.size() ) );
+      ilog( "node._message_cache: ${stats}", ("stats", _message_cache.get_statistics() ) );
       for( const peer_connection_ptr& peer : _active_connections )
       {
         ilog( "  peer ${endpoint}", ("endpoint", peer->get_remote_endpoint() ) );
@@ -4397,6 +5380,7 @@ namespace graphene { namespace net { namespace detail {
         ilog( "    peer.inventory_advertised_to_peer size: ${size}", ("size", peer->inventory_advertised_to_peer.size() ) );
         ilog( "    peer.items_requested_from_peer size: ${size}", ("size", peer->items_requested_from_peer.size() ) );
         ilog( "    peer.sync_items_requested_from_peer size: ${size}", ("size", peer->sync_items_requested_from_peer.size() ) );
+        ilog( "    peer memory usage: ${bytes} bytes", ("bytes", peer->get_memory_usage() ) );
       }
       ilog( "--------- END MEMORY USAGE ------------" );
     }
@@ -4504,6 +5488,9 @@ namespace graphene { namespace net { namespace detail {
         peer_details["lastrecv"] = peer->get_last_message_received_time().sec_since_epoch();
         peer_details["bytessent"] = peer->get_total_bytes_sent();
         peer_details["bytesrecv"] = peer->get_total_bytes_received();
+        peer_details["upload_rate"] = peer->upload_rate;
+        peer_details["upload_class"] = peer->upload_scheduled_as_syncing ? "sync" : "relay";
+        peer_details["memory_usage"] = peer->get_memory_usage();
         peer_details["conntime"] = peer->get_connection_time();
         peer_details["pingtime"] = ""; // TODO: fill me for bitcoin compatibility
         peer_details["pingwait"] = ""; // TODO: fill me for bitcoin compatibility
@@ -4574,7 +5561,7 @@ namespace graphene { namespace net { namespace detail {
       {
         graphene::net::trx_message transaction_message_to_broadcast = item_to_broadcast.as<graphene::net::trx_message>();
         hash_of_message_contents = transaction_message_to_broadcast.trx.id(); // for debugging
-        dlog( "broadcasting trx: ${trx}", ("trx", transaction_message_to_broadcast) );
+        tlog( "broadcasting trx: ${trx}", ("trx", transaction_message_to_broadcast) );
       }
       message_hash_type hash_of_item_to_broadcast = item_to_broadcast.id();
 
@@ -4588,6 +5575,15 @@ namespace graphene { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       // this version is called directly from the client
       message_propagation_data propagation_data{fc::time_point::now(), fc::time_point::now(), _node_id};
+      if( item_to_broadcast.msg_type == graphene::net::block_message_type )
+      {
+        // a block we produced enters the network here
+        block_propagation_trace& trace = trace_block( item_to_broadcast.id() );
+        trace.block_id = item_to_broadcast.as<graphene::net::block_message>().block_id;
+        trace.source_peer = _node_id;
+        trace.received_time = propagation_data.received_time;
+        trace.applied_time = propagation_data.validated_time;
+      }
       broadcast( item_to_broadcast, propagation_data );
     }
 
@@ -4600,6 +5596,13 @@ namespace graphene { namespace net { namespace detail {
       _hard_fork_block_numbers = hard_fork_block_numbers;
     }
 
+    void node_impl::bootstrap_state_from_peers(uint32_t min_attesting_peers)
+    {
+      VERIFY_CORRECT_THREAD();
+      _bootstrapping_state = true;
+      _min_state_snapshot_attestations = std::max<uint32_t>(min_attesting_peers, 1);
+    }
+
     bool node_impl::is_connected() const
     {
       VERIFY_CORRECT_THREAD();
@@ -4631,6 +5634,8 @@ namespace graphene { namespace net { namespace detail {
         _maximum_number_of_sync_blocks_to_prefetch = params["maximum_number_of_sync_blocks_to_prefetch"].as<uint32_t>();
       if (params.contains("maximum_blocks_per_peer_during_syncing"))
         _maximum_blocks_per_peer_during_syncing = params["maximum_blocks_per_peer_during_syncing"].as<uint32_t>();
+      if (params.contains("log_block_propagation_traces"))
+        _log_block_propagation_traces = params["log_block_propagation_traces"].as<bool>();
 
       _desired_number_of_connections = std::min(_desired_number_of_connections, _maximum_number_of_connections);
 
@@ -4650,6 +5655,7 @@ namespace graphene { namespace net { namespace detail {
       result["maximum_number_of_blocks_to_handle_at_one_time"] = _maximum_number_of_blocks_to_handle_at_one_time;
       result["maximum_number_of_sync_blocks_to_prefetch"] = _maximum_number_of_sync_blocks_to_prefetch;
       result["maximum_blocks_per_peer_during_syncing"] = _maximum_blocks_per_peer_during_syncing;
+      result["log_block_propagation_traces"] = _log_block_propagation_traces;
       return result;
     }
 
@@ -4665,6 +5671,44 @@ namespace graphene { namespace net { namespace detail {
       return _message_cache.get_message_propagation_data( block_id );
     }
 
+    block_propagation_trace& node_impl::trace_block( const message_hash_type& message_hash )
+    {
+      VERIFY_CORRECT_THREAD();
+      auto& traces_by_hash = _block_propagation_traces.get<1>();
+      auto iter = traces_by_hash.find( message_hash );
+      if( iter != traces_by_hash.end() )
+        return iter->trace;
+
+      _block_propagation_traces.push_back( traced_block{message_hash, block_propagation_trace()} );
+      if( _block_propagation_traces.size() > GRAPHENE_NET_BLOCK_PROPAGATION_TRACES_KEPT )
+        _block_propagation_traces.pop_front();
+      block_propagation_trace& trace = _block_propagation_traces.back().trace;
+      trace.first_seen_time = fc::time_point::now();
+      return trace;
+    }
+
+    void node_impl::note_block_relayed( const message_hash_type& message_hash, fc::time_point relay_time )
+    {
+      VERIFY_CORRECT_THREAD();
+      auto& traces_by_hash = _block_propagation_traces.get<1>();
+      auto iter = traces_by_hash.find( message_hash );
+      if( iter == traces_by_hash.end() || iter->trace.first_relayed_time != fc::time_point() )
+        return;
+      iter->trace.first_relayed_time = relay_time;
+      if( _log_block_propagation_traces )
+        ilog( "block propagation trace: ${trace}", ("trace", iter->trace) );
+    }
+
+    std::vector<block_propagation_trace> node_impl::get_block_propagation_traces() const
+    {
+      VERIFY_CORRECT_THREAD();
+      std::vector<block_propagation_trace> traces;
+      traces.reserve( _block_propagation_traces.size() );
+      for( const traced_block& block : _block_propagation_traces )
+        traces.push_back( block.trace );
+      return traces;
+    }
+
     node_id_t node_impl::get_node_id() const
     {
       VERIFY_CORRECT_THREAD();
@@ -4694,8 +5738,30 @@ namespace graphene { namespace net { namespace detail {
     void node_impl::set_total_bandwidth_limit( uint32_t upload_bytes_per_second, uint32_t download_bytes_per_second )
     {
       VERIFY_CORRECT_THREAD();
+      _total_upload_limit = upload_bytes_per_second;
+      _total_download_limit = download_bytes_per_second;
       _rate_limiter.set_upload_limit( upload_bytes_per_second );
       _rate_limiter.set_download_limit( download_bytes_per_second );
+      _sync_rate_limiter.set_upload_limit( upload_bytes_per_second );
+      _sync_rate_limiter.set_download_limit( download_bytes_per_second );
+    }
+
+    bool node_impl::bind_to_numa_node( uint32_t numa_node )
+    {
+      VERIFY_CORRECT_THREAD();
+      bool bound = graphene::utilities::bind_current_thread_to_numa_node( numa_node );
+      ilog( "p2p thread runs on ${cpus}", ("cpus", utilities::describe_current_thread_affinity()) );
+      for( const std::shared_ptr<fc::thread>& io_thread : _io_threads )
+        bound = io_thread->async( [numa_node](){ return graphene::utilities::bind_current_thread_to_numa_node( numa_node ); },
+                                  "bind_to_numa_node" ).wait() && bound;
+      return bound;
+    }
+
+    void node_impl::set_io_threads( const std::vector<std::shared_ptr<fc::thread> >& io_threads )
+    {
+      VERIFY_CORRECT_THREAD();
+      _io_threads = io_threads;
+      _next_io_thread = 0;
     }
 
     void node_impl::disable_peer_advertising()
@@ -4720,6 +5786,44 @@ namespace graphene { namespace net { namespace detail {
       info["firewalled"] = _is_firewalled;
       return info;
     }
+    fc::variant_object node_impl::get_upload_rates() const
+    {
+      VERIFY_CORRECT_THREAD();
+      auto group_rates = [](const fc::rate_limiting_group& group) {
+        fc::mutable_variant_object rates;
+        rates["upload_limit"] = group.get_upload_limit();
+        rates["upload_rate"] = group.get_actual_upload_rate();
+        rates["download_limit"] = group.get_download_limit();
+        rates["download_rate"] = group.get_actual_download_rate();
+        return rates;
+      };
+      fc::mutable_variant_object relay_rates = group_rates(_rate_limiter);
+      fc::mutable_variant_object sync_rates = group_rates(_sync_rate_limiter);
+
+      std::vector<fc::variant_object> peer_rates;
+      uint32_t number_of_syncing_peers = 0;
+      for (const peer_connection_ptr& peer : _active_connections)
+      {
+        fc::mutable_variant_object rates;
+        rates["addr"] = peer->get_remote_endpoint() ? (std::string)*peer->get_remote_endpoint() : std::string();
+        rates["upload_class"] = peer->upload_scheduled_as_syncing ? "sync" : "relay";
+        rates["upload_rate"] = peer->upload_rate;
+        peer_rates.push_back(rates);
+        if (peer->upload_scheduled_as_syncing)
+          ++number_of_syncing_peers;
+      }
+      relay_rates["peers"] = (uint32_t)_active_connections.size() - number_of_syncing_peers;
+      sync_rates["peers"] = number_of_syncing_peers;
+
+      fc::mutable_variant_object result;
+      result["total_upload_limit"] = _total_upload_limit;
+      result["total_download_limit"] = _total_download_limit;
+      result["relay"] = relay_rates;
+      result["sync"] = sync_rates;
+      result["peers"] = peer_rates;
+      return result;
+    }
+
     fc::variant_object node_impl::network_get_usage_stats() const
     {
       VERIFY_CORRECT_THREAD();
@@ -4857,6 +5961,11 @@ namespace graphene { namespace net { namespace detail {
     INVOKE_IN_IMPL(sync_from, current_head_block, hard_fork_block_numbers);
   }
 
+  void node::bootstrap_state_from_peers(uint32_t min_attesting_peers)
+  {
+    INVOKE_IN_IMPL(bootstrap_state_from_peers, min_attesting_peers);
+  }
+
   bool node::is_connected() const
   {
     INVOKE_IN_IMPL(is_connected);
@@ -4908,6 +6017,16 @@ namespace graphene { namespace net { namespace detail {
     INVOKE_IN_IMPL(set_total_bandwidth_limit, upload_bytes_per_second, download_bytes_per_second);
   }
 
+  bool node::bind_to_numa_node( uint32_t numa_node )
+  {
+    INVOKE_IN_IMPL(bind_to_numa_node, numa_node);
+  }
+
+  void node::set_io_threads( const std::vector<std::shared_ptr<fc::thread> >& io_threads )
+  {
+    INVOKE_IN_IMPL(set_io_threads, io_threads);
+  }
+
   void node::disable_peer_advertising()
   {
     INVOKE_IN_IMPL(disable_peer_advertising);
@@ -4928,6 +6047,16 @@ namespace graphene { namespace net { namespace detail {
     INVOKE_IN_IMPL(network_get_usage_stats);
   }
 
+  fc::variant_object node::get_upload_rates() const
+  {
+    INVOKE_IN_IMPL(get_upload_rates);
+  }
+
+  std::vector<block_propagation_trace> node::get_block_propagation_traces() const
+  {
+    INVOKE_IN_IMPL(get_block_propagation_traces);
+  }
+
   void node::close()
   {
     wlog( ".... WARNING NOT DOING ANYTHING WHEN I SHOULD ......" );
@@ -4938,27 +6067,36 @@ namespace graphene { namespace net { namespace detail {
   struct simulated_network::node_info
   {
     node_delegate* delegate;
+    fc::microseconds latency;
+    uint64_t bytes_per_second;
+    fc::time_point link_busy_until;
     fc::future<void> message_sender_task_done;
-    std::queue<message> messages_to_deliver;
-    node_info(node_delegate* delegate) : delegate(delegate) {}
+    std::queue<std::pair<message, fc::time_point> > messages_to_deliver; // with the time each message arrives
+    node_info(node_delegate* delegate, fc::microseconds latency, uint64_t bytes_per_second) :
+      delegate(delegate), latency(latency), bytes_per_second(bytes_per_second) {}
   };
 
   simulated_network::~simulated_network()
   {
-    for( node_info* network_node_info : network_nodes )
-    {
+    // nothing more gets queued while the senders stop, and none of them is deleted while another may still run
+    std::list<node_info*> nodes_to_delete;
+    nodes_to_delete.swap(network_nodes);
+    for( node_info* network_node_info : nodes_to_delete )
       network_node_info->message_sender_task_done.cancel_and_wait("~simulated_network()");
+    for( node_info* network_node_info : nodes_to_delete )
       delete network_node_info;
-    }
   }
 
   void simulated_network::message_sender(node_info* destination_node)
   {
     while (!destination_node->messages_to_deliver.empty())
     {
+      fc::time_point arrival_time = destination_node->messages_to_deliver.front().second;
+      if (arrival_time > fc::time_point::now())
+        fc::usleep(arrival_time - fc::time_point::now());
       try
       {
-        destination_node->delegate->handle_message(destination_node->messages_to_deliver.front(), false);
+        destination_node->delegate->handle_message(destination_node->messages_to_deliver.front().first, false);
       }
       catch ( const fc::exception& e )
       {
@@ -4971,16 +6109,32 @@ namespace graphene { namespace net { namespace detail {
   void simulated_network::broadcast( const message& item_to_broadcast  )
   {
     for (node_info* network_node_info : network_nodes)
-    {
-      network_node_info->messages_to_deliver.emplace(item_to_broadcast);
-      if (!network_node_info->message_sender_task_done.valid() || network_node_info->message_sender_task_done.ready())
-        network_node_info->message_sender_task_done = fc::async([=](){ message_sender(network_node_info); }, "simulated_network_sender");
-    }
+      queue_message(network_node_info, item_to_broadcast);
+  }
+
+  void simulated_network::send_message( node_delegate* destination, const message& message_to_send )
+  {
+    for (node_info* network_node_info : network_nodes)
+      if (network_node_info->delegate == destination)
+        queue_message(network_node_info, message_to_send);
   }
 
-  void simulated_network::add_node_delegate( node_delegate* node_delegate_to_add )
+  void simulated_network::queue_message( node_info* destination_node, const message& message_to_send )
   {
-    network_nodes.push_back(new node_info(node_delegate_to_add));
+    fc::time_point now = fc::time_point::now();
+    fc::time_point sent_time = std::max(now, destination_node->link_busy_until);
+    if (destination_node->bytes_per_second)
+      sent_time += fc::microseconds((sizeof(message_header) + message_to_send.size) * 1000000 / destination_node->bytes_per_second);
+    destination_node->link_busy_until = sent_time;
+
+    destination_node->messages_to_deliver.emplace(message_to_send, sent_time + destination_node->latency);
+    if (!destination_node->message_sender_task_done.valid() || destination_node->message_sender_task_done.ready())
+      destination_node->message_sender_task_done = fc::async([=](){ message_sender(destination_node); }, "simulated_network_sender");
+  }
+
+  void simulated_network::add_node_delegate( node_delegate* node_delegate_to_add, fc::microseconds latency, uint64_t bytes_per_second )
+  {
+    network_nodes.push_back(new node_info(node_delegate_to_add, latency, bytes_per_second));
   }
 
   namespace detail
@@ -4989,12 +6143,24 @@ namespace graphene { namespace net { namespace detail {
 #define INITIALIZE_ACCUMULATOR(r, data, method_name) \
       , BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _execution_accumulator))(boost::accumulators::tag::rolling_window::window_size = ROLLING_WINDOW_SIZE) \
       , BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _delay_before_accumulator))(boost::accumulators::tag::rolling_window::window_size = ROLLING_WINDOW_SIZE) \
-      , BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _delay_after_accumulator))(boost::accumulators::tag::rolling_window::window_size = ROLLING_WINDOW_SIZE)
+      , BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _delay_after_accumulator))(boost::accumulators::tag::rolling_window::window_size = ROLLING_WINDOW_SIZE) \
+      , BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _execution_histogram))(graphene::utilities::metrics().get_histogram( \
+          "graphene_p2p_delegate_call_microseconds", "Time the node delegate took to execute a call", \
+          call_time_bounds(), "method=\"" BOOST_PP_STRINGIZE(method_name) "\"")) \
+      , BOOST_PP_CAT(_, BOOST_PP_CAT(method_name, _delay_before_histogram))(graphene::utilities::metrics().get_histogram( \
+          "graphene_p2p_delegate_wait_microseconds", "Time a call waited for the node delegate thread", \
+          call_time_bounds(), "method=\"" BOOST_PP_STRINGIZE(method_name) "\""))
+
+    static std::vector<int64_t> call_time_bounds()
+    {
+      return graphene::utilities::exponential_bounds(10, 4, 10000000);
+    }
 
 
     statistics_gathering_node_delegate_wrapper::statistics_gathering_node_delegate_wrapper(node_delegate* delegate, fc::thread* thread_for_delegate_calls) :
       _node_delegate(delegate),
-      _thread(thread_for_delegate_calls)
+      _thread(thread_for_delegate_calls),
+      _handing_off_transactions(false)
       BOOST_PP_SEQ_FOR_EACH(INITIALIZE_ACCUMULATOR, unused, NODE_DELEGATE_METHOD_NAMES)
     {}
 #undef INITIALIZE_ACCUMULATOR
@@ -5033,7 +6199,9 @@ namespace graphene { namespace net { namespace detail {
     call_statistics_collector statistics_collector(#method_name, \
                                                    &_ ## method_name ## _execution_accumulator, \
                                                    &_ ## method_name ## _delay_before_accumulator, \
-                                                   &_ ## method_name ## _delay_after_accumulator); \
+                                                   &_ ## method_name ## _delay_after_accumulator, \
+                                                   &_ ## method_name ## _execution_histogram, \
+                                                   &_ ## method_name ## _delay_before_histogram); \
     if (_thread->is_current()) \
     { \
       call_statistics_collector::actual_execution_measurement_helper helper(statistics_collector); \
@@ -5047,14 +6215,98 @@ namespace graphene { namespace net { namespace detail {
 
     bool statistics_gathering_node_delegate_wrapper::has_item( const net::item_id& id )
     {
+      bool has_the_item = false;
+      if (_node_delegate->has_item_on_any_thread(id, has_the_item))
+        return has_the_item;
       INVOKE_AND_COLLECT_STATISTICS(has_item, id);
     }
 
     bool statistics_gathering_node_delegate_wrapper::handle_message( const message& message_to_handle, bool sync_mode )
     {
+      if (message_to_handle.msg_type == trx_message_type && !sync_mode && !_thread->is_current())
+        return handle_transaction_in_batch(message_to_handle);
       INVOKE_AND_COLLECT_STATISTICS(handle_message, message_to_handle, sync_mode);
     }
 
+    // during a flood every peer's connection is waiting on its own transaction.  Rather than each of them
+    // starting a task on the delegate thread and switching to it and back, the transactions gather in a batch
+    // while the one before is being handled, and the whole batch is handled in a single task
+    bool statistics_gathering_node_delegate_wrapper::handle_transaction_in_batch( const message& message_to_handle )
+    {
+      if (_waiting_transaction_batches.empty() ||
+          _waiting_transaction_batches.back()->messages.size() >= GRAPHENE_NET_MAX_TRANSACTIONS_PER_HANDOFF)
+        _waiting_transaction_batches.push_back(std::make_shared<transaction_batch>());
+      std::shared_ptr<transaction_batch> batch = _waiting_transaction_batches.back();
+      size_t position = batch->messages.size();
+      batch->messages.push_back(message_to_handle);
+
+      // whoever finds nothing being handed off hands off batches until none are left waiting
+      if (_handing_off_transactions)
+        fc::future<void>(batch->handled).wait();
+      else
+        hand_off_transaction_batches();
+
+      if (batch->failure)
+        batch->failure->dynamic_rethrow_exception();
+      if (batch->errors[position])
+        batch->errors[position]->dynamic_rethrow_exception();
+      return false;
+    }
+
+    void statistics_gathering_node_delegate_wrapper::hand_off_transaction_batches()
+    {
+      _handing_off_transactions = true;
+      while (!_waiting_transaction_batches.empty())
+      {
+        std::shared_ptr<transaction_batch> batch = _waiting_transaction_batches.front();
+        _waiting_transaction_batches.pop_front();
+        batch->errors.resize(batch->messages.size());
+        try
+        {
+          call_statistics_collector statistics_collector("handle_transaction_batch",
+                                                         &_handle_transaction_batch_execution_accumulator,
+                                                         &_handle_transaction_batch_delay_before_accumulator,
+                                                         &_handle_transaction_batch_delay_after_accumulator,
+                                                         &_handle_transaction_batch_execution_histogram,
+                                                         &_handle_transaction_batch_delay_before_histogram);
+          _thread->async([this, batch, &statistics_collector](){
+            call_statistics_collector::actual_execution_measurement_helper helper(statistics_collector);
+            for (size_t i = 0; i < batch->messages.size(); ++i)
+            {
+              try
+              {
+                _node_delegate->handle_message(batch->messages[i], false);
+              }
+              catch (const fc::exception& e)
+              {
+                batch->errors[i] = e.dynamic_copy_exception();
+              }
+              catch (const std::exception& e)
+              {
+                batch->errors[i] = fc::unhandled_exception(FC_LOG_MESSAGE(warn, "${e}", ("e", e.what()))).dynamic_copy_exception();
+              }
+            }
+          }, "invoke handle_transaction_batch").wait();
+        }
+        catch (const fc::exception& e)
+        {
+          // the batch couldn't be handed off (we're being canceled): it and the ones behind it fail with the reason
+          _handing_off_transactions = false;
+          fc::exception_ptr error = e.dynamic_copy_exception();
+          _waiting_transaction_batches.push_front(batch);
+          for (const std::shared_ptr<transaction_batch>& failed_batch : _waiting_transaction_batches)
+          {
+            failed_batch->failure = error;
+            failed_batch->handled->set_value();
+          }
+          _waiting_transaction_batches.clear();
+          throw;
+        }
+        batch->handled->set_value();
+      }
+      _handing_off_transactions = false;
+    }
+
     bool statistics_gathering_node_delegate_wrapper::handle_block( const graphene::net::block_message& blk_msg, bool syncmode )
     {
        if (_thread->is_current())  {  return _node_delegate->handle_block(blk_msg,syncmode);  }
@@ -5067,6 +6319,16 @@ namespace graphene { namespace net { namespace detail {
        else  return _thread->async([&](){  return _node_delegate->handle_transaction(trx_msg,syncmode);  }, "invoke handle_transaction").wait();
     }
 
+    bool statistics_gathering_node_delegate_wrapper::admit_transaction_on_any_thread( const graphene::net::trx_message& trx_msg, std::string& reason )
+    {
+      return _node_delegate->admit_transaction_on_any_thread(trx_msg, reason);
+    }
+
+    uint32_t statistics_gathering_node_delegate_wrapper::handle_sync_blocks( const std::vector<block_message>& blocks )
+    {
+      INVOKE_AND_COLLECT_STATISTICS(handle_sync_blocks, blocks);
+    }
+
     std::vector<item_hash_t> statistics_gathering_node_delegate_wrapper::get_item_ids(uint32_t item_type,
                                                                                   const std::vector<item_hash_t>& blockchain_synopsis,
                                                                                   uint32_t& remaining_item_count,
@@ -5080,6 +6342,26 @@ namespace graphene { namespace net { namespace detail {
       INVOKE_AND_COLLECT_STATISTICS(get_item, id);
     }
 
+    std::vector<fc::optional<message> > statistics_gathering_node_delegate_wrapper::get_items( const std::vector<item_id>& ids )
+    {
+      INVOKE_AND_COLLECT_STATISTICS(get_items, ids);
+    }
+
+    state_snapshot_manifest_message statistics_gathering_node_delegate_wrapper::get_state_snapshot_manifest()
+    {
+      INVOKE_AND_COLLECT_STATISTICS(get_state_snapshot_manifest);
+    }
+
+    std::vector<char> statistics_gathering_node_delegate_wrapper::get_state_snapshot_chunk( const block_id_type& block_id, uint32_t chunk_index )
+    {
+      INVOKE_AND_COLLECT_STATISTICS(get_state_snapshot_chunk, block_id, chunk_index);
+    }
+
+    void statistics_gathering_node_delegate_wrapper::handle_state_snapshot( const state_snapshot_manifest_message& manifest, const std::vector<char>& snapshot )
+    {
+      INVOKE_AND_COLLECT_STATISTICS(handle_state_snapshot, manifest, snapshot);
+    }
+
     fc::sha256 statistics_gathering_node_delegate_wrapper::get_chain_id() const
     {
       INVOKE_AND_COLLECT_STATISTICS(get_chain_id);
@@ -22,6 +22,8 @@
 
 #include <fc/thread/thread.hpp>
 
+#include <algorithm>
+
 #ifdef DEFAULT_LOGGER
 # undef DEFAULT_LOGGER
 #endif
@@ -35,24 +37,34 @@
 
 namespace graphene { namespace net
   {
-    message peer_connection::real_queued_message::get_message(peer_connection_delegate*)
+    namespace
+    {
+      // the most transactions we'll keep in the inventory (above), plus the most blocks that would be generated in
+      // GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES (plus one, to give us some wiggle room)
+      const uint32_t maximum_inventory_size = GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES * GRAPHENE_NET_MAX_TRX_PER_SECOND * 60 +
+                                              (GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES + 1) * 60 / GRAPHENE_MAX_BLOCK_INTERVAL;
+    }
+
+    std::shared_ptr<const message> peer_connection::real_queued_message::get_message(peer_connection_delegate*)
     {
       if (message_send_time_field_offset != (size_t)-1)
       {
-        // patch the current time into the message.  Since this operates on the packed version of the structure,
-        // it won't work for anything after a variable-length field
+        // patch the current time into a private copy of the message.  Since this operates on the packed version of
+        // the structure, it won't work for anything after a variable-length field
         std::vector<char> packed_current_time = fc::raw::pack(fc::time_point::now());
-        assert(message_send_time_field_offset + packed_current_time.size() <= message_to_send.data.size());
-        memcpy(message_to_send.data.data() + message_send_time_field_offset,
+        assert(message_send_time_field_offset + packed_current_time.size() <= message_to_send->data.size());
+        std::shared_ptr<message> timestamped_message = std::make_shared<message>(*message_to_send);
+        memcpy(timestamped_message->data.data() + message_send_time_field_offset,
                packed_current_time.data(), packed_current_time.size());
+        return timestamped_message;
       }
       return message_to_send;
     }
     size_t peer_connection::real_queued_message::get_size_in_queue()
     {
-      return message_to_send.data.size();
+      return message_to_send->data.size();
     }
-    message peer_connection::virtual_queued_message::get_message(peer_connection_delegate* node)
+    std::shared_ptr<const message> peer_connection::virtual_queued_message::get_message(peer_connection_delegate* node)
     {
       return node->get_message_for_item(item_to_send);
     }
@@ -62,23 +74,43 @@ namespace graphene { namespace net
       return sizeof(item_id);
     }
 
+    std::shared_ptr<const message> peer_connection::batch_queued_message::get_message(peer_connection_delegate* node)
+    {
+      return node->get_message_for_items(items_to_send, next_item_to_send);
+    }
+
+    size_t peer_connection::batch_queued_message::get_size_in_queue()
+    {
+      return sizeof(item_id) * items_to_send.size();
+    }
+
     peer_connection::peer_connection(peer_connection_delegate* delegate) :
       _node(delegate),
-      _message_connection(this),
-      _total_queued_messages_size(0),
+      _message_connection(this, delegate ? delegate->get_io_thread() : nullptr),
       direction(peer_connection_direction::unknown),
       is_firewalled(firewalled_state::unknown),
+      upload_scheduled_as_syncing(false),
+      bytes_sent_at_last_upload_rate_update(0),
+      upload_rate(0),
       our_state(our_connection_state::disconnected),
       they_have_requested_close(false),
       their_state(their_connection_state::disconnected),
       we_have_requested_close(false),
       negotiation_status(connection_negotiation_status::disconnected),
+      supports_compact_blocks(false),
+      supports_item_batches(false),
+      supports_compression(false),
       number_of_unfetched_item_ids(0),
       peer_needs_sync_items_from_us(true),
       we_need_sync_items_from_peer(true),
+      sync_window(0),
       last_block_number_delegate_has_seen(0),
       inhibit_fetching_sync_blocks(false),
+      inventory_peer_advertised_to_us(GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES * 60, maximum_inventory_size + 1),
+      inventory_advertised_to_peer(GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES * 60, maximum_inventory_size + 1),
       transaction_fetching_inhibited_until(fc::time_point::min()),
+      transaction_tokens(GRAPHENE_NET_PEER_TRANSACTION_BURST),
+      transaction_tokens_refilled(fc::time_point::now()),
       last_known_fork_block_number(0),
       firewall_check_state(nullptr)
 #ifndef NDEBUG
@@ -279,15 +311,21 @@ namespace graphene { namespace net
         ~counter() { assert(_send_message_queue_tasks_counter == 1); --_send_message_queue_tasks_counter; dlog("leaving peer_connection::send_queued_messages_task()"); }
       } concurrent_invocation_counter(_send_message_queue_tasks_running);
 #endif
-      while (!_queued_messages.empty())
+      for (;;)
       {
-        _queued_messages.front()->transmission_start_time = fc::time_point::now();
-        message message_to_send = _queued_messages.front()->get_message(_node);
+        // look again after every message, a block queued meanwhile goes ahead of the transactions still waiting
+        send_queue* queue = std::find_if(std::begin(_send_queues), std::end(_send_queues),
+                                         [](const send_queue& queue) { return !queue.queued_messages.empty(); });
+        if (queue == std::end(_send_queues))
+          break;
+        queued_message& queued_message_to_send = *queue->queued_messages.front();
+        queued_message_to_send.transmission_start_time = fc::time_point::now();
+        std::shared_ptr<const message> message_to_send = queued_message_to_send.get_message(_node);
         try
         {
           dlog("peer_connection::send_queued_messages_task() calling message_oriented_connection::send_message() "
                "to send message of type ${type} for peer ${endpoint}",
-               ("type", message_to_send.msg_type)("endpoint", get_remote_endpoint()));
+               ("type", message_to_send->msg_type)("endpoint", get_remote_endpoint()));
           _message_connection.send_message(message_to_send);
           dlog("peer_connection::send_queued_messages_task()'s call to message_oriented_connection::send_message() completed normally for peer ${endpoint}",
                ("endpoint", get_remote_endpoint()));
@@ -318,22 +356,43 @@ namespace graphene { namespace net
         {
           elog("message_oriented_exception::send_message() threw an unhandled exception");
         }
-        _queued_messages.front()->transmission_finish_time = fc::time_point::now();
-        _total_queued_messages_size -= _queued_messages.front()->get_size_in_queue();
-        _queued_messages.pop();
+        queued_message_to_send.transmission_finish_time = fc::time_point::now();
+        if (!queued_message_to_send.completely_sent())
+          continue;
+        queue->total_queued_messages_size -= queued_message_to_send.get_size_in_queue();
+        queue->queued_messages.pop();
       }
       dlog("leaving peer_connection::send_queued_messages_task() due to queue exhaustion");
     }
 
-    void peer_connection::send_queueable_message(std::unique_ptr<queued_message>&& message_to_send)
+    peer_connection::send_queue_class peer_connection::get_send_queue_class(uint32_t message_or_item_type)
+    {
+      switch (message_or_item_type)
+      {
+      case trx_message_type:
+        return transaction_send_queue;
+      case item_ids_inventory_message_type:
+        return inventory_send_queue;
+      default:
+        return block_send_queue;
+      }
+    }
+
+    void peer_connection::send_queueable_message(std::unique_ptr<queued_message>&& message_to_send, send_queue_class queue_class)
     {
       VERIFY_CORRECT_THREAD();
-      _total_queued_messages_size += message_to_send->get_size_in_queue();
-      _queued_messages.emplace(std::move(message_to_send));
-      if (_total_queued_messages_size > GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES)
+      static const size_t maximum_queued_messages_in_bytes[number_of_send_queues] = {
+        GRAPHENE_NET_MAXIMUM_QUEUED_BLOCK_MESSAGES_IN_BYTES,
+        GRAPHENE_NET_MAXIMUM_QUEUED_INVENTORY_MESSAGES_IN_BYTES,
+        GRAPHENE_NET_MAXIMUM_QUEUED_TRANSACTION_MESSAGES_IN_BYTES
+      };
+      send_queue& queue = _send_queues[queue_class];
+      queue.total_queued_messages_size += message_to_send->get_size_in_queue();
+      queue.queued_messages.emplace(std::move(message_to_send));
+      if (queue.total_queued_messages_size > maximum_queued_messages_in_bytes[queue_class])
       {
-        elog("send queue exceeded maximum size of ${max} bytes (current size ${current} bytes)",
-             ("max", GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES)("current", _total_queued_messages_size));
+        elog("send queue ${queue} exceeded maximum size of ${max} bytes (current size ${current} bytes)",
+             ("queue", (int)queue_class)("max", maximum_queued_messages_in_bytes[queue_class])("current", queue.total_queued_messages_size));
         try
         {
           close_connection();
@@ -358,12 +417,18 @@ namespace graphene { namespace net
     }
 
     void peer_connection::send_message(const message& message_to_send, size_t message_send_time_field_offset)
+    {
+      send_message(std::make_shared<const message>(message_to_send), message_send_time_field_offset);
+    }
+
+    void peer_connection::send_message(std::shared_ptr<const message> message_to_send, size_t message_send_time_field_offset)
     {
       VERIFY_CORRECT_THREAD();
       dlog("peer_connection::send_message() enqueueing message of type ${type} for peer ${endpoint}",
-           ("type", message_to_send.msg_type)("endpoint", get_remote_endpoint()));
-      std::unique_ptr<queued_message> message_to_enqueue(new real_queued_message(message_to_send, message_send_time_field_offset));
-      send_queueable_message(std::move(message_to_enqueue));
+           ("type", message_to_send->msg_type)("endpoint", get_remote_endpoint()));
+      send_queue_class queue_class = get_send_queue_class(message_to_send->msg_type);
+      std::unique_ptr<queued_message> message_to_enqueue(new real_queued_message(std::move(message_to_send), message_send_time_field_offset));
+      send_queueable_message(std::move(message_to_enqueue), queue_class);
     }
 
     void peer_connection::send_item(const item_id& item_to_send)
@@ -372,7 +437,18 @@ namespace graphene { namespace net
       dlog("peer_connection::send_item() enqueueing message of type ${type} for peer ${endpoint}",
            ("type", item_to_send.item_type)("endpoint", get_remote_endpoint()));
       std::unique_ptr<queued_message> message_to_enqueue(new virtual_queued_message(item_to_send));
-      send_queueable_message(std::move(message_to_enqueue));
+      send_queueable_message(std::move(message_to_enqueue), get_send_queue_class(item_to_send.item_type));
+    }
+
+    void peer_connection::send_items(std::vector<item_id> items_to_send)
+    {
+      VERIFY_CORRECT_THREAD();
+      dlog("peer_connection::send_items() enqueueing a batch of ${count} items for peer ${endpoint}",
+           ("count", items_to_send.size())("endpoint", get_remote_endpoint()));
+      // a batch answers one fetch_items_message, so its items are all of one type
+      send_queue_class queue_class = items_to_send.empty() ? block_send_queue : get_send_queue_class(items_to_send.front().item_type);
+      std::unique_ptr<queued_message> message_to_enqueue(new batch_queued_message(std::move(items_to_send)));
+      send_queueable_message(std::move(message_to_enqueue), queue_class);
     }
 
     void peer_connection::close_connection()
@@ -456,26 +532,24 @@ namespace graphene { namespace net
       return _message_connection.get_shared_secret();
     }
 
+    void peer_connection::enable_compression()
+    {
+      VERIFY_CORRECT_THREAD();
+      supports_compression = true;
+      _message_connection.enable_compression(GRAPHENE_NET_COMPRESSION_THRESHOLD_IN_BYTES);
+    }
+
     void peer_connection::clear_old_inventory()
     {
       VERIFY_CORRECT_THREAD();
-      fc::time_point_sec oldest_inventory_to_keep(fc::time_point::now() - fc::minutes(GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES));
-
-      // expire old items from inventory_advertised_to_peer
-      auto oldest_inventory_to_keep_iter = inventory_advertised_to_peer.get<timestamp_index>().lower_bound(oldest_inventory_to_keep);
-      auto begin_iter = inventory_advertised_to_peer.get<timestamp_index>().begin();
-      unsigned number_of_elements_advertised_to_peer_to_discard = std::distance(begin_iter, oldest_inventory_to_keep_iter);
-      inventory_advertised_to_peer.get<timestamp_index>().erase(begin_iter, oldest_inventory_to_keep_iter);
-
-      // also expire items from inventory_peer_advertised_to_us
-      oldest_inventory_to_keep_iter = inventory_peer_advertised_to_us.get<timestamp_index>().lower_bound(oldest_inventory_to_keep);
-      begin_iter = inventory_peer_advertised_to_us.get<timestamp_index>().begin();
-      unsigned number_of_elements_peer_advertised_to_discard = std::distance(begin_iter, oldest_inventory_to_keep_iter);
-      inventory_peer_advertised_to_us.get<timestamp_index>().erase(begin_iter, oldest_inventory_to_keep_iter);
-      dlog("Expiring old inventory for peer ${peer}: removing ${to_peer} items advertised to peer (${remain_to_peer} left), and ${to_us} advertised to us (${remain_to_us} left)",
+      // the sets forget whole buckets of items at once, so this doesn't depend on how many expire
+      fc::time_point_sec now(fc::time_point::now());
+      inventory_advertised_to_peer.expire(now);
+      inventory_peer_advertised_to_us.expire(now);
+      dlog("Expired old inventory for peer ${peer}: ${remain_to_peer} items advertised to peer left, and ${remain_to_us} advertised to us left",
            ("peer", get_remote_endpoint())
-           ("to_peer", number_of_elements_advertised_to_peer_to_discard)("remain_to_peer", inventory_advertised_to_peer.size())
-           ("to_us", number_of_elements_peer_advertised_to_discard)("remain_to_us", inventory_peer_advertised_to_us.size()));
+           ("remain_to_peer", inventory_advertised_to_peer.size())
+           ("remain_to_us", inventory_peer_advertised_to_us.size()));
     }
 
     // we have a higher limit for blocks than transactions so we will still fetch blocks even when transactions are throttled
@@ -488,12 +562,26 @@ namespace graphene { namespace net
     bool peer_connection::is_inventory_advertised_to_us_list_full() const
     {
       VERIFY_CORRECT_THREAD();
-      // allow the total inventory size to be the maximum number of transactions we'll store in the inventory (above)
-      // plus the maximum number of blocks that would be generated in GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES (plus one,
-      // to give us some wiggle room)
-      return inventory_peer_advertised_to_us.size() >
-        GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES * GRAPHENE_NET_MAX_TRX_PER_SECOND * 60 +
-        (GRAPHENE_NET_MAX_INVENTORY_SIZE_IN_MINUTES + 1) * 60 / GRAPHENE_MAX_BLOCK_INTERVAL;
+      return inventory_peer_advertised_to_us.size() > maximum_inventory_size;
+    }
+
+    size_t peer_connection::get_memory_usage() const
+    {
+      VERIFY_CORRECT_THREAD();
+      // node-based containers are counted at their elements plus a few pointers each
+      const size_t node_overhead = 4 * sizeof(void*);
+      size_t usage = sizeof(*this);
+      usage += inventory_peer_advertised_to_us.memory_usage() + inventory_advertised_to_peer.memory_usage();
+      usage += ids_of_items_to_get.size() * sizeof(item_hash_t);
+      usage += ids_of_items_being_processed.size() * (sizeof(item_hash_t) + node_overhead);
+      usage += (sync_items_requested_from_peer.size() + items_requested_from_peer.size()) *
+               (sizeof(item_to_time_map_type::value_type) + node_overhead);
+      for (const auto& partial_block : partial_compact_blocks)
+        usage += sizeof(partial_block) + node_overhead +
+                 partial_block.second.second.size() * sizeof(fc::optional<signed_transaction>);
+      for (const send_queue& queue : _send_queues)
+        usage += queue.total_queued_messages_size;
+      return usage;
     }
 
     bool peer_connection::performing_firewall_check() const
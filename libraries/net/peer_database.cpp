@@ -21,6 +21,7 @@
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/mem_fun.hpp>
 #include <boost/multi_index/tag.hpp>
+#include <boost/multi_index/composite_key.hpp>
 
 #include <fc/io/raw.hpp>
 #include <fc/io/raw_variant.hpp>
@@ -53,6 +54,14 @@ namespace graphene { namespace net {
 
       const fc::time_point_sec& get_last_seen_time() const { return peer_record.last_seen_time; }
       const fc::ip::endpoint&   get_endpoint() const { return peer_record.endpoint; }
+      bool last_connection_attempt_failed() const
+      {
+        return peer_record.last_connection_disposition == last_connection_failed ||
+               peer_record.last_connection_disposition == last_connection_rejected ||
+               peer_record.last_connection_disposition == last_connection_handshaking_failed;
+      }
+      uint32_t get_number_of_failed_connection_attempts() const { return peer_record.number_of_failed_connection_attempts; }
+      const fc::time_point_sec& get_last_connection_attempt_time() const { return peer_record.last_connection_attempt_time; }
     };
 
     class peer_database_impl
@@ -60,6 +69,7 @@ namespace graphene { namespace net {
     public:
       struct last_seen_time_index {};
       struct endpoint_index {};
+      struct connection_eligibility_index {};
       typedef boost::multi_index_container< potential_peer_database_entry, 
                                               indexed_by< ordered_non_unique< tag<last_seen_time_index>, 
                                                                               const_mem_fun< potential_peer_database_entry, 
@@ -72,7 +82,17 @@ namespace graphene { namespace net {
                                                                                         &potential_peer_database_entry::get_endpoint 
                                                                                       >, 
                                                                          std::hash<fc::ip::endpoint>  
-                                                                       > 
+                                                                       >,
+                                                          ordered_non_unique< tag<connection_eligibility_index>,
+                                                                              composite_key< potential_peer_database_entry,
+                                                                                             const_mem_fun< potential_peer_database_entry, bool,
+                                                                                                            &potential_peer_database_entry::last_connection_attempt_failed >,
+                                                                                             const_mem_fun< potential_peer_database_entry, uint32_t,
+                                                                                                            &potential_peer_database_entry::get_number_of_failed_connection_attempts >,
+                                                                                             const_mem_fun< potential_peer_database_entry, const fc::time_point_sec&,
+                                                                                                            &potential_peer_database_entry::get_last_connection_attempt_time >
+                                                                                           >
+                                                                            >
                                                         > 
                                           > potential_peer_set;
     //private:
@@ -89,6 +109,10 @@ namespace graphene { namespace net {
       void update_entry(const potential_peer_record& updatedRecord);
       potential_peer_record lookup_or_create_entry_for_endpoint(const fc::ip::endpoint& endpointToLookup);
       fc::optional<potential_peer_record> lookup_entry_for_endpoint(const fc::ip::endpoint& endpointToLookup);
+      std::vector<potential_peer_record> get_connection_candidates(fc::time_point_sec now,
+                                                                   uint32_t retry_timeout_seconds,
+                                                                   size_t max_candidates,
+                                                                   const std::function<bool(const potential_peer_record&)>& is_candidate) const;
 
       peer_database::iterator begin() const;
       peer_database::iterator end() const;
@@ -207,6 +231,40 @@ namespace graphene { namespace net {
       return fc::optional<potential_peer_record>();
     }
 
+    std::vector<potential_peer_record> peer_database_impl::get_connection_candidates(fc::time_point_sec now,
+                                                                                      uint32_t retry_timeout_seconds,
+                                                                                      size_t max_candidates,
+                                                                                      const std::function<bool(const potential_peer_record&)>& is_candidate) const
+    {
+      std::vector<potential_peer_record> candidates;
+      const auto& eligibility_index = _potential_peer_set.get<connection_eligibility_index>();
+      auto add_candidates = [&](decltype(eligibility_index.begin()) iter, decltype(eligibility_index.begin()) end) {
+        for (; iter != end && candidates.size() < max_candidates; ++iter)
+          if (is_candidate(iter->peer_record))
+            candidates.push_back(iter->peer_record);
+      };
+
+      // peers whose last connection attempt didn't fail can be tried at any time
+      auto first_failed_peer = eligibility_index.lower_bound(boost::make_tuple(true));
+      add_candidates(eligibility_index.begin(), first_failed_peer);
+
+      // each number of failures waits its own delay, and within it the peers we tried longest ago come first,
+      // so the peers ready for a retry are at the front of each group
+      auto group = first_failed_peer;
+      while (group != eligibility_index.end() && candidates.size() < max_candidates)
+      {
+        uint32_t failures = group->peer_record.number_of_failed_connection_attempts;
+        uint64_t delay_until_retry = uint64_t(failures + 1) * retry_timeout_seconds;
+        if (delay_until_retry < now.sec_since_epoch())
+        {
+          fc::time_point_sec retry_threshold(now.sec_since_epoch() - (uint32_t)delay_until_retry);
+          add_candidates(group, eligibility_index.lower_bound(boost::make_tuple(true, failures, retry_threshold)));
+        }
+        group = eligibility_index.upper_bound(boost::make_tuple(true, failures));
+      }
+      return candidates;
+    }
+
     peer_database::iterator peer_database_impl::begin() const
     {
       return peer_database::iterator(new peer_database_iterator_impl(_potential_peer_set.get<last_seen_time_index>().begin()));
@@ -297,6 +355,14 @@ namespace graphene { namespace net {
     return my->lookup_entry_for_endpoint(endpoint_to_lookup);
   }
 
+  std::vector<potential_peer_record> peer_database::get_connection_candidates(fc::time_point_sec now,
+                                                                             uint32_t retry_timeout_seconds,
+                                                                             size_t max_candidates,
+                                                                             const std::function<bool(const potential_peer_record&)>& is_candidate) const
+  {
+    return my->get_connection_candidates(now, retry_timeout_seconds, max_candidates, is_candidate);
+  }
+
   peer_database::iterator peer_database::begin() const
   {
     return my->begin();
@@ -27,13 +27,15 @@
 #include <fc/exception/exception.hpp>
 
 #include <graphene/net/stcp_socket.hpp>
+#include <graphene/net/config.hpp>
 
 namespace graphene { namespace net {
 
 stcp_socket::stcp_socket()
 //:_buf_len(0)
+   : _write_buffer_used(0)
 #ifndef NDEBUG
-   : _read_buffer_in_use(false),
+   , _read_buffer_in_use(false),
      _write_buffer_in_use(false)
 #endif
 {
@@ -94,7 +96,7 @@ size_t stcp_socket::readsome( char* buffer, size_t len )
     } buffer_in_use_checker(_read_buffer_in_use);
 #endif
 
-    const size_t read_buffer_length = 4096;
+    const size_t read_buffer_length = GRAPHENE_NET_READ_BUFFER_SIZE;
     if (!_read_buffer)
       _read_buffer.reset(new char[read_buffer_length], [](char* p){ delete[] p; });
 
@@ -110,10 +112,23 @@ size_t stcp_socket::readsome( char* buffer, size_t len )
     return s;
 } FC_RETHROW_EXCEPTIONS( warn, "", ("len",len) ) }
 
+/**
+ *   Reads into buf itself and decrypts it in place, as buf stays alive for as long as
+ *   the read can.
+ */
 size_t stcp_socket::readsome( const std::shared_ptr<char>& buf, size_t len, size_t offset ) 
-{
-  return readsome(buf.get() + offset, len);
-}
+{ try {
+    assert( len > 0 && (len % 16) == 0 );
+
+    size_t s = _sock.readsome( buf, len, offset );
+    if( s % 16 )
+    {
+      _sock.read(buf, 16 - (s%16), offset + s);
+      s += 16-(s%16);
+    }
+    _recv_aes.decode( buf.get() + offset, s, buf.get() + offset );
+    return s;
+} FC_RETHROW_EXCEPTIONS( warn, "", ("len",len) ) }
 
 bool stcp_socket::eof()const
 {
@@ -135,23 +150,37 @@ size_t stcp_socket::writesome( const char* buffer, size_t len )
     } buffer_in_use_checker(_write_buffer_in_use);
 #endif
 
-    const std::size_t write_buffer_length = 4096;
+    // the ciphertext is gathered until the buffer fills or the stream is flushed, so the pieces
+    // of a message go out to the socket together
+    const std::size_t write_buffer_length = GRAPHENE_NET_WRITE_BUFFER_SIZE;
     if (!_write_buffer)
       _write_buffer.reset(new char[write_buffer_length], [](char* p){ delete[] p; });
-    len = std::min<size_t>(write_buffer_length, len);
-    memset(_write_buffer.get(), 0, len); // just in case aes.encode screws up
+    if (_write_buffer_used == write_buffer_length)
+      write_buffered_data();
+    len = std::min<size_t>(write_buffer_length - _write_buffer_used, len);
+    char* ciphertext = _write_buffer.get() + _write_buffer_used;
+    memset(ciphertext, 0, len); // just in case aes.encode screws up
     /**
      * every sizeof(crypt_buf) bytes the aes channel
      * has an error and doesn't decrypt properly...  disable
      * for now because we are going to upgrade to something
      * better.
      */
-    uint32_t ciphertext_len = _send_aes.encode( buffer, len, _write_buffer.get() );
+    uint32_t ciphertext_len = _send_aes.encode( buffer, len, ciphertext );
     assert(ciphertext_len == len);
-    _sock.write( _write_buffer, ciphertext_len );
+    _write_buffer_used += ciphertext_len;
     return ciphertext_len;
 } FC_RETHROW_EXCEPTIONS( warn, "", ("len",len) ) }
 
+void stcp_socket::write_buffered_data()
+{
+  if (_write_buffer_used)
+  {
+    _sock.write( _write_buffer, _write_buffer_used );
+    _write_buffer_used = 0;
+  }
+}
+
 size_t stcp_socket::writesome( const std::shared_ptr<const char>& buf, size_t len, size_t offset )
 {
   return writesome(buf.get() + offset, len);
@@ -159,6 +188,7 @@ size_t stcp_socket::writesome( const std::shared_ptr<const char>& buf, size_t le
 
 void stcp_socket::flush()
 {
+  write_buffered_data();
   _sock.flush();
 }
 
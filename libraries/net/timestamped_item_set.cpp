@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/net/timestamped_item_set.hpp>
+
+#include <algorithm>
+#include <functional>
+
+namespace graphene { namespace net {
+
+  timestamped_item_set::timestamped_item_set(uint32_t window_seconds, uint32_t max_size) :
+    _window_seconds(window_seconds),
+    _bucket_seconds(std::max<uint32_t>(window_seconds / number_of_buckets, 1)),
+    _max_size(max_size)
+  {
+  }
+
+  bool timestamped_item_set::insert(const item_id& item, fc::time_point_sec now)
+  {
+    // the set's clock never runs backwards, and it keeps at most number_of_buckets buckets
+    uint32_t bucket = std::max(bucket_for(now), _newest_bucket);
+    if (bucket - _oldest_bucket >= number_of_buckets)
+      drop_buckets_before(bucket - number_of_buckets + 1);
+    _newest_bucket = bucket;
+
+    if (find(item) != npos)
+      return false;
+    while (_size >= _max_size && _oldest_bucket < _newest_bucket)
+      drop_buckets_before(_oldest_bucket + 1);
+    if (_size >= _max_size)
+      return false;
+
+    if ((_used_slots + 1) * 4 > _slots.size() * 3)
+      rebuild();
+    size_t mask = _slots.size() - 1;
+    size_t index = std::hash<item_id>()(item) & mask;
+    // the item isn't live anywhere, so the first slot without a live item will do
+    while (is_live(_slots[index]))
+      index = (index + 1) & mask;
+    slot& s = _slots[index];
+    if (s.bucket == empty_slot)
+      ++_used_slots;
+    s.item = item;
+    s.bucket = bucket;
+    ++_bucket_sizes[bucket % number_of_buckets];
+    ++_size;
+    return true;
+  }
+
+  bool timestamped_item_set::contains(const item_id& item) const
+  {
+    return find(item) != npos;
+  }
+
+  void timestamped_item_set::erase(const item_id& item)
+  {
+    size_t index = find(item);
+    if (index == npos)
+      return;
+    --_bucket_sizes[_slots[index].bucket % number_of_buckets];
+    --_size;
+    // the slot stays used, so the items placed after it are still found
+    _slots[index].bucket = erased_slot;
+  }
+
+  void timestamped_item_set::expire(fc::time_point_sec now)
+  {
+    if (now.sec_since_epoch() < _window_seconds)
+      return;
+    drop_buckets_before(bucket_for(fc::time_point_sec(now.sec_since_epoch() - _window_seconds)));
+  }
+
+  void timestamped_item_set::clear()
+  {
+    std::vector<slot>().swap(_slots);
+    _used_slots = 0;
+    _size = 0;
+    _oldest_bucket = erased_slot + 1;
+    _newest_bucket = erased_slot + 1;
+    std::fill(std::begin(_bucket_sizes), std::end(_bucket_sizes), 0);
+  }
+
+  size_t timestamped_item_set::memory_usage() const
+  {
+    return _slots.capacity() * sizeof(slot);
+  }
+
+  uint32_t timestamped_item_set::bucket_for(fc::time_point_sec time) const
+  {
+    return time.sec_since_epoch() / _bucket_seconds + erased_slot + 1;
+  }
+
+  size_t timestamped_item_set::find(const item_id& item) const
+  {
+    if (_size == 0)
+      return npos;
+    size_t mask = _slots.size() - 1;
+    // the table always has an empty slot, which ends the search
+    for (size_t index = std::hash<item_id>()(item) & mask; _slots[index].bucket != empty_slot; index = (index + 1) & mask)
+      if (is_live(_slots[index]) && _slots[index].item == item)
+        return index;
+    return npos;
+  }
+
+  void timestamped_item_set::drop_buckets_before(uint32_t bucket)
+  {
+    if (bucket <= _oldest_bucket)
+      return;
+    if (bucket - _oldest_bucket >= number_of_buckets)
+    {
+      std::fill(std::begin(_bucket_sizes), std::end(_bucket_sizes), 0);
+      _size = 0;
+    }
+    else
+      for (uint32_t dropped = _oldest_bucket; dropped < bucket; ++dropped)
+      {
+        _size -= _bucket_sizes[dropped % number_of_buckets];
+        _bucket_sizes[dropped % number_of_buckets] = 0;
+      }
+    _oldest_bucket = bucket;
+    _newest_bucket = std::max(_newest_bucket, _oldest_bucket);
+  }
+
+  void timestamped_item_set::rebuild()
+  {
+    size_t capacity = 16;
+    while (capacity < (size_t(_size) + 1) * 2)
+      capacity *= 2;
+    std::vector<slot> old_slots(capacity);
+    old_slots.swap(_slots);
+    _used_slots = 0;
+    size_t mask = capacity - 1;
+    for (const slot& s : old_slots)
+      if (is_live(s))
+      {
+        size_t index = std::hash<item_id>()(s.item) & mask;
+        while (_slots[index].bucket != empty_slot)
+          index = (index + 1) & mask;
+        _slots[index] = s;
+        ++_used_slots;
+      }
+  }
+
+} } // end namespace graphene::net
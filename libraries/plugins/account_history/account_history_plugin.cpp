@@ -29,6 +29,14 @@
 
 #include <fc/thread/thread.hpp>
 
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+#include <atomic>
+#include <map>
+#include <thread>
+#include <unordered_map>
+
 namespace graphene { namespace account_history {
 
 namespace detail
@@ -57,7 +65,7 @@ class account_update_observer : public graphene::chain::evaluation_observer
       account_update_observer( account_history_plugin& plugin )
           : _plugin( plugin )
       {
-         _pre_account_keys.reserve( GRAPHENE_DEFAULT_MAX_AUTHORITY_MEMBERSHIP * 2 + 2 );
+         _pre_account_addresses.reserve( GRAPHENE_DEFAULT_MAX_AUTHORITY_MEMBERSHIP * 2 + 2 );
       }
       virtual ~account_update_observer();
 
@@ -82,7 +90,7 @@ class account_update_observer : public graphene::chain::evaluation_observer
           const operation_result& result ) override;
 
       account_history_plugin& _plugin;
-      flat_set< key_id_type > _pre_account_keys;
+      flat_set< address > _pre_account_addresses;
 };
 
 class account_history_plugin_impl
@@ -91,19 +99,45 @@ class account_history_plugin_impl
       account_history_plugin_impl(account_history_plugin& _plugin)
          : _self( _plugin ),
            _create_observer( _plugin ),
-           _update_observer( _plugin )
+           _update_observer( _plugin ),
+           _indexing_thread( "account_history" )
       { }
       virtual ~account_history_plugin_impl();
 
+      /**
+       * Brings the key to account index in line with the accounts, deriving the addresses of their keys on the
+       * worker threads while the chain carries on
+       */
       void rebuild_key_account_index();
 
       flat_set<key_id_type> get_keys_for_account(
           const account_id_type& account_id );
+      flat_set<address> get_addresses( const flat_set<key_id_type>& key_ids );
+      void add_key_account( const address& addr, account_id_type account_id );
+      /// Removes account_id from the accounts of addr, and the key_account_object once it has none left
+      void remove_key_account( const address& addr, account_id_type account_id );
 
       /** this method is called as a callback after a block is applied
-       * and will process/index all operations that were applied in the block.
+       * and queues all operations that were applied in the block to be indexed
+       * by index_block() on _indexing_thread.
        */
       void update_account_histories( const signed_block& b );
+      /// Queues the operations of a block to be indexed on _indexing_thread
+      void queue_block( uint32_t block_num, const shared_ptr<vector<operation_history_object>>& ops );
+      void index_block( uint32_t block_num, const vector<operation_history_object>& hist,
+                        uint32_t last_irreversible_block_num, uint32_t prune_before_block );
+      /// Waits until every queued block is indexed
+      void wait_for_indexing();
+
+      /**
+       * Starts indexing the blocks after the last one in the history from the block database, while the chain
+       * carries on.  The blocks are read on the main thread a few at a time and indexed on _indexing_thread like
+       * the applied ones.
+       */
+      void start_replay();
+      void replay_some_blocks();
+      /// The operations of a stored block, as far as the block itself tells them
+      shared_ptr<vector<operation_history_object>> operations_of_block( const signed_block& b )const;
       void index_account_keys( const account_id_type& account_id );
 
       graphene::chain::database& database()
@@ -115,6 +149,42 @@ class account_history_plugin_impl
       account_create_observer _create_observer;
       account_update_observer _update_observer;
       flat_set<account_id_type> _tracked_accounts;
+      /// The operation types, by tag, which are left out of the histories
+      flat_set<int>             _excluded_operations;
+      /// How long the stored history is kept, or 0 for ever
+      uint32_t                  _max_history_seconds = 0;
+
+      /// Held exclusively while a block is indexed and shared by the queries
+      mutable boost::shared_mutex _history_mutex;
+      account_history_store     _history;
+      /// The number of blocks waiting on _indexing_thread
+      std::atomic<uint32_t>     _queued_blocks{ 0 };
+      fc::thread                _indexing_thread;
+
+      bool                      _replaying = false;
+      /// The last block queued by the replay, or by the chain once the replay caught up with it
+      uint32_t                  _replayed_through = 0;
+      /// The operations of the blocks applied during the replay which it has yet to reach, by block number
+      std::map< uint32_t, shared_ptr<vector<operation_history_object>> > _applied_during_replay;
+      fc::future<void>          _replay_task;
+
+      fc::future<void>          _key_index_task;
+      /// Set while the addresses are derived, when the accounts whose keys change are noted
+      bool                      _rebuilding_key_index = false;
+      flat_set<account_id_type> _accounts_changed_during_rebuild;
+      static const uint32_t     replay_blocks_per_task = 100;
+};
+
+/// The unqualified name of an operation type, e.g. fill_order_operation
+struct operation_name
+{
+   typedef string result_type;
+   template<typename T>
+   string operator()( const T& )const
+   {
+      string name = fc::get_typename<T>::name();
+      return name.substr( name.find_last_of( ':' ) + 1 );
+   }
 };
 
 struct operation_get_impacted_accounts
@@ -220,7 +290,7 @@ struct operation_get_impacted_accounts
 
    void operator()( const proposal_create_operation& o )const {
        for( auto op : o.proposed_ops )
-          op.op.visit( operation_get_required_auths( _impacted, _impacted ) );
+          graphene::chain::dispatch( op.op, operation_get_required_auths( _impacted, _impacted ) );
    }
 
    void operator()( const proposal_update_operation& o )const { }
@@ -257,6 +327,11 @@ struct operation_get_impacted_accounts
       _impacted.insert( o.owner );
    }
 
+   void operator()( const vesting_balance_withdraw_all_operation& o )const
+   {
+      _impacted.insert( o.owner );
+   }
+
    void operator()( const worker_create_operation& )const
    {}
 };
@@ -328,7 +403,7 @@ void account_update_observer::pre_evaluate(
    //}
 
    const account_update_operation& update_op = op.get< account_update_operation >();
-   _pre_account_keys = _plugin.my->get_keys_for_account( update_op.account );
+   _pre_account_addresses = _plugin.my->get_addresses( _plugin.my->get_keys_for_account( update_op.account ) );
    return;
 }
 
@@ -345,68 +420,36 @@ void account_update_observer::post_evaluate(
    if( !apply )
       return;
 
-   graphene::chain::database& db = _plugin.my->database();
-
    // if we only care about given accounts, then key -> account mapping
    //   is not maintained
    if( _plugin.my->_tracked_accounts.size() > 0 )
        return;
 
-   // wild back-of-envelope heuristic:  most account update ops
-   //   don't add more than two keys
-   flat_set<key_id_type> post_account_keys;
-   post_account_keys.reserve( _pre_account_keys.size() + 2 );
-
-   vector<key_id_type> removed_account_keys;
-   removed_account_keys.reserve( _pre_account_keys.size() );
-
+   // Only the addresses the update added or removed change in the index.  Addresses are compared rather than key
+   //    ids, since several key ids may alias one address: an address stays as long as any of its aliases does.
    const account_update_operation& update_op = op.get< account_update_operation >();
-   post_account_keys = _plugin.my->get_keys_for_account( update_op.account );
+   flat_set<address> post_account_addresses = _plugin.my->get_addresses( _plugin.my->get_keys_for_account( update_op.account ) );
 
+   vector<address> changed_addresses;
+   changed_addresses.reserve( _pre_account_addresses.size() + post_account_addresses.size() );
    std::set_difference(
-      _pre_account_keys.begin(), _pre_account_keys.end(),
-      post_account_keys.begin(), post_account_keys.end(),
-      std::back_inserter( removed_account_keys )
+      _pre_account_addresses.begin(), _pre_account_addresses.end(),
+      post_account_addresses.begin(), post_account_addresses.end(),
+      std::back_inserter( changed_addresses )
       );
+   for( const address& addr : changed_addresses )
+      _plugin.my->remove_key_account( addr, update_op.account );
 
-   //
-   // If a key_id is in _pre_account_keys but not in post_account_keys,
-   //    then it is placed in removed_account_keys by set_difference().
-   //
-   // Note, the *address* corresponding to this key may still exist
-   //    in the account, because it may be aliased to multiple key_id's.
-   //
-   // We delete the key_account_object for all removed_account_keys.
-   //    This correctly deletes addresses which were removed
-   //    from the account by the update_op.
-   //
-   // Unfortunately, in the case of aliased keys, it deletes
-   //    key_account_object if *any* of the aliases was removed from
-   //    the account.  We want it to delete only if *all* of the aliases
-   //    were removed from the account.
-   //
-   // However, we need to run index_account_keys() afterwards anyway.
-   //    It will re-add to the index any addresses which had been
-   //    deleted -- but only if they still exist in the account under
-   //    at least one alias.
-   //
-   // This is precisely the correct behavior.
-   //
-
-   for( const key_id_type& key_id : removed_account_keys )
-   {
-      auto& index = db.get_index_type<key_account_index>().indices().get<by_key>();
-      auto it = index.find( key_id(db).key_address() );
-      assert( it != index.end() );
-
-      db.modify<key_account_object>( *it, [&]( key_account_object& ka )
-      {
-         ka.account_ids.erase( update_op.account );
-      });
-   }
-
-   _plugin.my->index_account_keys( update_op.account );
+   changed_addresses.clear();
+   std::set_difference(
+      post_account_addresses.begin(), post_account_addresses.end(),
+      _pre_account_addresses.begin(), _pre_account_addresses.end(),
+      std::back_inserter( changed_addresses )
+      );
+   for( const address& addr : changed_addresses )
+      _plugin.my->add_key_account( addr, update_op.account );
 
+   _pre_account_addresses.clear();
    return;
 }
 
@@ -427,26 +470,119 @@ void account_update_observer::evaluation_failed(
        return;
 
    // cleaning up here is not strictly necessary, but good "hygiene"
-   _pre_account_keys.clear();
+   _pre_account_addresses.clear();
    return;
 }
 
 account_history_plugin_impl::~account_history_plugin_impl()
 {
-   return;
+   try {
+      wait_for_indexing();
+   } catch ( const fc::exception& e ) {
+      elog( "${e}", ("e", e.to_detail_string()) );
+   }
+}
+
+void account_history_plugin_impl::wait_for_indexing()
+{
+   _indexing_thread.async( []{} ).wait();
+}
+
+typedef static_variant<address,public_key_type> address_or_key;
+
+/**
+ * Unlike key_object::key_address(), this does not fill in the address cached in the key, so it may run on several
+ * threads at once
+ */
+static address key_address_of( const address_or_key& key_data )
+{
+   if( key_data.which() == address_or_key::tag<address>::value )
+      return key_data.get<address>();
+   return address( key_data.get<public_key_type>() );
 }
 
 void account_history_plugin_impl::rebuild_key_account_index()
 {
-   // TODO:  We should really delete the index before we re-create it.
-   // TODO:  Building and sorting a vector of tuples is probably more efficient
-   const graphene::chain::database& db = database();
+   graphene::chain::database& db = database();
 
-   vector< pair< account_id_type, address > > tuples_from_db;
-   const auto& primary_account_idx = db.get_index_type<account_index>().indices().get<by_id>();
-   for( const account_object& acct : primary_account_idx )
-      index_account_keys( acct.id );
-   return;
+   // The keys are copied out here, since the chain carries on while the addresses are derived from them.  The
+   //    accounts whose keys change meanwhile are noted by add_key_account() and remove_key_account(), and looked up
+   //    again at the end.  The copies are shared with the workers, which finish with them even if this is canceled.
+   struct work
+   {
+      vector< pair< account_id_type, vector<address_or_key> > > account_keys;
+      vector< vector< pair<address, account_id_type> > >         found;
+   };
+   auto rebuild = std::make_shared<work>();
+   for( const account_object& acct : db.get_index_type<account_index>().indices() )
+   {
+      vector<address_or_key> keys;
+      for( const key_id_type& key_id : get_keys_for_account( acct.id ) )
+         keys.push_back( key_id(db).key_data );
+      rebuild->account_keys.emplace_back( acct.id, std::move( keys ) );
+   }
+   _accounts_changed_during_rebuild.clear();
+   _rebuilding_key_index = true;
+
+   // Deriving the addresses of the public keys is most of the work, so the accounts are split over the worker threads
+   const utilities::thread_group& threads = _self.app().thread_pools().get( "worker", std::max( 1u, std::thread::hardware_concurrency() ) );
+   const size_t thread_count = std::max<size_t>( 1, std::min<size_t>( threads.size(), rebuild->account_keys.size() / 1000 + 1 ) );
+   rebuild->found.resize( thread_count );
+   auto derive = [rebuild, thread_count]( size_t part ) {
+      for( size_t j = part; j < rebuild->account_keys.size(); j += thread_count )
+         for( const address_or_key& key_data : rebuild->account_keys[j].second )
+            rebuild->found[part].emplace_back( key_address_of( key_data ), rebuild->account_keys[j].first );
+   };
+   try {
+      if( threads.empty() )
+         derive( 0 );
+      else
+      {
+         vector< fc::future<void> > done;
+         for( size_t i = 0; i < thread_count; ++i )
+            done.push_back( threads[i]->async( [derive, i]() { derive( i ); }, "rebuild_key_account_index" ) );
+         for( auto& f : done )
+            f.wait();
+      }
+   } catch( ... ) {
+      _rebuilding_key_index = false;
+      throw;
+   }
+   _rebuilding_key_index = false;
+
+   // Bring the stored index in line, only touching the objects which differ.  Nothing yields from here on.
+   db.without_pending_transactions( [&]() {
+      std::unordered_map< address, flat_set<account_id_type> > accounts_by_address;
+      for( const auto& part : rebuild->found )
+         for( const auto& item : part )
+            if( !_accounts_changed_during_rebuild.count( item.second ) )
+               accounts_by_address[item.first].insert( item.second );
+      for( const account_id_type& account_id : _accounts_changed_during_rebuild )
+         for( const address& addr : get_addresses( get_keys_for_account( account_id ) ) )
+            accounts_by_address[addr].insert( account_id );
+      _accounts_changed_during_rebuild.clear();
+
+      vector<const key_account_object*> stale;
+      for( const key_account_object& ka : db.get_index_type<key_account_index>().indices() )
+      {
+         auto itr = accounts_by_address.find( ka.key );
+         if( itr == accounts_by_address.end() )
+            stale.push_back( &ka );
+         else
+         {
+            if( itr->second != ka.account_ids )
+               db.modify( ka, [&]( key_account_object& obj ) { obj.account_ids = std::move( itr->second ); } );
+            accounts_by_address.erase( itr );
+         }
+      }
+      for( const key_account_object* ka : stale )
+         db.remove( *ka );
+      for( auto& item : accounts_by_address )
+         db.create<key_account_object>( [&]( key_account_object& ka ) {
+            ka.key = item.first;
+            ka.account_ids = std::move( item.second );
+         } );
+   });
 }
 
 flat_set<key_id_type> account_history_plugin_impl::get_keys_for_account( const account_id_type& account_id )
@@ -480,109 +616,254 @@ flat_set<key_id_type> account_history_plugin_impl::get_keys_for_account( const a
    return key_id_set;
 }
 
-void account_history_plugin_impl::index_account_keys( const account_id_type& account_id )
+flat_set<address> account_history_plugin_impl::get_addresses( const flat_set<key_id_type>& key_ids )
 {
-   // for each key in account authority... get address, modify(..)
-   graphene::chain::database& db = database();
-
-   flat_set<key_id_type> key_id_set = get_keys_for_account( account_id );
-
-   flat_set<address> address_set;
+   const graphene::chain::database& db = database();
 
    //
    // we pass the addresses through another flat_set because the
    //    blockchain doesn't force de-duplication of addresses
    //    (multiple key_id's might refer to the same address)
    //
-   address_set.reserve( key_id_set.size() );
-
-   for( const key_id_type& key_id : key_id_set )
+   flat_set<address> address_set;
+   address_set.reserve( key_ids.size() );
+   for( const key_id_type& key_id : key_ids )
       address_set.insert( key_id(db).key_address() );
+   return address_set;
+}
 
-   // add mappings for the given account
-   for( const address& addr : address_set )
+void account_history_plugin_impl::add_key_account( const address& addr, account_id_type account_id )
+{
+   if( _rebuilding_key_index )
+      _accounts_changed_during_rebuild.insert( account_id );
+   graphene::chain::database& db = database();
+   const auto& idx = db.get_index_type<key_account_index>().indices().get<by_key>();
+   auto it = idx.find( addr );
+   if( it == idx.end() )
+   {
+      // if unknown, we need to create a new object
+      db.create<key_account_object>( [&]( key_account_object& ka )
+      {
+         ka.key = addr;
+         ka.account_ids.insert( account_id );
+      });
+   }
+   else if( !it->account_ids.count( account_id ) )
    {
-       auto& idx = db.get_index_type<key_account_index>().indices().get<by_key>();
-       auto it = idx.find( addr );
-       if( it == idx.end() )
-       {
-          // if unknown, we need to create a new object
-          db.create<key_account_object>( [&]( key_account_object& ka )
-          {
-             ka.key = addr;
-             ka.account_ids.insert( account_id );
-          });
-       }
-       else
-       {
-          // if known, we need to add to existing object
-          db.modify<key_account_object>( *it,
-             [&]( key_account_object& ka )
-             {
-                ka.account_ids.insert( account_id );
-             });
-       }
+      // if known, we need to add to existing object
+      db.modify<key_account_object>( *it,
+         [&]( key_account_object& ka )
+         {
+            ka.account_ids.insert( account_id );
+         });
    }
+}
 
-   return;
+void account_history_plugin_impl::remove_key_account( const address& addr, account_id_type account_id )
+{
+   if( _rebuilding_key_index )
+      _accounts_changed_during_rebuild.insert( account_id );
+   graphene::chain::database& db = database();
+   const auto& idx = db.get_index_type<key_account_index>().indices().get<by_key>();
+   auto it = idx.find( addr );
+   if( it == idx.end() || !it->account_ids.count( account_id ) )
+      return;
+   if( it->account_ids.size() == 1 )
+      db.remove( *it );
+   else
+      db.modify<key_account_object>( *it, [&]( key_account_object& ka )
+      {
+         ka.account_ids.erase( account_id );
+      });
+}
+
+void account_history_plugin_impl::index_account_keys( const account_id_type& account_id )
+{
+   // add mappings for the given account, for each address in its authorities
+   for( const address& addr : get_addresses( get_keys_for_account( account_id ) ) )
+      add_key_account( addr, account_id );
 }
 
 void account_history_plugin_impl::update_account_histories( const signed_block& b )
 {
    graphene::chain::database& db = database();
    const vector<operation_history_object>& hist = db.get_applied_operations();
-   for( auto op : hist )
+
+   // The keys of tracked accounts are indexed in the object database, which only this thread may touch
+   if( _tracked_accounts.size() > 0 )
    {
-      // add to the operation history index
-      const auto& oho = db.create<operation_history_object>( [&]( operation_history_object& h ){
-                                h = op;
-                        });
+      for( const auto& op : hist )
+      {
+         flat_set<account_id_type> impacted;
+         graphene::chain::dispatch( op.op, operation_get_required_auths( impacted, impacted ) );
+         graphene::chain::dispatch( op.op, operation_get_impacted_accounts( op, _self, impacted ) );
+         for( auto account_id : _tracked_accounts )
+            if( impacted.find( account_id ) != impacted.end() )
+               index_account_keys( account_id );
+      }
+   }
+
+   // Keep a replay from queueing up more operations than fit in memory
+   if( _queued_blocks > 1000 )
+      wait_for_indexing();
+   auto ops = std::make_shared<vector<operation_history_object>>( hist );
+   const uint32_t block_num = b.block_num();
+   if( _replaying )
+   {
+      // A block re-applied after a fork switch replaces those it was popped back past
+      _applied_during_replay.erase( _applied_during_replay.lower_bound( block_num ), _applied_during_replay.end() );
+      if( block_num > _replayed_through + 1 )
+      {
+         // The replay indexes it in turn, with the operations the chain produced rather than those of the block
+         _applied_during_replay[block_num] = ops;
+         return;
+      }
+      _replayed_through = block_num;
+   }
+   queue_block( block_num, ops );
+}
+
+void account_history_plugin_impl::queue_block( uint32_t block_num,
+                                               const shared_ptr<vector<operation_history_object>>& ops )
+{
+   graphene::chain::database& db = database();
+   uint32_t prune_before_block = 0;
+   if( _max_history_seconds )
+   {
+      const uint32_t kept_blocks = _max_history_seconds / db.get_global_properties().parameters.block_interval;
+      if( block_num > kept_blocks )
+         prune_before_block = block_num - kept_blocks;
+   }
+
+   ++_queued_blocks;
+   const uint32_t last_irreversible_block_num = db.get_dynamic_global_properties().last_irreversible_block_num;
+   _indexing_thread.async( [this, ops, block_num, last_irreversible_block_num, prune_before_block]() {
+      try {
+         index_block( block_num, *ops, last_irreversible_block_num, prune_before_block );
+      } catch ( const fc::exception& e ) {
+         elog( "Failed to index the account history of block ${n}: ${e}", ("n", block_num)("e", e.to_detail_string()) );
+      }
+      --_queued_blocks;
+   } );
+}
+
+void account_history_plugin_impl::start_replay()
+{
+   _replayed_through = _history.head_block_num();
+   if( _replayed_through >= database().head_block_num() )
+      return;
+   ilog( "Indexing the account history of blocks ${first} through ${last} from the block database",
+         ("first", _replayed_through + 1)("last", database().head_block_num()) );
+   _replaying = true;
+   _replay_task = fc::async( [this]{ replay_some_blocks(); }, "account_history::replay" );
+}
+
+void account_history_plugin_impl::replay_some_blocks()
+{
+   graphene::chain::database& db = database();
+   if( _queued_blocks > 1000 )
+      wait_for_indexing();
+
+   // Nothing here yields to other tasks, so the chain can not apply a block while these are queued
+   const uint32_t last = std::min( db.head_block_num(), _replayed_through + replay_blocks_per_task );
+   while( _replayed_through < last )
+   {
+      const uint32_t block_num = _replayed_through + 1;
+      shared_ptr<vector<operation_history_object>> ops;
+      auto applied = _applied_during_replay.find( block_num );
+      if( applied != _applied_during_replay.end() )
+      {
+         ops = applied->second;
+         _applied_during_replay.erase( applied );
+      }
+      else
+      {
+         optional<signed_block> b = db.fetch_block_by_number( block_num );
+         if( b )
+            ops = operations_of_block( *b );
+         else
+         {
+            wlog( "Block ${n} is not in the block database, so its operations are left out of the account history",
+                  ("n", block_num) );
+            ops = std::make_shared<vector<operation_history_object>>();
+         }
+      }
+      queue_block( block_num, ops );
+      _replayed_through = block_num;
+   }
+
+   if( _replayed_through < db.head_block_num() )
+   {
+      _replay_task = fc::async( [this]{ replay_some_blocks(); }, "account_history::replay" );
+      return;
+   }
+   _replaying = false;
+   _applied_during_replay.clear();
+   ilog( "The account history caught up with the chain at block ${n}", ("n", _replayed_through) );
+}
+
+shared_ptr<vector<operation_history_object>> account_history_plugin_impl::operations_of_block( const signed_block& b )const
+{
+   // The virtual operations, such as order fills, are only known by applying the block, so they are missing
+   auto ops = std::make_shared<vector<operation_history_object>>();
+   const uint32_t block_num = b.block_num();
+   uint16_t virtual_op = 0;
+   for( uint16_t trx_in_block = 0; trx_in_block < b.transactions.size(); ++trx_in_block )
+   {
+      const processed_transaction& trx = b.transactions[trx_in_block];
+      for( uint16_t op_in_trx = 0; op_in_trx < trx.operations.size(); ++op_in_trx )
+      {
+         ops->emplace_back( trx.operations[op_in_trx] );
+         operation_history_object& oh = ops->back();
+         if( op_in_trx < trx.operation_results.size() )
+            oh.result = trx.operation_results[op_in_trx];
+         oh.block_num    = block_num;
+         oh.trx_in_block = trx_in_block;
+         oh.op_in_trx    = op_in_trx;
+         oh.virtual_op   = virtual_op++;
+      }
+   }
+   return ops;
+}
+
+void account_history_plugin_impl::index_block( uint32_t block_num, const vector<operation_history_object>& hist,
+                                               uint32_t last_irreversible_block_num, uint32_t prune_before_block )
+{
+   boost::unique_lock<boost::shared_mutex> lock( _history_mutex );
+   if( !_history.start_block( block_num ) )
+      return;
+
+   for( const auto& op : hist )
+   {
+      if( _excluded_operations.count( op.op.which() ) )
+         continue;
 
       // get the set of accounts this operation applies to
       flat_set<account_id_type> impacted;
-      op.op.visit( operation_get_required_auths( impacted, impacted ) );
-      op.op.visit( operation_get_impacted_accounts( oho, _self, impacted ) );
+      graphene::chain::dispatch( op.op, operation_get_required_auths( impacted, impacted ) );
+      graphene::chain::dispatch( op.op, operation_get_impacted_accounts( op, _self, impacted ) );
 
       // for each operation this account applies to that is in the config link it into the history
       if( _tracked_accounts.size() == 0 )
       {
-         for( auto& account_id : impacted )
-         {
-            // we don't do index_account_keys here anymore, because
-            // that indexing now happens in observers' post_evaluate()
-
-            // add history
-            const auto& stats_obj = account_id(db).statistics(db);
-            const auto& ath = db.create<account_transaction_history_object>( [&]( account_transaction_history_object& obj ){
-                obj.operation_id = oho.id;
-                obj.next = stats_obj.most_recent_op;
-            });
-            db.modify( stats_obj, [&]( account_statistics_object& obj ){
-                obj.most_recent_op = ath.id;
-            });
-         }
+         // we don't do index_account_keys here anymore, because
+         // that indexing now happens in observers' post_evaluate()
+         _history.append( op, impacted );
       }
       else
       {
+         flat_set<account_id_type> tracked;
          for( auto account_id : _tracked_accounts )
-         {
             if( impacted.find( account_id ) != impacted.end() )
-            {
-               index_account_keys( account_id );
-
-               // add history
-               const auto& stats_obj = account_id(db).statistics(db);
-               const auto& ath = db.create<account_transaction_history_object>( [&]( account_transaction_history_object& obj ){
-                   obj.operation_id = oho.id;
-                   obj.next = stats_obj.most_recent_op;
-               });
-               db.modify( stats_obj, [&]( account_statistics_object& obj ){
-                   obj.most_recent_op = ath.id;
-               });
-            }
-         }
+               tracked.insert( account_id );
+         if( !tracked.empty() )
+            _history.append( op, tracked );
       }
    }
+
+   _history.flush( last_irreversible_block_num );
+   if( prune_before_block )
+      _history.prune_before_block( prune_before_block );
 }
 } // end namespace detail
 
@@ -607,6 +888,11 @@ void account_history_plugin::plugin_set_program_options(
 {
    cli.add_options()
          ("track-account", bpo::value<std::vector<std::string>>()->composing()->multitoken(), "Account ID to track history for (may specify multiple times)")
+         ("history-exclude-operation", bpo::value<std::vector<std::string>>()->composing()->multitoken(),
+          "Operation type, by name (e.g. fill_order_operation) or tag, to leave out of account histories (may specify multiple times)")
+         ("max-ops-per-account", bpo::value<uint64_t>(), "Maximum number of operations to keep in the stored history of each account")
+         ("history-max-days", bpo::value<uint32_t>(), "Number of days of stored history to keep; each account keeps at least its last operation")
+         ("replay-account-history", "Drop the stored account history and rebuild it from the block database in the background, without replaying the chain")
          ;
    cfg.add(cli);
 }
@@ -614,19 +900,115 @@ void account_history_plugin::plugin_set_program_options(
 void account_history_plugin::plugin_initialize(const boost::program_options::variables_map& options)
 {
    database().applied_block.connect( [&]( const signed_block& b){ my->update_account_histories(b); } );
-   database().add_index< primary_index< simple_index< operation_history_object > > >();
-   database().add_index< primary_index< simple_index< account_transaction_history_object > > >();
+   database().add_applied_operations_consumer();
    database().add_index< primary_index< key_account_index >>();
 
    database().register_evaluation_observer<account_create_evaluator>( my->_create_observer );
    database().register_evaluation_observer< graphene::chain::account_update_evaluator >( my->_update_observer );
 
-   LOAD_VALUE_SET(options, "tracked-accounts", my->_tracked_accounts, graphene::chain::account_id_type);
+   LOAD_VALUE_SET(options, "track-account", my->_tracked_accounts, graphene::chain::account_id_type);
+
+   if( options.count("history-exclude-operation") )
+   {
+      for( const string& name : options["history-exclude-operation"].as<std::vector<std::string>>() )
+      {
+         int tag = -1;
+         for( int i = 0; i < operation::count() && tag < 0; ++i )
+         {
+            operation op;
+            op.set_which( i );
+            if( op.visit( detail::operation_name() ) == name || fc::to_string( int64_t(i) ) == name )
+               tag = i;
+         }
+         FC_ASSERT( tag >= 0, "Unknown operation type ${name}", ("name", name) );
+         my->_excluded_operations.insert( tag );
+      }
+   }
+   if( options.count("max-ops-per-account") )
+      my->_history.set_max_account_history( options["max-ops-per-account"].as<uint64_t>() );
+   if( options.count("history-max-days") )
+      my->_max_history_seconds = options["history-max-days"].as<uint32_t>() * 86400;
+
+   // Opened before the chain, which may replay blocks as it starts up
+   if( !app().data_dir().empty() )
+   {
+      if( options.count("replay-account-history") )
+      {
+         ilog( "Dropping the stored account history, to rebuild it from the block database" );
+         fc::remove_all( app().data_dir() / "account_history" );
+      }
+      my->_history.open( app().data_dir() / "account_history" );
+   }
 }
 
 void account_history_plugin::plugin_startup()
 {
-   my->rebuild_key_account_index();
+   my->_key_index_task = fc::async( [this]() { my->rebuild_key_account_index(); }, "rebuild_key_account_index" );
+
+   my->wait_for_indexing();
+   if( my->_history.is_open() )
+      my->start_replay();
+}
+
+void account_history_plugin::plugin_shutdown()
+{
+   // The blocks it has yet to index are picked up again at the next start
+   try {
+      if( my->_replay_task.valid() )
+         my->_replay_task.cancel_and_wait( __FUNCTION__ );
+   } catch( fc::canceled_exception& ) {
+      // Expected
+   }
+   // The key index is rebuilt again at the next start
+   try {
+      if( my->_key_index_task.valid() )
+         my->_key_index_task.cancel_and_wait( __FUNCTION__ );
+   } catch( fc::canceled_exception& ) {
+      // Expected
+   }
+   my->wait_for_indexing();
+   boost::unique_lock<boost::shared_mutex> lock( my->_history_mutex );
+   my->_history.close();
+}
+
+void account_history_plugin::wait_for_indexing()
+{
+   my->wait_for_indexing();
+}
+
+void account_history_plugin::wait_for_key_index()
+{
+   if( my->_key_index_task.valid() )
+      my->_key_index_task.wait();
+}
+
+bool account_history_plugin::plugin_is_ready()const
+{
+   return ( !my->_key_index_task.valid() || my->_key_index_task.ready() ) && !my->_replaying;
+}
+
+vector<operation_history_object> account_history_plugin::get_account_history( account_id_type account,
+                                                                              operation_history_id_type stop,
+                                                                              uint32_t limit,
+                                                                              operation_history_id_type start )const
+{
+   boost::shared_lock<boost::shared_mutex> lock( my->_history_mutex );
+   return my->_history.get_account_history( account, stop, limit, start );
+}
+
+vector<operation_history_object> account_history_plugin::get_relative_account_history( account_id_type account,
+                                                                                       uint64_t stop,
+                                                                                       uint32_t limit,
+                                                                                       uint64_t start )const
+{
+   boost::shared_lock<boost::shared_mutex> lock( my->_history_mutex );
+   return my->_history.get_relative_account_history( account, stop, limit, start );
+}
+
+uint64_t account_history_plugin::get_account_history_count( account_id_type account )const
+{
+   boost::shared_lock<boost::shared_mutex> lock( my->_history_mutex );
+   return my->_history.get_account_history_count( account );
 }
 
 flat_set<account_id_type> account_history_plugin::tracked_accounts() const
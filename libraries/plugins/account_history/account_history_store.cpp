@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/account_history/account_history_store.hpp>
+
+#include <limits>
+
+namespace graphene { namespace account_history {
+
+template<typename Visitor>
+void account_history_store::visit_account_history( account_id_type account, uint64_t first, Visitor&& visit )const
+{
+   auto itr = _tail_by_account.upper_bound( account_sequence( account, first ) );
+   while( itr != _tail_by_account.begin() )
+   {
+      --itr;
+      if( itr->first.first != account )
+         break;
+      if( !visit( itr->first.second, itr->second ) )
+         return;
+   }
+   if( !is_open() )
+      return;
+
+   // Then the index on disk, walked backwards from the greatest key not after (account, first)
+   const account_sequence first_key( account, first );
+   auto disk_itr = _account_operations.lower_bound( first_key );
+   if( !disk_itr.valid() )
+      disk_itr = _account_operations.last();
+   else if( first_key < disk_itr.key() )
+      --disk_itr;
+   for( ; disk_itr.valid(); --disk_itr )
+   {
+      auto key = disk_itr.key();
+      if( key.first != account || !visit( key.second, disk_itr.value() ) )
+         return;
+   }
+}
+
+account_history_store::~account_history_store()
+{
+   try {
+      close();
+   } catch ( const fc::exception& e ) {
+      elog( "Failed to write out the account history: ${e}", ("e", e.to_detail_string()) );
+   }
+}
+
+void account_history_store::open( const fc::path& dir )
+{ try {
+   fc::create_directories( dir );
+   _operations.open( dir / "operations" );
+   _account_operations.open( dir / "account_operations" );
+   _meta.open( dir / "meta" );
+
+   uint64_t last_id;
+   if( _operations.last( last_id ) )
+      _next_id = last_id + 1;
+   if( auto stored_block_num = _meta.fetch_optional( "stored_block_num" ) )
+      _stored_block_num = *stored_block_num;
+   // Anything appended before the store was opened follows what is already on disk
+   FC_ASSERT( _tail.empty() );
+} FC_CAPTURE_AND_RETHROW( (dir) ) }
+
+void account_history_store::close()
+{
+   if( !is_open() )
+      return;
+   flush( std::numeric_limits<uint32_t>::max() );
+   _meta.close();
+   _account_operations.close();
+   _operations.close();
+}
+
+bool account_history_store::start_block( uint32_t block_num )
+{
+   if( block_num <= _stored_block_num )
+      return false;
+   if( is_open() && !_head_block_num && block_num > _stored_block_num + 1 )
+      wlog( "The account history has no operations of blocks ${first} through ${last}; replay the chain to fill them in",
+            ("first", _stored_block_num + 1)("last", block_num - 1) );
+   _head_block_num = block_num;
+   while( !_tail.empty() && _tail.back().op.block_num >= block_num )
+      drop_back();
+   return true;
+}
+
+operation_history_id_type account_history_store::append( const operation_history_object& op,
+                                                         const flat_set<account_id_type>& accounts )
+{
+   operation_history_id_type id( _next_id++ );
+   _tail.push_back( stored_operation{ op, {} } );
+   stored_operation& entry = _tail.back();
+   entry.op.id = id;
+   entry.accounts.reserve( accounts.size() );
+   for( auto account : accounts )
+   {
+      account_sequence key( account, get_account_history_count( account ) + 1 );
+      _tail_by_account.emplace( key, id.instance.value );
+      entry.accounts.push_back( key );
+   }
+   return id;
+}
+
+void account_history_store::flush( uint32_t last_irreversible_block_num )
+{
+   const uint32_t stored_block_num = std::min( last_irreversible_block_num, _head_block_num );
+   if( !is_open() || stored_block_num <= _stored_block_num )
+      return;
+
+   // The operations go out first, so a crash in between can at worst lose index entries, never leave entries
+   // pointing at ids which are handed out again
+   {
+      auto batch = _operations.create_batch();
+      for( auto itr = _tail.begin(); itr != _tail.end() && itr->op.block_num <= stored_block_num; ++itr )
+         batch.store( itr->op.id.instance(), *itr );
+   }
+   vector<account_sequence> written;
+   {
+      auto batch = _account_operations.create_batch();
+      while( !_tail.empty() && _tail.front().op.block_num <= stored_block_num )
+      {
+         const stored_operation& entry = _tail.front();
+         for( const auto& key : entry.accounts )
+         {
+            batch.store( key, entry.op.id.instance() );
+            _tail_by_account.erase( key );
+            written.push_back( key );
+         }
+         _tail.pop_front();
+      }
+   }
+   // The watermark goes last, so after a crash the blocks after it are indexed again and skipped up to it
+   _meta.store( "stored_block_num", stored_block_num );
+   _stored_block_num = stored_block_num;
+   if( _max_account_history || _pruned_before_block )
+      for( const auto& key : written )
+         prune_account( key );
+}
+
+void account_history_store::prune_before_block( uint32_t block_num )
+{
+   if( !is_open() || block_num <= _pruned_before_block )
+      return;
+   _pruned_before_block = block_num;
+
+   uint64_t last_id;
+   if( !_operations.last( last_id ) )
+      return;
+   for( auto itr = _operations.lower_bound( _prune_from ); itr.valid() && itr.key() < last_id; ++itr )
+   {
+      const stored_operation stored = itr.value();
+      if( stored.op.block_num >= block_num )
+         break;
+      _prune_from = itr.key() + 1;
+      for( const auto& key : stored.accounts )
+      {
+         // The most recent entry of an account stays until the account has a newer one, on disk or in the tail
+         auto next = _account_operations.lower_bound( account_sequence( key.first, key.second + 1 ) );
+         bool is_last = ( !next.valid() || next.key().first != key.first ) &&
+                        !_tail_by_account.count( account_sequence( key.first, key.second + 1 ) );
+         if( !is_last && _account_operations.find( key ).valid() )
+            remove_entry( key, itr.key() );
+      }
+   }
+}
+
+void account_history_store::remove_entry( const account_sequence& key, uint64_t op )
+{
+   _account_operations.remove( key );
+   uint64_t last_id;
+   if( _operations.last( last_id ) && last_id == op )
+      return;
+   auto stored = _operations.fetch_optional( op );
+   if( !stored )
+      return;
+   for( const auto& other : stored->accounts )
+      if( _account_operations.find( other ).valid() )
+         return;
+   _operations.remove( op );
+}
+
+void account_history_store::prune_account( const account_sequence& key )
+{
+   const account_id_type account = key.first;
+   if( _max_account_history && key.second > _max_account_history )
+   {
+      const uint64_t last_removed = key.second - _max_account_history;
+      for( auto itr = _account_operations.lower_bound( account_sequence( account, 0 ) );
+           itr.valid() && itr.key().first == account && itr.key().second <= last_removed; ++itr )
+         remove_entry( itr.key(), itr.value() );
+   }
+   // The previous entry may have been kept past the age limit only for being the most recent
+   if( _pruned_before_block && key.second > 1 )
+   {
+      const account_sequence previous( account, key.second - 1 );
+      if( auto op = _account_operations.fetch_optional( previous ) )
+      {
+         auto stored = _operations.fetch_optional( *op );
+         if( stored && stored->op.block_num < _pruned_before_block )
+            remove_entry( previous, *op );
+      }
+   }
+}
+
+optional<operation_history_object> account_history_store::find( operation_history_id_type id )const
+{
+   uint64_t instance = id.instance.value;
+   if( !_tail.empty() && instance >= _tail.front().op.id.instance() )
+   {
+      size_t offset = instance - _tail.front().op.id.instance();
+      if( offset < _tail.size() )
+         return _tail[offset].op;
+      return optional<operation_history_object>();
+   }
+   if( !is_open() )
+      return optional<operation_history_object>();
+   if( auto stored = _operations.fetch_optional( instance ) )
+      return stored->op;
+   return optional<operation_history_object>();
+}
+
+uint64_t account_history_store::get_account_history_count( account_id_type account )const
+{
+   uint64_t count = 0;
+   visit_account_history( account, std::numeric_limits<uint64_t>::max(), [&]( uint64_t sequence, uint64_t ) {
+      count = sequence;
+      return false;
+   } );
+   return count;
+}
+
+vector<operation_history_object> account_history_store::get_account_history( account_id_type account,
+                                                                             operation_history_id_type stop,
+                                                                             uint32_t limit,
+                                                                             operation_history_id_type start )const
+{
+   vector<operation_history_object> result;
+   if( limit == 0 )
+      return result;
+   const uint64_t first = start.instance.value ? sequence_at( account, start.instance.value )
+                                               : std::numeric_limits<uint64_t>::max();
+   visit_account_history( account, first, [&]( uint64_t, uint64_t op ) {
+      if( op <= stop.instance.value )
+         return false;
+      if( auto history = find( operation_history_id_type( op ) ) )
+         result.push_back( std::move( *history ) );
+      return result.size() < limit;
+   } );
+   return result;
+}
+
+vector<operation_history_object> account_history_store::get_relative_account_history( account_id_type account,
+                                                                                      uint64_t stop,
+                                                                                      uint32_t limit,
+                                                                                      uint64_t start )const
+{
+   vector<operation_history_object> result;
+   if( limit == 0 )
+      return result;
+   visit_account_history( account, start ? start : std::numeric_limits<uint64_t>::max(),
+                          [&]( uint64_t sequence, uint64_t op ) {
+      if( sequence <= stop )
+         return false;
+      if( auto history = find( operation_history_id_type( op ) ) )
+         result.push_back( std::move( *history ) );
+      return result.size() < limit;
+   } );
+   return result;
+}
+
+void account_history_store::drop_back()
+{
+   const stored_operation& entry = _tail.back();
+   for( const auto& key : entry.accounts )
+      _tail_by_account.erase( key );
+   _next_id = entry.op.id.instance();
+   _tail.pop_back();
+}
+
+uint64_t account_history_store::sequence_at( account_id_type account, uint64_t op )const
+{
+   // The tail holds the most recent entries
+   const account_sequence last_key( account, std::numeric_limits<uint64_t>::max() );
+   auto itr = _tail_by_account.upper_bound( last_key );
+   while( itr != _tail_by_account.begin() )
+   {
+      --itr;
+      if( itr->first.first != account )
+         break;
+      if( itr->second <= op )
+         return itr->first.second;
+   }
+   if( !is_open() )
+      return 0;
+
+   auto disk_itr = _account_operations.lower_bound( last_key );
+   if( disk_itr.valid() )
+      --disk_itr;
+   else
+      disk_itr = _account_operations.last();
+   if( !disk_itr.valid() || disk_itr.key().first != account )
+      return 0;
+
+   // Operation ids grow with the sequence, so the entries on disk are binary searched; pruning only ever removes the
+   // oldest entries, so those left are contiguous
+   const uint64_t high_sequence = disk_itr.key().second;
+   auto oldest = _account_operations.lower_bound( account_sequence( account, 0 ) );
+   uint64_t low = oldest.key().second - 1;
+   uint64_t high = high_sequence;
+   while( low < high )
+   {
+      const uint64_t middle = low + ( high - low + 1 ) / 2;
+      auto middle_op = _account_operations.fetch_optional( account_sequence( account, middle ) );
+      FC_ASSERT( middle_op, "The history of ${a} is missing entry ${s}", ("a", account)("s", middle) );
+      if( *middle_op <= op )
+         low = middle;
+      else
+         high = middle - 1;
+   }
+   return low;
+}
+
+} } // graphene::account_history
@@ -17,6 +17,7 @@
  */
 #pragma once
 
+#include <graphene/account_history/account_history_store.hpp>
 #include <graphene/app/plugin.hpp>
 #include <graphene/chain/database.hpp>
 
@@ -63,7 +64,7 @@ typedef multi_index_container<
    key_account_object,
    indexed_by<
       hashed_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
-      ordered_unique< tag<by_key>, member< key_account_object, address, &key_account_object::key > >
+      hashed_unique< tag<by_key>, member< key_account_object, address, &key_account_object::key >, std::hash<address> >
    >
 > key_account_object_multi_index_type;
 
@@ -84,9 +85,27 @@ class account_history_plugin : public graphene::app::plugin
       virtual void plugin_set_program_options(bpo::options_description& cli, bpo::options_description& cfg) override;
       virtual void plugin_initialize(const bpo::variables_map& options) override;
       virtual void plugin_startup() override;
+      virtual void plugin_shutdown() override;
+      /// Ready once the key index is rebuilt and the history has caught up with the chain
+      virtual bool plugin_is_ready()const override;
 
       flat_set<account_id_type> tracked_accounts()const;
 
+      /**
+       * Blocks are indexed on a thread of the plugin after they are applied, so the history may lag the chain by the
+       * blocks still queued; this waits for them.
+       */
+      void wait_for_indexing();
+      /// The key index is rebuilt in the background after startup; this waits for it to be done
+      void wait_for_key_index();
+      /// @{ @name Queries of the account_history_store, which may run alongside the indexing of blocks
+      vector<operation_history_object> get_account_history( account_id_type account, operation_history_id_type stop,
+                                                            uint32_t limit, operation_history_id_type start )const;
+      vector<operation_history_object> get_relative_account_history( account_id_type account, uint64_t stop,
+                                                                     uint32_t limit, uint64_t start )const;
+      uint64_t get_account_history_count( account_id_type account )const;
+      /// @}
+
       friend class detail::account_history_plugin_impl;
       std::unique_ptr<detail::account_history_plugin_impl> my;
 };
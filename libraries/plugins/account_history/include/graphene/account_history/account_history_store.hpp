@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <graphene/chain/operation_history_object.hpp>
+#include <graphene/db/level_map.hpp>
+
+#include <deque>
+#include <map>
+
+namespace graphene { namespace account_history {
+using namespace chain;
+
+typedef std::pair<account_id_type,uint64_t> account_sequence;
+
+/// An operation with the (account, sequence) entries it has in the histories of accounts
+struct stored_operation
+{
+   operation_history_object op;
+   vector<account_sequence> accounts;
+};
+
+/**
+ * @class account_history_store
+ * @brief Keeps the operation history and the per-account indexes of it outside of the object database
+ *
+ * Each operation in an account's history gets the next sequence number of that account, starting from 1, so a page of
+ * the history is a direct range of sequence numbers.  The operations of irreversible blocks are appended to two
+ * LevelDB maps: the operations by id, and an index from (account, sequence) to operation id which is walked backwards
+ * to list an account's most recent operations first.  The operations of reversible blocks are kept in an in-memory
+ * tail, since a fork switch may still undo them, and are written out as their blocks become irreversible.  If the
+ * store is never opened, as in the tests, everything stays in the tail.
+ *
+ * Operation ids are assigned sequentially from 1, so the default id never names an operation.
+ *
+ * Stored history may be pruned to the most recent operations of each account, or to the operations of recent blocks.
+ * Both are done a few entries at a time as blocks are written out.  An operation is removed with the last entry which
+ * refers to it.  The age limit leaves each account its most recent entry, so that its sequence numbers carry on, and
+ * the last operation stored is always kept, so that operation ids do too.
+ */
+class account_history_store
+{
+   public:
+      ~account_history_store();
+
+      void open( const fc::path& dir );
+      /// Writes the whole tail out, since the chain cannot undo its blocks after a restart, and closes the maps
+      void close();
+      bool is_open()const { return _operations.is_open(); }
+
+      /**
+       * Prepares for the operations of a new block, dropping those of the tail from this block on, which a fork
+       * switch has undone.
+       *
+       * @return false if the operations of the block are already stored, as happens when the chain is replayed
+       */
+      bool start_block( uint32_t block_num );
+      /// Adds an operation of the block being applied to the histories of accounts
+      operation_history_id_type append( const operation_history_object& op, const flat_set<account_id_type>& accounts );
+      /// Writes out the operations of the blocks up to last_irreversible_block_num and drops them from memory
+      void flush( uint32_t last_irreversible_block_num );
+
+      /// Keeps at most max_operations entries in the stored history of each account, or all of them if 0
+      void set_max_account_history( uint64_t max_operations ) { _max_account_history = max_operations; }
+      /// Removes the stored operations of the blocks before block_num, which only ever grows between calls
+      void prune_before_block( uint32_t block_num );
+
+      optional<operation_history_object> find( operation_history_id_type id )const;
+      /// @return the number of operations in the history of account, which is also the sequence of the last one
+      uint64_t get_account_history_count( account_id_type account )const;
+      /**
+       * @return the operations of account with ids greater than stop and not greater than start (or any id if start is
+       * the default), most recent first, up to limit of them
+       */
+      vector<operation_history_object> get_account_history( account_id_type account, operation_history_id_type stop,
+                                                            uint32_t limit, operation_history_id_type start )const;
+      /**
+       * @return the operations of account with sequence numbers greater than stop and not greater than start (or any
+       * sequence if start is 0), most recent first, up to limit of them
+       */
+      vector<operation_history_object> get_relative_account_history( account_id_type account, uint64_t stop,
+                                                                     uint32_t limit, uint64_t start )const;
+
+      /// The number of operations held in memory
+      size_t tail_size()const { return _tail.size(); }
+      /// The last block whose operations are all written out, which is kept on disk across restarts
+      uint32_t stored_block_num()const { return _stored_block_num; }
+      /// The last block whose operations were appended or stored
+      uint32_t head_block_num()const { return std::max( _stored_block_num, _head_block_num ); }
+
+   private:
+      void drop_back();
+      /// Removes a stored entry, and its operation if no other entry refers to it
+      void remove_entry( const account_sequence& key, uint64_t op );
+      /// Applies the limits on the stored history of an account that has just had the entry key written out
+      void prune_account( const account_sequence& key );
+      /// @return the greatest sequence of account whose operation id is not greater than op, or 0 if there is none
+      uint64_t sequence_at( account_id_type account, uint64_t op )const;
+      /**
+       * Calls visit( sequence, operation id ) for the history of account from the sequence first down, for as long as
+       * it returns true
+       */
+      template<typename Visitor>
+      void visit_account_history( account_id_type account, uint64_t first, Visitor&& visit )const;
+
+      uint64_t                                            _next_id = 1;
+      /// The last block whose operations were written out
+      uint32_t                                            _stored_block_num = 0;
+      /// The last block started since the store was created, or 0
+      uint32_t                                            _head_block_num = 0;
+
+      uint64_t                                            _max_account_history = 0;
+      uint32_t                                            _pruned_before_block = 0;
+      /// The stored operation from which prune_before_block carries on
+      uint64_t                                            _prune_from = 1;
+
+      std::deque<stored_operation>                        _tail;
+      /// The operation ids of the tail by account and sequence
+      std::map<account_sequence,uint64_t>                 _tail_by_account;
+
+      db::level_map<uint64_t, stored_operation>           _operations;
+      db::level_map<account_sequence, uint64_t>           _account_operations;
+      /// The stored block number, under "stored_block_num"
+      db::level_map<string, uint32_t>                     _meta;
+};
+
+} } // graphene::account_history
+
+FC_REFLECT( graphene::account_history::stored_operation, (op)(accounts) )
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <graphene/app/plugin.hpp>
+#include <graphene/chain/database.hpp>
+
+#include <boost/multi_index/composite_key.hpp>
+
+namespace graphene { namespace market_history {
+using namespace chain;
+namespace bpo = boost::program_options;
+
+//
+// Plugins should #define their SPACE_ID's so plugins with
+// conflicting SPACE_ID assignments can be compiled into the
+// same binary (by simply re-assigning some of the conflicting #defined
+// SPACE_ID's in a build script).
+//
+// Assignment of SPACE_ID's cannot be done at run-time because
+// various template automagic depends on them being known at compile
+// time.
+//
+#ifndef MARKET_HISTORY_SPACE_ID
+#define MARKET_HISTORY_SPACE_ID 6
+#endif
+
+enum market_history_object_type
+{
+   bucket_object_type
+};
+
+/**
+ *  @brief Trading activity in one market over one interval
+ *
+ *  Prices are expressed as an amount of @ref base per amount of @ref quote, where base is always the lower asset id of
+ *  the market.  A bucket only exists for intervals during which at least one fill occurred.
+ */
+class bucket_object : public abstract_object<bucket_object>
+{
+   public:
+      static const uint8_t space_id = MARKET_HISTORY_SPACE_ID;
+      static const uint8_t type_id  = bucket_object_type;
+
+      asset_id_type        base;
+      asset_id_type        quote;
+      uint32_t             seconds = 0;
+      fc::time_point_sec   open_time;
+
+      price                open;
+      price                high;
+      price                low;
+      price                close;
+      share_type           base_volume;
+      share_type           quote_volume;
+};
+
+struct by_key{};
+typedef multi_index_container<
+   bucket_object,
+   indexed_by<
+      hashed_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
+      ordered_unique< tag<by_key>,
+         composite_key< bucket_object,
+            member< bucket_object, asset_id_type, &bucket_object::base >,
+            member< bucket_object, asset_id_type, &bucket_object::quote >,
+            member< bucket_object, uint32_t, &bucket_object::seconds >,
+            member< bucket_object, fc::time_point_sec, &bucket_object::open_time >
+         >
+      >
+   >
+> bucket_object_multi_index_type;
+
+typedef generic_index<bucket_object, bucket_object_multi_index_type> bucket_index;
+
+namespace detail
+{
+    class market_history_plugin_impl;
+}
+
+/**
+ *  @brief Keeps open/high/low/close/volume buckets for every market
+ *
+ *  Buckets are updated from the fills reported by each applied block, so they follow the chain through undo and
+ *  fork switches like any other object.
+ */
+class market_history_plugin : public graphene::app::plugin
+{
+   public:
+      market_history_plugin();
+      virtual ~market_history_plugin();
+
+      std::string plugin_name()const override;
+      virtual void plugin_set_program_options(bpo::options_description& cli, bpo::options_description& cfg) override;
+      virtual void plugin_initialize(const bpo::variables_map& options) override;
+      virtual void plugin_startup() override;
+
+      /// Interval lengths, in seconds, for which buckets are maintained
+      const flat_set<uint32_t>& tracked_buckets()const;
+      /// Number of buckets of each interval kept per market before the oldest are discarded
+      uint32_t max_history()const;
+
+      friend class detail::market_history_plugin_impl;
+      std::unique_ptr<detail::market_history_plugin_impl> my;
+};
+
+} } //graphene::market_history
+
+FC_REFLECT_DERIVED( graphene::market_history::bucket_object,
+            (graphene::db::object),
+            (base)(quote)(seconds)(open_time)
+            (open)(high)(low)(close)
+            (base_volume)(quote_volume)
+          )
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <graphene/market_history/market_history_plugin.hpp>
+
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/operation_history_object.hpp>
+
+#include <fc/io/json.hpp>
+
+namespace graphene { namespace market_history {
+
+namespace detail
+{
+
+class market_history_plugin_impl
+{
+   public:
+      market_history_plugin_impl(market_history_plugin& _plugin)
+         : _self( _plugin ) { }
+      virtual ~market_history_plugin_impl();
+
+      /** this method is called as a callback after a block is applied
+       * and will record the fills of the block in every tracked bucket
+       */
+      void update_market_histories( const signed_block& b );
+      void record_fill( const fill_order_operation& fill, fc::time_point_sec when );
+      void prune( asset_id_type base, asset_id_type quote, uint32_t seconds, fc::time_point_sec newest );
+
+      graphene::chain::database& database()
+      {
+         return _self.database();
+      }
+
+      market_history_plugin& _self;
+      flat_set<uint32_t>     _tracked_buckets = flat_set<uint32_t>{ 15, 60, 300, 3600, 86400 };
+      uint32_t               _maximum_history_per_bucket_size = 1000;
+};
+
+market_history_plugin_impl::~market_history_plugin_impl()
+{
+   return;
+}
+
+void market_history_plugin_impl::update_market_histories( const signed_block& b )
+{
+   if( _tracked_buckets.size() == 0 )
+      return;
+
+   for( const operation_history_object& o : database().get_applied_operations() )
+   {
+      if( o.op.which() != operation::tag<fill_order_operation>::value )
+         continue;
+
+      const fill_order_operation& fill = o.op.get<fill_order_operation>();
+      // every trade is reported once for each side, only count the side which gave up the base asset
+      if( !(fill.pays.asset_id < fill.receives.asset_id) )
+         continue;
+      if( fill.pays.amount == 0 || fill.receives.amount == 0 )
+         continue;
+
+      record_fill( fill, b.timestamp );
+   }
+}
+
+void market_history_plugin_impl::record_fill( const fill_order_operation& fill, fc::time_point_sec when )
+{
+   graphene::chain::database& db = database();
+   const auto& by_key_idx = db.get_index_type<bucket_index>().indices().get<by_key>();
+   const price trade( fill.pays, fill.receives );
+
+   for( uint32_t seconds : _tracked_buckets )
+   {
+      const fc::time_point_sec open_time( when.sec_since_epoch() / seconds * seconds );
+      auto itr = by_key_idx.find( boost::make_tuple( fill.pays.asset_id, fill.receives.asset_id, seconds, open_time ) );
+      if( itr == by_key_idx.end() )
+      {
+         db.create<bucket_object>( [&]( bucket_object& bucket ){
+            bucket.base         = fill.pays.asset_id;
+            bucket.quote        = fill.receives.asset_id;
+            bucket.seconds      = seconds;
+            bucket.open_time    = open_time;
+            bucket.open         = trade;
+            bucket.high         = trade;
+            bucket.low          = trade;
+            bucket.close        = trade;
+            bucket.base_volume  = fill.pays.amount;
+            bucket.quote_volume = fill.receives.amount;
+         });
+         prune( fill.pays.asset_id, fill.receives.asset_id, seconds, open_time );
+      }
+      else
+      {
+         db.modify( *itr, [&]( bucket_object& bucket ){
+            if( bucket.high < trade ) bucket.high = trade;
+            if( trade < bucket.low ) bucket.low = trade;
+            bucket.close         = trade;
+            bucket.base_volume  += fill.pays.amount;
+            bucket.quote_volume += fill.receives.amount;
+         });
+      }
+   }
+}
+
+void market_history_plugin_impl::prune( asset_id_type base, asset_id_type quote, uint32_t seconds, fc::time_point_sec newest )
+{
+   const uint64_t span = uint64_t(seconds) * _maximum_history_per_bucket_size;
+   if( newest.sec_since_epoch() <= span )
+      return;
+   const fc::time_point_sec cutoff( newest.sec_since_epoch() - span );
+
+   graphene::chain::database& db = database();
+   const auto& by_key_idx = db.get_index_type<bucket_index>().indices().get<by_key>();
+   auto itr = by_key_idx.lower_bound( boost::make_tuple( base, quote, seconds ) );
+   while( itr != by_key_idx.end() &&
+          itr->base == base && itr->quote == quote && itr->seconds == seconds &&
+          itr->open_time < cutoff )
+   {
+      const bucket_object& old_bucket = *itr;
+      ++itr;
+      db.remove( old_bucket );
+   }
+}
+
+} // end namespace detail
+
+market_history_plugin::market_history_plugin() :
+   my( new detail::market_history_plugin_impl(*this) )
+{
+}
+
+market_history_plugin::~market_history_plugin()
+{
+}
+
+std::string market_history_plugin::plugin_name()const
+{
+   return "market_history";
+}
+
+void market_history_plugin::plugin_set_program_options(
+   boost::program_options::options_description& cli,
+   boost::program_options::options_description& cfg
+   )
+{
+   cli.add_options()
+         ("bucket-size", bpo::value<std::string>()->default_value("[15,60,300,3600,86400]"),
+          "JSON array of the bucket lengths, in seconds, to track market history for")
+         ("history-per-size", bpo::value<uint32_t>()->default_value(1000),
+          "How many old buckets of each length to keep for every market")
+         ;
+   cfg.add(cli);
+}
+
+void market_history_plugin::plugin_initialize(const boost::program_options::variables_map& options)
+{ try {
+   database().applied_block.connect( [&]( const signed_block& b){ my->update_market_histories(b); } );
+   database().add_applied_operations_consumer();
+   database().add_index< primary_index< bucket_index > >();
+
+   if( options.count( "bucket-size" ) )
+   {
+      my->_tracked_buckets = fc::json::from_string( options["bucket-size"].as<string>() ).as<flat_set<uint32_t>>();
+      FC_ASSERT( my->_tracked_buckets.find( 0 ) == my->_tracked_buckets.end(), "Bucket lengths must be positive" );
+   }
+   if( options.count( "history-per-size" ) )
+      my->_maximum_history_per_bucket_size = options["history-per-size"].as<uint32_t>();
+} FC_CAPTURE_AND_RETHROW() }
+
+void market_history_plugin::plugin_startup()
+{
+}
+
+const flat_set<uint32_t>& market_history_plugin::tracked_buckets()const
+{
+   return my->_tracked_buckets;
+}
+
+uint32_t market_history_plugin::max_history()const
+{
+   return my->_maximum_history_per_bucket_size;
+}
+
+} }
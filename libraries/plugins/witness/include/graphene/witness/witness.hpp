@@ -25,10 +25,23 @@
 namespace graphene { namespace witness_plugin {
 namespace bpo = boost::program_options;
 
+/// How far from the time of their slots the blocks of this node were broadcast
+struct production_timing
+{
+   uint32_t         blocks = 0;
+   /// Signed; negative if the block went out before its slot
+   fc::microseconds last;
+   /// The largest and the sum of the distances from the slot times
+   fc::microseconds max;
+   fc::microseconds total;
+};
+
 class witness_plugin : public graphene::app::plugin {
 public:
    ~witness_plugin() {
       try {
+         if( _block_preparation_task.valid() )
+            _block_preparation_task.cancel_and_wait(__FUNCTION__);
          if( _block_production_task.valid() )
             _block_production_task.cancel_and_wait(__FUNCTION__);
       } catch(fc::canceled_exception&) {
@@ -46,6 +59,7 @@ public:
       ) override;
 
    void set_block_production(bool allow) { _production_enabled = allow; }
+   const production_timing& get_production_timing()const { return _production_timing; }
 
    virtual void plugin_initialize( const bpo::variables_map& options ) override;
    virtual void plugin_startup() override;
@@ -53,13 +67,26 @@ public:
 
 private:
    void schedule_next_production(const graphene::chain::chain_parameters& global_parameters);
-   void block_production_loop();
+   /// Produces the block of the slot at @p slot_time, if it is one of our witnesses' slots
+   void block_production_loop(fc::time_point_sec slot_time);
+   /// Schedules prepare_block ahead of the slot at @p next_slot_time, if it is one of our witnesses' slots
+   void schedule_block_preparation(fc::time_point_sec next_slot_time);
+   /// Builds and signs the block of a coming slot, which block_production_loop pushes if it is still current
+   void prepare_block(fc::time_point_sec when, chain::witness_id_type witness, chain::key_id_type key);
 
    bpo::variables_map _options;
    bool _production_enabled = false;
+   bool _prioritize_by_fee = false;
+   uint32_t _preparation_ms = 250;
+   uint32_t _production_tolerance_ms = 500;
+   production_timing _production_timing;
    std::map<chain::key_id_type, fc::ecc::private_key> _private_keys;
    std::set<chain::witness_id_type> _witnesses;
    fc::future<void> _block_production_task;
+   fc::future<void> _block_preparation_task;
+   fc::optional<chain::signed_block> _prepared_block;
 };
 
 } } //graphene::delegate
+
+FC_REFLECT( graphene::witness_plugin::production_timing, (blocks)(last)(max)(total) )
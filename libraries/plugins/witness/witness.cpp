@@ -37,6 +37,12 @@ void witness_plugin::plugin_set_program_options(
          ("private-key", bpo::value<vector<string>>()->composing()->multitoken()->
           DEFAULT_VALUE_VECTOR(std::make_pair(chain::key_id_type(), fc::ecc::private_key::regenerate(fc::sha256::hash(std::string("genesis"))))),
           "Tuple of [key ID, private key] (may specify multiple times)")
+         ("prioritize-by-fee", bpo::bool_switch()->notifier([this](bool e){_prioritize_by_fee = e;}),
+          "Fill produced blocks with the transactions paying the highest fee per byte first")
+         ("block-preparation-ms", bpo::value<uint32_t>()->notifier([this](uint32_t ms){_preparation_ms = ms;})->default_value(250),
+          "Build and sign each block this many milliseconds before its slot, then only check it is current at the slot (0 to disable)")
+         ("production-tolerance-ms", bpo::value<uint32_t>()->notifier([this](uint32_t ms){_production_tolerance_ms = ms;})->default_value(500),
+          "Skip a slot if block production wakes up further than this many milliseconds from its time")
          ;
    config_file_options.add(command_line_options);
 }
@@ -60,6 +66,7 @@ void witness_plugin::plugin_startup()
       std::set<chain::witness_id_type> bad_wits;
       //Start NTP time client
       graphene::time::now();
+      database().set_prioritize_transactions_by_fee( _prioritize_by_fee );
       for( auto wit : _witnesses )
    {
       auto key = wit(database()).signing_key;
@@ -87,36 +94,42 @@ void witness_plugin::plugin_shutdown()
    return;
 }
 
+/// The time of the local clock, which timers run on, when the network clock reads @p t
+static fc::time_point local_time_at( fc::time_point t )
+{
+   return fc::time_point::now() + ( t - graphene::time::precise_now() );
+}
+
 void witness_plugin::schedule_next_production(const graphene::chain::chain_parameters& global_parameters)
 {
    //Get next production time for *any* delegate
    auto block_interval = global_parameters.block_interval;
-   fc::time_point next_block_time = fc::time_point_sec() +
-         (graphene::time::now().sec_since_epoch() / block_interval + 1) * block_interval;
+   fc::time_point_sec next_slot_time = fc::time_point_sec() +
+         (graphene::time::precise_now().sec_since_epoch() / block_interval + 1) * block_interval;
 
-   if( graphene::time::ntp_time().valid() )
-      next_block_time -= graphene::time::ntp_error();
+   schedule_block_preparation(next_slot_time);
 
    //Sleep until the next production time for *any* delegate
-   _block_production_task = fc::schedule([this]{block_production_loop();},
-                                         next_block_time, "Witness Block Production");
+   _block_production_task = fc::schedule([=]{block_production_loop(next_slot_time);},
+                                         local_time_at(next_slot_time), "Witness Block Production");
 }
 
-void witness_plugin::block_production_loop()
+void witness_plugin::block_production_loop(fc::time_point_sec slot_time)
 {
    chain::database& db = database();
    const auto& global_parameters = db.get_global_properties().parameters;
+   fc::time_point woke = graphene::time::precise_now();
+   fc::time_point_sec now = woke;
 
    // Is there a head block within a block interval of now? If so, we're synced and can begin production.
    if( !_production_enabled &&
-       llabs((db.head_block_time() - graphene::time::now()).to_seconds()) <= global_parameters.block_interval )
+       llabs((db.head_block_time() - now).to_seconds()) <= global_parameters.block_interval )
       _production_enabled = true;
 
-   // is anyone scheduled to produce now or one second in the future?
-   uint32_t slot = db.get_slot_at_time( graphene::time::now() + fc::seconds(1) );
+   // is anyone scheduled to produce in the slot we woke up for?
+   uint32_t slot = db.get_slot_at_time( slot_time );
    graphene::chain::witness_id_type scheduled_witness = db.get_scheduled_witness( slot ).first;
    fc::time_point_sec scheduled_time = db.get_slot_time( slot );
-   fc::time_point_sec now = graphene::time::now();
    graphene::chain::key_id_type scheduled_key = scheduled_witness( db ).signing_key;
 
    auto is_scheduled = [&]()
@@ -144,17 +157,20 @@ void witness_plugin::block_production_loop()
          return false;
       }
 
-      // the local clock must be at least 1 second ahead of
-      // head_block_time.
-      if( (now - db.head_block_time()).to_seconds() <= 1 ) {
-         elog("Not producing block because head block is less than a second old.");
+      // the local clock must be at least half a block interval, and
+      // at most a second, ahead of head_block_time.
+      int64_t min_head_age = std::min<int64_t>( fc::seconds(1).count(),
+                                                fc::seconds(global_parameters.block_interval).count() / 2 );
+      if( (woke - fc::time_point(db.head_block_time())).count() < min_head_age ) {
+         elog("Not producing block because head block is too recent.");
          return false;
       }
 
-      // the local clock must be within 500 milliseconds of
+      // the local clock must be within the production tolerance of
       // the scheduled production time.
-      if( llabs((scheduled_time - now).count()) > fc::milliseconds(500).count() ) {
-         elog("Not producing block because network time is not within 500ms of scheduled block time.");
+      if( llabs((woke - fc::time_point(scheduled_time)).count()) > fc::milliseconds(_production_tolerance_ms).count() ) {
+         elog("Not producing block because network time is not within ${ms}ms of scheduled block time.",
+              ("ms", _production_tolerance_ms));
          return false;
       }
 
@@ -174,14 +190,30 @@ void witness_plugin::block_production_loop()
       ilog("Witness ${id} production slot has arrived; generating a block now...", ("id", scheduled_witness));
       try
       {
-         auto block = db.generate_block(
-            scheduled_time,
-            scheduled_witness,
-            _private_keys[ scheduled_key ]
-            );
-         ilog("Generated block #${n} with timestamp ${t} at time ${c}",
-              ("n", block.block_num())("t", block.timestamp)("c", now));
+         chain::signed_block block;
+         // Transactions which arrived after the block was prepared go into the next one
+         if( _prepared_block && _prepared_block->timestamp == scheduled_time &&
+             _prepared_block->witness == scheduled_witness && _prepared_block->previous == db.head_block_id() )
+         {
+            block = std::move( *_prepared_block );
+            db.push_generated_block( block );
+         }
+         else
+            block = db.generate_block(
+               scheduled_time,
+               scheduled_witness,
+               _private_keys[ scheduled_key ]
+               );
          p2p_node().broadcast(net::block_message(block));
+
+         fc::microseconds jitter = graphene::time::precise_now() - fc::time_point(scheduled_time);
+         ++_production_timing.blocks;
+         _production_timing.last = jitter;
+         _production_timing.total += fc::microseconds( llabs(jitter.count()) );
+         if( llabs(jitter.count()) > _production_timing.max.count() )
+            _production_timing.max = fc::microseconds( llabs(jitter.count()) );
+         ilog("Generated block #${n} with timestamp ${t} at time ${c}, ${j}us after its slot",
+              ("n", block.block_num())("t", block.timestamp)("c", woke)("j", jitter.count()));
       }
       catch( const fc::canceled_exception& )
       {
@@ -193,6 +225,46 @@ void witness_plugin::block_production_loop()
          elog("Got exception while generating block:\n${e}", ("e", e.to_detail_string()));
       }
    }
+   _prepared_block.reset();
 
    schedule_next_production(global_parameters);
 }
+
+void witness_plugin::schedule_block_preparation(fc::time_point_sec next_slot_time)
+{
+   if( _preparation_ms == 0 || !_production_enabled )
+      return;
+
+   chain::database& db = database();
+   uint32_t slot = db.get_slot_at_time( next_slot_time );
+   if( slot == 0 || db.get_slot_time( slot ) != next_slot_time )
+      return;
+   graphene::chain::witness_id_type witness = db.get_scheduled_witness( slot ).first;
+   if( _witnesses.find( witness ) == _witnesses.end() )
+      return;
+   graphene::chain::key_id_type key = witness( db ).signing_key;
+   if( _private_keys.find( key ) == _private_keys.end() )
+      return;
+
+   _block_preparation_task = fc::schedule([=]{prepare_block(next_slot_time, witness, key);},
+                                          local_time_at(fc::time_point(next_slot_time) - fc::milliseconds(_preparation_ms)),
+                                          "Witness Block Preparation");
+}
+
+void witness_plugin::prepare_block(fc::time_point_sec when, chain::witness_id_type witness, chain::key_id_type key)
+{
+   try
+   {
+      _prepared_block = database().build_block( when, witness, _private_keys[ key ] );
+   }
+   catch( const fc::canceled_exception& )
+   {
+      throw;
+   }
+   catch( const fc::exception& e )
+   {
+      // The slot changed hands since it was scheduled; generate_block will tell at the slot
+      dlog("Could not prepare the block for ${t}: ${e}", ("t", when)("e", e.to_string()));
+      _prepared_block.reset();
+   }
+}
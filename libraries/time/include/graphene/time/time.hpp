@@ -18,6 +18,7 @@
 #pragma once
 
 #include <fc/optional.hpp>
+#include <fc/reflect/reflect.hpp>
 #include <fc/signals.hpp>
 #include <fc/time.hpp>
 
@@ -26,11 +27,28 @@ namespace graphene { namespace time {
    typedef fc::signal<void()> time_discontinuity_signal_type;
    extern time_discontinuity_signal_type time_discontinuity_signal;
 
+   /// The state of the NTP correction applied to the local clock
+   struct time_stats
+   {
+      bool             synced = false;
+      /// What now() adds to the local clock
+      fc::microseconds offset;
+      /// What NTP last said should be added, which offset slews toward
+      fc::microseconds measured_offset;
+      uint32_t         measurements = 0;
+   };
+
+   /**
+    * NTP is queried on a thread of its own. None of these wait for it: until it answers, the local clock is used and
+    * ntp_time() is empty. Later corrections are slewed in at 1ms every 100ms rather than jumped to.
+    */
    fc::optional<fc::time_point> ntp_time();
    fc::time_point_sec           now();
-   fc::time_point_sec           nonblocking_now(); // identical to now() but guaranteed not to block
+   fc::time_point_sec           nonblocking_now(); // identical to now()
+   fc::time_point               precise_now();     // now() to the microsecond rather than the second
    void                         update_ntp_time();
    fc::microseconds             ntp_error();
+   time_stats                   get_time_stats();
    void                         shutdown_ntp_time();
 
    void                         start_simulated_time( const fc::time_point sim_time );
@@ -38,3 +56,5 @@ namespace graphene { namespace time {
    void                         advance_time( int32_t delta_seconds );
 
 } } // graphene::time
+
+FC_REFLECT( graphene::time::time_stats, (synced)(offset)(measured_offset)(measurements) )
@@ -22,6 +22,7 @@
 #include <fc/network/ntp.hpp>
 #include <fc/thread/mutex.hpp>
 #include <fc/thread/scoped_lock.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <atomic>
 
@@ -34,70 +35,142 @@ time_discontinuity_signal_type time_discontinuity_signal;
 
 namespace detail
 {
-  std::atomic<fc::ntp*> ntp_service(nullptr);
-  fc::mutex ntp_service_initialization_mutex;
-}
-
-fc::optional<fc::time_point> ntp_time()
-{
-  fc::ntp* actual_ntp_service = detail::ntp_service.load();
-  if (!actual_ntp_service)
+  /// How often the NTP offset is sampled, and how far the published offset moves toward it each time
+  const fc::microseconds poll_interval = fc::milliseconds(100);
+  const int64_t          max_slew_us   = 1000;
+
+  /**
+   * The NTP service lives on its own thread, which samples it and publishes the offset of the local clock below.
+   * Readers only ever load the atomics, so reading the time never waits for the network.
+   */
+  std::atomic<bool>     service_started(false);
+  std::atomic<bool>     synced(false);
+  std::atomic<int64_t>  offset_us(0);
+  std::atomic<int64_t>  measured_offset_us(0);
+  std::atomic<uint32_t> measurements(0);
+
+  fc::mutex             service_mutex;
+  fc::thread*           time_thread = nullptr;
+  fc::ntp*              ntp_service = nullptr;
+  fc::future<void>      poll_task;
+
+  void poll_ntp()
   {
-    fc::scoped_lock<fc::mutex> lock(detail::ntp_service_initialization_mutex);
-    actual_ntp_service = detail::ntp_service.load();
-    if (!actual_ntp_service)
+    fc::optional<fc::time_point> current_ntp_time = ntp_service->get_time();
+    if( current_ntp_time )
     {
-      actual_ntp_service = new fc::ntp;
-      detail::ntp_service.store(actual_ntp_service);
+      int64_t measured = (*current_ntp_time - fc::time_point::now()).count();
+      measured_offset_us.store( measured );
+      ++measurements;
+      if( !synced.load() )
+      {
+        // Nothing has been corrected yet, so there is nothing to slew from
+        offset_us.store( measured );
+        synced.store( true );
+      }
+      else
+      {
+        // Slew toward the measurement rather than jump, so the time keeps going forward at a steady pace
+        int64_t current = offset_us.load();
+        int64_t step = std::max( -max_slew_us, std::min( max_slew_us, measured - current ) );
+        offset_us.store( current + step );
+      }
     }
+    poll_task = time_thread->schedule( []{ poll_ntp(); }, fc::time_point::now() + poll_interval, "poll_ntp" );
+  }
+
+  void start_service()
+  {
+    if( service_started.load() )
+      return;
+    fc::scoped_lock<fc::mutex> lock(service_mutex);
+    if( service_started.load() )
+      return;
+    time_thread = new fc::thread("ntp");
+    // Not waited for, as creating the NTP service resolves its servers
+    time_thread->async( []{
+      ntp_service = new fc::ntp;
+      poll_ntp();
+    }, "start_ntp" );
+    service_started.store( true );
   }
-  return actual_ntp_service->get_time();
+}
+
+fc::optional<fc::time_point> ntp_time()
+{
+  detail::start_service();
+  if( !detail::synced.load() )
+    return fc::optional<fc::time_point>();
+  return fc::time_point::now() + fc::microseconds( detail::offset_us.load() );
 }
 
 void shutdown_ntp_time()
 {
-  fc::ntp* actual_ntp_service = detail::ntp_service.exchange(nullptr);
-  delete actual_ntp_service;
+  fc::scoped_lock<fc::mutex> lock(detail::service_mutex);
+  if( !detail::service_started.load() )
+    return;
+  detail::service_started.store( false );
+  detail::time_thread->async( []{
+    try {
+      if( detail::poll_task.valid() )
+        detail::poll_task.cancel_and_wait( "shutdown_ntp_time" );
+    } catch( const fc::canceled_exception& ) {
+    }
+    delete detail::ntp_service;
+    detail::ntp_service = nullptr;
+  }, "stop_ntp" ).wait();
+  detail::time_thread->quit();
+  delete detail::time_thread;
+  detail::time_thread = nullptr;
+  detail::synced.store( false );
+  detail::offset_us.store( 0 );
 }
 
-fc::time_point_sec now()
+fc::time_point precise_now()
 {
    if( simulated_time )
        return fc::time_point() + fc::seconds( simulated_time + adjusted_time_sec );
 
-   fc::optional<fc::time_point> current_ntp_time = ntp_time();
-   if( current_ntp_time.valid() )
-      return *current_ntp_time + fc::seconds( adjusted_time_sec );
-   else
-      return fc::time_point::now() + fc::seconds( adjusted_time_sec );
+   // The offset stays 0 until NTP time is known, leaving the local time
+   detail::start_service();
+   return fc::time_point::now() + fc::microseconds( detail::offset_us.load() ) + fc::seconds( adjusted_time_sec );
+}
+
+fc::time_point_sec now()
+{
+   return precise_now();
 }
 
 fc::time_point_sec nonblocking_now()
 {
-  if (simulated_time)
-    return fc::time_point() + fc::seconds(simulated_time + adjusted_time_sec);
-
-  fc::ntp* actual_ntp_service = detail::ntp_service.load();
-  fc::optional<fc::time_point> current_ntp_time;
-  if (actual_ntp_service)
-    current_ntp_time = actual_ntp_service->get_time();
-
-  if (current_ntp_time)
-    return *current_ntp_time + fc::seconds(adjusted_time_sec);
-  else
-    return fc::time_point::now() + fc::seconds(adjusted_time_sec);
+   return precise_now();
 }
 
 void update_ntp_time()
 {
-  detail::ntp_service.load()->request_now();
+  detail::start_service();
+  fc::scoped_lock<fc::mutex> lock(detail::service_mutex);
+  if( detail::time_thread )
+    detail::time_thread->async( []{
+      if( detail::ntp_service )
+        detail::ntp_service->request_now();
+    }, "update_ntp_time" );
 }
 
 fc::microseconds ntp_error()
 {
-  fc::optional<fc::time_point> current_ntp_time = ntp_time();
-  FC_ASSERT( current_ntp_time, "We don't have NTP time!" );
-  return *current_ntp_time - fc::time_point::now();
+  FC_ASSERT( detail::synced.load(), "We don't have NTP time!" );
+  return fc::microseconds( detail::offset_us.load() );
+}
+
+time_stats get_time_stats()
+{
+  time_stats stats;
+  stats.synced          = detail::synced.load();
+  stats.offset          = fc::microseconds( detail::offset_us.load() );
+  stats.measured_offset = fc::microseconds( detail::measured_offset_us.load() );
+  stats.measurements    = detail::measurements.load();
+  return stats;
 }
 
 void start_simulated_time( const fc::time_point sim_time )
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace graphene { namespace utilities {
+
+  /**
+   *  Compresses size bytes of data into a stream of literal runs and back references of up to 64KiB, in the
+   *  manner of LZ4.  The references may reach into dictionary, which must be given again to decompress, so
+   *  small inputs which share a lot with it compress well too.
+   */
+  std::vector<char> lz_compress(const char* data, size_t size, const std::vector<char>& dictionary = std::vector<char>());
+
+  /**
+   *  Reverses lz_compress, given the size of the original data.
+   *  @throws fc::exception if the compressed data is corrupt or does not decompress to exactly size bytes
+   */
+  std::vector<char> lz_decompress(const char* compressed, size_t compressed_size, size_t size,
+                                  const std::vector<char>& dictionary = std::vector<char>());
+
+} } // end namespace graphene::utilities
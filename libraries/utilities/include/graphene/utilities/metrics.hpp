@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace graphene { namespace utilities {
+
+  /** A count which only goes up, such as the number of blocks applied */
+  class counter
+  {
+  public:
+    void     increment(uint64_t by = 1) { _value.fetch_add(by, std::memory_order_relaxed); }
+    uint64_t value() const { return _value.load(std::memory_order_relaxed); }
+  private:
+    std::atomic<uint64_t> _value{0};
+  };
+
+  /** A value which goes up and down, such as the number of pending transactions */
+  class gauge
+  {
+  public:
+    void    set(int64_t value) { _value.store(value, std::memory_order_relaxed); }
+    void    add(int64_t by) { _value.fetch_add(by, std::memory_order_relaxed); }
+    int64_t value() const { return _value.load(std::memory_order_relaxed); }
+  private:
+    std::atomic<int64_t> _value{0};
+  };
+
+  /**
+   *  Counts observations, such as call times, in buckets by their upper bounds.  The buckets are counted
+   *  separately, so a render taken during an observation may be off by it, but never by more.
+   */
+  class histogram
+  {
+  public:
+    /** @param bounds the inclusive upper bounds of the buckets, in increasing order */
+    explicit histogram(std::vector<int64_t> bounds);
+
+    void observe(int64_t value);
+
+    const std::vector<int64_t>& bounds() const { return _bounds; }
+    /** The observations of each bucket, not cumulative, the last being of those above every bound */
+    std::vector<uint64_t>       bucket_counts() const;
+    uint64_t                    count() const { return _count.load(std::memory_order_relaxed); }
+    int64_t                     sum() const { return _sum.load(std::memory_order_relaxed); }
+  private:
+    std::vector<int64_t>                       _bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]>   _buckets;
+    std::atomic<uint64_t>                      _count{0};
+    std::atomic<int64_t>                       _sum{0};
+  };
+
+  /** Bounds from first up to last, each factor times the one before */
+  std::vector<int64_t> exponential_bounds(int64_t first, int64_t factor, int64_t last);
+
+  /**
+   *  Names the metrics of the node, to be rendered in the Prometheus text format.  A metric is found or created
+   *  by its name and labels once, under a lock; the reference returned stays valid for as long as the process
+   *  runs, and is updated from any thread without the registry.
+   *
+   *  Labels are given as they are rendered, such as <tt>method="has_item"</tt>, and each combination of labels
+   *  of a name is a metric of its own.
+   */
+  class metrics_registry
+  {
+  public:
+    counter&   get_counter(const std::string& name, const std::string& help, const std::string& labels = std::string());
+    gauge&     get_gauge(const std::string& name, const std::string& help, const std::string& labels = std::string());
+    /** The bounds are those of the first call for the name and labels */
+    histogram& get_histogram(const std::string& name, const std::string& help, const std::vector<int64_t>& bounds,
+                             const std::string& labels = std::string());
+
+    /**
+     *  Registers a function which brings gauges up to date, called on the rendering thread before every render.
+     *  @return the id to remove it by
+     */
+    uint64_t add_collector(std::function<void()> collect);
+    void     remove_collector(uint64_t id);
+
+    /** Calls the collectors, then renders every metric in the Prometheus text exposition format */
+    std::string render();
+
+  private:
+    enum metric_kind { counter_kind, gauge_kind, histogram_kind };
+    struct family
+    {
+      std::string                                        help;
+      metric_kind                                        kind;
+      std::map<std::string, std::unique_ptr<counter>>    counters;
+      std::map<std::string, std::unique_ptr<gauge>>      gauges;
+      std::map<std::string, std::unique_ptr<histogram>>  histograms;
+    };
+    family& get_family(const std::string& name, const std::string& help, metric_kind kind);
+
+    std::mutex                                     _mutex;
+    std::map<std::string, family>                  _families;
+    std::map<uint64_t, std::function<void()>>      _collectors;
+    uint64_t                                       _next_collector_id = 0;
+  };
+
+  /** The registry of this process */
+  metrics_registry& metrics();
+
+} } // end namespace graphene::utilities
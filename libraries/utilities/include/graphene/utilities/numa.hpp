@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace graphene { namespace utilities {
+
+  /** The NUMA nodes of this machine, as listed by the kernel; empty where that is not known */
+  std::vector<uint32_t> numa_nodes();
+
+  /** The CPUs of a NUMA node; empty if there is no such node */
+  std::vector<uint32_t> numa_node_cpus(uint32_t node);
+
+  /**
+   *  Restricts the calling thread to the CPUs of node, and asks the kernel to place the memory it touches from
+   *  now on there, falling back to other nodes once that one is full.  Only the calling thread is affected,
+   *  so threads it starts afterwards inherit the binding but existing ones do not.
+   *  @return false if the node does not exist or the binding is not supported on this platform
+   */
+  bool bind_current_thread_to_numa_node(uint32_t node);
+
+  /** A short description of the CPUs the calling thread may run on, for the logs */
+  std::string describe_current_thread_affinity();
+
+} } // end namespace graphene::utilities
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <fc/optional.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace graphene { namespace utilities {
+
+  typedef std::vector<std::shared_ptr<fc::thread>> thread_group;
+
+  /**
+   *  The worker threads of a node, in pools by the role they serve, such as "sigcheck" for recovering
+   *  signatures or "api" for answering queries.  A pool's threads are named after its role and numbered, so
+   *  they can be told apart in the logs, and may be pinned to a NUMA node.
+   *
+   *  The pools belong to the application, and the database, the p2p node and the plugins are handed the threads
+   *  of their roles rather than starting their own, so the whole topology is set in one place.  A thread runs
+   *  until the pools and everything it was handed to have let go of it.
+   */
+  class thread_pools
+  {
+  public:
+    struct pool_config
+    {
+      uint32_t                thread_count = 0;
+      fc::optional<uint32_t>  numa_node;
+    };
+
+    /** Parses a pool given as <tt>role=count</tt>, or <tt>role=count@node</tt> to pin it to a NUMA node */
+    static std::pair<std::string, pool_config> parse(const std::string& spec);
+
+    /** Sets the size and placement of a role's pool; this must be done before its threads are first asked for */
+    void configure(const std::string& role, const pool_config& config);
+    bool is_configured(const std::string& role) const;
+
+    /**
+     *  The threads of a role, started the first time they are asked for.  A role which was never configured
+     *  gets default_thread_count threads, and none if that is zero.
+     */
+    const thread_group& get(const std::string& role, uint32_t default_thread_count = 0);
+
+    /** Each role with the number of threads it has, and their NUMA node, for the logs */
+    std::string describe() const;
+
+  private:
+    struct pool
+    {
+      pool_config   config;
+      bool          started = false;
+      thread_group  threads;
+    };
+
+    mutable std::mutex           _mutex;
+    std::map<std::string, pool>  _pools;
+  };
+
+} } // end namespace graphene::utilities
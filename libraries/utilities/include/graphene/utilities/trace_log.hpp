@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <fc/log/logger.hpp>
+
+/**
+ *  Logging for the hot paths, such as every pushed block, every item served to a peer or every message handled,
+ *  which is too much to read in normal operation.  These messages go to the "trace" logger at debug level, so they
+ *  are only written when that logger is configured at debug level or below.
+ *
+ *  Checking the level costs one comparison against a logger looked up once per process, and the arguments are only
+ *  evaluated and turned into variants when the message will be written.  Building with GRAPHENE_TRACE_LOGS defined
+ *  to 0 removes the messages from the binary altogether, arguments included.
+ */
+#ifndef GRAPHENE_TRACE_LOGS
+# define GRAPHENE_TRACE_LOGS 1
+#endif
+
+#define GRAPHENE_TRACE_LOGGER "trace"
+
+namespace graphene { namespace utilities {
+
+  /** The logger of the trace messages */
+  inline fc::logger& trace_logger()
+  {
+    static fc::logger logger = fc::logger::get(GRAPHENE_TRACE_LOGGER);
+    return logger;
+  }
+
+} } // end namespace graphene::utilities
+
+#if GRAPHENE_TRACE_LOGS
+
+#define tlog( FORMAT, ... ) \
+  FC_MULTILINE_MACRO_BEGIN \
+   if( graphene::utilities::trace_logger().is_enabled( fc::log_level::debug ) ) \
+      graphene::utilities::trace_logger().log( FC_LOG_MESSAGE( debug, FORMAT, __VA_ARGS__ ) ); \
+  FC_MULTILINE_MACRO_END
+
+#define tdump( SEQ ) \
+    tlog( FC_FORMAT(SEQ), FC_FORMAT_ARG_PARAMS(SEQ) )
+
+#else
+
+#define tlog( FORMAT, ... ) \
+  FC_MULTILINE_MACRO_BEGIN FC_MULTILINE_MACRO_END
+
+#define tdump( SEQ ) \
+  FC_MULTILINE_MACRO_BEGIN FC_MULTILINE_MACRO_END
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/utilities/lz_compression.hpp>
+
+#include <fc/exception/exception.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace graphene { namespace utilities {
+
+  namespace {
+    const size_t   min_match = 4;
+    const size_t   max_offset = 0xffff;
+    const unsigned hash_bits = 14;
+
+    inline uint32_t read32(const char* p)
+    {
+      uint32_t v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+    inline uint32_t hash4(const char* p)
+    {
+      return (read32(p) * 2654435761u) >> (32 - hash_bits);
+    }
+
+    /// Lengths which don't fit in their nibble continue in bytes of 255, ended by a byte below it
+    void write_length(std::vector<char>& out, size_t length)
+    {
+      for (; length >= 255; length -= 255)
+        out.push_back(char(255));
+      out.push_back(char(length));
+    }
+    size_t read_length(const unsigned char*& in, const unsigned char* end)
+    {
+      size_t length = 0;
+      unsigned char b;
+      do
+      {
+        FC_ASSERT(in < end, "Compressed data is truncated");
+        b = *in++;
+        length += b;
+      } while (b == 255);
+      return length;
+    }
+
+    void write_sequence(std::vector<char>& out, const char* literals, size_t literal_count,
+                        size_t offset, size_t match_length)
+    {
+      const size_t match_code = match_length ? match_length - min_match : 0;
+      out.push_back(char((std::min<size_t>(literal_count, 15) << 4) | std::min<size_t>(match_code, 15)));
+      if (literal_count >= 15)
+        write_length(out, literal_count - 15);
+      out.insert(out.end(), literals, literals + literal_count);
+      if (!match_length)
+        return;
+      out.push_back(char(offset & 0xff));
+      out.push_back(char(offset >> 8));
+      if (match_code >= 15)
+        write_length(out, match_code - 15);
+    }
+  }
+
+  std::vector<char> lz_compress(const char* data, size_t size, const std::vector<char>& dictionary)
+  {
+    // Compress as if the data followed the dictionary, so references can reach back into it
+    const size_t dictionary_size = std::min(dictionary.size(), max_offset);
+    std::vector<char> source(dictionary.end() - dictionary_size, dictionary.end());
+    source.insert(source.end(), data, data + size);
+    const char* src = source.data();
+    const size_t end = source.size();
+
+    std::vector<int64_t> table(size_t(1) << hash_bits, -1);
+    for (size_t p = 0; p + min_match <= dictionary_size; ++p)
+      table[hash4(src + p)] = p;
+
+    std::vector<char> out;
+    out.reserve(size / 2 + 16);
+    size_t anchor = dictionary_size;
+    size_t p = dictionary_size;
+    while (p + min_match <= end)
+    {
+      const uint32_t h = hash4(src + p);
+      const int64_t candidate = table[h];
+      table[h] = p;
+      if (candidate < 0 || p - candidate > max_offset || read32(src + candidate) != read32(src + p))
+      {
+        ++p;
+        continue;
+      }
+
+      size_t length = min_match;
+      while (p + length < end && src[candidate + length] == src[p + length])
+        ++length;
+      write_sequence(out, src + anchor, p - anchor, p - candidate, length);
+      for (size_t q = p + 1; q < p + length && q + min_match <= end; ++q)
+        table[hash4(src + q)] = q;
+      p += length;
+      anchor = p;
+    }
+    write_sequence(out, src + anchor, end - anchor, 0, 0);
+    return out;
+  }
+
+  std::vector<char> lz_decompress(const char* compressed, size_t compressed_size, size_t size,
+                                  const std::vector<char>& dictionary)
+  {
+    const size_t dictionary_size = std::min(dictionary.size(), max_offset);
+    std::vector<char> out;
+    out.reserve(dictionary_size + size);
+    out.insert(out.end(), dictionary.end() - dictionary_size, dictionary.end());
+    const size_t out_end = dictionary_size + size;
+
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(compressed);
+    const unsigned char* in_end = in + compressed_size;
+    while (in < in_end)
+    {
+      const unsigned char token = *in++;
+      size_t literal_count = token >> 4;
+      if (literal_count == 15)
+        literal_count += read_length(in, in_end);
+      FC_ASSERT(literal_count <= size_t(in_end - in) && literal_count <= out_end - out.size(),
+                "Compressed data is corrupt");
+      out.insert(out.end(), in, in + literal_count);
+      in += literal_count;
+      if (in == in_end)
+        break;
+
+      FC_ASSERT(in_end - in >= 2, "Compressed data is truncated");
+      const size_t offset = size_t(in[0]) | (size_t(in[1]) << 8);
+      in += 2;
+      size_t length = (token & 15) + min_match;
+      if ((token & 15) == 15)
+        length += read_length(in, in_end);
+      FC_ASSERT(offset != 0 && offset <= out.size() && length <= out_end - out.size(), "Compressed data is corrupt");
+      // The reference may overlap the bytes it produces, so it is copied one byte at a time
+      size_t from = out.size() - offset;
+      for (size_t i = 0; i < length; ++i)
+        out.push_back(out[from + i]);
+    }
+    FC_ASSERT(out.size() == out_end, "Compressed data does not have the expected size",
+              ("expected", size)("actual", out.size() - dictionary_size));
+    out.erase(out.begin(), out.begin() + dictionary_size);
+    return out;
+  }
+
+} } // end namespace graphene::utilities
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/utilities/metrics.hpp>
+
+#include <fc/exception/exception.hpp>
+
+#include <algorithm>
+#include <sstream>
+
+namespace graphene { namespace utilities {
+
+  histogram::histogram(std::vector<int64_t> bounds)
+    : _bounds(std::move(bounds)),
+      _buckets(new std::atomic<uint64_t>[_bounds.size() + 1])
+  {
+    FC_ASSERT(std::is_sorted(_bounds.begin(), _bounds.end()), "Histogram bounds must be in increasing order");
+    for (size_t i = 0; i <= _bounds.size(); ++i)
+      _buckets[i].store(0, std::memory_order_relaxed);
+  }
+
+  void histogram::observe(int64_t value)
+  {
+    size_t bucket = std::lower_bound(_bounds.begin(), _bounds.end(), value) - _bounds.begin();
+    _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::vector<uint64_t> histogram::bucket_counts() const
+  {
+    std::vector<uint64_t> counts(_bounds.size() + 1);
+    for (size_t i = 0; i < counts.size(); ++i)
+      counts[i] = _buckets[i].load(std::memory_order_relaxed);
+    return counts;
+  }
+
+  std::vector<int64_t> exponential_bounds(int64_t first, int64_t factor, int64_t last)
+  {
+    FC_ASSERT(first > 0 && factor > 1);
+    std::vector<int64_t> bounds;
+    for (int64_t bound = first; bound <= last; bound *= factor)
+      bounds.push_back(bound);
+    return bounds;
+  }
+
+  metrics_registry::family& metrics_registry::get_family(const std::string& name, const std::string& help,
+                                                         metric_kind kind)
+  {
+    auto itr = _families.find(name);
+    if (itr == _families.end())
+    {
+      family& result = _families[name];
+      result.help = help;
+      result.kind = kind;
+      return result;
+    }
+    FC_ASSERT(itr->second.kind == kind, "Metric ${name} is registered as another kind", ("name", name));
+    return itr->second;
+  }
+
+  counter& metrics_registry::get_counter(const std::string& name, const std::string& help, const std::string& labels)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& metric = get_family(name, help, counter_kind).counters[labels];
+    if (!metric)
+      metric.reset(new counter);
+    return *metric;
+  }
+
+  gauge& metrics_registry::get_gauge(const std::string& name, const std::string& help, const std::string& labels)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& metric = get_family(name, help, gauge_kind).gauges[labels];
+    if (!metric)
+      metric.reset(new gauge);
+    return *metric;
+  }
+
+  histogram& metrics_registry::get_histogram(const std::string& name, const std::string& help,
+                                             const std::vector<int64_t>& bounds, const std::string& labels)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& metric = get_family(name, help, histogram_kind).histograms[labels];
+    if (!metric)
+      metric.reset(new histogram(bounds));
+    return *metric;
+  }
+
+  uint64_t metrics_registry::add_collector(std::function<void()> collect)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _collectors[_next_collector_id] = std::move(collect);
+    return _next_collector_id++;
+  }
+
+  void metrics_registry::remove_collector(uint64_t id)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _collectors.erase(id);
+  }
+
+  std::string metrics_registry::render()
+  {
+    // The collectors update gauges, which takes the lock, so they are called without it
+    std::vector<std::function<void()>> collectors;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      for (const auto& item : _collectors)
+        collectors.push_back(item.second);
+    }
+    for (const auto& collect : collectors)
+      collect();
+
+    // Labels are rendered in braces, joined with the bucket bound of a histogram
+    auto with_labels = [](const std::string& labels, const std::string& more) -> std::string {
+      if (labels.empty() && more.empty())
+        return std::string();
+      return "{" + labels + (labels.empty() || more.empty() ? "" : ",") + more + "}";
+    };
+
+    std::ostringstream out;
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto& item : _families)
+    {
+      const std::string& name = item.first;
+      const family& metrics = item.second;
+      static const char* const kind_names[] = { "counter", "gauge", "histogram" };
+      out << "# HELP " << name << " " << metrics.help << "\n";
+      out << "# TYPE " << name << " " << kind_names[metrics.kind] << "\n";
+      for (const auto& metric : metrics.counters)
+        out << name << with_labels(metric.first, "") << " " << metric.second->value() << "\n";
+      for (const auto& metric : metrics.gauges)
+        out << name << with_labels(metric.first, "") << " " << metric.second->value() << "\n";
+      for (const auto& metric : metrics.histograms)
+      {
+        const histogram& h = *metric.second;
+        const std::vector<uint64_t> counts = h.bucket_counts();
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < h.bounds().size(); ++i)
+        {
+          cumulative += counts[i];
+          out << name << "_bucket" << with_labels(metric.first, "le=\"" + std::to_string(h.bounds()[i]) + "\"")
+              << " " << cumulative << "\n";
+        }
+        cumulative += counts.back();
+        out << name << "_bucket" << with_labels(metric.first, "le=\"+Inf\"") << " " << cumulative << "\n";
+        out << name << "_sum" << with_labels(metric.first, "") << " " << h.sum() << "\n";
+        // The count is that of the buckets, so that it matches the +Inf bucket
+        out << name << "_count" << with_labels(metric.first, "") << " " << cumulative << "\n";
+      }
+    }
+    return out.str();
+  }
+
+  metrics_registry& metrics()
+  {
+    static metrics_registry registry;
+    return registry;
+  }
+
+} } // end namespace graphene::utilities
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/utilities/numa.hpp>
+
+#include <fstream>
+#include <sstream>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace graphene { namespace utilities {
+
+  namespace {
+    /** Parses a kernel list such as "0-3,8,10-11" */
+    std::vector<uint32_t> parse_list(const std::string& list)
+    {
+      std::vector<uint32_t> result;
+      std::stringstream ranges(list);
+      std::string range;
+      while (std::getline(ranges, range, ','))
+      {
+        if (range.empty() || range == "\n")
+          continue;
+        const size_t dash = range.find('-');
+        const uint32_t first = uint32_t(std::stoul(range.substr(0, dash)));
+        const uint32_t last = dash == std::string::npos ? first : uint32_t(std::stoul(range.substr(dash + 1)));
+        for (uint32_t i = first; i <= last; ++i)
+          result.push_back(i);
+      }
+      return result;
+    }
+
+    std::string read_line(const std::string& path)
+    {
+      std::ifstream in(path);
+      std::string line;
+      std::getline(in, line);
+      return line;
+    }
+  }
+
+  std::vector<uint32_t> numa_nodes()
+  {
+#ifdef __linux__
+    return parse_list(read_line("/sys/devices/system/node/online"));
+#else
+    return std::vector<uint32_t>();
+#endif
+  }
+
+  std::vector<uint32_t> numa_node_cpus(uint32_t node)
+  {
+#ifdef __linux__
+    return parse_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+#else
+    return std::vector<uint32_t>();
+#endif
+  }
+
+  bool bind_current_thread_to_numa_node(uint32_t node)
+  {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    const std::vector<uint32_t> cpus = numa_node_cpus(node);
+    if (cpus.empty())
+      return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (uint32_t cpu : cpus)
+      if (cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+      return false;
+
+    // MPOL_PREFERRED, from linux/mempolicy.h which is not installed everywhere
+    const int mpol_preferred = 1;
+    const unsigned long bits_per_word = sizeof(unsigned long) * 8;
+    std::vector<unsigned long> node_mask(node / bits_per_word + 1, 0);
+    node_mask[node / bits_per_word] |= 1ul << (node % bits_per_word);
+    // A failure here leaves the thread pinned with the default placement, which is still local first
+    syscall(SYS_set_mempolicy, mpol_preferred, node_mask.data(), node_mask.size() * bits_per_word + 1);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  std::string describe_current_thread_affinity()
+  {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+      return "unknown";
+    std::string result;
+    int first = -1;
+    for (int cpu = 0; cpu <= CPU_SETSIZE; ++cpu)
+    {
+      const bool in_set = cpu < CPU_SETSIZE && CPU_ISSET(cpu, &set);
+      if (in_set && first < 0)
+        first = cpu;
+      else if (!in_set && first >= 0)
+      {
+        if (!result.empty())
+          result += ",";
+        result += std::to_string(first);
+        if (cpu - 1 > first)
+          result += "-" + std::to_string(cpu - 1);
+        first = -1;
+      }
+    }
+    return result.empty() ? "none" : "cpus " + result;
+#else
+    return "unknown";
+#endif
+  }
+
+} } // end namespace graphene::utilities
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/utilities/thread_pools.hpp>
+#include <graphene/utilities/metrics.hpp>
+#include <graphene/utilities/numa.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <sstream>
+
+namespace graphene { namespace utilities {
+
+  std::pair<std::string, thread_pools::pool_config> thread_pools::parse(const std::string& spec)
+  {
+    const size_t equals = spec.find('=');
+    FC_ASSERT(equals != std::string::npos && equals > 0, "A thread pool is given as role=count[@numa-node], not ${spec}",
+              ("spec", spec));
+    pool_config config;
+    const std::string role = spec.substr(0, equals);
+    const size_t at = spec.find('@', equals);
+    try
+    {
+      config.thread_count = uint32_t(std::stoul(spec.substr(equals + 1, at - equals - 1)));
+      if (at != std::string::npos)
+        config.numa_node = uint32_t(std::stoul(spec.substr(at + 1)));
+    }
+    catch (const std::logic_error&)
+    {
+      FC_THROW("A thread pool is given as role=count[@numa-node], not ${spec}", ("spec", spec));
+    }
+    return std::make_pair(role, config);
+  }
+
+  void thread_pools::configure(const std::string& role, const pool_config& config)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    pool& p = _pools[role];
+    FC_ASSERT(!p.started, "The ${role} threads have already been started", ("role", role));
+    p.config = config;
+  }
+
+  bool thread_pools::is_configured(const std::string& role) const
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _pools.count(role) > 0;
+  }
+
+  const thread_group& thread_pools::get(const std::string& role, uint32_t default_thread_count)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto itr = _pools.find(role);
+    if (itr == _pools.end())
+    {
+      itr = _pools.insert(std::make_pair(role, pool())).first;
+      itr->second.config.thread_count = default_thread_count;
+    }
+    pool& p = itr->second;
+    if (p.started)
+      return p.threads;
+
+    p.started = true;
+    p.threads.reserve(p.config.thread_count);
+    for (uint32_t i = 0; i < p.config.thread_count; ++i)
+    {
+      p.threads.push_back(std::make_shared<fc::thread>(role + " " + std::to_string(i)));
+      if (p.config.numa_node)
+      {
+        const uint32_t numa_node = *p.config.numa_node;
+        if (!p.threads.back()->async([numa_node](){ return bind_current_thread_to_numa_node(numa_node); },
+                                     "bind_to_numa_node").wait())
+          wlog("Could not bind the ${role} threads to NUMA node ${node}", ("role", role)("node", numa_node));
+      }
+    }
+    metrics().get_gauge("graphene_thread_pool_threads", "Threads in each pool of worker threads",
+                        "role=\"" + role + "\"").set(p.threads.size());
+    ilog("Started ${n} ${role} threads", ("n", p.threads.size())("role", role));
+    return p.threads;
+  }
+
+  std::string thread_pools::describe() const
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::ostringstream description;
+    for (const auto& role_and_pool : _pools)
+    {
+      if (description.tellp() > 0)
+        description << ", ";
+      const pool& p = role_and_pool.second;
+      description << role_and_pool.first << "=" << (p.started ? p.threads.size() : p.config.thread_count);
+      if (p.config.numa_node)
+        description << "@" << *p.config.numa_node;
+    }
+    return description.str();
+  }
+
+} } // end namespace graphene::utilities
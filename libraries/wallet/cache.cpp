@@ -28,6 +28,8 @@
 #include <graphene/chain/withdraw_permission_object.hpp>
 #include <graphene/chain/bond_object.hpp>
 
+#include <graphene/wallet/wallet.hpp>
+
 using namespace fc;
 using namespace graphene::chain;
 
@@ -44,14 +46,14 @@ object* create_object( const variant& v )
    const variant_object& obj = v.get_object();
    object_id_type obj_id = obj["id"].as< object_id_type >();
 
-   FC_ASSERT( obj_id.type() == protocol_ids );
+   FC_ASSERT( obj_id.space() == protocol_ids );
 
    //
    // Sufficiently clever template metaprogramming might
    // be able to convince the compiler to emit this switch
    // instead of creating it explicitly.
    //
-   switch( obj_id.space() )
+   switch( obj_id.type() )
    {
       /*
       case null_object_type:
@@ -97,4 +99,40 @@ object* create_object( const variant& v )
    FC_ASSERT( false, "unknown type_id" );
 }
 
+const account_object* object_cache::find_account( const string& name )const
+{
+   auto itr = _account_names.find( name );
+   return itr == _account_names.end() ? nullptr : find<account_object>( itr->second );
+}
+
+const asset_object* object_cache::find_asset( const string& symbol )const
+{
+   auto itr = _asset_symbols.find( symbol );
+   return itr == _asset_symbols.end() ? nullptr : find<asset_object>( itr->second );
+}
+
+const object& object_cache::store( const variant& v )
+{
+   unique_ptr<object> obj( create_object( v ) );
+   if( const account_object* account = dynamic_cast<const account_object*>( obj.get() ) )
+      _account_names[account->name] = account->id;
+   else if( const asset_object* a = dynamic_cast<const asset_object*>( obj.get() ) )
+      _asset_symbols[a->symbol] = a->id;
+   auto& cached = _objects[obj->id];
+   cached = std::move( obj );
+   return *cached;
+}
+
+void object_cache::erase( object_id_type id )
+{
+   auto itr = _objects.find( id );
+   if( itr == _objects.end() )
+      return;
+   if( const account_object* account = dynamic_cast<const account_object*>( itr->second.get() ) )
+      _account_names.erase( account->name );
+   else if( const asset_object* a = dynamic_cast<const asset_object*>( itr->second.get() ) )
+      _asset_symbols.erase( a->symbol );
+   _objects.erase( itr );
+}
+
 } }
@@ -20,6 +20,8 @@
 #include <graphene/app/api.hpp>
 #include <graphene/chain/address.hpp>
 
+#include <unordered_map>
+
 using namespace graphene::app;
 using namespace graphene::chain;
 using namespace graphene::utilities;
@@ -41,6 +43,35 @@ typedef uint16_t transaction_handle_type;
 
 object* create_object( const variant& v );
 
+/**
+ * Copies of chain objects kept by the wallet so that looking them up again does not query the node. The wallet keeps
+ * them current from the change notifications of the node. Accounts and assets are also found by their name and
+ * symbol, which never change.
+ */
+class object_cache
+{
+   public:
+      /// @return the cached object of type T with the given id, or nullptr
+      template<typename T>
+      const T* find( object_id_type id )const
+      {
+         auto itr = _objects.find( id );
+         return itr == _objects.end() ? nullptr : dynamic_cast<const T*>( itr->second.get() );
+      }
+      const account_object* find_account( const string& name )const;
+      const asset_object*   find_asset( const string& symbol )const;
+
+      /// Caches the object in v, replacing the copy of the same id if there is one
+      const object& store( const variant& v );
+      void          erase( object_id_type id );
+      size_t        size()const { return _objects.size(); }
+
+   private:
+      map<object_id_type, unique_ptr<object>> _objects;
+      std::unordered_map<string, account_id_type> _account_names;
+      std::unordered_map<string, asset_id_type>   _asset_symbols;
+};
+
 struct plain_keys
 {
    map<key_id_type, string>  keys;
@@ -75,8 +106,10 @@ struct wallet_data
       }
    }
 
-   /** encrypted keys */
+   /** encrypted keys, as written by wallets that predate @ref cipher_key_chunks */
    vector<char>              cipher_keys;
+   /** encrypted keys, @ref keystore::keys_per_chunk to a chunk; keys in later chunks replace earlier ones */
+   vector<vector<char>>      cipher_key_chunks;
 
    // map of account_name -> base58_private_key for
    //    incomplete account regs
@@ -87,6 +120,68 @@ struct wallet_data
    string                    ws_password;
 };
 
+/**
+ * The private keys of the wallet, decoded once on unlock and indexed by key id and by address.
+ *
+ * Keys are encrypted in chunks of @ref keys_per_chunk. Only the last, partially filled chunk is
+ * re-encrypted when keys are imported, so saving does not grow with the number of keys already
+ * in the wallet. All chunks are rewritten only when the password changes or the keys were stored
+ * by an older wallet in @ref wallet_data::cipher_keys.
+ */
+class keystore
+{
+   public:
+      static const size_t keys_per_chunk = 1000;
+
+      bool is_locked()const { return _password == fc::sha512(); }
+      /// Decrypts all keys in data; throws if they were not encrypted with password
+      void unlock( const wallet_data& data, const fc::sha512& password );
+      /// Forgets the password and every decrypted key
+      void lock();
+      /// The keys are encrypted with password from the next @ref save on
+      void set_password( const fc::sha512& password );
+
+      /// Adds the key, or replaces the one stored under id; returns false if wif is malformed
+      bool add( key_id_type id, const string& wif );
+      const fc::ecc::private_key* find( key_id_type id )const;
+      const fc::ecc::private_key* find( const address& addr )const;
+      const map<key_id_type, string>& wif_keys()const { return _wif_keys; }
+      size_t size()const { return _wif_keys.size(); }
+
+      /// Writes the keys added since the last save to data
+      void save( wallet_data& data );
+
+   private:
+      vector<char> encrypt_chunk( vector<key_id_type>::const_iterator first,
+                                  vector<key_id_type>::const_iterator last )const;
+      void         insert( key_id_type id, const string& wif, fc::ecc::private_key&& key );
+
+      fc::sha512                             _password;
+      map<key_id_type, string>               _wif_keys;
+      map<key_id_type, fc::ecc::private_key> _keys;
+      map<address, key_id_type>              _key_ids;
+
+      /// Chunks at the front of wallet_data::cipher_key_chunks that will not be written again
+      size_t                                 _sealed_chunks = 0;
+      /// Keys in the chunk after the sealed ones
+      vector<key_id_type>                    _open_chunk;
+      bool                                   _open_chunk_changed = false;
+      bool                                   _rewrite_all = false;
+};
+
+/// What @ref wallet_api::bulk_transfer did
+struct bulk_transfer_result
+{
+   uint32_t                      transactions = 0;
+   uint32_t                      operations = 0;
+   /// How many of the transactions the node accepted
+   uint32_t                      accepted = 0;
+   /// The index of each transaction the node rejected, and why
+   vector<pair<uint32_t,string>> failures;
+   double                        seconds = 0;
+   double                        operations_per_second = 0;
+};
+
 namespace detail {
 class wallet_api_impl;
 }
@@ -109,12 +204,15 @@ class wallet_api
       optional<signed_block>            get_block( uint32_t num );
       uint64_t                          get_account_count()const;
       vector<account_object>            list_my_accounts();
-      map<string,account_id_type>       list_accounts(const string& lowerbound, uint32_t limit);
+      vector<pair<string,account_id_type>> list_accounts(const string& lowerbound, uint32_t limit);
       vector<asset>                     list_account_balances(const string& id);
+      vector<vesting_balance_object>    get_vesting_balances(string account_name_or_id)const;
       vector<asset_object>              list_assets(const string& lowerbound, uint32_t limit)const;
       vector<operation_history_object>  get_account_history(string name, int limit)const;
       vector<limit_order_object>        get_limit_orders(string a, string b, uint32_t limit)const;
+      order_book                        get_order_book(string base, string quote, uint32_t depth)const;
       vector<short_order_object>        get_short_orders(string a, uint32_t limit)const;
+      vector<bond_offer_object>         get_bond_offers(string a, uint32_t limit)const;
       vector<call_order_object>         get_call_orders(string a, uint32_t limit)const;
       vector<force_settlement_object>   get_settle_orders(string a, uint32_t limit)const;
       global_property_object            get_global_properties() const;
@@ -195,6 +293,33 @@ class wallet_api
                                   string memo,
                                   bool broadcast = false);
 
+      /**
+       * @brief Withdraws all that may be withdrawn from an account's vesting balances in an asset
+       *
+       * @param account_name_or_id The account owning the vesting balances
+       * @param asset_symbol The asset to withdraw
+       * @param broadcast true to broadcast the transaction on the network
+       * @returns the signed transaction withdrawing the vesting balances
+       */
+      signed_transaction withdraw_vesting_balances(string account_name_or_id,
+                                                   string asset_symbol,
+                                                   bool broadcast = false);
+
+      /**
+       * @brief Pays many accounts from one, packing the transfers into as few transactions as fit
+       *
+       * The transactions are filled up to the maximum transaction size, signed on @p signing_threads threads and
+       * broadcast with up to @p max_in_flight of them awaiting the node at a time. A transaction the node rejects
+       * does not stop the others; its transfers are not made.
+       *
+       * @param payments the payee name or ID and the amount of each transfer
+       */
+      bulk_transfer_result bulk_transfer(string from,
+                                         vector<pair<string,string>> payments,
+                                         string asset_symbol,
+                                         uint32_t signing_threads = 4,
+                                         uint32_t max_in_flight = 16);
+
       signed_transaction sell_asset(string seller_account,
                                     string amount_to_sell,
                                     string   symbol_to_sell,
@@ -237,9 +362,13 @@ class wallet_api
 
 FC_REFLECT( graphene::wallet::plain_keys, (keys)(checksum) )
 
+FC_REFLECT( graphene::wallet::bulk_transfer_result,
+            (transactions)(operations)(accepted)(failures)(seconds)(operations_per_second) )
+
 FC_REFLECT( graphene::wallet::wallet_data,
             (my_accounts)
             (cipher_keys)
+            (cipher_key_chunks)
             (pending_account_registrations)
             (ws_server)
             (ws_user)
@@ -265,6 +394,7 @@ FC_API( graphene::wallet::wallet_api,
         (list_my_accounts)
         (list_accounts)
         (list_account_balances)
+        (get_vesting_balances)
         (list_assets)
         (import_key)
         (suggest_brain_key)
@@ -274,6 +404,8 @@ FC_API( graphene::wallet::wallet_api,
         (sell_asset)
         (short_sell_asset)
         (transfer)
+        (withdraw_vesting_balances)
+        (bulk_transfer)
         (create_asset)
         (issue_asset)
         (get_asset)
@@ -289,7 +421,9 @@ FC_API( graphene::wallet::wallet_api,
         (load_wallet_file)
         (normalize_brain_key)
         (get_limit_orders)
+        (get_order_book)
         (get_short_orders)
+        (get_bond_offers)
         (get_call_orders)
         (get_settle_orders)
         (save_wallet_file)
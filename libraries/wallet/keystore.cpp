@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <graphene/wallet/wallet.hpp>
+#include <graphene/utilities/key_conversion.hpp>
+
+#include <fc/crypto/aes.hpp>
+
+#include <algorithm>
+
+namespace graphene { namespace wallet {
+
+const size_t keystore::keys_per_chunk;
+
+void keystore::unlock( const wallet_data& data, const fc::sha512& password )
+{ try {
+   FC_ASSERT( password != fc::sha512() );
+   FC_ASSERT( !data.cipher_keys.empty() || !data.cipher_key_chunks.empty(), "The wallet has no password set" );
+   lock();
+   try {
+      auto decrypt = [&]( const vector<char>& cipher ) -> map<key_id_type, string> {
+         auto pk = fc::raw::unpack<plain_keys>( fc::aes_decrypt( password, cipher ) );
+         FC_ASSERT( pk.checksum == password );
+         for( const auto& item : pk.keys )
+         {
+            fc::optional<fc::ecc::private_key> key = graphene::utilities::wif_to_key( item.second );
+            FC_ASSERT( key.valid(), "Malformed private key for ${id}", ("id", item.first) );
+            insert( item.first, item.second, std::move(*key) );
+         }
+         return pk.keys;
+      };
+
+      if( !data.cipher_keys.empty() )
+      {
+         decrypt( data.cipher_keys );
+         _rewrite_all = true;
+      }
+      for( const auto& chunk : data.cipher_key_chunks )
+      {
+         auto keys = decrypt( chunk );
+         _open_chunk.clear();
+         for( const auto& item : keys )
+            _open_chunk.push_back( item.first );
+      }
+      _sealed_chunks = data.cipher_key_chunks.empty() ? 0 : data.cipher_key_chunks.size() - 1;
+   } catch( ... ) {
+      lock();
+      throw;
+   }
+   _password = password;
+} FC_CAPTURE_AND_RETHROW() }
+
+void keystore::lock()
+{
+   _password = fc::sha512();
+   for( auto& item : _wif_keys )
+      std::fill( item.second.begin(), item.second.end(), '\0' );
+   _wif_keys.clear();
+   _keys.clear();
+   _key_ids.clear();
+   _sealed_chunks = 0;
+   _open_chunk.clear();
+   _open_chunk_changed = false;
+   _rewrite_all = false;
+}
+
+void keystore::set_password( const fc::sha512& password )
+{
+   FC_ASSERT( password != fc::sha512() );
+   _password = password;
+   _rewrite_all = true;
+}
+
+bool keystore::add( key_id_type id, const string& wif )
+{
+   FC_ASSERT( !is_locked() );
+   auto itr = _wif_keys.find( id );
+   if( itr != _wif_keys.end() && itr->second == wif )
+      return true;
+
+   fc::optional<fc::ecc::private_key> key = graphene::utilities::wif_to_key( wif );
+   if( !key.valid() )
+      return false;
+   bool replaced = itr != _wif_keys.end();
+   insert( id, wif, std::move(*key) );
+
+   if( !_rewrite_all )
+   {
+      // A key replaced in a sealed chunk is stored again in the open one, which is decrypted later
+      if( !replaced || std::find( _open_chunk.begin(), _open_chunk.end(), id ) == _open_chunk.end() )
+         _open_chunk.push_back( id );
+      _open_chunk_changed = true;
+   }
+   return true;
+}
+
+void keystore::insert( key_id_type id, const string& wif, fc::ecc::private_key&& key )
+{
+   auto itr = _keys.find( id );
+   if( itr != _keys.end() )
+      _key_ids.erase( address( itr->second.get_public_key() ) );
+   _key_ids[ address( key.get_public_key() ) ] = id;
+   _keys[ id ] = std::move( key );
+   _wif_keys[ id ] = wif;
+}
+
+const fc::ecc::private_key* keystore::find( key_id_type id )const
+{
+   auto itr = _keys.find( id );
+   return itr != _keys.end() ? &itr->second : nullptr;
+}
+
+const fc::ecc::private_key* keystore::find( const address& addr )const
+{
+   auto itr = _key_ids.find( addr );
+   return itr != _key_ids.end() ? find( itr->second ) : nullptr;
+}
+
+void keystore::save( wallet_data& data )
+{ try {
+   FC_ASSERT( !is_locked() );
+   if( _rewrite_all )
+   {
+      data.cipher_keys.clear();
+      data.cipher_key_chunks.clear();
+      _sealed_chunks = 0;
+      _open_chunk.clear();
+      _open_chunk.reserve( _keys.size() );
+      for( const auto& item : _keys )
+         _open_chunk.push_back( item.first );
+      _open_chunk_changed = true;
+      _rewrite_all = false;
+   }
+   // Even a wallet without keys stores one chunk, so that the password can be checked on unlock
+   if( !_open_chunk_changed && !data.cipher_key_chunks.empty() )
+      return;
+
+   data.cipher_key_chunks.resize( _sealed_chunks );
+   auto first = _open_chunk.cbegin();
+   do {
+      auto last = first + std::min<size_t>( keys_per_chunk, _open_chunk.cend() - first );
+      data.cipher_key_chunks.push_back( encrypt_chunk( first, last ) );
+      first = last;
+   } while( first != _open_chunk.cend() );
+
+   // Every chunk but the last is full, and is never written again
+   size_t full = data.cipher_key_chunks.size() - 1 - _sealed_chunks;
+   _open_chunk.erase( _open_chunk.begin(), _open_chunk.begin() + full * keys_per_chunk );
+   _sealed_chunks += full;
+   _open_chunk_changed = false;
+} FC_CAPTURE_AND_RETHROW() }
+
+vector<char> keystore::encrypt_chunk( vector<key_id_type>::const_iterator first,
+                                      vector<key_id_type>::const_iterator last )const
+{
+   plain_keys chunk;
+   chunk.checksum = _password;
+   for( ; first != last; ++first )
+      chunk.keys[*first] = _wif_keys.at( *first );
+   return fc::aes_encrypt( _password, fc::raw::pack( chunk ) );
+}
+
+} } // graphene::wallet
@@ -23,6 +23,7 @@
 #include <sstream>
 #include <string>
 #include <list>
+#include <deque>
 
 #include <fc/io/fstream.hpp>
 #include <fc/io/json.hpp>
@@ -33,6 +34,7 @@
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/hex.hpp>
 #include <fc/thread/mutex.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <graphene/app/api.hpp>
 #include <graphene/chain/address.hpp>
@@ -320,11 +322,8 @@ public:
 
    void encrypt_keys()
    {
-      plain_keys data;
-      data.keys = _keys;
-      data.checksum = _checksum;
-      auto plain_txt = fc::raw::pack(data);
-      _wallet.cipher_keys = fc::aes_encrypt( data.checksum, plain_txt );
+      if( !_keystore.is_locked() )
+         _keystore.save( _wallet );
    }
 
    bool copy_wallet_file( string destination_filename )
@@ -361,7 +360,7 @@ public:
 
    bool is_locked()const
    {
-      return _checksum == fc::sha512();
+      return _keystore.is_locked();
    }
 
    template<typename T>
@@ -396,13 +395,38 @@ public:
    {
       return _remote_db->get_dynamic_global_properties();
    }
+   /// Keeps the cached copy of an object, and the wallet's copy of its own accounts, up to date
+   void on_object_changed(const fc::variant& v)
+   {
+      const object& obj = _cache.store( v );
+      if( obj.id.space() == protocol_ids && obj.id.type() == account_object_type &&
+          _wallet.my_accounts.get<by_id>().count( obj.id ) )
+         _wallet.update_account( static_cast<const account_object&>( obj ) );
+   }
+   /**
+    * Caches obj and watches it for changes; keys never change, so they are not watched. The wallet's own accounts are
+    * watched by on_object_changed instead, which keeps their cached copies as well.
+    */
+   template<typename T>
+   const T& cache_object(const T& obj)const
+   {
+      const object& cached = _cache.store( fc::variant( obj ) );
+      if( obj.id.type() != key_object_type )
+         _remote_db->subscribe_to_objects( [this]( const fc::variant& v ) {
+            _cache.store( v );
+         }, {obj.id} );
+      return static_cast<const T&>( cached );
+   }
+
    account_object get_account(account_id_type id) const
    {
       if( _wallet.my_accounts.get<by_id>().count(id) )
          return *_wallet.my_accounts.get<by_id>().find(id);
+      if( const account_object* cached = _cache.find<account_object>(id) )
+         return *cached;
       auto rec = _remote_db->get_accounts({id}).front();
       FC_ASSERT(rec);
-      return *rec;
+      return cache_object(*rec);
    }
    account_object get_account(string account_name_or_id) const
    {
@@ -416,20 +440,34 @@ public:
          // It's a name
          if( _wallet.my_accounts.get<by_name>().count(account_name_or_id) )
             return *_wallet.my_accounts.get<by_name>().find(account_name_or_id);
+         if( const account_object* cached = _cache.find_account(account_name_or_id) )
+            return *cached;
          auto rec = _remote_db->lookup_account_names({account_name_or_id}).front();
          FC_ASSERT( rec && rec->name == account_name_or_id );
-         return *rec;
+         return cache_object(*rec);
       }
    }
    account_id_type get_account_id(string account_name_or_id) const
    {
-      return get_account(account_name_or_id).get_id();
+      FC_ASSERT( account_name_or_id.size() > 0 );
+      if( auto id = maybe_id<account_id_type>(account_name_or_id) )
+         return *id;
+      if( _wallet.my_accounts.get<by_name>().count(account_name_or_id) )
+         return _wallet.my_accounts.get<by_name>().find(account_name_or_id)->id;
+      if( const account_object* cached = _cache.find_account(account_name_or_id) )
+         return cached->id;
+      // Only the ID is needed, so the account itself is not fetched
+      auto id = _remote_db->lookup_account_ids({account_name_or_id}).front();
+      FC_ASSERT( id, "Unknown account ${a}", ("a", account_name_or_id) );
+      return *id;
    }
    optional<asset_object> find_asset(asset_id_type id)const
    {
+      if( const asset_object* cached = _cache.find<asset_object>(id) )
+         return *cached;
       auto rec = _remote_db->get_assets({id}).front();
       if( rec )
-         _asset_cache[id] = *rec;
+         cache_object(*rec);
       return rec;
    }
    optional<asset_object> find_asset(string asset_symbol_or_id)const
@@ -442,13 +480,15 @@ public:
          return find_asset(*id);
       } else {
          // It's a symbol
+         if( const asset_object* cached = _cache.find_asset(asset_symbol_or_id) )
+            return *cached;
          auto rec = _remote_db->lookup_asset_symbols({asset_symbol_or_id}).front();
          if( rec )
          {
             if( rec->symbol != asset_symbol_or_id )
                return optional<asset_object>();
 
-            _asset_cache[rec->get_id()] = *rec;
+            cache_object(*rec);
          }
          return rec;
       }
@@ -468,12 +508,11 @@ public:
    asset_id_type get_asset_id(string asset_symbol_or_id) const
    {
       FC_ASSERT( asset_symbol_or_id.size() > 0 );
-      vector<optional<asset_object>> opt_asset;
       if( std::isdigit( asset_symbol_or_id.front() ) )
          return fc::variant(asset_symbol_or_id).as<asset_id_type>();
-      opt_asset = _remote_db->lookup_asset_symbols( {asset_symbol_or_id} );
-      FC_ASSERT( (opt_asset.size() > 0) && (opt_asset[0].valid()) );
-      return opt_asset[0]->id;
+      auto opt_asset = find_asset( asset_symbol_or_id );
+      FC_ASSERT( opt_asset.valid() );
+      return opt_asset->id;
    }
    string                            get_wallet_filename() const
    {
@@ -481,19 +520,18 @@ public:
    }
    fc::ecc::private_key              get_private_key(key_id_type id)const
    {
-      auto it = _keys.find(id);
-      FC_ASSERT( it != _keys.end() );
-
-      fc::optional< fc::ecc::private_key > privkey = wif_to_key( it->second );
+      const fc::ecc::private_key* privkey = _keystore.find(id);
       FC_ASSERT( privkey );
       return *privkey;
    }
    fc::ecc::public_key               get_public_key(key_id_type id)const
    {
+      if( const key_object* cached = _cache.find<key_object>(id) )
+         return cached->key();
       vector<optional<key_object>> keys = _remote_db->get_keys( {id} );
       FC_ASSERT( keys.size() == 1 );
       FC_ASSERT( keys[0].valid() );
-      return keys[0]->key();
+      return cache_object(*keys[0]).key();
    }
 
    bool import_key(string account_name_or_id, string wif_key)
@@ -526,10 +564,10 @@ public:
          //    blockchain may not contain a key (i.e. are simply an address)
          if( opt_key->key_address() == wif_key_address )
          {
-            _keys[ opt_key->id ] = wif_key;
+            _keystore.add( opt_key->id, wif_key );
             if( _wallet.update_account(acnt) )
                _remote_db->subscribe_to_objects([this](const fc::variant& v) {
-                  _wallet.update_account(v.as<account_object>());
+                  on_object_changed(v);
                }, {acnt.id});
             return true;
          }
@@ -550,11 +588,22 @@ public:
          return false;
 
       if( !_wallet.my_accounts.empty() )
+      {
+         // The cached copies of these accounts would no longer be kept up to date
          _remote_db->unsubscribe_from_objects(_wallet.my_account_ids());
+         for( const auto& id : _wallet.my_account_ids() )
+            _cache.erase( id );
+      }
+      if( !_keystore.is_locked() )
+      {
+         // The decrypted keys belong to the wallet being replaced
+         _keystore.lock();
+         self.lock_changed(true);
+      }
       _wallet = fc::json::from_file( wallet_filename ).as< wallet_data >();
       if( !_wallet.my_accounts.empty() )
          _remote_db->subscribe_to_objects([this](const fc::variant& v) {
-            _wallet.update_account(v.as<account_object>());
+            on_object_changed(v);
          }, _wallet.my_account_ids());
       return true;
    }
@@ -740,16 +789,8 @@ public:
 
       for( key_id_type& key : paying_keys )
       {
-         auto it = _keys.find(key);
-         if( it != _keys.end() )
-         {
-            fc::optional< fc::ecc::private_key > privkey = wif_to_key( it->second );
-            if( !privkey.valid() )
-            {
-               FC_ASSERT( false, "Malformed private key in _keys" );
-            }
+         if( const fc::ecc::private_key* privkey = _keystore.find(key) )
             tx.sign( key, *privkey );
-         }
       }
 
       if( broadcast )
@@ -846,13 +887,8 @@ public:
 
          for( key_id_type& key : paying_keys )
          {
-            auto it = _keys.find(key);
-            if( it != _keys.end() )
-            {
-               fc::optional< fc::ecc::private_key > privkey = wif_to_key( it->second );
-               FC_ASSERT( privkey.valid(), "Malformed private key in _keys" );
+            if( const fc::ecc::private_key* privkey = _keystore.find(key) )
                tx.sign( key, *privkey );
-            }
          }
 
          // we do not insert owner_privkey here because
@@ -970,16 +1006,8 @@ public:
 
       for( key_id_type& key : approving_key_set )
       {
-         auto it = _keys.find(key);
-         if( it != _keys.end() )
-         {
-            fc::optional< fc::ecc::private_key > privkey = wif_to_key( it->second );
-            if( !privkey.valid() )
-            {
-               FC_ASSERT( false, "Malformed private key in _keys" );
-            }
+         if( const fc::ecc::private_key* privkey = _keystore.find(key) )
             tx.sign( key, *privkey );
-         }
       }
 
       if( broadcast )
@@ -1105,6 +1133,156 @@ public:
       return sign_transaction(tx, broadcast);
    } FC_CAPTURE_AND_RETHROW( (from)(to)(amount)(asset_symbol)(memo)(broadcast) ) }
 
+   signed_transaction withdraw_vesting_balances(string account_name_or_id, string asset_symbol, bool broadcast = false)
+   { try {
+      FC_ASSERT( !self.is_locked() );
+      fc::optional<asset_object> asset_obj = get_asset(asset_symbol);
+      FC_ASSERT(asset_obj, "Could not find asset matching ${asset}", ("asset", asset_symbol));
+
+      vesting_balance_withdraw_all_operation withdraw_op;
+      withdraw_op.owner = get_account_id(account_name_or_id);
+      withdraw_op.asset_type = asset_obj->id;
+
+      signed_transaction tx;
+      tx.operations.push_back(withdraw_op);
+      tx.visit(operation_set_fee(_remote_db->get_global_properties().parameters.current_fees));
+      tx.validate();
+
+      return sign_transaction(tx, broadcast);
+   } FC_CAPTURE_AND_RETHROW( (account_name_or_id)(asset_symbol)(broadcast) ) }
+
+   bulk_transfer_result bulk_transfer(string from, vector<pair<string,string>> payments, string asset_symbol,
+                                      uint32_t signing_threads, uint32_t max_in_flight)
+   { try {
+      FC_ASSERT( !self.is_locked() );
+      FC_ASSERT( signing_threads > 0 && max_in_flight > 0 );
+      fc::time_point start = fc::time_point::now();
+
+      asset_object asset_obj = get_asset(asset_symbol);
+      account_object from_account = get_account(from);
+
+      // Look the payees up a batch at a time rather than one query each
+      map<string, account_id_type> payees;
+      for( const auto& payment : payments )
+         payees[payment.first];
+      vector<string> unknown;
+      for( auto& payee : payees )
+      {
+         if( auto id = maybe_id<account_id_type>(payee.first) )
+            payee.second = *id;
+         else if( _wallet.my_accounts.get<by_name>().count(payee.first) )
+            payee.second = _wallet.my_accounts.get<by_name>().find(payee.first)->id;
+         else if( const account_object* cached = _cache.find_account(payee.first) )
+            payee.second = cached->id;
+         else
+            unknown.push_back(payee.first);
+      }
+      const size_t lookup_batch = 1000;
+      for( size_t i = 0; i < unknown.size(); i += lookup_batch )
+      {
+         vector<string> names( unknown.begin() + i, unknown.begin() + std::min(i + lookup_batch, unknown.size()) );
+         auto ids = _remote_db->lookup_account_ids(names);
+         for( size_t j = 0; j < names.size(); ++j )
+         {
+            FC_ASSERT( ids[j], "Unknown account ${a}", ("a", names[j]) );
+            payees[names[j]] = *ids[j];
+         }
+      }
+
+      vector<pair<key_id_type, fc::ecc::private_key>> signing_keys;
+      for( const key_id_type& key : from_account.active.get_keys() )
+      {
+         if( const fc::ecc::private_key* privkey = _keystore.find(key) )
+            signing_keys.emplace_back(key, *privkey);
+      }
+      FC_ASSERT( !signing_keys.empty(), "The wallet has none of the active keys of ${a}", ("a", from) );
+
+      // Every transaction lives as long as the chain allows, as broadcasting all of them may take a while
+      const chain_parameters& params = get_global_properties().parameters;
+      signed_transaction empty_trx;
+      empty_trx.set_expiration(get_dynamic_global_properties().head_block_id,
+                               params.maximum_time_until_expiration / params.block_interval);
+      // Leave room for the signatures, and for the operation count to grow
+      const uint64_t empty_size = fc::raw::pack_size(empty_trx) + fc::raw::pack_size(fc::unsigned_int(uint32_t(-1)))
+            + signing_keys.size() * fc::raw::pack_size(std::make_pair(key_id_type(), signature_type()));
+
+      vector<signed_transaction> trxs;
+      uint64_t trx_size = 0;
+      for( const auto& payment : payments )
+      {
+         transfer_operation xfer_op;
+         xfer_op.from = from_account.id;
+         xfer_op.to = payees[payment.first];
+         xfer_op.amount = asset_obj.amount_from_string(payment.second);
+         xfer_op.fee = xfer_op.calculate_fee(params.current_fees);
+         xfer_op.validate();
+
+         operation op = xfer_op;
+         const uint64_t op_size = fc::raw::pack_size(op);
+         if( trxs.empty() || trx_size + op_size > params.maximum_transaction_size )
+         {
+            trxs.push_back(empty_trx);
+            trx_size = empty_size;
+         }
+         trxs.back().operations.push_back(std::move(op));
+         trx_size += op_size;
+      }
+
+      // Each thread signs its own run of transactions
+      const size_t thread_count = std::min<size_t>(signing_threads, trxs.size());
+      if( thread_count > 0 )
+      {
+         const size_t chunk_size = (trxs.size() + thread_count - 1) / thread_count;
+         vector<unique_ptr<fc::thread>> threads;
+         vector<fc::future<void>> signers;
+         for( size_t t = 0; t < thread_count; ++t )
+         {
+            const size_t first = t * chunk_size;
+            const size_t last = std::min(first + chunk_size, trxs.size());
+            threads.emplace_back(new fc::thread("bulk_sign" + fc::to_string(uint64_t(t))));
+            signers.push_back(threads.back()->async([&trxs, &signing_keys, first, last]() {
+               for( size_t i = first; i < last; ++i )
+                  for( const auto& key : signing_keys )
+                     trxs[i].sign(key.first, key.second);
+            }, "bulk_sign"));
+         }
+         for( auto& signer : signers )
+            signer.wait();
+      }
+
+      bulk_transfer_result result;
+      result.transactions = trxs.size();
+      result.operations = payments.size();
+      std::deque<pair<uint32_t, fc::future<void>>> in_flight;
+      auto finish_oldest = [&]() {
+         try {
+            in_flight.front().second.wait();
+            ++result.accepted;
+         } catch( const fc::exception& e ) {
+            result.failures.emplace_back(in_flight.front().first, e.to_string());
+         }
+         in_flight.pop_front();
+      };
+      for( uint32_t i = 0; i < trxs.size(); ++i )
+      {
+         if( in_flight.size() >= max_in_flight )
+            finish_oldest();
+         const signed_transaction& trx = trxs[i];
+         in_flight.emplace_back(i, fc::async([this, &trx]() {
+            _remote_net->broadcast_transaction(trx);
+         }, "bulk_broadcast"));
+      }
+      while( !in_flight.empty() )
+         finish_oldest();
+
+      result.seconds = double((fc::time_point::now() - start).count()) / 1000000;
+      if( result.seconds > 0 )
+         result.operations_per_second = result.operations / result.seconds;
+      ilog("Sent ${n} transfers in ${t} transactions in ${s} seconds, ${f} of them rejected",
+           ("n", result.operations)("t", result.transactions)("s", result.seconds)("f", result.failures.size()));
+      return result;
+   } FC_CAPTURE_AND_RETHROW( (from)(asset_symbol)(signing_threads)(max_in_flight) ) }
+
    signed_transaction issue_asset(string to_account, string amount, string symbol,
                                   string memo, bool broadcast = false)
    {
@@ -1204,7 +1382,13 @@ void dbg_make_mia(string creator, string symbol)
 
 void flood_network(string prefix, uint32_t number_of_transactions)
 {
-   const account_object& master = *_wallet.my_accounts.get<by_name>().lower_bound("bts");
+   // The first of the wallet's accounts in name order from "bts" on
+   const account_object* first = nullptr;
+   for( const account_object& acct : _wallet.my_accounts )
+      if( acct.name >= "bts" && (!first || acct.name < first->name) )
+         first = &acct;
+   FC_ASSERT( first, "The wallet has no account to flood the network from" );
+   const account_object& master = *first;
    int number_of_accounts = number_of_transactions / 3;
    number_of_transactions -= number_of_accounts;
    auto key = derive_private_key("floodshill", 0);
@@ -1240,8 +1424,7 @@ void flood_network(string prefix, uint32_t number_of_transactions)
 string                  _wallet_filename;
 wallet_data             _wallet;
 
-map<key_id_type,string> _keys;
-fc::sha512              _checksum;
+keystore                _keystore;
 
 fc::api<login_api>      _remote_api;
 fc::api<database_api>   _remote_db;
@@ -1253,7 +1436,7 @@ mode_t                  _old_umask;
 #endif
 const string _wallet_filename_extension = ".wallet";
 
-mutable map<asset_id_type, asset_object> _asset_cache;
+mutable object_cache    _cache;
 };
 
 void operation_printer::fee(const asset& a)const {
@@ -1273,10 +1456,8 @@ void operation_printer::operator()(const transfer_operation& op) const
          try {
             optional<key_object> sender_key = wallet._remote_db->get_objects({op.memo->from}).front().as<optional<key_object>>();
             FC_ASSERT(sender_key, "Sender key ${k} does not exist.", ("k", op.memo->from));
-            FC_ASSERT(wallet._keys.count(op.memo->to), "Memo is encrypted to a key ${k} not in this wallet.",
-                      ("k", op.memo->to));
-            auto my_key = wif_to_key(wallet._keys.at(op.memo->to));
-            FC_ASSERT(my_key, "Unable to recover private key to decrypt memo. Wallet may be corrupted.");
+            const fc::ecc::private_key* my_key = wallet._keystore.find(op.memo->to);
+            FC_ASSERT(my_key, "Memo is encrypted to a key ${k} not in this wallet.", ("k", op.memo->to));
             out << " -- Memo: " << op.memo->get_message(*my_key, sender_key->key());
          } catch (const fc::exception& e) {
             out << " -- could not decrypt memo";
@@ -1361,7 +1542,7 @@ vector<account_object> wallet_api::list_my_accounts()
    return vector<account_object>(my->_wallet.my_accounts.begin(), my->_wallet.my_accounts.end());
 }
 
-map<string,account_id_type> wallet_api::list_accounts(const string& lowerbound, uint32_t limit)
+vector<pair<string,account_id_type>> wallet_api::list_accounts(const string& lowerbound, uint32_t limit)
 {
    return my->_remote_db->lookup_accounts(lowerbound, limit);
 }
@@ -1369,8 +1550,15 @@ map<string,account_id_type> wallet_api::list_accounts(const string& lowerbound,
 vector<asset> wallet_api::list_account_balances(const string& id)
 {
    if( auto real_id = detail::maybe_id<account_id_type>(id) )
-      return my->_remote_db->get_account_balances(*real_id, flat_set<asset_id_type>());
-   return my->_remote_db->get_account_balances(get_account(id).id, flat_set<asset_id_type>());
+      return my->_remote_db->get_all_account_balances(*real_id);
+   return my->_remote_db->get_all_account_balances(get_account(id).id);
+}
+
+vector<vesting_balance_object> wallet_api::get_vesting_balances(string account_name_or_id)const
+{
+   if( auto real_id = detail::maybe_id<account_id_type>(account_name_or_id) )
+      return my->_remote_db->get_vesting_balances(*real_id);
+   return my->_remote_db->get_vesting_balances(get_account(account_name_or_id).id);
 }
 
 vector<asset_object> wallet_api::list_assets(const string& lowerbound, uint32_t limit)const
@@ -1388,11 +1576,21 @@ vector<limit_order_object> wallet_api::get_limit_orders(string a, string b, uint
    return my->_remote_db->get_limit_orders(get_asset(a).id, get_asset(b).id, limit);
 }
 
+order_book wallet_api::get_order_book(string base, string quote, uint32_t depth)const
+{
+   return my->_remote_db->get_order_book(get_asset(base).id, get_asset(quote).id, depth);
+}
+
 vector<short_order_object> wallet_api::get_short_orders(string a, uint32_t limit)const
 {
    return my->_remote_db->get_short_orders(get_asset(a).id, limit);
 }
 
+vector<bond_offer_object> wallet_api::get_bond_offers(string a, uint32_t limit)const
+{
+   return my->_remote_db->get_bond_offers(get_asset(a).id, limit);
+}
+
 vector<call_order_object> wallet_api::get_call_orders(string a, uint32_t limit)const
 {
    return my->_remote_db->get_call_orders(get_asset(a).id, limit);
@@ -1548,6 +1746,16 @@ signed_transaction wallet_api::transfer(string from, string to, string amount,
 {
    return my->transfer(from, to, amount, asset_symbol, memo, broadcast);
 }
+signed_transaction wallet_api::withdraw_vesting_balances(string account_name_or_id, string asset_symbol,
+                                                        bool broadcast /* = false */)
+{
+   return my->withdraw_vesting_balances(account_name_or_id, asset_symbol, broadcast);
+}
+bulk_transfer_result wallet_api::bulk_transfer(string from, vector<pair<string,string>> payments, string asset_symbol,
+                                              uint32_t signing_threads, uint32_t max_in_flight)
+{
+   return my->bulk_transfer(from, payments, asset_symbol, signing_threads, max_in_flight);
+}
 signed_transaction wallet_api::create_asset(string issuer,
                                             string symbol,
                                             uint8_t precision,
@@ -1681,7 +1889,7 @@ bool wallet_api::is_locked()const
 }
 bool wallet_api::is_new()const
 {
-   return my->_wallet.cipher_keys.size() == 0;
+   return my->_wallet.cipher_keys.empty() && my->_wallet.cipher_key_chunks.empty();
 }
 
 void wallet_api::encrypt_keys()
@@ -1693,10 +1901,7 @@ void wallet_api::lock()
 { try {
    FC_ASSERT( !is_locked() );
    encrypt_keys();
-   for( auto key : my->_keys )
-      key.second = key_to_wif({});
-   my->_keys.clear();
-   my->_checksum = fc::sha512();
+   my->_keystore.lock();
    my->self.lock_changed(true);
 } FC_CAPTURE_AND_RETHROW() }
 
@@ -1704,11 +1909,7 @@ void wallet_api::unlock(string password)
 { try {
    FC_ASSERT(password.size() > 0);
    auto pw = fc::sha512::hash(password.c_str(), password.size());
-   vector<char> decrypted = fc::aes_decrypt(pw, my->_wallet.cipher_keys);
-   auto pk = fc::raw::unpack<plain_keys>(decrypted);
-   FC_ASSERT(pk.checksum == pw);
-   my->_keys = std::move(pk.keys);
-   my->_checksum = pk.checksum;
+   my->_keystore.unlock(my->_wallet, pw);
    my->self.lock_changed(false);
 } FC_CAPTURE_AND_RETHROW() }
 
@@ -1716,14 +1917,14 @@ void wallet_api::set_password( string password )
 {
    if( !is_new() )
       FC_ASSERT( !is_locked(), "The wallet must be unlocked before the password can be set" );
-   my->_checksum = fc::sha512::hash( password.c_str(), password.size() );
+   my->_keystore.set_password( fc::sha512::hash( password.c_str(), password.size() ) );
    lock();
 }
 
 map<key_id_type, string> wallet_api::dump_private_keys()
 {
    FC_ASSERT(!is_locked());
-   return my->_keys;
+   return my->_keystore.wif_keys();
 }
 
 signed_transaction wallet_api::upgrade_account( string name, bool broadcast )
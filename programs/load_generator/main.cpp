@@ -0,0 +1,550 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * The load generator connects to a node's websocket RPC, signs transactions from a scenario file ahead of time and
+ * broadcasts them at the rates the scenario asks for. It reports how many transactions the node accepted, why the
+ * rest were rejected and how long accepted transactions took to appear in an applied block.
+ *
+ * A scenario is a JSON file such as:
+ *
+ *    {
+ *       "signing_key": "5KQwrPbwdL6PhXujxW37FSSQZ1JiwsST4cqQzDeyXtP79zkvFD3",
+ *       "accounts": ["init0", "init1", "init2", "init3"],
+ *       "duration_seconds": 120,
+ *       "steps": [
+ *          {"type": "transfer", "rate": 200, "asset": "CORE", "amount": 1},
+ *          {"type": "limit_order_create", "rate": 50, "asset": "CORE", "amount": 100,
+ *           "receive_asset": "USD", "receive_amount": 1},
+ *          {"type": "limit_order_cancel", "rate": 20, "asset": "CORE", "receive_asset": "USD"}
+ *       ]
+ *    }
+ *
+ * Every account must be controlled by the signing key. The operations of a step are spread over the first fan_out
+ * accounts (all of them if fan_out is zero), and the amounts grow with each transaction of a batch so that no two
+ * transactions are identical.
+ */
+
+#include <algorithm>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+
+#include <fc/io/json.hpp>
+#include <fc/network/http/websocket.hpp>
+#include <fc/rpc/websocket_api.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <graphene/app/api.hpp>
+#include <graphene/chain/key_object.hpp>
+#include <graphene/utilities/key_conversion.hpp>
+
+#include <boost/program_options.hpp>
+
+using namespace graphene::app;
+using namespace graphene::chain;
+using namespace graphene::utilities;
+using namespace std;
+namespace bpo = boost::program_options;
+
+struct load_step
+{
+   /// transfer, limit_order_create, limit_order_cancel, account_create or asset_publish_feed
+   string   type;
+   /// Transactions per second
+   double   rate = 1;
+   /// The asset transferred, sold, or for which a feed is published
+   string   asset = GRAPHENE_SYMBOL;
+   int64_t  amount = 1;
+   /// The asset an order wants to receive, or the collateral a feed is quoted in
+   string   receive_asset = GRAPHENE_SYMBOL;
+   int64_t  receive_amount = 1;
+};
+
+struct load_scenario
+{
+   string            signing_key;
+   vector<string>    accounts;
+   uint32_t          fan_out = 0;
+   /// Prefix of the names of created accounts; the start time of the run is appended to keep runs apart
+   string            new_account_prefix = "load-run";
+   uint32_t          duration_seconds = 60;
+   /// Transactions are signed this many seconds of load at a time, and each batch references the head block
+   uint32_t          batch_seconds = 10;
+   uint16_t          lifetime_intervals = 120;
+   vector<load_step> steps;
+};
+
+FC_REFLECT( load_step, (type)(rate)(asset)(amount)(receive_asset)(receive_amount) )
+FC_REFLECT( load_scenario, (signing_key)(accounts)(fan_out)(new_account_prefix)(duration_seconds)(batch_seconds)
+            (lifetime_intervals)(steps) )
+
+class load_generator
+{
+   public:
+      load_generator( fc::api<login_api> remote_api, const load_scenario& scenario, uint32_t signing_threads )
+         : _scenario( scenario ),
+           _remote_db( remote_api->database() ),
+           _remote_net( remote_api->network() ),
+           _main_thread( &fc::thread::current() )
+      {
+         FC_ASSERT( !_scenario.steps.empty(), "The scenario has no steps" );
+         FC_ASSERT( _scenario.batch_seconds > 0 );
+         for( const load_step& step : _scenario.steps )
+            FC_ASSERT( step.rate > 0, "Step ${t} needs a positive rate", ("t", step.type) );
+
+         fc::optional<fc::ecc::private_key> key = wif_to_key( _scenario.signing_key );
+         FC_ASSERT( key, "The signing key is not a valid WIF key" );
+         _signing_key = *key;
+
+         resolve_accounts();
+         resolve_assets();
+         _fees = _remote_db->get_global_properties().parameters.current_fees;
+         _stats.resize( _scenario.steps.size() );
+         _run_stamp = fc::time_point::now().sec_since_epoch();
+
+         for( uint32_t i = 0; i < std::max( signing_threads, 1u ); ++i )
+            _signers.push_back( std::make_shared<fc::thread>( "signer " + std::to_string( i ) ) );
+
+         _last_block = _remote_db->get_dynamic_global_properties().head_block_number;
+         _remote_db->subscribe_to_objects( [this]( const fc::variant& obj )
+         {
+            uint32_t head = obj.as<dynamic_global_property_object>().head_block_number;
+            _main_thread->async( [this,head]{ on_head_block( head ); }, "Scan applied block" );
+         }, {dynamic_global_property_id_type()} );
+      }
+
+      ~load_generator()
+      {
+         _remote_db->cancel_all_subscriptions();
+      }
+
+      void run( fc::microseconds report_interval )
+      {
+         uint32_t batch_count = ( _scenario.duration_seconds + _scenario.batch_seconds - 1 ) / _scenario.batch_seconds;
+         fc::time_point next_report = fc::time_point::now() + report_interval;
+
+         fc::future<vector<scheduled_transaction>> next_batch = fc::async( [this]{ return prepare_batch( 0 ); },
+                                                                           "Prepare batch" );
+         for( uint32_t b = 0; b < batch_count; ++b )
+         {
+            vector<scheduled_transaction> batch = next_batch.wait();
+            // signing the next batch overlaps with sending this one
+            if( b + 1 < batch_count )
+               next_batch = fc::async( [this,b]{ return prepare_batch( b + 1 ); }, "Prepare batch" );
+
+            fc::time_point batch_start = fc::time_point::now();
+            for( scheduled_transaction& s : batch )
+            {
+               fc::time_point send_at = batch_start + s.offset;
+               if( send_at > fc::time_point::now() )
+                  fc::usleep( send_at - fc::time_point::now() );
+               if( fc::time_point::now() >= next_report )
+               {
+                  report( false );
+                  next_report += report_interval;
+               }
+               send( std::move( s ) );
+            }
+         }
+
+         while( _in_flight > 0 )
+            fc::usleep( fc::milliseconds( 10 ) );
+         // give the transactions accepted last a few blocks to be included
+         fc::time_point give_up = fc::time_point::now() +
+               fc::seconds( 3 * _remote_db->get_global_properties().parameters.block_interval );
+         while( !_sent_at.empty() && fc::time_point::now() < give_up )
+            fc::usleep( fc::milliseconds( 100 ) );
+         report( true );
+      }
+
+   private:
+      struct signing_account
+      {
+         account_id_type id;
+         key_id_type     key;
+      };
+
+      struct scheduled_transaction
+      {
+         size_t             step;
+         fc::microseconds   offset;
+         key_id_type        key;
+         signed_transaction trx;
+      };
+
+      struct sent_transaction
+      {
+         size_t         step;
+         fc::time_point sent;
+      };
+
+      struct step_stats
+      {
+         uint64_t            sent = 0;
+         uint64_t            accepted = 0;
+         uint64_t            rejected = 0;
+         uint64_t            included = 0;
+         map<string,uint64_t> rejections;
+         /// Inclusion latencies of the transactions included so far, in microseconds
+         vector<int64_t>     latencies;
+      };
+
+      void resolve_accounts()
+      {
+         FC_ASSERT( !_scenario.accounts.empty(), "The scenario names no accounts" );
+         size_t count = _scenario.fan_out ? std::min<size_t>( _scenario.fan_out, _scenario.accounts.size() )
+                                          : _scenario.accounts.size();
+         vector<string> names( _scenario.accounts.begin(), _scenario.accounts.begin() + count );
+         vector<optional<account_object>> accounts = _remote_db->lookup_account_names( names );
+         public_key_type signing_public_key( _signing_key.get_public_key() );
+
+         for( size_t i = 0; i < accounts.size(); ++i )
+         {
+            FC_ASSERT( accounts[i], "Unknown account ${a}", ("a", names[i]) );
+            vector<key_id_type> key_ids = accounts[i]->active.get_keys();
+            vector<optional<key_object>> keys = _remote_db->get_keys( key_ids );
+            optional<key_id_type> signing_key_id;
+            for( size_t k = 0; k < keys.size() && !signing_key_id; ++k )
+               if( keys[k] && keys[k]->key_data.which() == 1 && keys[k]->key() == signing_public_key )
+                  signing_key_id = key_ids[k];
+            FC_ASSERT( signing_key_id, "The signing key does not control account ${a}", ("a", names[i]) );
+            _accounts.push_back( signing_account{ accounts[i]->id, *signing_key_id } );
+         }
+      }
+
+      void resolve_assets()
+      {
+         set<string> symbols;
+         for( const load_step& step : _scenario.steps )
+         {
+            symbols.insert( step.asset );
+            symbols.insert( step.receive_asset );
+         }
+         vector<string> lookup( symbols.begin(), symbols.end() );
+         vector<optional<asset_id_type>> ids = _remote_db->lookup_asset_ids( lookup );
+         for( size_t i = 0; i < lookup.size(); ++i )
+         {
+            FC_ASSERT( ids[i], "Unknown asset ${a}", ("a", lookup[i]) );
+            _assets[lookup[i]] = *ids[i];
+         }
+      }
+
+      /// Builds the operations of one transaction of a step; @return false when there is nothing to do
+      bool build_operation( const load_step& step, uint32_t batch, uint64_t seq, signed_transaction& trx,
+                            account_id_type& payer )
+      {
+         const signing_account& from = _accounts[seq % _accounts.size()];
+         payer = from.id;
+         asset_id_type asset_id = _assets[step.asset];
+         asset_id_type receive_id = _assets[step.receive_asset];
+
+         if( step.type == "transfer" )
+         {
+            FC_ASSERT( _accounts.size() > 1, "Transfers need at least two accounts" );
+            size_t n = _accounts.size();
+            transfer_operation op;
+            op.from = from.id;
+            op.to = _accounts[( seq + 1 + ( seq / n ) % ( n - 1 ) ) % n].id;
+            op.amount = asset( step.amount + int64_t( seq ), asset_id );
+            trx.operations.push_back( op );
+         }
+         else if( step.type == "limit_order_create" )
+         {
+            limit_order_create_operation op;
+            op.seller = from.id;
+            op.amount_to_sell = asset( step.amount + int64_t( seq ), asset_id );
+            op.min_to_receive = asset( step.receive_amount, receive_id );
+            op.expiration = fc::time_point::now() + fc::seconds( _scenario.duration_seconds + 3600 );
+            trx.operations.push_back( op );
+         }
+         else if( step.type == "limit_order_cancel" )
+         {
+            if( _orders_to_cancel.empty() )
+               return false;
+            limit_order_cancel_operation op;
+            op.order = _orders_to_cancel.front().first;
+            op.fee_paying_account = _orders_to_cancel.front().second;
+            _orders_to_cancel.pop_front();
+            payer = op.fee_paying_account;
+            trx.operations.push_back( op );
+         }
+         else if( step.type == "account_create" )
+         {
+            key_create_operation key_op;
+            key_op.fee_paying_account = from.id;
+            key_op.key_data = public_key_type( _signing_key.get_public_key() );
+
+            account_create_operation op;
+            op.registrar = from.id;
+            op.referrer = from.id;
+            op.name = _scenario.new_account_prefix + std::to_string( _run_stamp ) + "b" + std::to_string( batch ) +
+                      "n" + std::to_string( seq );
+            op.owner = authority( 1, relative_key_id_type( 0 ), 1 );
+            op.active = op.owner;
+            op.memo_key = relative_key_id_type( 0 );
+            trx.operations.push_back( key_op );
+            trx.operations.push_back( op );
+         }
+         else if( step.type == "asset_publish_feed" )
+         {
+            asset_publish_feed_operation op;
+            op.publisher = from.id;
+            op.asset_id = asset_id;
+            op.feed.settlement_price = price( asset( step.receive_amount, receive_id ),
+                                              asset( step.amount + int64_t( seq ), asset_id ) );
+            trx.operations.push_back( op );
+         }
+         else
+            FC_ASSERT( false, "Unknown step type ${t}", ("t", step.type) );
+         return true;
+      }
+
+      /// Orders of the load accounts which a limit_order_cancel step of the coming batch may cancel
+      void collect_orders_to_cancel()
+      {
+         set<account_id_type> ours;
+         for( const signing_account& a : _accounts )
+            ours.insert( a.id );
+         set<limit_order_id_type> queued;
+         for( const auto& o : _orders_to_cancel )
+            queued.insert( o.first );
+
+         for( const load_step& step : _scenario.steps )
+         {
+            if( step.type != "limit_order_cancel" )
+               continue;
+            for( const limit_order_object& order : _remote_db->get_limit_orders( _assets[step.asset],
+                                                                                _assets[step.receive_asset], 100 ) )
+               if( ours.count( order.seller ) && !_cancelled.count( order.id ) && !queued.count( order.id ) )
+               {
+                  _orders_to_cancel.emplace_back( order.id, order.seller );
+                  queued.insert( order.id );
+               }
+         }
+      }
+
+      vector<scheduled_transaction> prepare_batch( uint32_t batch )
+      {
+         block_id_type reference_block = _remote_db->get_dynamic_global_properties().head_block_id;
+         collect_orders_to_cancel();
+
+         uint32_t seconds = std::min( _scenario.batch_seconds, _scenario.duration_seconds - batch * _scenario.batch_seconds );
+         vector<scheduled_transaction> result;
+         for( size_t s = 0; s < _scenario.steps.size(); ++s )
+         {
+            const load_step& step = _scenario.steps[s];
+            uint64_t count = uint64_t( step.rate * seconds );
+            for( uint64_t seq = 0; seq < count; ++seq )
+            {
+               scheduled_transaction st;
+               account_id_type payer;
+               if( !build_operation( step, batch, seq, st.trx, payer ) )
+                  break;
+               st.step = s;
+               st.offset = fc::microseconds( int64_t( seq * 1000000 / step.rate ) );
+               for( const signing_account& a : _accounts )
+                  if( a.id == payer )
+                     st.key = a.key;
+               st.trx.visit( operation_set_fee( _fees ) );
+               st.trx.set_expiration( reference_block, _scenario.lifetime_intervals );
+               if( step.type == "limit_order_cancel" )
+                  _cancelled.insert( st.trx.operations.back().get<limit_order_cancel_operation>().order );
+               result.push_back( std::move( st ) );
+            }
+         }
+         std::stable_sort( result.begin(), result.end(),
+                           []( const scheduled_transaction& a, const scheduled_transaction& b ) {
+                              return a.offset < b.offset;
+                           } );
+
+         // every signer takes an interleaved share of the batch
+         vector<fc::future<void>> signed_shares;
+         for( size_t i = 0; i < _signers.size(); ++i )
+            signed_shares.push_back( _signers[i]->async( [this,i,&result]{
+               for( size_t t = i; t < result.size(); t += _signers.size() )
+                  result[t].trx.sign( result[t].key, _signing_key );
+            }, "Sign batch" ) );
+         for( fc::future<void>& share : signed_shares )
+            share.wait();
+         return result;
+      }
+
+      void send( scheduled_transaction&& s )
+      {
+         step_stats& stats = _stats[s.step];
+         transaction_id_type id = s.trx.id();
+         ++stats.sent;
+         ++_in_flight;
+         _sent_at[id] = sent_transaction{ s.step, fc::time_point::now() };
+
+         auto trx = std::make_shared<signed_transaction>( std::move( s.trx ) );
+         size_t step = s.step;
+         fc::async( [this,trx,id,step]{
+            step_stats& stats = _stats[step];
+            try {
+               _remote_net->broadcast_transaction( *trx );
+               ++stats.accepted;
+            } catch( const fc::exception& e ) {
+               ++stats.rejected;
+               ++stats.rejections[rejection_reason( e )];
+               _sent_at.erase( id );
+            }
+            --_in_flight;
+         }, "Broadcast transaction" );
+      }
+
+      /// The unformatted message of the innermost assertion, so rejections of the same kind are counted together
+      static string rejection_reason( const fc::exception& e )
+      {
+         const auto& log = e.get_log();
+         if( !log.empty() && !log.back().get_format().empty() )
+            return log.back().get_format();
+         return e.what();
+      }
+
+      void on_head_block( uint32_t head )
+      {
+         _scan_target = std::max( _scan_target, head );
+         if( _scanning )
+            return;
+         _scanning = true;
+         while( _last_block < _scan_target )
+         {
+            optional<signed_block> block = _remote_db->get_block( _last_block + 1 );
+            fc::time_point applied = fc::time_point::now();
+            ++_last_block;
+            if( !block )
+               continue;
+            for( const processed_transaction& trx : block->transactions )
+            {
+               auto itr = _sent_at.find( trx.id() );
+               if( itr == _sent_at.end() )
+                  continue;
+               step_stats& stats = _stats[itr->second.step];
+               ++stats.included;
+               stats.latencies.push_back( ( applied - itr->second.sent ).count() );
+               _sent_at.erase( itr );
+            }
+         }
+         _scanning = false;
+      }
+
+      void report( bool final )
+      {
+         fc::microseconds elapsed = fc::time_point::now() - _first_report_start;
+         double seconds = std::max( elapsed.count() / 1000000.0, 0.001 );
+         std::cout << ( final ? "Final report" : "Report" ) << " after " << std::fixed << std::setprecision( 1 )
+                   << seconds << "s, head block " << _last_block << "\n";
+         for( size_t s = 0; s < _stats.size(); ++s )
+         {
+            step_stats& stats = _stats[s];
+            std::cout << "  " << std::left << std::setw( 20 ) << _scenario.steps[s].type << std::right
+                      << " sent " << stats.sent << ", accepted " << stats.accepted
+                      << " (" << std::setprecision( 1 ) << stats.accepted / seconds << "/s)"
+                      << ", rejected " << stats.rejected << ", included " << stats.included;
+            if( !stats.latencies.empty() )
+            {
+               vector<int64_t> sorted = stats.latencies;
+               std::sort( sorted.begin(), sorted.end() );
+               auto percentile = [&sorted]( double p ) {
+                  return sorted[ std::min( sorted.size() - 1, size_t( p * sorted.size() ) ) ] / 1000;
+               };
+               std::cout << ", inclusion ms p50 " << percentile( 0.5 ) << " p99 " << percentile( 0.99 )
+                         << " max " << sorted.back() / 1000;
+            }
+            std::cout << "\n";
+            if( final )
+            {
+               for( const auto& reason : stats.rejections )
+                  std::cout << "      " << reason.second << " x " << reason.first << "\n";
+               if( stats.accepted > stats.included )
+                  std::cout << "      " << stats.accepted - stats.included << " accepted but never included\n";
+            }
+         }
+         std::cout << std::flush;
+      }
+
+      load_scenario                            _scenario;
+      fc::api<database_api>                    _remote_db;
+      fc::api<network_api>                     _remote_net;
+      fc::thread*                              _main_thread;
+      vector<std::shared_ptr<fc::thread>>      _signers;
+
+      fc::ecc::private_key                     _signing_key;
+      vector<signing_account>                  _accounts;
+      map<string,asset_id_type>                _assets;
+      fee_schedule_type                        _fees;
+      uint32_t                                 _run_stamp = 0;
+
+      std::deque<std::pair<limit_order_id_type,account_id_type>> _orders_to_cancel;
+      set<limit_order_id_type>                 _cancelled;
+
+      vector<step_stats>                       _stats;
+      map<transaction_id_type,sent_transaction> _sent_at;
+      uint64_t                                 _in_flight = 0;
+      uint32_t                                 _last_block = 0;
+      uint32_t                                 _scan_target = 0;
+      bool                                     _scanning = false;
+      fc::time_point                           _first_report_start = fc::time_point::now();
+};
+
+int main( int argc, char** argv )
+{
+   try {
+      bpo::options_description opts;
+         opts.add_options()
+         ("help,h", "Print this help message and exit.")
+         ("server-rpc-endpoint,s", bpo::value<string>()->default_value("ws://127.0.0.1:8090"), "Server websocket RPC endpoint")
+         ("server-rpc-user,u", bpo::value<string>()->default_value(""), "Server Username")
+         ("server-rpc-password,p", bpo::value<string>()->default_value(""), "Server Password")
+         ("scenario", bpo::value<string>()->default_value("scenario.json"), "JSON file describing the load to generate")
+         ("signing-threads", bpo::value<uint32_t>()->default_value(4), "Number of threads signing transactions")
+         ("report-interval", bpo::value<uint32_t>()->default_value(10), "Seconds between progress reports");
+
+      bpo::variables_map options;
+      bpo::store( bpo::parse_command_line(argc, argv, opts), options );
+
+      if( options.count("help") )
+      {
+         std::cout << opts << "\n";
+         return 0;
+      }
+
+      fc::path scenario_file( options.at("scenario").as<string>() );
+      FC_ASSERT( fc::exists( scenario_file ), "Scenario file ${f} does not exist", ("f", scenario_file) );
+      load_scenario scenario = fc::json::from_file( scenario_file ).as<load_scenario>();
+
+      fc::http::websocket_client client;
+      auto con  = client.connect( options.at("server-rpc-endpoint").as<string>() );
+      auto apic = std::make_shared<fc::rpc::websocket_api_connection>(*con);
+
+      auto remote_api = apic->get_remote_api< login_api >(1);
+      FC_ASSERT( remote_api->login( options.at("server-rpc-user").as<string>(),
+                                    options.at("server-rpc-password").as<string>() ) );
+
+      load_generator generator( remote_api, scenario, options.at("signing-threads").as<uint32_t>() );
+      generator.run( fc::seconds( options.at("report-interval").as<uint32_t>() ) );
+   }
+   catch ( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return -1;
+   }
+   return 0;
+}
@@ -19,6 +19,7 @@
 
 #include <graphene/witness/witness.hpp>
 #include <graphene/account_history/account_history_plugin.hpp>
+#include <graphene/market_history/market_history_plugin.hpp>
 
 #include <fc/thread/thread.hpp>
 #include <fc/interprocess/signals.hpp>
@@ -49,6 +50,7 @@ int main(int argc, char** argv) {
 
       auto witness_plug = node.register_plugin<witness_plugin::witness_plugin>();
       auto history_plug = node.register_plugin<account_history::account_history_plugin>();
+      auto market_history_plug = node.register_plugin<market_history::market_history_plugin>();
 
       {
          bpo::options_description cli, cfg;
@@ -96,3 +96,56 @@ BOOST_AUTO_TEST_CASE( two_node_network )
       throw;
    }
 }
+
+BOOST_AUTO_TEST_CASE( snapshot_bootstrap )
+{
+   using namespace graphene::chain;
+   using namespace graphene::app;
+   try {
+      fc::temp_directory app_dir;
+      fc::temp_directory app2_dir;
+      fc::temp_file genesis_json;
+      fc::json::save_to_file(genesis_allocation(), genesis_json.path());
+
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::ecc::private_key genesis_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")));
+
+      graphene::app::application app1;
+      bpo::variables_map cfg;
+      cfg.emplace("p2p-endpoint", bpo::variable_value(string("127.0.0.1:5050"), false));
+      cfg.emplace("genesis-json", bpo::variable_value(boost::filesystem::path(genesis_json.path()), false));
+      cfg.emplace("state-snapshot-interval", bpo::variable_value(uint32_t(2), false));
+      app1.initialize(app_dir.path(), cfg);
+      app1.startup();
+
+      std::shared_ptr<chain::database> db1 = app1.chain_database();
+      for( int i = 0; i < 2; ++i )
+      {
+         now += GRAPHENE_DEFAULT_BLOCK_INTERVAL;
+         db1->generate_block( now, db1->get_scheduled_witness( 1 ).first, genesis_key );
+      }
+      // Block 2 is snapshotted once it has been applied, and block 3 is left for the new node to sync
+      fc::usleep(fc::milliseconds(250));
+      now += GRAPHENE_DEFAULT_BLOCK_INTERVAL;
+      db1->generate_block( now, db1->get_scheduled_witness( 1 ).first, genesis_key );
+
+      graphene::app::application app2;
+      bpo::variables_map cfg2;
+      cfg2.emplace("p2p-endpoint", bpo::variable_value(string("127.0.0.1:5151"), false));
+      cfg2.emplace("genesis-json", bpo::variable_value(boost::filesystem::path(genesis_json.path()), false));
+      cfg2.emplace("seed-node", bpo::variable_value(vector<string>{"127.0.0.1:5050"}, false));
+      cfg2.emplace("bootstrap-from-peers", bpo::variable_value(uint32_t(1), false));
+      app2.initialize(app2_dir.path(), cfg2);
+      app2.startup();
+      fc::usleep(fc::milliseconds(1500));
+
+      std::shared_ptr<chain::database> db2 = app2.chain_database();
+      BOOST_CHECK_EQUAL(db2->head_block_num(), 3);
+      BOOST_CHECK(db2->head_block_id() == db1->head_block_id());
+      // Only the blocks from the snapshot on were fetched
+      BOOST_CHECK(!db2->fetch_block_by_id(db1->get_block_id_for_num(1)));
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/limit_order_object.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "../common/database_fixture.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace graphene::chain;
+
+namespace {
+
+#ifdef NDEBUG
+const int account_count = 1000;
+const int rounds        = 20;
+const vector<int> block_sizes = { 100, 1000, 5000, 10000, 20000 };
+#else
+const int account_count = 50;
+const int rounds        = 5;
+const vector<int> block_sizes = { 10, 100, 500 };
+#endif
+
+/// The checks a witness leaves out for its own pending transactions, which were checked when they were pushed
+const uint32_t production_skip = database::skip_transaction_signatures | database::skip_authority_check;
+
+/// Wall clock latency of each block produced, in microseconds
+struct latencies
+{
+   vector<int64_t>  samples;
+   fc::time_point   started;
+
+   void start() { started = fc::time_point::now(); }
+   void stop()  { samples.push_back( (fc::time_point::now() - started).count() ); }
+
+   void report( const string& name, int transactions )
+   {
+      if( samples.empty() ) return;
+      std::sort( samples.begin(), samples.end() );
+      const int64_t total = std::accumulate( samples.begin(), samples.end(), int64_t(0) );
+      ilog( "${n} of ${t} transactions: ${c} blocks, mean ${mean} us, p50 ${p50} us, p90 ${p90} us, p99 ${p99} us, max ${max} us",
+            ("n", name)("t", transactions)("c", samples.size())("mean", total / int64_t(samples.size()))
+            ("p50", samples[samples.size() / 2])("p90", samples[samples.size() * 9 / 10])
+            ("p99", samples[samples.size() * 99 / 100])("max", samples.back()) );
+   }
+};
+
+/** Funded accounts and a user issued asset to place orders for */
+struct block_production_fixture : database_fixture
+{
+   block_production_fixture()
+   {
+      for( int i = 0; i < account_count; ++i )
+      {
+         const account_object& account = create_account( "producer" + std::to_string( i ) );
+         transfer( genesis_account(db), account, asset( 1000000000 ) );
+         accounts.push_back( account.id );
+         if( i % 100 == 99 ) next_block();
+      }
+      market = create_user_issued_asset( "BENCHBP" ).id;
+      next_block();
+   }
+
+   void next_block()
+   {
+      generate_block();
+      trx.set_expiration( db.head_block_time() + fc::minutes(1) );
+   }
+
+   account_id_type account( int i )const { return accounts[i % accounts.size()]; }
+
+   /**
+    * Pushes count distinct transactions, in turn a transfer, an order which rests in the book and an account
+    * creation, stopping early if the next one might not fit in the block.
+    * @return the number of transactions pushed
+    */
+   int push_mixed( int count )
+   {
+      const uint64_t max_block_size = db.get_global_properties().parameters.maximum_block_size;
+      for( int j = 0; j < count; ++j, ++serial )
+      {
+         if( db.pending_block_size() + GRAPHENE_DEFAULT_MAX_TRANSACTION_SIZE > max_block_size )
+            return j;
+
+         signed_transaction tx;
+         tx.set_expiration( db.head_block_time() + fc::minutes(1) );
+         switch( serial % 3 )
+         {
+            case 0:
+            {
+               transfer_operation xfer;
+               xfer.from = account( serial );
+               xfer.to = account( serial + 1 );
+               xfer.amount = asset( 1 + serial );
+               tx.operations.push_back( xfer );
+               break;
+            }
+            case 1:
+            {
+               limit_order_create_operation order;
+               order.seller = account( serial );
+               order.amount_to_sell = asset( 100 + serial );
+               order.min_to_receive = asset( 1000000000, market );
+               tx.operations.push_back( order );
+               break;
+            }
+            default:
+               tx.operations.push_back( make_account( "bp" + std::to_string( serial ) ) );
+         }
+         for( auto& op : tx.operations ) op.visit( operation_set_fee( db.current_fee_schedule() ) );
+         db.push_transaction( tx, ~0 );
+      }
+      return count;
+   }
+
+   vector<account_id_type> accounts;
+   asset_id_type           market;
+   int                     serial = 0;
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE( block_production_benchmarks, block_production_fixture )
+
+/**
+ *  Times generate_block as a witness runs it at its slot: the pending block is finished, signed and applied as the
+ *  new head, and the transactions which were not included are pushed again on top of it.
+ */
+BOOST_AUTO_TEST_CASE( generate_block_latency_bench )
+{
+   try {
+      const auto key = generate_private_key( "genesis" );
+      for( int size : block_sizes )
+      {
+         latencies producing;
+         int pushed = size;
+         for( int r = 0; r < rounds && pushed == size; ++r )
+         {
+            pushed = push_mixed( size );
+            const auto when = db.get_slot_time( 1 );
+            const auto witness = db.get_scheduled_witness( 1 ).first;
+            producing.start();
+            const signed_block block = db.generate_block( when, witness, key, production_skip );
+            producing.stop();
+            BOOST_CHECK_EQUAL( block.transactions.size(), size_t(pushed) );
+         }
+         producing.report( "generate_block", pushed );
+         if( pushed < size )
+         {
+            ilog( "Blocks are limited to ${n} of these transactions by maximum_block_size", ("n", pushed) );
+            break;
+         }
+      }
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+/**
+ *  Times the slow path, where the block is finished by build_block and then applied again from scratch by
+ *  push_block, as happens when the head changed in between.
+ */
+BOOST_AUTO_TEST_CASE( build_and_push_block_latency_bench )
+{
+   try {
+      const auto key = generate_private_key( "genesis" );
+      for( int size : block_sizes )
+      {
+         latencies building, pushing;
+         int pushed = size;
+         for( int r = 0; r < rounds && pushed == size; ++r )
+         {
+            pushed = push_mixed( size );
+            const auto when = db.get_slot_time( 1 );
+            const auto witness = db.get_scheduled_witness( 1 ).first;
+            building.start();
+            const signed_block block = db.build_block( when, witness, key, production_skip );
+            building.stop();
+            pushing.start();
+            db.push_block( block, production_skip );
+            pushing.stop();
+            BOOST_CHECK( db.head_block_id() == block.id() );
+         }
+         building.report( "build_block", pushed );
+         pushing.report( "push_block", pushed );
+         if( pushed < size )
+            break;
+      }
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
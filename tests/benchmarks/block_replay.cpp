@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/block_database.hpp>
+
+#include <graphene/db/level_map.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/reflect/reflect.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdlib>
+
+using namespace graphene::chain;
+
+namespace {
+
+std::string replay_parameter( const char* name, const std::string& default_value )
+{
+   const char* value = std::getenv( name );
+   return value ? value : default_value;
+}
+
+uint64_t replay_parameter( const char* name, uint64_t default_value )
+{
+   const char* value = std::getenv( name );
+   return value ? std::strtoull( value, nullptr, 0 ) : default_value;
+}
+
+/**
+ *  What to replay and how, each overridable through the environment variable next to it.
+ *
+ *  The blocks are read from a block database directory, holding the blocks and index files a node keeps in
+ *  blockchain/database/blocks, or from an older block_num_to_block directory. They are pushed with the skip flags
+ *  given, which may be in hex, to a fresh database made from the genesis allocation in the json file given, or from
+ *  the default one of the witness node when there is none.
+ */
+struct replay_parameters
+{
+   std::string blocks_dir    = replay_parameter( "GRAPHENE_REPLAY_BENCH_BLOCKS", std::string() );
+   std::string genesis_json  = replay_parameter( "GRAPHENE_REPLAY_BENCH_GENESIS", std::string() );
+   uint32_t    skip          = replay_parameter( "GRAPHENE_REPLAY_BENCH_SKIP", uint64_t(database::skip_nothing) );
+   uint32_t    threads       = replay_parameter( "GRAPHENE_REPLAY_BENCH_THREADS", uint64_t(0) );
+   uint32_t    block_limit   = replay_parameter( "GRAPHENE_REPLAY_BENCH_BLOCK_LIMIT", uint64_t(0) ); ///< 0 for every block
+};
+
+/// Adds up the timings of the blocks replayed, field by field
+struct add_timing
+{
+   block_timing&        total;
+   const block_timing&  timing;
+
+   template<typename Member, class Class, Member (Class::*member)>
+   void operator()( const char* )const
+   {
+      add( total.*member, timing.*member );
+   }
+
+   static void add( uint32_t& total, uint32_t value ) { total += value; }
+   static void add( uint64_t& total, uint64_t value ) { total += value; }
+   static void add( vector<uint64_t>& total, const vector<uint64_t>& values )
+   {
+      total.resize( std::max( total.size(), values.size() ) );
+      for( size_t i = 0; i < values.size(); ++i )
+         total[i] += values[i];
+   }
+};
+
+/// Reports the average of each phase over the blocks replayed
+struct report_timing
+{
+   const block_timing&  total;
+   uint32_t             block_count;
+
+   template<typename Member, class Class, Member (Class::*member)>
+   void operator()( const char* name )const
+   {
+      report( name, total.*member );
+   }
+
+   void report( const char*, uint32_t )const {}
+   void report( const char* name, uint64_t value )const
+   {
+      ilog( "   ${phase}: ${us} us per block", ("phase",name)("us",value / 1000 / block_count) );
+   }
+   void report( const char* name, const vector<uint64_t>& values )const
+   {
+      for( size_t i = 0; i < values.size(); ++i )
+         ilog( "   ${phase}[${i}]: ${us} us per block", ("phase",name)("i",i)("us",values[i] / 1000 / block_count) );
+   }
+};
+
+uint64_t peak_rss_kb()
+{
+   struct rusage usage;
+   getrusage( RUSAGE_SELF, &usage );
+#ifdef __APPLE__
+   return usage.ru_maxrss / 1024;
+#else
+   return usage.ru_maxrss;
+#endif
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE( block_replay_benchmarks )
+
+/**
+ *  Pushes recorded blocks to a fresh database one by one, as a node receiving them would, and reports the blocks
+ *  and operations applied per second, the peak resident size and the average time of each phase of a block.
+ *  Only the pushes are timed; reading and unpacking the recorded blocks is not.
+ */
+BOOST_AUTO_TEST_CASE( recorded_block_replay_bench )
+{
+   try {
+      replay_parameters parameters;
+      if( parameters.blocks_dir.empty() )
+      {
+         ilog( "Set GRAPHENE_REPLAY_BENCH_BLOCKS to a block directory to replay it" );
+         return;
+      }
+
+      auto nathan_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "nathan" ) ) );
+      genesis_allocation allocation = {{public_key_type( nathan_key.get_public_key() ), 1}};
+      if( !parameters.genesis_json.empty() )
+         allocation = fc::json::from_file( parameters.genesis_json ).as<genesis_allocation>();
+
+      fc::temp_directory data_dir( fc::current_path() );
+      database db;
+      db.set_signature_thread_count( parameters.threads );
+      db.set_block_timing_history( 1 );
+      db.open( data_dir.path(), allocation );
+
+      uint32_t block_count = 0;
+      uint64_t operation_count = 0;
+      uint64_t push_ns = 0;
+      block_timing total;
+      auto replay = [&]( const signed_block& b ) -> bool {
+         if( parameters.block_limit && block_count >= parameters.block_limit )
+            return false;
+         const auto start = std::chrono::steady_clock::now();
+         db.push_block( b, parameters.skip );
+         push_ns += std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+
+         fc::reflector<block_timing>::visit( add_timing{ total, db.get_block_timings().back() } );
+         ++block_count;
+         for( const auto& trx : b.transactions )
+            operation_count += trx.operations.size();
+         return true;
+      };
+
+      const fc::path blocks_dir( parameters.blocks_dir );
+      if( fc::exists( blocks_dir / "index" ) )
+      {
+         block_database blocks;
+         blocks.open( blocks_dir );
+         for( uint32_t num = 1; ; ++num )
+         {
+            optional<signed_block> b = blocks.fetch_by_number( num );
+            if( !b || !replay( *b ) )
+               break;
+         }
+      }
+      else
+      {
+         // Block ids start with the block number, so the old blocks are iterated in order
+         graphene::db::level_map<block_id_type, signed_block> blocks;
+         blocks.open( blocks_dir );
+         auto itr = blocks.begin();
+         while( itr.valid() && replay( itr.value() ) )
+            ++itr;
+      }
+      BOOST_REQUIRE_GT( block_count, 0 );
+
+      const double seconds = push_ns / 1e9;
+      ilog( "Replayed ${blocks} blocks with ${ops} operations in ${ms} ms, skip ${skip}, ${threads} signature threads",
+            ("blocks",block_count)("ops",operation_count)("ms",push_ns / 1000000)
+            ("skip",parameters.skip)("threads",parameters.threads) );
+      ilog( "${bps} blocks/sec, ${ops} ops/sec, peak RSS ${rss} kB",
+            ("bps",uint64_t(block_count / seconds))("ops",uint64_t(operation_count / seconds))("rss",peak_rss_kb()) );
+      fc::reflector<block_timing>::visit( report_timing{ total, block_count } );
+
+      db.close();
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
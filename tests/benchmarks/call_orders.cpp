@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/limit_order_object.hpp>
+#include <graphene/chain/short_order_object.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "../common/database_fixture.hpp"
+
+using namespace graphene::chain;
+
+BOOST_FIXTURE_TEST_CASE( call_order_feed_update_bench, database_fixture )
+{
+   try {
+      const int call_count = 100000;
+#ifdef NDEBUG
+      const int feed_updates = 10000;
+#else
+      const int feed_updates = 1000;
+#endif
+
+      const asset_object& bitusd = create_bitasset( "BITUSD" );
+      const account_object& seller = create_account( "seller" );
+      const asset_id_type usd_id = bitusd.id;
+
+      // The positions are put in place directly, only their place in the call book matters here
+      fc::time_point start_time = fc::time_point::now();
+      for( int i = 0; i < call_count; ++i )
+         db.create<call_order_object>( [&]( call_order_object& call ) {
+            call.borrower = account_id_type( 1000 + i );
+            call.collateral = 1000 + i;
+            call.debt = 100;
+            call.maintenance_collateral_ratio = 1750;
+            call.call_price = price::call_price( call.get_debt(), call.get_collateral(), call.maintenance_collateral_ratio );
+         });
+      ilog( "Created ${c} call orders in ${t} milliseconds.",
+            ("c", call_count)("t", (fc::time_point::now() - start_time).count() / 1000) );
+
+      // An order selling the asset at every call limit below, which the safest position is still above
+      db.adjust_balance( seller, asset( 1000, usd_id ) );
+      const limit_order_object* order = create_sell_order( seller, asset( 100, usd_id ), asset( 500 ) );
+
+      const asset_bitasset_data_object& bitasset = bitusd.bitasset_data( db );
+      start_time = fc::time_point::now();
+      for( int i = 0; i < feed_updates; ++i )
+      {
+         db.modify( bitasset, [&]( asset_bitasset_data_object& b ) {
+            b.current_feed.call_limit = price( asset( 500 + i % 200 ), asset( 100, usd_id ) );
+            b.current_feed.short_limit = ~price( asset( 1000 ), asset( 100, usd_id ) );
+         });
+         BOOST_CHECK( !db.check_call_orders( bitusd ) );
+      }
+      auto elapsed = (fc::time_point::now() - start_time).count();
+      ilog( "Checked ${c} call orders after each of ${n} feed updates in ${t} milliseconds, ${a} microseconds each.",
+            ("c", call_count)("n", feed_updates)("t", elapsed / 1000)("a", elapsed / feed_updates) );
+
+      BOOST_CHECK_EQUAL( db.get_index_type<call_order_index>().indices().size(), call_count );
+
+      // Take the seeded positions and balance back out so the supplies still add up
+      const auto& call_idx = db.get_index_type<call_order_index>().indices();
+      while( !call_idx.empty() )
+         db.remove( *call_idx.begin() );
+      cancel_limit_order( *order );
+      db.adjust_balance( seller, -asset( 1000, usd_id ) );
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
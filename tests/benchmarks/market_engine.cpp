@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/limit_order_object.hpp>
+#include <graphene/chain/short_order_object.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "../common/database_fixture.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace graphene::chain;
+
+namespace {
+
+#ifdef NDEBUG
+const int account_count = 1000;
+const int market_count  = 20;
+const int order_count   = 100000;
+#else
+const int account_count = 50;
+const int market_count  = 5;
+const int order_count   = 2000;
+#endif
+
+/// Wall clock latency of each operation of one kind, in microseconds
+struct latencies
+{
+   vector<int64_t>  samples;
+   fc::time_point   started;
+
+   void start() { started = fc::time_point::now(); }
+   void stop()  { samples.push_back( (fc::time_point::now() - started).count() ); }
+
+   /// ops is the number of operations the samples cover, when a sample covers more than one
+   void report( const string& name, uint64_t ops = 0 )
+   {
+      if( samples.empty() ) return;
+      if( ops == 0 ) ops = samples.size();
+      std::sort( samples.begin(), samples.end() );
+      const int64_t total = std::max<int64_t>( 1, std::accumulate( samples.begin(), samples.end(), int64_t(0) ) );
+      ilog( "${n}: ${c} ops in ${t} milliseconds, ${r} ops/sec, p50 ${p50} us, p99 ${p99} us per sample",
+            ("n", name)("c", ops)("t", total / 1000)("r", ops * 1000000 / total)
+            ("p50", samples[samples.size() / 2])("p99", samples[samples.size() * 99 / 100]) );
+   }
+};
+
+/**
+ *  Sets up account_count funded accounts and market_count user issued assets, each traded against the core asset,
+ *  with every account holding some of every asset.
+ */
+struct market_bench_fixture : database_fixture
+{
+   market_bench_fixture()
+   {
+      for( int i = 0; i < account_count; ++i )
+      {
+         const account_object& account = create_account( "bench" + std::to_string( i ) );
+         transfer( genesis_account(db), account, asset( 1000000000 ) );
+         accounts.push_back( account.id );
+         if( i % 100 == 99 ) next_block();
+      }
+      for( int k = 0; k < market_count; ++k )
+      {
+         const asset_object& uia = create_user_issued_asset( string( "BENCH" ) + char( 'A' + k ) );
+         markets.push_back( uia.id );
+         for( int i = 0; i < account_count; ++i )
+         {
+            issue_uia( accounts[i](db), uia.amount( 1000000000 ) );
+            db.push_transaction( trx, ~0 );
+            trx.operations.clear();
+         }
+         next_block();
+      }
+   }
+
+   void next_block()
+   {
+      generate_block();
+      trx.set_expiration( db.head_block_time() + fc::minutes(1) );
+   }
+
+   account_id_type account( int i )const { return accounts[i % accounts.size()]; }
+   asset_id_type   market( int i )const  { return markets[i % markets.size()]; }
+
+   /// Resting orders selling every market's asset at 1:1, with distinct amounts so no two transactions repeat
+   vector<limit_order_id_type> place_asks()
+   {
+      vector<limit_order_id_type> asks;
+      asks.reserve( order_count );
+      for( int j = 0; j < order_count; ++j )
+      {
+         asks.push_back( create_sell_order( account( j ), asset( 100 + j, market( j ) ), asset( 100 + j ) )->id );
+         if( j % 200 == 199 ) next_block();
+      }
+      return asks;
+   }
+
+   vector<account_id_type> accounts;
+   vector<asset_id_type>   markets;
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE( market_engine_benchmarks, market_bench_fixture )
+
+BOOST_AUTO_TEST_CASE( limit_order_match_bench )
+{
+   try {
+      place_asks();
+      next_block();
+
+      // Each bid crosses exactly the oldest ask left in its market
+      latencies matching;
+      for( int j = 0; j < order_count; ++j )
+      {
+         matching.start();
+         create_sell_order( account( j + 1 ), asset( 100 + j ), asset( 100 + j, market( j ) ) );
+         matching.stop();
+         if( j % 200 == 199 ) next_block();
+      }
+      matching.report( "limit_order_create, each filling a resting order" );
+      BOOST_CHECK( db.get_index_type<limit_order_index>().indices().empty() );
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( limit_order_cancel_bench )
+{
+   try {
+      vector<limit_order_id_type> asks = place_asks();
+      next_block();
+
+      latencies canceling;
+      for( int j = 0; j < order_count; ++j )
+      {
+         const limit_order_object& ask = asks[j](db);
+         canceling.start();
+         cancel_limit_order( ask );
+         canceling.stop();
+         if( j % 200 == 199 ) next_block();
+      }
+      canceling.report( "limit_order_cancel" );
+      BOOST_CHECK( db.get_index_type<limit_order_index>().indices().empty() );
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( check_call_orders_bench )
+{
+   try {
+      const asset_object& bitusd = create_bitasset( "BENCHUSD" );
+      const asset_id_type usd_id = bitusd.id;
+
+      // The positions are put in place directly, only their place in the call book matters here
+      for( int j = 0; j < order_count; ++j )
+         db.create<call_order_object>( [&]( call_order_object& call ) {
+            call.borrower = account_id_type( 1000000 + j );
+            call.collateral = 1000 + j;
+            call.debt = 100;
+            call.maintenance_collateral_ratio = 1750;
+            call.call_price = price::call_price( call.get_debt(), call.get_collateral(), call.maintenance_collateral_ratio );
+         });
+      db.adjust_balance( account( 0 ), asset( 1000, usd_id ) );
+      const limit_order_object* order = create_sell_order( account( 0 ), asset( 100, usd_id ), asset( 500 ) );
+
+      // Every feed leaves the order able to cover the riskiest position, which is still safe
+      latencies checking;
+      const asset_bitasset_data_object& bitasset = bitusd.bitasset_data( db );
+      for( int i = 0; i < 1000; ++i )
+      {
+         db.modify( bitasset, [&]( asset_bitasset_data_object& b ) {
+            b.current_feed.call_limit = price( asset( 500 + i % 200 ), asset( 100, usd_id ) );
+            b.current_feed.short_limit = ~price( asset( 1000 ), asset( 100, usd_id ) );
+         });
+         checking.start();
+         db.check_call_orders( bitusd );
+         checking.stop();
+      }
+      checking.report( "check_call_orders after a feed update, " + std::to_string( order_count ) + " positions" );
+
+      // Take the seeded positions and balance back out so the supplies still add up
+      const auto& call_idx = db.get_index_type<call_order_index>().indices();
+      BOOST_CHECK_EQUAL( call_idx.size(), order_count );
+      while( !call_idx.empty() )
+         db.remove( *call_idx.begin() );
+      cancel_limit_order( *order );
+      db.adjust_balance( account( 0 ), -asset( 1000, usd_id ) );
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( clear_expired_orders_bench )
+{
+   try {
+      const uint32_t interval = db.get_global_properties().parameters.block_interval;
+      const int expiring_blocks = 20;
+
+      // All orders go in the next block, and expire over the expiring_blocks after it
+      for( int j = 0; j < order_count; ++j )
+      {
+         limit_order_create_operation op;
+         op.seller = account( j );
+         op.amount_to_sell = asset( 100 + j, market( j ) );
+         op.min_to_receive = asset( 100 + j );
+         op.expiration = db.head_block_time() + interval * (2 + j % expiring_blocks);
+         trx.operations.push_back( op );
+         db.push_transaction( trx, ~0 );
+         trx.operations.clear();
+      }
+      next_block();
+      BOOST_CHECK_EQUAL( db.get_index_type<limit_order_index>().indices().size(), order_count );
+
+      latencies blocks;
+      for( int i = 0; i <= expiring_blocks; ++i )
+      {
+         blocks.start();
+         next_block();
+         blocks.stop();
+      }
+      blocks.report( "blocks clearing expired orders", order_count );
+      BOOST_CHECK( db.get_index_type<limit_order_index>().indices().empty() );
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,486 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/net/node.hpp>
+#include <graphene/chain/operations.hpp>
+
+#include <fc/thread/thread.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+
+using namespace graphene::chain;
+using namespace graphene::net;
+
+namespace {
+
+uint64_t bench_parameter( const char* name, uint64_t default_value )
+{
+   const char* value = std::getenv( name );
+   return value ? std::strtoull( value, nullptr, 10 ) : default_value;
+}
+
+/**
+ *  The simulated network's shape and load, each overridable through the environment variable next to it.
+ *  The topology is "ring", "random" (a ring plus random connections up to peers_per_node) or "full".
+ */
+struct propagation_parameters
+{
+   uint32_t node_count              = bench_parameter( "GRAPHENE_NET_BENCH_NODES", 50 );
+   uint32_t peers_per_node          = bench_parameter( "GRAPHENE_NET_BENCH_PEERS", 8 );
+   uint32_t latency_ms              = bench_parameter( "GRAPHENE_NET_BENCH_LATENCY_MS", 50 );
+   uint64_t bytes_per_second        = bench_parameter( "GRAPHENE_NET_BENCH_BYTES_PER_SECOND", 1000000 );
+   uint32_t transaction_count       = bench_parameter( "GRAPHENE_NET_BENCH_TRANSACTIONS", 2000 );
+   uint32_t transactions_per_second = bench_parameter( "GRAPHENE_NET_BENCH_TRANSACTIONS_PER_SECOND", 500 );
+   uint32_t transactions_per_block  = bench_parameter( "GRAPHENE_NET_BENCH_TRANSACTIONS_PER_BLOCK", 200 );
+   std::string topology             = std::getenv( "GRAPHENE_NET_BENCH_TOPOLOGY" ) ? std::getenv( "GRAPHENE_NET_BENCH_TOPOLOGY" ) : "random";
+};
+
+/**
+ *  How nodes pass on the items they accept: pushing the whole item to every peer, or announcing it in an inventory
+ *  message and sending it to the peers that ask, optionally sending blocks as compact blocks.
+ */
+enum relay_mode
+{
+   flood,
+   announce,
+   announce_compact_blocks
+};
+
+struct propagation_run;
+struct bench_node;
+
+/// One direction of a connection, the delegate the network delivers to on the receiving node's behalf
+struct bench_link : node_delegate
+{
+   bench_node* sender;
+   bench_node* receiver;
+
+   bench_link( bench_node* sender, bench_node* receiver ) : sender( sender ), receiver( receiver ) {}
+
+   bool handle_message( const message& message_to_process, bool sync_mode ) override;
+
+   // the simulated network only ever calls handle_message()
+   bool has_item( const item_id& ) override { return false; }
+   bool handle_block( const block_message&, bool ) override { return false; }
+   bool handle_transaction( const trx_message&, bool ) override { return false; }
+   std::vector<item_hash_t> get_item_ids( uint32_t, const std::vector<item_hash_t>&, uint32_t& remaining_item_count, uint32_t ) override
+   {
+      remaining_item_count = 0;
+      return std::vector<item_hash_t>();
+   }
+   message get_item( const item_id& ) override { FC_THROW_EXCEPTION( fc::key_not_found_exception, "no items behind a link" ); }
+   fc::sha256 get_chain_id()const override { return fc::sha256(); }
+   std::vector<item_hash_t> get_blockchain_synopsis( uint32_t, const item_hash_t&, uint32_t ) override { return std::vector<item_hash_t>(); }
+   void sync_status( uint32_t, uint32_t ) override {}
+   void connection_count_changed( uint32_t ) override {}
+   uint32_t get_block_number( const item_hash_t& ) override { return 0; }
+   fc::time_point_sec get_block_time( const item_hash_t& ) override { return fc::time_point_sec::min(); }
+   fc::time_point_sec get_blockchain_now() override { return fc::time_point::now(); }
+   item_hash_t get_head_block_id()const override { return item_hash_t(); }
+   uint32_t estimate_last_known_fork_from_git_revision_timestamp( uint32_t )const override { return 0; }
+   void error_encountered( const std::string&, const fc::oexception& ) override {}
+};
+
+struct bench_node
+{
+   propagation_run&                                run;
+   std::map<bench_node*, bench_link*>              links; ///< to each peer
+   std::map<item_hash_t, message>                  items;
+   std::set<item_hash_t>                           requested_items;
+   std::map<transaction_id_type, signed_transaction> transactions;
+   std::map<item_hash_t, compact_block_message>    compact_blocks_waiting_for_transactions;
+
+   uint64_t bytes_received    = 0;
+   uint64_t messages_received = 0;
+   uint64_t duplicate_items   = 0; ///< items received which this node already had
+
+   explicit bench_node( propagation_run& run ) : run( run ) {}
+
+   void send( bench_node* peer, const message& message_to_send );
+   void on_message( bench_node* peer, const message& received_message );
+   /// originating_peer is null for the items injected here
+   void accept( bench_node* originating_peer, const message& item );
+   void rebuild_compact_block( bench_node* peer, const compact_block_message& compact_block );
+};
+
+/// Wall clock time from an item's injection until it reached each node, in microseconds
+struct propagation_latencies
+{
+   std::vector<int64_t> to_each_node;
+   std::vector<int64_t> to_every_node; ///< one sample per item, when its last node got it
+
+   void report( const std::string& name, size_t item_count )
+   {
+      std::sort( to_each_node.begin(), to_each_node.end() );
+      std::sort( to_every_node.begin(), to_every_node.end() );
+      auto percentile = []( const std::vector<int64_t>& samples, int p ) {
+         return samples.empty() ? 0 : samples[std::min( samples.size() - 1, samples.size() * p / 100 )] / 1000;
+      };
+      ilog( "${n}: ${c} of ${t} reached every node; to each node p50 ${p50} ms, p90 ${p90} ms, p99 ${p99} ms; "
+            "to every node p50 ${a50} ms, p99 ${a99} ms",
+            ("n", name)("c", to_every_node.size())("t", item_count)
+            ("p50", percentile( to_each_node, 50 ))("p90", percentile( to_each_node, 90 ))("p99", percentile( to_each_node, 99 ))
+            ("a50", percentile( to_every_node, 50 ))("a99", percentile( to_every_node, 99 )) );
+   }
+};
+
+struct propagation_run
+{
+   relay_mode                               mode;
+   std::vector<std::unique_ptr<bench_node>> nodes;
+   std::vector<std::unique_ptr<bench_link>> links;
+   std::map<item_hash_t, fc::time_point>    injection_times;
+   std::map<item_hash_t, uint32_t>          nodes_reached;
+   size_t                                   items_at_every_node = 0;
+   propagation_latencies                    transaction_latencies;
+   propagation_latencies                    block_latencies;
+   size_t                                   transactions_injected = 0;
+   size_t                                   blocks_injected = 0;
+   // declared last, so its senders are stopped before anything they use goes away
+   simulated_network                        network;
+
+   propagation_run( relay_mode mode, const propagation_parameters& parameters ) :
+      mode( mode ),
+      network( "propagation benchmark" )
+   {
+      for( uint32_t i = 0; i < parameters.node_count; ++i )
+         nodes.emplace_back( new bench_node( *this ) );
+
+      // the ring keeps the network connected, random topologies add peers_per_node / 2 connections from each node
+      std::mt19937 random( 1 );
+      std::set<std::pair<uint32_t, uint32_t>> connections;
+      auto connect = [&]( uint32_t a, uint32_t b ) {
+         if( a != b )
+            connections.emplace( std::min( a, b ), std::max( a, b ) );
+      };
+      const uint32_t n = parameters.node_count;
+      if( parameters.topology == "full" )
+      {
+         for( uint32_t a = 0; a < n; ++a )
+            for( uint32_t b = a + 1; b < n; ++b )
+               connect( a, b );
+      }
+      else
+      {
+         for( uint32_t a = 0; a < n; ++a )
+            connect( a, (a + 1) % n );
+         if( parameters.topology == "random" )
+            for( uint32_t a = 0; a < n; ++a )
+               for( uint32_t j = 1; j < parameters.peers_per_node / 2; ++j )
+                  connect( a, random() % n );
+      }
+
+      std::uniform_int_distribution<uint32_t> latency_ms( parameters.latency_ms / 2, parameters.latency_ms * 3 / 2 );
+      for( const auto& connection : connections )
+      {
+         fc::microseconds latency = fc::milliseconds( latency_ms( random ) );
+         bench_node* a = nodes[connection.first].get();
+         bench_node* b = nodes[connection.second].get();
+         for( auto direction : { std::make_pair( a, b ), std::make_pair( b, a ) } )
+         {
+            links.emplace_back( new bench_link( direction.first, direction.second ) );
+            direction.first->links[direction.second] = links.back().get();
+            network.add_node_delegate( links.back().get(), latency, parameters.bytes_per_second );
+         }
+      }
+      ilog( "Simulating ${n} nodes with ${c} connections in a ${t} topology",
+            ("n", n)("c", connections.size())("t", parameters.topology) );
+   }
+
+   void inject( bench_node& origin, const message& item )
+   {
+      injection_times[item.id()] = fc::time_point::now();
+      if( item.msg_type == block_message_type )
+         ++blocks_injected;
+      else
+         ++transactions_injected;
+      origin.accept( nullptr, item );
+   }
+
+   void item_reached_node( const message& item, const item_hash_t& item_hash, bool injected_here )
+   {
+      propagation_latencies& latencies = item.msg_type == block_message_type ? block_latencies : transaction_latencies;
+      const int64_t latency = (fc::time_point::now() - injection_times.at( item_hash )).count();
+      if( !injected_here )
+         latencies.to_each_node.push_back( latency );
+      if( ++nodes_reached[item_hash] == nodes.size() )
+      {
+         latencies.to_every_node.push_back( latency );
+         ++items_at_every_node;
+      }
+   }
+
+   bool complete()const { return items_at_every_node == injection_times.size(); }
+
+   void report( const std::string& name )
+   {
+      transaction_latencies.report( name + " transactions", transactions_injected );
+      block_latencies.report( name + " blocks", blocks_injected );
+
+      uint64_t total_bytes = 0, max_bytes = 0, total_messages = 0, total_duplicates = 0;
+      for( const auto& node : nodes )
+      {
+         total_bytes += node->bytes_received;
+         max_bytes = std::max( max_bytes, node->bytes_received );
+         total_messages += node->messages_received;
+         total_duplicates += node->duplicate_items;
+      }
+      ilog( "${n}: each node received ${b} bytes on average and ${m} bytes at most, in ${c} messages on average; "
+            "${d} duplicate items in all",
+            ("n", name)("b", total_bytes / nodes.size())("m", max_bytes)
+            ("c", total_messages / nodes.size())("d", total_duplicates) );
+   }
+};
+
+bool bench_link::handle_message( const message& message_to_process, bool )
+{
+   receiver->on_message( sender, message_to_process );
+   return false;
+}
+
+void bench_node::send( bench_node* peer, const message& message_to_send )
+{
+   run.network.send_message( links.at( peer ), message_to_send );
+}
+
+void bench_node::on_message( bench_node* peer, const message& received_message )
+{
+   bytes_received += sizeof( message_header ) + received_message.size;
+   ++messages_received;
+
+   switch( received_message.msg_type )
+   {
+      case trx_message_type:
+      case block_message_type:
+         if( items.count( received_message.id() ) )
+            ++duplicate_items;
+         else
+            accept( peer, received_message );
+         break;
+      case item_ids_inventory_message_type:
+      {
+         item_ids_inventory_message inventory = received_message.as<item_ids_inventory_message>();
+         std::vector<item_hash_t> items_to_fetch;
+         for( const item_hash_t& item_hash : inventory.item_hashes_available )
+            if( !items.count( item_hash ) && requested_items.insert( item_hash ).second )
+               items_to_fetch.push_back( item_hash );
+         if( !items_to_fetch.empty() )
+            send( peer, fetch_items_message( inventory.item_type, items_to_fetch ) );
+         break;
+      }
+      case fetch_items_message_type:
+      {
+         fetch_items_message fetch = received_message.as<fetch_items_message>();
+         for( const item_hash_t& item_hash : fetch.items_to_fetch )
+         {
+            auto item = items.find( item_hash );
+            if( item == items.end() )
+               continue;
+            if( item->second.msg_type == block_message_type && run.mode == announce_compact_blocks )
+               send( peer, compact_block_message( item_hash, item->second.as<block_message>().block ) );
+            else
+               send( peer, item->second );
+         }
+         break;
+      }
+      case compact_block_message_type:
+      {
+         compact_block_message compact_block = received_message.as<compact_block_message>();
+         if( items.count( compact_block.block_message_hash ) )
+         {
+            ++duplicate_items;
+            break;
+         }
+         std::vector<uint32_t> missing_transactions;
+         for( uint32_t i = 0; i < compact_block.transactions.size(); ++i )
+            if( !transactions.count( compact_block.transactions[i].id ) )
+               missing_transactions.push_back( i );
+         if( missing_transactions.empty() )
+            rebuild_compact_block( peer, compact_block );
+         else
+         {
+            send( peer, fetch_compact_block_transactions_message( compact_block.block_message_hash, missing_transactions ) );
+            compact_blocks_waiting_for_transactions[compact_block.block_message_hash] = std::move( compact_block );
+         }
+         break;
+      }
+      case fetch_compact_block_transactions_message_type:
+      {
+         fetch_compact_block_transactions_message fetch = received_message.as<fetch_compact_block_transactions_message>();
+         auto item = items.find( fetch.block_message_hash );
+         if( item == items.end() )
+            break;
+         signed_block block = item->second.as<block_message>().block;
+         compact_block_transactions_message reply( fetch.block_message_hash );
+         for( uint32_t index : fetch.transaction_indices )
+            if( index < block.transactions.size() )
+               reply.transactions.push_back( block.transactions[index] );
+         send( peer, reply );
+         break;
+      }
+      case compact_block_transactions_message_type:
+      {
+         compact_block_transactions_message reply = received_message.as<compact_block_transactions_message>();
+         auto waiting = compact_blocks_waiting_for_transactions.find( reply.block_message_hash );
+         if( waiting == compact_blocks_waiting_for_transactions.end() )
+            break;
+         compact_block_message compact_block = std::move( waiting->second );
+         compact_blocks_waiting_for_transactions.erase( waiting );
+         for( const signed_transaction& trx : reply.transactions )
+            transactions.emplace( trx.id(), trx );
+         rebuild_compact_block( peer, compact_block );
+         break;
+      }
+      default:
+         FC_ASSERT( !"Unexpected message type", "${type}", ("type", received_message.msg_type) );
+   }
+}
+
+void bench_node::rebuild_compact_block( bench_node* peer, const compact_block_message& compact_block )
+{
+   signed_block block;
+   static_cast<signed_block_header&>( block ) = compact_block.block_header;
+   for( const auto& compact_transaction : compact_block.transactions )
+   {
+      auto trx = transactions.find( compact_transaction.id );
+      FC_ASSERT( trx != transactions.end(), "peer didn't send all the missing transactions" );
+      processed_transaction transaction( trx->second );
+      transaction.operation_results = compact_transaction.operation_results;
+      block.transactions.emplace_back( std::move( transaction ) );
+   }
+   message full_block = block_message( block );
+   FC_ASSERT( full_block.id() == compact_block.block_message_hash );
+   if( !items.count( compact_block.block_message_hash ) )
+      accept( peer, full_block );
+}
+
+void bench_node::accept( bench_node* originating_peer, const message& item )
+{
+   const item_hash_t item_hash = item.id();
+   items.emplace( item_hash, item );
+   if( item.msg_type == trx_message_type )
+   {
+      signed_transaction trx = item.as<trx_message>().trx;
+      transactions.emplace( trx.id(), std::move( trx ) );
+   }
+   run.item_reached_node( item, item_hash, originating_peer == nullptr );
+
+   for( const auto& link : links )
+      if( link.first != originating_peer )
+      {
+         if( run.mode == flood )
+            send( link.first, item );
+         else
+            send( link.first, item_ids_inventory_message( item.msg_type, std::vector<item_hash_t>{ item_hash } ) );
+      }
+}
+
+/// A transfer with a signature, about the size of the transactions relayed in practice, made unique by its number
+signed_transaction make_transaction( uint32_t number )
+{
+   signed_transaction trx;
+   trx.ref_block_prefix = number;
+   transfer_operation transfer;
+   transfer.from = account_id_type( 1 + number % 100 );
+   transfer.to = account_id_type( 101 + number % 100 );
+   transfer.amount = asset( 1 + number );
+   trx.operations.push_back( transfer );
+   trx.signatures[key_id_type( number % 100 )] = signature_type();
+   return trx;
+}
+
+/**
+ *  Injects the transactions at a steady rate at random nodes, and after every transactions_per_block of them a block
+ *  holding them at another random node, then waits for every item to reach every node and reports.
+ */
+void run_propagation_benchmark( relay_mode mode, const std::string& name )
+{
+   propagation_parameters parameters;
+   propagation_run run( mode, parameters );
+
+   std::mt19937 random( 2 );
+   auto random_node = [&]() -> bench_node& { return *run.nodes[random() % run.nodes.size()]; };
+   const fc::microseconds transaction_interval( 1000000 / std::max<uint32_t>( 1, parameters.transactions_per_second ) );
+
+   signed_block block;
+   block_id_type head_block_id;
+   for( uint32_t i = 0; i < parameters.transaction_count; ++i )
+   {
+      signed_transaction trx = make_transaction( i );
+      run.inject( random_node(), trx_message( trx ) );
+      block.transactions.emplace_back( std::move( trx ) );
+      if( block.transactions.size() == parameters.transactions_per_block )
+      {
+         block.previous = head_block_id;
+         block.timestamp = fc::time_point_sec( i );
+         block.transaction_merkle_root = block.calculate_merkle_root();
+         head_block_id = block.id();
+         run.inject( random_node(), block_message( block ) );
+         block.transactions.clear();
+      }
+      fc::usleep( transaction_interval );
+   }
+
+   const fc::time_point deadline = fc::time_point::now() + fc::seconds( 60 );
+   while( !run.complete() && fc::time_point::now() < deadline )
+      fc::usleep( fc::milliseconds( 10 ) );
+   BOOST_CHECK( run.complete() );
+   run.report( name );
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE( network_propagation_benchmarks )
+
+BOOST_AUTO_TEST_CASE( flood_propagation_bench )
+{
+   try {
+      run_propagation_benchmark( flood, "flooding full items" );
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( inventory_propagation_bench )
+{
+   try {
+      run_propagation_benchmark( announce, "announcing items in inventory messages" );
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( compact_block_propagation_bench )
+{
+   try {
+      run_propagation_benchmark( announce_compact_blocks, "announcing items, sending compact blocks" );
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
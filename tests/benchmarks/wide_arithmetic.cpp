@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/asset.hpp>
+#include <graphene/chain/config.hpp>
+#include <graphene/chain/wide_arithmetic.hpp>
+
+#include <fc/time.hpp>
+#include <fc/uint128.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <random>
+
+using namespace graphene::chain;
+
+namespace {
+
+#ifdef NDEBUG
+const size_t sample_count = 10000000;
+#else
+const size_t sample_count = 1000000;
+#endif
+
+/// asset * price as the chain used to calculate it, with fc::uint128
+asset reference_multiply( const asset& a, const price& b )
+{
+   if( a.asset_id == b.base.asset_id )
+   {
+      auto result = (fc::uint128(a.amount.value) * b.quote.amount.value)/b.base.amount.value;
+      FC_ASSERT( result <= GRAPHENE_MAX_SHARE_SUPPLY );
+      return asset( result.to_uint64(), b.quote.asset_id );
+   }
+   auto result = (fc::uint128(a.amount.value) * b.base.amount.value)/b.quote.amount.value;
+   FC_ASSERT( result <= GRAPHENE_MAX_SHARE_SUPPLY );
+   return asset( result.to_uint64(), b.base.asset_id );
+}
+
+/// The percentage fee of an amount as the chain used to calculate it, with fc::uint128
+uint64_t reference_fee( uint64_t amount, uint16_t percent )
+{
+   fc::uint128 a( amount );
+   a *= percent;
+   a /= GRAPHENE_100_PERCENT;
+   return a.to_uint64();
+}
+
+uint64_t fee( uint64_t amount, uint16_t percent )
+{
+   uint64_t result;
+   multiply_divide( amount, percent, GRAPHENE_100_PERCENT, result );
+   return result;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( wide_arithmetic_bench )
+{
+   try {
+      std::mt19937_64 random( 7 );
+      vector<asset> amounts;
+      vector<price> prices;
+      vector<uint16_t> percents;
+      amounts.reserve( sample_count );
+      prices.reserve( sample_count );
+      percents.reserve( sample_count );
+      // The prices keep every product within the supply, so each conversion succeeds
+      for( size_t i = 0; i < sample_count; ++i )
+      {
+         const share_type base = 1 + random() % 1000000;
+         const share_type quote = 1 + random() % (GRAPHENE_MAX_SHARE_SUPPLY / 1000000);
+         prices.push_back( asset( base, asset_id_type(1) ) / asset( quote, asset_id_type() ) );
+         amounts.push_back( asset( share_type( 1 + random() % 1000000 ), asset_id_type(1) ) );
+         percents.push_back( uint16_t( random() % (GRAPHENE_100_PERCENT + 1) ) );
+      }
+
+      vector<asset> reference_results( sample_count ), results( sample_count );
+      fc::time_point start = fc::time_point::now();
+      for( size_t i = 0; i < sample_count; ++i )
+         reference_results[i] = reference_multiply( amounts[i], prices[i] );
+      const auto reference_time = (fc::time_point::now() - start).count();
+      start = fc::time_point::now();
+      for( size_t i = 0; i < sample_count; ++i )
+         results[i] = amounts[i] * prices[i];
+      const auto price_time = (fc::time_point::now() - start).count();
+      BOOST_CHECK( reference_results == results );
+
+      vector<uint64_t> reference_fees( sample_count ), fees( sample_count );
+      start = fc::time_point::now();
+      for( size_t i = 0; i < sample_count; ++i )
+         reference_fees[i] = reference_fee( uint64_t(results[i].amount.value), percents[i] );
+      const auto reference_fee_time = (fc::time_point::now() - start).count();
+      start = fc::time_point::now();
+      for( size_t i = 0; i < sample_count; ++i )
+         fees[i] = fee( uint64_t(results[i].amount.value), percents[i] );
+      const auto fee_time = (fc::time_point::now() - start).count();
+      BOOST_CHECK( reference_fees == fees );
+
+      size_t reference_less = 0, less = 0;
+      start = fc::time_point::now();
+      for( size_t i = 1; i < sample_count; ++i )
+         reference_less += fc::uint128( prices[i].quote.amount.value ) * prices[i-1].base.amount.value <
+                           fc::uint128( prices[i-1].quote.amount.value ) * prices[i].base.amount.value;
+      const auto reference_compare_time = (fc::time_point::now() - start).count();
+      start = fc::time_point::now();
+      for( size_t i = 1; i < sample_count; ++i )
+         less += prices[i-1] < prices[i];
+      const auto compare_time = (fc::time_point::now() - start).count();
+      BOOST_CHECK_EQUAL( reference_less, less );
+
+      ilog( "${n} samples, ${native}: asset * price ${r} ms with fc::uint128, ${p} ms now; "
+            "fees ${rf} ms with fc::uint128, ${f} ms now; price comparisons ${rc} ms with fc::uint128, ${c} ms now",
+#ifdef GRAPHENE_NATIVE_INT128
+            ("native","native 128 bit integers")
+#else
+            ("native","portable 128 bit arithmetic")
+#endif
+            ("n",sample_count)("r",reference_time / 1000)("p",price_time / 1000)
+            ("rf",reference_fee_time / 1000)("f",fee_time / 1000)
+            ("rc",reference_compare_time / 1000)("c",compare_time / 1000) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
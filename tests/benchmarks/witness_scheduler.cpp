@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <graphene/chain/witness_schedule_object.hpp>
+
+#include <fc/crypto/digest.hpp>
+#include <fc/time.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace graphene::chain;
+
+namespace {
+
+/// The scheduler the chain used to run, which checks its invariant after every step
+typedef generic_witness_scheduler< witness_id_type, witness_scheduler_rng,
+                                   decltype( chain_parameters::maximum_witness_count ), uint32_t, true >
+   checked_witness_scheduler;
+
+/**
+ *  Schedules rounds of a full witness set, swapping a tenth of the witnesses out at every tenth round as a
+ *  maintenance interval would, and returns the witnesses scheduled in order
+ */
+template< typename Scheduler >
+vector<witness_id_type> run_schedule( uint32_t witness_count, uint32_t rounds, const std::string& name )
+{
+   const fc::sha256 seed = fc::sha256::hash( std::string( "witness_scheduler_bench" ) );
+   witness_scheduler_rng rng( seed.data(), 0 );
+
+   flat_set<witness_id_type> active;
+   for( uint32_t i = 0; i < witness_count; ++i )
+      active.insert( witness_id_type( i ) );
+   Scheduler scheduler;
+   scheduler._min_token_count = witness_count / 2;
+   scheduler.update( active );
+
+   vector<witness_id_type> scheduled;
+   scheduled.reserve( size_t(witness_count) * rounds );
+   const fc::time_point start = fc::time_point::now();
+   for( uint32_t round = 0; round < rounds; ++round )
+   {
+      if( round % 10 == 9 )
+      {
+         flat_set<witness_id_type> revised;
+         for( uint32_t i = 0; i < witness_count; ++i )
+            revised.insert( witness_id_type( (i + round * witness_count / 100) % (witness_count * 2) ) );
+         scheduler.update( revised );
+      }
+      for( uint32_t slot = 0; slot < witness_count; ++slot )
+      {
+         while( scheduler.size() == 0 )
+            scheduler.produce_schedule( rng );
+         scheduled.push_back( scheduler.consume_schedule() );
+      }
+   }
+   const auto elapsed = (fc::time_point::now() - start).count();
+   ilog( "${name}: scheduled ${n} rounds of ${w} witnesses in ${t} milliseconds, ${a} microseconds per slot",
+         ("name",name)("n",rounds)("w",witness_count)("t",elapsed / 1000)("a",elapsed / (uint64_t(witness_count) * rounds)) );
+   return scheduled;
+}
+
+/// The rng as the chain used to run it, drawing its bits one at a time
+class bitwise_rng : public witness_scheduler_rng
+{
+   public:
+      bitwise_rng( const char* seed, uint64_t counter ) : witness_scheduler_rng( seed, counter ) {}
+
+      uint64_t draw_bitwise( uint64_t bound )
+      {
+         const uint8_t bitcount = uint8_t( 64 - __builtin_clzll( bound ) );
+         while( true )
+         {
+            uint64_t result = 0;
+            uint64_t mask = 1;
+            for( uint8_t count = bitcount; count > 0; --count )
+            {
+               if( !_has_current_value )
+                  _reset_current_value();
+               if( _current_value.data()[ (_current_offset >> 3) & 0x1F ] & (1 << (_current_offset & 0x07)) )
+                  result |= mask;
+               mask += mask;
+               if( ++_current_offset == (_current_value.data_size() << 3) )
+               {
+                  _counter++;
+                  _current_offset = 0;
+                  _has_current_value = false;
+               }
+            }
+            if( result < bound )
+               return result;
+         }
+      }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( witness_scheduler_rng_bench )
+{
+   try {
+      const fc::sha256 seed = fc::sha256::hash( std::string( "witness_scheduler_rng_bench" ) );
+      const uint64_t bound = GRAPHENE_DEFAULT_MAX_WITNESSES;
+#ifdef NDEBUG
+      const size_t draw_count = 10000000;
+#else
+      const size_t draw_count = 1000000;
+#endif
+      vector<uint64_t> bitwise( draw_count ), bytewise( draw_count ), batched( draw_count );
+
+      bitwise_rng reference( seed.data(), 0 );
+      fc::time_point start = fc::time_point::now();
+      for( uint64_t& draw : bitwise )
+         draw = reference.draw_bitwise( bound );
+      const auto bitwise_time = (fc::time_point::now() - start).count();
+
+      witness_scheduler_rng single( seed.data(), 0 );
+      start = fc::time_point::now();
+      for( uint64_t& draw : bytewise )
+         draw = single( bound );
+      const auto bytewise_time = (fc::time_point::now() - start).count();
+
+      witness_scheduler_rng batch( seed.data(), 0 );
+      start = fc::time_point::now();
+      batch.draw( bound, batched.data(), batched.size() );
+      const auto batched_time = (fc::time_point::now() - start).count();
+
+      ilog( "${n} draws below ${b}: ${bit} ms a bit at a time, ${byte} ms a byte at a time, ${batch} ms batched",
+            ("n",draw_count)("b",bound)("bit",bitwise_time / 1000)("byte",bytewise_time / 1000)("batch",batched_time / 1000) );
+      BOOST_CHECK( bitwise == bytewise );
+      BOOST_CHECK( bitwise == batched );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( witness_scheduler_bench )
+{
+   try {
+      const uint32_t witness_count = GRAPHENE_DEFAULT_MAX_WITNESSES;
+#ifdef NDEBUG
+      const uint32_t rounds = 100;
+#else
+      const uint32_t rounds = 10;
+#endif
+      const auto checked = run_schedule<checked_witness_scheduler>( witness_count, rounds, "checked scheduler" );
+      const auto unchecked = run_schedule<witness_scheduler>( witness_count, rounds, "chain scheduler" );
+      BOOST_CHECK( checked == unchecked );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
@@ -19,6 +19,7 @@
 #include <boost/program_options.hpp>
 
 #include <graphene/account_history/account_history_plugin.hpp>
+#include <graphene/market_history/market_history_plugin.hpp>
 
 #include <graphene/db/simple_index.hpp>
 
@@ -32,6 +33,7 @@
 #include <graphene/chain/witness_object.hpp>
 
 #include <fc/crypto/digest.hpp>
+#include <fc/filesystem.hpp>
 
 #include <iostream>
 #include <iomanip>
@@ -43,21 +45,47 @@ namespace graphene { namespace chain {
 
 using std::cout;
 
+namespace {
+   /// Where the first fixture of the process saves the state after genesis
+   const fc::path& genesis_state_file()
+   {
+      static fc::temp_directory dir;
+      static const fc::path file = dir.path() / "genesis_state";
+      return file;
+   }
+}
+
+bool database_fixture::reuse_genesis_state = true;
+
 database_fixture::database_fixture()
    : app(), db( *app.chain_database() )
 {
    auto ahplugin = app.register_plugin<graphene::account_history::account_history_plugin>();
+   auto mhplugin = app.register_plugin<graphene::market_history::market_history_plugin>();
 
    boost::program_options::variables_map options;
 
    // app.initialize();
    ahplugin->plugin_set_app( &app );
    ahplugin->plugin_initialize( options );
-
-   db.init_genesis();
+   mhplugin->plugin_set_app( &app );
+   mhplugin->plugin_initialize( options );
+
+   const bool restored = reuse_genesis_state && fc::exists( genesis_state_file() );
+   if( restored )
+      db.open_in_memory_from_snapshot( genesis_state_file() );
+   else
+      db.open_in_memory();
    ahplugin->plugin_startup();
+   mhplugin->plugin_startup();
+   ahplugin->wait_for_key_index();
 
-   generate_block();
+   if( !restored )
+   {
+      generate_block();
+      if( reuse_genesis_state )
+         db.snapshot( genesis_state_file() );
+   }
 
    genesis_key(db); // attempt to deref
    trx.set_expiration(db.head_block_time() + fc::minutes(1));
@@ -73,8 +101,7 @@ database_fixture::~database_fixture()
       verify_account_history_plugin_index();
    }
 
-   if( data_dir )
-      db.close();
+   db.close();
    return;
 }
 
@@ -146,7 +173,7 @@ void database_fixture::verify_asset_supplies( )const
          BOOST_CHECK_EQUAL(total_balances[asset_obj.id].value, asset_obj.dynamic_asset_data_id(db).current_supply.value);
       total_balances[asset_id_type()] += asset_obj.dynamic_asset_data_id(db).fee_pool;
    }
-   for( const witness_object& witness_obj : db.get_index_type<simple_index<witness_object>>() )
+   for( const witness_object& witness_obj : db.get_index_type<witness_index>() )
    {
       total_balances[asset_id_type()] += witness_obj.accumulated_income;
    }
@@ -156,7 +183,7 @@ void database_fixture::verify_asset_supplies( )const
       if( bond_offer.amount.asset_id == asset_id_type() )
          core_in_orders += bond_offer.amount.amount;
    }
-   for( const vesting_balance_object& vbo : db.get_index_type< simple_index<vesting_balance_object> >() )
+   for( const vesting_balance_object& vbo : db.get_index_type< vesting_balance_index >().indices() )
       total_balances[ vbo.balance.asset_id ] += vbo.balance.amount;
 
    total_balances[asset_id_type()] += db.get_dynamic_global_properties().witness_budget;
@@ -252,18 +279,8 @@ void database_fixture::verify_account_history_plugin_index( )const
    return;
 }
 
-void database_fixture::open_database()
-{
-   if( !data_dir ) {
-      data_dir = fc::temp_directory();
-      db.open(data_dir->path());
-   }
-}
-
 signed_block database_fixture::generate_block(uint32_t skip, const fc::ecc::private_key& key, int miss_blocks)
 {
-   open_database();
-
    // skip == ~0 will skip checks specified in database::validation_steps
    return db.generate_block(db.get_slot_time(miss_blocks + 1),
                             db.get_scheduled_witness(miss_blocks + 1).first,
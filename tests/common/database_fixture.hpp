@@ -96,10 +96,15 @@ struct database_fixture {
    const key_object* key1= nullptr;
    const key_object* key2= nullptr;
    const key_object* key3= nullptr;
-   optional<fc::temp_directory> data_dir;
    bool skip_key_index_test = false;
    uint32_t anon_acct_count;
 
+   /**
+    * Fixtures keep the state and blocks in memory.  When this is set, the first fixture snapshots the state after
+    * genesis and its first block, and later fixtures load that snapshot instead of running genesis again.
+    */
+   static bool reuse_genesis_state;
+
    database_fixture();
    ~database_fixture();
 
@@ -108,7 +113,6 @@ struct database_fixture {
    void _push_transaction( const signed_transaction& tx, uint32_t skip_flags, const char* file, int line );
    void verify_asset_supplies( )const;
    void verify_account_history_plugin_index( )const;
-   void open_database();
    signed_block generate_block(uint32_t skip = ~0,
                                const fc::ecc::private_key& key = generate_private_key("genesis"),
                                int miss_blocks = 0);
@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/operations.hpp>
+#include <graphene/chain/account_object.hpp>
+#include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/limit_order_object.hpp>
+
+#include <fc/filesystem.hpp>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+using namespace graphene::chain;
+
+namespace {
+
+uint64_t soak_parameter( const char* name, uint64_t default_value )
+{
+   const char* value = std::getenv( name );
+   return value ? std::strtoull( value, nullptr, 0 ) : default_value;
+}
+
+/**
+ *  How long to soak and with what, each overridable through the environment variable next to it.
+ *
+ *  Each round pushes up to max_ops random operations, then either produces a block, forks for a few blocks, or
+ *  pops the block it just produced and replaces it. The defaults make a run of a few minutes; a soak of weeks of
+ *  uptime wants millions of rounds. The resources are sampled every sample_interval rounds, and, after the first
+ *  quarter of the samples has warmed the chain up, the later half of the samples may not exceed the earlier half by
+ *  more than max_growth percent.
+ */
+struct soak_parameters
+{
+   uint64_t rounds           = soak_parameter( "GRAPHENE_SOAK_ROUNDS", 2000 );
+   uint64_t sample_interval  = soak_parameter( "GRAPHENE_SOAK_SAMPLE_INTERVAL", 100 );
+   uint64_t max_ops          = soak_parameter( "GRAPHENE_SOAK_MAX_OPS", 20 );
+   uint64_t fork_percent     = soak_parameter( "GRAPHENE_SOAK_FORK_PERCENT", 2 );
+   uint64_t pop_percent      = soak_parameter( "GRAPHENE_SOAK_POP_PERCENT", 3 );
+   uint64_t max_accounts     = soak_parameter( "GRAPHENE_SOAK_MAX_ACCOUNTS", 100 );
+   uint64_t max_orders       = soak_parameter( "GRAPHENE_SOAK_MAX_ORDERS", 200 );
+   uint64_t max_growth       = soak_parameter( "GRAPHENE_SOAK_MAX_GROWTH_PERCENT", 50 );
+};
+
+uint64_t current_rss_bytes()
+{
+#ifdef __linux__
+   std::ifstream statm( "/proc/self/statm" );
+   uint64_t size = 0;
+   uint64_t resident = 0;
+   if( statm >> size >> resident )
+      return resident * sysconf( _SC_PAGESIZE );
+#endif
+   // elsewhere the peak, which still grows with a creeping footprint
+   struct rusage usage;
+   getrusage( RUSAGE_SELF, &usage );
+#ifdef __APPLE__
+   return usage.ru_maxrss;
+#else
+   return usage.ru_maxrss * 1024;
+#endif
+}
+
+struct soak_sample
+{
+   uint64_t round = 0;
+   uint64_t head_block_num = 0;
+   uint64_t rss_bytes = 0;
+   uint64_t undo_bytes = 0;
+   uint64_t fork_db_blocks = 0;
+   uint64_t index_objects = 0;
+   uint64_t index_bytes = 0;
+   /// The mean time db2 took to apply a block since the previous sample
+   uint64_t block_latency_us = 0;
+};
+
+/**
+ *  Two databases sharing a chain. db1 takes the transactions and produces the blocks, which db2 follows; for forks
+ *  db2 produces a longer branch of its own, which db1 switches to.
+ */
+struct soak_chain
+{
+   fc::temp_directory            data_dir1;
+   fc::temp_directory            data_dir2;
+   database                      db1;
+   database                      db2;
+   fc::ecc::private_key          key = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "genesis" ) ) );
+   uint32_t                      skip = database::skip_transaction_signatures | database::skip_authority_check;
+   asset_id_type                 uia;
+   vector<account_id_type>       accounts;
+   vector<limit_order_id_type>   orders;
+   uint64_t                      sequence = 0;
+   uint64_t                      rejected = 0;
+
+   soak_chain()
+   {
+      db1.open( data_dir1.path(), genesis_allocation() );
+      db2.open( data_dir2.path(), genesis_allocation() );
+
+      asset_create_operation creator;
+      creator.issuer = account_id_type();
+      creator.symbol = "SOAK";
+      creator.precision = 2;
+      creator.common_options.core_exchange_rate = price( {asset( 1, 1 ), asset( 1 )} );
+      creator.common_options.max_supply = GRAPHENE_MAX_SHARE_SUPPLY;
+      optional<processed_transaction> created = push( creator );
+      FC_ASSERT( created );
+      uia = created->operation_results[0].get<object_id_type>();
+      FC_ASSERT( push( asset_issue_operation( {asset(), account_id_type(), asset( GRAPHENE_MAX_SHARE_SUPPLY / 2, uia ),
+                                                account_id_type()} ) ) );
+      advance();
+   }
+
+   /// @return the results of a transaction of the operation, or nothing if it was rejected
+   optional<processed_transaction> push( const operation& op )
+   {
+      signed_transaction trx;
+      trx.operations.push_back( op );
+      trx.visit( operation_set_fee( db1.current_fee_schedule() ) );
+      trx.set_expiration( db1.head_block_time() + fc::seconds( 30 ) );
+      try {
+         return db1.push_transaction( trx, skip );
+      } catch( const fc::exception& ) {
+         ++rejected;
+         return optional<processed_transaction>();
+      }
+   }
+
+   void push_random_operation( const soak_parameters& params )
+   {
+      ++sequence;
+      // forks and pops may have undone what these refer to
+      accounts.erase( std::remove_if( accounts.begin(), accounts.end(), [this]( account_id_type id ) {
+         return db1.find_object( id ) == nullptr;
+      } ), accounts.end() );
+      orders.erase( std::remove_if( orders.begin(), orders.end(), [this]( limit_order_id_type id ) {
+         return db1.find_object( id ) == nullptr;
+      } ), orders.end() );
+
+      uint32_t kind = std::rand() % 4;
+      if( kind == 0 && accounts.size() < params.max_accounts )
+      {
+         account_create_operation op;
+         op.registrar = account_id_type();
+         op.referrer = account_id_type();
+         op.name = "soak" + std::to_string( sequence );
+         op.owner = authority( 1, key_id_type(), 1 );
+         op.active = op.owner;
+         op.memo_key = key_id_type();
+         if( optional<processed_transaction> result = push( op ) )
+            accounts.push_back( result->operation_results[0].get<object_id_type>() );
+      }
+      else if( kind == 1 && !orders.empty() && ( orders.size() >= params.max_orders || std::rand() % 2 ) )
+      {
+         size_t i = std::rand() % orders.size();
+         limit_order_cancel_operation op;
+         op.order = orders[i];
+         op.fee_paying_account = account_id_type();
+         push( op );
+         orders.erase( orders.begin() + i );
+      }
+      else if( kind == 1 )
+      {
+         limit_order_create_operation op;
+         op.seller = account_id_type();
+         bool sell_core = std::rand() % 2;
+         op.amount_to_sell = asset( 100 + std::rand() % 100, sell_core ? asset_id_type() : uia );
+         op.min_to_receive = asset( 100 + std::rand() % 100, sell_core ? uia : asset_id_type() );
+         op.expiration = db1.head_block_time() + fc::days( 1 );
+         if( optional<processed_transaction> result = push( op ) )
+         {
+            limit_order_id_type id = result->operation_results[0].get<object_id_type>();
+            // filled right away
+            if( db1.find_object( id ) )
+               orders.push_back( id );
+         }
+      }
+      else
+      {
+         // the amounts grow with the sequence, so that no two transfers are duplicates
+         transfer_operation op;
+         bool from_genesis = accounts.empty() || std::rand() % 2;
+         op.from = from_genesis ? account_id_type() : accounts[ std::rand() % accounts.size() ];
+         op.to = accounts.empty() ? account_id_type() : accounts[ std::rand() % accounts.size() ];
+         op.amount = asset( ( from_genesis ? 1000000 : 1 ) + int64_t( sequence % 100000 ) );
+         if( op.from != op.to )
+            push( op );
+      }
+   }
+
+   signed_block generate( database& db, uint32_t slot = 1 )
+   {
+      return db.generate_block( db.get_slot_time( slot ), db.get_scheduled_witness( slot ).first, key, skip );
+   }
+
+   /// Produces a block on db1 and applies it to db2; @return the microseconds db2 took to apply it
+   uint64_t advance()
+   {
+      signed_block block = generate( db1 );
+      auto start = std::chrono::steady_clock::now();
+      db2.push_block( block, skip );
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      return std::chrono::duration_cast<std::chrono::microseconds>( elapsed ).count();
+   }
+
+   /// db1 produces depth blocks while db2 produces depth+1 from a skipped slot, then each is given the other's
+   void fork( uint32_t depth )
+   {
+      vector<signed_block> ours;
+      vector<signed_block> theirs;
+      for( uint32_t i = 0; i < depth; ++i )
+         ours.push_back( generate( db1 ) );
+      theirs.push_back( generate( db2, 2 ) );
+      for( uint32_t i = 0; i < depth; ++i )
+         theirs.push_back( generate( db2 ) );
+
+      for( const signed_block& block : theirs )
+         db1.push_block( block, skip );
+      for( const signed_block& block : ours )
+         db2.push_block( block, skip );
+      FC_ASSERT( db1.head_block_id() == db2.head_block_id() );
+   }
+
+   /// db1 pops a block db2 has already applied and builds on a replacement, which db2 then has to switch to
+   void pop_and_replace()
+   {
+      db2.push_block( generate( db1 ), skip );
+      db1.pop_block();
+      signed_block replacement = generate( db1, 2 );
+      signed_block next = generate( db1 );
+      db2.push_block( replacement, skip );
+      db2.push_block( next, skip );
+      FC_ASSERT( db1.head_block_id() == db2.head_block_id() );
+   }
+
+   soak_sample sample( uint64_t round, uint64_t block_latency_us )const
+   {
+      soak_sample s;
+      s.round = round;
+      s.head_block_num = db1.head_block_num();
+      s.rss_bytes = current_rss_bytes();
+      s.undo_bytes = db1.get_undo_stats().bytes + db2.get_undo_stats().bytes;
+      s.fork_db_blocks = db1.get_fork_db_size() + db2.get_fork_db_size();
+      s.block_latency_us = block_latency_us;
+      for( const database* db : {&db1, &db2} )
+         for( const index_stats& stats : db->get_index_stats() )
+         {
+            // the block summaries fill a ring of 64K entries, which a short soak never completes
+            if( stats.space_id == implementation_ids && stats.type_id == impl_block_summary_object_type )
+               continue;
+            s.index_objects += stats.object_count;
+            s.index_bytes += stats.object_bytes + stats.container_bytes + stats.pool_used_bytes + stats.pool_free_bytes;
+         }
+      return s;
+   }
+};
+
+/// Fails when, after the warm up, the later half of the samples exceeds the earlier half by more than allowed
+void check_bounded( const vector<soak_sample>& samples, const char* name, uint64_t soak_sample::* field,
+                    uint64_t max_growth_percent, uint64_t slack )
+{
+   size_t first = samples.size() / 4;
+   size_t middle = first + ( samples.size() - first ) / 2;
+   if( middle == first || middle == samples.size() )
+      return;
+
+   double earlier = 0;
+   double later = 0;
+   for( size_t i = first; i < middle; ++i )
+      earlier += samples[i].*field;
+   for( size_t i = middle; i < samples.size(); ++i )
+      later += samples[i].*field;
+   earlier /= middle - first;
+   later /= samples.size() - middle;
+
+   BOOST_CHECK_MESSAGE( later <= earlier * ( 100 + max_growth_percent ) / 100 + slack,
+                        name << " grew from " << uint64_t( earlier ) << " to " << uint64_t( later ) );
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(soak_tests)
+
+BOOST_AUTO_TEST_CASE( soak )
+{
+   try
+   {
+      soak_parameters params;
+      soak_chain chain;
+      vector<soak_sample> samples;
+      uint64_t latency_sum = 0;
+      uint64_t latency_count = 0;
+
+      for( uint64_t round = 1; round <= params.rounds; ++round )
+      {
+         uint64_t ops = std::rand() % ( params.max_ops + 1 );
+         for( uint64_t i = 0; i < ops; ++i )
+            chain.push_random_operation( params );
+
+         uint64_t choice = std::rand() % 100;
+         if( choice < params.fork_percent )
+            chain.fork( 1 + std::rand() % 3 );
+         else if( choice < params.fork_percent + params.pop_percent )
+            chain.pop_and_replace();
+         else
+         {
+            latency_sum += chain.advance();
+            ++latency_count;
+         }
+
+         if( round % params.sample_interval == 0 )
+         {
+            samples.push_back( chain.sample( round, latency_count ? latency_sum / latency_count : 0 ) );
+            latency_sum = latency_count = 0;
+            const soak_sample& s = samples.back();
+            std::cout << "round " << s.round << ": block " << s.head_block_num << ", rss " << s.rss_bytes / 1024
+                      << " kB, undo " << s.undo_bytes / 1024 << " kB, fork db " << s.fork_db_blocks << " blocks, "
+                      << s.index_objects << " objects in " << s.index_bytes / 1024 << " kB of indexes, "
+                      << s.block_latency_us << " us per block, " << chain.rejected << " rejected\n";
+         }
+      }
+
+      check_bounded( samples, "RSS", &soak_sample::rss_bytes, params.max_growth, 16 * 1024 * 1024 );
+      check_bounded( samples, "Undo history", &soak_sample::undo_bytes, params.max_growth, 1024 * 1024 );
+      check_bounded( samples, "Fork database", &soak_sample::fork_db_blocks, params.max_growth, 16 );
+      check_bounded( samples, "Index objects", &soak_sample::index_objects, params.max_growth, 1000 );
+      check_bounded( samples, "Index memory", &soak_sample::index_bytes, params.max_growth, 1024 * 1024 );
+      check_bounded( samples, "Block latency", &soak_sample::block_latency_us, params.max_growth, 1000 );
+   }
+   catch( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
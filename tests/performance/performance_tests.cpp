@@ -8,6 +8,7 @@
 #include <graphene/chain/key_object.hpp>
 #include <graphene/chain/delegate_object.hpp>
 #include <graphene/chain/proposal_object.hpp>
+#include <graphene/chain/signature_batch.hpp>
 
 #include <graphene/db/simple_index.hpp>
 
@@ -29,6 +30,23 @@ BOOST_AUTO_TEST_CASE( sigcheck_benchmark )
    auto end = fc::time_point::now();
    auto elapsed = end-start;
    wdump( ((100000.0*1000000.0) / elapsed.count()) );
+
+   // The same number of signatures, recovered as one batch spread over a growing number of threads
+   graphene::utilities::thread_group threads;
+   for( uint32_t thread_count : { 0, 1, 2, 4 } )
+   {
+      while( threads.size() < thread_count )
+         threads.emplace_back( new fc::thread( "sigcheck" + fc::to_string(uint64_t(threads.size())) ) );
+
+      signature_batch batch;
+      for( uint32_t i = 0; i < 100000; ++i )
+         batch.add( digest, sig );
+      start = fc::time_point::now();
+      BOOST_CHECK( batch.verify( threads ) );
+      end = fc::time_point::now();
+      elapsed = end-start;
+      wdump( (thread_count)((100000.0*1000000.0) / elapsed.count()) );
+   }
 }
 /*
 BOOST_AUTO_TEST_CASE( transfer_benchmark )
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2015, Cryptonomex, Inc.
+ * All rights reserved.
+ *
+ * This source code is provided for evaluation in private test networks only, until September 8, 2015. After this date, this license expires and
+ * the code may not be used, modified or distributed for any purpose. Redistribution and use in source and binary forms, with or without modification,
+ * are permitted until September 8, 2015, provided that the following conditions are met:
+ *
+ * 1. The code and/or derivative works are used only for private test networks consisting of no more than 10 P2P nodes.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <boost/test/unit_test.hpp>
+
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/operations.hpp>
+#include <graphene/chain/account_object.hpp>
+#include <graphene/chain/key_object.hpp>
+#include <graphene/chain/transaction_evaluation_state.hpp>
+
+#include <fc/crypto/digest.hpp>
+#include <fc/io/json.hpp>
+
+#include "../common/database_fixture.hpp"
+
+#include <cstdlib>
+
+using namespace graphene::chain;
+
+struct benchmark_result
+{
+   string   name;
+   uint64_t iterations = 0;
+   double   seconds = 0;
+   double   ops_per_second = 0;
+};
+
+FC_REFLECT( benchmark_result, (name)(iterations)(seconds)(ops_per_second) )
+
+namespace {
+
+/**
+ * Every benchmark appends its result here, and the whole set is rewritten to the file named by the
+ * GRAPHENE_BENCHMARK_RESULTS environment variable (signature_benchmarks.json by default) so runs on different
+ * builds can be compared.
+ */
+vector<benchmark_result> benchmark_results;
+
+void record_benchmark( const string& name, uint64_t iterations, const fc::microseconds& elapsed )
+{
+   benchmark_result result;
+   result.name = name;
+   result.iterations = iterations;
+   result.seconds = elapsed.count() / 1000000.0;
+   result.ops_per_second = result.seconds > 0 ? iterations / result.seconds : 0;
+   wdump( (result) );
+
+   benchmark_results.push_back( result );
+   const char* path = std::getenv( "GRAPHENE_BENCHMARK_RESULTS" );
+   fc::json::save_to_file( benchmark_results, fc::path( path ? path : "signature_benchmarks.json" ) );
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE( signature_benchmarks, database_fixture )
+
+BOOST_AUTO_TEST_CASE( key_recovery_benchmark )
+{
+   const uint32_t iterations = 10000;
+   auto key = generate_private_key( "nathan" );
+   auto digest = fc::sha256::hash( "hello" );
+   auto sig = key.sign_compact( digest );
+
+   auto start = fc::time_point::now();
+   for( uint32_t i = 0; i < iterations; ++i )
+      BOOST_CHECK( fc::ecc::public_key( sig, digest ) == key.get_public_key() );
+   record_benchmark( "key_recovery", iterations, fc::time_point::now() - start );
+}
+
+/**
+ * Account k has an active authority of 2 of {signed key, unsigned key, account k-1}, so approving the top account walks
+ * down the whole chain. The bottom account only has the two keys.
+ */
+BOOST_AUTO_TEST_CASE( check_authority_benchmark )
+{ try {
+   const uint32_t iterations = 20000;
+   signed_transaction signatures;
+
+   vector<account_id_type> accounts;
+   for( uint32_t depth = 0; depth <= GRAPHENE_MAX_SIG_CHECK_DEPTH; ++depth )
+   {
+      string name = "multisig" + fc::to_string( uint64_t(depth) );
+      key_id_type signed_key = register_key( generate_private_key( name + "a" ).get_public_key() ).get_id();
+      key_id_type unsigned_key = register_key( generate_private_key( name + "b" ).get_public_key() ).get_id();
+      // check_authority only looks at which keys signed, not at the signatures themselves
+      signatures.signatures[signed_key] = fc::ecc::compact_signature();
+
+      account_id_type account = create_account( name, signed_key ).id;
+      account_update_operation op;
+      op.account = account;
+      op.active = depth == 0 ? authority( 2, signed_key, 1, unsigned_key, 1 )
+                             : authority( 2, signed_key, 1, unsigned_key, 1, accounts.back(), 1 );
+      trx.operations.push_back( op );
+      db.push_transaction( trx, ~0 );
+      trx.clear();
+      accounts.push_back( account );
+
+      const account_object& top = account( db );
+      auto start = fc::time_point::now();
+      for( uint32_t i = 0; i < iterations; ++i )
+      {
+         transaction_evaluation_state eval_state( &db );
+         eval_state._trx = &signatures;
+         BOOST_CHECK( eval_state.check_authority( top ) );
+      }
+      record_benchmark( "check_authority_depth_" + fc::to_string( uint64_t(depth) ), iterations,
+                        fc::time_point::now() - start );
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( transfer_apply_benchmark )
+{ try {
+   const uint32_t iterations = 5000;
+   auto nathan_key = generate_private_key( "nathan" );
+   key_id_type nathan_key_id = register_key( nathan_key.get_public_key() ).get_id();
+   const account_object& nathan = create_account( "nathan", nathan_key_id );
+   fund( nathan, asset( iterations * (iterations + 1) ) );
+
+   vector<signed_transaction> transactions;
+   for( uint32_t i = 0; i < iterations; ++i )
+   {
+      // Distinct amounts give distinct transaction ids
+      trx.operations.push_back( transfer_operation( { asset(), nathan.id, account_id_type(), asset( i + 1 ) } ) );
+      sign( trx, nathan_key_id, nathan_key );
+      transactions.push_back( trx );
+      trx.clear();
+   }
+
+   auto start = fc::time_point::now();
+   for( const auto& t : transactions )
+      db.push_transaction( t, database::skip_block_size_check );
+   record_benchmark( "apply_transfer", iterations, fc::time_point::now() - start );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_SUITE_END()
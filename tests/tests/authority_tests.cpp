@@ -57,6 +57,36 @@ BOOST_AUTO_TEST_CASE( simple_single_signature )
    }
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE( shared_authorities )
+{ try {
+   fc::ecc::private_key nathan_key = fc::ecc::private_key::generate();
+   fc::ecc::private_key dan_key = fc::ecc::private_key::generate();
+   const key_object& nathan_key_obj = register_key(nathan_key.get_public_key());
+   const key_object& dan_key_obj = register_key(dan_key.get_public_key());
+   const account_object& nathan = create_account("nathan", nathan_key_obj.id);
+   const account_object& dan = create_account("dan", dan_key_obj.id);
+   const asset_object& core = asset_id_type()(db);
+   auto old_balance = fund(nathan);
+   fund(dan);
+
+   // Many operations of one account need its signature once
+   for( int i = 0; i < 10; ++i )
+      trx.operations.push_back(transfer_operation({asset(), nathan.id, account_id_type(), core.amount(10)}));
+   sign(trx, nathan_key_obj.id, nathan_key);
+   db.push_transaction(trx, database::skip_transaction_dupe_check);
+   BOOST_CHECK_EQUAL(get_balance(nathan, core), old_balance - 100);
+
+   // An operation of another account still needs its own signature
+   trx.clear();
+   trx.operations.push_back(transfer_operation({asset(), nathan.id, account_id_type(), core.amount(10)}));
+   trx.operations.push_back(transfer_operation({asset(), dan.id, account_id_type(), core.amount(10)}));
+   sign(trx, nathan_key_obj.id, nathan_key);
+   BOOST_CHECK_THROW(db.push_transaction(trx, database::skip_transaction_dupe_check), fc::exception);
+   sign(trx, dan_key_obj.id, dan_key);
+   db.push_transaction(trx, database::skip_transaction_dupe_check);
+   BOOST_CHECK_EQUAL(get_balance(nathan, core), old_balance - 110);
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE( any_two_of_three )
 {
    try {
@@ -263,6 +293,42 @@ BOOST_AUTO_TEST_CASE( recursive_accounts )
    }
 }
 
+BOOST_AUTO_TEST_CASE( authority_cache_invalidation )
+{ try {
+   fc::ecc::private_key nathan_key1 = fc::ecc::private_key::regenerate(fc::digest("key1"));
+   const key_object& key1 = register_key(nathan_key1.get_public_key());
+   fc::ecc::private_key nathan_key2 = fc::ecc::private_key::regenerate(fc::digest("key2"));
+   const key_object& key2 = register_key(nathan_key2.get_public_key());
+   const account_object& nathan = create_account("nathan", key1.id);
+   const asset_object& core = asset_id_type()(db);
+   fund(nathan);
+   generate_block();
+
+   // The first transfer leaves an approval of nathan by key1 in the authority cache when the block is applied
+   transfer_operation op = {asset(), nathan.id, account_id_type(), core.amount(500)};
+   trx.operations.push_back(op);
+   sign(trx, key1.id, nathan_key1);
+   db.push_transaction(trx);
+   trx.clear();
+
+   account_update_operation uop;
+   uop.account = nathan.id;
+   uop.active = authority(1, key2.get_id(), 1);
+   trx.operations.push_back(uop);
+   sign(trx, key1.id, nathan_key1);
+   db.push_transaction(trx);
+   trx.clear();
+
+   // This transfer is no longer authorized by key1, and must not be let through by the cached approval
+   op.amount = core.amount(600);
+   trx.operations.push_back(op);
+   sign(trx, key1.id, nathan_key1);
+   db.push_transaction(trx, database::skip_authority_check);
+   trx.clear();
+
+   BOOST_CHECK_THROW(generate_block(database::skip_nothing), fc::exception);
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE( proposed_single_account )
 {
    using namespace graphene::chain;
@@ -18,6 +18,8 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <graphene/app/metrics_server.hpp>
+
 #include <graphene/chain/database.hpp>
 #include <graphene/chain/operations.hpp>
 
@@ -25,12 +27,22 @@
 #include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/key_object.hpp>
 #include <graphene/chain/delegate_object.hpp>
+#include <graphene/chain/limit_order_object.hpp>
+#include <graphene/chain/short_order_object.hpp>
+#include <graphene/chain/transaction_conflicts.hpp>
+#include <graphene/chain/wide_arithmetic.hpp>
 #include <graphene/chain/witness_scheduler_rng.hpp>
 
 #include <graphene/db/simple_index.hpp>
 
+#include <graphene/net/timestamped_item_set.hpp>
+
+#include <graphene/utilities/metrics.hpp>
+#include <graphene/utilities/thread_pools.hpp>
+
 #include <fc/crypto/digest.hpp>
 #include <fc/crypto/hex.hpp>
+#include <fc/uint128.hpp>
 #include "../common/database_fixture.hpp"
 
 #include <algorithm>
@@ -87,6 +99,286 @@ BOOST_AUTO_TEST_CASE( memo_test )
    BOOST_CHECK_EQUAL(m.get_message(receiver, sender.get_public_key()), "Hello, world!");
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE( transaction_hash_cache )
+{ try {
+   signed_transaction trx;
+   trx.set_expiration( fc::time_point_sec( GRAPHENE_GENESIS_TIMESTAMP ) + fc::minutes(1) );
+   trx.operations.push_back( transfer_operation() );
+   auto id = trx.id();
+   auto digest = trx.digest();
+
+   trx.set_hash_cache_enabled( true );
+   BOOST_CHECK( trx.id() == id );
+   BOOST_CHECK( trx.digest() == digest );
+   BOOST_CHECK( trx.digest( block_id_type() ) == signed_transaction( trx ).digest( block_id_type() ) );
+
+   // Modifying the transaction through its member functions drops the cached hashes
+   trx.set_expiration( fc::time_point_sec( GRAPHENE_GENESIS_TIMESTAMP ) + fc::minutes(2) );
+   BOOST_CHECK( trx.id() != id );
+
+   // Copies do not inherit the cache
+   signed_transaction copy = trx;
+   copy.ref_block_prefix += 1;
+   BOOST_CHECK( copy.id() != trx.id() );
+
+   trx.set_hash_cache_enabled( false );
+   trx.ref_block_prefix += 1;
+   BOOST_CHECK( copy.id() == trx.id() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( merkle_accumulator_test )
+{ try {
+   graphene::utilities::thread_group threads;
+   threads.emplace_back( new fc::thread( "merkle0" ) );
+   threads.emplace_back( new fc::thread( "merkle1" ) );
+
+   signed_block block;
+   merkle_accumulator merkle;
+   BOOST_CHECK( merkle.root() == checksum_type() );
+   BOOST_CHECK( block.calculate_merkle_root() == checksum_type() );
+   for( uint32_t n = 1; n <= 33; ++n )
+   {
+      processed_transaction trx;
+      trx.set_expiration( fc::time_point_sec( n ) );
+      block.transactions.push_back( trx );
+      merkle.append( trx.merkle_digest() );
+
+      // Hash the tree level by level, carrying the odd node of each level up unchanged
+      vector<digest_type> nodes;
+      for( const auto& t : block.transactions )
+         nodes.push_back( t.merkle_digest() );
+      while( nodes.size() > 1 )
+      {
+         vector<digest_type> next;
+         for( uint32_t i = 0; i + 1 < nodes.size(); i += 2 )
+            next.push_back( digest_type::hash( std::make_pair( nodes[i], nodes[i+1] ) ) );
+         if( nodes.size() % 2 )
+            next.push_back( nodes.back() );
+         nodes = std::move( next );
+      }
+      auto expected = checksum_type::hash( nodes[0] );
+
+      BOOST_CHECK_EQUAL( merkle.size(), n );
+      BOOST_CHECK( merkle.root() == expected );
+      BOOST_CHECK( block.calculate_merkle_root() == expected );
+      BOOST_CHECK( block.calculate_merkle_root( threads ) == expected );
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( margin_call_tracker_test )
+{ try {
+   margin_call_tracker tracker;
+   asset_id_type usd(1), eur(2);
+   BOOST_CHECK( tracker.needs_check( usd ) );
+   tracker.set_checked( usd );
+   tracker.set_checked( eur );
+   BOOST_CHECK( !tracker.needs_check( usd ) );
+
+   // An order in the market of an asset makes it worth checking again, along with the other side
+   limit_order_object order;
+   order.id = limit_order_id_type();
+   order.sell_price = price( asset( 1, usd ), asset( 1 ) );
+   tracker.on_add( order );
+   BOOST_CHECK( tracker.needs_check( usd ) );
+   BOOST_CHECK( !tracker.needs_check( eur ) );
+   tracker.on_remove( order );
+   tracker.set_checked( usd );
+
+   call_order_object call;
+   call.id = call_order_id_type();
+   call.call_price = price( asset( 2 ), asset( 1, eur ) );
+   tracker.on_modify( call );
+   BOOST_CHECK( tracker.needs_check( eur ) );
+   BOOST_CHECK( !tracker.needs_check( usd ) );
+
+   // A feed change forgets every asset
+   asset_bitasset_data_object bitasset;
+   bitasset.id = asset_bitasset_data_id_type();
+   tracker.on_modify( bitasset );
+   BOOST_CHECK( tracker.needs_check( usd ) );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( timestamped_item_set_test )
+{ try {
+   graphene::net::timestamped_item_set items( 120, 100 );
+   auto item = []( uint32_t n ) {
+      return graphene::net::item_id( graphene::net::trx_message_type, fc::ripemd160::hash( (const char*)&n, sizeof(n) ) );
+   };
+   fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+   for( uint32_t n = 0; n < 50; ++n )
+      BOOST_CHECK( items.insert( item( n ), now ) );
+   BOOST_CHECK( !items.insert( item( 0 ), now ) );
+   items.erase( item( 1 ) );
+   BOOST_CHECK( !items.contains( item( 1 ) ) );
+   BOOST_CHECK( items.contains( item( 2 ) ) );
+   BOOST_CHECK_EQUAL( items.size(), 49 );
+
+   // The items of later buckets outlive the earlier ones
+   for( uint32_t n = 50; n < 60; ++n )
+      BOOST_CHECK( items.insert( item( n ), now + 60 ) );
+   items.expire( now + 135 );
+   BOOST_CHECK( !items.contains( item( 0 ) ) );
+   BOOST_CHECK( items.contains( item( 55 ) ) );
+   BOOST_CHECK_EQUAL( items.size(), 10 );
+
+   // A full set drops its oldest buckets, but never the newest
+   for( uint32_t n = 60; n < 150; ++n )
+      BOOST_CHECK( items.insert( item( n ), now + 90 ) );
+   BOOST_CHECK_EQUAL( items.size(), 100 );
+   BOOST_CHECK( items.insert( item( 150 ), now + 90 ) );
+   BOOST_CHECK( !items.contains( item( 55 ) ) );
+   BOOST_CHECK_EQUAL( items.size(), 91 );
+   for( uint32_t n = 151; n < 160; ++n )
+      BOOST_CHECK( items.insert( item( n ), now + 90 ) );
+   BOOST_CHECK( !items.insert( item( 160 ), now + 90 ) );
+   BOOST_CHECK_LE( items.memory_usage(), 256 * (sizeof(graphene::net::item_id) + sizeof(uint32_t)) );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( schedule_transactions_by_footprint )
+{ try {
+   vector<operation_footprint> footprints( 8 );
+   footprints[0].accounts = { account_id_type(1) };
+   footprints[1].accounts = { account_id_type(2) };
+   footprints[2].accounts = { account_id_type(1), account_id_type(3) };
+   footprints[3].unbounded = true;
+   footprints[4].assets_read = { asset_id_type() };
+   footprints[5].assets_read = { asset_id_type() };
+   footprints[6].assets_written = { asset_id_type() };
+   footprints[7].assets_read = { asset_id_type(1) };
+
+   BOOST_CHECK( footprints[0].conflicts_with( footprints[2] ) );
+   BOOST_CHECK( !footprints[0].conflicts_with( footprints[1] ) );
+   BOOST_CHECK( footprints[3].conflicts_with( footprints[1] ) );
+   // Only a write of an asset conflicts with its reads
+   BOOST_CHECK( !footprints[4].conflicts_with( footprints[5] ) );
+   BOOST_CHECK( footprints[4].conflicts_with( footprints[6] ) );
+
+   auto stages = schedule_transactions( footprints );
+   BOOST_REQUIRE_EQUAL( stages.size(), 3 );
+   BOOST_REQUIRE_EQUAL( stages[0].groups.size(), 2 );
+   BOOST_CHECK( stages[0].groups[0] == vector<uint32_t>({ 0, 2 }) );
+   BOOST_CHECK( stages[0].groups[1] == vector<uint32_t>({ 1 }) );
+   BOOST_REQUIRE_EQUAL( stages[1].groups.size(), 1 );
+   BOOST_CHECK( stages[1].groups[0] == vector<uint32_t>({ 3 }) );
+   BOOST_REQUIRE_EQUAL( stages[2].groups.size(), 2 );
+   BOOST_CHECK( stages[2].groups[0] == vector<uint32_t>({ 4, 5, 6 }) );
+   BOOST_CHECK( stages[2].groups[1] == vector<uint32_t>({ 7 }) );
+
+   // Transfers between unrelated accounts of existing balances touch disjoint state
+   signed_transaction trx;
+   trx.operations.push_back( transfer_operation({ asset(), account_id_type(1), account_id_type(2), asset(1) }) );
+   operation_footprint transfer = get_transaction_footprint( trx );
+   BOOST_CHECK( transfer.accounts == flat_set<account_id_type>({ account_id_type(1), account_id_type(2) }) );
+   BOOST_CHECK( transfer.assets_read == flat_set<asset_id_type>({ asset_id_type() }) );
+   BOOST_CHECK( !transfer.unbounded );
+   trx.operations.push_back( asset_update_operation() );
+   BOOST_CHECK( get_transaction_footprint( trx ).unbounded );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( metrics_registry_render )
+{ try {
+   graphene::utilities::metrics_registry registry;
+   registry.get_counter( "test_calls_total", "Calls" ).increment( 3 );
+   // The same name and labels find the same metric
+   registry.get_counter( "test_calls_total", "Calls" ).increment();
+   auto& depth = registry.get_gauge( "test_depth", "Depth", "kind=\"undo\"" );
+   depth.set( 5 );
+   depth.add( -2 );
+   auto& latency = registry.get_histogram( "test_latency", "Latency", { 10, 100 } );
+   for( int64_t value : { 1, 10, 50, 1000 } )
+      latency.observe( value );
+   BOOST_CHECK_THROW( registry.get_gauge( "test_calls_total", "Calls" ), fc::exception );
+
+   int collected = 0;
+   auto collector = registry.add_collector( [&collected]() { ++collected; } );
+   const std::string text = registry.render();
+   BOOST_CHECK_EQUAL( collected, 1 );
+   BOOST_CHECK( text.find( "# TYPE test_calls_total counter\ntest_calls_total 4\n" ) != std::string::npos );
+   BOOST_CHECK( text.find( "test_depth{kind=\"undo\"} 3\n" ) != std::string::npos );
+   // Buckets are cumulative, and the count matches the +Inf bucket
+   BOOST_CHECK( text.find( "test_latency_bucket{le=\"10\"} 2\n" ) != std::string::npos );
+   BOOST_CHECK( text.find( "test_latency_bucket{le=\"100\"} 3\n" ) != std::string::npos );
+   BOOST_CHECK( text.find( "test_latency_bucket{le=\"+Inf\"} 4\n" ) != std::string::npos );
+   BOOST_CHECK( text.find( "test_latency_sum 1061\ntest_latency_count 4\n" ) != std::string::npos );
+   registry.remove_collector( collector );
+   registry.render();
+   BOOST_CHECK_EQUAL( collected, 1 );
+
+   BOOST_CHECK_EQUAL( graphene::app::metrics_server::respond( "GET /metrics HTTP/1.1\r\nHost: x\r\n\r\n" ).find( "HTTP/1.1 200 OK\r\n" ), 0u );
+   BOOST_CHECK_EQUAL( graphene::app::metrics_server::respond( "GET /metrics?x=1 HTTP/1.0\r\n\r\n" ).find( "HTTP/1.1 200 OK\r\n" ), 0u );
+   BOOST_CHECK_EQUAL( graphene::app::metrics_server::respond( "GET / HTTP/1.1\r\n\r\n" ).find( "HTTP/1.1 404" ), 0u );
+   BOOST_CHECK_EQUAL( graphene::app::metrics_server::respond( "POST /metrics HTTP/1.1\r\n\r\n" ).find( "HTTP/1.1 404" ), 0u );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( thread_pools_by_role )
+{ try {
+   using graphene::utilities::thread_pools;
+   BOOST_CHECK_EQUAL( thread_pools::parse( "sigcheck=4" ).first, "sigcheck" );
+   BOOST_CHECK_EQUAL( thread_pools::parse( "sigcheck=4" ).second.thread_count, 4u );
+   BOOST_CHECK( !thread_pools::parse( "sigcheck=4" ).second.numa_node );
+   BOOST_CHECK_EQUAL( *thread_pools::parse( "api=2@1" ).second.numa_node, 1u );
+   BOOST_CHECK_THROW( thread_pools::parse( "sigcheck" ), fc::exception );
+   BOOST_CHECK_THROW( thread_pools::parse( "=4" ), fc::exception );
+   BOOST_CHECK_THROW( thread_pools::parse( "api=two" ), fc::exception );
+
+   thread_pools pools;
+   pools.configure( "api", thread_pools::parse( "api=2" ).second );
+   // The configured size wins over the default, and the same threads are handed to everyone asking
+   BOOST_CHECK_EQUAL( pools.get( "api", 5 ).size(), 2u );
+   BOOST_CHECK( pools.get( "api" )[1] == pools.get( "api", 5 )[1] );
+   BOOST_CHECK_EQUAL( pools.get( "api" )[1]->name(), "api 1" );
+   BOOST_CHECK_THROW( pools.configure( "api", thread_pools::pool_config() ), fc::exception );
+   BOOST_CHECK_EQUAL( pools.get( "worker", 3 ).size(), 3u );
+   BOOST_CHECK( pools.get( "sigcheck" ).empty() );
+   BOOST_CHECK_EQUAL( pools.describe(), "api=2, sigcheck=0, worker=3" );
+} FC_LOG_AND_RETHROW() }
+
+// The portable routines are checked at compile time, including the carries out of every partial product
+static_assert( graphene::chain::detail::portable_multiply( ~uint64_t(0), ~uint64_t(0) ) ==
+               graphene::chain::detail::portable_uint128{ ~uint64_t(0) - 1, 1 }, "" );
+static_assert( graphene::chain::detail::portable_multiply( uint64_t(1) << 32, uint64_t(1) << 32 ) ==
+               graphene::chain::detail::portable_uint128{ 1, 0 }, "" );
+static_assert( graphene::chain::detail::portable_divide(
+                  graphene::chain::detail::portable_multiply( GRAPHENE_MAX_SHARE_SUPPLY, GRAPHENE_100_PERCENT ), 3 ).quotient
+               == uint64_t(GRAPHENE_MAX_SHARE_SUPPLY) * GRAPHENE_100_PERCENT / 3, "" );
+static_assert( graphene::chain::detail::portable_divide( graphene::chain::detail::portable_uint128{ 2, 1 }, 3 ).remainder
+               == 0, "" );
+static_assert( !graphene::chain::detail::portable_quotient_fits(
+                  graphene::chain::detail::portable_multiply( ~uint64_t(0), 2 ), 1 ), "" );
+
+BOOST_AUTO_TEST_CASE( wide_arithmetic_matches_uint128 )
+{ try {
+   namespace detail = graphene::chain::detail;
+   std::mt19937_64 random( 42 );
+   // Shifting by a random amount gives small and large operands alike
+   auto next = [&]() -> uint64_t { uint64_t shift = random() % 64; return random() >> shift; };
+   for( int i = 0; i < 100000; ++i )
+   {
+      const uint64_t a = next(), b = next(), c = next(), d = next();
+      const uint64_t divisor = next() | 1;
+
+      BOOST_REQUIRE_EQUAL( multiply( a, b ) < multiply( c, d ),
+                           detail::portable_multiply( a, b ) < detail::portable_multiply( c, d ) );
+      BOOST_REQUIRE_EQUAL( multiply( a, b ) == multiply( c, d ),
+                           detail::portable_multiply( a, b ) == detail::portable_multiply( c, d ) );
+      BOOST_REQUIRE_EQUAL( multiply( a, b ) < multiply( c, d ), fc::uint128( a ) * b < fc::uint128( c ) * d );
+
+      const fc::uint128 expected = fc::uint128( a ) * b / divisor;
+      uint64_t quotient = 0, remainder = 0;
+      const bool fits = multiply_divide( a, b, divisor, quotient, &remainder );
+      BOOST_REQUIRE_EQUAL( fits, expected <= fc::uint128( ~uint64_t(0) ) );
+      BOOST_REQUIRE_EQUAL( fits, detail::portable_quotient_fits( detail::portable_multiply( a, b ), divisor ) );
+      if( fits )
+      {
+         BOOST_REQUIRE_EQUAL( quotient, expected.to_uint64() );
+         BOOST_REQUIRE_EQUAL( remainder, (fc::uint128( a ) * b - expected * divisor).to_uint64() );
+         const auto portable = detail::portable_divide( detail::portable_multiply( a, b ), divisor );
+         BOOST_REQUIRE_EQUAL( portable.quotient, quotient );
+         BOOST_REQUIRE_EQUAL( portable.remainder, remainder );
+      }
+   }
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE( witness_rng_test_bits )
 {
    try
@@ -212,6 +504,17 @@ BOOST_AUTO_TEST_CASE( witness_rng_test_bits )
          }
       }
 
+      // Batched draws are the draws one at a time would have been
+      hash_ctr_rng< fc::sha256, 32 > single_rng( seed.data(), 5 ), batch_rng( seed.data(), 5 );
+      for( uint64_t bound : { uint64_t(0), uint64_t(1), uint64_t(7), uint64_t(101), uint64_t(1) << 40 } )
+      {
+         uint64_t draws[37];
+         batch_rng.draw( bound, draws, 37 );
+         for( uint64_t draw : draws )
+            BOOST_CHECK_EQUAL( draw, single_rng( bound ) );
+      }
+      BOOST_CHECK_EQUAL( batch_rng.get_bits( 64 ), single_rng.get_bits( 64 ) );
+
    } FC_LOG_AND_RETHROW()
 }
 
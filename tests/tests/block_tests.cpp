@@ -20,6 +20,7 @@
 
 #include <graphene/chain/database.hpp>
 #include <graphene/chain/operations.hpp>
+#include <graphene/chain/block_view.hpp>
 
 #include <graphene/chain/account_object.hpp>
 #include <graphene/chain/delegate_object.hpp>
@@ -27,10 +28,14 @@
 #include <graphene/chain/limit_order_object.hpp>
 #include <graphene/chain/proposal_object.hpp>
 #include <graphene/chain/short_order_object.hpp>
+#include <graphene/chain/transaction_object.hpp>
+#include <graphene/chain/vesting_balance_object.hpp>
 #include <graphene/chain/witness_schedule_object.hpp>
 
 #include <fc/crypto/digest.hpp>
 
+#include <fstream>
+
 #include "../common/database_fixture.hpp"
 
 using namespace graphene::chain;
@@ -196,123 +201,1238 @@ BOOST_AUTO_TEST_CASE( fork_blocks )
    }
 }
 
-BOOST_AUTO_TEST_CASE( undo_pending )
+BOOST_AUTO_TEST_CASE( push_blocks )
+{
+   try {
+      fc::temp_directory data_dir1;
+      fc::temp_directory data_dir2;
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+
+      database db1;
+      db1.open( data_dir1.path(), genesis_allocation() );
+      database db2;
+      db2.open( data_dir2.path(), genesis_allocation() );
+
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      vector<signed_block> blocks;
+      for( uint32_t i = 0; i < 30; ++i )
+      {
+         now += db1.block_interval();
+         blocks.push_back( db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key ) );
+      }
+      vector<const signed_block*> run;
+      for( const signed_block& b : blocks )
+         run.push_back( &b );
+      BOOST_CHECK_EQUAL( db2.push_blocks( run ), 30 );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+
+      // The blocks of the run can still be built on
+      now += db1.block_interval();
+      db2.push_block( db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key ) );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+
+      // A run stops at the first block which fails
+      blocks.clear();
+      for( uint32_t i = 0; i < 5; ++i )
+      {
+         now += db1.block_interval();
+         blocks.push_back( db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key ) );
+      }
+      blocks[2].transactions.emplace_back( signed_transaction() );
+      blocks[2].transactions.back().operations.emplace_back( transfer_operation() );
+      blocks[2].sign( delegate_priv_key );
+      run.clear();
+      for( const signed_block& b : blocks )
+         run.push_back( &b );
+      BOOST_CHECK_EQUAL( db2.push_blocks( run ), 2 );
+      BOOST_CHECK( db2.head_block_id() == blocks[1].id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( undo_pending )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory data_dir;
+      {
+         database db;
+         db.open(data_dir.path());
+
+         auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+         const graphene::db::index& account_idx = db.get_index(protocol_ids, account_object_type);
+
+         {
+            signed_transaction trx;
+            trx.set_expiration(db.head_block_time() + fc::minutes(1));
+            trx.operations.push_back(transfer_operation({asset(), account_id_type(), account_id_type(1), asset(10000000)}));
+            db.push_transaction(trx, ~0);
+
+            now += db.block_interval();
+            auto b = db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key, ~0 );
+         }
+
+         signed_transaction trx;
+         trx.set_expiration( now + db.get_global_properties().parameters.maximum_time_until_expiration );
+         account_id_type nathan_id = account_idx.get_next_id();
+         account_create_operation cop;
+         cop.registrar = account_id_type(1);
+         cop.name = "nathan";
+         cop.owner = authority(1, key_id_type(), 1);
+         trx.operations.push_back(cop);
+         trx.sign( key_id_type(), delegate_priv_key );
+         db.push_transaction(trx);
+
+         now += db.block_interval();
+         auto b = db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key );
+
+         BOOST_CHECK(nathan_id(db).name == "nathan");
+
+         trx.clear();
+         trx.set_expiration(db.head_block_time() + db.get_global_properties().parameters.maximum_time_until_expiration-1);
+         trx.operations.push_back(transfer_operation({asset(1),account_id_type(1), nathan_id, asset(5000)}));
+         trx.sign( key_id_type(), delegate_priv_key );
+         db.push_transaction(trx);
+         trx.clear();
+         trx.set_expiration(db.head_block_time() + db.get_global_properties().parameters.maximum_time_until_expiration-2);
+         trx.operations.push_back(transfer_operation({asset(1),account_id_type(1), nathan_id, asset(5000)}));
+         trx.sign( key_id_type(), delegate_priv_key );
+         db.push_transaction(trx);
+
+         BOOST_CHECK(db.get_balance(nathan_id, asset_id_type()).amount == 10000);
+         db.clear_pending();
+         BOOST_CHECK(db.get_balance(nathan_id, asset_id_type()).amount == 0);
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( switch_forks_undo_create )
+{
+   try {
+      fc::temp_directory dir1,
+                         dir2;
+      database db1,
+               db2;
+      db1.open(dir1.path());
+      db2.open(dir2.path());
+
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      const graphene::db::index& account_idx = db1.get_index(protocol_ids, account_object_type);
+
+      signed_transaction trx;
+      trx.set_expiration(now + db1.get_global_properties().parameters.maximum_time_until_expiration);
+      account_id_type nathan_id = account_idx.get_next_id();
+      account_create_operation cop;
+      cop.registrar = account_id_type(1);
+      cop.name = "nathan";
+      cop.owner = authority(1, key_id_type(), 1);
+      trx.operations.push_back(cop);
+      trx.sign( key_id_type(), delegate_priv_key );
+      db1.push_transaction(trx);
+
+      auto aw = db1.get_global_properties().active_witnesses;
+      now += db1.block_interval();
+      auto b =  db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key );
+
+      BOOST_CHECK(nathan_id(db1).name == "nathan");
+
+      now = fc::time_point_sec( GRAPHENE_GENESIS_TIMESTAMP );
+      now += db2.block_interval();
+      b =  db2.generate_block( now, db2.get_scheduled_witness( 1 ).first, delegate_priv_key );
+      db1.push_block(b);
+      aw = db2.get_global_properties().active_witnesses;
+      now += db2.block_interval();
+      b =  db2.generate_block( now, db2.get_scheduled_witness( 1 ).first, delegate_priv_key );
+      db1.push_block(b);
+
+      BOOST_CHECK_THROW(nathan_id(db1), fc::exception);
+
+      db2.push_transaction(trx);
+
+      aw = db2.get_global_properties().active_witnesses;
+      now += db2.block_interval();
+      b =  db2.generate_block( now, db2.get_scheduled_witness( 1 ).first, delegate_priv_key );
+      db1.push_block(b);
+
+      BOOST_CHECK(nathan_id(db1).name == "nathan");
+      BOOST_CHECK(nathan_id(db2).name == "nathan");
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( duplicate_transactions )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory dir1,
+                         dir2;
+      database db1,
+               db2;
+      db1.open(dir1.path());
+      db2.open(dir2.path());
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      const graphene::db::index& account_idx = db1.get_index(protocol_ids, account_object_type);
+
+      signed_transaction trx;
+      trx.set_expiration(db1.head_block_time() + fc::minutes(1));
+      account_id_type nathan_id = account_idx.get_next_id();
+      account_create_operation cop;
+      cop.name = "nathan";
+      cop.owner = authority(1, key_id_type(), 1);
+      trx.operations.push_back(cop);
+      trx.sign( key_id_type(), delegate_priv_key );
+      db1.push_transaction(trx, skip_sigs);
+
+      trx = decltype(trx)();
+      trx.set_expiration(db1.head_block_time() + fc::minutes(1));
+      trx.operations.push_back(transfer_operation({asset(), account_id_type(), nathan_id, asset(500)}));
+      trx.sign( key_id_type(), delegate_priv_key );
+      db1.push_transaction(trx, skip_sigs);
+
+      BOOST_CHECK_THROW(db1.push_transaction(trx, skip_sigs), fc::exception);
+
+      now += db1.block_interval();
+      auto b = db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key, skip_sigs );
+      db2.push_block(b, skip_sigs);
+
+      BOOST_CHECK_THROW(db1.push_transaction(trx, skip_sigs), fc::exception);
+      BOOST_CHECK_THROW(db2.push_transaction(trx, skip_sigs), fc::exception);
+      BOOST_CHECK_EQUAL(db1.get_balance(nathan_id, asset_id_type()).amount.value, 500);
+      BOOST_CHECK_EQUAL(db2.get_balance(nathan_id, asset_id_type()).amount.value, 500);
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( pending_transactions_survive_blocks )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory dir1,
+                         dir2;
+      database db1,
+               db2;
+      db1.open(dir1.path());
+      db2.open(dir2.path());
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+
+      auto initial_balance = db1.get_balance(account_id_type(1), asset_id_type()).amount.value;
+      signed_transaction trx;
+      trx.set_expiration(db1.head_block_time() + fc::minutes(1));
+      trx.operations.push_back(transfer_operation({asset(), account_id_type(), account_id_type(1), asset(500)}));
+      trx.sign( key_id_type(), delegate_priv_key );
+      db1.push_transaction(trx, skip_sigs);
+      BOOST_CHECK_EQUAL(db1.get_pending_transactions().size(), 1);
+
+      // A block without the transaction leaves it pending, applied on the new head
+      now += db2.block_interval();
+      auto b = db2.generate_block( now, db2.get_scheduled_witness( 1 ).first, delegate_priv_key, skip_sigs );
+      db1.push_block(b, skip_sigs);
+      BOOST_CHECK_EQUAL(db1.get_pending_transactions().size(), 1);
+      BOOST_CHECK_EQUAL(db1.get_balance(account_id_type(1), asset_id_type()).amount.value, initial_balance + 500);
+
+      // Once it is in a block, it is no longer pending
+      now += db1.block_interval();
+      b = db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key, skip_sigs );
+      BOOST_CHECK_EQUAL(b.transactions.size(), 1);
+      BOOST_CHECK_EQUAL(db1.get_pending_transactions().size(), 0);
+
+      trx = decltype(trx)();
+      trx.set_expiration(db1.head_block_time() + fc::minutes(1));
+      trx.operations.push_back(transfer_operation({asset(), account_id_type(), account_id_type(1), asset(700)}));
+      trx.sign( key_id_type(), delegate_priv_key );
+      db1.push_transaction(trx, skip_sigs);
+      BOOST_CHECK_EQUAL(db1.get_pending_transactions().size(), 1);
+      db1.clear_pending();
+      BOOST_CHECK_EQUAL(db1.get_pending_transactions().size(), 0);
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( prioritize_transactions_by_fee )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory dir;
+      database db;
+      db.open(dir.path());
+      db.set_prioritize_transactions_by_fee(true);
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      auto push_transfer = [&]( account_id_type from, account_id_type to, share_type fee, share_type amount ) {
+         signed_transaction trx;
+         trx.set_expiration(db.head_block_time() + fc::minutes(1));
+         trx.operations.push_back(transfer_operation({asset(fee), from, to, asset(amount)}));
+         trx.sign( key_id_type(), delegate_priv_key );
+         db.push_transaction(trx, skip_sigs);
+      };
+
+      // Give account 1 something to pay fees with
+      push_transfer( account_id_type(), account_id_type(1), 0, 10000 );
+      now += db.block_interval();
+      db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key, skip_sigs );
+
+      push_transfer( account_id_type(), account_id_type(1), 0, 100 );
+      push_transfer( account_id_type(), account_id_type(1), 50, 200 );
+      push_transfer( account_id_type(1), account_id_type(), 50, 300 );
+
+      // The higher fee goes first, but an account's second transaction waits for every account's first
+      now += db.block_interval();
+      auto b = db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key, skip_sigs );
+      BOOST_REQUIRE_EQUAL(b.transactions.size(), 3);
+      BOOST_CHECK_EQUAL(b.transactions[0].operations[0].get<transfer_operation>().amount.amount.value, 300);
+      BOOST_CHECK_EQUAL(b.transactions[1].operations[0].get<transfer_operation>().amount.amount.value, 100);
+      BOOST_CHECK_EQUAL(b.transactions[2].operations[0].get<transfer_operation>().amount.amount.value, 200);
+      BOOST_CHECK_EQUAL(db.get_pending_transactions().size(), 0);
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( prepared_blocks )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory dir;
+      database db;
+      db.open(dir.path());
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      auto push_transfer = [&]( share_type amount ) {
+         signed_transaction trx;
+         trx.set_expiration(db.head_block_time() + fc::minutes(1));
+         trx.operations.push_back(transfer_operation({asset(), account_id_type(), account_id_type(1), asset(amount)}));
+         trx.sign( key_id_type(), delegate_priv_key );
+         db.push_transaction(trx, skip_sigs);
+      };
+      auto initial_balance = db.get_balance(account_id_type(1), asset_id_type()).amount.value;
+
+      // A transaction pushed after the block was built waits for the next block
+      push_transfer( 100 );
+      now += db.block_interval();
+      auto b = db.build_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key, skip_sigs );
+      push_transfer( 200 );
+      BOOST_CHECK_EQUAL(db.head_block_num(), 0);
+      db.push_generated_block( b, skip_sigs );
+      BOOST_CHECK_EQUAL(db.head_block_id().str(), b.id().str());
+      BOOST_CHECK_EQUAL(b.transactions.size(), 1);
+      BOOST_CHECK_EQUAL(db.get_pending_transactions().size(), 1);
+      BOOST_CHECK_EQUAL(db.get_balance(account_id_type(1), asset_id_type()).amount.value, initial_balance + 300);
+
+      // A block built on a head which has since moved on can not be pushed
+      now += db.block_interval();
+      auto stale = db.build_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key, skip_sigs );
+      db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key, skip_sigs );
+      BOOST_CHECK_THROW( db.push_generated_block( stale, skip_sigs ), fc::exception );
+      BOOST_CHECK_EQUAL(db.get_pending_transactions().size(), 0);
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( generate_block_keeps_pending_state )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory dir1,
+                         dir2;
+      database db1,
+               db2;
+      db1.open(dir1.path());
+      db2.open(dir2.path());
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      auto push_transfer = [&]( share_type amount ) {
+         signed_transaction trx;
+         trx.set_expiration(db1.head_block_time() + fc::minutes(1));
+         trx.operations.push_back(transfer_operation({asset(), account_id_type(), account_id_type(1), asset(amount)}));
+         trx.sign( key_id_type(), delegate_priv_key );
+         db1.push_transaction(trx, skip_sigs);
+      };
+
+      // A transaction which fails leaves no operation behind for the block
+      push_transfer( 100 );
+      BOOST_CHECK_THROW( push_transfer( GRAPHENE_MAX_SHARE_SUPPLY ), fc::exception );
+      push_transfer( 200 );
+
+      vector<operation_history_object> applied_ops;
+      db1.add_applied_operations_consumer();
+      db1.applied_block.connect( [&]( const signed_block& ) { applied_ops = db1.get_applied_operations(); } );
+      now += db1.block_interval();
+      auto b = db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key, skip_sigs );
+      BOOST_REQUIRE_EQUAL(b.transactions.size(), 2);
+      BOOST_REQUIRE_EQUAL(applied_ops.size(), 2);
+      BOOST_CHECK_EQUAL(applied_ops[0].block_num, 1);
+      BOOST_CHECK_EQUAL(applied_ops[0].trx_in_block, 0);
+      BOOST_CHECK_EQUAL(applied_ops[1].trx_in_block, 1);
+      BOOST_CHECK_EQUAL(db1.get_pending_transactions().size(), 0);
+
+      // The block applies to the same state from scratch
+      db2.push_block(b, skip_sigs);
+      BOOST_CHECK_EQUAL(db2.head_block_id().str(), db1.head_block_id().str());
+      BOOST_CHECK_EQUAL(db1.get_balance(account_id_type(1), asset_id_type()).amount.value,
+                        db2.get_balance(account_id_type(1), asset_id_type()).amount.value);
+      BOOST_CHECK_EQUAL(db1.get_dynamic_global_properties().head_block_number,
+                        db2.get_dynamic_global_properties().head_block_number);
+
+      // And is undone like any other
+      db1.pop_block();
+      BOOST_CHECK_EQUAL(db1.head_block_num(), 0);
+      BOOST_CHECK_EQUAL(db1.get_balance(account_id_type(1), asset_id_type()).amount.value,
+                        db2.get_balance(account_id_type(1), asset_id_type()).amount.value - 300);
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( parallel_signature_recovery )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory dir1,
+                         dir2;
+      database db1,
+               db2;
+      db1.open(dir1.path());
+      db2.open(dir2.path());
+      db2.set_signature_thread_count(4);
+
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         signed_transaction trx;
+         trx.set_expiration(db1.head_block_time() + fc::minutes(1));
+         account_create_operation cop;
+         cop.registrar = account_id_type(1);
+         cop.name = "nathan" + fc::to_string(i);
+         cop.owner = authority(1, key_id_type(), 1);
+         trx.operations.push_back(cop);
+         trx.sign( key_id_type(), delegate_priv_key );
+         db1.push_transaction(trx);
+      }
+
+      now += db1.block_interval();
+      auto b = db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key );
+      BOOST_CHECK_EQUAL( b.transactions.size(), 10 );
+      db2.push_block(b);
+      BOOST_CHECK( db2.head_block_id() == b.id() );
+
+      // A transaction signed with the wrong key must not slip through the worker threads
+      signed_transaction trx;
+      trx.set_expiration(db1.head_block_time() + fc::minutes(1));
+      account_create_operation cop;
+      cop.registrar = account_id_type(1);
+      cop.name = "forged";
+      cop.owner = authority(1, key_id_type(), 1);
+      trx.operations.push_back(cop);
+      trx.sign( key_id_type(), fc::ecc::private_key::generate() );
+      db1.push_transaction(trx, database::skip_transaction_signatures);
+
+      now += db1.block_interval();
+      b = db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key );
+      BOOST_CHECK_THROW( db2.push_block(b), fc::exception );
+      BOOST_CHECK( db2.head_block_id() == b.previous );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( transaction_conflicts )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory dir1,
+                         dir2;
+      database db1,
+               db2;
+      db1.open(dir1.path());
+      db2.open(dir2.path());
+      db2.set_transaction_conflict_tracking( true );
+
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      const graphene::db::index& account_idx = db1.get_index(protocol_ids, account_object_type);
+      vector<account_id_type> accounts;
+      for( uint32_t i = 0; i < 3; ++i )
+      {
+         signed_transaction trx;
+         trx.set_expiration(db1.head_block_time() + fc::minutes(1));
+         accounts.push_back( account_idx.get_next_id() );
+         account_create_operation cop;
+         cop.registrar = account_id_type(1);
+         cop.name = "nathan" + fc::to_string(i);
+         cop.owner = authority(1, key_id_type(), 1);
+         trx.operations.push_back(cop);
+         trx.sign( key_id_type(), delegate_priv_key );
+         db1.push_transaction(trx);
+      }
+      // Both transfers debit the genesis balance, so the second one conflicts with the first
+      for( uint32_t i = 0; i < 2; ++i )
+      {
+         signed_transaction trx;
+         trx.set_expiration(db1.head_block_time() + fc::minutes(1));
+         trx.operations.push_back(transfer_operation({asset(), account_id_type(), accounts[i], asset(500)}));
+         trx.sign( key_id_type(), delegate_priv_key );
+         db1.push_transaction(trx);
+      }
+
+      now += db1.block_interval();
+      auto b = db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key );
+      BOOST_CHECK_EQUAL( b.transactions.size(), 5 );
+      db2.push_block(b);
+      BOOST_CHECK( db2.head_block_id() == b.id() );
+      BOOST_CHECK_EQUAL( db2.get_balance(accounts[1], asset_id_type()).amount.value, 500 );
+
+      const transaction_conflict_stats& stats = db2.get_transaction_conflict_stats();
+      BOOST_CHECK_EQUAL( stats.blocks, 1 );
+      BOOST_CHECK_EQUAL( stats.transactions, 5 );
+      BOOST_CHECK_EQUAL( stats.conflicting_transactions, 1 );
+      BOOST_CHECK_GT( stats.objects_written, 5 );
+      // The transfers credit accounts created earlier in the block, so the scheduler must keep them together
+      BOOST_CHECK_GE( stats.scheduled_stages, 1 );
+      BOOST_CHECK_GE( stats.scheduled_groups, 1 );
+      BOOST_CHECK_EQUAL( stats.footprint_misses, 0 );
+      // The block built by db1 was not applied transaction by transaction
+      BOOST_CHECK_EQUAL( db1.get_transaction_conflict_stats().transactions, 0 );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( batch_signature_verification )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory dir1,
+                         dir2;
+      database db1,
+               db2;
+      db1.open(dir1.path());
+      db2.open(dir2.path());
+      db2.set_signature_thread_count(2);
+      db2.set_batch_signature_verification(true);
+
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      auto make_trx = [&]( const string& name, const fc::ecc::private_key& key ) {
+         signed_transaction trx;
+         trx.set_expiration(db1.head_block_time() + fc::minutes(1));
+         account_create_operation cop;
+         cop.registrar = account_id_type(1);
+         cop.name = name;
+         cop.owner = authority(1, key_id_type(), 1);
+         trx.operations.push_back(cop);
+         trx.sign( key_id_type(), key );
+         return trx;
+      };
+
+      for( uint32_t i = 0; i < 5; ++i )
+         db1.push_transaction( make_trx( "nathan" + fc::to_string(i), delegate_priv_key ) );
+      now += db1.block_interval();
+      auto b = db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key );
+      db2.push_block(b);
+      BOOST_CHECK( db2.head_block_id() == b.id() );
+
+      // Signatures by the wrong key recover fine, so they must still be caught against the expected keys
+      db1.push_transaction( make_trx( "forged", fc::ecc::private_key::generate() ), database::skip_transaction_signatures );
+      now += db1.block_interval();
+      b = db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key );
+      BOOST_CHECK_THROW( db2.push_block(b), fc::exception );
+      BOOST_CHECK( db2.head_block_id() == b.previous );
+
+      // The same goes for a block signed by the wrong witness key
+      db1.pop_block();
+      b = db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key );
+      b.sign( fc::ecc::private_key::generate() );
+      BOOST_CHECK_THROW( db2.push_block(b), fc::exception );
+      BOOST_CHECK( db2.head_block_id() == b.previous );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( precheck_transaction )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory dir;
+      database db;
+      db.open(dir.path());
+      db.set_signature_thread_count(2);
+
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      now += db.block_interval();
+      db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key );
+
+      signed_transaction trx;
+      trx.set_expiration(db.head_block_time() + fc::minutes(1));
+      account_create_operation cop;
+      cop.registrar = account_id_type(1);
+      cop.name = "nathan";
+      cop.owner = authority(1, key_id_type(), 1);
+      trx.operations.push_back(cop);
+      trx.sign( key_id_type(), delegate_priv_key );
+      db.precheck_transaction(trx);
+
+      // The signature recovered by the precheck is reused when the transaction is pushed
+      auto misses = db.get_signature_cache_stats().misses;
+      db.push_transaction(trx);
+      BOOST_CHECK_EQUAL( db.get_signature_cache_stats().misses, misses );
+
+      signed_transaction forged = trx;
+      forged.sign( key_id_type(), fc::ecc::private_key::generate() );
+      BOOST_CHECK_THROW( db.precheck_transaction(forged), fc::exception );
+
+      signed_transaction expired = trx;
+      expired.set_expiration(db.head_block_time() - fc::minutes(1));
+      expired.sign( key_id_type(), delegate_priv_key );
+      BOOST_CHECK_THROW( db.precheck_transaction(expired), fc::exception );
+
+      signed_transaction bad_reference = trx;
+      bad_reference.set_expiration( block_id_type(), 3 );
+      bad_reference.sign( key_id_type(), delegate_priv_key );
+      BOOST_CHECK_THROW( db.precheck_transaction(bad_reference), fc::exception );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( precheck_block )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory dir1,
+                         dir2;
+      database db1,
+               db2;
+      db1.open(dir1.path());
+      db2.open(dir2.path());
+
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      now += db1.block_interval();
+      db2.push_block( db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key ) );
+
+      signed_transaction trx;
+      trx.set_expiration(db1.head_block_time() + fc::minutes(1));
+      account_create_operation cop;
+      cop.registrar = account_id_type(1);
+      cop.name = "nathan";
+      cop.owner = authority(1, key_id_type(), 1);
+      trx.operations.push_back(cop);
+      trx.sign( key_id_type(), delegate_priv_key );
+      db1.push_transaction(trx);
+      now += db1.block_interval();
+      auto b = db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key );
+
+      // A block carrying the same transaction twice is rejected without being applied
+      signed_block duplicate = b;
+      duplicate.transactions.push_back( trx );
+      duplicate.transaction_merkle_root = duplicate.calculate_merkle_root();
+      duplicate.sign( delegate_priv_key );
+      BOOST_CHECK_THROW( db2.push_block( duplicate ), fc::exception );
+
+      signed_block expired = b;
+      expired.transactions[0].set_expiration( db2.head_block_time() - fc::minutes(1) );
+      expired.transactions[0].sign( key_id_type(), delegate_priv_key );
+      expired.transaction_merkle_root = expired.calculate_merkle_root();
+      expired.sign( delegate_priv_key );
+      BOOST_CHECK_THROW( db2.push_block( expired ), fc::exception );
+
+      BOOST_CHECK_EQUAL( db2.head_block_num(), 1 );
+
+      db2.push_block( b );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( open_from_snapshot )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory dir1,
+                         dir2;
+      database db1,
+               db2;
+      db1.open(dir1.path());
+
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      signed_transaction trx;
+      trx.set_expiration(db1.head_block_time() + fc::minutes(1));
+      account_create_operation cop;
+      cop.registrar = account_id_type(1);
+      cop.name = "nathan";
+      cop.owner = authority(1, key_id_type(), 1);
+      trx.operations.push_back(cop);
+      trx.sign( key_id_type(), delegate_priv_key );
+      db1.push_transaction(trx);
+      for( int i = 0; i < 3; ++i )
+      {
+         now += db1.block_interval();
+         db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key );
+      }
+
+      // A pending transaction is left out of the snapshot, but stays pending
+      trx.clear();
+      trx.set_expiration(db1.head_block_time() + fc::minutes(1));
+      cop.name = "sam";
+      trx.operations.push_back(cop);
+      trx.sign( key_id_type(), delegate_priv_key );
+      db1.push_transaction(trx);
+
+      auto snapshot_file = dir1.path() / "snapshot.bin";
+      db1.snapshot( snapshot_file );
+      const auto& db1_accounts = db1.get_index_type<account_index>().indices().get<by_name>();
+      BOOST_CHECK( db1_accounts.find( "sam" ) != db1_accounts.end() );
+
+      db2.open_from_snapshot( snapshot_file, dir2.path() );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+      const auto& accounts = db2.get_index_type<account_index>().indices().get<by_name>();
+      BOOST_CHECK( accounts.find( "nathan" ) != accounts.end() );
+      BOOST_CHECK( accounts.find( "sam" ) == accounts.end() );
+
+      // The node carries on from the snapshot like any other
+      now += db1.block_interval();
+      db2.push_block( db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key ) );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+      BOOST_CHECK( accounts.find( "sam" ) != accounts.end() );
+
+      // A damaged snapshot is refused
+      {
+         std::fstream f( snapshot_file.generic_string(), std::ios::in | std::ios::out | std::ios::binary );
+         f.seekg( -1, std::ios::end );
+         char last = f.get();
+         f.seekp( -1, std::ios::end );
+         f.put( last ^ 1 );
+      }
+      database db3;
+      fc::temp_directory dir3;
+      BOOST_CHECK_THROW( db3.open_from_snapshot( snapshot_file, dir3.path() ), fc::exception );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( open_in_memory )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      database db1,
+               db2;
+      db1.open_in_memory();
+      BOOST_CHECK( db1.find( global_property_id_type() ) != nullptr );
+
+      vector<signed_block> blocks;
+      for( int i = 0; i < 5; ++i )
+      {
+         now += db1.block_interval();
+         blocks.push_back( db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key ) );
+      }
+      BOOST_CHECK_EQUAL( db1.head_block_num(), 5u );
+      BOOST_REQUIRE( db1.fetch_block_by_number( 3 ) );
+      BOOST_CHECK( db1.fetch_block_by_number( 3 )->id() == blocks[2].id() );
+
+      // Popped blocks are dropped from the in memory block database like from the files
+      db1.pop_block();
+      BOOST_CHECK_EQUAL( db1.head_block_num(), 4u );
+      BOOST_CHECK( !db1.fetch_block_by_number( 5 ) );
+      now += db1.block_interval();
+      db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key );
+      BOOST_CHECK_EQUAL( db1.head_block_num(), 5u );
+
+      fc::temp_directory dir;
+      auto snapshot_file = dir.path() / "snapshot.bin";
+      db1.snapshot( snapshot_file );
+      db2.open_in_memory_from_snapshot( snapshot_file );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+
+      now += db1.block_interval();
+      db2.push_block( db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key ) );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( resume_from_checkpoint )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory data_dir;
+      auto delegate_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      block_id_type head_id;
+      {
+         database db;
+         db.set_checkpoint_interval( 4 );
+         db.open( data_dir.path() );
+         db._undo_db.set_max_size( 3 );
+         for( uint32_t i = 0; i < 20; ++i )
+         {
+            now += db.block_interval();
+            db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key );
+         }
+
+         // The checkpoint of a popped block is never written
+         db.pop_block();
+         BOOST_CHECK_EQUAL( db.head_block_num(), 19 );
+         db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key );
+         head_id = db.head_block_id();
+         // Leave without closing, as if the node had crashed
+      }
+      {
+         database db;
+         db.open( data_dir.path() );
+         BOOST_CHECK_EQUAL( db.head_block_num(), 20 );
+         BOOST_CHECK( db.head_block_id() == head_id );
+
+         now += db.block_interval();
+         db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key );
+         BOOST_CHECK_EQUAL( db.head_block_num(), 21 );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( resume_from_synced_checkpoint )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory data_dir;
+      auto delegate_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      block_id_type head_id;
+      {
+         database db;
+         db.set_checkpoint_interval( 4 );
+         // Checkpoints wait for the sync every 8 blocks to be written
+         db.set_sync_interval( 8, 0 );
+         db.open( data_dir.path() );
+         db._undo_db.set_max_size( 3 );
+         for( uint32_t i = 0; i < 21; ++i )
+         {
+            now += db.block_interval();
+            db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key );
+         }
+         head_id = db.head_block_id();
+         db.wait_for_writes();
+         // Leave without closing, as if the node had crashed
+      }
+      {
+         database db;
+         db.open( data_dir.path() );
+         BOOST_CHECK_EQUAL( db.head_block_num(), 21 );
+         BOOST_CHECK( db.head_block_id() == head_id );
+
+         now += db.block_interval();
+         db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key );
+         BOOST_CHECK_EQUAL( db.head_block_num(), 22 );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( replay_blocks )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory data_dir;
+      auto delegate_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      block_id_type head_id;
+      {
+         database db;
+         db.open( data_dir.path() );
+         // Enough blocks for the replay to read more than one batch
+         for( uint32_t i = 0; i < 1100; ++i )
+         {
+            now += db.block_interval();
+            db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key );
+         }
+         head_id = db.head_block_id();
+         db.close();
+      }
+      {
+         database db;
+         db.set_signature_thread_count( 2 );
+         db.set_trusted_replay( false );
+         db.reindex( data_dir.path(), genesis_allocation() );
+         BOOST_CHECK_EQUAL( db.head_block_num(), 1100 );
+         BOOST_CHECK( db.head_block_id() == head_id );
+
+         // The undo history is back on once the replay is over
+         now += db.block_interval();
+         db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key );
+         db.pop_block();
+         BOOST_CHECK( db.head_block_id() == head_id );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_checkpoints )
+{
+   try {
+      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
+      fc::temp_directory dir1, dir2, dir3;
+      auto delegate_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+      database db1;
+      db1.open( dir1.path() );
+      vector<signed_block> blocks;
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         now += db1.block_interval();
+         blocks.push_back( db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key ) );
+      }
+
+      database db2;
+      db2.add_block_checkpoints( { { 5, blocks[4].id() } } );
+      db2.open( dir2.path() );
+      BOOST_CHECK( db2.before_last_block_checkpoint( 5 ) );
+      BOOST_CHECK( !db2.before_last_block_checkpoint( 6 ) );
+      for( const auto& b : blocks )
+         db2.push_block( b );
+      BOOST_CHECK( db2.head_block_id() == db1.head_block_id() );
+
+      // A block which does not match its checkpoint is rejected
+      database db3;
+      db3.add_block_checkpoints( { { 5, blocks[3].id() } } );
+      db3.open( dir3.path() );
+      for( uint32_t i = 0; i < 4; ++i )
+         db3.push_block( blocks[i] );
+      BOOST_CHECK_THROW( db3.push_block( blocks[4] ), fc::exception );
+      BOOST_CHECK_EQUAL( db3.head_block_num(), 4 );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( fork_database_prune )
+{
+   try {
+      auto make_block = []( const signed_block& prev, uint32_t salt ) {
+         signed_block b;
+         b.previous = prev.id();
+         b.timestamp = prev.timestamp + 1 + salt;
+         return b;
+      };
+      fork_database fdb;
+      fdb.set_max_size( 4 );
+      vector<signed_block> chain( 1 );
+      chain[0].timestamp = fc::time_point_sec( GRAPHENE_GENESIS_TIMESTAMP );
+      fdb.start_block( chain[0] );
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         chain.push_back( make_block( chain.back(), 0 ) );
+         fdb.push_block( chain.back() );
+      }
+      BOOST_CHECK( fdb.head()->id == chain.back().id() );
+      // Every block more than 4 below the head is gone
+      for( uint32_t i = 0; i < chain.size(); ++i )
+         BOOST_CHECK_EQUAL( fdb.is_known_block( chain[i].id() ), i + 4 > 10 );
+
+      // A fork from block 8, and the branches down to their common ancestor
+      signed_block fork9 = make_block( chain[8], 1 );
+      signed_block fork10 = make_block( fork9, 0 );
+      signed_block fork11 = make_block( fork10, 0 );
+      fdb.push_block( fork9 );
+      fdb.push_block( fork10 );
+      BOOST_CHECK( fdb.head()->id == chain.back().id() );
+      fdb.push_block( fork11 );
+      BOOST_CHECK( fdb.head()->id == fork11.id() );
+      auto branches = fdb.fetch_branch_from( fork11.id(), chain.back().id() );
+      BOOST_REQUIRE_EQUAL( branches.first.size(), 3 );
+      BOOST_REQUIRE_EQUAL( branches.second.size(), 2 );
+      BOOST_CHECK( branches.first.back()->id == fork9.id() );
+      BOOST_CHECK( branches.second.back()->id == chain[9].id() );
+
+      // Removing a block removes the blocks built on it
+      fdb.remove( fork10.id() );
+      BOOST_CHECK( fdb.is_known_block( fork9.id() ) );
+      BOOST_CHECK( !fdb.is_known_block( fork11.id() ) );
+      fdb.set_head( fdb.fetch_block( chain.back().id() ) );
+      fdb.pop_block();
+      BOOST_CHECK( fdb.head()->id == chain[9].id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_store )
+{
+   try {
+      fc::temp_directory data_dir;
+      vector<signed_block> blocks;
+      {
+         block_database bdb;
+         bdb.open( data_dir.path() );
+         for( uint32_t i = 0; i < 10; ++i )
+         {
+            signed_block b;
+            b.previous = blocks.empty() ? block_id_type() : blocks.back().id();
+            b.timestamp = fc::time_point_sec( GRAPHENE_GENESIS_TIMESTAMP + i );
+            bdb.store( b.id(), b );
+            blocks.push_back( b );
+         }
+         BOOST_CHECK( bdb.last()->id() == blocks.back().id() );
+         bdb.close();
+      }
+
+      block_database bdb;
+      bdb.open( data_dir.path() );
+      for( const signed_block& b : blocks )
+      {
+         BOOST_CHECK( bdb.contains( b.id() ) );
+         BOOST_CHECK( bdb.fetch_block_id( b.block_num() ) == b.id() );
+         BOOST_CHECK( bdb.fetch_by_number( b.block_num() )->id() == b.id() );
+         BOOST_CHECK( bdb.fetch_optional( b.id() )->timestamp == b.timestamp );
+         vector<char> packed;
+         BOOST_CHECK( bdb.fetch_packed( b.id(), packed ) );
+         BOOST_CHECK( packed == fc::raw::pack( b ) );
+      }
+      BOOST_CHECK( !bdb.fetch_by_number( 11 ) );
+      vector<block_id_type> ids = bdb.fetch_block_ids( 3, 20 );
+      BOOST_REQUIRE_EQUAL( ids.size(), 8 );
+      BOOST_CHECK( ids.front() == blocks[2].id() );
+      BOOST_CHECK( ids.back() == blocks.back().id() );
+
+      // Storing a block on another fork drops the blocks after it
+      signed_block fork = blocks[4];
+      fork.timestamp += 100;
+      bdb.store( fork.id(), fork );
+      BOOST_CHECK( !bdb.contains( blocks[4].id() ) );
+      BOOST_CHECK( bdb.fetch_block_id( 5 ) == fork.id() );
+      BOOST_CHECK_EQUAL( bdb.fetch_block_ids( 1, 20 ).size(), 5 );
+      BOOST_CHECK( !bdb.fetch_by_number( 6 ) );
+      BOOST_CHECK( bdb.last()->id() == fork.id() );
+
+      bdb.remove( fork.id() );
+      BOOST_CHECK( bdb.last()->id() == blocks[3].id() );
+      BOOST_CHECK( bdb.fetch_optional( blocks[2].id() ).valid() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_compression )
+{
+   try {
+      fc::temp_directory data_dir;
+      vector<signed_block> blocks;
+      uint64_t packed_size = 0;
+      {
+         block_database bdb;
+         bdb.open( data_dir.path() );
+         for( uint32_t i = 0; i < 10; ++i )
+         {
+            // Compressed and uncompressed blocks are mixed
+            bdb.set_compression( i >= 5 );
+            signed_block b;
+            b.previous = blocks.empty() ? block_id_type() : blocks.back().id();
+            b.timestamp = fc::time_point_sec( GRAPHENE_GENESIS_TIMESTAMP + i );
+            processed_transaction trx;
+            for( uint32_t j = 0; j < 20; ++j )
+            {
+               transfer_operation op;
+               op.amount = asset( j );
+               trx.operations.push_back( op );
+            }
+            b.transactions.push_back( trx );
+            bdb.store( b.id(), b );
+            blocks.push_back( b );
+            packed_size += fc::raw::pack_size( b );
+         }
+         // The summaries of the blocks just stored come from memory
+         const auto summary = bdb.fetch_header_summary_by_number( 8 );
+         BOOST_REQUIRE( summary.valid() );
+         BOOST_CHECK( summary->header.id() == blocks[7].id() );
+         BOOST_CHECK_EQUAL( summary->transaction_count, 1 );
+         BOOST_CHECK_EQUAL( summary->size, fc::raw::pack_size( blocks[7] ) );
+         bdb.close();
+      }
+      BOOST_CHECK_LT( fc::file_size( data_dir.path() / "blocks" ), packed_size );
+
+      block_database bdb;
+      bdb.open( data_dir.path() );
+      for( const signed_block& b : blocks )
+      {
+         BOOST_CHECK( bdb.fetch_by_number( b.block_num() )->id() == b.id() );
+         vector<char> packed;
+         BOOST_CHECK( bdb.fetch_packed( b.id(), packed ) );
+         BOOST_CHECK( packed == fc::raw::pack( b ) );
+      }
+
+      // After reopening they are decoded from the blocks, compressed or not
+      for( uint32_t num : { 2, 8 } )
+      {
+         const auto summary = bdb.fetch_header_summary_by_number( num );
+         BOOST_REQUIRE( summary.valid() );
+         BOOST_CHECK( summary->header.id() == blocks[num - 1].id() );
+         BOOST_CHECK_EQUAL( summary->transaction_count, 1 );
+         BOOST_CHECK_EQUAL( summary->size, fc::raw::pack_size( blocks[num - 1] ) );
+      }
+      BOOST_CHECK( !bdb.fetch_header_summary_by_number( 11 ).valid() );
+
+      // Dropping compressed blocks truncates the file where they start
+      bdb.remove( blocks[7].id() );
+      BOOST_CHECK( bdb.last()->id() == blocks[6].id() );
+      signed_block fork = blocks[7];
+      fork.timestamp += 100;
+      bdb.set_compression( true );
+      bdb.store( fork.id(), fork );
+      BOOST_CHECK( bdb.fetch_optional( fork.id() )->timestamp == fork.timestamp );
+      BOOST_CHECK( bdb.fetch_optional( blocks[6].id() ).valid() );
+      BOOST_CHECK( bdb.fetch_header_by_number( 8 )->timestamp == fork.timestamp );
+      BOOST_CHECK( !bdb.fetch_header_summary_by_number( 9 ).valid() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_pruning )
 {
    try {
-      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
       fc::temp_directory data_dir;
+      vector<signed_block> blocks;
       {
-         database db;
-         db.open(data_dir.path());
-
-         auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
-         const graphene::db::index& account_idx = db.get_index(protocol_ids, account_object_type);
-
+         block_database bdb;
+         bdb.open( data_dir.path() );
+         bdb.set_pruning( 3 );
+         for( uint32_t i = 0; i < 10; ++i )
          {
-            signed_transaction trx;
-            trx.set_expiration(db.head_block_time() + fc::minutes(1));
-            trx.operations.push_back(transfer_operation({asset(), account_id_type(), account_id_type(1), asset(10000000)}));
-            db.push_transaction(trx, ~0);
-
-            now += db.block_interval();
-            auto b = db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key, ~0 );
+            signed_block b;
+            b.previous = blocks.empty() ? block_id_type() : blocks.back().id();
+            b.timestamp = fc::time_point_sec( GRAPHENE_GENESIS_TIMESTAMP + i );
+            bdb.store( b.id(), b );
+            blocks.push_back( b );
          }
+         BOOST_CHECK_EQUAL( bdb.pruned_below(), 8 );
+         bdb.close();
+      }
 
-         signed_transaction trx;
-         trx.set_expiration( now + db.get_global_properties().parameters.maximum_time_until_expiration );
-         account_id_type nathan_id = account_idx.get_next_id();
-         account_create_operation cop;
-         cop.registrar = account_id_type(1);
-         cop.name = "nathan";
-         cop.owner = authority(1, key_id_type(), 1);
-         trx.operations.push_back(cop);
-         trx.sign( key_id_type(), delegate_priv_key );
-         db.push_transaction(trx);
-
-         now += db.block_interval();
-         auto b = db.generate_block( now, db.get_scheduled_witness( 1 ).first, delegate_priv_key );
-
-         BOOST_CHECK(nathan_id(db).name == "nathan");
-
-         trx.clear();
-         trx.set_expiration(db.head_block_time() + db.get_global_properties().parameters.maximum_time_until_expiration-1);
-         trx.operations.push_back(transfer_operation({asset(1),account_id_type(1), nathan_id, asset(5000)}));
-         trx.sign( key_id_type(), delegate_priv_key );
-         db.push_transaction(trx);
-         trx.clear();
-         trx.set_expiration(db.head_block_time() + db.get_global_properties().parameters.maximum_time_until_expiration-2);
-         trx.operations.push_back(transfer_operation({asset(1),account_id_type(1), nathan_id, asset(5000)}));
-         trx.sign( key_id_type(), delegate_priv_key );
-         db.push_transaction(trx);
-
-         BOOST_CHECK(db.get_balance(nathan_id, asset_id_type()).amount == 10000);
-         db.clear_pending();
-         BOOST_CHECK(db.get_balance(nathan_id, asset_id_type()).amount == 0);
+      // Pruned blocks are still known by id, but only the last ones can be fetched, also after reopening
+      block_database bdb;
+      bdb.open( data_dir.path() );
+      BOOST_CHECK_EQUAL( bdb.pruned_below(), 8 );
+      for( const signed_block& b : blocks )
+      {
+         BOOST_CHECK( bdb.contains( b.id() ) );
+         BOOST_CHECK( bdb.fetch_block_id( b.block_num() ) == b.id() );
+         BOOST_CHECK_EQUAL( bdb.fetch_optional( b.id() ).valid(), b.block_num() >= 8 );
       }
+      BOOST_CHECK_EQUAL( bdb.fetch_block_ids( 1, 20 ).size(), 10 );
+      BOOST_CHECK( bdb.last()->id() == blocks.back().id() );
+
+      // Switching forks within the blocks kept still works
+      signed_block fork = blocks[8];
+      fork.timestamp += 100;
+      bdb.store( fork.id(), fork );
+      BOOST_CHECK( bdb.last()->id() == fork.id() );
+      BOOST_CHECK( bdb.fetch_optional( blocks[7].id() ).valid() );
    } catch (fc::exception& e) {
       edump((e.to_detail_string()));
       throw;
    }
 }
 
-BOOST_AUTO_TEST_CASE( switch_forks_undo_create )
+BOOST_AUTO_TEST_CASE( block_view )
 {
    try {
-      fc::temp_directory dir1,
-                         dir2;
-      database db1,
-               db2;
-      db1.open(dir1.path());
-      db2.open(dir2.path());
-
-      fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
-      auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
-      const graphene::db::index& account_idx = db1.get_index(protocol_ids, account_object_type);
-
-      signed_transaction trx;
-      trx.set_expiration(now + db1.get_global_properties().parameters.maximum_time_until_expiration);
-      account_id_type nathan_id = account_idx.get_next_id();
-      account_create_operation cop;
-      cop.registrar = account_id_type(1);
-      cop.name = "nathan";
-      cop.owner = authority(1, key_id_type(), 1);
-      trx.operations.push_back(cop);
-      trx.sign( key_id_type(), delegate_priv_key );
-      db1.push_transaction(trx);
-
-      auto aw = db1.get_global_properties().active_witnesses;
-      now += db1.block_interval();
-      auto b =  db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key );
-
-      BOOST_CHECK(nathan_id(db1).name == "nathan");
-
-      now = fc::time_point_sec( GRAPHENE_GENESIS_TIMESTAMP );
-      now += db2.block_interval();
-      b =  db2.generate_block( now, db2.get_scheduled_witness( 1 ).first, delegate_priv_key );
-      db1.push_block(b);
-      aw = db2.get_global_properties().active_witnesses;
-      now += db2.block_interval();
-      b =  db2.generate_block( now, db2.get_scheduled_witness( 1 ).first, delegate_priv_key );
-      db1.push_block(b);
-
-      BOOST_CHECK_THROW(nathan_id(db1), fc::exception);
-
-      db2.push_transaction(trx);
-
-      aw = db2.get_global_properties().active_witnesses;
-      now += db2.block_interval();
-      b =  db2.generate_block( now, db2.get_scheduled_witness( 1 ).first, delegate_priv_key );
-      db1.push_block(b);
+      fc::ecc::private_key signer = fc::ecc::private_key::regenerate( fc::sha256::hash( string( "signer" ) ) );
+      signed_block b;
+      b.timestamp = fc::time_point_sec( GRAPHENE_GENESIS_TIMESTAMP );
+      for( uint32_t i = 0; i < 3; ++i )
+      {
+         processed_transaction trx;
+         transfer_operation op;
+         op.amount = asset( i );
+         trx.operations.push_back( op );
+         b.transactions.push_back( trx );
+      }
+      b.transaction_merkle_root = b.calculate_merkle_root();
+      b.sign( signer );
+
+      const vector<char> packed = fc::raw::pack( b );
+      const graphene::chain::signed_block_view view( packed );
+      BOOST_CHECK( view.id() == b.id() );
+      BOOST_CHECK( view.digest() == b.digest() );
+      BOOST_CHECK( view.signee() == signer.get_public_key() );
+      BOOST_CHECK_EQUAL( view.block_num(), b.block_num() );
+      BOOST_CHECK_EQUAL( view.transaction_count(), 3 );
+      BOOST_CHECK( view.calculate_merkle_root() == b.transaction_merkle_root );
+      BOOST_CHECK( fc::raw::pack( view.unpack() ) == packed );
+
+      uint32_t seen = 0;
+      view.for_each_transaction( [&]( const processed_transaction& trx, const char* data, size_t size ) {
+         BOOST_CHECK( trx.operations[0].get<transfer_operation>().amount == asset( seen ) );
+         BOOST_CHECK( vector<char>( data, data + size ) == fc::raw::pack( b.transactions[seen] ) );
+         ++seen;
+      } );
+      BOOST_CHECK_EQUAL( seen, 3 );
+
+      // A transaction count larger than the block is refused before anything is decoded
+      vector<char> bad( packed.begin(), packed.begin() + fc::raw::pack_size( signed_block_header( b ) ) );
+      const vector<char> count = fc::raw::pack( fc::unsigned_int( 1000000 ) );
+      bad.insert( bad.end(), count.begin(), count.end() );
+      BOOST_CHECK_THROW( graphene::chain::signed_block_view( bad.data(), bad.size() ), fc::exception );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
 
-      BOOST_CHECK(nathan_id(db1).name == "nathan");
-      BOOST_CHECK(nathan_id(db2).name == "nathan");
+BOOST_FIXTURE_TEST_CASE( fetch_block_header, database_fixture )
+{
+   try {
+      generate_blocks( 3 );
+      const auto header = db.fetch_block_header_by_number( 2 );
+      BOOST_REQUIRE( header.valid() );
+      BOOST_CHECK( header->id() == db.fetch_block_by_number( 2 )->id() );
+      BOOST_CHECK( db.fetch_block_header_by_id( header->id() )->timestamp == header->timestamp );
+      BOOST_CHECK( !db.fetch_block_header_by_number( db.head_block_num() + 1 ).valid() );
    } catch (fc::exception& e) {
       edump((e.to_detail_string()));
       throw;
    }
 }
 
-BOOST_AUTO_TEST_CASE( duplicate_transactions )
+BOOST_AUTO_TEST_CASE( signature_cache )
 {
    try {
       fc::time_point_sec now( GRAPHENE_GENESIS_TIMESTAMP );
@@ -323,37 +1443,30 @@ BOOST_AUTO_TEST_CASE( duplicate_transactions )
       db1.open(dir1.path());
       db2.open(dir2.path());
 
-      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
-
       auto delegate_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
-      const graphene::db::index& account_idx = db1.get_index(protocol_ids, account_object_type);
-
       signed_transaction trx;
       trx.set_expiration(db1.head_block_time() + fc::minutes(1));
-      account_id_type nathan_id = account_idx.get_next_id();
       account_create_operation cop;
+      cop.registrar = account_id_type(1);
       cop.name = "nathan";
       cop.owner = authority(1, key_id_type(), 1);
       trx.operations.push_back(cop);
       trx.sign( key_id_type(), delegate_priv_key );
-      db1.push_transaction(trx, skip_sigs);
-
-      trx = decltype(trx)();
-      trx.set_expiration(db1.head_block_time() + fc::minutes(1));
-      trx.operations.push_back(transfer_operation({asset(), account_id_type(), nathan_id, asset(500)}));
-      trx.sign( key_id_type(), delegate_priv_key );
-      db1.push_transaction(trx, skip_sigs);
-
-      BOOST_CHECK_THROW(db1.push_transaction(trx, skip_sigs), fc::exception);
+      db1.push_transaction(trx);
+      db2.push_transaction(trx);
+      BOOST_CHECK_EQUAL( db2.get_signature_cache_stats().misses, 1 );
+      BOOST_CHECK_EQUAL( db2.get_signature_cache_stats().hits, 0 );
 
+      // The signature was already recovered when the transaction was pushed
       now += db1.block_interval();
-      auto b = db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key, skip_sigs );
-      db2.push_block(b, skip_sigs);
+      auto b = db1.generate_block( now, db1.get_scheduled_witness( 1 ).first, delegate_priv_key );
+      db2.push_block(b);
+      BOOST_CHECK( db2.head_block_id() == b.id() );
+      BOOST_CHECK_EQUAL( db2.get_signature_cache_stats().misses, 1 );
+      BOOST_CHECK_GE( db2.get_signature_cache_stats().hits, 1 );
 
-      BOOST_CHECK_THROW(db1.push_transaction(trx, skip_sigs), fc::exception);
-      BOOST_CHECK_THROW(db2.push_transaction(trx, skip_sigs), fc::exception);
-      BOOST_CHECK_EQUAL(db1.get_balance(nathan_id, asset_id_type()).amount.value, 500);
-      BOOST_CHECK_EQUAL(db2.get_balance(nathan_id, asset_id_type()).amount.value, 500);
+      db2.set_signature_cache_size(0);
+      BOOST_CHECK_EQUAL( db2.get_signature_cache_stats().size, 0 );
    } catch (fc::exception& e) {
       edump((e.to_detail_string()));
       throw;
@@ -414,6 +1527,40 @@ BOOST_AUTO_TEST_CASE( tapos )
    }
 }
 
+BOOST_FIXTURE_TEST_CASE( far_witness_schedule, database_fixture )
+{
+   try {
+      auto expected_far_witnesses = [&]( uint32_t first_slot, uint32_t count ) -> vector<witness_id_type> {
+         const witness_schedule_object& wso = witness_schedule_id_type()(db);
+         witness_scheduler_rng far_rng( wso.rng_seed.begin(), GRAPHENE_FAR_SCHEDULE_CTR_IV );
+         far_future_witness_scheduler far_scheduler( wso.scheduler, far_rng );
+         vector<witness_id_type> result( count );
+         for( uint32_t i = 0; i < count; ++i )
+            far_scheduler.get_slot( first_slot + i, result[i] );
+         return result;
+      };
+      auto far_witnesses = [&]( uint32_t first_slot, uint32_t count ) -> vector<witness_id_type> {
+         vector<witness_id_type> result;
+         for( uint32_t i = 0; i < count; ++i )
+         {
+            auto scheduled = db.get_scheduled_witness( first_slot + i );
+            BOOST_CHECK( !scheduled.second );
+            result.push_back( scheduled.first );
+         }
+         return result;
+      };
+
+      const uint32_t first_far_slot = witness_schedule_id_type()(db).scheduler.size() + 1;
+      BOOST_CHECK( far_witnesses( first_far_slot, 100 ) == expected_far_witnesses( first_far_slot, 100 ) );
+      // A block changes the near schedule, so the far one kept is not used for it
+      generate_block();
+      BOOST_CHECK( far_witnesses( first_far_slot, 100 ) == expected_far_witnesses( first_far_slot, 100 ) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_FIXTURE_TEST_CASE( maintenance_interval, database_fixture )
 {
    try {
@@ -469,6 +1616,38 @@ BOOST_FIXTURE_TEST_CASE( maintenance_interval, database_fixture )
  *  This feature allows people to safely submit orders that have a limited lifetime, which is essential to some
  *  traders.
  */
+BOOST_FIXTURE_TEST_CASE( maintenance_on_signature_threads, database_fixture )
+{
+   try {
+      // The witnesses are sorted on a signature thread while the delegates are sorted here
+      db.set_signature_thread_count( 2 );
+      const account_object& nathan = create_account("nathan");
+      upgrade_to_prime(nathan);
+      const delegate_object nathans_delegate = create_delegate(nathan);
+      {
+         account_update_operation op;
+         op.account = nathan.id;
+         op.vote = nathan.votes;
+         op.vote->insert(nathans_delegate.vote_id);
+         trx.operations.push_back(op);
+         db.push_transaction(trx, ~0);
+         trx.operations.clear();
+      }
+      transfer(account_id_type()(db), nathan, asset(5000));
+
+      const auto initial_witnesses = db.get_global_properties().active_witnesses;
+      generate_blocks(db.get_dynamic_global_properties().next_maintenance_time);
+
+      const auto& active_delegates = db.get_global_properties().active_delegates;
+      BOOST_CHECK(std::find(active_delegates.begin(), active_delegates.end(), nathans_delegate.id) !=
+                  active_delegates.end());
+      BOOST_CHECK(db.get_global_properties().active_witnesses == initial_witnesses);
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_FIXTURE_TEST_CASE( short_order_expiration, database_fixture )
 { try {
    //Get a sane head block time
@@ -728,6 +1907,28 @@ BOOST_FIXTURE_TEST_CASE( force_settlement, database_fixture )
    BOOST_CHECK(!db.get_index_type<call_order_index>().indices().empty());
 } FC_LOG_AND_RETHROW() }
 
+BOOST_FIXTURE_TEST_CASE( last_irreversible_block, database_fixture )
+{
+   try {
+      BOOST_CHECK_EQUAL( db.get_dynamic_global_properties().last_irreversible_block_num, 0 );
+      generate_blocks( 30 );
+
+      // Once most witnesses have built on a block, it can no longer be undone
+      uint32_t last_irreversible = db.get_dynamic_global_properties().last_irreversible_block_num;
+      BOOST_CHECK_GT( last_irreversible, 0 );
+      BOOST_CHECK_LT( last_irreversible, db.head_block_num() );
+      BOOST_CHECK_LE( db._undo_db.size(), db.head_block_num() - last_irreversible );
+
+      generate_blocks( 10 );
+      BOOST_CHECK_GT( db.get_dynamic_global_properties().last_irreversible_block_num, last_irreversible );
+      BOOST_CHECK_LE( db._undo_db.size(),
+                      db.head_block_num() - db.get_dynamic_global_properties().last_irreversible_block_num );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_FIXTURE_TEST_CASE( pop_block_twice, database_fixture )
 {
    try
@@ -787,6 +1988,130 @@ BOOST_FIXTURE_TEST_CASE( pop_block_twice, database_fixture )
    }
 }
 
+BOOST_FIXTURE_TEST_CASE( deferred_cashback_matches_generated_block, database_fixture )
+{
+   try
+   {
+      uint32_t skip_flags = (
+           database::skip_delegate_signature
+         | database::skip_transaction_signatures
+         | database::skip_authority_check
+         );
+
+      ACTOR(alice);
+      transfer(genesis_account, alice_id, asset(1000000));
+      upgrade_to_prime(alice_id);
+      generate_block( skip_flags );
+      BOOST_REQUIRE( alice_id(db).cashback_vb.valid() );
+      const vesting_balance_id_type vb_id = *alice_id(db).cashback_vb;
+
+      // Several fees paid in one block all land in alice's existing cashback balance
+      transfer(alice_id, genesis_account, asset(100), asset(10000));
+      transfer(alice_id, genesis_account, asset(100), asset(20000));
+      signed_block b = generate_block( skip_flags );
+      const vesting_balance_object generated = vb_id(db);
+      BOOST_CHECK( generated.balance.amount > 0 );
+
+      // Re-applying the block defers the deposits until the end of the block; the result must not differ
+      db.pop_block();
+      db.push_block( b, skip_flags );
+      const vesting_balance_object applied = vb_id(db);
+      BOOST_CHECK( applied.balance == generated.balance );
+      BOOST_CHECK( fc::raw::pack(applied.policy) == fc::raw::pack(generated.policy) );
+   }
+   catch( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( state_hash_matches_recomputed_state, database_fixture )
+{
+   try
+   {
+      // Hashes every chain object from scratch, to check the hash kept up to date block by block
+      auto recompute = [&]() -> fc::sha256 {
+         state_hash fresh;
+         for( const index_stats& stats : db.get_index_stats() )
+            if( stats.space_id == protocol_ids || stats.space_id == implementation_ids )
+               db.get_index( stats.space_id, stats.type_id ).inspect_all_objects(
+                  [&]( const object& obj ) { fresh.add( obj ); } );
+         return fresh.result();
+      };
+
+      db.enable_state_hash();
+      BOOST_CHECK( db.get_state_hash() == recompute() );
+
+      ACTOR(alice);
+      transfer(genesis_account, alice_id, asset(1000000));
+      signed_block b1 = generate_block();
+      BOOST_CHECK( db.get_state_hash() == recompute() );
+      transfer(alice_id, genesis_account, asset(100));
+      signed_block b2 = generate_block();
+      const fc::sha256 hash2 = db.get_state_hash();
+      BOOST_CHECK( hash2 == recompute() );
+      BOOST_REQUIRE( db.get_state_hash_at( b1.block_num() ).valid() );
+      BOOST_CHECK( *db.get_state_hash_at( b2.block_num() ) == hash2 );
+      BOOST_CHECK( *db.get_state_hash_at( b1.block_num() ) != hash2 );
+
+      // Popping and pushing the block again, which undoes and redoes its changes, hashes the same
+      db.pop_block();
+      db.push_block( b2 );
+      BOOST_CHECK( db.get_state_hash() == hash2 );
+      BOOST_CHECK( *db.get_state_hash_at( b2.block_num() ) == hash2 );
+
+      // A block with nothing in it still changes the head block
+      generate_block();
+      BOOST_CHECK( db.get_state_hash() != hash2 );
+      BOOST_CHECK( db.get_state_hash() == recompute() );
+   }
+   catch( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( key_id_reused_after_pop_block, database_fixture )
+{
+   try
+   {
+      // Check nothing but transaction signatures
+      uint32_t skip_flags = ~uint32_t(0) & ~uint32_t(database::skip_transaction_signatures);
+
+      private_key_type key1 = generate_private_key("key1");
+      private_key_type key2 = generate_private_key("key2");
+      generate_block();
+
+      key_id_type key_id = register_key( key1.get_public_key() ).get_id();
+      trx.operations.push_back(key_create_operation({asset(), account_id_type(), public_key_type(key1.get_public_key())}));
+      sign( trx, key_id, key1 );
+      db.push_transaction( trx, skip_flags );
+      trx.clear();
+      generate_block();
+
+      // Undo the key's creation and give its id to a different key
+      db.pop_block();
+      BOOST_CHECK( db.find_object( key_id ) == nullptr );
+      BOOST_CHECK( register_key( key2.get_public_key() ).get_id() == key_id );
+
+      trx.operations.push_back(key_create_operation({asset(), account_id_type(), public_key_type(key2.get_public_key())}));
+      sign( trx, key_id, key2 );
+      db.push_transaction( trx, skip_flags );
+      trx.clear();
+
+      trx.operations.push_back(key_create_operation({asset(), account_id_type(), public_key_type(key1.get_public_key())}));
+      sign( trx, key_id, key1 );
+      BOOST_CHECK_THROW( db.push_transaction( trx, skip_flags ), fc::exception );
+   }
+   catch( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
 BOOST_FIXTURE_TEST_CASE( witness_scheduler_missed_blocks, database_fixture )
 { try {
    db.get_near_witness_schedule();
@@ -815,4 +2140,147 @@ BOOST_FIXTURE_TEST_CASE( witness_scheduler_missed_blocks, database_fixture )
    });
 } FC_LOG_AND_RETHROW() }
 
+BOOST_FIXTURE_TEST_CASE( evaluator_stats, database_fixture )
+{ try {
+   ACTOR(alice);
+   const int tag = operation::tag<transfer_operation>::value;
+   BOOST_CHECK( db.get_evaluator_stats()[tag].operation.find("transfer_operation") != string::npos );
+
+   // Evaluations are counted but not timed until a sample interval is set
+   uint64_t calls = db.get_evaluator_stats()[tag].calls;
+   transfer( account_id_type(), alice_id, asset(1000) );
+   BOOST_CHECK_EQUAL( db.get_evaluator_stats()[tag].calls, calls + 1 );
+   BOOST_CHECK_EQUAL( db.get_evaluator_stats()[tag].sampled_calls, 0 );
+
+   db.set_evaluator_sample_interval( 2 );
+   transfer( account_id_type(), alice_id, asset(1000) );
+   transfer( account_id_type(), alice_id, asset(1000) );
+   const evaluator_stats& stats = db.get_evaluator_stats()[tag];
+   BOOST_CHECK_EQUAL( stats.calls, calls + 3 );
+   BOOST_CHECK_EQUAL( stats.sampled_calls, 1 );
+   BOOST_CHECK_EQUAL( stats.max_apply_ns, stats.apply_ns );
+   // At least the balances of both accounts are saved to the undo history
+   BOOST_CHECK_GE( stats.undo_clones, 2 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_FIXTURE_TEST_CASE( block_timings, database_fixture )
+{ try {
+   uint32_t observer_calls = 0;
+   auto c = db.applied_block.connect( [&]( const signed_block& ) { ++observer_calls; } );
+
+   db.set_block_timing_history( 2 );
+   generate_blocks( 3 );
+   BOOST_REQUIRE_EQUAL( db.get_block_timings().size(), 2 );
+   const block_timing& timing = db.get_block_timings().back();
+   BOOST_CHECK_EQUAL( timing.block_num, db.head_block_num() );
+   BOOST_CHECK_GE( timing.total_ns, timing.applied_block_ns + timing.pending_block_ns );
+   // Every observer is timed on its own, the one connected by this test last
+   BOOST_CHECK_EQUAL( observer_calls, 3 );
+   BOOST_REQUIRE( !timing.applied_block_observers_ns.empty() );
+   BOOST_CHECK_LE( timing.applied_block_observers_ns.back(), timing.applied_block_ns );
+
+   db.set_block_timing_history( 0 );
+   BOOST_CHECK( db.get_block_timings().empty() );
+   generate_block();
+   BOOST_CHECK( db.get_block_timings().empty() );
+   BOOST_CHECK_EQUAL( observer_calls, 4 );
+   c.disconnect();
+} FC_LOG_AND_RETHROW() }
+
+BOOST_FIXTURE_TEST_CASE( recent_transaction_bodies, database_fixture )
+{ try {
+   ACTOR(alice);
+   generate_block();
+   auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+   trx.set_expiration( db.head_block_time() + fc::minutes(1) );
+   trx.operations.push_back( transfer_operation({ asset(), account_id_type(), alice_id, asset(1000) }) );
+   db.push_transaction( trx, skip_sigs );
+   const transaction_id_type trx_id = trx.id();
+
+   // A pending transaction is served from the pending pool
+   BOOST_CHECK( db.get_recent_transaction( trx_id ).id() == trx_id );
+
+   generate_block( skip_sigs );
+   BOOST_CHECK( db.get_pending_transactions().empty() );
+   const auto& dupes = db.get_index_type<transaction_index>().indices().get<by_trx_id>();
+   BOOST_REQUIRE( dupes.find( trx_id ) != dupes.end() );
+   BOOST_CHECK_EQUAL( dupes.find( trx_id )->block_num, db.head_block_num() );
+   // Only its id is kept, so the body comes from its block
+   BOOST_CHECK( db.get_recent_transaction( trx_id ).id() == trx_id );
+   BOOST_CHECK_THROW( db.get_recent_transaction( transaction_id_type() ), fc::exception );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( head_state_follows_blocks )
+{ try {
+   fc::temp_directory data_dir;
+   auto delegate_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("genesis")) );
+   {
+      database db;
+      db.open( data_dir.path(), genesis_allocation() );
+      BOOST_CHECK( &db.get_dynamic_global_properties() == &db.get( dynamic_global_property_id_type() ) );
+      BOOST_CHECK( &db.get_global_properties() == &db.get( global_property_id_type() ) );
+
+      auto b = db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1).first, delegate_priv_key );
+      BOOST_CHECK_EQUAL( db.head_block_num(), 1 );
+      BOOST_CHECK( db.head_block_id() == b.id() );
+      BOOST_CHECK( db.head_block_time() == b.timestamp );
+
+      db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1).first, delegate_priv_key );
+      BOOST_CHECK_EQUAL( db.head_block_num(), 2 );
+      db.pop_block();
+      BOOST_CHECK_EQUAL( db.head_block_num(), 1 );
+      BOOST_CHECK( db.head_block_id() == b.id() );
+      BOOST_CHECK( db.head_block_time() == b.timestamp );
+      db.close();
+   }
+   {
+      // The objects are loaded again rather than created, and the accessors find the loaded ones
+      database db;
+      db.open( data_dir.path(), genesis_allocation() );
+      BOOST_CHECK( &db.get_dynamic_global_properties() == &db.get( dynamic_global_property_id_type() ) );
+      BOOST_CHECK( &db.get_global_properties() == &db.get( global_property_id_type() ) );
+      BOOST_CHECK_EQUAL( db.head_block_num(), 1 );
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( genesis_allocation_accounts )
+{ try {
+   fc::temp_directory data_dir;
+   genesis_allocation allocation;
+   for( int i = 0; i < 3; ++i )
+      allocation.emplace_back( public_key_type( fc::ecc::private_key::regenerate( fc::digest(i) ).get_public_key() ),
+                               i + 1 );
+   allocation.emplace_back( address( public_key_type( fc::ecc::private_key::regenerate( fc::digest(3) ).get_public_key() ) ),
+                            0 );
+
+   database db;
+   db.set_signature_thread_count( 2 );
+   db.open( data_dir.path(), allocation );
+
+   const auto& accounts_by_name = db.get_index_type<account_index>().indices().get<by_name>();
+   int64_t total = 0;
+   for( int i = 0; i < 3; ++i )
+   {
+      string name = "bts";
+      for( char c : string( allocation[i].first.get<public_key_type>() ).substr( sizeof(GRAPHENE_ADDRESS_PREFIX) - 1 ) )
+         name += isupper(c) ? string("-") + char(tolower(c)) : string( 1, c );
+      auto itr = accounts_by_name.find( name );
+      BOOST_REQUIRE( itr != accounts_by_name.end() );
+      const account_object& account = *itr;
+      const key_object& key = account.memo_key(db);
+      BOOST_CHECK( key.key_data.get<public_key_type>() == allocation[i].first.get<public_key_type>() );
+      BOOST_CHECK( account.owner == authority( 1, key_id_type( key.id ), 1 ) );
+      BOOST_CHECK( account.active == account.owner );
+      BOOST_CHECK( account.statistics(db).id == account.statistics );
+      int64_t amount = int64_t( GRAPHENE_INITIAL_SUPPLY ) * (i + 1) / 6;
+      BOOST_CHECK_EQUAL( db.get_balance( account.id, asset_id_type() ).amount.value, amount );
+      total += amount;
+   }
+   // The zero allocation gets no account, and the rounding left over goes to the fees rather than to genesis
+   BOOST_CHECK_EQUAL( db.get_index_type<account_index>().indices().size(),
+                      1 + std::max( GRAPHENE_MIN_WITNESS_COUNT, GRAPHENE_MIN_DELEGATE_COUNT ) + 3 );
+   BOOST_CHECK_EQUAL( db.get_balance( account_id_type(), asset_id_type() ).amount.value, 0 );
+   BOOST_CHECK_EQUAL( asset_dynamic_data_id_type()(db).accumulated_fees.value, int64_t( GRAPHENE_INITIAL_SUPPLY ) - total );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()
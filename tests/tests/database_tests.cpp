@@ -22,7 +22,14 @@
 #include <graphene/chain/operations.hpp>
 
 #include <graphene/chain/account_object.hpp>
+#include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/key_object.hpp>
+#include <graphene/chain/limit_order_object.hpp>
+#include <graphene/chain/witness_object.hpp>
+
+#include <graphene/db/lru_level_map.hpp>
+#include <graphene/db/object_pool.hpp>
+#include <graphene/db/page_arena.hpp>
 
 #include <fc/crypto/digest.hpp>
 
@@ -55,3 +62,676 @@ BOOST_AUTO_TEST_CASE( undo_test )
       throw;
    }
 }
+
+BOOST_AUTO_TEST_CASE( typed_modify )
+{
+   try {
+      struct modify_counter : public graphene::db::index_observer
+      {
+         int modified = 0;
+         virtual void on_modify( const graphene::db::object& obj ) override { ++modified; }
+      };
+
+      database db;
+      auto counter = std::make_shared<modify_counter>();
+      const_cast<graphene::db::index&>( db.get_index<account_balance_object>() ).add_observer( counter );
+      account_balance_id_type bal_id = db.create<account_balance_object>( [&]( account_balance_object& obj ){
+         obj.balance = 1;
+      }).id;
+
+      // account_balance_object declares its index, so this skips the virtual modify but must still be undoable
+      {
+         auto ses = db._undo_db.start_undo_session();
+         db.modify( bal_id(db), [&]( account_balance_object& obj ){ obj.balance = 2; } );
+         BOOST_CHECK_EQUAL( bal_id(db).balance.value, 2 );
+         BOOST_CHECK_EQUAL( counter->modified, 1 );
+      }
+      BOOST_CHECK_EQUAL( bal_id(db).balance.value, 1 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( typed_lookup )
+{
+   try {
+      database db1;
+      database db2;
+      account_balance_id_type bal_id = db1.create<account_balance_object>( [&]( account_balance_object& obj ){
+         obj.balance = 1;
+      }).id;
+
+      // Typed ids find the index by slot, which must resolve to the index of each database
+      BOOST_CHECK( &db1.get_index<implementation_ids, impl_account_balance_object_type>() ==
+                   &db1.get_index( implementation_ids, impl_account_balance_object_type ) );
+      BOOST_CHECK( &db2.get_index<account_balance_object>() ==
+                   &db2.get_index( implementation_ids, impl_account_balance_object_type ) );
+      BOOST_CHECK( &bal_id(db1) == &db1.get_object( bal_id ) );
+      BOOST_CHECK_EQUAL( bal_id(db1).balance.value, 1 );
+      BOOST_CHECK( db2.find( bal_id ) == nullptr );
+      BOOST_CHECK( db1.find( account_balance_id_type( 1 ) ) == nullptr );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( index_memory_stats )
+{
+   try {
+      database db;
+      const auto& idx = db.get_index<account_object>();
+      graphene::db::index_stats before = idx.stats();
+      db.create<account_object>( [&]( account_object& obj ){
+         obj.name = string( 200, 'n' );
+         obj.active = authority( 1, key_id_type(), 1 );
+      });
+      graphene::db::index_stats after = idx.stats();
+
+      BOOST_CHECK_EQUAL( after.space_id, protocol_ids );
+      BOOST_CHECK_EQUAL( after.type_id, account_object_type );
+      BOOST_CHECK_EQUAL( after.object_count, before.object_count + 1 );
+      // The object and the memory of its name and authority are counted
+      BOOST_CHECK_GE( after.object_bytes - before.object_bytes, sizeof(account_object) + 200 + sizeof(key_id_type) );
+      BOOST_CHECK_GT( after.container_bytes, before.container_bytes );
+
+      bool found = false;
+      for( const auto& stats : db.get_index_stats() )
+         if( stats.space_id == protocol_ids && stats.type_id == account_object_type )
+            found = stats.object_count == after.object_count;
+      BOOST_CHECK( found );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( object_pool_reuse )
+{
+   try {
+      graphene::db::object_pool pool;
+      void* first = pool.allocate( 40 );
+      void* second = pool.allocate( 40 );
+      const graphene::db::pool_stats both = pool.stats();
+      BOOST_CHECK_EQUAL( both.element_size, 40u );
+      BOOST_CHECK_GE( both.used_bytes, 80u );
+      BOOST_CHECK_GT( both.free_bytes, 0u );
+
+      // Freed elements are handed out again, and other sizes do not come from the pool
+      pool.deallocate( first, 40 );
+      BOOST_CHECK( pool.allocate( 40 ) == first );
+      void* other = pool.allocate( 100 );
+      BOOST_CHECK_EQUAL( pool.stats().used_bytes, both.used_bytes );
+      pool.deallocate( other, 100 );
+
+      pool.deallocate( first, 40 );
+      pool.deallocate( second, 40 );
+      BOOST_CHECK_EQUAL( pool.stats().used_bytes, 0u );
+      BOOST_CHECK_EQUAL( pool.stats().free_bytes, both.used_bytes + both.free_bytes );
+
+      // The orders index allocates from its pool, and keeps the memory of removed orders
+      database db;
+      const auto& orders = db.get_index<limit_order_object>();
+      const auto& order = db.create<limit_order_object>( []( limit_order_object& ){} );
+      const graphene::db::index_stats created = orders.stats();
+      BOOST_CHECK_GT( created.pool_used_bytes, 0u );
+      db.remove( order );
+      const graphene::db::index_stats removed = orders.stats();
+      BOOST_CHECK_LT( removed.pool_used_bytes, created.pool_used_bytes );
+      BOOST_CHECK_EQUAL( removed.pool_used_bytes + removed.pool_free_bytes,
+                         created.pool_used_bytes + created.pool_free_bytes );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( page_arena_regions )
+{
+   try {
+      {
+         graphene::db::page_arena heap;
+         void* chunk = heap.allocate( 1000 );
+         BOOST_CHECK_EQUAL( reinterpret_cast<uintptr_t>( chunk ) % alignof(std::max_align_t), 0u );
+         BOOST_CHECK_GE( heap.reserved_bytes(), 1000u );
+         BOOST_CHECK_EQUAL( heap.huge_page_bytes(), 0u );
+      }
+
+      BOOST_CHECK( graphene::db::huge_page_mode_from_string( "transparent" ) == graphene::db::transparent_huge_pages );
+      BOOST_CHECK_THROW( graphene::db::huge_page_mode_from_string( "gigantic" ), fc::exception );
+      graphene::db::set_huge_page_mode( graphene::db::transparent_huge_pages );
+      {
+         graphene::db::page_arena arena;
+         char* first = static_cast<char*>( arena.allocate( 1000 ) );
+         char* second = static_cast<char*>( arena.allocate( 1000 ) );
+         first[999] = 1;
+         second[0] = 2;
+#ifdef __linux__
+         // Chunks are carved from one region mapped for huge pages
+         BOOST_CHECK_EQUAL( arena.reserved_bytes(), graphene::db::page_arena::region_size );
+         BOOST_CHECK_EQUAL( arena.huge_page_bytes(), graphene::db::page_arena::region_size );
+         BOOST_CHECK_EQUAL( reinterpret_cast<uintptr_t>( first ) % graphene::db::page_arena::region_size, 0u );
+         BOOST_CHECK( second >= first + 1000 );
+#endif
+         BOOST_CHECK_EQUAL( first[999], 1 );
+      }
+      graphene::db::set_huge_page_mode( graphene::db::no_huge_pages );
+   } catch ( const fc::exception& e )
+   {
+      graphene::db::set_huge_page_mode( graphene::db::no_huge_pages );
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( slab_index_storage )
+{
+   try {
+      database db;
+      const auto& witnesses = db.get_index_type<witness_index>();
+      vector<const witness_object*> created;
+      for( int i = 0; i < 300; ++i )
+         created.push_back( &db.create<witness_object>( [&]( witness_object& w ){ w.accumulated_income = i; } ) );
+
+      // Objects keep their address while others come and go
+      witness_id_type removed_id = created[10]->id;
+      db.remove( *created[10] );
+      BOOST_CHECK( db.find( removed_id ) == nullptr );
+      const auto& replacement = db.create<witness_object>( [&]( witness_object& w ){ w.accumulated_income = 300; } );
+      BOOST_CHECK( &replacement == created[10] );
+      BOOST_CHECK( db.find_object( created[11]->id ) == created[11] );
+
+      share_type total;
+      size_t count = 0;
+      for( const witness_object& w : witnesses )
+      {
+         total += w.accumulated_income;
+         ++count;
+      }
+      BOOST_CHECK_EQUAL( count, 300 );
+      BOOST_CHECK_EQUAL( total.value, 300 * 299 / 2 - 10 + 300 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( flat_index_storage )
+{
+   try {
+      database db;
+      typedef flat_index<asset_dynamic_data_object> dynamic_data_index;
+      const auto& dynamic_data = db.get_index_type<dynamic_data_index>();
+      vector<dynamic_asset_data_id_type> ids;
+      for( int i = 0; i < 3; ++i )
+         ids.push_back( db.create<asset_dynamic_data_object>( [&]( asset_dynamic_data_object& d ){
+            d.current_supply = i + 1;
+         }).id );
+
+      {
+         auto ses = db._undo_db.start_undo_session();
+         db.remove( ids[1](db) );
+         BOOST_CHECK( db.find( ids[1] ) == nullptr );
+         BOOST_CHECK_EQUAL( dynamic_data.size(), 2 );
+
+         // Removed instances are skipped
+         share_type total;
+         dynamic_data.inspect_all_objects( [&]( const object& o ){
+            total += static_cast<const asset_dynamic_data_object&>(o).current_supply;
+         });
+         BOOST_CHECK_EQUAL( total.value, 4 );
+      }
+      BOOST_REQUIRE( db.find( ids[1] ) != nullptr );
+      BOOST_CHECK_EQUAL( ids[1](db).current_supply.value, 2 );
+      BOOST_CHECK_EQUAL( dynamic_data.size(), 3 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( balance_lookup )
+{
+   try {
+      database db;
+      for( int owner = 0; owner < 100; ++owner )
+         for( int a = 0; a < 3; ++a )
+            db.adjust_balance( account_id_type(owner), asset( owner * 10 + a + 1, asset_id_type(a) ) );
+      BOOST_CHECK_EQUAL( db.get_balance( account_id_type(42), asset_id_type(2) ).amount.value, 423 );
+      BOOST_CHECK_EQUAL( db.get_balance( account_id_type(100), asset_id_type(0) ).amount.value, 0 );
+
+      // Balances created or removed in an undone session come and go from the lookup as well
+      const auto& balances = db.get_index_type<account_balance_index>().indices();
+      {
+         auto ses = db._undo_db.start_undo_session();
+         db.adjust_balance( account_id_type(100), asset( 5, asset_id_type(0) ) );
+         BOOST_CHECK_EQUAL( db.get_balance( account_id_type(100), asset_id_type(0) ).amount.value, 5 );
+         for( auto itr = balances.begin(); itr != balances.end(); )
+         {
+            const auto& b = *itr++;
+            if( b.owner.instance.value % 2 )
+               db.remove( b );
+         }
+         BOOST_CHECK_EQUAL( db.get_balance( account_id_type(41), asset_id_type(1) ).amount.value, 0 );
+         BOOST_CHECK_EQUAL( db.get_balance( account_id_type(42), asset_id_type(1) ).amount.value, 422 );
+      }
+      BOOST_CHECK_EQUAL( db.get_balance( account_id_type(100), asset_id_type(0) ).amount.value, 0 );
+      for( int owner = 0; owner < 100; ++owner )
+         BOOST_CHECK_EQUAL( db.get_balance( account_id_type(owner), asset_id_type(1) ).amount.value, owner * 10 + 2 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( batched_observer )
+{
+   try {
+      struct change_recorder : public graphene::db::batched_index_observer
+      {
+         vector<graphene::db::object_change> changes;
+         int calls = 0;
+         virtual void on_changes( const vector<graphene::db::object_change>& c ) override
+         {
+            changes = c;
+            ++calls;
+         }
+         const graphene::db::object_change* find( object_id_type id )const
+         {
+            for( const auto& c : changes )
+               if( c.id == id )
+                  return &c;
+            return nullptr;
+         }
+      };
+
+      database db;
+      auto recorder = std::make_shared<change_recorder>();
+      db.add_batched_observer<account_balance_object>( recorder );
+      auto create_balance = [&]( int64_t amount ) {
+         return account_balance_id_type( db.create<account_balance_object>( [&]( account_balance_object& b ){
+            b.balance = amount;
+         }).id );
+      };
+      auto modified_id = create_balance( 1 );
+      auto removed_id = create_balance( 2 );
+      db.publish_changes();
+      BOOST_CHECK_EQUAL( recorder->calls, 1 );
+      BOOST_CHECK_EQUAL( recorder->changes.size(), 2 );
+
+      db.modify( modified_id(db), [&]( account_balance_object& b ){ b.balance = 10; } );
+      db.modify( modified_id(db), [&]( account_balance_object& b ){ b.balance = 11; } );
+      db.remove( removed_id(db) );
+      auto transient_id = create_balance( 3 );
+      db.remove( transient_id(db) );
+      db.publish_changes();
+      BOOST_CHECK_EQUAL( recorder->calls, 2 );
+      BOOST_CHECK_EQUAL( recorder->changes.size(), 2 );
+
+      auto modified = recorder->find( modified_id );
+      BOOST_REQUIRE( modified && modified->before && modified->after );
+      BOOST_CHECK_EQUAL( static_cast<const account_balance_object&>(*modified->before).balance.value, 1 );
+      BOOST_CHECK_EQUAL( static_cast<const account_balance_object*>(modified->after)->balance.value, 11 );
+      auto removed = recorder->find( removed_id );
+      BOOST_REQUIRE( removed && removed->before );
+      BOOST_CHECK( removed->after == nullptr );
+      BOOST_CHECK_EQUAL( static_cast<const account_balance_object&>(*removed->before).balance.value, 2 );
+
+      // Nothing changed, so the observer is not called
+      db.publish_changes();
+      BOOST_CHECK_EQUAL( recorder->calls, 2 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( undo_sessions_reuse_arena )
+{
+   try {
+      database db;
+      auto ses = db._undo_db.start_undo_session();
+      account_balance_id_type bal_id = db.create<account_balance_object>( [&]( account_balance_object& obj ){
+         obj.balance = 1;
+      }).id;
+      ses.commit();
+
+      // Run past the maximum stack size so the oldest states are dropped as well
+      for( int i = 0; i < 300; ++i )
+      {
+         auto outer = db._undo_db.start_undo_session();
+         db.modify( bal_id(db), [&]( account_balance_object& obj ){ obj.balance = 2; } );
+         {
+            auto inner = db._undo_db.start_undo_session();
+            db.modify( bal_id(db), [&]( account_balance_object& obj ){ obj.balance = 3; } );
+            db.create<account_balance_object>( [&]( account_balance_object& obj ){ obj.balance = 4; } );
+            inner.merge();
+         }
+         {
+            auto inner = db._undo_db.start_undo_session();
+            db.remove( bal_id(db) );
+         }
+         BOOST_CHECK_EQUAL( bal_id(db).balance.value, 3 );
+         if( i % 2 )
+         {
+            outer.undo();
+            BOOST_CHECK_EQUAL( bal_id(db).balance.value, 1 );
+         }
+         else
+         {
+            outer.commit();
+            db._undo_db.pop_commit();
+            BOOST_CHECK_EQUAL( bal_id(db).balance.value, 1 );
+         }
+      }
+      BOOST_CHECK( db.find_object( account_balance_id_type( uint64_t( bal_id.instance.value + 1 ) ) ) == nullptr );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( undo_restores_packed_objects )
+{
+   try {
+      database db;
+      auto ses = db._undo_db.start_undo_session();
+      account_id_type acct_id = db.create<account_object>( [&]( account_object& obj ){
+         obj.name = "nathan";
+         obj.active = authority( 1, key_id_type(), 1 );
+      }).id;
+      ses.commit();
+
+      ses = db._undo_db.start_undo_session();
+      db.modify( acct_id(db), [&]( account_object& obj ){
+         obj.name = "sam";
+         obj.active.add_authority( key_id_type(7), 2 );
+      });
+      db.modify( acct_id(db), [&]( account_object& obj ){ obj.name = "dan"; } );
+      ses.undo();
+      BOOST_CHECK_EQUAL( acct_id(db).name, "nathan" );
+      BOOST_CHECK_EQUAL( acct_id(db).active.auths.size(), 1 );
+
+      // Removing a modified object restores it as it was before the modification
+      ses = db._undo_db.start_undo_session();
+      db.modify( acct_id(db), [&]( account_object& obj ){ obj.name = "sam"; } );
+      db.remove( acct_id(db) );
+      BOOST_CHECK( db.find_object( acct_id ) == nullptr );
+      ses.undo();
+      BOOST_CHECK_EQUAL( acct_id(db).name, "nathan" );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( apply_changes_undo )
+{
+   try {
+      database source, copy;
+      source._undo_db.disable();
+      auto create_balance = [&]( int64_t amount ) {
+         return source.create<account_balance_object>( [&]( account_balance_object& obj ){
+            obj.owner = account_id_type( amount );
+            obj.balance = amount;
+         }).id;
+      };
+      const auto first = create_balance( 1 );
+      const auto second = create_balance( 2 );
+      const auto& copied = copy.get_index_type<account_balance_index>().indices();
+
+      // The objects applied inside a session are created by it, so undoing it removes them
+      auto ses = copy._undo_db.start_undo_session();
+      copy.apply_changes( *source.pack_all_objects() );
+      BOOST_CHECK_EQUAL( copied.size(), 2 );
+      ses.undo();
+      BOOST_CHECK_EQUAL( copied.size(), 0 );
+      const object_id_type first_id = first;
+      BOOST_CHECK( copy.get_index( first_id.space(), first_id.type() ).get_next_id() == first_id );
+
+      copy.apply_changes( *source.pack_all_objects() );
+      source.remove( source.get( first ) );
+      source.modify( source.get( second ), []( account_balance_object& obj ){ obj.balance = 5; } );
+      const auto third = create_balance( 3 );
+      copy.replace_all_objects( *source.pack_all_objects() );
+      BOOST_CHECK_EQUAL( copied.size(), 2 );
+      BOOST_CHECK( copy.find( first ) == nullptr );
+      BOOST_CHECK_EQUAL( copy.get( second ).balance.value, 5 );
+      BOOST_CHECK_EQUAL( copy.get( third ).balance.value, 3 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( undo_merged_sessions )
+{
+   try {
+      database db;
+      auto ses = db._undo_db.start_undo_session();
+      account_balance_id_type bal_id = db.create<account_balance_object>( [&]( account_balance_object& obj ){
+         obj.balance = 1;
+      }).id;
+      ses.commit();
+
+      ses = db._undo_db.start_undo_session();
+      account_balance_id_type new_id;
+      for( int i = 0; i < 10; ++i )
+      {
+         auto trx_session = db._undo_db.start_undo_session();
+         db.modify( bal_id(db), [&]( account_balance_object& obj ){ obj.balance += 1; } );
+         if( i == 3 )
+            new_id = db.create<account_balance_object>( [&]( account_balance_object& obj ){ obj.balance = 7; } ).id;
+         else if( i == 6 )
+            db.modify( new_id(db), [&]( account_balance_object& obj ){ obj.balance = 8; } );
+         else if( i == 8 )
+            db.remove( new_id(db) );
+         trx_session.merge();
+      }
+      BOOST_CHECK_EQUAL( db._undo_db.size(), 2 );
+      BOOST_CHECK_EQUAL( bal_id(db).balance.value, 11 );
+      // The object created by one merged session is reported as modified by a later one
+      BOOST_CHECK( db._undo_db.head_modified_ids() == vector<object_id_type>({ bal_id, new_id }) );
+      undo_changes changes = db._undo_db.head_changes();
+      BOOST_CHECK( changes.created == vector<object_id_type>({ new_id }) );
+      BOOST_CHECK( changes.modified == vector<object_id_type>({ bal_id, new_id }) );
+      BOOST_CHECK( changes.removed == vector<object_id_type>({ new_id }) );
+      BOOST_CHECK( changes.affected() == db._undo_db.head_affected_ids() );
+
+      ses.undo();
+      BOOST_CHECK_EQUAL( bal_id(db).balance.value, 1 );
+      BOOST_CHECK( db.find_object( new_id ) == nullptr );
+      BOOST_CHECK( db.create<account_balance_object>( []( account_balance_object& ){} ).id == new_id );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( undo_memory_bound )
+{
+   try {
+      database db;
+      account_balance_id_type bal_id = db.create<account_balance_object>( []( account_balance_object& ){} ).id;
+      for( int i = 0; i < 10; ++i )
+      {
+         auto ses = db._undo_db.start_undo_session();
+         for( int j = 0; j < 100; ++j )
+            db.create<account_balance_object>( []( account_balance_object& ){} );
+         db.modify( bal_id(db), [&]( account_balance_object& obj ){ obj.balance = i; } );
+         ses.commit();
+      }
+      auto stats = db._undo_db.get_stats();
+      BOOST_CHECK_EQUAL( stats.depth, 11 );
+      BOOST_REQUIRE_EQUAL( stats.session_bytes.size(), 11 );
+      BOOST_CHECK( stats.session_bytes.back() > 0 );
+      BOOST_CHECK( stats.bytes <= stats.reserved_bytes );
+
+      // Bounding the memory by less than a single session drops the whole stack when the next session starts
+      db._undo_db.set_max_bytes( stats.session_bytes.back() / 2 );
+      auto ses = db._undo_db.start_undo_session();
+      BOOST_CHECK_EQUAL( db._undo_db.size(), 1 );
+      ses.undo();
+      BOOST_CHECK_EQUAL( bal_id(db).balance.value, 9 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( flush_changed_objects )
+{
+   try {
+      fc::temp_directory dir;
+      account_balance_id_type kept_id, removed_id;
+      {
+         database db;
+         db.open( dir.path() );
+         kept_id = db.create<account_balance_object>( []( account_balance_object& obj ){ obj.balance = 1; } ).id;
+         removed_id = db.create<account_balance_object>( []( account_balance_object& obj ){ obj.balance = 2; } ).id;
+         db.flush();
+
+         db.modify( kept_id(db), []( account_balance_object& obj ){ obj.balance = 3; } );
+         db.remove( removed_id(db) );
+         db.close();
+      }
+      database db;
+      db.open( dir.path() );
+      BOOST_CHECK_EQUAL( kept_id(db).balance.value, 3 );
+      BOOST_CHECK( db.find_object( removed_id ) == nullptr );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( object_store_profiles )
+{
+   try {
+      fc::temp_directory dir;
+      account_balance_id_type bal_id;
+      {
+         database db;
+         db.set_store_options( graphene::db::write_heavy, 8 * 1024 * 1024 );
+         db.open( dir.path() );
+         bal_id = db.create<account_balance_object>( []( account_balance_object& obj ){ obj.balance = 5; } ).id;
+         db.close();
+      }
+      // The profile only changes how the store is read and written, so every profile reads what another one wrote
+      int64_t expected = 5;
+      for( auto profile : { graphene::db::point_lookup, graphene::db::sequential_scan, graphene::db::default_profile } )
+      {
+         database db;
+         db.set_store_options( profile, 1024 * 1024 );
+         db.open( dir.path() );
+         BOOST_CHECK_EQUAL( bal_id(db).balance.value, expected++ );
+         db.modify( bal_id(db), []( account_balance_object& obj ){ obj.balance += 1; } );
+         db.close();
+      }
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( lru_level_map_eviction )
+{
+   try {
+      fc::temp_directory dir;
+      const string value( 100, 'x' );
+      {
+         graphene::db::lru_level_map<uint32_t, string> map;
+         // Room for about three entries
+         map.open( dir.path(), 350 );
+         for( uint32_t i = 0; i < 10; ++i )
+            map.store( i, value + fc::to_string(i) );
+         const auto& stats = map.get_stats();
+         BOOST_CHECK_LE( stats.bytes, stats.byte_budget );
+         BOOST_CHECK_EQUAL( stats.entries + stats.evictions, 10 );
+
+         // Evicted entries were written back, and are read through on a miss
+         BOOST_CHECK_EQUAL( map.fetch( 0 ), value + "0" );
+         uint64_t misses = stats.misses;
+         BOOST_CHECK_EQUAL( map.fetch( 0 ), value + "0" );
+         BOOST_CHECK_EQUAL( stats.misses, misses );
+         BOOST_CHECK_GE( stats.hits, 1 );
+
+         map.remove( 1 );
+         BOOST_CHECK( !map.fetch_optional( 1 ) );
+         map.store( 9, "nine" );
+         map.close();
+      }
+      graphene::db::lru_level_map<uint32_t, string> map;
+      map.open( dir.path(), 1024 );
+      BOOST_CHECK( !map.fetch_optional( 1 ) );
+      BOOST_CHECK_EQUAL( map.fetch( 9 ), "nine" );
+      BOOST_CHECK_EQUAL( map.fetch( 5 ), value + "5" );
+      BOOST_CHECK_EQUAL( map.get_stats().misses, 3 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( read_view_epochs )
+{
+   try {
+      database db;
+      db.enable_read_views();
+      account_balance_id_type bal_id = db.create<account_balance_object>( []( account_balance_object& obj ){
+         obj.balance = 1;
+      }).id;
+
+      // Nothing is seen before it is published
+      BOOST_CHECK( !db.get_read_view().find<account_balance_object>( bal_id ) );
+      db.publish_read_view();
+      auto first = db.get_read_view();
+      BOOST_CHECK_EQUAL( first.get<account_balance_object>( bal_id )->balance.value, 1 );
+
+      db.modify( bal_id(db), []( account_balance_object& obj ){ obj.balance = 2; } );
+      db.publish_read_view();
+      auto second = db.get_read_view();
+      BOOST_CHECK_GT( second.epoch(), first.epoch() );
+      // A view keeps seeing its epoch, whichever thread reads it
+      fc::thread reader( "reader" );
+      BOOST_CHECK_EQUAL( reader.async( [&]() { return first.get<account_balance_object>( bal_id )->balance.value; } ).wait(), 1 );
+      BOOST_CHECK_EQUAL( reader.async( [&]() { return second.get<account_balance_object>( bal_id )->balance.value; } ).wait(), 2 );
+
+      db.remove( bal_id(db) );
+      db.publish_read_view();
+      BOOST_CHECK( !db.get_read_view().find<account_balance_object>( bal_id ) );
+      BOOST_CHECK_EQUAL( second.get<account_balance_object>( bal_id )->balance.value, 2 );
+
+      // Once the views are gone, publishing reclaims the copies only they could see
+      auto copy = first.find<account_balance_object>( bal_id );
+      {
+         auto released = std::move( first );
+      }
+      {
+         auto released = std::move( second );
+      }
+      db.publish_read_view();
+      BOOST_CHECK( copy.unique() );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
@@ -18,6 +18,12 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <graphene/app/api.hpp>
+#include <graphene/app/binary_api_server.hpp>
+#include <graphene/app/read_replica.hpp>
+#include <graphene/app/state_replication.hpp>
+#include <graphene/app/subscription_hub.hpp>
+
 #include <graphene/chain/operations.hpp>
 
 #include <graphene/chain/account_object.hpp>
@@ -31,7 +37,10 @@
 #include <graphene/chain/withdraw_permission_object.hpp>
 #include <graphene/chain/witness_object.hpp>
 
+#include <graphene/market_history/market_history_plugin.hpp>
+
 #include <fc/crypto/digest.hpp>
+#include <fc/thread/thread.hpp>
 
 #include "../common/database_fixture.hpp"
 
@@ -259,7 +268,7 @@ BOOST_AUTO_TEST_CASE( create_delegate )
       REQUIRE_THROW_WITH_VALUE(op, fee, asset(-600));
       trx.operations.back() = op;
 
-      delegate_id_type delegate_id = db.get_index_type<primary_index<simple_index<delegate_object>>>().get_next_id();
+      delegate_id_type delegate_id = db.get_index_type<primary_index<delegate_index>>().get_next_id();
       db.push_transaction(trx, ~0);
       const delegate_object& d = delegate_id(db);
 
@@ -868,6 +877,62 @@ BOOST_AUTO_TEST_CASE( uia_fees )
    }
 }
 
+BOOST_AUTO_TEST_CASE( market_fees_in_blocks )
+{ try {
+   INVOKE( issue_uia );
+   const asset_object&   test_asset     = get_asset( "TEST" );
+   const account_object& nathan_account = get_account( "nathan" );
+   const account_object& buyer_account  = create_account( "buyer" );
+   const asset_dynamic_data_object& test_dynamic = test_asset.dynamic_asset_data_id(db);
+
+   transfer( genesis_account(db), buyer_account, asset( 10000 ) );
+   create_sell_order( nathan_account, test_asset.amount(1000), asset(1000) );
+   create_sell_order( buyer_account, asset(300), test_asset.amount(300) );
+   create_sell_order( buyer_account, asset(500), test_asset.amount(500) );
+   auto pending_fees = test_dynamic.accumulated_fees;
+   BOOST_CHECK( pending_fees > 0 );
+
+   // Applying the same transactions in a block adds the fees of every fill once, at the end
+   generate_block();
+   BOOST_CHECK( test_dynamic.accumulated_fees == pending_fees );
+   BOOST_CHECK_EQUAL( get_balance( buyer_account, test_asset ), 800 - pending_fees.value );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( operation_fees_in_blocks )
+{ try {
+   const account_object& alice = create_account( "alice" );
+   transfer( genesis_account(db), alice, asset( 100000 ) );
+   generate_block();
+
+   const asset_dynamic_data_object& core_dynamic = asset_id_type()(db).dynamic_asset_data_id(db);
+   const account_statistics_object& alice_stats = alice.statistics(db);
+   for( int i = 0; i < 3; ++i )
+      transfer( alice, genesis_account(db), asset( 100 ), asset( 50 + i ) );
+   share_type pending_fees = core_dynamic.accumulated_fees;
+   share_type pending_lifetime_fees = alice_stats.lifetime_fees_paid;
+   BOOST_CHECK( pending_lifetime_fees == 50 + 51 + 52 );
+
+   // Applying the same transactions as an incoming block defers the fees to the end, with the same results
+   signed_block b = generate_block();
+   db.pop_block();
+   db.push_block( b, database::skip_transaction_dupe_check );
+   BOOST_CHECK( core_dynamic.accumulated_fees == pending_fees );
+   BOOST_CHECK( alice_stats.lifetime_fees_paid == pending_lifetime_fees );
+   BOOST_CHECK_EQUAL( get_balance( alice, asset_id_type()(db) ), 100000 - 300 - 153 );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
 BOOST_AUTO_TEST_CASE( cancel_limit_order_test )
 { try {
    INVOKE( issue_uia );
@@ -890,6 +955,659 @@ BOOST_AUTO_TEST_CASE( cancel_limit_order_test )
  }
 }
 
+BOOST_AUTO_TEST_CASE( market_order_book_test )
+{ try {
+   INVOKE( issue_uia );
+   const asset_object&   test_asset     = get_asset( "TEST" );
+   const account_object& buyer_account  = create_account( "buyer" );
+
+   transfer( genesis_account(db), buyer_account, asset( 10000 ) );
+
+   const auto& book = db.get_limit_order_book();
+   BOOST_CHECK( book.levels( asset_id_type(), test_asset.id ) == nullptr );
+
+   limit_order_id_type first_id  = create_sell_order( buyer_account, asset(100), test_asset.amount(200) )->id;
+   limit_order_id_type second_id = create_sell_order( buyer_account, asset(100), test_asset.amount(100) )->id;
+   limit_order_id_type third_id  = create_sell_order( buyer_account, asset(200), test_asset.amount(200) )->id;
+
+   // The best price first, and the oldest order first within a price
+   const auto* levels = book.levels( asset_id_type(), test_asset.id );
+   BOOST_REQUIRE( levels != nullptr );
+   BOOST_REQUIRE_EQUAL( levels->size(), 2 );
+   BOOST_CHECK_EQUAL( levels->begin()->second.size(), 2 );
+   BOOST_CHECK( levels->begin()->second.front()->id == second_id );
+   BOOST_CHECK( levels->begin()->second.back()->id == third_id );
+   BOOST_CHECK( levels->rbegin()->second.front()->id == first_id );
+   BOOST_CHECK( book.best( price( test_asset.amount(1), asset(1) ) ) == nullptr );
+   BOOST_CHECK( book.best( price( asset(1), test_asset.amount(1) ) )->id == second_id );
+
+   // Undo puts a canceled order back in its place
+   {
+      auto session = db._undo_db.start_undo_session();
+      cancel_limit_order( second_id(db) );
+      BOOST_CHECK( book.best( price( asset(1), test_asset.amount(1) ) )->id == third_id );
+   }
+   BOOST_CHECK( book.best( price( asset(1), test_asset.amount(1) ) )->id == second_id );
+   BOOST_CHECK_EQUAL( levels->begin()->second.size(), 2 );
+
+   cancel_limit_order( first_id(db) );
+   cancel_limit_order( second_id(db) );
+   cancel_limit_order( third_id(db) );
+   BOOST_CHECK( book.levels( asset_id_type(), test_asset.id ) == nullptr );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( batch_matching_test )
+{ try {
+   INVOKE( issue_uia );
+   const asset_object&   test_asset     = get_asset( "TEST" );
+   const account_object& nathan_account = get_account( "nathan" );
+   const account_object& buyer_account  = create_account( "buyer" );
+
+   transfer( genesis_account(db), buyer_account, asset( 10000 ) );
+   asset_update_operation update;
+   update.issuer = test_asset.issuer;
+   update.asset_to_update = test_asset.id;
+   update.new_options = test_asset.options;
+   update.new_options.flags |= batch_matching;
+   trx.operations.push_back( update );
+   db.push_transaction( trx, ~0 );
+   trx.operations.clear();
+
+   // Crossing orders wait for the end of the block
+   limit_order_id_type first_id  = create_sell_order( buyer_account, asset(100), test_asset.amount(100) )->id;
+   limit_order_id_type second_id = create_sell_order( nathan_account, test_asset.amount(200), asset(100) )->id;
+   BOOST_CHECK( db.find( first_id ) );
+   BOOST_CHECK( db.find( second_id ) );
+
+   limit_order_create_operation fill_or_kill;
+   fill_or_kill.seller = buyer_account.id;
+   fill_or_kill.amount_to_sell = asset(100);
+   fill_or_kill.min_to_receive = test_asset.amount(100);
+   fill_or_kill.fill_or_kill = true;
+   trx.operations.push_back( fill_or_kill );
+   BOOST_CHECK_THROW( db.push_transaction( trx, ~0 ), fc::exception );
+   trx.operations.clear();
+
+   // The newer order gets the price of the older one
+   generate_block();
+   BOOST_CHECK( !db.find( first_id ) );
+   BOOST_CHECK( !db.find( second_id ) );
+   BOOST_CHECK_EQUAL( get_balance( buyer_account, asset_id_type()(db) ), 9900 );
+   BOOST_CHECK_EQUAL( get_balance( buyer_account, test_asset ), 99 );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( expired_limit_order_test )
+{ try {
+   INVOKE( issue_uia );
+   const asset_object&   test_asset     = get_asset( "TEST" );
+   const account_object& buyer_account  = create_account( "buyer" );
+
+   transfer( genesis_account(db), buyer_account, asset( 10000 ) );
+
+   limit_order_create_operation op;
+   op.seller = buyer_account.id;
+   op.amount_to_sell = asset(1000);
+   op.min_to_receive = test_asset.amount(100);
+   op.expiration = db.head_block_time() + db.get_global_properties().parameters.block_interval * 2;
+   trx.operations.push_back( op );
+   auto processed = db.push_transaction( trx, ~0 );
+   trx.operations.clear();
+   limit_order_id_type order_id = processed.operation_results[0].get<object_id_type>();
+   BOOST_CHECK_EQUAL( get_balance( buyer_account, asset_id_type()(db) ), 9000 );
+
+   // The cancellation is still recorded as an operation, with the refund as its result
+   vector<operation_history_object> cancels;
+   boost::signals2::scoped_connection connection = db.applied_block.connect( [&]( const signed_block& ) {
+      for( const auto& applied : db.get_applied_operations() )
+         if( applied.op.which() == operation::tag<limit_order_cancel_operation>::value )
+            cancels.push_back( applied );
+   } );
+   generate_blocks( 3 );
+   BOOST_CHECK( !db.find( order_id ) );
+   BOOST_CHECK_EQUAL( get_balance( buyer_account, asset_id_type()(db) ), 10000 );
+   BOOST_REQUIRE_EQUAL( cancels.size(), 1 );
+   BOOST_CHECK( cancels[0].op.get<limit_order_cancel_operation>().order == order_id );
+   BOOST_CHECK( cancels[0].result.get<asset>() == asset(1000) );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( order_book_depth )
+{ try {
+   INVOKE( issue_uia );
+   const asset_object&   test_asset     = get_asset( "TEST" );
+   const account_object& nathan_account = get_account( "nathan" );
+   const account_object& buyer_account  = create_account( "buyer" );
+   transfer( genesis_account(db), buyer_account, asset( 10000 ) );
+
+   create_sell_order( buyer_account, asset(100), test_asset.amount(100) );
+   create_sell_order( buyer_account, asset(200), test_asset.amount(200) );
+   create_sell_order( buyer_account, asset(100), test_asset.amount(200) );
+   create_sell_order( nathan_account, test_asset.amount(300), asset(600) );
+
+   graphene::app::database_api api( db );
+   auto book = api.get_order_book( asset_id_type(), test_asset.id, 10 );
+   // Orders at the same price are aggregated, best price first
+   BOOST_REQUIRE_EQUAL( book.asks.size(), 2 );
+   BOOST_CHECK( book.asks[0].sell_price == price( asset(1), test_asset.amount(1) ) );
+   BOOST_CHECK_EQUAL( book.asks[0].for_sale.value, 300 );
+   BOOST_CHECK_EQUAL( book.asks[0].orders, 2 );
+   BOOST_CHECK_EQUAL( book.asks[1].for_sale.value, 100 );
+   BOOST_REQUIRE_EQUAL( book.bids.size(), 1 );
+   BOOST_CHECK_EQUAL( book.bids[0].for_sale.value, 300 );
+
+   BOOST_CHECK_EQUAL( api.get_order_book( asset_id_type(), test_asset.id, 1 ).asks.size(), 1 );
+   BOOST_CHECK_THROW( api.get_order_book( asset_id_type(), test_asset.id, 101 ), fc::exception );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( subscription_hub_dispatch )
+{ try {
+   INVOKE( issue_uia );
+   const asset_object&   test_asset     = get_asset( "TEST" );
+   const account_object& nathan_account = get_account( "nathan" );
+
+   auto hub = std::make_shared<graphene::app::subscription_hub>( std::ref(db) );
+   graphene::app::database_api first( db, hub );
+   graphene::app::database_api second( db, hub );
+   int first_objects = 0, second_objects = 0, books = 0;
+   vector<object_id_type> ids{ dynamic_global_property_id_type() };
+   first.subscribe_to_objects( [&]( const fc::variant& ){ ++first_objects; }, ids );
+   second.subscribe_to_objects( [&]( const fc::variant& ){ ++second_objects; }, ids );
+   first.subscribe_to_order_book( [&]( const fc::variant& ){ ++books; }, asset_id_type(), test_asset.id, 10 );
+   second.subscribe_to_order_book( [&]( const fc::variant& ){ ++books; }, asset_id_type(), test_asset.id, 10 );
+
+   // Both connections are notified of each block through the one hub
+   create_sell_order( nathan_account, test_asset.amount(100), asset(200) );
+   generate_block();
+   fc::usleep( fc::milliseconds(10) );
+   BOOST_CHECK_EQUAL( first_objects, 1 );
+   BOOST_CHECK_EQUAL( second_objects, 1 );
+   BOOST_CHECK_EQUAL( books, 2 );
+
+   // A connection which cancels its subscriptions or goes away is no longer notified
+   second.cancel_all_subscriptions();
+   {
+      graphene::app::database_api third( db, hub );
+      third.subscribe_to_objects( [&]( const fc::variant& ){ ++books; }, ids );
+   }
+   create_sell_order( nathan_account, test_asset.amount(100), asset(300) );
+   generate_block();
+   fc::usleep( fc::milliseconds(10) );
+   BOOST_CHECK_EQUAL( first_objects, 2 );
+   BOOST_CHECK_EQUAL( second_objects, 1 );
+   BOOST_CHECK_EQUAL( books, 3 );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( transaction_confirmation_subscription )
+{ try {
+   ACTOR(alice);
+   generate_block();
+   graphene::app::database_api api( db );
+   vector<graphene::app::transaction_confirmation> confirmations;
+
+   trx.set_expiration( db.head_block_time() + fc::minutes(1) );
+   trx.operations.push_back( transfer_operation({ asset(), account_id_type(), alice_id, asset(1000) }) );
+   const transaction_id_type trx_id = trx.id();
+   api.subscribe_to_transaction( [&]( const fc::variant& v ){
+      confirmations.push_back( v.as<graphene::app::transaction_confirmation>() );
+   }, trx_id );
+   db.push_transaction( trx, ~0 );
+
+   // Included once, then irreversible once, and then the subscription is over
+   generate_block();
+   fc::usleep( fc::milliseconds(10) );
+   BOOST_REQUIRE_EQUAL( confirmations.size(), 1 );
+   const uint32_t block_num = db.head_block_num();
+   BOOST_CHECK( confirmations[0].id == trx_id );
+   BOOST_CHECK_EQUAL( confirmations[0].block_num, block_num );
+   BOOST_CHECK( confirmations[0].block_id == db.head_block_id() );
+   BOOST_CHECK_EQUAL( confirmations[0].trx_num, 0 );
+   BOOST_CHECK_EQUAL( confirmations[0].operation_results.size(), 1 );
+   BOOST_CHECK( !confirmations[0].irreversible );
+
+   for( int i = 0; i < 100 && db.get_dynamic_global_properties().last_irreversible_block_num < block_num; ++i )
+      generate_block();
+   BOOST_REQUIRE_GE( db.get_dynamic_global_properties().last_irreversible_block_num, block_num );
+   generate_blocks( 3 );
+   fc::usleep( fc::milliseconds(10) );
+   BOOST_REQUIRE_EQUAL( confirmations.size(), 2 );
+   BOOST_CHECK( confirmations[1].irreversible );
+   BOOST_CHECK_EQUAL( confirmations[1].block_num, block_num );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( read_replica_follows_blocks )
+{ try {
+   graphene::utilities::thread_pools pools;
+   auto replica = std::make_shared<graphene::app::read_replica>( std::ref(db), pools.get( "api", 2 ) );
+   graphene::app::database_api api( db, nullptr, replica );
+   auto alice = [&]() { return api.lookup_account_names( { "alice" } )[0]; };
+
+   // Pending transactions are left out of the copy
+   create_account( "alice" );
+   BOOST_CHECK( !alice() );
+   generate_block();
+   replica->wait_for_updates();
+   BOOST_REQUIRE( alice() );
+   BOOST_CHECK( alice()->id == get_account( "alice" ).id );
+   BOOST_CHECK_EQUAL( api.get_dynamic_global_properties().head_block_number, db.head_block_num() );
+
+   // A block which does not follow the copied one has the whole state copied again
+   db.pop_block();
+   create_account( "bob" );
+   generate_block();
+   replica->wait_for_updates();
+   BOOST_CHECK_EQUAL( api.get_dynamic_global_properties().head_block_number, db.head_block_num() );
+   BOOST_CHECK( api.lookup_account_names( { "bob" } )[0] );
+   BOOST_CHECK_EQUAL( api.get_account_count(), db.get_index_type<account_index>().indices().size() );
+
+   BOOST_CHECK( !api.get_objects( { account_id_type() } )[0].is_null() );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( state_replication_follows_blocks )
+{ try {
+   // So that the replica is only caught up once the state arrives
+   generate_block();
+   graphene::app::state_replication_server server( db );
+   server.listen( fc::ip::endpoint::from_string( "127.0.0.1:0" ) );
+   database replica;
+   replica.open_in_memory( genesis_allocation() );
+   graphene::app::state_replication_client client( replica );
+   client.connect( server.get_local_endpoint() );
+
+   auto caught_up = [&]() -> bool {
+      for( int i = 0; i < 500 && replica.head_block_id() != db.head_block_id(); ++i )
+         fc::usleep( fc::milliseconds( 10 ) );
+      return replica.head_block_id() == db.head_block_id();
+   };
+   const auto& replica_accounts = replica.get_index_type<account_index>().indices().get<by_name>();
+
+   // The whole state is sent first, then the objects each block changed
+   BOOST_REQUIRE( caught_up() );
+   create_account( "alice" );
+   generate_block();
+   BOOST_REQUIRE( caught_up() );
+   BOOST_REQUIRE( replica_accounts.find( "alice" ) != replica_accounts.end() );
+   BOOST_CHECK( replica_accounts.find( "alice" )->id == get_account( "alice" ).id );
+   BOOST_CHECK_EQUAL( replica.head_block_num(), db.head_block_num() );
+
+   // A block of another fork has the popped block undone first
+   db.pop_block();
+   create_account( "bob" );
+   generate_block();
+   BOOST_REQUIRE( caught_up() );
+   BOOST_REQUIRE( replica_accounts.find( "bob" ) != replica_accounts.end() );
+   BOOST_CHECK( replica_accounts.find( "bob" )->id == get_account( "bob" ).id );
+   BOOST_CHECK_EQUAL( replica_accounts.size(), db.get_index_type<account_index>().indices().size() );
+   BOOST_CHECK( replica.get_dynamic_global_properties().time == db.head_block_time() );
+
+   // The replica undoes what it is told to, and nothing else
+   graphene::app::state_diff undo;
+   undo.step = graphene::app::state_diff::undo_block;
+   undo.block_id = block_id_type();
+   BOOST_CHECK_THROW( client.apply( undo ), fc::exception );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( database_api_batch )
+{ try {
+   const account_object& alice = create_account( "alice" );
+   graphene::app::database_api api( db );
+
+   vector<graphene::app::batch_call> calls( 3 );
+   calls[0].method = "lookup_account_names";
+   calls[0].params = { fc::variant( vector<string>{ "alice" } ) };
+   calls[1].method = "get_account_count";
+   calls[2].method = "get_dynamic_global_properties";
+   auto results = api.batch( calls );
+   BOOST_REQUIRE_EQUAL( results.size(), 3 );
+   auto accounts = results[0].as<vector<optional<account_object>>>();
+   BOOST_REQUIRE( accounts.size() == 1 && accounts[0] );
+   BOOST_CHECK( accounts[0]->id == alice.id );
+   BOOST_CHECK_EQUAL( results[1].as_uint64(), api.get_account_count() );
+   BOOST_CHECK_EQUAL( results[2].as<dynamic_global_property_object>().head_block_number, db.head_block_num() );
+
+   // Any bad call fails the whole batch
+   calls[1].params = { fc::variant( 1 ) };
+   BOOST_CHECK_THROW( api.batch( calls ), fc::exception );
+   calls[1].params.clear();
+   calls[1].method = "subscribe_to_objects";
+   BOOST_CHECK_THROW( api.batch( calls ), fc::exception );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( account_name_lookups )
+{ try {
+   const account_object& alice = create_account( "alice" );
+   const account_object& alicia = create_account( "alicia" );
+   create_account( "bob" );
+   graphene::app::database_api api( db );
+
+   auto names = api.lookup_accounts( "alice", 2 );
+   BOOST_REQUIRE_EQUAL( names.size(), 2 );
+   BOOST_CHECK( names[0].first == "alice" && names[0].second == alice.id );
+   BOOST_CHECK( names[1].first == "alicia" && names[1].second == alicia.id );
+   BOOST_CHECK_EQUAL( api.lookup_accounts_by_prefix( "ali", 1000 ).size(), 2 );
+   BOOST_CHECK_EQUAL( api.lookup_accounts_by_prefix( "alic", 1 ).size(), 1 );
+   BOOST_CHECK( api.lookup_accounts_by_prefix( "alz", 1000 ).empty() );
+
+   // Enough accounts to merge the recent names into the flat arrays, some of which are then removed again
+   account_name_table table;
+   vector<account_object> accounts( 3000 );
+   for( size_t i = 0; i < accounts.size(); ++i )
+   {
+      accounts[i].id = account_id_type( i );
+      accounts[i].name = "name" + fc::to_string( uint64_t( accounts.size() - i ) );
+      table.on_add( accounts[i] );
+   }
+   for( size_t i = 0; i < accounts.size(); i += 3 )
+      table.on_remove( accounts[i] );
+   BOOST_CHECK_EQUAL( table.size(), 2000 );
+
+   string last;
+   size_t visited = 0;
+   table.visit_from( string(), [&]( const char* name, size_t size, account_id_type id ) {
+      string current( name, size );
+      BOOST_CHECK( last < current );
+      BOOST_CHECK( accounts[id.instance.value].name == current && id.instance.value % 3 != 0 );
+      last = current;
+      return ++visited < 5000;
+   } );
+   BOOST_CHECK_EQUAL( visited, 2000 );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( all_account_balances )
+{ try {
+   const account_object& alice = create_account( "alice" );
+   const account_object& bob = create_account( "bob" );
+   const asset_object& uia = create_user_issued_asset( "UIA" );
+   transfer( account_id_type(), alice.id, asset( 1000 ) );
+   issue_uia( alice, uia.amount( 50 ) );
+   graphene::app::database_api api( db );
+
+   auto balances = api.get_all_account_balances( alice.id );
+   BOOST_REQUIRE_EQUAL( balances.size(), 2 );
+   BOOST_CHECK( std::find( balances.begin(), balances.end(), asset( 1000 ) ) != balances.end() );
+   BOOST_CHECK( std::find( balances.begin(), balances.end(), uia.amount( 50 ) ) != balances.end() );
+
+   auto all = api.get_balances_for_accounts( { bob.id, alice.id } );
+   BOOST_REQUIRE_EQUAL( all.size(), 2 );
+   BOOST_CHECK( all[0].empty() );
+   BOOST_CHECK_EQUAL( all[1].size(), 2 );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( account_history_store_tail_and_disk )
+{ try {
+   const account_object& alice = create_account( "alice" );
+   transfer( account_id_type(), alice.id, asset( 1000 ) );
+   generate_block();
+   app.get_plugin<graphene::account_history::account_history_plugin>( "account_history" )->wait_for_indexing();
+   graphene::app::history_api history( app );
+   auto ops = history.get_account_history( alice.id );
+   BOOST_REQUIRE( !ops.empty() );
+   BOOST_CHECK( ops.front().op.which() == operation::tag<transfer_operation>::value );
+
+   fc::temp_directory dir;
+   const flat_set<account_id_type> accounts{ alice.id };
+   operation_history_object op( transfer_operation() );
+   {
+      graphene::account_history::account_history_store store;
+      store.open( dir.path() );
+      for( uint32_t block_num = 1; block_num <= 3; ++block_num )
+      {
+         BOOST_REQUIRE( store.start_block( block_num ) );
+         op.block_num = block_num;
+         store.append( op, accounts );
+         store.append( op, accounts );
+      }
+      // A fork switch replaces block 3
+      BOOST_REQUIRE( store.start_block( 3 ) );
+      op.block_num = 3;
+      BOOST_CHECK( store.append( op, accounts ) == operation_history_id_type( 5 ) );
+      BOOST_CHECK_EQUAL( store.tail_size(), 5 );
+
+      store.flush( 2 );
+      BOOST_CHECK_EQUAL( store.tail_size(), 1 );
+      auto all = store.get_account_history( alice.id, operation_history_id_type(), 100, operation_history_id_type() );
+      BOOST_REQUIRE_EQUAL( all.size(), 5 );
+      for( size_t i = 0; i < all.size(); ++i )
+         BOOST_CHECK( all[i].id == operation_history_id_type( 5 - i ) );
+      auto middle = store.get_account_history( alice.id, operation_history_id_type( 1 ), 2, operation_history_id_type( 4 ) );
+      BOOST_REQUIRE_EQUAL( middle.size(), 2 );
+      BOOST_CHECK( middle[0].id == operation_history_id_type( 4 ) && middle[1].id == operation_history_id_type( 3 ) );
+      BOOST_CHECK( store.get_account_history( account_id_type(), operation_history_id_type(), 100,
+                                              operation_history_id_type() ).empty() );
+
+      // Pages by sequence number span the disk and the tail alike
+      BOOST_CHECK_EQUAL( store.get_account_history_count( alice.id ), 5 );
+      auto page = store.get_relative_account_history( alice.id, 1, 2, 3 );
+      BOOST_REQUIRE_EQUAL( page.size(), 2 );
+      BOOST_CHECK( page[0].id == operation_history_id_type( 3 ) && page[1].id == operation_history_id_type( 2 ) );
+      page = store.get_relative_account_history( alice.id, 3, 100, 0 );
+      BOOST_REQUIRE_EQUAL( page.size(), 2 );
+      BOOST_CHECK( page[0].id == operation_history_id_type( 5 ) && page[1].id == operation_history_id_type( 4 ) );
+   }
+
+   // Closing wrote out the tail as well, and a replay skips what is stored
+   graphene::account_history::account_history_store store;
+   store.open( dir.path() );
+   BOOST_CHECK( !store.start_block( 3 ) );
+   BOOST_CHECK( store.find( operation_history_id_type( 5 ) ) );
+   BOOST_REQUIRE( store.start_block( 4 ) );
+   BOOST_CHECK( store.append( op, accounts ) == operation_history_id_type( 6 ) );
+   BOOST_CHECK_EQUAL( store.get_account_history_count( alice.id ), 6 );
+   BOOST_CHECK_EQUAL( store.get_account_history( alice.id, operation_history_id_type(), 100,
+                                                 operation_history_id_type() ).size(), 6 );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( account_history_pruning )
+{ try {
+   const account_id_type alice( 10 ), bob( 11 );
+   fc::temp_directory dir;
+   graphene::account_history::account_history_store store;
+   store.open( dir.path() );
+   store.set_max_account_history( 2 );
+
+   // Alice has an operation in every block, Bob only in the first
+   operation_history_object op( transfer_operation() );
+   for( uint32_t block_num = 1; block_num <= 5; ++block_num )
+   {
+      BOOST_REQUIRE( store.start_block( block_num ) );
+      op.block_num = block_num;
+      store.append( op, block_num == 1 ? flat_set<account_id_type>{ alice, bob } : flat_set<account_id_type>{ alice } );
+      store.flush( block_num );
+   }
+   auto history = store.get_relative_account_history( alice, 0, 100, 0 );
+   BOOST_REQUIRE_EQUAL( history.size(), 2 );
+   BOOST_CHECK( history[0].id == operation_history_id_type( 5 ) && history[1].id == operation_history_id_type( 4 ) );
+   BOOST_CHECK_EQUAL( store.get_account_history_count( alice ), 5 );
+   // The first operation is still in Bob's history
+   BOOST_CHECK( store.find( operation_history_id_type( 1 ) ) );
+   BOOST_CHECK( !store.find( operation_history_id_type( 2 ) ) );
+   BOOST_REQUIRE_EQUAL( store.get_account_history( alice, operation_history_id_type(), 100,
+                                                   operation_history_id_type( 4 ) ).size(), 1 );
+
+   // By age, Bob keeps his last operation until he has a newer one
+   store.prune_before_block( 5 );
+   BOOST_CHECK_EQUAL( store.get_relative_account_history( alice, 0, 100, 0 ).size(), 1 );
+   BOOST_CHECK_EQUAL( store.get_relative_account_history( bob, 0, 100, 0 ).size(), 1 );
+   BOOST_REQUIRE( store.start_block( 6 ) );
+   op.block_num = 6;
+   store.append( op, { bob } );
+   store.flush( 6 );
+   history = store.get_relative_account_history( bob, 0, 100, 0 );
+   BOOST_REQUIRE_EQUAL( history.size(), 1 );
+   BOOST_CHECK( history[0].id == operation_history_id_type( 6 ) );
+   BOOST_CHECK( !store.find( operation_history_id_type( 1 ) ) );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( binary_api_calls )
+{ try {
+   const account_object& alice = create_account( "alice" );
+   graphene::app::binary_api_server server( app );
+
+   graphene::app::binary_api_request request;
+   request.id = 7;
+   request.api = "database";
+   request.method = "lookup_account_names";
+   request.params = fc::raw::pack( vector<string>{ "alice", "nobody" } );
+   auto response = server.call( request );
+   BOOST_CHECK_EQUAL( response.id, 7 );
+   BOOST_REQUIRE( !response.error );
+   auto accounts = fc::raw::unpack<vector<optional<account_object>>>( response.result );
+   BOOST_REQUIRE_EQUAL( accounts.size(), 2 );
+   BOOST_REQUIRE( accounts[0] );
+   BOOST_CHECK( accounts[0]->id == alice.id );
+   BOOST_CHECK( !accounts[1] );
+
+   // Several arguments are packed one after the other
+   request.method = "lookup_accounts";
+   request.params = fc::raw::pack( string( "alice" ) );
+   auto limit = fc::raw::pack( uint32_t( 1 ) );
+   request.params.insert( request.params.end(), limit.begin(), limit.end() );
+   response = server.call( request );
+   BOOST_REQUIRE( !response.error );
+   auto names = fc::raw::unpack<vector<pair<string,account_id_type>>>( response.result );
+   BOOST_REQUIRE_EQUAL( names.size(), 1 );
+   BOOST_CHECK( names.begin()->second == alice.id );
+
+   // Methods taking callbacks are only served over the websocket API
+   request.method = "subscribe_to_objects";
+   BOOST_CHECK( server.call( request ).error );
+   request.method = "no_such_method";
+   BOOST_CHECK( server.call( request ).error );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
+BOOST_AUTO_TEST_CASE( market_history_buckets )
+{ try {
+   INVOKE( issue_uia );
+   const asset_object&   core_asset     = asset_id_type()(db);
+   const asset_object&   test_asset     = get_asset( "TEST" );
+   const account_object& nathan_account = get_account( "nathan" );
+   const account_object& buyer_account  = create_account( "buyer" );
+   transfer( genesis_account(db), buyer_account, asset( 10000 ) );
+   generate_block();
+
+   const auto& by_key_idx = db.get_index_type<market_history::bucket_index>().indices().get<market_history::by_key>();
+   auto buckets = [&]( uint32_t seconds ) {
+      vector<market_history::bucket_object> result;
+      auto itr = by_key_idx.lower_bound( boost::make_tuple( core_asset.id, test_asset.id, seconds ) );
+      while( itr != by_key_idx.end() && itr->base == core_asset.id && itr->quote == test_asset.id && itr->seconds == seconds )
+         result.push_back( *itr++ );
+      return result;
+   };
+   BOOST_CHECK( buckets( 60 ).empty() );
+
+   // Both sides of a fill are reported, but each trade is only counted once
+   create_sell_order( buyer_account, asset(100), test_asset.amount(100) );
+   create_sell_order( nathan_account, test_asset.amount(100), asset(100) );
+   generate_block();
+   auto day = buckets( 86400 );
+   BOOST_REQUIRE_EQUAL( day.size(), 1 );
+   BOOST_CHECK_EQUAL( day[0].base_volume.value, 100 );
+   BOOST_CHECK_EQUAL( day[0].quote_volume.value, 100 );
+   BOOST_CHECK( day[0].open == price( asset(100), test_asset.amount(100) ) );
+   BOOST_CHECK( day[0].open_time.sec_since_epoch() % 86400 == 0 );
+
+   create_sell_order( buyer_account, asset(100), test_asset.amount(50) );
+   create_sell_order( nathan_account, test_asset.amount(50), asset(100) );
+   generate_block();
+   for( uint32_t seconds : { 15, 60, 300, 3600, 86400 } )
+   {
+      share_type base_volume, quote_volume;
+      for( const auto& bucket : buckets( seconds ) )
+      {
+         BOOST_CHECK( bucket.open_time.sec_since_epoch() % seconds == 0 );
+         base_volume += bucket.base_volume;
+         quote_volume += bucket.quote_volume;
+      }
+      BOOST_CHECK_EQUAL( base_volume.value, 200 );
+      BOOST_CHECK_EQUAL( quote_volume.value, 150 );
+   }
+   const auto last = buckets( 15 ).back();
+   BOOST_CHECK( last.close == price( asset(100), test_asset.amount(50) ) );
+   BOOST_CHECK( last.high == price( asset(100), test_asset.amount(50) ) );
+ }
+ catch ( const fc::exception& e )
+ {
+    elog( "${e}", ("e", e.to_detail_string() ) );
+    throw;
+ }
+}
+
 BOOST_AUTO_TEST_CASE( delegate_feeds )
 {
    using namespace graphene::chain;
@@ -1765,6 +2483,9 @@ BOOST_AUTO_TEST_CASE( margin_call_short_test )
       auto unmatched = create_short( buyer1, bitusd.amount(990), core.amount(1500) );
       if( unmatched ) edump((*unmatched));
       BOOST_REQUIRE( !unmatched );
+      // The canceled order refunded the asset, which was then settled into the backing asset
+      BOOST_CHECK_EQUAL( get_balance(buyer1, bitusd), 0 );
+      BOOST_CHECK( db.get_limit_order_book().orders_selling( bitusd.id ).empty() );
 
    } catch( const fc::exception& e) {
       edump((e.to_detail_string()));
@@ -2218,6 +2939,51 @@ BOOST_AUTO_TEST_CASE( bond_create_offer_test )
    REQUIRE_OP_EVALUATION_SUCCESS( op, offer_to_borrow, false );
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE( bond_offers_best_rate_first )
+{ try {
+   auto offer = [&]( bool offer_to_borrow, uint16_t interest_apr, share_type amount, asset_id_type asset_type )
+      -> bond_offer_id_type
+   {
+      return db.create<bond_offer_object>( [&]( bond_offer_object& obj ) {
+         obj.offered_by_account = account_id_type();
+         obj.offer_to_borrow = offer_to_borrow;
+         obj.amount = asset( amount, asset_type );
+         obj.interest_apr = interest_apr;
+      } ).id;
+   };
+   const bond_offer_id_type lend_high  = offer( false, 500, 100, asset_id_type() );
+   const bond_offer_id_type lend_low   = offer( false, 100, 100, asset_id_type() );
+   const bond_offer_id_type lend_large = offer( false, 100, 900, asset_id_type() );
+   const bond_offer_id_type borrow_low  = offer( true, 100, 100, asset_id_type() );
+   const bond_offer_id_type borrow_high = offer( true, 700, 100, asset_id_type() );
+   offer( false, 1, 100, asset_id_type( 1 ) );
+
+   graphene::app::database_api api( db );
+   auto ids = [&]( uint32_t limit ) -> vector<bond_offer_id_type>
+   {
+      vector<bond_offer_id_type> result;
+      for( const bond_offer_object& o : api.get_bond_offers( asset_id_type(), limit ) )
+         result.push_back( o.id );
+      return result;
+   };
+
+   // Lowest rates to lend first, then highest rates to borrow, the largest amount first at the same rate
+   vector<bond_offer_id_type> expected{ lend_large, lend_low, lend_high, borrow_high, borrow_low };
+   BOOST_CHECK( ids( 10 ) == expected );
+   expected = { lend_large, borrow_high };
+   BOOST_CHECK( ids( 1 ) == expected );
+
+   // The order follows changes to an offer
+   db.modify( lend_large(db), []( bond_offer_object& o ) { o.amount.amount = 50; } );
+   BOOST_CHECK( api.get_bond_offers( asset_id_type(), 1 )[0].id == lend_low );
+   BOOST_CHECK_THROW( api.get_bond_offers( asset_id_type(), 101 ), fc::exception );
+
+   // The offers were made without funds, so they go before the supplies are checked
+   const auto& offers = db.get_index_type<bond_offer_index>().indices();
+   while( !offers.empty() )
+      db.remove( *offers.begin() );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE( vesting_balance_create_test )
 { try {
    INVOKE( create_uia );
@@ -2490,6 +3256,79 @@ BOOST_AUTO_TEST_CASE( vesting_balance_withdraw_test )
    // TODO:  Test with non-core asset and Bob account
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE( vesting_balance_withdraw_all_test )
+{ try {
+   // required for head block time
+   generate_block();
+
+   const asset_object& core = asset_id_type()(db);
+
+   const account_object& alice_account = create_account( "alice" );
+   const account_object& bob_account = create_account( "bob" );
+   transfer( genesis_account(db), alice_account, core.amount( 1000000 ) );
+
+   auto create_vbo = [&]( account_id_type owner, asset amount, uint32_t elapsed_seconds ) -> vesting_balance_id_type
+   {
+      transaction tx;
+
+      vesting_balance_create_operation create_op;
+      create_op.fee = core.amount( 0 );
+      create_op.creator = alice_account.id;
+      create_op.owner = owner;
+      create_op.amount = amount;
+      create_op.vesting_seconds = 1000;
+      tx.operations.push_back( create_op );
+
+      processed_transaction ptx = db.push_transaction( tx, ~0 );
+      vesting_balance_id_type id( ptx.operation_results[0].get<object_id_type>() );
+
+      // HACK:  Move the creation record into the past, as vesting_balance_withdraw_test does
+      db.modify( id(db), [&]( vesting_balance_object& _vbo )
+      {
+         _vbo.policy.get<cdd_vesting_policy>().coin_seconds_earned_last_update -= elapsed_seconds;
+      } );
+      return id;
+   };
+
+   vesting_balance_id_type half_vested  = create_vbo( alice_account.id, core.amount( 10000 ), 500 );
+   vesting_balance_id_type bobs         = create_vbo( bob_account.id,   core.amount( 10000 ), 1000 );
+   vesting_balance_id_type fully_vested = create_vbo( alice_account.id, core.amount( 10000 ), 1000 );
+   vesting_balance_id_type unvested     = create_vbo( alice_account.id, core.amount( 10000 ), 0 );
+   BOOST_CHECK_EQUAL( db.get_balance( alice_account, core ).amount.value, 960000 );
+
+   // The owner index lists an account's vesting balances, in order of creation
+   const auto& by_owner = db.get_index_type<vesting_balance_index>().indices().get<by_account>();
+   vector<vesting_balance_id_type> alices;
+   for( auto itr = by_owner.lower_bound( alice_account.id ); itr != by_owner.upper_bound( alice_account.id ); ++itr )
+      alices.push_back( itr->id );
+   BOOST_REQUIRE_EQUAL( alices.size(), 3 );
+   BOOST_CHECK( alices[0] == half_vested );
+   BOOST_CHECK( alices[1] == fully_vested );
+   BOOST_CHECK( alices[2] == unvested );
+
+   vesting_balance_withdraw_all_operation op;
+   op.fee = core.amount( 0 );
+   op.owner = alice_account.id;
+   op.asset_type = core.id;
+   REQUIRE_OP_VALIDATION_SUCCESS( op, fee, core.amount(  0 ) );
+   REQUIRE_OP_VALIDATION_FAILURE( op, fee, core.amount( -1 ) );
+
+   trx.clear();
+   trx.operations.push_back( op );
+   processed_transaction ptx = db.push_transaction( trx, ~0 );
+   BOOST_CHECK( ptx.operation_results[0].get<asset>() == core.amount( 15000 ) );
+   BOOST_CHECK_EQUAL( db.get_balance( alice_account, core ).amount.value, 975000 );
+   BOOST_CHECK_EQUAL( half_vested(db).balance.amount.value, 5000 );
+   BOOST_CHECK_EQUAL( fully_vested(db).balance.amount.value, 0 );
+   BOOST_CHECK_EQUAL( unvested(db).balance.amount.value, 10000 );
+   BOOST_CHECK_EQUAL( bobs(db).balance.amount.value, 10000 );
+
+   // Everything which had vested has been withdrawn
+   trx.clear();
+   trx.operations.push_back( op );
+   BOOST_REQUIRE_THROW( db.push_transaction( trx, ~0 ), fc::exception );
+} FC_LOG_AND_RETHROW() }
+
 // TODO:  Write linear VBO tests
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -385,6 +385,36 @@ BOOST_AUTO_TEST_CASE( mia_feeds )
    }
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE( mia_feed_expiration )
+{ try {
+   ACTOR(dan);
+   const asset_object& bit_usd = create_bitasset("BITUSD");
+   const asset_bitasset_data_object& bitasset = bit_usd.bitasset_data(db);
+   const uint32_t block_interval = db.get_global_properties().parameters.block_interval;
+
+   price_feed feed;
+   feed.call_limit = price(asset(GRAPHENE_BLOCKCHAIN_PRECISION),bit_usd.amount(30));
+   feed.short_limit = ~price(asset(GRAPHENE_BLOCKCHAIN_PRECISION),bit_usd.amount(10));
+   db.modify(bitasset, [&](asset_bitasset_data_object& a) {
+      a.options.feed_lifetime_sec = 12 * block_interval;
+      a.feeds[dan_id] = make_pair(db.head_block_time(), feed);
+      a.update_median_feeds(db.head_block_time());
+   });
+   const fc::time_point_sec expiration = bitasset.feed_expiration_time();
+   BOOST_CHECK(expiration == db.head_block_time() + 12 * block_interval);
+
+   generate_blocks(expiration - block_interval);
+   BOOST_REQUIRE(db.head_block_time() < expiration);
+   BOOST_CHECK(bitasset.current_feed == feed);
+   BOOST_CHECK(bitasset.feed_expiration_time() == expiration);
+
+   // The feed expires in the first block after its lifetime, even when no block is produced at the expiration
+   generate_block(~0, generate_private_key("genesis"), 1);
+   BOOST_CHECK(db.head_block_time() > expiration);
+   BOOST_CHECK(bitasset.current_feed == price_feed());
+   BOOST_CHECK(bitasset.feed_expiration_time() > db.head_block_time());
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE( witness_create )
 { try {
    ACTOR(nathan);
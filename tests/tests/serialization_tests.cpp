@@ -22,6 +22,10 @@
 #include <graphene/chain/operations.hpp>
 
 #include <graphene/chain/key_object.hpp>
+#include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/operation_history_object.hpp>
+
+#include <graphene/app/json_writer.hpp>
 
 #include <fc/crypto/digest.hpp>
 #include <fc/reflect/variant.hpp>
@@ -73,6 +77,33 @@ BOOST_AUTO_TEST_CASE( json_tests )
    }
 }
 
+BOOST_AUTO_TEST_CASE( json_writer_matches_variant )
+{
+   try {
+      ACTOR(alice);
+      transfer( genesis_account, alice_id, asset(1000) );
+      signed_block b = generate_block();
+
+      BOOST_CHECK_EQUAL( graphene::app::to_json_string( b ), fc::json::to_string( fc::variant( b ) ) );
+      BOOST_CHECK_EQUAL( graphene::app::to_json_string( alice_id(db) ), fc::json::to_string( fc::variant( alice_id(db) ) ) );
+      BOOST_CHECK_EQUAL( graphene::app::to_json_string( asset_id_type()(db) ),
+                         fc::json::to_string( fc::variant( asset_id_type()(db) ) ) );
+      BOOST_CHECK_EQUAL( graphene::app::to_json_string( db.get_global_properties() ),
+                         fc::json::to_string( fc::variant( db.get_global_properties() ) ) );
+
+      operation_history_object oh( b.transactions.front().operations.front() );
+      oh.result = b.transactions.front().operation_results.front();
+      oh.block_num = b.block_num();
+      BOOST_CHECK_EQUAL( graphene::app::to_json_string( oh ), fc::json::to_string( fc::variant( oh ) ) );
+
+      optional<signed_block> none;
+      BOOST_CHECK_EQUAL( graphene::app::to_json_string( none ), fc::json::to_string( fc::variant( none ) ) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 
 
 BOOST_AUTO_TEST_SUITE_END()